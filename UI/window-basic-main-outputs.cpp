@@ -938,6 +938,8 @@ bool SimpleOutput::ConfigureRecording(bool updateReplayBuffer)
 		config_get_int(main->Config(), "SimpleOutput", "RecRBTime");
 	int rbSize =
 		config_get_int(main->Config(), "SimpleOutput", "RecRBSize");
+	bool rbDisk = config_get_bool(main->Config(), "SimpleOutput",
+				      "RecRBDiskBuffer");
 
 	string f;
 	string strPath;
@@ -955,6 +957,7 @@ bool SimpleOutput::ConfigureRecording(bool updateReplayBuffer)
 		obs_data_set_int(settings, "max_time_sec", rbTime);
 		obs_data_set_int(settings, "max_size_mb",
 				 usingRecordingPreset ? rbSize : 0);
+		obs_data_set_bool(settings, "use_disk_buffer", rbDisk);
 	} else {
 		f = GetFormatString(filenameFormat, nullptr, nullptr);
 		strPath = GetRecordingFilename(path,
@@ -1786,6 +1789,8 @@ bool AdvancedOutput::StartReplayBuffer()
 					     "RecRBSuffix");
 		rbTime = config_get_int(main->Config(), "AdvOut", "RecRBTime");
 		rbSize = config_get_int(main->Config(), "AdvOut", "RecRBSize");
+		bool rbDisk = config_get_bool(main->Config(), "AdvOut",
+					      "RecRBDiskBuffer");
 
 		string f = GetFormatString(filenameFormat, rbPrefix, rbSuffix);
 		string strPath = GetOutputFilename(
@@ -1800,6 +1805,7 @@ bool AdvancedOutput::StartReplayBuffer()
 		obs_data_set_int(settings, "max_time_sec", rbTime);
 		obs_data_set_int(settings, "max_size_mb",
 				 usesBitrate ? 0 : rbSize);
+		obs_data_set_bool(settings, "use_disk_buffer", rbDisk);
 
 		obs_output_update(replayBuffer, settings);
 
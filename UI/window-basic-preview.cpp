@@ -106,28 +106,13 @@ static bool FindItemAtPos(obs_scene_t *scene, obs_sceneitem_t *item,
 			  void *param)
 {
 	SceneFindData *data = reinterpret_cast<SceneFindData *>(param);
-	matrix4 transform;
-	matrix4 invTransform;
-	vec3 transformedPos;
-	vec3 pos3;
-	vec3 pos3_;
 
 	if (!SceneItemHasVideo(item))
 		return true;
 	if (obs_sceneitem_locked(item))
 		return true;
 
-	vec3_set(&pos3, data->pos.x, data->pos.y, 0.0f);
-
-	obs_sceneitem_get_box_transform(item, &transform);
-
-	matrix4_inv(&invTransform, &transform);
-	vec3_transform(&transformedPos, &pos3, &invTransform);
-	vec3_transform(&pos3_, &transformedPos, &transform);
-
-	if (CloseFloat(pos3.x, pos3_.x) && CloseFloat(pos3.y, pos3_.y) &&
-	    transformedPos.x >= 0.0f && transformedPos.x <= 1.0f &&
-	    transformedPos.y >= 0.0f && transformedPos.y <= 1.0f) {
+	if (obs_sceneitem_hit_test(item, &data->pos)) {
 		if (data->selectBelow && obs_sceneitem_selected(item)) {
 			if (data->item)
 				return false;
@@ -335,6 +335,51 @@ static void mp_media_next_audio(mp_media_t *m)
 	m->a_cb(m->opaque, &audio);
 }
 
+/* scales or copies the decoded frame into a frame from v_acquire_cb and
+ * hands it to v_cb, skipping the intermediate scale buffer and the copy
+ * obs_source_output_video would make */
+static void mp_media_output_acquired(mp_media_t *m,
+				     const struct obs_source_frame *info)
+{
+	AVFrame *f = m->v.frame;
+	struct obs_source_frame *frame;
+	int linesize[4];
+
+	frame = m->v_acquire_cb(m->opaque, info->format, info->width,
+				info->height, m->cur_range);
+	if (!frame)
+		return;
+
+	for (size_t i = 0; i < 4; i++)
+		linesize[i] = (int)frame->linesize[i];
+
+	if (m->swscale) {
+		int ret = sws_scale(m->swscale, (const uint8_t *const *)f->data,
+				    f->linesize, 0, f->height, frame->data,
+				    linesize);
+		if (ret < 0) {
+			m->v_release_cb(m->opaque, frame);
+			return;
+		}
+	} else {
+		/* negative (bottom-up) source strides come out top-down */
+		av_image_copy(frame->data, linesize,
+			      (const uint8_t **)f->data, f->linesize,
+			      (enum AVPixelFormat)f->format, f->width,
+			      f->height);
+	}
+
+	memcpy(frame->color_matrix, info->color_matrix,
+	       sizeof(frame->color_matrix));
+	memcpy(frame->color_range_min, info->color_range_min,
+	       sizeof(frame->color_range_min));
+	memcpy(frame->color_range_max, info->color_range_max,
+	       sizeof(frame->color_range_max));
+	frame->timestamp = info->timestamp;
+
+	m->v_cb(m->opaque, frame);
+}
+
 static void mp_media_next_video(mp_media_t *m, bool preload)
 {
 	struct mp_decode *d = &m->v;
@@ -343,6 +388,7 @@ static void mp_media_next_video(mp_media_t *m, bool preload)
 	enum video_colorspace new_space;
 	enum video_range_type new_range;
 	AVFrame *f = d->frame;
+	bool acquire = !preload && m->v_acquire_cb;
 
 	if (!preload) {
 		if (!mp_media_can_play_frame(m, d))
@@ -357,7 +403,8 @@ static void mp_media_next_video(mp_media_t *m, bool preload)
 	}
 
 	bool flip = false;
-	if (m->swscale) {
+	/* acquired frames are scaled straight into their own planes */
+	if (m->swscale && !acquire) {
 		int ret = sws_scale(m->swscale, (const uint8_t *const *)f->data,
 				    f->linesize, 0, f->height, m->scale_pic,
 				    m->scale_linesizes);
@@ -433,6 +480,8 @@ static void mp_media_next_video(mp_media_t *m, bool preload)
 		} else {
 			m->v_preload_cb(m->opaque, frame);
 		}
+	} else if (acquire) {
+		mp_media_output_acquired(m, frame);
 	} else {
 		m->v_cb(m->opaque, frame);
 	}
@@ -806,6 +855,8 @@ bool mp_media_init(mp_media_t *media, const struct mp_media_info *info)
 	pthread_mutex_init_value(&media->mutex);
 	media->opaque = info->opaque;
 	media->v_cb = info->v_cb;
+	media->v_acquire_cb = info->v_release_cb ? info->v_acquire_cb : NULL;
+	media->v_release_cb = info->v_release_cb;
 	media->a_cb = info->a_cb;
 	media->stop_cb = info->stop_cb;
 	media->v_seek_cb = info->v_seek_cb;
@@ -39,6 +39,9 @@ extern "C" {
 #endif
 
 typedef void (*mp_video_cb)(void *opaque, struct obs_source_frame *frame);
+typedef struct obs_source_frame *(*mp_video_acquire_cb)(
+	void *opaque, enum video_format format, uint32_t width,
+	uint32_t height, enum video_range_type range);
 typedef void (*mp_audio_cb)(void *opaque, struct obs_source_audio *audio);
 typedef void (*mp_stop_cb)(void *opaque);
 
@@ -49,6 +52,8 @@ struct mp_media {
 	mp_video_cb v_seek_cb;
 	mp_stop_cb stop_cb;
 	mp_video_cb v_cb;
+	mp_video_acquire_cb v_acquire_cb;
+	mp_video_cb v_release_cb;
 	mp_audio_cb a_cb;
 	void *opaque;
 
@@ -115,6 +120,12 @@ struct mp_media_info {
 	mp_audio_cb a_cb;
 	mp_stop_cb stop_cb;
 
+	/* optional: if set, playing frames are decoded or scaled straight into
+	 * frames from v_acquire_cb, and v_cb takes ownership of them.  frames
+	 * that could not be filled go back through v_release_cb */
+	mp_video_acquire_cb v_acquire_cb;
+	mp_video_cb v_release_cb;
+
 	const char *path;
 	const char *format;
 	int buffering;
@@ -0,0 +1,1041 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <math.h>
+#include <graphics/vec2.h>
+#include <graphics/vec3.h>
+#include "null-subsystem.h"
+
+/* per-draw state: shader parameters are resolved once per draw call rather
+ * than once per pixel */
+struct null_draw {
+	gs_device_t *device;
+	gs_texture_t *target;
+	int min_x, min_y, max_x, max_y;
+	struct gs_rect viewport;
+	struct matrix4 viewproj;
+
+	null_vertex_shader_t vs;
+	null_pixel_shader_t ps;
+
+	const struct gs_texture *image[4];
+	const gs_samplerstate_t *sampler[4];
+
+	struct vec4 color;
+	struct vec4 color_vec[3];
+	struct vec3 color_range_min;
+	struct vec3 color_range_max;
+	struct vec4 randomvals[3];
+	struct vec2 scale;
+	bool has_scale;
+	float width;
+	float height;
+	float width_i;
+	float width_d2;
+	float height_d2;
+};
+
+/* a single pixel: x/y are the pixel center in render target space, u/v span
+ * the viewport from 0 to 1, t/color are the interpolated vertex attributes */
+struct null_fragment {
+	float x, y;
+	float u, v;
+	struct vec4 t;
+	struct vec4 color;
+};
+
+/* ------------------------------------------------------------------------- */
+/* shader helpers */
+
+static inline void sample(const struct null_draw *d, size_t idx, float u,
+			  float v, struct vec4 *out)
+{
+	if (d->image[idx])
+		null_texture_sample(d->image[idx], d->sampler[idx], u, v, out);
+	else
+		vec4_zero(out);
+}
+
+static inline void load(const struct null_draw *d, size_t idx, float x,
+			float y, struct vec4 *out)
+{
+	if (d->image[idx])
+		null_texel_load(d->image[idx], (int)x, (int)y, out);
+	else
+		vec4_zero(out);
+}
+
+static inline float dot_rgb(const struct vec4 *vec, const struct vec4 *rgb)
+{
+	return vec->x * rgb->x + vec->y * rgb->y + vec->z * rgb->z + vec->w;
+}
+
+static inline float saturate(float val)
+{
+	return val < 0.0f ? 0.0f : (val > 1.0f ? 1.0f : val);
+}
+
+static inline float clampf(float val, float min_val, float max_val)
+{
+	return val < min_val ? min_val : (val > max_val ? max_val : val);
+}
+
+static void yuv_to_rgb(const struct null_draw *d, float y, float u, float v,
+		       float alpha, struct vec4 *out)
+{
+	struct vec4 yuv;
+
+	vec4_set(&yuv, clampf(y, d->color_range_min.x, d->color_range_max.x),
+		 clampf(u, d->color_range_min.y, d->color_range_max.y),
+		 clampf(v, d->color_range_min.z, d->color_range_max.z), 0.0f);
+
+	vec4_set(out, dot_rgb(&d->color_vec[0], &yuv),
+		 dot_rgb(&d->color_vec[1], &yuv),
+		 dot_rgb(&d->color_vec[2], &yuv), alpha);
+}
+
+static inline float expand_limited(float val)
+{
+	return (255.0f / 219.0f) * val - (16.0f / 219.0f);
+}
+
+/* ------------------------------------------------------------------------- */
+/* vertex shaders: transform the interpolated varyings of a fragment */
+
+static void vs_default(const struct null_draw *d, struct null_fragment *f)
+{
+	/* repeat.effect scales the texture coordinates in its VSDefault */
+	if (d->has_scale) {
+		f->t.x *= d->scale.x;
+		f->t.y *= d->scale.y;
+	}
+}
+
+static void vs_tex_pos_left(const struct null_draw *d, struct null_fragment *f)
+{
+	vec4_set(&f->t, f->u - d->width_i, f->u, f->v, 0.0f);
+}
+
+static void vs_tex_pos_half_reverse(const struct null_draw *d,
+				    struct null_fragment *f)
+{
+	vec4_set(&f->t, d->width_d2 * f->u, d->height * f->v, 0.0f, 0.0f);
+}
+
+static void vs_tex_pos_half_half_reverse(const struct null_draw *d,
+					 struct null_fragment *f)
+{
+	vec4_set(&f->t, d->width_d2 * f->u, d->height_d2 * f->v, 0.0f, 0.0f);
+}
+
+static void vs_pos_wide_reverse(const struct null_draw *d,
+				struct null_fragment *f)
+{
+	vec4_set(&f->t, d->width * f->u, d->width_d2 * f->u, d->height * f->v,
+		 0.0f);
+}
+
+/* ------------------------------------------------------------------------- */
+/* default.effect, opaque.effect, premultiplied_alpha.effect, solid.effect */
+
+static void ps_draw_bare(const struct null_draw *d,
+			 const struct null_fragment *f, struct vec4 *out)
+{
+	sample(d, 0, f->t.x, f->t.y, out);
+}
+
+static void ps_draw_alpha_divide(const struct null_draw *d,
+				 const struct null_fragment *f,
+				 struct vec4 *out)
+{
+	sample(d, 0, f->t.x, f->t.y, out);
+
+	float multiplier = out->w > 0.0f ? 1.0f / out->w : 0.0f;
+	out->x *= multiplier;
+	out->y *= multiplier;
+	out->z *= multiplier;
+}
+
+static void ps_draw_opaque(const struct null_draw *d,
+			   const struct null_fragment *f, struct vec4 *out)
+{
+	sample(d, 0, f->t.x, f->t.y, out);
+	out->w = 1.0f;
+}
+
+static void ps_draw_premultiplied(const struct null_draw *d,
+				  const struct null_fragment *f,
+				  struct vec4 *out)
+{
+	sample(d, 0, f->t.x, f->t.y, out);
+
+	if (out->w > 0.0f) {
+		out->x /= out->w;
+		out->y /= out->w;
+		out->z /= out->w;
+	}
+
+	for (size_t i = 0; i < 4; i++)
+		out->ptr[i] = saturate(out->ptr[i]);
+}
+
+static void ps_solid(const struct null_draw *d, const struct null_fragment *f,
+		     struct vec4 *out)
+{
+	UNUSED_PARAMETER(f);
+	*out = d->color;
+}
+
+static void ps_solid_colored(const struct null_draw *d,
+			     const struct null_fragment *f, struct vec4 *out)
+{
+	vec4_mul(out, &f->color, &d->color);
+}
+
+static inline float rand_val(const struct null_fragment *f,
+			     const struct vec4 *rand_vals)
+{
+	float val = sinf(f->x * rand_vals->x + f->y * rand_vals->y) *
+		    rand_vals->z;
+	return 0.5f + 0.5f * (val - floorf(val));
+}
+
+static void ps_random(const struct null_draw *d, const struct null_fragment *f,
+		      struct vec4 *out)
+{
+	vec4_set(out, rand_val(f, &d->randomvals[0]),
+		 rand_val(f, &d->randomvals[1]),
+		 rand_val(f, &d->randomvals[2]), 1.0f);
+}
+
+/* ------------------------------------------------------------------------- */
+/* format_conversion.effect, RGB to YUV */
+
+static void ps_y(const struct null_draw *d, const struct null_fragment *f,
+		 struct vec4 *out)
+{
+	struct vec4 rgb;
+	load(d, 0, f->x, f->y, &rgb);
+	vec4_set(out, dot_rgb(&d->color_vec[0], &rgb), 0.0f, 0.0f, 1.0f);
+}
+
+static void ps_u(const struct null_draw *d, const struct null_fragment *f,
+		 struct vec4 *out)
+{
+	struct vec4 rgb;
+	load(d, 0, f->x, f->y, &rgb);
+	vec4_set(out, dot_rgb(&d->color_vec[1], &rgb), 0.0f, 0.0f, 1.0f);
+}
+
+static void ps_v(const struct null_draw *d, const struct null_fragment *f,
+		 struct vec4 *out)
+{
+	struct vec4 rgb;
+	load(d, 0, f->x, f->y, &rgb);
+	vec4_set(out, dot_rgb(&d->color_vec[2], &rgb), 0.0f, 0.0f, 1.0f);
+}
+
+static inline void sample_wide(const struct null_draw *d,
+			       const struct null_fragment *f, struct vec4 *rgb)
+{
+	struct vec4 left, right;
+
+	sample(d, 0, f->t.x, f->t.z, &left);
+	sample(d, 0, f->t.y, f->t.z, &right);
+	vec4_add(rgb, &left, &right);
+	vec4_mulf(rgb, rgb, 0.5f);
+	rgb->w = 0.0f;
+}
+
+static void ps_uv_wide(const struct null_draw *d,
+		       const struct null_fragment *f, struct vec4 *out)
+{
+	struct vec4 rgb;
+	sample_wide(d, f, &rgb);
+	vec4_set(out, dot_rgb(&d->color_vec[1], &rgb),
+		 dot_rgb(&d->color_vec[2], &rgb), 0.0f, 1.0f);
+}
+
+static void ps_u_wide(const struct null_draw *d,
+		      const struct null_fragment *f, struct vec4 *out)
+{
+	struct vec4 rgb;
+	sample_wide(d, f, &rgb);
+	vec4_set(out, dot_rgb(&d->color_vec[1], &rgb), 0.0f, 0.0f, 1.0f);
+}
+
+static void ps_v_wide(const struct null_draw *d,
+		      const struct null_fragment *f, struct vec4 *out)
+{
+	struct vec4 rgb;
+	sample_wide(d, f, &rgb);
+	vec4_set(out, dot_rgb(&d->color_vec[2], &rgb), 0.0f, 0.0f, 1.0f);
+}
+
+/* ------------------------------------------------------------------------- */
+/* format_conversion.effect, YUV to RGB */
+
+enum packed_order { PACKED_UYVY, PACKED_YUY2, PACKED_YVYU };
+
+static inline void packed_reverse(const struct null_draw *d,
+				  const struct null_fragment *f,
+				  enum packed_order order, struct vec4 *out)
+{
+	struct vec4 p;
+	float y0, y1, cb, cr;
+	bool left = (f->t.x - floorf(f->t.x)) < 0.5f;
+
+	load(d, 0, f->t.x, f->t.y, &p);
+
+	if (order == PACKED_UYVY) {
+		y0 = p.y;
+		y1 = p.w;
+		cb = p.z;
+		cr = p.x;
+	} else {
+		y0 = p.z;
+		y1 = p.x;
+		cb = order == PACKED_YUY2 ? p.y : p.w;
+		cr = order == PACKED_YUY2 ? p.w : p.y;
+	}
+
+	yuv_to_rgb(d, left ? y0 : y1, cb, cr, 1.0f, out);
+}
+
+static void ps_uyvy_reverse(const struct null_draw *d,
+			    const struct null_fragment *f, struct vec4 *out)
+{
+	packed_reverse(d, f, PACKED_UYVY, out);
+}
+
+static void ps_yuy2_reverse(const struct null_draw *d,
+			    const struct null_fragment *f, struct vec4 *out)
+{
+	packed_reverse(d, f, PACKED_YUY2, out);
+}
+
+static void ps_yvyu_reverse(const struct null_draw *d,
+			    const struct null_fragment *f, struct vec4 *out)
+{
+	packed_reverse(d, f, PACKED_YVYU, out);
+}
+
+static inline void planar_reverse(const struct null_draw *d, float luma_x,
+				  float luma_y, float chroma_x, float chroma_y,
+				  bool has_alpha, struct vec4 *out)
+{
+	struct vec4 y, cb, cr, a;
+
+	load(d, 0, luma_x, luma_y, &y);
+	load(d, 1, chroma_x, chroma_y, &cb);
+	load(d, 2, chroma_x, chroma_y, &cr);
+
+	if (has_alpha)
+		load(d, 3, luma_x, luma_y, &a);
+	else
+		a.x = 1.0f;
+
+	yuv_to_rgb(d, y.x, cb.x, cr.x, a.x, out);
+}
+
+static void ps_planar420_reverse(const struct null_draw *d,
+				 const struct null_fragment *f,
+				 struct vec4 *out)
+{
+	planar_reverse(d, f->x, f->y, f->t.x, f->t.y, false, out);
+}
+
+static void ps_planar420a_reverse(const struct null_draw *d,
+				  const struct null_fragment *f,
+				  struct vec4 *out)
+{
+	planar_reverse(d, f->x, f->y, f->t.x, f->t.y, true, out);
+}
+
+static void ps_planar422_reverse(const struct null_draw *d,
+				 const struct null_fragment *f,
+				 struct vec4 *out)
+{
+	planar_reverse(d, f->t.x, f->t.z, f->t.y, f->t.z, false, out);
+}
+
+static void ps_planar422a_reverse(const struct null_draw *d,
+				  const struct null_fragment *f,
+				  struct vec4 *out)
+{
+	planar_reverse(d, f->t.x, f->t.z, f->t.y, f->t.z, true, out);
+}
+
+static void ps_planar444_reverse(const struct null_draw *d,
+				 const struct null_fragment *f,
+				 struct vec4 *out)
+{
+	planar_reverse(d, f->x, f->y, f->x, f->y, false, out);
+}
+
+static void ps_planar444a_reverse(const struct null_draw *d,
+				  const struct null_fragment *f,
+				  struct vec4 *out)
+{
+	planar_reverse(d, f->x, f->y, f->x, f->y, true, out);
+}
+
+static void ps_ayuv_reverse(const struct null_draw *d,
+			    const struct null_fragment *f, struct vec4 *out)
+{
+	struct vec4 yuva;
+	load(d, 0, f->x, f->y, &yuva);
+	yuv_to_rgb(d, yuva.x, yuva.y, yuva.z, yuva.w, out);
+}
+
+static void ps_nv12_reverse(const struct null_draw *d,
+			    const struct null_fragment *f, struct vec4 *out)
+{
+	struct vec4 y, cbcr;
+
+	load(d, 0, f->x, f->y, &y);
+	load(d, 1, f->t.x, f->t.y, &cbcr);
+	yuv_to_rgb(d, y.x, cbcr.x, cbcr.y, 1.0f, out);
+}
+
+static void ps_y800_limited(const struct null_draw *d,
+			    const struct null_fragment *f, struct vec4 *out)
+{
+	struct vec4 y;
+	float full;
+
+	load(d, 0, f->x, f->y, &y);
+	full = expand_limited(y.x);
+	vec4_set(out, full, full, full, 1.0f);
+}
+
+static void ps_y800_full(const struct null_draw *d,
+			 const struct null_fragment *f, struct vec4 *out)
+{
+	struct vec4 y;
+
+	load(d, 0, f->x, f->y, &y);
+	vec4_set(out, y.x, y.x, y.x, 1.0f);
+}
+
+static void ps_rgb_limited(const struct null_draw *d,
+			   const struct null_fragment *f, struct vec4 *out)
+{
+	load(d, 0, f->x, f->y, out);
+	out->x = expand_limited(out->x);
+	out->y = expand_limited(out->y);
+	out->z = expand_limited(out->z);
+}
+
+static inline void bgr3(const struct null_draw *d,
+			const struct null_fragment *f, struct vec4 *out)
+{
+	float x = f->x * 3.0f;
+	struct vec4 b, g, r;
+
+	load(d, 0, x - 1.0f, f->y, &b);
+	load(d, 0, x, f->y, &g);
+	load(d, 0, x + 1.0f, f->y, &r);
+	vec4_set(out, r.x, g.x, b.x, 1.0f);
+}
+
+static void ps_bgr3_limited(const struct null_draw *d,
+			    const struct null_fragment *f, struct vec4 *out)
+{
+	bgr3(d, f, out);
+	out->x = expand_limited(out->x);
+	out->y = expand_limited(out->y);
+	out->z = expand_limited(out->z);
+}
+
+static void ps_bgr3_full(const struct null_draw *d,
+			 const struct null_fragment *f, struct vec4 *out)
+{
+	bgr3(d, f, out);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const struct {
+	const char *entry;
+	null_vertex_shader_t func;
+} vertex_shaders[] = {
+	{"VSDefault", vs_default},
+	{"VSTexPos_Left", vs_tex_pos_left},
+	{"VSTexPosHalf_Reverse", vs_tex_pos_half_reverse},
+	{"VSTexPosHalfHalf_Reverse", vs_tex_pos_half_half_reverse},
+	{"VSPosWide_Reverse", vs_pos_wide_reverse},
+};
+
+/* entries with a file name only match shaders from that effect file */
+static const struct {
+	const char *file;
+	const char *entry;
+	null_pixel_shader_t func;
+} pixel_shaders[] = {
+	{NULL, "PSDrawBare", ps_draw_bare},
+	{NULL, "PSDrawAlphaDivide", ps_draw_alpha_divide},
+	{"premultiplied_alpha.effect", "PSDraw", ps_draw_premultiplied},
+	{"opaque.effect", "PSDraw", ps_draw_opaque},
+	{NULL, "PSSolid", ps_solid},
+	{NULL, "PSSolidColored", ps_solid_colored},
+	{NULL, "PSRandom", ps_random},
+	{NULL, "PS_Y", ps_y},
+	{NULL, "PS_U", ps_u},
+	{NULL, "PS_V", ps_v},
+	{NULL, "PS_UV_Wide", ps_uv_wide},
+	{NULL, "PS_U_Wide", ps_u_wide},
+	{NULL, "PS_V_Wide", ps_v_wide},
+	{NULL, "PSUYVY_Reverse", ps_uyvy_reverse},
+	{NULL, "PSYUY2_Reverse", ps_yuy2_reverse},
+	{NULL, "PSYVYU_Reverse", ps_yvyu_reverse},
+	{NULL, "PSPlanar420_Reverse", ps_planar420_reverse},
+	{NULL, "PSPlanar420A_Reverse", ps_planar420a_reverse},
+	{NULL, "PSPlanar422_Reverse", ps_planar422_reverse},
+	{NULL, "PSPlanar422A_Reverse", ps_planar422a_reverse},
+	{NULL, "PSPlanar444_Reverse", ps_planar444_reverse},
+	{NULL, "PSPlanar444A_Reverse", ps_planar444a_reverse},
+	{NULL, "PSAYUV_Reverse", ps_ayuv_reverse},
+	{NULL, "PSNV12_Reverse", ps_nv12_reverse},
+	{NULL, "PSY800_Limited", ps_y800_limited},
+	{NULL, "PSY800_Full", ps_y800_full},
+	{NULL, "PSRGB_Limited", ps_rgb_limited},
+	{NULL, "PSBGR3_Limited", ps_bgr3_limited},
+	{NULL, "PSBGR3_Full", ps_bgr3_full},
+};
+
+null_vertex_shader_t null_find_vertex_shader(const char *entry)
+{
+	if (!entry)
+		return NULL;
+
+	for (size_t i = 0; i < sizeof(vertex_shaders) / sizeof(*vertex_shaders);
+	     i++) {
+		if (strcmp(vertex_shaders[i].entry, entry) == 0)
+			return vertex_shaders[i].func;
+	}
+
+	return NULL;
+}
+
+static inline bool ends_with(const char *str, const char *suffix)
+{
+	size_t len = strlen(str);
+	size_t suffix_len = strlen(suffix);
+	return len >= suffix_len &&
+	       strcmp(str + len - suffix_len, suffix) == 0;
+}
+
+null_pixel_shader_t null_find_pixel_shader(const char *file, const char *entry)
+{
+	if (!entry)
+		return ps_draw_bare;
+
+	for (size_t i = 0; i < sizeof(pixel_shaders) / sizeof(*pixel_shaders);
+	     i++) {
+		if (strcmp(pixel_shaders[i].entry, entry) != 0)
+			continue;
+		if (pixel_shaders[i].file &&
+		    (!file || !strstr(file, pixel_shaders[i].file)))
+			continue;
+
+		return pixel_shaders[i].func;
+	}
+
+	/* scale filters (bicubic, lanczos, area, ...) are approximated with
+	 * a bilinear sample */
+	blog(LOG_DEBUG,
+	     "Software renderer: no implementation of pixel shader "
+	     "'%s' (%s), drawing its texture instead",
+	     entry, file ? file : "unknown");
+
+	return ends_with(entry, "Divide") ? ps_draw_alpha_divide
+					  : ps_draw_bare;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static gs_sparam_t *find_param(const struct null_draw *d, const char *name)
+{
+	gs_shader_t *ps = d->device->cur_pixel_shader;
+	gs_shader_t *vs = d->device->cur_vertex_shader;
+	gs_sparam_t *param = gs_shader_get_param_by_name(ps, name);
+
+	if (!param && vs)
+		param = gs_shader_get_param_by_name(vs, name);
+	return param;
+}
+
+static void get_floats(const struct null_draw *d, const char *name,
+		       float *out, size_t count)
+{
+	gs_sparam_t *param = find_param(d, name);
+
+	if (param && param->cur_value.num >= count * sizeof(float))
+		memcpy(out, param->cur_value.array, count * sizeof(float));
+}
+
+static void get_images(struct null_draw *d)
+{
+	static const char *names[] = {"image", "image1", "image2", "image3"};
+	gs_shader_t *ps = d->device->cur_pixel_shader;
+	gs_samplerstate_t *shader_sampler =
+		ps->samplers.num ? ps->samplers.array[0] : NULL;
+
+	for (size_t i = 0; i < 4; i++) {
+		gs_sparam_t *param = gs_shader_get_param_by_name(ps, names[i]);
+		const gs_samplerstate_t *sampler = NULL;
+
+		d->image[i] = param ? param->texture : NULL;
+
+		if (param && param->next_sampler)
+			sampler = param->next_sampler;
+		else if (shader_sampler)
+			sampler = shader_sampler;
+		else if (d->device->cur_samplers[i])
+			sampler = d->device->cur_samplers[i];
+		else
+			sampler = d->device->default_sampler;
+
+		d->sampler[i] = sampler;
+	}
+}
+
+static bool setup_draw(gs_device_t *device, struct null_draw *d)
+{
+	gs_texture_t *target = device->cur_render_target;
+	struct gs_rect vp = device->cur_viewport;
+
+	memset(d, 0, sizeof(*d));
+	d->device = device;
+	d->target = target;
+
+	if (vp.cx <= 0 || vp.cy <= 0) {
+		vp.x = 0;
+		vp.y = 0;
+		vp.cx = (int)target->width;
+		vp.cy = (int)target->height;
+	}
+
+	d->viewport = vp;
+	d->min_x = vp.x > 0 ? vp.x : 0;
+	d->min_y = vp.y > 0 ? vp.y : 0;
+	d->max_x = vp.x + vp.cx;
+	d->max_y = vp.y + vp.cy;
+	if (d->max_x > (int)target->width)
+		d->max_x = (int)target->width;
+	if (d->max_y > (int)target->height)
+		d->max_y = (int)target->height;
+
+	if (device->scissor_enabled) {
+		const struct gs_rect *sr = &device->cur_scissor;
+		if (sr->x > d->min_x)
+			d->min_x = sr->x;
+		if (sr->y > d->min_y)
+			d->min_y = sr->y;
+		if (sr->x + sr->cx < d->max_x)
+			d->max_x = sr->x + sr->cx;
+		if (sr->y + sr->cy < d->max_y)
+			d->max_y = sr->y + sr->cy;
+	}
+
+	if (d->min_x >= d->max_x || d->min_y >= d->max_y)
+		return false;
+
+	d->viewproj = device->cur_viewproj;
+	d->vs = device->cur_vertex_shader->vertex_func;
+	d->ps = device->cur_pixel_shader->pixel_func;
+
+	get_images(d);
+
+	vec4_set(&d->color, 1.0f, 1.0f, 1.0f, 1.0f);
+	vec3_set(&d->color_range_min, 0.0f, 0.0f, 0.0f);
+	vec3_set(&d->color_range_max, 1.0f, 1.0f, 1.0f);
+
+	get_floats(d, "color", d->color.ptr, 4);
+	get_floats(d, "color_vec0", d->color_vec[0].ptr, 4);
+	get_floats(d, "color_vec1", d->color_vec[1].ptr, 4);
+	get_floats(d, "color_vec2", d->color_vec[2].ptr, 4);
+	get_floats(d, "color_range_min", d->color_range_min.ptr, 3);
+	get_floats(d, "color_range_max", d->color_range_max.ptr, 3);
+	get_floats(d, "randomvals1", d->randomvals[0].ptr, 4);
+	get_floats(d, "randomvals2", d->randomvals[1].ptr, 4);
+	get_floats(d, "randomvals3", d->randomvals[2].ptr, 4);
+	get_floats(d, "width", &d->width, 1);
+	get_floats(d, "height", &d->height, 1);
+	get_floats(d, "width_i", &d->width_i, 1);
+	get_floats(d, "width_d2", &d->width_d2, 1);
+	get_floats(d, "height_d2", &d->height_d2, 1);
+
+	d->has_scale = find_param(d, "scale") != NULL;
+	vec2_set(&d->scale, 1.0f, 1.0f);
+	get_floats(d, "scale", d->scale.ptr, 2);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline float blend_factor(enum gs_blend_type type,
+				 const struct vec4 *src,
+				 const struct vec4 *dst, size_t c)
+{
+	switch (type) {
+	case GS_BLEND_ZERO:
+		return 0.0f;
+	case GS_BLEND_ONE:
+		return 1.0f;
+	case GS_BLEND_SRCCOLOR:
+		return src->ptr[c];
+	case GS_BLEND_INVSRCCOLOR:
+		return 1.0f - src->ptr[c];
+	case GS_BLEND_SRCALPHA:
+		return src->w;
+	case GS_BLEND_INVSRCALPHA:
+		return 1.0f - src->w;
+	case GS_BLEND_DSTCOLOR:
+		return dst->ptr[c];
+	case GS_BLEND_INVDSTCOLOR:
+		return 1.0f - dst->ptr[c];
+	case GS_BLEND_DSTALPHA:
+		return dst->w;
+	case GS_BLEND_INVDSTALPHA:
+		return 1.0f - dst->w;
+	case GS_BLEND_SRCALPHASAT:
+		if (c == 3)
+			return 1.0f;
+		return src->w < 1.0f - dst->w ? src->w : 1.0f - dst->w;
+	}
+
+	return 1.0f;
+}
+
+static void write_pixel(const struct null_draw *d, int x, int y,
+			struct vec4 *src)
+{
+	gs_device_t *device = d->device;
+	bool masked = !device->write_mask[0] || !device->write_mask[1] ||
+		      !device->write_mask[2] || !device->write_mask[3];
+	struct vec4 dst;
+
+	if (!device->blend_enabled && !masked) {
+		null_texel_store(d->target, x, y, src);
+		return;
+	}
+
+	null_texel_load(d->target, x, y, &dst);
+
+	for (size_t c = 0; c < 4; c++)
+		src->ptr[c] = saturate(src->ptr[c]);
+
+	if (device->blend_enabled) {
+		struct vec4 out;
+		for (size_t c = 0; c < 4; c++) {
+			enum gs_blend_type sf = c < 3 ? device->blend_src_c
+						      : device->blend_src_a;
+			enum gs_blend_type df = c < 3 ? device->blend_dest_c
+						      : device->blend_dest_a;
+			out.ptr[c] = src->ptr[c] *
+					     blend_factor(sf, src, &dst, c) +
+				     dst.ptr[c] *
+					     blend_factor(df, src, &dst, c);
+		}
+		*src = out;
+	}
+
+	for (size_t c = 0; c < 4; c++)
+		if (!device->write_mask[c])
+			src->ptr[c] = dst.ptr[c];
+
+	null_texel_store(d->target, x, y, src);
+}
+
+static inline void shade(const struct null_draw *d, struct null_fragment *f,
+			 int x, int y)
+{
+	struct vec4 out;
+
+	f->x = (float)x + 0.5f;
+	f->y = (float)y + 0.5f;
+	f->u = (f->x - (float)d->viewport.x) / (float)d->viewport.cx;
+	f->v = (f->y - (float)d->viewport.y) / (float)d->viewport.cy;
+
+	if (d->vs)
+		d->vs(d, f);
+
+	d->ps(d, f, &out);
+	write_pixel(d, x, y, &out);
+}
+
+/* the conversion effects draw a full-screen triangle generated from the
+ * vertex ID, so every pixel of the viewport is covered */
+static void draw_fullscreen(const struct null_draw *d)
+{
+	struct null_fragment f = {0};
+
+	for (int y = d->min_y; y < d->max_y; y++) {
+		for (int x = d->min_x; x < d->max_x; x++) {
+			vec4_zero(&f.t);
+			shade(d, &f, x, y);
+		}
+	}
+}
+
+struct null_vertex {
+	float x, y;
+	struct vec4 t;
+	struct vec4 color;
+};
+
+static void get_vertex(const struct null_draw *d, const struct gs_vb_data *vb,
+		       size_t idx, struct null_vertex *vert)
+{
+	struct vec4 pos;
+
+	vec4_set(&pos, vb->points[idx].x, vb->points[idx].y,
+		 vb->points[idx].z, 1.0f);
+	vec4_transform(&pos, &pos, &d->viewproj);
+
+	if (pos.w != 0.0f && pos.w != 1.0f) {
+		pos.x /= pos.w;
+		pos.y /= pos.w;
+	}
+
+	vert->x = (float)d->viewport.x +
+		  (pos.x + 1.0f) * 0.5f * (float)d->viewport.cx;
+	vert->y = (float)d->viewport.y +
+		  (1.0f - pos.y) * 0.5f * (float)d->viewport.cy;
+
+	vec4_zero(&vert->t);
+	if (vb->num_tex && vb->tvarray[0].array) {
+		size_t width = vb->tvarray[0].width;
+		const float *uv = (const float *)vb->tvarray[0].array;
+
+		if (width > 4)
+			width = 4;
+		memcpy(vert->t.ptr, uv + idx * vb->tvarray[0].width,
+		       width * sizeof(float));
+	}
+
+	if (vb->colors) {
+		uint32_t c = vb->colors[idx];
+		vec4_set(&vert->color, (float)(c & 0xFF) / 255.0f,
+			 (float)((c >> 8) & 0xFF) / 255.0f,
+			 (float)((c >> 16) & 0xFF) / 255.0f,
+			 (float)(c >> 24) / 255.0f);
+	} else {
+		vec4_set(&vert->color, 1.0f, 1.0f, 1.0f, 1.0f);
+	}
+}
+
+static inline float edge(const struct null_vertex *a,
+			 const struct null_vertex *b, float x, float y)
+{
+	return (b->x - a->x) * (y - a->y) - (b->y - a->y) * (x - a->x);
+}
+
+/* top-left fill rule, so that the shared edge of two triangles is only drawn
+ * once (which matters when blending) */
+static inline bool is_top_left(const struct null_vertex *a,
+			       const struct null_vertex *b)
+{
+	float dx = b->x - a->x;
+	float dy = b->y - a->y;
+	return (dy == 0.0f && dx > 0.0f) || dy < 0.0f;
+}
+
+static void draw_triangle(const struct null_draw *d,
+			  const struct null_vertex *v0,
+			  const struct null_vertex *v1,
+			  const struct null_vertex *v2)
+{
+	float area = edge(v0, v1, v2->x, v2->y);
+	struct null_fragment f = {0};
+
+	if (area == 0.0f)
+		return;
+
+	/* rasterize both windings the same way */
+	if (area < 0.0f) {
+		const struct null_vertex *tmp = v1;
+		v1 = v2;
+		v2 = tmp;
+		area = -area;
+	}
+
+	float min_xf = fminf(v0->x, fminf(v1->x, v2->x));
+	float max_xf = fmaxf(v0->x, fmaxf(v1->x, v2->x));
+	float min_yf = fminf(v0->y, fminf(v1->y, v2->y));
+	float max_yf = fmaxf(v0->y, fmaxf(v1->y, v2->y));
+
+	int min_x = (int)floorf(min_xf);
+	int max_x = (int)ceilf(max_xf);
+	int min_y = (int)floorf(min_yf);
+	int max_y = (int)ceilf(max_yf);
+
+	if (min_x < d->min_x)
+		min_x = d->min_x;
+	if (min_y < d->min_y)
+		min_y = d->min_y;
+	if (max_x > d->max_x)
+		max_x = d->max_x;
+	if (max_y > d->max_y)
+		max_y = d->max_y;
+
+	bool tl0 = is_top_left(v1, v2);
+	bool tl1 = is_top_left(v2, v0);
+	bool tl2 = is_top_left(v0, v1);
+	float inv_area = 1.0f / area;
+
+	for (int y = min_y; y < max_y; y++) {
+		float py = (float)y + 0.5f;
+
+		for (int x = min_x; x < max_x; x++) {
+			float px = (float)x + 0.5f;
+			float w0 = edge(v1, v2, px, py);
+			float w1 = edge(v2, v0, px, py);
+			float w2 = edge(v0, v1, px, py);
+
+			if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+				continue;
+			if ((w0 == 0.0f && !tl0) || (w1 == 0.0f && !tl1) ||
+			    (w2 == 0.0f && !tl2))
+				continue;
+
+			w0 *= inv_area;
+			w1 *= inv_area;
+			w2 *= inv_area;
+
+			for (size_t i = 0; i < 4; i++) {
+				f.t.ptr[i] = v0->t.ptr[i] * w0 +
+					     v1->t.ptr[i] * w1 +
+					     v2->t.ptr[i] * w2;
+				f.color.ptr[i] = v0->color.ptr[i] * w0 +
+						 v1->color.ptr[i] * w1 +
+						 v2->color.ptr[i] * w2;
+			}
+
+			shade(d, &f, x, y);
+		}
+	}
+}
+
+static inline size_t get_index(const gs_indexbuffer_t *ib, size_t i)
+{
+	if (!ib)
+		return i;
+	if (ib->type == GS_UNSIGNED_LONG)
+		return ((const uint32_t *)ib->data)[i];
+	return ((const uint16_t *)ib->data)[i];
+}
+
+static void draw_triangles(const struct null_draw *d,
+			   enum gs_draw_mode draw_mode, uint32_t start_vert,
+			   uint32_t num_verts)
+{
+	const gs_indexbuffer_t *ib = d->device->cur_index_buffer;
+	const struct gs_vb_data *vb = d->device->cur_vertex_buffer->data;
+	struct null_vertex verts[3];
+	size_t count = num_verts;
+	size_t max_idx = ib ? ib->num : vb->num;
+
+	if (!count)
+		count = max_idx - start_vert;
+	if (start_vert + count > max_idx)
+		count = max_idx > start_vert ? max_idx - start_vert : 0;
+
+	if (draw_mode == GS_TRIS) {
+		for (size_t i = 0; i + 3 <= count; i += 3) {
+			for (size_t j = 0; j < 3; j++)
+				get_vertex(d, vb,
+					   get_index(ib, start_vert + i + j),
+					   &verts[j]);
+			draw_triangle(d, &verts[0], &verts[1], &verts[2]);
+		}
+
+	} else if (draw_mode == GS_TRISTRIP) {
+		for (size_t i = 0; i + 3 <= count; i++) {
+			for (size_t j = 0; j < 3; j++)
+				get_vertex(d, vb,
+					   get_index(ib, start_vert + i + j),
+					   &verts[j]);
+			draw_triangle(d, &verts[0], &verts[1], &verts[2]);
+		}
+	}
+}
+
+static void update_viewproj_matrix(gs_device_t *device)
+{
+	struct gs_shader *vs = device->cur_vertex_shader;
+	struct matrix4 viewproj;
+
+	gs_matrix_get(&device->cur_view);
+	matrix4_mul(&device->cur_viewproj, &device->cur_view,
+		    &device->cur_proj);
+
+	if (vs->viewproj) {
+		matrix4_transpose(&viewproj, &device->cur_viewproj);
+		gs_shader_set_matrix4(vs->viewproj, &viewproj);
+	}
+}
+
+void device_draw(gs_device_t *device, enum gs_draw_mode draw_mode,
+		 uint32_t start_vert, uint32_t num_verts)
+{
+	gs_effect_t *effect = gs_get_effect();
+	struct null_draw draw;
+
+	if (!device->cur_render_target || !device->cur_vertex_shader ||
+	    !device->cur_pixel_shader) {
+		blog(LOG_ERROR, "device_draw (software): no render target "
+				"or shaders loaded");
+		return;
+	}
+
+	if (effect)
+		gs_effect_update_params(effect);
+
+	update_viewproj_matrix(device);
+
+	if (!setup_draw(device, &draw))
+		return;
+
+	if (device->cur_vertex_shader->vertex_id || !device->cur_vertex_buffer)
+		draw_fullscreen(&draw);
+	else
+		draw_triangles(&draw, draw_mode, start_vert, num_verts);
+}
+
+void device_clear(gs_device_t *device, uint32_t clear_flags,
+		  const struct vec4 *color, float depth, uint8_t stencil)
+{
+	gs_texture_t *target = device->cur_render_target;
+
+	UNUSED_PARAMETER(depth);
+	UNUSED_PARAMETER(stencil);
+
+	if (!(clear_flags & GS_CLEAR_COLOR) || !target)
+		return;
+
+	/* store the color once, then replicate it across the target */
+	uint32_t bpp = target->bytes_per_pixel;
+	uint32_t row_size = target->width * bpp;
+
+	null_texel_store(target, 0, 0, color);
+	for (uint32_t x = 1; x < target->width; x++)
+		memcpy(target->data + x * bpp, target->data, bpp);
+	for (uint32_t y = 1; y < target->height; y++)
+		memcpy(target->data + (size_t)y * target->linesize,
+		       target->data, row_size);
+}
@@ -0,0 +1,197 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+/*
+ *   Software (CPU-only) graphics subsystem.  Textures live in system memory
+ * and draws are rasterized on the calling thread.  Shaders are not compiled;
+ * instead, the entry point of each shader is looked up in a table of C
+ * implementations of the built-in effects (see null-draw.c).  Unknown pixel
+ * shaders fall back to sampling their "image" texture.
+ */
+
+#include <util/darray.h>
+#include <util/threading.h>
+#include <graphics/graphics.h>
+#include <graphics/device-exports.h>
+#include <graphics/matrix4.h>
+
+struct gs_sampler_state {
+	gs_device_t *device;
+	volatile long ref;
+	struct gs_sampler_info info;
+};
+
+static inline void samplerstate_addref(gs_samplerstate_t *ss)
+{
+	os_atomic_inc_long(&ss->ref);
+}
+
+static inline void samplerstate_release(gs_samplerstate_t *ss)
+{
+	if (os_atomic_dec_long(&ss->ref) == 0)
+		bfree(ss);
+}
+
+struct gs_texture {
+	gs_device_t *device;
+	enum gs_texture_type type;
+	enum gs_color_format format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t bytes_per_pixel;
+	uint32_t linesize;
+	bool is_dynamic;
+	bool is_render_target;
+	uint8_t *data;
+};
+
+struct gs_stage_surface {
+	gs_device_t *device;
+	enum gs_color_format format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t bytes_per_pixel;
+	uint32_t linesize;
+	uint8_t *data;
+};
+
+struct gs_zstencil_buffer {
+	gs_device_t *device;
+	enum gs_zstencil_format format;
+	uint32_t width;
+	uint32_t height;
+};
+
+struct gs_vertex_buffer {
+	gs_device_t *device;
+	struct gs_vb_data *data;
+	bool dynamic;
+};
+
+struct gs_index_buffer {
+	gs_device_t *device;
+	enum gs_index_type type;
+	void *data;
+	size_t num;
+	size_t width;
+	bool dynamic;
+};
+
+struct gs_shader_param {
+	enum gs_shader_param_type type;
+	char *name;
+	gs_shader_t *shader;
+	gs_samplerstate_t *next_sampler;
+	int array_count;
+
+	struct gs_texture *texture;
+
+	DARRAY(uint8_t) cur_value;
+	DARRAY(uint8_t) def_value;
+};
+
+struct null_draw;
+struct null_fragment;
+
+typedef void (*null_vertex_shader_t)(const struct null_draw *draw,
+				     struct null_fragment *frag);
+typedef void (*null_pixel_shader_t)(const struct null_draw *draw,
+				    const struct null_fragment *frag,
+				    struct vec4 *out);
+
+struct gs_shader {
+	gs_device_t *device;
+	enum gs_shader_type type;
+	char *entry;
+	bool vertex_id;
+
+	gs_sparam_t *viewproj;
+	gs_sparam_t *world;
+
+	DARRAY(struct gs_shader_param) params;
+	DARRAY(gs_samplerstate_t *) samplers;
+
+	null_vertex_shader_t vertex_func;
+	null_pixel_shader_t pixel_func;
+};
+
+struct gs_swap_chain {
+	gs_device_t *device;
+	struct gs_init_data info;
+	gs_texture_t *target;
+};
+
+struct gs_timer {
+	gs_device_t *device;
+	uint64_t begin;
+	uint64_t end;
+};
+
+struct gs_timer_range {
+	gs_device_t *device;
+};
+
+struct gs_device {
+	gs_texture_t *cur_render_target;
+	gs_zstencil_t *cur_zstencil_buffer;
+	gs_texture_t *cur_textures[GS_MAX_TEXTURES];
+	gs_samplerstate_t *cur_samplers[GS_MAX_TEXTURES];
+	gs_vertbuffer_t *cur_vertex_buffer;
+	gs_indexbuffer_t *cur_index_buffer;
+	gs_shader_t *cur_vertex_shader;
+	gs_shader_t *cur_pixel_shader;
+	gs_swapchain_t *cur_swap;
+
+	gs_samplerstate_t *default_sampler;
+
+	enum gs_cull_mode cur_cull_mode;
+	struct gs_rect cur_viewport;
+	struct gs_rect cur_scissor;
+	bool scissor_enabled;
+
+	bool blend_enabled;
+	enum gs_blend_type blend_src_c;
+	enum gs_blend_type blend_dest_c;
+	enum gs_blend_type blend_src_a;
+	enum gs_blend_type blend_dest_a;
+	bool write_mask[4];
+
+	struct matrix4 cur_proj;
+	struct matrix4 cur_view;
+	struct matrix4 cur_viewproj;
+
+	DARRAY(struct matrix4) proj_stack;
+};
+
+/* ------------------------------------------------------------------------- */
+/* texel access, null-texture.c */
+
+extern uint32_t null_format_bytes(enum gs_color_format format);
+extern void null_texel_load(const struct gs_texture *tex, int x, int y,
+			    struct vec4 *out);
+extern void null_texel_store(struct gs_texture *tex, int x, int y,
+			     const struct vec4 *val);
+extern void null_texture_sample(const struct gs_texture *tex,
+				const gs_samplerstate_t *sampler, float u,
+				float v, struct vec4 *out);
+
+/* ------------------------------------------------------------------------- */
+/* shader tables, null-draw.c */
+
+extern null_vertex_shader_t null_find_vertex_shader(const char *entry);
+extern null_pixel_shader_t null_find_pixel_shader(const char *file,
+						  const char *entry);
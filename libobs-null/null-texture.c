@@ -0,0 +1,678 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <math.h>
+#include "null-subsystem.h"
+
+uint32_t null_format_bytes(enum gs_color_format format)
+{
+	switch (format) {
+	case GS_DXT1:
+	case GS_DXT3:
+	case GS_DXT5:
+		/* block compressed formats are not decoded, but are given
+		 * enough room to be stored uncompressed */
+		return 4;
+	default:
+		return gs_get_format_bpp(format) / 8;
+	}
+}
+
+static inline float half_to_float(uint16_t h)
+{
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exp = (h >> 10) & 0x1F;
+	uint32_t mant = h & 0x3FF;
+	union {
+		uint32_t u;
+		float f;
+	} val;
+
+	if (exp == 0) {
+		float f = ldexpf((float)mant, -24);
+		return sign ? -f : f;
+	} else if (exp == 31) {
+		val.u = sign | 0x7F800000 | (mant << 13);
+	} else {
+		val.u = sign | ((exp + 112) << 23) | (mant << 13);
+	}
+
+	return val.f;
+}
+
+static inline uint16_t float_to_half(float f)
+{
+	union {
+		float f;
+		uint32_t u;
+	} val = {.f = f};
+	uint16_t sign = (uint16_t)((val.u >> 16) & 0x8000);
+	int exp = (int)((val.u >> 23) & 0xFF) - 112;
+	uint32_t mant = val.u & 0x7FFFFF;
+
+	if (exp <= 0)
+		return sign;
+	if (exp >= 31)
+		return sign | 0x7C00;
+
+	return sign | (uint16_t)(exp << 10) | (uint16_t)(mant >> 13);
+}
+
+static inline float unorm8(uint8_t val)
+{
+	return (float)val / 255.0f;
+}
+
+static inline float unorm16(uint16_t val)
+{
+	return (float)val / 65535.0f;
+}
+
+static inline uint32_t to_unorm(float val, uint32_t max)
+{
+	if (!(val > 0.0f))
+		return 0;
+	if (val >= 1.0f)
+		return max;
+	return (uint32_t)(val * (float)max + 0.5f);
+}
+
+void null_texel_load(const struct gs_texture *tex, int x, int y,
+		     struct vec4 *out)
+{
+	const uint8_t *p;
+
+	vec4_set(out, 0.0f, 0.0f, 0.0f, 1.0f);
+
+	if (x < 0 || y < 0 || (uint32_t)x >= tex->width ||
+	    (uint32_t)y >= tex->height)
+		return;
+
+	p = tex->data + (size_t)y * tex->linesize +
+	    (size_t)x * tex->bytes_per_pixel;
+
+	switch (tex->format) {
+	case GS_A8:
+		vec4_set(out, 0.0f, 0.0f, 0.0f, unorm8(p[0]));
+		break;
+	case GS_R8:
+		out->x = unorm8(p[0]);
+		break;
+	case GS_R8G8:
+		out->x = unorm8(p[0]);
+		out->y = unorm8(p[1]);
+		break;
+	case GS_RGBA:
+		vec4_set(out, unorm8(p[0]), unorm8(p[1]), unorm8(p[2]),
+			 unorm8(p[3]));
+		break;
+	case GS_BGRA:
+		vec4_set(out, unorm8(p[2]), unorm8(p[1]), unorm8(p[0]),
+			 unorm8(p[3]));
+		break;
+	case GS_BGRX:
+		vec4_set(out, unorm8(p[2]), unorm8(p[1]), unorm8(p[0]), 1.0f);
+		break;
+	case GS_R10G10B10A2: {
+		uint32_t val = *(const uint32_t *)p;
+		vec4_set(out, (float)(val & 0x3FF) / 1023.0f,
+			 (float)((val >> 10) & 0x3FF) / 1023.0f,
+			 (float)((val >> 20) & 0x3FF) / 1023.0f,
+			 (float)(val >> 30) / 3.0f);
+		break;
+	}
+	case GS_RGBA16: {
+		const uint16_t *c = (const uint16_t *)p;
+		vec4_set(out, unorm16(c[0]), unorm16(c[1]), unorm16(c[2]),
+			 unorm16(c[3]));
+		break;
+	}
+	case GS_R16:
+		out->x = unorm16(*(const uint16_t *)p);
+		break;
+	case GS_RGBA16F: {
+		const uint16_t *c = (const uint16_t *)p;
+		vec4_set(out, half_to_float(c[0]), half_to_float(c[1]),
+			 half_to_float(c[2]), half_to_float(c[3]));
+		break;
+	}
+	case GS_RG16F: {
+		const uint16_t *c = (const uint16_t *)p;
+		out->x = half_to_float(c[0]);
+		out->y = half_to_float(c[1]);
+		break;
+	}
+	case GS_R16F:
+		out->x = half_to_float(*(const uint16_t *)p);
+		break;
+	case GS_RGBA32F:
+		memcpy(out->ptr, p, sizeof(float) * 4);
+		break;
+	case GS_RG32F:
+		memcpy(out->ptr, p, sizeof(float) * 2);
+		break;
+	case GS_R32F:
+		memcpy(out->ptr, p, sizeof(float));
+		break;
+	case GS_DXT1:
+	case GS_DXT3:
+	case GS_DXT5:
+	case GS_UNKNOWN:
+		break;
+	}
+}
+
+void null_texel_store(struct gs_texture *tex, int x, int y,
+		      const struct vec4 *val)
+{
+	uint8_t *p;
+
+	if (x < 0 || y < 0 || (uint32_t)x >= tex->width ||
+	    (uint32_t)y >= tex->height)
+		return;
+
+	p = tex->data + (size_t)y * tex->linesize +
+	    (size_t)x * tex->bytes_per_pixel;
+
+	switch (tex->format) {
+	case GS_A8:
+		p[0] = (uint8_t)to_unorm(val->w, 255);
+		break;
+	case GS_R8:
+		p[0] = (uint8_t)to_unorm(val->x, 255);
+		break;
+	case GS_R8G8:
+		p[0] = (uint8_t)to_unorm(val->x, 255);
+		p[1] = (uint8_t)to_unorm(val->y, 255);
+		break;
+	case GS_RGBA:
+		p[0] = (uint8_t)to_unorm(val->x, 255);
+		p[1] = (uint8_t)to_unorm(val->y, 255);
+		p[2] = (uint8_t)to_unorm(val->z, 255);
+		p[3] = (uint8_t)to_unorm(val->w, 255);
+		break;
+	case GS_BGRA:
+	case GS_BGRX:
+		p[0] = (uint8_t)to_unorm(val->z, 255);
+		p[1] = (uint8_t)to_unorm(val->y, 255);
+		p[2] = (uint8_t)to_unorm(val->x, 255);
+		p[3] = (uint8_t)to_unorm(val->w, 255);
+		break;
+	case GS_R10G10B10A2:
+		*(uint32_t *)p = to_unorm(val->x, 1023) |
+				 (to_unorm(val->y, 1023) << 10) |
+				 (to_unorm(val->z, 1023) << 20) |
+				 (to_unorm(val->w, 3) << 30);
+		break;
+	case GS_RGBA16: {
+		uint16_t *c = (uint16_t *)p;
+		for (size_t i = 0; i < 4; i++)
+			c[i] = (uint16_t)to_unorm(val->ptr[i], 65535);
+		break;
+	}
+	case GS_R16:
+		*(uint16_t *)p = (uint16_t)to_unorm(val->x, 65535);
+		break;
+	case GS_RGBA16F: {
+		uint16_t *c = (uint16_t *)p;
+		for (size_t i = 0; i < 4; i++)
+			c[i] = float_to_half(val->ptr[i]);
+		break;
+	}
+	case GS_RG16F: {
+		uint16_t *c = (uint16_t *)p;
+		c[0] = float_to_half(val->x);
+		c[1] = float_to_half(val->y);
+		break;
+	}
+	case GS_R16F:
+		*(uint16_t *)p = float_to_half(val->x);
+		break;
+	case GS_RGBA32F:
+		memcpy(p, val->ptr, sizeof(float) * 4);
+		break;
+	case GS_RG32F:
+		memcpy(p, val->ptr, sizeof(float) * 2);
+		break;
+	case GS_R32F:
+		memcpy(p, val->ptr, sizeof(float));
+		break;
+	case GS_DXT1:
+	case GS_DXT3:
+	case GS_DXT5:
+	case GS_UNKNOWN:
+		break;
+	}
+}
+
+/* returns false if the coordinate falls on the border color */
+static inline bool address(enum gs_address_mode mode, int *coord, int size)
+{
+	int c = *coord;
+
+	switch (mode) {
+	case GS_ADDRESS_WRAP:
+		c %= size;
+		if (c < 0)
+			c += size;
+		break;
+	case GS_ADDRESS_MIRROR: {
+		int period = size * 2;
+		c %= period;
+		if (c < 0)
+			c += period;
+		if (c >= size)
+			c = period - 1 - c;
+		break;
+	}
+	case GS_ADDRESS_MIRRORONCE:
+		if (c < 0)
+			c = -c - 1;
+		if (c >= size)
+			c = size - 1;
+		break;
+	case GS_ADDRESS_BORDER:
+		if (c < 0 || c >= size)
+			return false;
+		break;
+	case GS_ADDRESS_CLAMP:
+	default:
+		if (c < 0)
+			c = 0;
+		else if (c >= size)
+			c = size - 1;
+	}
+
+	*coord = c;
+	return true;
+}
+
+static inline void fetch(const struct gs_texture *tex,
+			 const struct gs_sampler_info *info, int x, int y,
+			 struct vec4 *out)
+{
+	if (address(info->address_u, &x, (int)tex->width) &&
+	    address(info->address_v, &y, (int)tex->height)) {
+		null_texel_load(tex, x, y, out);
+	} else {
+		uint32_t c = info->border_color;
+		vec4_set(out, unorm8((c >> 16) & 0xFF), unorm8((c >> 8) & 0xFF),
+			 unorm8(c & 0xFF), unorm8(c >> 24));
+	}
+}
+
+static inline bool is_point_filter(enum gs_sample_filter filter)
+{
+	return filter == GS_FILTER_POINT ||
+	       filter == GS_FILTER_MIN_MAG_POINT_MIP_LINEAR ||
+	       filter == GS_FILTER_MIN_LINEAR_MAG_MIP_POINT;
+}
+
+void null_texture_sample(const struct gs_texture *tex,
+			 const gs_samplerstate_t *sampler, float u, float v,
+			 struct vec4 *out)
+{
+	const struct gs_sampler_info *info = &sampler->info;
+	float x = u * (float)tex->width;
+	float y = v * (float)tex->height;
+
+	if (!tex->data) {
+		vec4_zero(out);
+		return;
+	}
+
+	if (is_point_filter(info->filter)) {
+		fetch(tex, info, (int)floorf(x), (int)floorf(y), out);
+		return;
+	}
+
+	x -= 0.5f;
+	y -= 0.5f;
+
+	float fx = floorf(x);
+	float fy = floorf(y);
+	float ax = x - fx;
+	float ay = y - fy;
+	int x0 = (int)fx;
+	int y0 = (int)fy;
+	struct vec4 t00, t10, t01, t11;
+
+	fetch(tex, info, x0, y0, &t00);
+	fetch(tex, info, x0 + 1, y0, &t10);
+	fetch(tex, info, x0, y0 + 1, &t01);
+	fetch(tex, info, x0 + 1, y0 + 1, &t11);
+
+	for (size_t i = 0; i < 4; i++) {
+		float top = t00.ptr[i] + (t10.ptr[i] - t00.ptr[i]) * ax;
+		float bottom = t01.ptr[i] + (t11.ptr[i] - t01.ptr[i]) * ax;
+		out->ptr[i] = top + (bottom - top) * ay;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void texture_upload(gs_texture_t *tex, const uint8_t *data)
+{
+	uint32_t row_size = tex->width * tex->bytes_per_pixel;
+
+	for (uint32_t y = 0; y < tex->height; y++)
+		memcpy(tex->data + (size_t)y * tex->linesize,
+		       data + (size_t)y * row_size, row_size);
+}
+
+gs_texture_t *device_texture_create(gs_device_t *device, uint32_t width,
+				    uint32_t height,
+				    enum gs_color_format color_format,
+				    uint32_t levels, const uint8_t **data,
+				    uint32_t flags)
+{
+	struct gs_texture *tex;
+
+	if (!width || !height || !null_format_bytes(color_format)) {
+		blog(LOG_ERROR, "device_texture_create (software): invalid "
+				"texture size or format");
+		return NULL;
+	}
+
+	tex = bzalloc(sizeof(struct gs_texture));
+	tex->device = device;
+	tex->type = GS_TEXTURE_2D;
+	tex->format = color_format;
+	tex->width = width;
+	tex->height = height;
+	tex->bytes_per_pixel = null_format_bytes(color_format);
+	tex->linesize = (width * tex->bytes_per_pixel + 31) & ~31;
+	tex->is_dynamic = (flags & GS_DYNAMIC) != 0;
+	tex->is_render_target = (flags & GS_RENDER_TARGET) != 0;
+	tex->data = bzalloc((size_t)tex->linesize * height);
+
+	if (data && data[0] && color_format != GS_DXT1 &&
+	    color_format != GS_DXT3 && color_format != GS_DXT5)
+		texture_upload(tex, data[0]);
+
+	UNUSED_PARAMETER(levels);
+	return tex;
+}
+
+gs_texture_t *device_cubetexture_create(gs_device_t *device, uint32_t size,
+					enum gs_color_format color_format,
+					uint32_t levels, const uint8_t **data,
+					uint32_t flags)
+{
+	blog(LOG_WARNING, "device_cubetexture_create (software): "
+			  "cube textures are not supported");
+
+	UNUSED_PARAMETER(device);
+	UNUSED_PARAMETER(size);
+	UNUSED_PARAMETER(color_format);
+	UNUSED_PARAMETER(levels);
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(flags);
+	return NULL;
+}
+
+gs_texture_t *device_voltexture_create(gs_device_t *device, uint32_t width,
+				       uint32_t height, uint32_t depth,
+				       enum gs_color_format color_format,
+				       uint32_t levels,
+				       const uint8_t *const *data,
+				       uint32_t flags)
+{
+	blog(LOG_WARNING, "device_voltexture_create (software): "
+			  "volume textures are not supported");
+
+	UNUSED_PARAMETER(device);
+	UNUSED_PARAMETER(width);
+	UNUSED_PARAMETER(height);
+	UNUSED_PARAMETER(depth);
+	UNUSED_PARAMETER(color_format);
+	UNUSED_PARAMETER(levels);
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(flags);
+	return NULL;
+}
+
+enum gs_texture_type device_get_texture_type(const gs_texture_t *texture)
+{
+	return texture->type;
+}
+
+void gs_texture_destroy(gs_texture_t *tex)
+{
+	if (!tex)
+		return;
+
+	bfree(tex->data);
+	bfree(tex);
+}
+
+uint32_t gs_texture_get_width(const gs_texture_t *tex)
+{
+	return tex->width;
+}
+
+uint32_t gs_texture_get_height(const gs_texture_t *tex)
+{
+	return tex->height;
+}
+
+enum gs_color_format gs_texture_get_color_format(const gs_texture_t *tex)
+{
+	return tex->format;
+}
+
+bool gs_texture_map(gs_texture_t *tex, uint8_t **ptr, uint32_t *linesize)
+{
+	*ptr = tex->data;
+	*linesize = tex->linesize;
+	return true;
+}
+
+void gs_texture_unmap(gs_texture_t *tex)
+{
+	UNUSED_PARAMETER(tex);
+}
+
+bool gs_texture_is_rect(const gs_texture_t *tex)
+{
+	UNUSED_PARAMETER(tex);
+	return false;
+}
+
+void *gs_texture_get_obj(gs_texture_t *tex)
+{
+	return tex->data;
+}
+
+void gs_cubetexture_destroy(gs_texture_t *cubetex)
+{
+	gs_texture_destroy(cubetex);
+}
+
+uint32_t gs_cubetexture_get_size(const gs_texture_t *cubetex)
+{
+	return cubetex->width;
+}
+
+enum gs_color_format
+gs_cubetexture_get_color_format(const gs_texture_t *cubetex)
+{
+	return cubetex->format;
+}
+
+void gs_voltexture_destroy(gs_texture_t *voltex)
+{
+	gs_texture_destroy(voltex);
+}
+
+uint32_t gs_voltexture_get_width(const gs_texture_t *voltex)
+{
+	return voltex->width;
+}
+
+uint32_t gs_voltexture_get_height(const gs_texture_t *voltex)
+{
+	return voltex->height;
+}
+
+uint32_t gs_voltexture_get_depth(const gs_texture_t *voltex)
+{
+	UNUSED_PARAMETER(voltex);
+	return 1;
+}
+
+enum gs_color_format gs_voltexture_get_color_format(const gs_texture_t *voltex)
+{
+	return voltex->format;
+}
+
+/* ------------------------------------------------------------------------- */
+
+gs_stagesurf_t *device_stagesurface_create(gs_device_t *device, uint32_t width,
+					   uint32_t height,
+					   enum gs_color_format color_format)
+{
+	struct gs_stage_surface *surf;
+
+	if (!width || !height || !null_format_bytes(color_format)) {
+		blog(LOG_ERROR, "device_stagesurface_create (software): "
+				"invalid surface size or format");
+		return NULL;
+	}
+
+	surf = bzalloc(sizeof(struct gs_stage_surface));
+	surf->device = device;
+	surf->format = color_format;
+	surf->width = width;
+	surf->height = height;
+	surf->bytes_per_pixel = null_format_bytes(color_format);
+	surf->linesize = (width * surf->bytes_per_pixel + 31) & ~31;
+	surf->data = bzalloc((size_t)surf->linesize * height);
+	return surf;
+}
+
+void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
+			  gs_texture_t *src)
+{
+	uint32_t row_size;
+
+	if (!src || !dst) {
+		blog(LOG_ERROR, "device_stage_texture (software): "
+				"NULL source or destination");
+		return;
+	}
+
+	if (src->format != dst->format || src->width != dst->width ||
+	    src->height != dst->height) {
+		blog(LOG_ERROR, "device_stage_texture (software): source and "
+				"destination must match in size and format");
+		return;
+	}
+
+	row_size = src->width * src->bytes_per_pixel;
+	for (uint32_t y = 0; y < src->height; y++)
+		memcpy(dst->data + (size_t)y * dst->linesize,
+		       src->data + (size_t)y * src->linesize, row_size);
+
+	UNUSED_PARAMETER(device);
+}
+
+void gs_stagesurface_destroy(gs_stagesurf_t *stagesurf)
+{
+	if (!stagesurf)
+		return;
+
+	bfree(stagesurf->data);
+	bfree(stagesurf);
+}
+
+uint32_t gs_stagesurface_get_width(const gs_stagesurf_t *stagesurf)
+{
+	return stagesurf->width;
+}
+
+uint32_t gs_stagesurface_get_height(const gs_stagesurf_t *stagesurf)
+{
+	return stagesurf->height;
+}
+
+enum gs_color_format
+gs_stagesurface_get_color_format(const gs_stagesurf_t *stagesurf)
+{
+	return stagesurf->format;
+}
+
+bool gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
+			 uint32_t *linesize)
+{
+	*data = stagesurf->data;
+	*linesize = stagesurf->linesize;
+	return true;
+}
+
+void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
+{
+	UNUSED_PARAMETER(stagesurf);
+}
+
+/* ------------------------------------------------------------------------- */
+
+gs_zstencil_t *device_zstencil_create(gs_device_t *device, uint32_t width,
+				      uint32_t height,
+				      enum gs_zstencil_format format)
+{
+	struct gs_zstencil_buffer *zs;
+
+	zs = bzalloc(sizeof(struct gs_zstencil_buffer));
+	zs->device = device;
+	zs->format = format;
+	zs->width = width;
+	zs->height = height;
+	return zs;
+}
+
+void gs_zstencil_destroy(gs_zstencil_t *zstencil)
+{
+	bfree(zstencil);
+}
+
+/* ------------------------------------------------------------------------- */
+
+gs_samplerstate_t *
+device_samplerstate_create(gs_device_t *device,
+			   const struct gs_sampler_info *info)
+{
+	struct gs_sampler_state *sampler;
+
+	sampler = bzalloc(sizeof(struct gs_sampler_state));
+	sampler->device = device;
+	sampler->ref = 1;
+	sampler->info = *info;
+	return sampler;
+}
+
+void gs_samplerstate_destroy(gs_samplerstate_t *samplerstate)
+{
+	if (!samplerstate)
+		return;
+
+	if (samplerstate->device)
+		for (int i = 0; i < GS_MAX_TEXTURES; i++)
+			if (samplerstate->device->cur_samplers[i] ==
+			    samplerstate)
+				samplerstate->device->cur_samplers[i] = NULL;
+
+	samplerstate_release(samplerstate);
+}
@@ -56,6 +56,19 @@ static inline void decl_info_free(struct decl_info *decl)
 
 EXPORT bool parse_decl_string(struct decl_info *decl, const char *decl_string);
 
+/* FNV-1a, used to look up signals and procedures by name */
+static inline uint32_t decl_hash_name(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,6 +21,7 @@
 
 struct proc_info {
 	struct decl_info func;
+	uint32_t hash;
 	void *data;
 	proc_handler_proc_t callback;
 };
@@ -31,13 +32,58 @@ static inline void proc_info_free(struct proc_info *pi)
 }
 
 struct proc_handler {
-	/* TODO: replace with hash table lookup? */
 	DARRAY(struct proc_info) procs;
+
+	/* open addressing table of indices into procs, plus one */
+	size_t *table;
+	size_t table_size;
 };
 
+static struct proc_info *getproc(proc_handler_t *handler, const char *name)
+{
+	uint32_t hash = decl_hash_name(name);
+	size_t mask = handler->table_size - 1;
+
+	if (!handler->table)
+		return NULL;
+
+	for (size_t i = hash & mask; handler->table[i]; i = (i + 1) & mask) {
+		struct proc_info *info =
+			handler->procs.array + handler->table[i] - 1;
+
+		if (info->hash == hash && strcmp(info->func.name, name) == 0)
+			return info;
+	}
+
+	return NULL;
+}
+
+static void insert_proc(proc_handler_t *handler, size_t idx)
+{
+	size_t mask = handler->table_size - 1;
+	size_t i = handler->procs.array[idx].hash & mask;
+
+	while (handler->table[i])
+		i = (i + 1) & mask;
+
+	handler->table[i] = idx + 1;
+}
+
+static void rehash_procs(proc_handler_t *handler)
+{
+	size_t size = handler->table_size ? handler->table_size * 2 : 16;
+
+	bfree(handler->table);
+	handler->table = bzalloc(sizeof(size_t) * size);
+	handler->table_size = size;
+
+	for (size_t i = 0; i < handler->procs.num; i++)
+		insert_proc(handler, i);
+}
+
 proc_handler_t *proc_handler_create(void)
 {
-	struct proc_handler *handler = bmalloc(sizeof(struct proc_handler));
+	struct proc_handler *handler = bzalloc(sizeof(struct proc_handler));
 	da_init(handler->procs);
 	return handler;
 }
@@ -48,6 +94,7 @@ void proc_handler_destroy(proc_handler_t *handler)
 		for (size_t i = 0; i < handler->procs.num; i++)
 			proc_info_free(handler->procs.array + i);
 		da_free(handler->procs);
+		bfree(handler->table);
 		bfree(handler);
 	}
 }
@@ -67,26 +114,36 @@ void proc_handler_add(proc_handler_t *handler, const char *decl_string,
 		return;
 	}
 
+	/* the first procedure added with a name is the one that is called */
+	if (getproc(handler, pi.func.name)) {
+		decl_info_free(&pi.func);
+		return;
+	}
+
+	pi.hash = decl_hash_name(pi.func.name);
 	pi.callback = proc;
 	pi.data = data;
 
 	da_push_back(handler->procs, &pi);
+
+	if (handler->procs.num * 2 > handler->table_size)
+		rehash_procs(handler);
+	else
+		insert_proc(handler, handler->procs.num - 1);
 }
 
 bool proc_handler_call(proc_handler_t *handler, const char *name,
 		       calldata_t *params)
 {
+	struct proc_info *info;
+
 	if (!handler)
 		return false;
 
-	for (size_t i = 0; i < handler->procs.num; i++) {
-		struct proc_info *info = handler->procs.array + i;
-
-		if (strcmp(info->func.name, name) == 0) {
-			info->callback(info->data, params);
-			return true;
-		}
-	}
+	info = getproc(handler, name);
+	if (!info)
+		return false;
 
-	return false;
+	info->callback(info->data, params);
+	return true;
 }
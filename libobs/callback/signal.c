@@ -14,6 +14,8 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdarg.h>
+
 #include "../util/darray.h"
 #include "../util/threading.h"
 
@@ -29,13 +31,69 @@ struct signal_callback {
 
 struct signal_info {
 	struct decl_info func;
+	signal_id_t id;
 	DARRAY(struct signal_callback) callbacks;
+	volatile long num_callbacks;
 	pthread_mutex_t mutex;
 	bool signalling;
 
-	struct signal_info *next;
+	/* call data with every parameter but strings, and where their values
+	 * are, see signal_handler_signal_args */
+	DARRAY(uint8_t) layout;
+	DARRAY(size_t) offsets;
 };
 
+static inline size_t param_size(enum call_param_type type)
+{
+	switch (type) {
+	case CALL_PARAM_TYPE_INT:
+		return sizeof(long long);
+	case CALL_PARAM_TYPE_FLOAT:
+		return sizeof(double);
+	case CALL_PARAM_TYPE_BOOL:
+		return sizeof(bool);
+	case CALL_PARAM_TYPE_PTR:
+		return sizeof(void *);
+	default:
+		return 0;
+	}
+}
+
+static void push_layout_size(struct signal_info *si, size_t size)
+{
+	da_push_back_array(si->layout, (uint8_t *)&size, sizeof(size_t));
+}
+
+static void signal_info_build_layout(struct signal_info *si)
+{
+	for (size_t i = 0; i < si->func.params.num; i++) {
+		struct decl_param *param = si->func.params.array + i;
+		size_t name_size = strlen(param->name) + 1;
+		size_t size = param_size(param->type);
+		size_t offset = 0;
+
+		if (size) {
+			push_layout_size(si, name_size);
+			da_push_back_array(si->layout, (uint8_t *)param->name,
+					   name_size);
+			push_layout_size(si, size);
+
+			offset = si->layout.num;
+			da_resize(si->layout, offset + size);
+			memset(si->layout.array + offset, 0, size);
+		}
+
+		da_push_back(si->offsets, &offset);
+	}
+
+	push_layout_size(si, 0);
+}
+
+static inline void set_callbacks(struct signal_info *si)
+{
+	os_atomic_set_long(&si->num_callbacks, (long)si->callbacks.num);
+}
+
 static inline struct signal_info *signal_info_create(struct decl_info *info)
 {
 	pthread_mutexattr_t attr;
@@ -49,9 +107,12 @@ static inline struct signal_info *signal_info_create(struct decl_info *info)
 	si = bmalloc(sizeof(struct signal_info));
 
 	si->func = *info;
-	si->next = NULL;
+	si->id = signal_get_id(info->name);
 	si->signalling = false;
+	si->num_callbacks = 0;
 	da_init(si->callbacks);
+	da_init(si->layout);
+	da_init(si->offsets);
 
 	if (pthread_mutex_init(&si->mutex, &attr) != 0) {
 		blog(LOG_ERROR, "Could not create signal");
@@ -61,6 +122,7 @@ static inline struct signal_info *signal_info_create(struct decl_info *info)
 		return NULL;
 	}
 
+	signal_info_build_layout(si);
 	return si;
 }
 
@@ -70,6 +132,8 @@ static inline void signal_info_destroy(struct signal_info *si)
 		pthread_mutex_destroy(&si->mutex);
 		decl_info_free(&si->func);
 		da_free(si->callbacks);
+		da_free(si->layout);
+		da_free(si->offsets);
 		bfree(si);
 	}
 }
@@ -96,32 +160,81 @@ struct global_callback_info {
 };
 
 struct signal_handler {
-	struct signal_info *first;
+	/* open addressing table, by signal ID */
+	struct signal_info **signals;
+	size_t table_size;
+	size_t num_signals;
 	pthread_mutex_t mutex;
 	volatile long refs;
 
 	DARRAY(struct global_callback_info) global_callbacks;
+	volatile long num_global_callbacks;
 	pthread_mutex_t global_callbacks_mutex;
 };
 
+/* signal names within a handler never share an ID, which is checked when
+ * they are added */
+static struct signal_info *getsignal_id(signal_handler_t *handler,
+					signal_id_t id)
+{
+	size_t mask = handler->table_size - 1;
+
+	if (!handler->signals)
+		return NULL;
+
+	for (size_t i = id & mask; handler->signals[i]; i = (i + 1) & mask) {
+		if (handler->signals[i]->id == id)
+			return handler->signals[i];
+	}
+
+	return NULL;
+}
+
 static struct signal_info *getsignal(signal_handler_t *handler,
-				     const char *name,
-				     struct signal_info **p_last)
+				     const char *name)
 {
-	struct signal_info *signal, *last = NULL;
+	struct signal_info *sig = getsignal_id(handler, signal_get_id(name));
 
-	signal = handler->first;
-	while (signal != NULL) {
-		if (strcmp(signal->func.name, name) == 0)
-			break;
+	if (sig && strcmp(sig->func.name, name) != 0)
+		return NULL;
+	return sig;
+}
+
+static void insert_signal(signal_handler_t *handler, struct signal_info *sig)
+{
+	size_t mask = handler->table_size - 1;
+	size_t i = sig->id & mask;
+
+	while (handler->signals[i])
+		i = (i + 1) & mask;
 
-		last = signal;
-		signal = signal->next;
+	handler->signals[i] = sig;
+}
+
+static void add_signal(signal_handler_t *handler, struct signal_info *sig)
+{
+	if (++handler->num_signals * 2 > handler->table_size) {
+		struct signal_info **signals = handler->signals;
+		size_t size = handler->table_size;
+
+		handler->table_size = size ? size * 2 : 64;
+		handler->signals = bzalloc(sizeof(struct signal_info *) *
+					   handler->table_size);
+
+		for (size_t i = 0; i < size; i++) {
+			if (signals[i])
+				insert_signal(handler, signals[i]);
+		}
+
+		bfree(signals);
 	}
 
-	if (p_last)
-		*p_last = last;
-	return signal;
+	insert_signal(handler, sig);
+}
+
+signal_id_t signal_get_id(const char *name)
+{
+	return name ? decl_hash_name(name) : 0;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -129,7 +242,6 @@ static struct signal_info *getsignal(signal_handler_t *handler,
 signal_handler_t *signal_handler_create(void)
 {
 	struct signal_handler *handler = bzalloc(sizeof(struct signal_handler));
-	handler->first = NULL;
 	handler->refs = 1;
 
 	pthread_mutexattr_t attr;
@@ -156,13 +268,10 @@ signal_handler_t *signal_handler_create(void)
 
 static void signal_handler_actually_destroy(signal_handler_t *handler)
 {
-	struct signal_info *sig = handler->first;
-	while (sig != NULL) {
-		struct signal_info *next = sig->next;
-		signal_info_destroy(sig);
-		sig = next;
-	}
+	for (size_t i = 0; i < handler->table_size; i++)
+		signal_info_destroy(handler->signals[i]);
 
+	bfree(handler->signals);
 	da_free(handler->global_callbacks);
 	pthread_mutex_destroy(&handler->global_callbacks_mutex);
 	pthread_mutex_destroy(&handler->mutex);
@@ -179,7 +288,7 @@ void signal_handler_destroy(signal_handler_t *handler)
 bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 {
 	struct decl_info func = {0};
-	struct signal_info *sig, *last;
+	struct signal_info *sig;
 	bool success = true;
 
 	if (!parse_decl_string(&func, signal_decl)) {
@@ -189,17 +298,22 @@ bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 
 	pthread_mutex_lock(&handler->mutex);
 
-	sig = getsignal(handler, func.name, &last);
-	if (sig) {
+	sig = getsignal_id(handler, signal_get_id(func.name));
+	if (sig && strcmp(sig->func.name, func.name) == 0) {
 		blog(LOG_WARNING, "Signal declaration '%s' exists", func.name);
 		decl_info_free(&func);
 		success = false;
+	} else if (sig) {
+		blog(LOG_ERROR, "Signal '%s' has the same ID as '%s'",
+		     func.name, sig->func.name);
+		decl_info_free(&func);
+		success = false;
 	} else {
 		sig = signal_info_create(&func);
-		if (!last)
-			handler->first = sig;
+		if (sig)
+			add_signal(handler, sig);
 		else
-			last->next = sig;
+			success = false;
 	}
 
 	pthread_mutex_unlock(&handler->mutex);
@@ -212,7 +326,7 @@ static void signal_handler_connect_internal(signal_handler_t *handler,
 					    signal_callback_t callback,
 					    void *data, bool keep_ref)
 {
-	struct signal_info *sig, *last;
+	struct signal_info *sig;
 	struct signal_callback cb_data = {callback, data, false, keep_ref};
 	size_t idx;
 
@@ -220,7 +334,7 @@ static void signal_handler_connect_internal(signal_handler_t *handler,
 		return;
 
 	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, signal, &last);
+	sig = getsignal(handler, signal);
 	pthread_mutex_unlock(&handler->mutex);
 
 	if (!sig) {
@@ -241,6 +355,7 @@ static void signal_handler_connect_internal(signal_handler_t *handler,
 	idx = signal_get_callback_idx(sig, callback, data);
 	if (keep_ref || idx == DARRAY_INVALID)
 		da_push_back(sig->callbacks, &cb_data);
+	set_callbacks(sig);
 
 	pthread_mutex_unlock(&sig->mutex);
 }
@@ -266,7 +381,22 @@ static inline struct signal_info *getsignal_locked(signal_handler_t *handler,
 		return NULL;
 
 	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, name, NULL);
+	sig = getsignal(handler, name);
+	pthread_mutex_unlock(&handler->mutex);
+
+	return sig;
+}
+
+static inline struct signal_info *getsignal_id_locked(signal_handler_t *handler,
+						      signal_id_t id)
+{
+	struct signal_info *sig;
+
+	if (!handler)
+		return NULL;
+
+	pthread_mutex_lock(&handler->mutex);
+	sig = getsignal_id(handler, id);
 	pthread_mutex_unlock(&handler->mutex);
 
 	return sig;
@@ -291,6 +421,7 @@ void signal_handler_disconnect(signal_handler_t *handler, const char *signal,
 		} else {
 			keep_ref = sig->callbacks.array[idx].keep_ref;
 			da_erase(sig->callbacks, idx);
+			set_callbacks(sig);
 		}
 	}
 
@@ -312,15 +443,12 @@ void signal_handler_remove_current(void)
 		current_global_cb->remove = true;
 }
 
-void signal_handler_signal(signal_handler_t *handler, const char *signal,
-			   calldata_t *params)
+static void signal_dispatch(signal_handler_t *handler, struct signal_info *sig,
+			    calldata_t *params)
 {
-	struct signal_info *sig = getsignal_locked(handler, signal);
+	const char *signal = sig->func.name;
 	long remove_refs = 0;
 
-	if (!sig)
-		return;
-
 	pthread_mutex_lock(&sig->mutex);
 	sig->signalling = true;
 
@@ -343,6 +471,7 @@ void signal_handler_signal(signal_handler_t *handler, const char *signal,
 		}
 	}
 
+	set_callbacks(sig);
 	sig->signalling = false;
 	pthread_mutex_unlock(&sig->mutex);
 
@@ -369,6 +498,9 @@ void signal_handler_signal(signal_handler_t *handler, const char *signal,
 			if (cb->remove && !cb->signaling)
 				da_erase(handler->global_callbacks, i - 1);
 		}
+
+		os_atomic_set_long(&handler->num_global_callbacks,
+				   (long)handler->global_callbacks.num);
 	}
 
 	pthread_mutex_unlock(&handler->global_callbacks_mutex);
@@ -380,6 +512,170 @@ void signal_handler_signal(signal_handler_t *handler, const char *signal,
 	}
 }
 
+void signal_handler_signal(signal_handler_t *handler, const char *signal,
+			   calldata_t *params)
+{
+	struct signal_info *sig = getsignal_locked(handler, signal);
+
+	if (sig)
+		signal_dispatch(handler, sig, params);
+}
+
+void signal_handler_signal_id(signal_handler_t *handler, signal_id_t id,
+			      calldata_t *params)
+{
+	struct signal_info *sig = getsignal_id_locked(handler, id);
+
+	if (sig)
+		signal_dispatch(handler, sig, params);
+}
+
+static inline bool has_callbacks(signal_handler_t *handler,
+				 struct signal_info *sig)
+{
+	return os_atomic_load_long(&sig->num_callbacks) > 0 ||
+	       os_atomic_load_long(&handler->num_global_callbacks) > 0;
+}
+
+bool signal_handler_has_callbacks(signal_handler_t *handler, signal_id_t id)
+{
+	struct signal_info *sig = getsignal_id_locked(handler, id);
+	return sig && has_callbacks(handler, sig);
+}
+
+#define ARGS_STACK_SIZE 256
+
+/* reads the arguments with the types of the parameters, and returns the
+ * size of the call data that is needed for them */
+static size_t get_args_size(struct signal_info *sig, va_list args)
+{
+	size_t size = sig->layout.num;
+
+	for (size_t i = 0; i < sig->func.params.num; i++) {
+		struct decl_param *param = sig->func.params.array + i;
+		const char *str;
+
+		switch (param->type) {
+		case CALL_PARAM_TYPE_INT:
+			(void)va_arg(args, long long);
+			break;
+		case CALL_PARAM_TYPE_FLOAT:
+			(void)va_arg(args, double);
+			break;
+		case CALL_PARAM_TYPE_BOOL:
+			(void)va_arg(args, int);
+			break;
+		case CALL_PARAM_TYPE_PTR:
+			(void)va_arg(args, void *);
+			break;
+		case CALL_PARAM_TYPE_STRING:
+			str = va_arg(args, const char *);
+			size += sizeof(size_t) * 2 + strlen(param->name) + 1;
+			size += str ? strlen(str) + 1 : 0;
+			break;
+		case CALL_PARAM_TYPE_VOID:
+			break;
+		}
+	}
+
+	return size;
+}
+
+static void set_args(struct signal_info *sig, calldata_t *params,
+		     va_list args)
+{
+	uint8_t *stack = params->stack;
+
+	memcpy(stack, sig->layout.array, sig->layout.num);
+	params->size = sig->layout.num;
+
+	for (size_t i = 0; i < sig->func.params.num; i++) {
+		struct decl_param *param = sig->func.params.array + i;
+		uint8_t *val = stack + sig->offsets.array[i];
+		long long int_val;
+		double float_val;
+		bool bool_val;
+		void *ptr;
+
+		switch (param->type) {
+		case CALL_PARAM_TYPE_INT:
+			int_val = va_arg(args, long long);
+			memcpy(val, &int_val, sizeof(int_val));
+			break;
+		case CALL_PARAM_TYPE_FLOAT:
+			float_val = va_arg(args, double);
+			memcpy(val, &float_val, sizeof(float_val));
+			break;
+		case CALL_PARAM_TYPE_BOOL:
+			bool_val = va_arg(args, int) != 0;
+			memcpy(val, &bool_val, sizeof(bool_val));
+			break;
+		case CALL_PARAM_TYPE_PTR:
+			ptr = va_arg(args, void *);
+			memcpy(val, &ptr, sizeof(ptr));
+			break;
+		case CALL_PARAM_TYPE_STRING:
+			calldata_set_string(params, param->name,
+					    va_arg(args, const char *));
+			break;
+		case CALL_PARAM_TYPE_VOID:
+			break;
+		}
+	}
+}
+
+/* The call data is copied from the layout of the signal, and the values
+ * are written where the layout says they are, so no parameter has to be
+ * looked up by name.  Strings are added after that. */
+void signal_handler_signal_args(signal_handler_t *handler, signal_id_t id,
+				...)
+{
+	struct signal_info *sig = getsignal_id_locked(handler, id);
+	uint8_t stack[ARGS_STACK_SIZE];
+	uint8_t *buf = stack;
+	struct calldata params;
+	size_t size;
+	va_list args;
+
+	/* nothing to build the call data for */
+	if (!sig || !has_callbacks(handler, sig))
+		return;
+
+	va_start(args, id);
+	size = get_args_size(sig, args) + 1;
+	va_end(args);
+
+	if (size > ARGS_STACK_SIZE)
+		buf = bmalloc(size);
+
+	calldata_init_fixed(&params, buf, size);
+
+	va_start(args, id);
+	set_args(sig, &params, args);
+	va_end(args);
+
+	signal_dispatch(handler, sig, &params);
+
+	if (buf != stack)
+		bfree(buf);
+}
+
+/* compares only the callback and its data, the rest of the info changes
+ * while signaling */
+static size_t global_callback_idx(signal_handler_t *handler,
+				  global_signal_callback_t callback, void *data)
+{
+	for (size_t i = 0; i < handler->global_callbacks.num; i++) {
+		struct global_callback_info *cb =
+			handler->global_callbacks.array + i;
+
+		if (cb->callback == callback && cb->data == data)
+			return i;
+	}
+
+	return DARRAY_INVALID;
+}
+
 void signal_handler_connect_global(signal_handler_t *handler,
 				   global_signal_callback_t callback,
 				   void *data)
@@ -392,10 +688,13 @@ void signal_handler_connect_global(signal_handler_t *handler,
 
 	pthread_mutex_lock(&handler->global_callbacks_mutex);
 
-	idx = da_find(handler->global_callbacks, &cb_data, 0);
+	idx = global_callback_idx(handler, callback, data);
 	if (idx == DARRAY_INVALID)
 		da_push_back(handler->global_callbacks, &cb_data);
 
+	os_atomic_set_long(&handler->num_global_callbacks,
+			   (long)handler->global_callbacks.num);
+
 	pthread_mutex_unlock(&handler->global_callbacks_mutex);
 }
 
@@ -403,7 +702,6 @@ void signal_handler_disconnect_global(signal_handler_t *handler,
 				      global_signal_callback_t callback,
 				      void *data)
 {
-	struct global_callback_info cb_data = {callback, data, false};
 	size_t idx;
 
 	if (!handler || !callback)
@@ -411,7 +709,7 @@ void signal_handler_disconnect_global(signal_handler_t *handler,
 
 	pthread_mutex_lock(&handler->global_callbacks_mutex);
 
-	idx = da_find(handler->global_callbacks, &cb_data, 0);
+	idx = global_callback_idx(handler, callback, data);
 	if (idx != DARRAY_INVALID) {
 		struct global_callback_info *cb =
 			handler->global_callbacks.array + idx;
@@ -420,6 +718,9 @@ void signal_handler_disconnect_global(signal_handler_t *handler,
 			cb->remove = true;
 		else
 			da_erase(handler->global_callbacks, idx);
+
+		os_atomic_set_long(&handler->num_global_callbacks,
+				   (long)handler->global_callbacks.num);
 	}
 
 	pthread_mutex_unlock(&handler->global_callbacks_mutex);
@@ -36,6 +36,15 @@ typedef struct signal_handler signal_handler_t;
 typedef void (*global_signal_callback_t)(void *, const char *, calldata_t *);
 typedef void (*signal_callback_t)(void *, calldata_t *);
 
+/**
+ * Signal IDs are derived from signal names only, so the ID of a name is the
+ * same for every signal handler and can be kept around.  Signaling by ID
+ * skips looking up the name.
+ */
+typedef uint32_t signal_id_t;
+
+EXPORT signal_id_t signal_get_id(const char *name);
+
 EXPORT signal_handler_t *signal_handler_create(void);
 EXPORT void signal_handler_destroy(signal_handler_t *handler);
 
@@ -77,6 +86,20 @@ EXPORT void signal_handler_remove_current(void);
 
 EXPORT void signal_handler_signal(signal_handler_t *handler, const char *signal,
 				  calldata_t *params);
+EXPORT void signal_handler_signal_id(signal_handler_t *handler, signal_id_t id,
+				     calldata_t *params);
+
+/**
+ * Signals with the parameters of the signal's declaration, in order, as
+ * long long for int, double for float, bool, void * for ptr and
+ * const char * for string.  The call data is only created if anything is
+ * connected to the signal, and out parameters cannot be read back.
+ */
+EXPORT void signal_handler_signal_args(signal_handler_t *handler,
+				       signal_id_t id, ...);
+
+EXPORT bool signal_handler_has_callbacks(signal_handler_t *handler,
+					 signal_id_t id);
 
 #ifdef __cplusplus
 }
@@ -15,10 +15,24 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <math.h>
 #include "format-conversion.h"
+#include "video-frame.h"
 
 #include "../util/sse-intrin.h"
 
+#if !NEEDS_SIMDE && (defined(_M_IX86) || defined(_M_X64) || \
+		     defined(__i386__) || defined(__x86_64__))
+#define FORMAT_CONVERSION_AVX2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_FUNC
+#else
+#define AVX2_FUNC __attribute__((target("avx2")))
+#endif
+#endif
+
 /* ...surprisingly, if I don't use a macro to force inlining, it causes the
  * CPU usage to boost by a tremendous amount in debug builds. */
 
@@ -316,3 +330,1392 @@ void decompress_422(const uint8_t *input, uint32_t in_linesize,
 		}
 	}
 }
+
+/* ------------------------------------------------------------------------- */
+/* row kernels used by video_frame_convert                                   */
+
+/* YUV <-> RGB matrix in fixed point.  The coefficients stay below 4.0, so
+ * with 13 fractional bits they fit in 16 bits for _mm_madd_epi16. */
+struct color_matrix {
+	int32_t m[3][4];
+};
+
+#define MATRIX_SHIFT 13
+#define MATRIX_ONE (1 << MATRIX_SHIFT)
+
+struct conversion_kernels {
+	const char *name;
+
+	/* NV12 chroma row <-> separate U and V rows */
+	void (*deinterleave_uv)(const uint8_t *uv, uint8_t *u, uint8_t *v,
+				uint32_t count);
+	void (*interleave_uv)(const uint8_t *u, const uint8_t *v, uint8_t *uv,
+			      uint32_t count);
+
+	/* packed 4:2:2 row (YUY2/YVYU/UYVY) to luma and two chroma rows */
+	void (*split_422)(const uint8_t *in, uint8_t *lum, uint8_t *c0,
+			  uint8_t *c1, uint32_t width, bool leading_lum);
+
+	/* rounded average of two rows, (a + b + 1) >> 1 */
+	void (*avg_rows)(const uint8_t *a, const uint8_t *b, uint8_t *out,
+			 uint32_t count);
+
+	/* 32-bit RGB pixels, optionally swapping R/B and forcing alpha */
+	void (*convert_rgb32)(const uint8_t *in, uint8_t *out, uint32_t count,
+			      bool swap_rb, bool set_alpha);
+
+	/* color matrix applied in place to a 4:4:4 intermediate row */
+	void (*apply_matrix)(uint8_t *row, uint32_t width,
+			     const struct color_matrix *cm);
+
+	/* Y, U and V rows to a 4:4:4 intermediate row with opaque alpha,
+	 * U and V are half as wide if subsampled */
+	void (*merge_yuv)(const uint8_t *lum, const uint8_t *u,
+			  const uint8_t *v, uint8_t *out, uint32_t width,
+			  bool subsampled);
+
+	/* 4:4:4 intermediate row to full width Y, U and V rows */
+	void (*split_yuv)(const uint8_t *in, uint8_t *lum, uint8_t *u,
+			  uint8_t *v, uint32_t width);
+
+	/* rounded average of the pixel pairs of row a, or of the 2x2 blocks
+	 * of rows a and b if b is not NULL */
+	void (*downsample)(const uint8_t *a, const uint8_t *b, uint8_t *out,
+			   uint32_t count);
+};
+
+static void deinterleave_uv_c(const uint8_t *uv, uint8_t *u, uint8_t *v,
+			      uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		u[i] = uv[i * 2];
+		v[i] = uv[i * 2 + 1];
+	}
+}
+
+static void interleave_uv_c(const uint8_t *u, const uint8_t *v, uint8_t *uv,
+			    uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		uv[i * 2] = u[i];
+		uv[i * 2 + 1] = v[i];
+	}
+}
+
+static void split_422_c(const uint8_t *in, uint8_t *lum, uint8_t *c0,
+			uint8_t *c1, uint32_t width, bool leading_lum)
+{
+	uint32_t lum_ofs = leading_lum ? 0 : 1;
+	uint32_t chroma_ofs = leading_lum ? 1 : 0;
+
+	for (uint32_t i = 0; i < width / 2; i++) {
+		const uint8_t *pair = in + i * 4;
+
+		lum[i * 2] = pair[lum_ofs];
+		lum[i * 2 + 1] = pair[lum_ofs + 2];
+		c0[i] = pair[chroma_ofs];
+		c1[i] = pair[chroma_ofs + 2];
+	}
+}
+
+static void avg_rows_c(const uint8_t *a, const uint8_t *b, uint8_t *out,
+		       uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+		out[i] = (uint8_t)((a[i] + b[i] + 1) >> 1);
+}
+
+static void convert_rgb32_c(const uint8_t *in, uint8_t *out, uint32_t count,
+			    bool swap_rb, bool set_alpha)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		const uint8_t *px = in + i * 4;
+		uint8_t *out_px = out + i * 4;
+		uint8_t c0 = px[0];
+		uint8_t c2 = px[2];
+
+		out_px[0] = swap_rb ? c2 : c0;
+		out_px[1] = px[1];
+		out_px[2] = swap_rb ? c0 : c2;
+		out_px[3] = set_alpha ? 0xFF : px[3];
+	}
+}
+
+static inline uint8_t apply_row(const int32_t m[4], int32_t c0, int32_t c1,
+				int32_t c2)
+{
+	int32_t val = m[0] * c0 + m[1] * c1 + m[2] * c2 + m[3] +
+		      MATRIX_ONE / 2;
+
+	if (val < 0)
+		return 0;
+	val >>= MATRIX_SHIFT;
+	return (uint8_t)(val > 255 ? 255 : val);
+}
+
+static void apply_matrix_c(uint8_t *row, uint32_t width,
+			   const struct color_matrix *cm)
+{
+	for (uint32_t x = 0; x < width; x++) {
+		uint8_t *px = row + x * 4;
+		int32_t c0 = px[0];
+		int32_t c1 = px[1];
+		int32_t c2 = px[2];
+
+		px[0] = apply_row(cm->m[0], c0, c1, c2);
+		px[1] = apply_row(cm->m[1], c0, c1, c2);
+		px[2] = apply_row(cm->m[2], c0, c1, c2);
+	}
+}
+
+static void merge_yuv_c(const uint8_t *lum, const uint8_t *u,
+			const uint8_t *v, uint8_t *out, uint32_t width,
+			bool subsampled)
+{
+	uint32_t shift = subsampled ? 1 : 0;
+
+	for (uint32_t x = 0; x < width; x++) {
+		out[x * 4] = lum[x];
+		out[x * 4 + 1] = u[x >> shift];
+		out[x * 4 + 2] = v[x >> shift];
+		out[x * 4 + 3] = 0xFF;
+	}
+}
+
+static void split_yuv_c(const uint8_t *in, uint8_t *lum, uint8_t *u,
+			uint8_t *v, uint32_t width)
+{
+	for (uint32_t x = 0; x < width; x++) {
+		lum[x] = in[x * 4];
+		u[x] = in[x * 4 + 1];
+		v[x] = in[x * 4 + 2];
+	}
+}
+
+static void downsample_c(const uint8_t *a, const uint8_t *b, uint8_t *out,
+			 uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t sum = a[i * 2] + a[i * 2 + 1];
+
+		if (b) {
+			sum += b[i * 2] + b[i * 2 + 1];
+			out[i] = (uint8_t)((sum + 2) >> 2);
+		} else {
+			out[i] = (uint8_t)((sum + 1) >> 1);
+		}
+	}
+}
+
+/* SSE2 kernels.  On ARM these go through simde and end up as NEON. */
+
+static void deinterleave_uv_sse2(const uint8_t *uv, uint8_t *u, uint8_t *v,
+				 uint32_t count)
+{
+	__m128i mask = _mm_set1_epi16(0x00FF);
+	uint32_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(uv + i * 2));
+		__m128i b = _mm_loadu_si128((const __m128i *)(uv + i * 2 + 16));
+
+		_mm_storeu_si128((__m128i *)(u + i),
+				 _mm_packus_epi16(_mm_and_si128(a, mask),
+						  _mm_and_si128(b, mask)));
+		_mm_storeu_si128((__m128i *)(v + i),
+				 _mm_packus_epi16(_mm_srli_epi16(a, 8),
+						  _mm_srli_epi16(b, 8)));
+	}
+
+	deinterleave_uv_c(uv + i * 2, u + i, v + i, count - i);
+}
+
+static void interleave_uv_sse2(const uint8_t *u, const uint8_t *v, uint8_t *uv,
+			       uint32_t count)
+{
+	uint32_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(u + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(v + i));
+
+		_mm_storeu_si128((__m128i *)(uv + i * 2),
+				 _mm_unpacklo_epi8(a, b));
+		_mm_storeu_si128((__m128i *)(uv + i * 2 + 16),
+				 _mm_unpackhi_epi8(a, b));
+	}
+
+	interleave_uv_c(u + i, v + i, uv + i * 2, count - i);
+}
+
+static void split_422_sse2(const uint8_t *in, uint8_t *lum, uint8_t *c0,
+			   uint8_t *c1, uint32_t width, bool leading_lum)
+{
+	__m128i mask = _mm_set1_epi16(0x00FF);
+	uint32_t x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(in + x * 2));
+		__m128i b = _mm_loadu_si128((const __m128i *)(in + x * 2 + 16));
+		__m128i l, c;
+
+		if (leading_lum) {
+			l = _mm_packus_epi16(_mm_and_si128(a, mask),
+					     _mm_and_si128(b, mask));
+			c = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+					     _mm_srli_epi16(b, 8));
+		} else {
+			l = _mm_packus_epi16(_mm_srli_epi16(a, 8),
+					     _mm_srli_epi16(b, 8));
+			c = _mm_packus_epi16(_mm_and_si128(a, mask),
+					     _mm_and_si128(b, mask));
+		}
+
+		_mm_storeu_si128((__m128i *)(lum + x), l);
+		_mm_storel_epi64((__m128i *)(c0 + x / 2),
+				 _mm_packus_epi16(_mm_and_si128(c, mask),
+						  _mm_setzero_si128()));
+		_mm_storel_epi64((__m128i *)(c1 + x / 2),
+				 _mm_packus_epi16(_mm_srli_epi16(c, 8),
+						  _mm_setzero_si128()));
+	}
+
+	split_422_c(in + x * 2, lum + x, c0 + x / 2, c1 + x / 2, width - x,
+		    leading_lum);
+}
+
+static void avg_rows_sse2(const uint8_t *a, const uint8_t *b, uint8_t *out,
+			  uint32_t count)
+{
+	uint32_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_avg_epu8(va, vb));
+	}
+
+	avg_rows_c(a + i, b + i, out + i, count - i);
+}
+
+static void convert_rgb32_sse2(const uint8_t *in, uint8_t *out, uint32_t count,
+			       bool swap_rb, bool set_alpha)
+{
+	__m128i ga_mask = _mm_set1_epi32((int)0xFF00FF00);
+	__m128i rb_mask = _mm_set1_epi32(0x00FF00FF);
+	__m128i alpha = _mm_set1_epi32(set_alpha ? (int)0xFF000000 : 0);
+	uint32_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i *)(in + i * 4));
+
+		if (swap_rb) {
+			__m128i rb = _mm_and_si128(px, rb_mask);
+			rb = _mm_or_si128(_mm_slli_epi32(rb, 16),
+					  _mm_srli_epi32(rb, 16));
+			px = _mm_or_si128(_mm_and_si128(px, ga_mask), rb);
+		}
+
+		px = _mm_or_si128(px, alpha);
+		_mm_storeu_si128((__m128i *)(out + i * 4), px);
+	}
+
+	convert_rgb32_c(in + i * 4, out + i * 4, count - i, swap_rb, set_alpha);
+}
+
+/* four pixels at a time: c0 * m0 + c1 * m1 of each pixel end up in one
+ * 32-bit lane and c2 * m2 in the next, the even/odd shuffles add them */
+static void apply_matrix_sse2(uint8_t *row, uint32_t width,
+			      const struct color_matrix *cm)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i coef[3];
+	__m128i ofs[3];
+	uint32_t x = 0;
+
+	for (int r = 0; r < 3; r++) {
+		const int32_t *m = cm->m[r];
+
+		coef[r] = _mm_setr_epi16((short)m[0], (short)m[1],
+					 (short)m[2], 0, (short)m[0],
+					 (short)m[1], (short)m[2], 0);
+		ofs[r] = _mm_set1_epi32(m[3] + MATRIX_ONE / 2);
+	}
+
+	for (; x + 4 <= width; x += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i *)(row + x * 4));
+		__m128i lo = _mm_unpacklo_epi8(px, zero);
+		__m128i hi = _mm_unpackhi_epi8(px, zero);
+		__m128i c[3];
+		__m128i c01, c2a, u, v;
+
+		for (int r = 0; r < 3; r++) {
+			__m128i ma = _mm_madd_epi16(lo, coef[r]);
+			__m128i mb = _mm_madd_epi16(hi, coef[r]);
+			__m128 a = _mm_castsi128_ps(ma);
+			__m128 b = _mm_castsi128_ps(mb);
+			__m128i even = _mm_castps_si128(
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+			__m128i odd = _mm_castps_si128(
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+			c[r] = _mm_add_epi32(_mm_add_epi32(even, odd), ofs[r]);
+			c[r] = _mm_srai_epi32(c[r], MATRIX_SHIFT);
+		}
+
+		/* the saturating packs clamp to 0..255 like apply_row */
+		c01 = _mm_packs_epi32(c[0], c[1]);
+		c2a = _mm_packs_epi32(c[2], _mm_srli_epi32(px, 24));
+		u = _mm_unpacklo_epi16(c01, c2a);
+		v = _mm_unpackhi_epi16(c01, c2a);
+		_mm_storeu_si128((__m128i *)(row + x * 4),
+				 _mm_packus_epi16(_mm_unpacklo_epi16(u, v),
+						  _mm_unpackhi_epi16(u, v)));
+	}
+
+	apply_matrix_c(row + x * 4, width - x, cm);
+}
+
+static void merge_yuv_sse2(const uint8_t *lum, const uint8_t *u,
+			   const uint8_t *v, uint8_t *out, uint32_t width,
+			   bool subsampled)
+{
+	__m128i alpha = _mm_set1_epi8((char)0xFF);
+	uint32_t x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i vy = _mm_loadu_si128((const __m128i *)(lum + x));
+		__m128i vu, vv, yu_lo, yu_hi, va_lo, va_hi;
+
+		if (subsampled) {
+			vu = _mm_loadl_epi64((const __m128i *)(u + x / 2));
+			vv = _mm_loadl_epi64((const __m128i *)(v + x / 2));
+			vu = _mm_unpacklo_epi8(vu, vu);
+			vv = _mm_unpacklo_epi8(vv, vv);
+		} else {
+			vu = _mm_loadu_si128((const __m128i *)(u + x));
+			vv = _mm_loadu_si128((const __m128i *)(v + x));
+		}
+
+		yu_lo = _mm_unpacklo_epi8(vy, vu);
+		yu_hi = _mm_unpackhi_epi8(vy, vu);
+		va_lo = _mm_unpacklo_epi8(vv, alpha);
+		va_hi = _mm_unpackhi_epi8(vv, alpha);
+
+		_mm_storeu_si128((__m128i *)(out + x * 4),
+				 _mm_unpacklo_epi16(yu_lo, va_lo));
+		_mm_storeu_si128((__m128i *)(out + x * 4 + 16),
+				 _mm_unpackhi_epi16(yu_lo, va_lo));
+		_mm_storeu_si128((__m128i *)(out + x * 4 + 32),
+				 _mm_unpacklo_epi16(yu_hi, va_hi));
+		_mm_storeu_si128((__m128i *)(out + x * 4 + 48),
+				 _mm_unpackhi_epi16(yu_hi, va_hi));
+	}
+
+	if (subsampled)
+		merge_yuv_c(lum + x, u + x / 2, v + x / 2, out + x * 4,
+			    width - x, true);
+	else
+		merge_yuv_c(lum + x, u + x, v + x, out + x * 4, width - x,
+			    false);
+}
+
+/* byte c of each of the 16 pixels in p[0..3] */
+static inline __m128i extract_component(const __m128i p[4], int c)
+{
+	__m128i mask = _mm_set1_epi32(0xFF);
+	__m128i shift = _mm_cvtsi32_si128(c * 8);
+	__m128i a = _mm_and_si128(_mm_srl_epi32(p[0], shift), mask);
+	__m128i b = _mm_and_si128(_mm_srl_epi32(p[1], shift), mask);
+	__m128i d = _mm_and_si128(_mm_srl_epi32(p[2], shift), mask);
+	__m128i e = _mm_and_si128(_mm_srl_epi32(p[3], shift), mask);
+
+	return _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(d, e));
+}
+
+static void split_yuv_sse2(const uint8_t *in, uint8_t *lum, uint8_t *u,
+			   uint8_t *v, uint32_t width)
+{
+	uint32_t x = 0;
+
+	for (; x + 16 <= width; x += 16) {
+		const __m128i *src = (const __m128i *)(in + x * 4);
+		__m128i p[4];
+
+		for (int i = 0; i < 4; i++)
+			p[i] = _mm_loadu_si128(src + i);
+
+		_mm_storeu_si128((__m128i *)(lum + x), extract_component(p, 0));
+		_mm_storeu_si128((__m128i *)(u + x), extract_component(p, 1));
+		_mm_storeu_si128((__m128i *)(v + x), extract_component(p, 2));
+	}
+
+	split_yuv_c(in + x * 4, lum + x, u + x, v + x, width - x);
+}
+
+static inline __m128i sum_pairs(const uint8_t *row)
+{
+	__m128i mask = _mm_set1_epi16(0x00FF);
+	__m128i px = _mm_loadu_si128((const __m128i *)row);
+
+	return _mm_add_epi16(_mm_and_si128(px, mask), _mm_srli_epi16(px, 8));
+}
+
+static void downsample_sse2(const uint8_t *a, const uint8_t *b, uint8_t *out,
+			    uint32_t count)
+{
+	__m128i one = _mm_set1_epi16(1);
+	__m128i two = _mm_set1_epi16(2);
+	uint32_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128i sum = sum_pairs(a + i * 2);
+
+		if (b) {
+			sum = _mm_add_epi16(sum, sum_pairs(b + i * 2));
+			sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+		} else {
+			sum = _mm_srli_epi16(_mm_add_epi16(sum, one), 1);
+		}
+
+		_mm_storel_epi64((__m128i *)(out + i),
+				 _mm_packus_epi16(sum, sum));
+	}
+
+	downsample_c(a + i * 2, b ? b + i * 2 : NULL, out + i, count - i);
+}
+
+static const struct conversion_kernels kernels_sse2 = {
+	.name = "sse2",
+	.deinterleave_uv = deinterleave_uv_sse2,
+	.interleave_uv = interleave_uv_sse2,
+	.split_422 = split_422_sse2,
+	.avg_rows = avg_rows_sse2,
+	.convert_rgb32 = convert_rgb32_sse2,
+	.apply_matrix = apply_matrix_sse2,
+	.merge_yuv = merge_yuv_sse2,
+	.split_yuv = split_yuv_sse2,
+	.downsample = downsample_sse2,
+};
+
+#ifdef FORMAT_CONVERSION_AVX2
+/* 256-bit pack/unpack instructions work per 128-bit lane, hence the
+ * permutes to put the lanes back in order */
+
+AVX2_FUNC static void deinterleave_uv_avx2(const uint8_t *uv, uint8_t *u,
+					   uint8_t *v, uint32_t count)
+{
+	__m256i mask = _mm256_set1_epi16(0x00FF);
+	uint32_t i = 0;
+
+	for (; i + 32 <= count; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(uv + i * 2));
+		__m256i b =
+			_mm256_loadu_si256((const __m256i *)(uv + i * 2 + 32));
+		__m256i vu = _mm256_packus_epi16(_mm256_and_si256(a, mask),
+						 _mm256_and_si256(b, mask));
+		__m256i vv = _mm256_packus_epi16(_mm256_srli_epi16(a, 8),
+						 _mm256_srli_epi16(b, 8));
+
+		vu = _mm256_permute4x64_epi64(vu, _MM_SHUFFLE(3, 1, 2, 0));
+		vv = _mm256_permute4x64_epi64(vv, _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i *)(u + i), vu);
+		_mm256_storeu_si256((__m256i *)(v + i), vv);
+	}
+
+	deinterleave_uv_sse2(uv + i * 2, u + i, v + i, count - i);
+}
+
+AVX2_FUNC static void interleave_uv_avx2(const uint8_t *u, const uint8_t *v,
+					 uint8_t *uv, uint32_t count)
+{
+	uint32_t i = 0;
+
+	for (; i + 32 <= count; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(u + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(v + i));
+		__m256i lo = _mm256_unpacklo_epi8(a, b);
+		__m256i hi = _mm256_unpackhi_epi8(a, b);
+
+		_mm256_storeu_si256((__m256i *)(uv + i * 2),
+				    _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i *)(uv + i * 2 + 32),
+				    _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+
+	interleave_uv_sse2(u + i, v + i, uv + i * 2, count - i);
+}
+
+AVX2_FUNC static void avg_rows_avx2(const uint8_t *a, const uint8_t *b,
+				    uint8_t *out, uint32_t count)
+{
+	uint32_t i = 0;
+
+	for (; i + 32 <= count; i += 32) {
+		__m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+		_mm256_storeu_si256((__m256i *)(out + i),
+				    _mm256_avg_epu8(va, vb));
+	}
+
+	avg_rows_sse2(a + i, b + i, out + i, count - i);
+}
+
+AVX2_FUNC static void convert_rgb32_avx2(const uint8_t *in, uint8_t *out,
+					 uint32_t count, bool swap_rb,
+					 bool set_alpha)
+{
+	__m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8,
+					   11, 14, 13, 12, 15, 2, 1, 0, 3, 6,
+					   5, 4, 7, 10, 9, 8, 11, 14, 13, 12,
+					   15);
+	__m256i alpha = _mm256_set1_epi32(set_alpha ? (int)0xFF000000 : 0);
+	uint32_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256i px = _mm256_loadu_si256((const __m256i *)(in + i * 4));
+
+		if (swap_rb)
+			px = _mm256_shuffle_epi8(px, shuffle);
+
+		px = _mm256_or_si256(px, alpha);
+		_mm256_storeu_si256((__m256i *)(out + i * 4), px);
+	}
+
+	convert_rgb32_sse2(in + i * 4, out + i * 4, count - i, swap_rb,
+			   set_alpha);
+}
+
+static const struct conversion_kernels kernels_avx2 = {
+	.name = "avx2",
+	.deinterleave_uv = deinterleave_uv_avx2,
+	.interleave_uv = interleave_uv_avx2,
+	.split_422 = split_422_sse2,
+	.avg_rows = avg_rows_avx2,
+	.convert_rgb32 = convert_rgb32_avx2,
+	.apply_matrix = apply_matrix_sse2,
+	.merge_yuv = merge_yuv_sse2,
+	.split_yuv = split_yuv_sse2,
+	.downsample = downsample_sse2,
+};
+
+static bool cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+static const struct conversion_kernels *get_kernels(void)
+{
+	static const struct conversion_kernels *kernels = NULL;
+
+	/* racing here is harmless, every thread picks the same set */
+	if (!kernels) {
+#ifdef FORMAT_CONVERSION_AVX2
+		kernels = cpu_has_avx2() ? &kernels_avx2 : &kernels_sse2;
+#else
+		kernels = &kernels_sse2;
+#endif
+	}
+
+	return kernels;
+}
+
+const char *video_frame_convert_get_kernel_name(void)
+{
+	return get_kernels()->name;
+}
+
+/* ------------------------------------------------------------------------- */
+/* conversion through a packed 4:4:4 intermediate                           */
+
+/* the intermediate is 4 bytes per pixel: Y, U, V, A for YUV formats, and
+ * R, G, B, A for RGB formats */
+enum format_family {
+	FAMILY_YUV,
+	FAMILY_RGB,
+};
+
+struct format_desc {
+	enum format_family family;
+	uint32_t chroma_shift_x;
+	uint32_t chroma_shift_y;
+};
+
+static bool get_format_desc(enum video_format format, struct format_desc *desc)
+{
+	desc->family = FAMILY_YUV;
+	desc->chroma_shift_x = 0;
+	desc->chroma_shift_y = 0;
+
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_I40A:
+		desc->chroma_shift_x = 1;
+		desc->chroma_shift_y = 1;
+		return true;
+	case VIDEO_FORMAT_YVYU:
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+	case VIDEO_FORMAT_I422:
+	case VIDEO_FORMAT_I42A:
+		desc->chroma_shift_x = 1;
+		return true;
+	case VIDEO_FORMAT_Y800:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_YUVA:
+	case VIDEO_FORMAT_AYUV:
+		return true;
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+	case VIDEO_FORMAT_BGR3:
+		desc->family = FAMILY_RGB;
+		return true;
+	case VIDEO_FORMAT_NONE:;
+	}
+
+	return false;
+}
+
+static inline const uint8_t *in_row(const struct video_frame *frame,
+				    size_t plane, uint32_t y)
+{
+	return frame->data[plane] + y * frame->linesize[plane];
+}
+
+static inline uint8_t *out_row(struct video_frame *frame, size_t plane,
+			       uint32_t y)
+{
+	return frame->data[plane] + y * frame->linesize[plane];
+}
+
+static void unpack_planar(const struct video_frame *src, uint32_t y,
+			  uint32_t width, uint32_t shift_x, uint32_t shift_y,
+			  bool has_alpha, uint8_t *out)
+{
+	const uint8_t *lum = in_row(src, 0, y);
+	const uint8_t *u = in_row(src, 1, y >> shift_y);
+	const uint8_t *v = in_row(src, 2, y >> shift_y);
+	const uint8_t *a = has_alpha ? in_row(src, 3, y) : NULL;
+
+	for (uint32_t x = 0; x < width; x++) {
+		out[x * 4] = lum[x];
+		out[x * 4 + 1] = u[x >> shift_x];
+		out[x * 4 + 2] = v[x >> shift_x];
+		out[x * 4 + 3] = a ? a[x] : 0xFF;
+	}
+}
+
+static void unpack_packed_422(const uint8_t *row, uint32_t width,
+			      uint32_t lum_ofs, uint32_t u_ofs, uint32_t v_ofs,
+			      uint8_t *out)
+{
+	for (uint32_t x = 0; x < width; x++) {
+		const uint8_t *pair = row + (x >> 1) * 4;
+
+		out[x * 4] = row[x * 2 + lum_ofs];
+		out[x * 4 + 1] = pair[u_ofs];
+		out[x * 4 + 2] = pair[v_ofs];
+		out[x * 4 + 3] = 0xFF;
+	}
+}
+
+static void unpack_packed(const uint8_t *row, uint32_t width, uint32_t bpp,
+			  int c0, int c1, int c2, int a, uint8_t *out)
+{
+	for (uint32_t x = 0; x < width; x++) {
+		const uint8_t *px = row + x * bpp;
+
+		out[x * 4] = px[c0];
+		out[x * 4 + 1] = px[c1];
+		out[x * 4 + 2] = px[c2];
+		out[x * 4 + 3] = a >= 0 ? px[a] : 0xFF;
+	}
+}
+
+static void unpack_row(enum video_format format, const struct video_frame *src,
+		       uint32_t y, uint32_t width, uint8_t *out)
+{
+	const uint8_t *row = in_row(src, 0, y);
+
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+		unpack_planar(src, y, width, 1, 1, false, out);
+		break;
+	case VIDEO_FORMAT_I40A:
+		unpack_planar(src, y, width, 1, 1, true, out);
+		break;
+	case VIDEO_FORMAT_I422:
+		unpack_planar(src, y, width, 1, 0, false, out);
+		break;
+	case VIDEO_FORMAT_I42A:
+		unpack_planar(src, y, width, 1, 0, true, out);
+		break;
+	case VIDEO_FORMAT_I444:
+		unpack_planar(src, y, width, 0, 0, false, out);
+		break;
+	case VIDEO_FORMAT_YUVA:
+		unpack_planar(src, y, width, 0, 0, true, out);
+		break;
+	case VIDEO_FORMAT_NV12: {
+		const uint8_t *uv = in_row(src, 1, y >> 1);
+
+		for (uint32_t x = 0; x < width; x++) {
+			out[x * 4] = row[x];
+			out[x * 4 + 1] = uv[(x >> 1) * 2];
+			out[x * 4 + 2] = uv[(x >> 1) * 2 + 1];
+			out[x * 4 + 3] = 0xFF;
+		}
+		break;
+	}
+	case VIDEO_FORMAT_YUY2:
+		unpack_packed_422(row, width, 0, 1, 3, out);
+		break;
+	case VIDEO_FORMAT_YVYU:
+		unpack_packed_422(row, width, 0, 3, 1, out);
+		break;
+	case VIDEO_FORMAT_UYVY:
+		unpack_packed_422(row, width, 1, 0, 2, out);
+		break;
+	case VIDEO_FORMAT_Y800:
+		for (uint32_t x = 0; x < width; x++) {
+			out[x * 4] = row[x];
+			out[x * 4 + 1] = 0x80;
+			out[x * 4 + 2] = 0x80;
+			out[x * 4 + 3] = 0xFF;
+		}
+		break;
+	case VIDEO_FORMAT_AYUV:
+	case VIDEO_FORMAT_RGBA:
+		unpack_packed(row, width, 4, 0, 1, 2, 3, out);
+		break;
+	case VIDEO_FORMAT_BGRA:
+		unpack_packed(row, width, 4, 2, 1, 0, 3, out);
+		break;
+	case VIDEO_FORMAT_BGRX:
+		unpack_packed(row, width, 4, 2, 1, 0, -1, out);
+		break;
+	case VIDEO_FORMAT_BGR3:
+		unpack_packed(row, width, 3, 2, 1, 0, -1, out);
+		break;
+	case VIDEO_FORMAT_NONE:;
+	}
+}
+
+/* writes component c of a 4:4:4 row pair to a chroma row, averaging 2x1 or
+ * 2x2 pixels depending on the subsampling */
+static void pack_chroma(const uint8_t *row0, const uint8_t *row1,
+			uint32_t width, uint32_t c, uint8_t *out,
+			uint32_t stride)
+{
+	for (uint32_t x = 0; x < width / 2; x++) {
+		const uint8_t *p0 = row0 + x * 8 + c;
+		uint32_t sum = p0[0] + p0[4];
+
+		if (row1) {
+			const uint8_t *p1 = row1 + x * 8 + c;
+			sum += p1[0] + p1[4];
+			out[x * stride] = (uint8_t)((sum + 2) >> 2);
+		} else {
+			out[x * stride] = (uint8_t)((sum + 1) >> 1);
+		}
+	}
+}
+
+static void pack_component(const uint8_t *row, uint32_t width, uint32_t c,
+			   uint8_t *out, uint32_t stride)
+{
+	for (uint32_t x = 0; x < width; x++)
+		out[x * stride] = row[x * 4 + c];
+}
+
+static void pack_planar(struct video_frame *dst, const uint8_t *row0,
+			const uint8_t *row1, uint32_t y, uint32_t width,
+			const struct format_desc *desc, bool has_alpha)
+{
+	pack_component(row0, width, 0, out_row(dst, 0, y), 1);
+	if (has_alpha)
+		pack_component(row0, width, 3, out_row(dst, 3, y), 1);
+
+	if (desc->chroma_shift_x) {
+		uint32_t chroma_y = y >> desc->chroma_shift_y;
+		const uint8_t *avg_row = desc->chroma_shift_y ? row1 : NULL;
+
+		pack_chroma(row0, avg_row, width, 1, out_row(dst, 1, chroma_y),
+			    1);
+		pack_chroma(row0, avg_row, width, 2, out_row(dst, 2, chroma_y),
+			    1);
+	} else {
+		pack_component(row0, width, 1, out_row(dst, 1, y), 1);
+		pack_component(row0, width, 2, out_row(dst, 2, y), 1);
+	}
+}
+
+static void pack_packed_422(uint8_t *row, const uint8_t *in, uint32_t width,
+			    uint32_t lum_ofs, uint32_t u_ofs, uint32_t v_ofs)
+{
+	pack_component(in, width, 0, row + lum_ofs, 2);
+	pack_chroma(in, NULL, width, 1, row + u_ofs, 4);
+	pack_chroma(in, NULL, width, 2, row + v_ofs, 4);
+}
+
+static void pack_packed(uint8_t *row, const uint8_t *in, uint32_t width,
+			uint32_t bpp, int c0, int c1, int c2, int a)
+{
+	pack_component(in, width, 0, row + c0, bpp);
+	pack_component(in, width, 1, row + c1, bpp);
+	pack_component(in, width, 2, row + c2, bpp);
+	if (a >= 0)
+		pack_component(in, width, 3, row + a, bpp);
+}
+
+static void pack_second_row(enum video_format format, struct video_frame *dst,
+			    const uint8_t *row1, uint32_t y, uint32_t width)
+{
+	pack_component(row1, width, 0, out_row(dst, 0, y), 1);
+	if (format == VIDEO_FORMAT_I40A)
+		pack_component(row1, width, 3, out_row(dst, 3, y), 1);
+}
+
+/* packs row y from row0.  for 4:2:0 formats this is called once per pair of
+ * rows and also writes row y + 1 from row1 */
+static void pack_rows(enum video_format format, struct video_frame *dst,
+		      const uint8_t *row0, const uint8_t *row1, uint32_t y,
+		      uint32_t width, const struct format_desc *desc)
+{
+	uint8_t *row = out_row(dst, 0, y);
+
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_I422:
+	case VIDEO_FORMAT_I444:
+		pack_planar(dst, row0, row1, y, width, desc, false);
+		break;
+	case VIDEO_FORMAT_I40A:
+	case VIDEO_FORMAT_I42A:
+	case VIDEO_FORMAT_YUVA:
+		pack_planar(dst, row0, row1, y, width, desc, true);
+		break;
+	case VIDEO_FORMAT_NV12: {
+		uint8_t *uv = out_row(dst, 1, y >> 1);
+
+		pack_component(row0, width, 0, row, 1);
+		pack_chroma(row0, row1, width, 1, uv, 2);
+		pack_chroma(row0, row1, width, 2, uv + 1, 2);
+		break;
+	}
+	case VIDEO_FORMAT_YUY2:
+		pack_packed_422(row, row0, width, 0, 1, 3);
+		break;
+	case VIDEO_FORMAT_YVYU:
+		pack_packed_422(row, row0, width, 0, 3, 1);
+		break;
+	case VIDEO_FORMAT_UYVY:
+		pack_packed_422(row, row0, width, 1, 0, 2);
+		break;
+	case VIDEO_FORMAT_Y800:
+		pack_component(row0, width, 0, row, 1);
+		break;
+	case VIDEO_FORMAT_AYUV:
+	case VIDEO_FORMAT_RGBA:
+		pack_packed(row, row0, width, 4, 0, 1, 2, 3);
+		break;
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+		pack_packed(row, row0, width, 4, 2, 1, 0, 3);
+		break;
+	case VIDEO_FORMAT_BGR3:
+		pack_packed(row, row0, width, 3, 2, 1, 0, -1);
+		break;
+	case VIDEO_FORMAT_NONE:;
+	}
+
+	if (desc->chroma_shift_y)
+		pack_second_row(format, dst, row1, y + 1, width);
+}
+
+static void get_color_matrix(enum video_colorspace colorspace,
+			     enum video_range_type range, bool to_rgb,
+			     struct color_matrix *cm)
+{
+	float matrix[16];
+	double a[3][3];
+	double ofs[3];
+
+	video_format_get_parameters(colorspace, range, matrix, NULL, NULL);
+
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 3; c++)
+			a[r][c] = matrix[r * 4 + c];
+		ofs[r] = matrix[r * 4 + 3] * 255.0;
+	}
+
+	/* the matrix is YUV -> RGB, invert it for RGB -> YUV */
+	if (!to_rgb) {
+		double inv[3][3];
+		double inv_ofs[3];
+		double det = a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) -
+			     a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+			     a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+
+		inv[0][0] = (a[1][1] * a[2][2] - a[1][2] * a[2][1]) / det;
+		inv[0][1] = (a[0][2] * a[2][1] - a[0][1] * a[2][2]) / det;
+		inv[0][2] = (a[0][1] * a[1][2] - a[0][2] * a[1][1]) / det;
+		inv[1][0] = (a[1][2] * a[2][0] - a[1][0] * a[2][2]) / det;
+		inv[1][1] = (a[0][0] * a[2][2] - a[0][2] * a[2][0]) / det;
+		inv[1][2] = (a[0][2] * a[1][0] - a[0][0] * a[1][2]) / det;
+		inv[2][0] = (a[1][0] * a[2][1] - a[1][1] * a[2][0]) / det;
+		inv[2][1] = (a[0][1] * a[2][0] - a[0][0] * a[2][1]) / det;
+		inv[2][2] = (a[0][0] * a[1][1] - a[0][1] * a[1][0]) / det;
+
+		for (int r = 0; r < 3; r++)
+			inv_ofs[r] = -(inv[r][0] * ofs[0] + inv[r][1] * ofs[1] +
+				       inv[r][2] * ofs[2]);
+
+		memcpy(a, inv, sizeof(a));
+		memcpy(ofs, inv_ofs, sizeof(ofs));
+	}
+
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 3; c++)
+			cm->m[r][c] = (int32_t)lround(a[r][c] * MATRIX_ONE);
+		cm->m[r][3] = (int32_t)lround(ofs[r] * MATRIX_ONE);
+	}
+}
+
+/* unpacks a row with the SIMD kernels, false if the format has no fast
+ * path.  scratch holds at least width bytes. */
+static bool unpack_row_simd(const struct conversion_kernels *k,
+			    enum video_format format,
+			    const struct video_frame *src, uint32_t y,
+			    uint32_t width, uint8_t *scratch, uint8_t *out)
+{
+	const uint8_t *row = in_row(src, 0, y);
+	uint32_t cw = width / 2;
+
+	switch (format) {
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+		k->convert_rgb32(row, out, width, format != VIDEO_FORMAT_RGBA,
+				 format == VIDEO_FORMAT_BGRX);
+		return true;
+	case VIDEO_FORMAT_I420:
+		k->merge_yuv(row, in_row(src, 1, y / 2), in_row(src, 2, y / 2),
+			     out, width, true);
+		return true;
+	case VIDEO_FORMAT_I422:
+		k->merge_yuv(row, in_row(src, 1, y), in_row(src, 2, y), out,
+			     width, true);
+		return true;
+	case VIDEO_FORMAT_I444:
+		k->merge_yuv(row, in_row(src, 1, y), in_row(src, 2, y), out,
+			     width, false);
+		return true;
+	case VIDEO_FORMAT_NV12:
+		k->deinterleave_uv(in_row(src, 1, y / 2), scratch,
+				   scratch + cw, cw);
+		k->merge_yuv(row, scratch, scratch + cw, out, width, true);
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* packs a row (a pair of rows for 4:2:0) with the SIMD kernels, false if
+ * the format has no fast path.  scratch holds at least width * 5 bytes. */
+static bool pack_rows_simd(const struct conversion_kernels *k,
+			   enum video_format format, struct video_frame *dst,
+			   const uint8_t *row0, const uint8_t *row1,
+			   uint32_t y, uint32_t width, uint8_t *scratch)
+{
+	uint8_t *row = out_row(dst, 0, y);
+	uint32_t cw = width / 2;
+	uint8_t *u0 = scratch;
+	uint8_t *v0 = scratch + width;
+	uint8_t *u1 = scratch + width * 2;
+	uint8_t *v1 = scratch + width * 3;
+	uint8_t *u = scratch + width * 4;
+	uint8_t *v = u + cw;
+
+	switch (format) {
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+		k->convert_rgb32(row0, row, width, format != VIDEO_FORMAT_RGBA,
+				 false);
+		return true;
+	case VIDEO_FORMAT_I444:
+		k->split_yuv(row0, row, out_row(dst, 1, y), out_row(dst, 2, y),
+			     width);
+		return true;
+	case VIDEO_FORMAT_I422:
+		k->split_yuv(row0, row, u0, v0, width);
+		k->downsample(u0, NULL, out_row(dst, 1, y), cw);
+		k->downsample(v0, NULL, out_row(dst, 2, y), cw);
+		return true;
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_NV12:
+		k->split_yuv(row0, row, u0, v0, width);
+		k->split_yuv(row1, out_row(dst, 0, y + 1), u1, v1, width);
+
+		if (format == VIDEO_FORMAT_NV12) {
+			k->downsample(u0, u1, u, cw);
+			k->downsample(v0, v1, v, cw);
+			k->interleave_uv(u, v, out_row(dst, 1, y / 2), cw);
+		} else {
+			k->downsample(u0, u1, out_row(dst, 1, y / 2), cw);
+			k->downsample(v0, v1, out_row(dst, 2, y / 2), cw);
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* kernels is NULL for the scalar reference path */
+static void convert_through_444(const struct conversion_kernels *kernels,
+				struct video_frame *dst,
+				enum video_format dst_format,
+				const struct format_desc *out_desc,
+				const struct video_frame *src,
+				enum video_format src_format,
+				const struct format_desc *in_desc,
+				uint32_t width, uint32_t height,
+				enum video_colorspace colorspace,
+				enum video_range_type range)
+{
+	uint32_t step = out_desc->chroma_shift_y ? 2 : 1;
+	uint8_t *rows = bmalloc(width * 13);
+	uint8_t *row0 = rows;
+	uint8_t *row1 = rows + width * 4;
+	uint8_t *scratch = rows + width * 8;
+	struct color_matrix cm;
+	bool use_matrix = in_desc->family != out_desc->family;
+
+	if (use_matrix)
+		get_color_matrix(colorspace, range,
+				 out_desc->family == FAMILY_RGB, &cm);
+
+	for (uint32_t y = 0; y < height; y += step) {
+		for (uint32_t i = 0; i < step; i++) {
+			uint8_t *out = i ? row1 : row0;
+
+			if (!kernels || !unpack_row_simd(kernels, src_format,
+							 src, y + i, width,
+							 scratch, out))
+				unpack_row(src_format, src, y + i, width, out);
+
+			if (!use_matrix)
+				continue;
+			if (kernels)
+				kernels->apply_matrix(out, width, &cm);
+			else
+				apply_matrix_c(out, width, &cm);
+		}
+
+		if (!kernels ||
+		    !pack_rows_simd(kernels, dst_format, dst, row0,
+				    step == 2 ? row1 : NULL, y, width, scratch))
+			pack_rows(dst_format, dst, row0,
+				  step == 2 ? row1 : NULL, y, width, out_desc);
+	}
+
+	bfree(rows);
+}
+
+/* ------------------------------------------------------------------------- */
+/* direct conversions using the SIMD row kernels                             */
+
+static inline bool is_packed_422(enum video_format format)
+{
+	return format == VIDEO_FORMAT_YUY2 || format == VIDEO_FORMAT_YVYU ||
+	       format == VIDEO_FORMAT_UYVY;
+}
+
+static inline bool is_rgb32(enum video_format format)
+{
+	return format == VIDEO_FORMAT_RGBA || format == VIDEO_FORMAT_BGRA ||
+	       format == VIDEO_FORMAT_BGRX;
+}
+
+static inline bool has_luma_plane(enum video_format format)
+{
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_I422:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_I40A:
+	case VIDEO_FORMAT_I42A:
+	case VIDEO_FORMAT_YUVA:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void copy_plane(struct video_frame *dst, const struct video_frame *src,
+		       size_t plane, uint32_t row_bytes, uint32_t rows)
+{
+	for (uint32_t y = 0; y < rows; y++)
+		memcpy(out_row(dst, plane, y), in_row(src, plane, y),
+		       row_bytes);
+}
+
+static void split_422_frame(const struct conversion_kernels *k,
+			    struct video_frame *dst,
+			    enum video_format dst_format,
+			    const struct video_frame *src,
+			    enum video_format src_format, uint32_t width,
+			    uint32_t height)
+{
+	bool leading_lum = src_format != VIDEO_FORMAT_UYVY;
+	bool swap_uv = src_format == VIDEO_FORMAT_YVYU;
+	uint32_t cw = width / 2;
+	uint8_t *tmp = bmalloc(cw * 6);
+	uint8_t *u0 = tmp, *v0 = tmp + cw;
+	uint8_t *u1 = tmp + cw * 2, *v1 = tmp + cw * 3;
+	uint8_t *u = tmp + cw * 4, *v = tmp + cw * 5;
+
+	if (dst_format == VIDEO_FORMAT_I422) {
+		for (uint32_t y = 0; y < height; y++) {
+			uint8_t *out_u = out_row(dst, 1, y);
+			uint8_t *out_v = out_row(dst, 2, y);
+
+			k->split_422(in_row(src, 0, y), out_row(dst, 0, y),
+				     swap_uv ? out_v : out_u,
+				     swap_uv ? out_u : out_v, width,
+				     leading_lum);
+		}
+
+		bfree(tmp);
+		return;
+	}
+
+	for (uint32_t y = 0; y < height; y += 2) {
+		k->split_422(in_row(src, 0, y), out_row(dst, 0, y),
+			     swap_uv ? v0 : u0, swap_uv ? u0 : v0, width,
+			     leading_lum);
+		k->split_422(in_row(src, 0, y + 1), out_row(dst, 0, y + 1),
+			     swap_uv ? v1 : u1, swap_uv ? u1 : v1, width,
+			     leading_lum);
+
+		if (dst_format == VIDEO_FORMAT_NV12) {
+			k->avg_rows(u0, u1, u, cw);
+			k->avg_rows(v0, v1, v, cw);
+			k->interleave_uv(u, v, out_row(dst, 1, y / 2), cw);
+		} else {
+			k->avg_rows(u0, u1, out_row(dst, 1, y / 2), cw);
+			k->avg_rows(v0, v1, out_row(dst, 2, y / 2), cw);
+		}
+	}
+
+	bfree(tmp);
+}
+
+static bool convert_direct(const struct conversion_kernels *k,
+			   struct video_frame *dst,
+			   enum video_format dst_format,
+			   const struct video_frame *src,
+			   enum video_format src_format, uint32_t width,
+			   uint32_t height)
+{
+	uint32_t cw = width / 2;
+	uint32_t ch = height / 2;
+
+	if (src_format == VIDEO_FORMAT_NV12 &&
+	    dst_format == VIDEO_FORMAT_I420) {
+		copy_plane(dst, src, 0, width, height);
+		for (uint32_t y = 0; y < ch; y++)
+			k->deinterleave_uv(in_row(src, 1, y),
+					   out_row(dst, 1, y),
+					   out_row(dst, 2, y), cw);
+		return true;
+	}
+
+	if (src_format == VIDEO_FORMAT_I420 &&
+	    dst_format == VIDEO_FORMAT_NV12) {
+		copy_plane(dst, src, 0, width, height);
+		for (uint32_t y = 0; y < ch; y++)
+			k->interleave_uv(in_row(src, 1, y), in_row(src, 2, y),
+					 out_row(dst, 1, y), cw);
+		return true;
+	}
+
+	if (is_packed_422(src_format) && (dst_format == VIDEO_FORMAT_I420 ||
+					  dst_format == VIDEO_FORMAT_NV12 ||
+					  dst_format == VIDEO_FORMAT_I422)) {
+		split_422_frame(k, dst, dst_format, src, src_format, width,
+				height);
+		return true;
+	}
+
+	if (is_rgb32(src_format) && is_rgb32(dst_format)) {
+		bool swap_rb = (src_format == VIDEO_FORMAT_RGBA) !=
+			       (dst_format == VIDEO_FORMAT_RGBA);
+		bool set_alpha = src_format == VIDEO_FORMAT_BGRX;
+
+		for (uint32_t y = 0; y < height; y++)
+			k->convert_rgb32(in_row(src, 0, y), out_row(dst, 0, y),
+					 width, swap_rb, set_alpha);
+		return true;
+	}
+
+	if (has_luma_plane(src_format) && dst_format == VIDEO_FORMAT_Y800) {
+		copy_plane(dst, src, 0, width, height);
+		return true;
+	}
+
+	return false;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void copy_frame(struct video_frame *dst, const struct video_frame *src,
+		       enum video_format format, uint32_t width,
+		       uint32_t height)
+{
+	struct format_desc desc;
+	uint32_t cw, ch;
+
+	get_format_desc(format, &desc);
+	cw = width >> desc.chroma_shift_x;
+	ch = height >> desc.chroma_shift_y;
+
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_I422:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_I40A:
+	case VIDEO_FORMAT_I42A:
+	case VIDEO_FORMAT_YUVA:
+		copy_plane(dst, src, 0, width, height);
+		copy_plane(dst, src, 1, cw, ch);
+		copy_plane(dst, src, 2, cw, ch);
+		if (format == VIDEO_FORMAT_I40A ||
+		    format == VIDEO_FORMAT_I42A || format == VIDEO_FORMAT_YUVA)
+			copy_plane(dst, src, 3, width, height);
+		break;
+	case VIDEO_FORMAT_NV12:
+		copy_plane(dst, src, 0, width, height);
+		copy_plane(dst, src, 1, width, ch);
+		break;
+	case VIDEO_FORMAT_YVYU:
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+		copy_plane(dst, src, 0, width * 2, height);
+		break;
+	case VIDEO_FORMAT_Y800:
+		copy_plane(dst, src, 0, width, height);
+		break;
+	case VIDEO_FORMAT_BGR3:
+		copy_plane(dst, src, 0, width * 3, height);
+		break;
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+	case VIDEO_FORMAT_AYUV:
+		copy_plane(dst, src, 0, width * 4, height);
+		break;
+	case VIDEO_FORMAT_NONE:;
+	}
+}
+
+static bool get_conversion_descs(enum video_format dst_format,
+				 enum video_format src_format, uint32_t width,
+				 uint32_t height, struct format_desc *out_desc,
+				 struct format_desc *in_desc)
+{
+	if (!get_format_desc(src_format, in_desc) ||
+	    !get_format_desc(dst_format, out_desc))
+		return false;
+
+	return !(((in_desc->chroma_shift_x || out_desc->chroma_shift_x) &&
+		  (width & 1) != 0) ||
+		 ((in_desc->chroma_shift_y || out_desc->chroma_shift_y) &&
+		  (height & 1) != 0));
+}
+
+static bool convert_frame(const struct conversion_kernels *kernels,
+			  struct video_frame *dst,
+			  enum video_format dst_format,
+			  const struct video_frame *src,
+			  enum video_format src_format, uint32_t width,
+			  uint32_t height, enum video_colorspace colorspace,
+			  enum video_range_type range)
+{
+	struct format_desc in_desc;
+	struct format_desc out_desc;
+
+	if (!dst || !src)
+		return false;
+	if (!get_conversion_descs(dst_format, src_format, width, height,
+				  &out_desc, &in_desc))
+		return false;
+	if (!width || !height)
+		return true;
+
+	if (src_format == dst_format) {
+		copy_frame(dst, src, src_format, width, height);
+		return true;
+	}
+
+	if (kernels && convert_direct(kernels, dst, dst_format, src,
+				      src_format, width, height))
+		return true;
+
+	convert_through_444(kernels, dst, dst_format, &out_desc, src,
+			    src_format, &in_desc, width, height, colorspace,
+			    range);
+	return true;
+}
+
+bool video_frame_convert_supported(enum video_format dst_format,
+				   enum video_format src_format,
+				   uint32_t width, uint32_t height)
+{
+	struct format_desc in_desc;
+	struct format_desc out_desc;
+
+	return get_conversion_descs(dst_format, src_format, width, height,
+				    &out_desc, &in_desc);
+}
+
+bool video_frame_convert(struct video_frame *dst, enum video_format dst_format,
+			 const struct video_frame *src,
+			 enum video_format src_format, uint32_t width,
+			 uint32_t height, enum video_colorspace colorspace,
+			 enum video_range_type range)
+{
+	return convert_frame(get_kernels(), dst, dst_format, src, src_format,
+			     width, height, colorspace, range);
+}
+
+bool video_frame_convert_reference(struct video_frame *dst,
+				   enum video_format dst_format,
+				   const struct video_frame *src,
+				   enum video_format src_format,
+				   uint32_t width, uint32_t height,
+				   enum video_colorspace colorspace,
+				   enum video_range_type range)
+{
+	return convert_frame(NULL, dst, dst_format, src, src_format, width,
+			     height, colorspace, range);
+}
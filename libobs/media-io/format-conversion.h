@@ -18,6 +18,7 @@
 #pragma once
 
 #include "../util/c99defs.h"
+#include "video-io.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -56,6 +57,41 @@ EXPORT void decompress_422(const uint8_t *input, uint32_t in_linesize,
 			   uint32_t start_y, uint32_t end_y, uint8_t *output,
 			   uint32_t out_linesize, bool leading_lum);
 
+/*
+ * Generic CPU conversion between any two of the 8-bit video formats.
+ *
+ * Common pairs (NV12 <-> I420, packed 4:2:2 -> planar, RGBA <-> BGRA/BGRX,
+ * luma extraction) use SIMD kernels picked at runtime (AVX2 or SSE2, NEON
+ * through simde on ARM).  Everything else converts through a 4:4:4
+ * intermediate, where the color matrix and the RGB32, I420, NV12, I422 and
+ * I444 rows also use SIMD kernels.  Colorspace and range are only used to
+ * convert between YUV and RGB.  Width and height must be even for chroma
+ * subsampled formats.
+ */
+
+EXPORT bool video_frame_convert(struct video_frame *dst,
+				enum video_format dst_format,
+				const struct video_frame *src,
+				enum video_format src_format, uint32_t width,
+				uint32_t height,
+				enum video_colorspace colorspace,
+				enum video_range_type range);
+
+/* whether video_frame_convert can convert between the formats at this size */
+EXPORT bool video_frame_convert_supported(enum video_format dst_format,
+					  enum video_format src_format,
+					  uint32_t width, uint32_t height);
+
+/* scalar reference implementation of video_frame_convert, used for tests */
+EXPORT bool video_frame_convert_reference(
+	struct video_frame *dst, enum video_format dst_format,
+	const struct video_frame *src, enum video_format src_format,
+	uint32_t width, uint32_t height, enum video_colorspace colorspace,
+	enum video_range_type range);
+
+/* name of the SIMD kernel set video_frame_convert uses on this CPU */
+EXPORT const char *video_frame_convert_get_kernel_name(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -40,12 +40,22 @@ struct cached_frame_info {
 	int count;
 };
 
+/* Inputs are kept sorted from largest to smallest output size.  Scaled inputs
+ * form a rendition ladder: each one scales from the smallest larger input of
+ * the same format (1080p -> 720p -> 480p) rather than from the full frame, and
+ * inputs with identical conversions share a single scaled frame. */
 struct video_input {
 	struct video_scale_info conversion;
+	struct video_scale_info scale_from;
+	size_t ladder_src;
 	video_scaler_t *scaler;
+	bool convert_format;
 	struct video_frame frame[MAX_CONVERT_BUFFERS];
 	int cur_frame;
 
+	struct video_data cur;
+	bool cur_valid;
+
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
 };
@@ -55,6 +65,8 @@ static inline void video_input_free(struct video_input *input)
 	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
 		video_frame_free(&input->frame[i]);
 	video_scaler_destroy(input->scaler);
+	input->scaler = NULL;
+	input->convert_format = false;
 }
 
 struct video_output {
@@ -85,12 +97,31 @@ struct video_output {
 
 /* ------------------------------------------------------------------------- */
 
+static bool convert_video_format(struct video_input *input,
+				 struct video_frame *frame,
+				 const struct video_data *data)
+{
+	struct video_frame src;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		src.data[i] = data->data[i];
+		src.linesize[i] = data->linesize[i];
+	}
+
+	return video_frame_convert(frame, input->conversion.format, &src,
+				   input->scale_from.format,
+				   input->conversion.width,
+				   input->conversion.height,
+				   input->conversion.colorspace,
+				   input->conversion.range);
+}
+
 static inline bool scale_video_output(struct video_input *input,
 				      struct video_data *data)
 {
 	bool success = true;
 
-	if (input->scaler) {
+	if (input->scaler || input->convert_format) {
 		struct video_frame *frame;
 
 		if (++input->cur_frame == MAX_CONVERT_BUFFERS)
@@ -98,10 +129,13 @@ static inline bool scale_video_output(struct video_input *input,
 
 		frame = &input->frame[input->cur_frame];
 
-		success = video_scaler_scale(input->scaler, frame->data,
-					     frame->linesize,
-					     (const uint8_t *const *)data->data,
-					     data->linesize);
+		if (input->convert_format)
+			success = convert_video_format(input, frame, data);
+		else
+			success = video_scaler_scale(
+				input->scaler, frame->data, frame->linesize,
+				(const uint8_t *const *)data->data,
+				data->linesize);
 
 		if (success) {
 			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
@@ -138,8 +172,22 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		struct video_input *input = video->inputs.array + i;
 		struct video_data frame = frame_info->frame;
 
-		if (scale_video_output(input, &frame))
+		if (input->ladder_src != DARRAY_INVALID) {
+			struct video_input *src =
+				video->inputs.array + input->ladder_src;
+			if (!src->cur_valid) {
+				input->cur_valid = false;
+				continue;
+			}
+
+			frame = src->cur;
+		}
+
+		input->cur_valid = scale_video_output(input, &frame);
+		if (input->cur_valid) {
+			input->cur = frame;
 			input->callback(input->param, &frame);
+		}
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
@@ -297,22 +345,53 @@ static size_t video_get_input_idx(const video_t *video,
 	return DARRAY_INVALID;
 }
 
-static inline bool video_input_init(struct video_input *input,
-				    struct video_output *video)
+static inline void get_full_frame_info(const struct video_output *video,
+				       struct video_scale_info *info)
 {
-	if (input->conversion.width != video->info.width ||
-	    input->conversion.height != video->info.height ||
-	    input->conversion.format != video->info.format) {
-		struct video_scale_info from = {.format = video->info.format,
-						.width = video->info.width,
-						.height = video->info.height,
-						.range = video->info.range,
-						.colorspace =
-							video->info.colorspace};
+	info->format = video->info.format;
+	info->width = video->info.width;
+	info->height = video->info.height;
+	info->range = video->info.range;
+	info->colorspace = video->info.colorspace;
+}
+
+static inline bool scale_info_equal(const struct video_scale_info *a,
+				    const struct video_scale_info *b)
+{
+	return a->format == b->format && a->width == b->width &&
+	       a->height == b->height && a->range == b->range &&
+	       a->colorspace == b->colorspace;
+}
 
-		int ret = video_scaler_create(&input->scaler,
-					      &input->conversion, &from,
-					      VIDEO_SCALE_FAST_BILINEAR);
+/* a conversion that only changes the pixel format is done with the SIMD
+ * converter instead of swscale */
+static inline bool can_convert_format(const struct video_scale_info *to,
+				      const struct video_scale_info *from)
+{
+	return to->width == from->width && to->height == from->height &&
+	       to->range == from->range &&
+	       to->colorspace == from->colorspace &&
+	       video_frame_convert_supported(to->format, from->format,
+					     to->width, to->height);
+}
+
+static bool video_input_init(struct video_input *input,
+			     const struct video_scale_info *from)
+{
+	video_input_free(input);
+	input->scale_from = *from;
+
+	if (input->conversion.width != from->width ||
+	    input->conversion.height != from->height ||
+	    input->conversion.format != from->format) {
+		int ret = VIDEO_SCALER_SUCCESS;
+
+		if (can_convert_format(&input->conversion, from))
+			input->convert_format = true;
+		else
+			ret = video_scaler_create(&input->scaler,
+						  &input->conversion, from,
+						  VIDEO_SCALE_FAST_BILINEAR);
 		if (ret != VIDEO_SCALER_SUCCESS) {
 			if (ret == VIDEO_SCALER_BAD_CONVERSION)
 				blog(LOG_ERROR, "video_input_init: Bad "
@@ -334,6 +413,69 @@ static inline bool video_input_init(struct video_input *input,
 	return true;
 }
 
+static inline uint64_t input_area(const struct video_input *input)
+{
+	return (uint64_t)input->conversion.width * input->conversion.height;
+}
+
+/* finds the smallest input ahead of this one that it can be scaled from
+ * without any format, range or colorspace conversion */
+static size_t find_ladder_src(const struct video_output *video, size_t idx)
+{
+	const struct video_input *input = video->inputs.array + idx;
+	size_t best = DARRAY_INVALID;
+
+	for (size_t i = 0; i < idx; i++) {
+		const struct video_input *src = video->inputs.array + i;
+
+		if (src->conversion.format != input->conversion.format ||
+		    src->conversion.range != input->conversion.range ||
+		    src->conversion.colorspace !=
+			    input->conversion.colorspace)
+			continue;
+		if (src->conversion.width < input->conversion.width ||
+		    src->conversion.height < input->conversion.height)
+			continue;
+
+		if (best == DARRAY_INVALID ||
+		    input_area(src) <= input_area(video->inputs.array + best))
+			best = i;
+	}
+
+	return best;
+}
+
+static void update_ladder(struct video_output *video)
+{
+	struct video_scale_info full;
+	get_full_frame_info(video, &full);
+
+	for (size_t i = 0; i < video->inputs.num; i++) {
+		struct video_input *input = video->inputs.array + i;
+		size_t src_idx = find_ladder_src(video, i);
+		struct video_scale_info from = full;
+
+		if (src_idx != DARRAY_INVALID)
+			from = video->inputs.array[src_idx].conversion;
+
+		input->ladder_src = src_idx;
+		input->cur_valid = false;
+
+		if (scale_info_equal(&from, &input->scale_from))
+			continue;
+
+		if (!video_input_init(input, &from)) {
+			input->ladder_src = DARRAY_INVALID;
+			video_input_init(input, &full);
+			continue;
+		}
+
+		blog(LOG_DEBUG, "video-io: %ux%u input scaled from %ux%u",
+		     input->conversion.width, input->conversion.height,
+		     from.width, from.height);
+	}
+}
+
 static inline void reset_frames(video_t *video)
 {
 	os_atomic_set_long(&video->skipped_frames, 0);
@@ -371,15 +513,27 @@ bool video_output_connect(
 		if (input.conversion.height == 0)
 			input.conversion.height = video->info.height;
 
-		success = video_input_init(&input, video);
+		struct video_scale_info full;
+		get_full_frame_info(video, &full);
+
+		success = video_input_init(&input, &full);
 		if (success) {
+			size_t idx = 0;
+
 			if (video->inputs.num == 0) {
 				if (!os_atomic_load_long(&video->gpu_refs)) {
 					reset_frames(video);
 				}
 				os_atomic_set_bool(&video->raw_active, true);
 			}
-			da_push_back(video->inputs, &input);
+
+			while (idx < video->inputs.num &&
+			       input_area(video->inputs.array + idx) >=
+				       input_area(&input))
+				idx++;
+
+			da_insert(video->inputs, idx, &input);
+			update_ladder(video);
 		}
 	}
 
@@ -419,6 +573,7 @@ void video_output_disconnect(video_t *video,
 	if (idx != DARRAY_INVALID) {
 		video_input_free(video->inputs.array + idx);
 		da_erase(video->inputs, idx);
+		update_ladder(video);
 
 		if (video->inputs.num == 0) {
 			os_atomic_set_bool(&video->raw_active, false);
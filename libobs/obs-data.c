@@ -20,18 +20,24 @@
 #include "util/dstr.h"
 #include "util/darray.h"
 #include "util/platform.h"
+#include "util/profiler.h"
 #include "graphics/vec2.h"
 #include "graphics/vec3.h"
 #include "graphics/vec4.h"
 #include "graphics/quat.h"
 #include "obs-data.h"
 
+#include <errno.h>
+#include <locale.h>
+#include <math.h>
 #include <jansson.h>
 
 struct obs_data_item {
 	volatile long ref;
 	struct obs_data *parent;
 	struct obs_data_item *next;
+	struct obs_data_item *hash_next;
+	uint32_t hash;
 	enum obs_data_type type;
 	size_t name_len;
 	size_t data_len;
@@ -46,10 +52,25 @@ struct obs_data {
 	volatile long ref;
 	char *json;
 	struct obs_data_item *first_item;
+	struct obs_data_item *last_item;
+
+	/* built once an object has enough items for a scan to matter */
+	struct obs_data_item **buckets;
+	size_t num_buckets;
+	size_t num_items;
+
+	/* changes with every modification, for incremental binary saves */
+	int64_t generation;
+
+	/* objects loaded from binary data read their items on first use */
+	struct data_blob *blob;
+	size_t blob_offset;
+	volatile bool lazy;
 };
 
 struct obs_data_array {
 	volatile long ref;
+	int64_t generation;
 	DARRAY(obs_data_t *) objects;
 };
 
@@ -61,6 +82,47 @@ struct obs_data_number {
 	};
 };
 
+/* every object and array gets a new generation when it is created or
+ * changed, so a pointer and a generation identify its contents.  64 bits
+ * so that generations are never reused, long is 32 bits on Windows */
+static volatile int64_t data_generation = 0;
+
+static inline int64_t next_generation(void)
+{
+#ifdef _MSC_VER
+	int64_t val;
+
+	do {
+		val = data_generation;
+	} while (_InterlockedCompareExchange64(&data_generation, val + 1,
+					       val) != val);
+
+	return val + 1;
+#else
+	return __atomic_add_fetch(&data_generation, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline void mark_changed(struct obs_data *data)
+{
+	if (data)
+		data->generation = next_generation();
+}
+
+static inline void mark_array_changed(struct obs_data_array *array)
+{
+	array->generation = next_generation();
+}
+
+static void load_lazy_data(struct obs_data *data);
+static void release_blob_data(struct obs_data *data);
+
+static inline void load_lazy(struct obs_data *data)
+{
+	if (data && os_atomic_load_bool(&data->lazy))
+		load_lazy_data(data);
+}
+
 /* ------------------------------------------------------------------------- */
 /* Item structure, designed to be one allocation only */
 
@@ -261,6 +323,128 @@ static inline void item_autoselect_data_addref(struct obs_data_item *item)
 	}
 }
 
+/* ------------------------------------------------------------------------- */
+/* Item hash table
+ *
+ * Items stay in a sorted linked list for iteration and saving, the hash
+ * table only chains the same items again by the hash of their name.  The
+ * hash is kept in the item, so most mismatches never reach strcmp. */
+
+#define HASH_MIN_ITEMS 8
+#define HASH_MIN_BUCKETS 16
+
+static inline uint32_t hash_name(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static inline struct obs_data_item **get_bucket(struct obs_data *data,
+						 uint32_t hash)
+{
+	return &data->buckets[hash & (data->num_buckets - 1)];
+}
+
+static void rehash_items(struct obs_data *data, size_t num_buckets)
+{
+	struct obs_data_item *item;
+
+	bfree(data->buckets);
+	data->buckets = bzalloc(sizeof(*data->buckets) * num_buckets);
+	data->num_buckets = num_buckets;
+
+	for (item = data->first_item; item; item = item->next) {
+		struct obs_data_item **bucket = get_bucket(data, item->hash);
+
+		item->hash_next = *bucket;
+		*bucket = item;
+	}
+}
+
+/* expects the item to already be in the list */
+static void hash_insert(struct obs_data *data, struct obs_data_item *item)
+{
+	struct obs_data_item **bucket;
+
+	/* once the table exists it stays, even if erases drop the count
+	 * below the threshold again */
+	if (++data->num_items < HASH_MIN_ITEMS && !data->buckets)
+		return;
+
+	if (data->num_items > data->num_buckets) {
+		rehash_items(data, data->num_buckets ? data->num_buckets * 2
+						     : HASH_MIN_BUCKETS);
+		return;
+	}
+
+	bucket = get_bucket(data, item->hash);
+	item->hash_next = *bucket;
+	*bucket = item;
+}
+
+static void hash_remove(struct obs_data *data, struct obs_data_item *item)
+{
+	struct obs_data_item **prev_next;
+
+	data->num_items--;
+
+	if (!data->buckets)
+		return;
+
+	prev_next = get_bucket(data, item->hash);
+	while (*prev_next) {
+		if (*prev_next == item) {
+			*prev_next = item->hash_next;
+			item->hash_next = NULL;
+			break;
+		}
+
+		prev_next = &(*prev_next)->hash_next;
+	}
+}
+
+static void hash_replace(struct obs_data *data, struct obs_data_item *old_ptr,
+			 struct obs_data_item *new_ptr)
+{
+	struct obs_data_item **prev_next;
+
+	if (!data->buckets)
+		return;
+
+	prev_next = get_bucket(data, new_ptr->hash);
+	while (*prev_next) {
+		if (*prev_next == old_ptr) {
+			*prev_next = new_ptr;
+			break;
+		}
+
+		prev_next = &(*prev_next)->hash_next;
+	}
+}
+
+static struct obs_data_item *get_last_item(struct obs_data *data)
+{
+	struct obs_data_item *item = data->last_item;
+
+	if (!item && data->first_item) {
+		item = data->first_item;
+		while (item->next)
+			item = item->next;
+
+		data->last_item = item;
+	}
+
+	return item;
+}
+
+/* ------------------------------------------------------------------------- */
+
 static struct obs_data_item *obs_data_item_create(const char *name,
 						  const void *data, size_t size,
 						  enum obs_data_type type,
@@ -297,6 +481,7 @@ static struct obs_data_item *obs_data_item_create(const char *name,
 
 	strcpy(get_item_name(item), name);
 	memcpy(get_item_data(item), data, size);
+	item->hash = hash_name(name);
 
 	item_data_addref(item);
 	return item;
@@ -324,23 +509,33 @@ static struct obs_data_item **get_item_prev_next(struct obs_data *data,
 
 static inline void obs_data_item_detach(struct obs_data_item *item)
 {
-	struct obs_data_item **prev_next =
-		get_item_prev_next(item->parent, item);
+	struct obs_data *data = item->parent;
+	struct obs_data_item **prev_next = get_item_prev_next(data, item);
 
 	if (prev_next) {
 		*prev_next = item->next;
 		item->next = NULL;
+
+		if (data->last_item == item)
+			data->last_item = NULL;
+		hash_remove(data, item);
+		mark_changed(data);
 	}
 }
 
 static inline void obs_data_item_reattach(struct obs_data_item *old_ptr,
 					  struct obs_data_item *new_ptr)
 {
-	struct obs_data_item **prev_next =
-		get_item_prev_next(new_ptr->parent, old_ptr);
+	struct obs_data *data = new_ptr->parent;
+	struct obs_data_item **prev_next = get_item_prev_next(data, old_ptr);
 
-	if (prev_next)
+	if (prev_next) {
 		*prev_next = new_ptr;
+
+		if (data->last_item == old_ptr)
+			data->last_item = new_ptr;
+		hash_replace(data, old_ptr, new_ptr);
+	}
 }
 
 static struct obs_data_item *
@@ -621,394 +816,2044 @@ static json_t *obs_data_to_json(obs_data_t *data)
 }
 
 /* ------------------------------------------------------------------------- */
+/* Streaming Json loading
+ *
+ * Files are read in chunks and their values are set directly into the data
+ * objects as they are parsed, instead of building a complete jansson tree
+ * first.  Values are handled the same way as obs_data_add_json_item: arrays
+ * only keep their objects, and nulls are skipped. */
+
+#define JSON_READ_SIZE 65536
+#define JSON_MAX_DEPTH 2048
+
+struct json_reader {
+	FILE *file;
+	char buf[JSON_READ_SIZE];
+	size_t pos;
+	size_t size;
 
-obs_data_t *obs_data_create()
+	int line;
+	int depth;
+	const char *error;
+	struct dstr str;
+};
+
+static bool json_fill(struct json_reader *r)
 {
-	struct obs_data *data = bzalloc(sizeof(struct obs_data));
-	data->ref = 1;
+	if (r->pos < r->size)
+		return true;
 
-	return data;
+	r->pos = 0;
+	r->size = fread(r->buf, 1, JSON_READ_SIZE, r->file);
+	return r->size > 0;
 }
 
-obs_data_t *obs_data_create_from_json(const char *json_string)
+static inline int json_peek(struct json_reader *r)
 {
-	obs_data_t *data = obs_data_create();
+	return json_fill(r) ? (uint8_t)r->buf[r->pos] : EOF;
+}
 
-	json_error_t error;
-	json_t *root = json_loads(json_string, JSON_REJECT_DUPLICATES, &error);
+static inline int json_getc(struct json_reader *r)
+{
+	int c = json_peek(r);
 
-	if (root) {
-		obs_data_add_json_object_data(data, root);
-		json_decref(root);
-	} else {
-		blog(LOG_ERROR,
-		     "obs-data.c: [obs_data_create_from_json] "
-		     "Failed reading json string (%d): %s",
-		     error.line, error.text);
-		obs_data_release(data);
-		data = NULL;
+	if (c != EOF) {
+		r->pos++;
+		if (c == '\n')
+			r->line++;
 	}
 
-	return data;
+	return c;
 }
 
-obs_data_t *obs_data_create_from_json_file(const char *json_file)
+static inline int json_skip_whitespace(struct json_reader *r)
 {
-	char *file_data = os_quick_read_utf8_file(json_file);
-	obs_data_t *data = NULL;
+	int c = json_peek(r);
 
-	if (file_data) {
-		data = obs_data_create_from_json(file_data);
-		bfree(file_data);
+	while (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+		json_getc(r);
+		c = json_peek(r);
 	}
 
-	return data;
+	return c;
 }
 
-obs_data_t *obs_data_create_from_json_file_safe(const char *json_file,
-						const char *backup_ext)
+static inline bool json_fail(struct json_reader *r, const char *error)
 {
-	obs_data_t *file_data = obs_data_create_from_json_file(json_file);
-	if (!file_data && backup_ext && *backup_ext) {
-		struct dstr backup_file = {0};
+	if (!r->error)
+		r->error = error;
+	return false;
+}
 
-		dstr_copy(&backup_file, json_file);
-		if (*backup_ext != '.')
-			dstr_cat(&backup_file, ".");
-		dstr_cat(&backup_file, backup_ext);
+static bool json_expect(struct json_reader *r, char expected,
+			const char *error)
+{
+	if (json_skip_whitespace(r) != expected)
+		return json_fail(r, error);
 
-		if (os_file_exists(backup_file.array)) {
-			blog(LOG_WARNING,
-			     "obs-data.c: "
-			     "[obs_data_create_from_json_file_safe] "
-			     "attempting backup file");
+	json_getc(r);
+	return true;
+}
 
-			/* delete current file if corrupt to prevent it from
-			 * being backed up again */
-			os_rename(backup_file.array, json_file);
+static int json_read_hex(struct json_reader *r)
+{
+	int val = 0;
 
-			file_data = obs_data_create_from_json_file(json_file);
-		}
+	for (int i = 0; i < 4; i++) {
+		int c = json_getc(r);
 
-		dstr_free(&backup_file);
+		val <<= 4;
+		if (c >= '0' && c <= '9')
+			val |= c - '0';
+		else if (c >= 'a' && c <= 'f')
+			val |= c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			val |= c - 'A' + 10;
+		else
+			return -1;
 	}
 
-	return file_data;
+	return val;
 }
 
-void obs_data_addref(obs_data_t *data)
+static void json_cat_utf8(struct dstr *str, int32_t ch)
 {
-	if (data)
-		os_atomic_inc_long(&data->ref);
+	char utf8[4];
+	size_t len;
+
+	if (ch < 0x80) {
+		utf8[0] = (char)ch;
+		len = 1;
+	} else if (ch < 0x800) {
+		utf8[0] = (char)(0xC0 | (ch >> 6));
+		utf8[1] = (char)(0x80 | (ch & 0x3F));
+		len = 2;
+	} else if (ch < 0x10000) {
+		utf8[0] = (char)(0xE0 | (ch >> 12));
+		utf8[1] = (char)(0x80 | ((ch >> 6) & 0x3F));
+		utf8[2] = (char)(0x80 | (ch & 0x3F));
+		len = 3;
+	} else {
+		utf8[0] = (char)(0xF0 | (ch >> 18));
+		utf8[1] = (char)(0x80 | ((ch >> 12) & 0x3F));
+		utf8[2] = (char)(0x80 | ((ch >> 6) & 0x3F));
+		utf8[3] = (char)(0x80 | (ch & 0x3F));
+		len = 4;
+	}
+
+	dstr_ncat(str, utf8, len);
 }
 
-static inline void obs_data_destroy(struct obs_data *data)
+/* same rules as jansson: no overlong forms, surrogates or code points past
+ * U+10FFFF */
+static bool json_valid_utf8(const char *str, size_t len)
 {
-	struct obs_data_item *item = data->first_item;
+	const uint8_t *p = (const uint8_t *)str;
+	const uint8_t *end = p + len;
 
-	while (item) {
-		struct obs_data_item *next = item->next;
-		obs_data_item_release(&item);
-		item = next;
+	while (p < end) {
+		uint8_t c = *p++;
+		int32_t ch;
+		size_t count;
+
+		if (c < 0x80)
+			continue;
+		else if (c >= 0xC2 && c <= 0xDF)
+			count = 1, ch = c & 0x1F;
+		else if (c >= 0xE0 && c <= 0xEF)
+			count = 2, ch = c & 0x0F;
+		else if (c >= 0xF0 && c <= 0xF4)
+			count = 3, ch = c & 0x07;
+		else
+			return false;
+
+		if ((size_t)(end - p) < count)
+			return false;
+
+		for (size_t i = 0; i < count; i++) {
+			if ((p[i] & 0xC0) != 0x80)
+				return false;
+			ch = (ch << 6) | (p[i] & 0x3F);
+		}
+		p += count;
+
+		if ((count == 2 && ch < 0x800) ||
+		    (count == 3 && ch < 0x10000) ||
+		    (ch >= 0xD800 && ch <= 0xDFFF) || ch > 0x10FFFF)
+			return false;
 	}
 
-	/* NOTE: don't use bfree for json text, allocated by json */
-	free(data->json);
-	bfree(data);
+	return true;
 }
 
-void obs_data_release(obs_data_t *data)
+static bool json_read_escape(struct json_reader *r, struct dstr *str)
 {
-	if (!data)
-		return;
+	int32_t ch;
+	int c = json_getc(r);
 
-	if (os_atomic_dec_long(&data->ref) == 0)
-		obs_data_destroy(data);
-}
+	switch (c) {
+	case '"':
+	case '\\':
+	case '/':
+		dstr_cat_ch(str, (char)c);
+		return true;
+	case 'b':
+		dstr_ncat(str, "\b", 1);
+		return true;
+	case 'f':
+		dstr_ncat(str, "\f", 1);
+		return true;
+	case 'n':
+		dstr_ncat(str, "\n", 1);
+		return true;
+	case 'r':
+		dstr_ncat(str, "\r", 1);
+		return true;
+	case 't':
+		dstr_ncat(str, "\t", 1);
+		return true;
+	case 'u':
+		break;
+	default:
+		return json_fail(r, "invalid escape");
+	}
 
-const char *obs_data_get_json(obs_data_t *data)
-{
-	if (!data)
-		return NULL;
+	ch = json_read_hex(r);
+	if (ch < 0)
+		return json_fail(r, "invalid escape");
 
-	/* NOTE: don't use libobs bfree for json text */
-	free(data->json);
-	data->json = NULL;
+	if (ch >= 0xD800 && ch <= 0xDBFF) {
+		int32_t low;
 
-	json_t *root = obs_data_to_json(data);
-	data->json = json_dumps(root, JSON_PRESERVE_ORDER | JSON_INDENT(4));
-	json_decref(root);
+		if (json_getc(r) != '\\' || json_getc(r) != 'u')
+			return json_fail(r, "invalid Unicode escape");
 
-	return data->json;
-}
+		low = json_read_hex(r);
+		if (low < 0xDC00 || low > 0xDFFF)
+			return json_fail(r, "invalid Unicode escape");
 
-bool obs_data_save_json(obs_data_t *data, const char *file)
-{
-	const char *json = obs_data_get_json(data);
+		ch = (((ch & 0x3FF) << 10) | (low & 0x3FF)) + 0x10000;
 
-	if (json && *json) {
-		return os_quick_write_utf8_file(file, json, strlen(json),
-						false);
+	} else if (ch >= 0xDC00 && ch <= 0xDFFF) {
+		return json_fail(r, "invalid Unicode escape");
+
+	} else if (ch == 0) {
+		return json_fail(r, "\\u0000 is not allowed");
 	}
 
-	return false;
+	json_cat_utf8(str, ch);
+	return true;
 }
 
-bool obs_data_save_json_safe(obs_data_t *data, const char *file,
-			     const char *temp_ext, const char *backup_ext)
+static bool json_read_string(struct json_reader *r, struct dstr *str)
 {
-	const char *json = obs_data_get_json(data);
+	dstr_resize(str, 0);
+	json_getc(r);
 
-	if (json && *json) {
-		return os_quick_write_utf8_file_safe(
-			file, json, strlen(json), false, temp_ext, backup_ext);
+	for (;;) {
+		size_t start;
+		int c;
+
+		if (!json_fill(r))
+			return json_fail(r, "premature end of input");
+
+		/* copy plain runs straight out of the read buffer */
+		start = r->pos;
+		while (r->pos < r->size) {
+			c = (uint8_t)r->buf[r->pos];
+			if (c == '"' || c == '\\' || c < 0x20)
+				break;
+			r->pos++;
+		}
+
+		if (r->pos > start)
+			dstr_ncat(str, r->buf + start, r->pos - start);
+		if (r->pos == r->size)
+			continue;
+
+		c = json_getc(r);
+		if (c == '"')
+			break;
+		if (c != '\\')
+			return json_fail(r, "control character in string");
+		if (!json_read_escape(r, str))
+			return false;
 	}
 
-	return false;
+	if (!json_valid_utf8(str->array, str->len))
+		return json_fail(r, "invalid UTF-8 in string");
+
+	/* keep empty strings valid */
+	if (!str->array)
+		dstr_copy(str, "");
+	return true;
 }
 
-static struct obs_data_item *get_item(struct obs_data *data, const char *name)
+static bool json_read_digits(struct json_reader *r, struct dstr *num)
 {
-	if (!data)
-		return NULL;
-
-	struct obs_data_item *item = data->first_item;
+	int c = json_peek(r);
 
-	while (item) {
-		if (strcmp(get_item_name(item), name) == 0)
-			return item;
+	if (c < '0' || c > '9')
+		return false;
 
-		item = item->next;
+	while (c >= '0' && c <= '9') {
+		dstr_cat_ch(num, (char)json_getc(r));
+		c = json_peek(r);
 	}
 
-	return NULL;
+	return true;
 }
 
-static void set_item_data(struct obs_data *data, struct obs_data_item **item,
-			  const char *name, const void *ptr, size_t size,
-			  enum obs_data_type type, bool default_data,
-			  bool autoselect_data)
+/* jansson does the same: strtod follows the locale's decimal point */
+static double json_strtod(struct dstr *num)
 {
-	obs_data_item_t *new_item = NULL;
+	const char *point = localeconv()->decimal_point;
 
-	if ((!item || (item && !*item)) && data) {
-		new_item = obs_data_item_create(name, ptr, size, type,
-						default_data, autoselect_data);
+	if (point && *point && *point != '.')
+		dstr_replace(num, ".", point);
 
-		obs_data_item_t *prev = obs_data_first(data);
-		obs_data_item_t *next = obs_data_first(data);
-		obs_data_item_next(&next);
-		for (; prev && next;
-		     obs_data_item_next(&prev), obs_data_item_next(&next)) {
-			if (strcmp(get_item_name(next), name) > 0)
-				break;
-		}
+	return strtod(num->array, NULL);
+}
 
-		new_item->parent = data;
-		if (prev && strcmp(get_item_name(prev), name) < 0) {
-			prev->next = new_item;
-			new_item->next = next;
+static bool json_read_number(struct json_reader *r, obs_data_t *data,
+			     const char *key)
+{
+	struct dstr *num = &r->str;
+	bool real = false;
+	int c;
 
-		} else {
-			data->first_item = new_item;
-			new_item->next = prev;
-		}
+	dstr_resize(num, 0);
 
-		if (!prev)
-			data->first_item = new_item;
+	if (json_peek(r) == '-')
+		dstr_cat_ch(num, (char)json_getc(r));
 
-		obs_data_item_release(&prev);
-		obs_data_item_release(&next);
+	if (json_peek(r) == '0') {
+		dstr_cat_ch(num, (char)json_getc(r));
+		c = json_peek(r);
+		if (c >= '0' && c <= '9')
+			return json_fail(r, "invalid token");
 
-	} else if (default_data) {
-		obs_data_item_set_default_data(item, ptr, size, type);
-	} else if (autoselect_data) {
-		obs_data_item_set_autoselect_data(item, ptr, size, type);
-	} else {
-		obs_data_item_setdata(item, ptr, size, type);
+	} else if (!json_read_digits(r, num)) {
+		return json_fail(r, "invalid token");
 	}
-}
+
+	if (json_peek(r) == '.') {
+		real = true;
+		dstr_cat_ch(num, (char)json_getc(r));
+		if (!json_read_digits(r, num))
+			return json_fail(r, "invalid token");
+	}
+
+	c = json_peek(r);
+	if (c == 'e' || c == 'E') {
+		real = true;
+		dstr_cat_ch(num, (char)json_getc(r));
+
+		c = json_peek(r);
+		if (c == '+' || c == '-')
+			dstr_cat_ch(num, (char)json_getc(r));
+		if (!json_read_digits(r, num))
+			return json_fail(r, "invalid token");
+	}
+
+	if (!real) {
+		long long val;
+
+		errno = 0;
+		val = strtoll(num->array, NULL, 10);
+		if (errno == ERANGE)
+			return json_fail(r, "too big integer");
+
+		if (data)
+			obs_data_set_int(data, key, val);
+
+	} else {
+		double val = json_strtod(num);
+
+		if (isinf(val))
+			return json_fail(r, "real number overflow");
+
+		if (data)
+			obs_data_set_double(data, key, val);
+	}
+
+	return true;
+}
+
+static bool json_read_literal(struct json_reader *r, const char *literal)
+{
+	for (; *literal; literal++) {
+		if (json_getc(r) != (uint8_t)*literal)
+			return json_fail(r, "invalid token");
+	}
+
+	return true;
+}
+
+static bool json_read_value(struct json_reader *r, obs_data_t *data,
+			    const char *key);
+
+/* a NULL data object parses and drops the values */
+static bool json_read_object(struct json_reader *r, obs_data_t *data)
+{
+	struct dstr item_key = {0};
+	bool success = false;
+	int c;
+
+	if (++r->depth > JSON_MAX_DEPTH) {
+		json_fail(r, "maximum parsing depth reached");
+		goto exit;
+	}
+
+	json_getc(r);
+
+	if (json_skip_whitespace(r) == '}') {
+		json_getc(r);
+		success = true;
+		goto exit;
+	}
+
+	for (;;) {
+		if (json_skip_whitespace(r) != '"') {
+			json_fail(r, "string or '}' expected");
+			goto exit;
+		}
+		if (!json_read_string(r, &item_key))
+			goto exit;
+
+		if (data && obs_data_has_user_value(data, item_key.array)) {
+			json_fail(r, "duplicate object key");
+			goto exit;
+		}
+
+		if (!json_expect(r, ':', "':' expected"))
+			goto exit;
+		if (!json_read_value(r, data, item_key.array))
+			goto exit;
+
+		c = json_skip_whitespace(r);
+		json_getc(r);
+
+		if (c == '}')
+			break;
+		if (c != ',') {
+			json_fail(r, "'}' expected");
+			goto exit;
+		}
+	}
+
+	success = true;
+
+exit:
+	r->depth--;
+	dstr_free(&item_key);
+	return success;
+}
+
+static bool json_read_array(struct json_reader *r, obs_data_array_t *array)
+{
+	bool success = false;
+	int c;
+
+	if (++r->depth > JSON_MAX_DEPTH) {
+		json_fail(r, "maximum parsing depth reached");
+		goto exit;
+	}
+
+	json_getc(r);
+
+	if (json_skip_whitespace(r) == ']') {
+		json_getc(r);
+		success = true;
+		goto exit;
+	}
+
+	for (;;) {
+		if (json_skip_whitespace(r) == '{' && array) {
+			obs_data_t *item = obs_data_create();
+			bool item_success = json_read_object(r, item);
+
+			obs_data_array_push_back(array, item);
+			obs_data_release(item);
+
+			if (!item_success)
+				goto exit;
+
+		} else if (!json_read_value(r, NULL, NULL)) {
+			goto exit;
+		}
+
+		c = json_skip_whitespace(r);
+		json_getc(r);
+
+		if (c == ']')
+			break;
+		if (c != ',') {
+			json_fail(r, "']' expected");
+			goto exit;
+		}
+	}
+
+	success = true;
+
+exit:
+	r->depth--;
+	return success;
+}
+
+static bool json_read_value(struct json_reader *r, obs_data_t *data,
+			    const char *key)
+{
+	int c = json_skip_whitespace(r);
+
+	if (c == '{') {
+		obs_data_t *obj = data ? obs_data_create() : NULL;
+		bool success = json_read_object(r, obj);
+
+		if (data)
+			obs_data_set_obj(data, key, obj);
+		obs_data_release(obj);
+		return success;
+
+	} else if (c == '[') {
+		obs_data_array_t *array = data ? obs_data_array_create()
+					       : NULL;
+		bool success = json_read_array(r, array);
+
+		if (data)
+			obs_data_set_array(data, key, array);
+		obs_data_array_release(array);
+		return success;
+
+	} else if (c == '"') {
+		if (!json_read_string(r, &r->str))
+			return false;
+		if (data)
+			obs_data_set_string(data, key, r->str.array);
+		return true;
+
+	} else if (c == '-' || (c >= '0' && c <= '9')) {
+		return json_read_number(r, data, key);
+
+	} else if (c == 't') {
+		if (!json_read_literal(r, "true"))
+			return false;
+		if (data)
+			obs_data_set_bool(data, key, true);
+		return true;
+
+	} else if (c == 'f') {
+		if (!json_read_literal(r, "false"))
+			return false;
+		if (data)
+			obs_data_set_bool(data, key, false);
+		return true;
+
+	} else if (c == 'n') {
+		return json_read_literal(r, "null");
+	}
+
+	return json_fail(r, c == EOF ? "premature end of input"
+				     : "invalid token");
+}
+
+static obs_data_t *obs_data_read_json_file(FILE *file, const char *path)
+{
+	struct json_reader *r = bzalloc(sizeof(struct json_reader));
+	obs_data_t *data = obs_data_create();
+	bool success;
+	int c;
+
+	r->file = file;
+	r->line = 1;
+
+	/* skip the UTF-8 BOM */
+	if (json_fill(r) && r->size >= 3 &&
+	    memcmp(r->buf, "\xEF\xBB\xBF", 3) == 0)
+		r->pos = 3;
+
+	c = json_skip_whitespace(r);
+	if (c == '{')
+		success = json_read_object(r, data);
+	else if (c == '[')
+		success = json_read_array(r, NULL);
+	else
+		success = json_fail(r, "'[' or '{' expected");
+
+	if (success && json_skip_whitespace(r) != EOF)
+		success = json_fail(r, "end of file expected");
+
+	if (!success) {
+		blog(LOG_ERROR,
+		     "obs-data.c: [obs_data_create_from_json_file] "
+		     "Failed reading json file '%s' (%d): %s",
+		     path, r->line, r->error);
+		obs_data_release(data);
+		data = NULL;
+	}
+
+	dstr_free(&r->str);
+	bfree(r);
+	return data;
+}
+
+/* ------------------------------------------------------------------------- */
+
+obs_data_t *obs_data_create()
+{
+	struct obs_data *data = bzalloc(sizeof(struct obs_data));
+	data->ref = 1;
+	mark_changed(data);
+
+	return data;
+}
+
+obs_data_t *obs_data_create_from_json(const char *json_string)
+{
+	obs_data_t *data = obs_data_create();
+
+	json_error_t error;
+	json_t *root = json_loads(json_string, JSON_REJECT_DUPLICATES, &error);
+
+	if (root) {
+		obs_data_add_json_object_data(data, root);
+		json_decref(root);
+	} else {
+		blog(LOG_ERROR,
+		     "obs-data.c: [obs_data_create_from_json] "
+		     "Failed reading json string (%d): %s",
+		     error.line, error.text);
+		obs_data_release(data);
+		data = NULL;
+	}
+
+	return data;
+}
+
+static const char *create_from_json_file_name =
+	"obs_data_create_from_json_file";
+
+obs_data_t *obs_data_create_from_json_file(const char *json_file)
+{
+	obs_data_t *data = NULL;
+	FILE *file;
+
+	if (!json_file)
+		return NULL;
+
+	file = os_fopen(json_file, "rb");
+	if (!file)
+		return NULL;
+
+	profile_start(create_from_json_file_name);
+	data = obs_data_read_json_file(file, json_file);
+	profile_end(create_from_json_file_name);
+
+	fclose(file);
+	return data;
+}
+
+obs_data_t *obs_data_create_from_json_file_safe(const char *json_file,
+						const char *backup_ext)
+{
+	obs_data_t *file_data = obs_data_create_from_json_file(json_file);
+	if (!file_data && backup_ext && *backup_ext) {
+		struct dstr backup_file = {0};
+
+		dstr_copy(&backup_file, json_file);
+		if (*backup_ext != '.')
+			dstr_cat(&backup_file, ".");
+		dstr_cat(&backup_file, backup_ext);
+
+		if (os_file_exists(backup_file.array)) {
+			blog(LOG_WARNING,
+			     "obs-data.c: "
+			     "[obs_data_create_from_json_file_safe] "
+			     "attempting backup file");
+
+			/* delete current file if corrupt to prevent it from
+			 * being backed up again */
+			os_rename(backup_file.array, json_file);
+
+			file_data = obs_data_create_from_json_file(json_file);
+		}
+
+		dstr_free(&backup_file);
+	}
+
+	return file_data;
+}
+
+void obs_data_addref(obs_data_t *data)
+{
+	if (data)
+		os_atomic_inc_long(&data->ref);
+}
+
+static inline void obs_data_destroy(struct obs_data *data)
+{
+	struct obs_data_item *item = data->first_item;
+
+	while (item) {
+		struct obs_data_item *next = item->next;
+		obs_data_item_release(&item);
+		item = next;
+	}
+
+	/* NOTE: don't use bfree for json text, allocated by json */
+	free(data->json);
+	bfree(data->buckets);
+	release_blob_data(data);
+	bfree(data);
+}
+
+void obs_data_release(obs_data_t *data)
+{
+	if (!data)
+		return;
+
+	if (os_atomic_dec_long(&data->ref) == 0)
+		obs_data_destroy(data);
+}
+
+const char *obs_data_get_json(obs_data_t *data)
+{
+	if (!data)
+		return NULL;
+
+	/* NOTE: don't use libobs bfree for json text */
+	free(data->json);
+	data->json = NULL;
+
+	json_t *root = obs_data_to_json(data);
+	data->json = json_dumps(root, JSON_PRESERVE_ORDER | JSON_INDENT(4));
+	json_decref(root);
+
+	return data->json;
+}
+
+bool obs_data_save_json(obs_data_t *data, const char *file)
+{
+	const char *json = obs_data_get_json(data);
+
+	if (json && *json) {
+		return os_quick_write_utf8_file(file, json, strlen(json),
+						false);
+	}
+
+	return false;
+}
+
+bool obs_data_save_json_safe(obs_data_t *data, const char *file,
+			     const char *temp_ext, const char *backup_ext)
+{
+	const char *json = obs_data_get_json(data);
+
+	if (json && *json) {
+		return os_quick_write_utf8_file_safe(
+			file, json, strlen(json), false, temp_ext, backup_ext);
+	}
+
+	return false;
+}
+
+static struct obs_data_item *get_item(struct obs_data *data, const char *name)
+{
+	struct obs_data_item *item;
+	uint32_t hash;
+
+	if (!data)
+		return NULL;
+
+	load_lazy(data);
+	hash = hash_name(name);
+
+	if (data->buckets) {
+		item = *get_bucket(data, hash);
+
+		while (item) {
+			if (item->hash == hash &&
+			    strcmp(get_item_name(item), name) == 0)
+				return item;
+
+			item = item->hash_next;
+		}
+
+		return NULL;
+	}
+
+	item = data->first_item;
+
+	while (item) {
+		if (item->hash == hash &&
+		    strcmp(get_item_name(item), name) == 0)
+			return item;
+
+		item = item->next;
+	}
+
+	return NULL;
+}
+
+static void set_item_data(struct obs_data *data, struct obs_data_item **item,
+			  const char *name, const void *ptr, size_t size,
+			  enum obs_data_type type, bool default_data,
+			  bool autoselect_data)
+{
+	obs_data_item_t *new_item = NULL;
+
+	mark_changed(data ? data : (item && *item ? (*item)->parent : NULL));
+
+	if ((!item || (item && !*item)) && data) {
+		new_item = obs_data_item_create(name, ptr, size, type,
+						default_data, autoselect_data);
+		new_item->parent = data;
+
+		/* saved data is sorted already, so loading it only ever
+		 * appends */
+		obs_data_item_t *last = get_last_item(data);
+		if (!last || strcmp(get_item_name(last), name) < 0) {
+			if (last)
+				last->next = new_item;
+			else
+				data->first_item = new_item;
+
+			data->last_item = new_item;
+			hash_insert(data, new_item);
+			return;
+		}
+
+		obs_data_item_t *prev = obs_data_first(data);
+		obs_data_item_t *next = obs_data_first(data);
+		obs_data_item_next(&next);
+		for (; prev && next;
+		     obs_data_item_next(&prev), obs_data_item_next(&next)) {
+			if (strcmp(get_item_name(next), name) > 0)
+				break;
+		}
+
+		if (prev && strcmp(get_item_name(prev), name) < 0) {
+			prev->next = new_item;
+			new_item->next = next;
+
+		} else {
+			data->first_item = new_item;
+			new_item->next = prev;
+		}
+
+		if (!prev)
+			data->first_item = new_item;
+
+		obs_data_item_release(&prev);
+		obs_data_item_release(&next);
+
+		hash_insert(data, new_item);
+
+	} else if (default_data) {
+		obs_data_item_set_default_data(item, ptr, size, type);
+	} else if (autoselect_data) {
+		obs_data_item_set_autoselect_data(item, ptr, size, type);
+	} else {
+		obs_data_item_setdata(item, ptr, size, type);
+	}
+}
 
 static inline void set_item(struct obs_data *data, obs_data_item_t **item,
 			    const char *name, const void *ptr, size_t size,
 			    enum obs_data_type type)
 {
-	obs_data_item_t *actual_item = NULL;
+	obs_data_item_t *actual_item = NULL;
+
+	if (!data && !item)
+		return;
+
+	if (!item) {
+		actual_item = get_item(data, name);
+		item = &actual_item;
+	}
+
+	set_item_data(data, item, name, ptr, size, type, false, false);
+}
+
+static inline void set_item_def(struct obs_data *data, obs_data_item_t **item,
+				const char *name, const void *ptr, size_t size,
+				enum obs_data_type type)
+{
+	obs_data_item_t *actual_item = NULL;
+
+	if (!data && !item)
+		return;
+
+	if (!item) {
+		actual_item = get_item(data, name);
+		item = &actual_item;
+	}
+
+	if (item && *item && (*item)->type != type)
+		return;
+
+	set_item_data(data, item, name, ptr, size, type, true, false);
+}
+
+static inline void set_item_auto(struct obs_data *data, obs_data_item_t **item,
+				 const char *name, const void *ptr, size_t size,
+				 enum obs_data_type type)
+{
+	obs_data_item_t *actual_item = NULL;
+
+	if (!data && !item)
+		return;
+
+	if (!item) {
+		actual_item = get_item(data, name);
+		item = &actual_item;
+	}
+
+	set_item_data(data, item, name, ptr, size, type, false, true);
+}
+
+static void copy_obj(struct obs_data *data, const char *name,
+		     struct obs_data *obj,
+		     void (*callback)(obs_data_t *, const char *, obs_data_t *))
+{
+	if (obj) {
+		obs_data_t *new_obj = obs_data_create();
+		obs_data_apply(new_obj, obj);
+		callback(data, name, new_obj);
+		obs_data_release(new_obj);
+	}
+}
+
+static void copy_array(struct obs_data *data, const char *name,
+		       struct obs_data_array *array,
+		       void (*callback)(obs_data_t *, const char *,
+					obs_data_array_t *))
+{
+	if (array) {
+		obs_data_array_t *new_array = obs_data_array_create();
+		da_reserve(new_array->objects, array->objects.num);
+
+		for (size_t i = 0; i < array->objects.num; i++) {
+			obs_data_t *new_obj = obs_data_create();
+			obs_data_t *obj = array->objects.array[i];
+
+			obs_data_apply(new_obj, obj);
+			obs_data_array_push_back(new_array, new_obj);
+
+			obs_data_release(new_obj);
+		}
+
+		callback(data, name, new_array);
+		obs_data_array_release(new_array);
+	}
+}
+
+static inline void copy_item(struct obs_data *data, struct obs_data_item *item)
+{
+	const char *name = get_item_name(item);
+	void *ptr = get_item_data(item);
+
+	if (item->type == OBS_DATA_OBJECT) {
+		obs_data_t **obj = item->data_size ? ptr : NULL;
+
+		if (obj)
+			copy_obj(data, name, *obj, obs_data_set_obj);
+
+	} else if (item->type == OBS_DATA_ARRAY) {
+		obs_data_array_t **array = item->data_size ? ptr : NULL;
+
+		if (array)
+			copy_array(data, name, *array, obs_data_set_array);
+
+	} else {
+		if (item->data_size)
+			set_item(data, NULL, name, ptr, item->data_size,
+				 item->type);
+	}
+}
+
+void obs_data_apply(obs_data_t *target, obs_data_t *apply_data)
+{
+	struct obs_data_item *item;
+
+	if (!target || !apply_data || target == apply_data)
+		return;
+
+	load_lazy(apply_data);
+	item = apply_data->first_item;
+
+	while (item) {
+		copy_item(target, item);
+		item = item->next;
+	}
+}
+
+void obs_data_erase(obs_data_t *data, const char *name)
+{
+	struct obs_data_item *item = get_item(data, name);
+
+	if (item) {
+		obs_data_item_detach(item);
+		obs_data_item_release(&item);
+	}
+}
+
+static inline void clear_item(struct obs_data_item *item)
+{
+	void *ptr = get_item_data(item);
+	size_t size;
+
+	if (item->data_len) {
+		if (item->type == OBS_DATA_OBJECT) {
+			obs_data_t **obj = item->data_size ? ptr : NULL;
+
+			if (obj && *obj)
+				obs_data_release(*obj);
+
+		} else if (item->type == OBS_DATA_ARRAY) {
+			obs_data_array_t **array = item->data_size ? ptr : NULL;
+
+			if (array && *array)
+				obs_data_array_release(*array);
+		}
+
+		size = item->default_len + item->autoselect_size;
+		if (size)
+			memmove(ptr, (uint8_t *)ptr + item->data_len, size);
+
+		item->data_size = 0;
+		item->data_len = 0;
+	}
+}
+
+void obs_data_clear(obs_data_t *target)
+{
+	struct obs_data_item *item;
+
+	if (!target)
+		return;
+
+	load_lazy(target);
+	mark_changed(target);
+	item = target->first_item;
+
+	while (item) {
+		clear_item(item);
+		item = item->next;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* Binary format
+ *
+ * Numbers are little endian.  The file starts with a header:
+ *
+ *   "OBSD", u32 version, u64 root object offset, u64 string table offset
+ *
+ * An object is a u32 size of the rest of the object, a u32 item count, and
+ * its items, sorted by name: a u32 name index, a u8 type and the value.
+ * Values are a u32 string index, an i64, a double, a u8 bool, an object, or
+ * an array: a u32 size of the rest of the array, a u32 count and the
+ * objects.
+ *
+ * The string table holds every name and string value once: a u32 count, a
+ * u32 size of the string data, a u32 offset into the string data for each
+ * string, and the string data itself.
+ *
+ * Loaded files stay mapped, and objects only read their items when they are
+ * first used.  The sizes let objects skip their children until then. */
+
+#define BIN_MAGIC "OBSD"
+#define BIN_VERSION 1
+#define BIN_HEADER_SIZE 24
+
+enum bin_type {
+	BIN_STRING = 1,
+	BIN_INT,
+	BIN_DOUBLE,
+	BIN_BOOL,
+	BIN_OBJECT,
+	BIN_ARRAY,
+};
+
+struct data_blob {
+	volatile long ref;
+	pthread_mutex_t mutex;
+	size_t lazy_count;
+
+	os_file_map_t *map;
+	const uint8_t *data;
+	size_t size;
+
+	const uint8_t *offsets;
+	const char *strings;
+	uint32_t num_strings;
+};
+
+struct bin_reader {
+	const uint8_t *pos;
+	const uint8_t *end;
+	bool error;
+};
+
+static inline bool bin_check(struct bin_reader *r, size_t size)
+{
+	if (r->error || (size_t)(r->end - r->pos) < size) {
+		r->error = true;
+		return false;
+	}
+
+	return true;
+}
+
+static inline uint8_t bin_r8(struct bin_reader *r)
+{
+	return bin_check(r, 1) ? *(r->pos++) : 0;
+}
+
+static inline uint32_t bin_rl32(struct bin_reader *r)
+{
+	uint32_t val;
+
+	if (!bin_check(r, 4))
+		return 0;
+
+	val = (uint32_t)r->pos[0] | ((uint32_t)r->pos[1] << 8) |
+	      ((uint32_t)r->pos[2] << 16) | ((uint32_t)r->pos[3] << 24);
+	r->pos += 4;
+	return val;
+}
+
+static inline uint64_t bin_rl64(struct bin_reader *r)
+{
+	uint64_t lo = bin_rl32(r);
+	uint64_t hi = bin_rl32(r);
+	return lo | (hi << 32);
+}
+
+static inline const uint8_t *bin_skip(struct bin_reader *r, size_t size)
+{
+	const uint8_t *pos = r->pos;
+
+	if (!bin_check(r, size))
+		return NULL;
+
+	r->pos += size;
+	return pos;
+}
+
+static inline uint32_t read_l32(const uint8_t *data)
+{
+	return (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+	       ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static const char *blob_string(struct data_blob *blob, uint32_t idx)
+{
+	if (idx >= blob->num_strings)
+		return NULL;
+
+	return blob->strings + read_l32(blob->offsets + idx * 4);
+}
+
+static void blob_release(struct data_blob *blob)
+{
+	if (os_atomic_dec_long(&blob->ref) == 0) {
+		os_file_map_close(blob->map);
+		pthread_mutex_destroy(&blob->mutex);
+		bfree(blob);
+	}
+}
+
+/* expects the blob mutex to be locked, or the blob to not be shared yet */
+static obs_data_t *create_lazy_data(struct data_blob *blob, size_t offset)
+{
+	struct obs_data *data = obs_data_create();
+
+	os_atomic_inc_long(&blob->ref);
+	blob->lazy_count++;
+
+	data->blob = blob;
+	data->blob_offset = offset;
+	data->lazy = true;
+	return data;
+}
+
+/* the file is unmapped once no object needs to read from it anymore */
+static void finish_lazy_data(struct data_blob *blob)
+{
+	if (--blob->lazy_count == 0) {
+		os_file_map_close(blob->map);
+		blob->map = NULL;
+		blob->data = NULL;
+	}
+}
+
+static void release_blob_data(struct obs_data *data)
+{
+	struct data_blob *blob = data->blob;
+
+	if (!blob)
+		return;
+
+	if (data->lazy) {
+		pthread_mutex_lock(&blob->mutex);
+		finish_lazy_data(blob);
+		pthread_mutex_unlock(&blob->mutex);
+	}
+
+	blob_release(blob);
+}
+
+static inline void set_bin_item(struct obs_data *data, const char *name,
+				const void *ptr, size_t size,
+				enum obs_data_type type)
+{
+	set_item_data(data, NULL, name, ptr, size, type, false, false);
+}
+
+/* reads the size of an object or array and skips the rest of it */
+static bool skip_bin_value(struct bin_reader *r, size_t *offset,
+			   const uint8_t *start)
+{
+	uint32_t size;
+
+	*offset = (size_t)(r->pos - start);
+	size = bin_rl32(r);
+	return bin_skip(r, size) != NULL;
+}
+
+static bool read_bin_array(struct data_blob *blob, struct bin_reader *r,
+			   struct obs_data *data, const char *name)
+{
+	obs_data_array_t *array = obs_data_array_create();
+	struct bin_reader array_r;
+	uint32_t size = bin_rl32(r);
+	uint32_t count;
+
+	array_r.pos = bin_skip(r, size);
+	array_r.end = array_r.pos ? array_r.pos + size : NULL;
+	array_r.error = !array_r.pos;
+
+	count = bin_rl32(&array_r);
+
+	for (uint32_t i = 0; i < count && !array_r.error; i++) {
+		size_t offset;
+
+		if (skip_bin_value(&array_r, &offset, blob->data)) {
+			obs_data_t *obj = create_lazy_data(blob, offset);
+			obs_data_array_push_back(array, obj);
+			obs_data_release(obj);
+		}
+	}
+
+	set_bin_item(data, name, &array, sizeof(obs_data_array_t *),
+		     OBS_DATA_ARRAY);
+	obs_data_array_release(array);
+	return !array_r.error;
+}
+
+static bool read_bin_value(struct data_blob *blob, struct bin_reader *r,
+			   struct obs_data *data, const char *name)
+{
+	struct obs_data_number num;
+	uint8_t type = bin_r8(r);
+	const char *str;
+	obs_data_t *obj;
+	size_t offset;
+	uint64_t val;
+	bool b;
+
+	switch (type) {
+	case BIN_STRING:
+		str = blob_string(blob, bin_rl32(r));
+		if (!str)
+			return false;
+		set_bin_item(data, name, str, strlen(str) + 1, OBS_DATA_STRING);
+		break;
+	case BIN_INT:
+		num.type = OBS_DATA_NUM_INT;
+		num.int_val = (long long)bin_rl64(r);
+		set_bin_item(data, name, &num, sizeof(num), OBS_DATA_NUMBER);
+		break;
+	case BIN_DOUBLE:
+		val = bin_rl64(r);
+		num.type = OBS_DATA_NUM_DOUBLE;
+		memcpy(&num.double_val, &val, sizeof(double));
+		set_bin_item(data, name, &num, sizeof(num), OBS_DATA_NUMBER);
+		break;
+	case BIN_BOOL:
+		b = bin_r8(r) != 0;
+		set_bin_item(data, name, &b, sizeof(bool), OBS_DATA_BOOLEAN);
+		break;
+	case BIN_OBJECT:
+		if (!skip_bin_value(r, &offset, blob->data))
+			return false;
+		obj = create_lazy_data(blob, offset);
+		set_bin_item(data, name, &obj, sizeof(obs_data_t *),
+			     OBS_DATA_OBJECT);
+		obs_data_release(obj);
+		break;
+	case BIN_ARRAY:
+		return read_bin_array(blob, r, data, name);
+	default:
+		return false;
+	}
+
+	return !r->error;
+}
+
+static void read_bin_object(struct data_blob *blob, struct obs_data *data)
+{
+	struct bin_reader r = {blob->data + data->blob_offset,
+			       blob->data + blob->size, false};
+	const char *prev_name = NULL;
+	uint32_t size = bin_rl32(&r);
+	uint32_t count;
+
+	if (bin_check(&r, size))
+		r.end = r.pos + size;
+
+	count = bin_rl32(&r);
+
+	for (uint32_t i = 0; i < count && !r.error; i++) {
+		const char *name = blob_string(blob, bin_rl32(&r));
+
+		/* items have to be sorted like the item list */
+		if (!name || (prev_name && strcmp(prev_name, name) >= 0) ||
+		    !read_bin_value(blob, &r, data, name)) {
+			r.error = true;
+			break;
+		}
+
+		prev_name = name;
+	}
+
+	if (r.error)
+		blog(LOG_ERROR,
+		     "obs-data.c: [read_bin_object] "
+		     "Invalid object at offset %zu",
+		     data->blob_offset);
+}
+
+static void load_lazy_data(struct obs_data *data)
+{
+	struct data_blob *blob = data->blob;
+
+	pthread_mutex_lock(&blob->mutex);
+
+	if (os_atomic_load_bool(&data->lazy)) {
+		read_bin_object(blob, data);
+		finish_lazy_data(blob);
+		os_atomic_set_bool(&data->lazy, false);
+	}
+
+	pthread_mutex_unlock(&blob->mutex);
+}
+
+static bool init_blob_strings(struct data_blob *blob, uint64_t offset)
+{
+	struct bin_reader r;
+	uint32_t strings_size;
+
+	if (offset > blob->size)
+		return false;
+
+	r.pos = blob->data + offset;
+	r.end = blob->data + blob->size;
+	r.error = false;
+
+	blob->num_strings = bin_rl32(&r);
+	strings_size = bin_rl32(&r);
+
+	if (blob->num_strings > blob->size / 4)
+		return false;
+
+	blob->offsets = bin_skip(&r, (size_t)blob->num_strings * 4);
+	blob->strings = (const char *)bin_skip(&r, strings_size);
+	if (r.error)
+		return false;
+
+	/* makes sure every string ends inside of the string data */
+	if (blob->num_strings && (!strings_size ||
+				  blob->strings[strings_size - 1] != 0))
+		return false;
+
+	for (uint32_t i = 0; i < blob->num_strings; i++) {
+		if (read_l32(blob->offsets + i * 4) >= strings_size)
+			return false;
+	}
+
+	return true;
+}
+
+obs_data_t *obs_data_create_from_binary_file(const char *binary_file)
+{
+	struct data_blob *blob;
+	struct bin_reader r;
+	obs_data_t *data;
+	uint64_t root_offset;
+	uint64_t strings_offset;
+
+	os_file_map_t *map = os_file_map_open(binary_file);
+	if (!map)
+		return NULL;
+
+	blob = bzalloc(sizeof(struct data_blob));
+	if (pthread_mutex_init(&blob->mutex, NULL) != 0) {
+		os_file_map_close(map);
+		bfree(blob);
+		return NULL;
+	}
+
+	blob->ref = 1;
+	blob->map = map;
+	blob->data = os_file_map_data(map);
+	blob->size = os_file_map_size(map);
+
+	r.pos = blob->data;
+	r.end = blob->data + blob->size;
+	r.error = false;
+
+	if (!bin_check(&r, BIN_HEADER_SIZE) ||
+	    memcmp(r.pos, BIN_MAGIC, 4) != 0)
+		goto fail;
+
+	bin_skip(&r, 4);
+	if (bin_rl32(&r) != BIN_VERSION)
+		goto fail;
+
+	root_offset = bin_rl64(&r);
+	strings_offset = bin_rl64(&r);
+
+	if (root_offset >= blob->size)
+		goto fail;
+	if (!init_blob_strings(blob, strings_offset))
+		goto fail;
+
+	data = create_lazy_data(blob, (size_t)root_offset);
+	blob_release(blob);
+	return data;
+
+fail:
+	blog(LOG_ERROR,
+	     "obs-data.c: [obs_data_create_from_binary_file] "
+	     "Invalid binary file '%s'",
+	     binary_file);
+	blob_release(blob);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Binary writer
+ *
+ * A writer keeps the output of its last save and remembers where each
+ * object and array was written, along with the objects and arrays it
+ * contained.  If an object and everything below it is unchanged since then,
+ * the next save copies its bytes instead of encoding it again, without
+ * having to look at its items.  Names and strings keep their index across
+ * saves for this, so the string table only grows until it is rebuilt. */
+
+#define WRITER_MIN_STRINGS 4096
+
+struct bin_child {
+	const void *ptr;
+	bool array;
+};
+
+struct bin_entry {
+	const void *ptr;
+	int64_t generation;
+	size_t offset;
+	size_t size;
+	size_t first_child;
+	size_t num_children;
+
+	uint32_t checked;
+	bool clean;
+};
+
+struct bin_cache {
+	struct bin_entry *entries;
+	size_t capacity;
+	size_t num;
+
+	DARRAY(struct bin_child) children;
+};
+
+struct obs_data_writer {
+	DARRAY(uint8_t) buf;
+	DARRAY(uint8_t) prev_buf;
+	struct bin_cache cache;
+	struct bin_cache prev_cache;
+	DARRAY(struct bin_child) child_stack;
+	uint32_t save_id;
+
+	DARRAY(char) string_data;
+	DARRAY(uint32_t) string_offsets;
+	uint32_t *string_buckets;
+	size_t num_string_buckets;
+	size_t rebuild_strings;
+
+	size_t reused_bytes;
+};
+
+static inline size_t hash_ptr(const void *ptr)
+{
+	uintptr_t val = (uintptr_t)ptr;
+	val ^= val >> 17;
+	val *= 0x9E3779B1u;
+	return (size_t)(val ^ (val >> 15));
+}
 
-	if (!data && !item)
-		return;
+static struct bin_entry *cache_find(struct bin_cache *cache, const void *ptr)
+{
+	size_t mask = cache->capacity - 1;
+	size_t idx;
 
-	if (!item) {
-		actual_item = get_item(data, name);
-		item = &actual_item;
+	if (!cache->capacity)
+		return NULL;
+
+	for (idx = hash_ptr(ptr) & mask; cache->entries[idx].ptr;
+	     idx = (idx + 1) & mask) {
+		if (cache->entries[idx].ptr == ptr)
+			return &cache->entries[idx];
 	}
 
-	set_item_data(data, item, name, ptr, size, type, false, false);
+	return NULL;
 }
 
-static inline void set_item_def(struct obs_data *data, obs_data_item_t **item,
-				const char *name, const void *ptr, size_t size,
-				enum obs_data_type type)
+static void cache_insert(struct bin_cache *cache, const struct bin_entry *entry)
 {
-	obs_data_item_t *actual_item = NULL;
+	size_t mask = cache->capacity - 1;
+	size_t idx = hash_ptr(entry->ptr) & mask;
 
-	if (!data && !item)
-		return;
+	while (cache->entries[idx].ptr)
+		idx = (idx + 1) & mask;
 
-	if (!item) {
-		actual_item = get_item(data, name);
-		item = &actual_item;
+	cache->entries[idx] = *entry;
+	cache->num++;
+}
+
+static void cache_grow(struct bin_cache *cache)
+{
+	struct bin_entry *entries = cache->entries;
+	size_t capacity = cache->capacity;
+
+	cache->capacity = capacity ? capacity * 2 : 256;
+	cache->entries = bzalloc(sizeof(struct bin_entry) * cache->capacity);
+	cache->num = 0;
+
+	for (size_t i = 0; i < capacity; i++) {
+		if (entries[i].ptr)
+			cache_insert(cache, &entries[i]);
 	}
 
-	if (item && *item && (*item)->type != type)
+	bfree(entries);
+}
+
+/* no references are held: the generation of an object that was freed and
+ * reallocated at the same address is always different */
+static void cache_set(struct bin_cache *cache, const struct bin_entry *entry)
+{
+	struct bin_entry *existing = cache_find(cache, entry->ptr);
+
+	if (existing) {
+		*existing = *entry;
 		return;
+	}
 
-	set_item_data(data, item, name, ptr, size, type, true, false);
+	if ((cache->num + 1) * 2 > cache->capacity)
+		cache_grow(cache);
+
+	cache_insert(cache, entry);
 }
 
-static inline void set_item_auto(struct obs_data *data, obs_data_item_t **item,
-				 const char *name, const void *ptr, size_t size,
-				 enum obs_data_type type)
+static void cache_clear(struct bin_cache *cache)
 {
-	obs_data_item_t *actual_item = NULL;
+	if (cache->num)
+		memset(cache->entries, 0,
+		       sizeof(struct bin_entry) * cache->capacity);
+	cache->num = 0;
+	da_resize(cache->children, 0);
+}
 
-	if (!data && !item)
-		return;
+static void cache_free(struct bin_cache *cache)
+{
+	bfree(cache->entries);
+	da_free(cache->children);
+	memset(cache, 0, sizeof(*cache));
+}
 
-	if (!item) {
-		actual_item = get_item(data, name);
-		item = &actual_item;
-	}
+/* the children pushed since child_start become the children of the entry */
+static void cache_set_written(struct obs_data_writer *w, const void *ptr,
+			      int64_t generation, size_t offset,
+			      size_t child_start)
+{
+	struct bin_entry entry = {0};
 
-	set_item_data(data, item, name, ptr, size, type, false, true);
+	entry.ptr = ptr;
+	entry.generation = generation;
+	entry.offset = offset;
+	entry.size = w->buf.num - offset;
+	entry.first_child = w->cache.children.num;
+	entry.num_children = w->child_stack.num - child_start;
+
+	da_push_back_array(w->cache.children,
+			   w->child_stack.array + child_start,
+			   entry.num_children);
+	da_resize(w->child_stack, child_start);
+
+	cache_set(&w->cache, &entry);
 }
 
-static void copy_obj(struct obs_data *data, const char *name,
-		     struct obs_data *obj,
-		     void (*callback)(obs_data_t *, const char *, obs_data_t *))
+static inline void push_child(struct obs_data_writer *w, const void *ptr,
+			      bool array)
 {
-	if (obj) {
-		obs_data_t *new_obj = obs_data_create();
-		obs_data_apply(new_obj, obj);
-		callback(data, name, new_obj);
-		obs_data_release(new_obj);
+	struct bin_child child = {ptr, array};
+	da_push_back(w->child_stack, &child);
+}
+
+static inline void bin_w8(struct obs_data_writer *w, uint8_t val)
+{
+	da_push_back(w->buf, &val);
+}
+
+static inline void bin_patch32(struct obs_data_writer *w, size_t pos,
+			       uint32_t val)
+{
+	w->buf.array[pos] = (uint8_t)val;
+	w->buf.array[pos + 1] = (uint8_t)(val >> 8);
+	w->buf.array[pos + 2] = (uint8_t)(val >> 16);
+	w->buf.array[pos + 3] = (uint8_t)(val >> 24);
+}
+
+static inline void bin_wl32(struct obs_data_writer *w, uint32_t val)
+{
+	size_t pos = w->buf.num;
+
+	da_resize(w->buf, pos + 4);
+	bin_patch32(w, pos, val);
+}
+
+static inline void bin_wl64(struct obs_data_writer *w, uint64_t val)
+{
+	bin_wl32(w, (uint32_t)val);
+	bin_wl32(w, (uint32_t)(val >> 32));
+}
+
+static void rehash_strings(struct obs_data_writer *w)
+{
+	size_t num = w->num_string_buckets ? w->num_string_buckets * 2 : 1024;
+	size_t mask = num - 1;
+
+	bfree(w->string_buckets);
+	w->string_buckets = bzalloc(sizeof(uint32_t) * num);
+	w->num_string_buckets = num;
+
+	for (size_t i = 0; i < w->string_offsets.num; i++) {
+		const char *str =
+			w->string_data.array + w->string_offsets.array[i];
+		size_t idx = hash_name(str) & mask;
+
+		while (w->string_buckets[idx])
+			idx = (idx + 1) & mask;
+		w->string_buckets[idx] = (uint32_t)i + 1;
 	}
 }
 
-static void copy_array(struct obs_data *data, const char *name,
-		       struct obs_data_array *array,
-		       void (*callback)(obs_data_t *, const char *,
-					obs_data_array_t *))
+static uint32_t intern_string(struct obs_data_writer *w, const char *str)
 {
-	if (array) {
-		obs_data_array_t *new_array = obs_data_array_create();
-		da_reserve(new_array->objects, array->objects.num);
+	size_t mask = w->num_string_buckets - 1;
+	size_t idx = hash_name(str) & mask;
+	uint32_t offset;
+	uint32_t str_idx;
 
-		for (size_t i = 0; i < array->objects.num; i++) {
-			obs_data_t *new_obj = obs_data_create();
-			obs_data_t *obj = array->objects.array[i];
+	while (w->string_buckets[idx]) {
+		str_idx = w->string_buckets[idx] - 1;
+		if (strcmp(w->string_data.array +
+				   w->string_offsets.array[str_idx],
+			   str) == 0)
+			return str_idx;
 
-			obs_data_apply(new_obj, obj);
-			obs_data_array_push_back(new_array, new_obj);
+		idx = (idx + 1) & mask;
+	}
 
-			obs_data_release(new_obj);
-		}
+	str_idx = (uint32_t)w->string_offsets.num;
+	offset = (uint32_t)w->string_data.num;
+	da_push_back(w->string_offsets, &offset);
+	da_push_back_array(w->string_data, str, strlen(str) + 1);
+	w->string_buckets[idx] = str_idx + 1;
 
-		callback(data, name, new_array);
-		obs_data_array_release(new_array);
+	if (w->string_offsets.num * 2 > w->num_string_buckets)
+		rehash_strings(w);
+
+	return str_idx;
+}
+
+static int64_t get_generation(const struct bin_child *child)
+{
+	if (child->array)
+		return ((const struct obs_data_array *)child->ptr)->generation;
+
+	/* lazy objects were never written */
+	if (os_atomic_load_bool(&((struct obs_data *)child->ptr)->lazy))
+		return 0;
+
+	return ((const struct obs_data *)child->ptr)->generation;
+}
+
+/* the children of a clean entry are the same objects as in the last save,
+ * which keeps them alive */
+static bool is_clean(struct obs_data_writer *w, const struct bin_child *child)
+{
+	struct bin_entry *entry = cache_find(&w->prev_cache, child->ptr);
+	const struct bin_child *children;
+
+	if (!entry)
+		return false;
+	if (entry->checked == w->save_id)
+		return entry->clean;
+
+	entry->checked = w->save_id;
+	entry->clean = false;
+
+	if (entry->generation != get_generation(child))
+		return false;
+
+	children = w->prev_cache.children.array + entry->first_child;
+
+	for (size_t i = 0; i < entry->num_children; i++) {
+		if (!is_clean(w, &children[i]))
+			return false;
 	}
+
+	entry->clean = true;
+	return true;
 }
 
-static inline void copy_item(struct obs_data *data, struct obs_data_item *item)
+/* registers a copied entry and everything below it at its new offset */
+static void move_clean(struct obs_data_writer *w, const void *ptr,
+		       int64_t delta)
 {
-	const char *name = get_item_name(item);
-	void *ptr = get_item_data(item);
+	struct bin_entry *prev = cache_find(&w->prev_cache, ptr);
+	const struct bin_child *children =
+		w->prev_cache.children.array + prev->first_child;
+	struct bin_entry entry = *prev;
 
-	if (item->type == OBS_DATA_OBJECT) {
-		obs_data_t **obj = item->data_size ? ptr : NULL;
+	entry.offset = (size_t)((int64_t)prev->offset + delta);
+	entry.first_child = w->cache.children.num;
+	da_push_back_array(w->cache.children, children, prev->num_children);
+	cache_set(&w->cache, &entry);
 
-		if (obj)
-			copy_obj(data, name, *obj, obs_data_set_obj);
+	for (size_t i = 0; i < prev->num_children; i++)
+		move_clean(w, children[i].ptr, delta);
+}
 
-	} else if (item->type == OBS_DATA_ARRAY) {
-		obs_data_array_t **array = item->data_size ? ptr : NULL;
+static bool copy_clean(struct obs_data_writer *w, const void *ptr, bool array)
+{
+	struct bin_child child = {ptr, array};
+	struct bin_entry *entry;
+	size_t offset = w->buf.num;
 
-		if (array)
-			copy_array(data, name, *array, obs_data_set_array);
+	if (!is_clean(w, &child))
+		return false;
 
-	} else {
-		if (item->data_size)
-			set_item(data, NULL, name, ptr, item->data_size,
-				 item->type);
+	entry = cache_find(&w->prev_cache, ptr);
+	da_push_back_array(w->buf, w->prev_buf.array + entry->offset,
+			   entry->size);
+	w->reused_bytes += entry->size;
+
+	move_clean(w, ptr, (int64_t)offset - (int64_t)entry->offset);
+	return true;
+}
+
+static void write_bin_object(struct obs_data_writer *w, struct obs_data *data);
+
+static void write_bin_array(struct obs_data_writer *w,
+			    struct obs_data_array *array)
+{
+	size_t start = w->buf.num;
+	size_t child_start = w->child_stack.num;
+
+	if (!array) {
+		bin_wl32(w, 4);
+		bin_wl32(w, 0);
+		return;
+	}
+
+	if (copy_clean(w, array, true))
+		return;
+
+	bin_wl32(w, 0);
+	bin_wl32(w, (uint32_t)array->objects.num);
+
+	for (size_t i = 0; i < array->objects.num; i++) {
+		write_bin_object(w, array->objects.array[i]);
+		push_child(w, array->objects.array[i], false);
 	}
+
+	bin_patch32(w, start, (uint32_t)(w->buf.num - start - 4));
+	cache_set_written(w, array, array->generation, start, child_start);
 }
 
-void obs_data_apply(obs_data_t *target, obs_data_t *apply_data)
+static void write_bin_item(struct obs_data_writer *w,
+			   struct obs_data_item *item)
+{
+	struct obs_data_number *num;
+	obs_data_array_t *array;
+	obs_data_t *obj;
+	uint64_t bits;
+
+	switch (item->type) {
+	case OBS_DATA_STRING:
+		bin_w8(w, BIN_STRING);
+		bin_wl32(w, intern_string(w, obs_data_item_get_string(item)));
+		break;
+	case OBS_DATA_NUMBER:
+		num = get_item_data(item);
+		if (num->type == OBS_DATA_NUM_INT) {
+			bin_w8(w, BIN_INT);
+			bin_wl64(w, (uint64_t)num->int_val);
+		} else {
+			memcpy(&bits, &num->double_val, sizeof(bits));
+			bin_w8(w, BIN_DOUBLE);
+			bin_wl64(w, bits);
+		}
+		break;
+	case OBS_DATA_BOOLEAN:
+		bin_w8(w, BIN_BOOL);
+		bin_w8(w, obs_data_item_get_bool(item) ? 1 : 0);
+		break;
+	case OBS_DATA_OBJECT:
+		obj = get_item_obj(item);
+		bin_w8(w, BIN_OBJECT);
+		write_bin_object(w, obj);
+		if (obj)
+			push_child(w, obj, false);
+		break;
+	case OBS_DATA_ARRAY:
+		array = get_item_array(item);
+		bin_w8(w, BIN_ARRAY);
+		write_bin_array(w, array);
+		if (array)
+			push_child(w, array, true);
+		break;
+	case OBS_DATA_NULL:
+		break;
+	}
+}
+
+static void write_bin_object(struct obs_data_writer *w, struct obs_data *data)
 {
 	struct obs_data_item *item;
+	size_t start = w->buf.num;
+	size_t child_start = w->child_stack.num;
+	uint32_t count = 0;
 
-	if (!target || !apply_data || target == apply_data)
+	if (!data) {
+		bin_wl32(w, 4);
+		bin_wl32(w, 0);
+		return;
+	}
+
+	if (copy_clean(w, data, false))
 		return;
 
-	item = apply_data->first_item;
+	load_lazy(data);
 
-	while (item) {
-		copy_item(target, item);
-		item = item->next;
+	bin_wl32(w, 0);
+	bin_wl32(w, 0);
+
+	for (item = data->first_item; item; item = item->next) {
+		if (!obs_data_item_has_user_value(item) ||
+		    item->type == OBS_DATA_NULL)
+			continue;
+
+		bin_wl32(w, intern_string(w, get_item_name(item)));
+		write_bin_item(w, item);
+		count++;
 	}
+
+	bin_patch32(w, start, (uint32_t)(w->buf.num - start - 4));
+	bin_patch32(w, start + 4, count);
+	cache_set_written(w, data, data->generation, start, child_start);
 }
 
-void obs_data_erase(obs_data_t *data, const char *name)
+static void write_bin_strings(struct obs_data_writer *w)
 {
-	struct obs_data_item *item = get_item(data, name);
+	bin_wl32(w, (uint32_t)w->string_offsets.num);
+	bin_wl32(w, (uint32_t)w->string_data.num);
 
-	if (item) {
-		obs_data_item_detach(item);
-		obs_data_item_release(&item);
-	}
+	for (size_t i = 0; i < w->string_offsets.num; i++)
+		bin_wl32(w, w->string_offsets.array[i]);
+
+	da_push_back_array(w->buf, w->string_data.array, w->string_data.num);
 }
 
-static inline void clear_item(struct obs_data_item *item)
+static void reset_writer(struct obs_data_writer *w)
 {
-	void *ptr = get_item_data(item);
-	size_t size;
+	cache_clear(&w->prev_cache);
+	da_resize(w->prev_buf, 0);
+	da_resize(w->string_data, 0);
+	da_resize(w->string_offsets, 0);
 
-	if (item->data_len) {
-		if (item->type == OBS_DATA_OBJECT) {
-			obs_data_t **obj = item->data_size ? ptr : NULL;
+	bfree(w->string_buckets);
+	w->string_buckets = NULL;
+	w->num_string_buckets = 0;
+	rehash_strings(w);
+}
 
-			if (obj && *obj)
-				obs_data_release(*obj);
+/* this save is what the next one compares against */
+static void swap_saves(struct obs_data_writer *w)
+{
+	struct bin_cache cache = w->prev_cache;
+	struct darray buf = w->prev_buf.da;
 
-		} else if (item->type == OBS_DATA_ARRAY) {
-			obs_data_array_t **array = item->data_size ? ptr : NULL;
+	cache_clear(&cache);
+	w->prev_cache = w->cache;
+	w->cache = cache;
 
-			if (array && *array)
-				obs_data_array_release(*array);
-		}
+	w->prev_buf.da = w->buf.da;
+	w->buf.da = buf;
+}
 
-		size = item->default_len + item->autoselect_size;
-		if (size)
-			memmove(ptr, (uint8_t *)ptr + item->data_len, size);
+static void encode_binary(struct obs_data_writer *w, obs_data_t *data)
+{
+	size_t max_strings = w->rebuild_strings * 2;
+	bool rebuild = !w->save_id ||
+		       w->string_offsets.num > max_strings + WRITER_MIN_STRINGS;
+	size_t strings_offset;
 
-		item->data_size = 0;
-		item->data_len = 0;
-	}
+	/* strings that are not used anymore pile up in the string table */
+	if (rebuild)
+		reset_writer(w);
+
+	w->save_id++;
+	w->reused_bytes = 0;
+	da_resize(w->buf, BIN_HEADER_SIZE);
+
+	write_bin_object(w, data);
+
+	if (rebuild)
+		w->rebuild_strings = w->string_offsets.num;
+
+	strings_offset = w->buf.num;
+	write_bin_strings(w);
+
+	memcpy(w->buf.array, BIN_MAGIC, 4);
+	bin_patch32(w, 4, BIN_VERSION);
+	bin_patch32(w, 8, BIN_HEADER_SIZE);
+	bin_patch32(w, 12, 0);
+	bin_patch32(w, 16, (uint32_t)strings_offset);
+	bin_patch32(w, 20, (uint32_t)((uint64_t)strings_offset >> 32));
+
+	swap_saves(w);
 }
 
-void obs_data_clear(obs_data_t *target)
+obs_data_writer_t *obs_data_writer_create(void)
 {
-	struct obs_data_item *item;
+	struct obs_data_writer *w = bzalloc(sizeof(struct obs_data_writer));
+	rehash_strings(w);
+	return w;
+}
 
-	if (!target)
+void obs_data_writer_destroy(obs_data_writer_t *writer)
+{
+	if (!writer)
 		return;
 
-	item = target->first_item;
+	cache_free(&writer->cache);
+	cache_free(&writer->prev_cache);
+	da_free(writer->child_stack);
+	da_free(writer->buf);
+	da_free(writer->prev_buf);
+	da_free(writer->string_data);
+	da_free(writer->string_offsets);
+	bfree(writer->string_buckets);
+	bfree(writer);
+}
 
-	while (item) {
-		clear_item(item);
-		item = item->next;
-	}
+static bool writer_save(obs_data_writer_t *writer, obs_data_t *data,
+			const char *file, const char *temp_ext,
+			const char *backup_ext)
+{
+	const char *buf;
+	size_t size;
+
+	if (!writer || !data || !file)
+		return false;
+
+	encode_binary(writer, data);
+	buf = (const char *)writer->prev_buf.array;
+	size = writer->prev_buf.num;
+
+	if (!temp_ext)
+		return os_quick_write_utf8_file(file, buf, size, false);
+
+	return os_quick_write_utf8_file_safe(file, buf, size, false, temp_ext,
+					     backup_ext);
+}
+
+bool obs_data_writer_save(obs_data_writer_t *writer, obs_data_t *data,
+			  const char *file)
+{
+	return writer_save(writer, data, file, NULL, NULL);
+}
+
+bool obs_data_writer_save_safe(obs_data_writer_t *writer, obs_data_t *data,
+			       const char *file, const char *temp_ext,
+			       const char *backup_ext)
+{
+	if (!temp_ext || !*temp_ext)
+		return false;
+
+	return writer_save(writer, data, file, temp_ext, backup_ext);
+}
+
+size_t obs_data_writer_get_reused_bytes(obs_data_writer_t *writer)
+{
+	return writer ? writer->reused_bytes : 0;
+}
+
+bool obs_data_save_binary(obs_data_t *data, const char *file)
+{
+	obs_data_writer_t *writer = obs_data_writer_create();
+	bool success = obs_data_writer_save(writer, data, file);
+
+	obs_data_writer_destroy(writer);
+	return success;
+}
+
+bool obs_data_save_binary_safe(obs_data_t *data, const char *file,
+			       const char *temp_ext, const char *backup_ext)
+{
+	obs_data_writer_t *writer = obs_data_writer_create();
+	bool success = obs_data_writer_save_safe(writer, data, file, temp_ext,
+						 backup_ext);
+
+	obs_data_writer_destroy(writer);
+	return success;
+}
+
+bool obs_data_convert_json_to_binary(const char *json_file,
+				     const char *binary_file)
+{
+	obs_data_t *data = obs_data_create_from_json_file(json_file);
+	bool success = data && obs_data_save_binary(data, binary_file);
+
+	obs_data_release(data);
+	return success;
+}
+
+bool obs_data_convert_binary_to_json(const char *binary_file,
+				     const char *json_file)
+{
+	obs_data_t *data = obs_data_create_from_binary_file(binary_file);
+	bool success = data && obs_data_save_json(data, json_file);
+
+	obs_data_release(data);
+	return success;
 }
 
 typedef void (*set_item_t)(obs_data_t *, obs_data_item_t **, const char *,
@@ -1264,6 +3109,7 @@ obs_data_array_t *obs_data_array_create()
 {
 	struct obs_data_array *array = bzalloc(sizeof(struct obs_data_array));
 	array->ref = 1;
+	mark_array_changed(array);
 
 	return array;
 }
@@ -1318,6 +3164,7 @@ size_t obs_data_array_push_back(obs_data_array_t *array, obs_data_t *obj)
 		return 0;
 
 	os_atomic_inc_long(&obj->ref);
+	mark_array_changed(array);
 	return da_push_back(array->objects, &obj);
 }
 
@@ -1327,6 +3174,7 @@ void obs_data_array_insert(obs_data_array_t *array, size_t idx, obs_data_t *obj)
 		return;
 
 	os_atomic_inc_long(&obj->ref);
+	mark_array_changed(array);
 	da_insert(array->objects, idx, &obj);
 }
 
@@ -1340,6 +3188,7 @@ void obs_data_array_push_back_array(obs_data_array_t *array,
 		obs_data_t *obj = array2->objects.array[i];
 		obs_data_addref(obj);
 	}
+	mark_array_changed(array);
 	da_push_back_da(array->objects, array2->objects);
 }
 
@@ -1347,6 +3196,7 @@ void obs_data_array_erase(obs_data_array_t *array, size_t idx)
 {
 	if (array) {
 		obs_data_release(array->objects.array[idx]);
+		mark_array_changed(array);
 		da_erase(array->objects, idx);
 	}
 }
@@ -1409,6 +3259,10 @@ void obs_data_item_unset_user_value(obs_data_item_t *item)
 
 	void *old_non_user_data = get_default_data_ptr(item);
 
+	/* not through set_item_data, the next save must not reuse the
+	 * object as it was written */
+	mark_changed(item->parent);
+
 	item_data_release(item);
 	item->data_size = 0;
 	item->data_len = 0;
@@ -1426,6 +3280,8 @@ void obs_data_item_unset_default_value(obs_data_item_t *item)
 
 	void *old_autoselect_data = get_autoselect_data_ptr(item);
 
+	mark_changed(item->parent);
+
 	item_default_data_release(item);
 	item->default_size = 0;
 	item->default_len = 0;
@@ -1440,6 +3296,8 @@ void obs_data_item_unset_autoselect_value(obs_data_item_t *item)
 	if (!item || !item->autoselect_size)
 		return;
 
+	mark_changed(item->parent);
+
 	item_autoselect_data_release(item);
 	item->autoselect_size = 0;
 }
@@ -1452,6 +3310,7 @@ obs_data_item_t *obs_data_first(obs_data_t *data)
 	if (!data)
 		return NULL;
 
+	load_lazy(data);
 	if (data->first_item)
 		os_atomic_inc_long(&data->first_item->ref);
 	return data->first_item;
@@ -39,9 +39,11 @@ struct quat;
 struct obs_data;
 struct obs_data_item;
 struct obs_data_array;
+struct obs_data_writer;
 typedef struct obs_data obs_data_t;
 typedef struct obs_data_item obs_data_item_t;
 typedef struct obs_data_array obs_data_array_t;
+typedef struct obs_data_writer obs_data_writer_t;
 
 enum obs_data_type {
 	OBS_DATA_NULL,
@@ -75,6 +77,29 @@ EXPORT bool obs_data_save_json_safe(obs_data_t *data, const char *file,
 				    const char *temp_ext,
 				    const char *backup_ext);
 
+/* Binary files, see the documentation for the format */
+EXPORT obs_data_t *obs_data_create_from_binary_file(const char *binary_file);
+EXPORT bool obs_data_save_binary(obs_data_t *data, const char *file);
+EXPORT bool obs_data_save_binary_safe(obs_data_t *data, const char *file,
+				      const char *temp_ext,
+				      const char *backup_ext);
+
+EXPORT bool obs_data_convert_json_to_binary(const char *json_file,
+					    const char *binary_file);
+EXPORT bool obs_data_convert_binary_to_json(const char *binary_file,
+					    const char *json_file);
+
+/* Writers only encode the objects that changed since their last save */
+EXPORT obs_data_writer_t *obs_data_writer_create(void);
+EXPORT void obs_data_writer_destroy(obs_data_writer_t *writer);
+EXPORT bool obs_data_writer_save(obs_data_writer_t *writer, obs_data_t *data,
+				 const char *file);
+EXPORT bool obs_data_writer_save_safe(obs_data_writer_t *writer,
+				      obs_data_t *data, const char *file,
+				      const char *temp_ext,
+				      const char *backup_ext);
+EXPORT size_t obs_data_writer_get_reused_bytes(obs_data_writer_t *writer);
+
 EXPORT void obs_data_apply(obs_data_t *target, obs_data_t *apply_data);
 
 EXPORT void obs_data_erase(obs_data_t *data, const char *name);
@@ -23,16 +23,30 @@
 #define set_encoder_active(encoder, val) \
 	os_atomic_set_bool(&encoder->active, val)
 
-struct obs_encoder_info *find_encoder(const char *id)
+static struct obs_encoder_info *find_encoder_type(const char *id)
 {
-	for (size_t i = 0; i < obs->encoder_types.num; i++) {
-		struct obs_encoder_info *info = obs->encoder_types.array + i;
+	struct obs_encoder_info *info = NULL;
 
-		if (strcmp(info->id, id) == 0)
-			return info;
+	pthread_rwlock_rdlock(&obs->types_lock);
+	for (size_t i = 0; i < obs->encoder_types.num; i++) {
+		if (strcmp(obs->encoder_types.array[i]->id, id) == 0) {
+			info = obs->encoder_types.array[i];
+			break;
+		}
 	}
+	pthread_rwlock_unlock(&obs->types_lock);
 
-	return NULL;
+	return info;
+}
+
+struct obs_encoder_info *find_encoder(const char *id)
+{
+	struct obs_encoder_info *info = find_encoder_type(id);
+
+	if (!info && obs_load_deferred_module("encoders", "id", id))
+		info = find_encoder_type(id);
+
+	return info;
 }
 
 const char *obs_encoder_get_display_name(const char *id)
@@ -50,6 +64,7 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 	pthread_mutex_init_value(&encoder->callbacks_mutex);
 	pthread_mutex_init_value(&encoder->outputs_mutex);
 	pthread_mutex_init_value(&encoder->pause.mutex);
+	pthread_mutex_init_value(&encoder->async_mutex);
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		return false;
@@ -66,6 +81,8 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 		return false;
 	if (pthread_mutex_init(&encoder->pause.mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&encoder->async_mutex, NULL) != 0)
+		return false;
 
 	if (encoder->orig_info.get_defaults) {
 		encoder->orig_info.get_defaults(encoder->context.settings);
@@ -196,6 +213,143 @@ static inline bool gpu_encode_available(const struct obs_encoder *encoder)
 	       obs->video.using_nv12_tex;
 }
 
+static inline bool async_encode_available(const struct obs_encoder *encoder)
+{
+	return (encoder->info.caps & OBS_ENCODER_CAP_ASYNC_ENCODE) != 0;
+}
+
+static void *async_encode_thread(void *param)
+{
+	struct obs_encoder *encoder = param;
+	struct encoder_async_frame *af;
+	struct encoder_frame enc_frame;
+
+	os_set_thread_name("obs encoder: async encode thread");
+
+	/* frames still queued when the last output stops are never encoded,
+	 * nothing would receive their packets */
+	while (os_sem_wait(encoder->async_frame_sem) == 0) {
+		bool queued;
+
+		if (os_atomic_load_bool(&encoder->stopping))
+			break;
+
+		pthread_mutex_lock(&encoder->async_mutex);
+		queued = encoder->async_queue.size != 0;
+		if (queued)
+			circlebuf_pop_front(&encoder->async_queue, &af,
+					    sizeof(af));
+		pthread_mutex_unlock(&encoder->async_mutex);
+
+		if (!queued) {
+			if (os_atomic_load_bool(&encoder->async_stop))
+				break;
+			continue;
+		}
+
+		memset(&enc_frame, 0, sizeof(struct encoder_frame));
+
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			enc_frame.data[i] = af->frame.data[i];
+			enc_frame.linesize[i] = af->frame.linesize[i];
+		}
+
+		enc_frame.frames = 1;
+		enc_frame.pts = af->pts;
+		enc_frame.force_keyframe = af->force_keyframe;
+
+		/* an encode error has already stopped the encoder */
+		if (!do_encode(encoder, &enc_frame))
+			break;
+
+		pthread_mutex_lock(&encoder->async_mutex);
+		circlebuf_push_back(&encoder->async_avail_queue, &af,
+				    sizeof(af));
+		pthread_mutex_unlock(&encoder->async_mutex);
+
+		profile_reenable_thread();
+	}
+
+	return NULL;
+}
+
+static void free_async_encode(struct obs_encoder *encoder)
+{
+	if (encoder->async_thread_initialized) {
+		os_atomic_set_bool(&encoder->async_stop, true);
+		os_sem_post(encoder->async_frame_sem);
+		pthread_join(encoder->async_thread, NULL);
+		encoder->async_thread_initialized = false;
+
+		if (encoder->async_dropped_frames)
+			blog(LOG_INFO,
+			     "encoder '%s': %ld frames dropped because the "
+			     "encode thread fell behind",
+			     encoder->context.name,
+			     encoder->async_dropped_frames);
+	}
+
+	for (size_t i = 0; i < NUM_ASYNC_ENCODE_FRAMES; i++)
+		video_frame_free(&encoder->async_frames[i].frame);
+
+	circlebuf_free(&encoder->async_queue);
+	circlebuf_free(&encoder->async_avail_queue);
+	os_sem_destroy(encoder->async_frame_sem);
+	encoder->async_frame_sem = NULL;
+}
+
+static bool start_async_encode(struct obs_encoder *encoder,
+			       const struct video_scale_info *info)
+{
+	/* an encode error stops the encoder from its own encode thread, which
+	 * can't be joined there, so it gets joined on the next start */
+	free_async_encode(encoder);
+
+	encoder->async_stop = false;
+	encoder->async_format = info->format;
+	encoder->async_height = info->height;
+	encoder->async_pending_keyframe = false;
+	encoder->async_dropped_frames = 0;
+
+	for (size_t i = 0; i < NUM_ASYNC_ENCODE_FRAMES; i++) {
+		struct encoder_async_frame *af = &encoder->async_frames[i];
+
+		video_frame_init(&af->frame, info->format, info->width,
+				 info->height);
+		circlebuf_push_back(&encoder->async_avail_queue, &af,
+				    sizeof(af));
+	}
+
+	if (os_sem_init(&encoder->async_frame_sem, 0) != 0)
+		goto fail;
+	if (pthread_create(&encoder->async_thread, NULL, async_encode_thread,
+			   encoder) != 0)
+		goto fail;
+
+	encoder->async_thread_initialized = true;
+	return true;
+
+fail:
+	blog(LOG_WARNING,
+	     "Failed to start async encode thread for encoder '%s', "
+	     "encoding on the video thread instead",
+	     encoder->context.name);
+	free_async_encode(encoder);
+	return false;
+}
+
+static void stop_async_encode(struct obs_encoder *encoder)
+{
+	if (!encoder->async_thread_initialized)
+		return;
+
+	/* called from the encode thread itself on encode errors */
+	if (pthread_equal(pthread_self(), encoder->async_thread))
+		return;
+
+	free_async_encode(encoder);
+}
+
 static void add_connection(struct obs_encoder *encoder)
 {
 	if (encoder->info.type == OBS_ENCODER_AUDIO) {
@@ -211,6 +365,9 @@ static void add_connection(struct obs_encoder *encoder)
 		if (gpu_encode_available(encoder)) {
 			start_gpu_encode(encoder);
 		} else {
+			if (async_encode_available(encoder))
+				start_async_encode(encoder, &info);
+
 			start_raw_video(encoder->media, &info, receive_video,
 					encoder);
 		}
@@ -228,7 +385,10 @@ static void remove_connection(struct obs_encoder *encoder, bool shutdown)
 		if (gpu_encode_available(encoder)) {
 			stop_gpu_encode(encoder);
 		} else {
+			/* no more frames come in, then the encode thread
+			 * finishes the frame it is on and exits */
 			stop_raw_video(encoder->media, receive_video, encoder);
+			stop_async_encode(encoder);
 		}
 	}
 
@@ -266,6 +426,7 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 		     encoder->context.name);
 
 		free_audio_buffers(encoder);
+		free_async_encode(encoder);
 
 		if (encoder->context.data)
 			encoder->info.destroy(encoder->context.data);
@@ -274,6 +435,7 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 		pthread_mutex_destroy(&encoder->callbacks_mutex);
 		pthread_mutex_destroy(&encoder->outputs_mutex);
 		pthread_mutex_destroy(&encoder->pause.mutex);
+		pthread_mutex_destroy(&encoder->async_mutex);
 		obs_context_data_free(&encoder->context);
 		if (encoder->owns_info_id)
 			bfree((void *)encoder->info.id);
@@ -520,7 +682,7 @@ void obs_encoder_shutdown(obs_encoder_t *encoder)
 		encoder->info.destroy(encoder->context.data);
 		encoder->context.data = NULL;
 		encoder->paired_encoder = NULL;
-		encoder->first_received = false;
+		os_atomic_set_bool(&encoder->first_received, false);
 		encoder->offset_usec = 0;
 		encoder->start_ts = 0;
 	}
@@ -575,6 +737,7 @@ static inline void obs_encoder_start_internal(
 	pthread_mutex_unlock(&encoder->callbacks_mutex);
 
 	if (first) {
+		os_atomic_set_bool(&encoder->stopping, false);
 		os_atomic_set_bool(&encoder->paused, false);
 		pause_reset(&encoder->pause);
 
@@ -610,13 +773,17 @@ static inline bool obs_encoder_stop_internal(
 
 	idx = get_callback_idx(encoder, new_packet, param);
 	if (idx != DARRAY_INVALID) {
+		last = (encoder->callbacks.num == 1);
+		if (last)
+			os_atomic_set_bool(&encoder->stopping, true);
 		da_erase(encoder->callbacks, idx);
-		last = (encoder->callbacks.num == 0);
 	}
 
 	pthread_mutex_unlock(&encoder->callbacks_mutex);
 
 	if (last) {
+		/* packets of frames still being encoded on the async encode
+		 * thread are dropped, nothing is sent once this returns */
 		remove_connection(encoder, true);
 		encoder->initialized = false;
 
@@ -698,6 +865,37 @@ void obs_encoder_set_scaled_size(obs_encoder_t *encoder, uint32_t width,
 	encoder->scaled_height = height;
 }
 
+void obs_encoder_set_keyframe_alignment(obs_encoder_t *encoder,
+					uint32_t interval)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_set_keyframe_alignment"))
+		return;
+	if (encoder->info.type != OBS_ENCODER_VIDEO) {
+		blog(LOG_WARNING,
+		     "obs_encoder_set_keyframe_alignment: "
+		     "encoder '%s' is not a video encoder",
+		     obs_encoder_get_name(encoder));
+		return;
+	}
+	if (encoder_active(encoder)) {
+		blog(LOG_WARNING,
+		     "encoder '%s': Cannot set the keyframe "
+		     "alignment while the encoder is active",
+		     obs_encoder_get_name(encoder));
+		return;
+	}
+
+	encoder->keyframe_alignment = interval;
+}
+
+uint32_t obs_encoder_get_keyframe_alignment(const obs_encoder_t *encoder)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_get_keyframe_alignment"))
+		return 0;
+
+	return encoder->keyframe_alignment;
+}
+
 bool obs_encoder_scaling_enabled(const obs_encoder_t *encoder)
 {
 	if (!obs_encoder_valid(encoder, "obs_encoder_scaling_enabled"))
@@ -930,9 +1128,9 @@ void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 	}
 
 	if (received) {
-		if (!encoder->first_received) {
+		if (!os_atomic_load_bool(&encoder->first_received)) {
 			encoder->offset_usec = packet_dts_usec(pkt);
-			encoder->first_received = true;
+			os_atomic_set_bool(&encoder->first_received, true);
 		}
 
 		/* we use system time here to ensure sync with other encoders,
@@ -947,10 +1145,12 @@ void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
-		for (size_t i = encoder->callbacks.num; i > 0; i--) {
-			struct encoder_callback *cb;
-			cb = encoder->callbacks.array + (i - 1);
-			send_packet(encoder, cb, pkt);
+		if (!os_atomic_load_bool(&encoder->stopping)) {
+			for (size_t i = encoder->callbacks.num; i > 0; i--) {
+				struct encoder_callback *cb;
+				cb = encoder->callbacks.array + (i - 1);
+				send_packet(encoder, cb, pkt);
+			}
 		}
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
@@ -1015,6 +1215,62 @@ bool video_pause_check(struct pause_data *pause, uint64_t timestamp)
 	return ignore_frame;
 }
 
+/* the queue is bounded: if the encode thread falls behind, the frame is
+ * dropped instead of blocking the video-io thread and every other encoder on
+ * it.  its pts is still used up so the timeline stays intact, and a keyframe
+ * it should have been is forced on the next frame that is queued */
+static void queue_async_frame(struct obs_encoder *encoder,
+			      struct video_data *frame, int64_t pts,
+			      bool force_keyframe)
+{
+	struct encoder_async_frame *af = NULL;
+	struct video_frame src;
+
+	pthread_mutex_lock(&encoder->async_mutex);
+	if (encoder->async_avail_queue.size)
+		circlebuf_pop_front(&encoder->async_avail_queue, &af,
+				    sizeof(af));
+	pthread_mutex_unlock(&encoder->async_mutex);
+
+	if (!af) {
+		encoder->async_pending_keyframe |= force_keyframe;
+		encoder->async_dropped_frames++;
+		return;
+	}
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		src.data[i] = frame->data[i];
+		src.linesize[i] = frame->linesize[i];
+	}
+
+	video_frame_copy(&af->frame, &src, encoder->async_format,
+			 encoder->async_height);
+	af->pts = pts;
+	af->force_keyframe = force_keyframe || encoder->async_pending_keyframe;
+	encoder->async_pending_keyframe = false;
+
+	pthread_mutex_lock(&encoder->async_mutex);
+	circlebuf_push_back(&encoder->async_queue, &af, sizeof(af));
+	pthread_mutex_unlock(&encoder->async_mutex);
+
+	os_sem_post(encoder->async_frame_sem);
+}
+
+/* counts frames from the start of the video output so that every encoder on
+ * the same output agrees on where the aligned keyframes go */
+static inline bool aligned_keyframe(const struct obs_encoder *encoder,
+				    uint64_t timestamp)
+{
+	uint64_t frame_time = video_output_get_frame_time(encoder->media);
+	uint64_t frame_idx;
+
+	if (!encoder->keyframe_alignment || !frame_time)
+		return false;
+
+	frame_idx = (timestamp + frame_time / 2) / frame_time;
+	return frame_idx % encoder->keyframe_alignment == 0;
+}
+
 static const char *receive_video_name = "receive_video";
 static void receive_video(void *param, struct video_data *frame)
 {
@@ -1023,9 +1279,10 @@ static void receive_video(void *param, struct video_data *frame)
 	struct obs_encoder *encoder = param;
 	struct obs_encoder *pair = encoder->paired_encoder;
 	struct encoder_frame enc_frame;
+	bool force_keyframe;
 
-	if (!encoder->first_received && pair) {
-		if (!pair->first_received ||
+	if (!os_atomic_load_bool(&encoder->first_received) && pair) {
+		if (!os_atomic_load_bool(&pair->first_received) ||
 		    pair->first_raw_ts > frame->timestamp) {
 			goto wait_for_audio;
 		}
@@ -1034,6 +1291,18 @@ static void receive_video(void *param, struct video_data *frame)
 	if (video_pause_check(&encoder->pause, frame->timestamp))
 		goto wait_for_audio;
 
+	if (!encoder->start_ts)
+		encoder->start_ts = frame->timestamp;
+
+	force_keyframe = aligned_keyframe(encoder, frame->timestamp);
+
+	if (encoder->async_thread_initialized) {
+		queue_async_frame(encoder, frame, encoder->cur_pts,
+				  force_keyframe);
+		encoder->cur_pts += encoder->timebase_num;
+		goto wait_for_audio;
+	}
+
 	memset(&enc_frame, 0, sizeof(struct encoder_frame));
 
 	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
@@ -1041,11 +1310,9 @@ static void receive_video(void *param, struct video_data *frame)
 		enc_frame.linesize[i] = frame->linesize[i];
 	}
 
-	if (!encoder->start_ts)
-		encoder->start_ts = frame->timestamp;
-
 	enc_frame.frames = 1;
 	enc_frame.pts = encoder->cur_pts;
+	enc_frame.force_keyframe = force_keyframe;
 
 	if (do_encode(encoder, &enc_frame))
 		encoder->cur_pts += encoder->timebase_num;
@@ -1261,9 +1528,9 @@ static void receive_audio(void *param, size_t mix_idx, struct audio_data *in)
 	struct obs_encoder *encoder = param;
 	struct audio_data audio = *in;
 
-	if (!encoder->first_received) {
+	if (!os_atomic_load_bool(&encoder->first_received)) {
 		encoder->first_raw_ts = audio.timestamp;
-		encoder->first_received = true;
+		os_atomic_set_bool(&encoder->first_received, true);
 		clear_audio(encoder);
 	}
 
@@ -33,6 +33,7 @@ extern "C" {
 #define OBS_ENCODER_CAP_PASS_TEXTURE (1 << 1)
 #define OBS_ENCODER_CAP_DYN_BITRATE (1 << 2)
 #define OBS_ENCODER_CAP_INTERNAL (1 << 3)
+#define OBS_ENCODER_CAP_ASYNC_ENCODE (1 << 4)
 
 /** Specifies the encoder type */
 enum obs_encoder_type {
@@ -40,6 +41,16 @@ enum obs_encoder_type {
 	OBS_ENCODER_VIDEO  /**< The encoder provides a video codec */
 };
 
+/** Points of the output pipeline a packet is time stamped at */
+enum obs_packet_trace_stage {
+	OBS_PACKET_TRACE_ENCODED,     /**< Received from the encoder */
+	OBS_PACKET_TRACE_DELAYED,     /**< Left the output delay queue */
+	OBS_PACKET_TRACE_INTERLEAVED, /**< Passed to the output */
+	OBS_PACKET_TRACE_MUXED,       /**< Muxed by the output */
+	OBS_PACKET_TRACE_SENT,        /**< Written to the socket or file */
+	OBS_PACKET_TRACE_STAGES,
+};
+
 /** Encoder output packet */
 struct encoder_packet {
 	uint8_t *data; /**< Packet data */
@@ -100,6 +111,12 @@ struct encoder_frame {
 
 	/** Presentation timestamp */
 	int64_t pts;
+
+	/**
+	 * Video only: the frame must be encoded as a keyframe, set when the
+	 * encoder's keyframe alignment is in use
+	 */
+	bool force_keyframe;
 };
 
 /**
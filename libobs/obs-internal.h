@@ -32,6 +32,7 @@
 
 #include "media-io/audio-resampler.h"
 #include "media-io/video-io.h"
+#include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
 
 #include "obs.h"
@@ -101,11 +102,32 @@ struct obs_module {
 	const char *(*description)(void);
 	const char *(*author)(void);
 
+	/* time spent in os_dlopen and in obs_module_load */
+	uint64_t open_time_ns;
+	uint64_t load_time_ns;
+
 	struct obs_module *next;
 };
 
 extern void free_module(struct obs_module *mod);
 
+/* a module that only registered types the last time it was loaded, it is
+ * loaded the first time one of those types is requested */
+struct obs_deferred_module {
+	char *mod_name;
+	char *bin_path;
+	char *data_path;
+	obs_data_t *types;
+	bool loaded;
+};
+
+extern bool obs_init_deferred_modules(void);
+extern void obs_free_deferred_modules(void);
+extern bool obs_load_deferred_module(const char *types, const char *field,
+				     const char *id);
+extern void obs_load_deferred_modules(const char *types, int source_type);
+extern void *obs_get_registered_type(const struct darray *types, size_t idx);
+
 struct obs_module_path {
 	char *bin;
 	char *data;
@@ -241,6 +263,24 @@ struct obs_task_info {
 	void *param;
 };
 
+#define TICK_POOL_MAX_THREADS 8
+
+/* threads that call the video_tick of OBS_SOURCE_PARALLEL_TICK sources along
+ * with the graphics thread, started by it the first time they are needed */
+struct obs_tick_pool {
+	pthread_t threads[TICK_POOL_MAX_THREADS];
+	size_t num_threads;
+	bool initialized;
+	volatile bool stop;
+	os_sem_t *start;
+	os_event_t *done;
+
+	DARRAY(struct obs_source *) sources;
+	volatile long next;
+	volatile long running;
+	float seconds;
+};
+
 struct obs_core_video {
 	graphics_t *graphics;
 	gs_stagesurf_t *copy_surfaces[NUM_TEXTURES][NUM_CHANNELS];
@@ -288,6 +328,7 @@ struct obs_core_video {
 	uint32_t total_frames;
 	uint32_t lagged_frames;
 	bool thread_initialized;
+	struct obs_tick_pool tick_pool;
 
 	bool gpu_conversion;
 	const char *conversion_techs[NUM_CHANNELS];
@@ -351,6 +392,18 @@ struct obs_audio_mixes {
 };
 
 /* user sources, output channels, and displays */
+/* name and uuid lookup for the contexts of one type, the hash chains go
+ * through the contexts themselves.  Only public contexts are indexed. */
+struct obs_context_index {
+	pthread_rwlock_t lock;
+	struct obs_context_data **names;
+	struct obs_context_data **uuids;
+	size_t num_buckets;
+	size_t num;
+};
+
+#define ALL_AUDIO_MIXES ((1 << MAX_AUDIO_MIXES) - 1)
+
 struct obs_core_data {
 	struct obs_source *first_source;
 	struct obs_source *first_audio_source;
@@ -368,9 +421,30 @@ struct obs_core_data {
 	pthread_mutex_t audio_sources_mutex;
 	pthread_mutex_t draw_callbacks_mutex;
 	pthread_mutex_t mixers_mutex;
+	struct obs_context_index source_index;
+	struct obs_context_index output_index;
+	struct obs_context_index encoder_index;
+	struct obs_context_index service_index;
 	DARRAY(struct draw_callback) draw_callbacks;
 	DARRAY(struct tick_callback) tick_callbacks;
 
+	/* the sources that are ticked every frame, changed with sources_mutex
+	 * held.  Removed weak refs are kept until the graphics thread has
+	 * copied the list again, which it does at most once per tick, and it
+	 * ticks its copy without a lock. */
+	DARRAY(obs_weak_source_t *) tick_sources;
+	DARRAY(obs_weak_source_t *) tick_sources_removed;
+	volatile bool tick_sources_changed;
+	DARRAY(obs_weak_source_t *) tick_list;
+
+	/* sources without a tick of their own that have a pending show,
+	 * activate or update, each holding a reference */
+	struct obs_source *volatile tick_queue;
+
+	/* bumped when a source changes size or is removed, scenes compare it
+	 * to decide whether their items need to be checked again */
+	volatile long layout_gen;
+
 	struct obs_view main_view;
 
 	long long unnamed_index;
@@ -421,13 +495,23 @@ struct obs_core {
 	struct obs_module *first_module;
 	DARRAY(struct obs_module_path) module_paths;
 
-	DARRAY(struct obs_source_info) source_types;
-	DARRAY(struct obs_source_info) input_types;
-	DARRAY(struct obs_source_info) filter_types;
-	DARRAY(struct obs_source_info) transition_types;
-	DARRAY(struct obs_output_info) output_types;
-	DARRAY(struct obs_encoder_info) encoder_types;
-	DARRAY(struct obs_service_info) service_types;
+	/* what each module registered, kept in the module config path */
+	bool defer_modules;
+	obs_data_t *module_cache;
+	pthread_mutex_t deferred_modules_mutex;
+	DARRAY(struct obs_deferred_module) deferred_modules;
+
+	/* a deferred module registers its types on whatever thread first
+	 * asks for one, so the lists are locked and each type is allocated
+	 * on its own to keep the pointers handed out by lookups valid */
+	pthread_rwlock_t types_lock;
+	DARRAY(struct obs_source_info *) source_types;
+	DARRAY(struct obs_source_info *) input_types;
+	DARRAY(struct obs_source_info *) filter_types;
+	DARRAY(struct obs_source_info *) transition_types;
+	DARRAY(struct obs_output_info *) output_types;
+	DARRAY(struct obs_encoder_info *) encoder_types;
+	DARRAY(struct obs_service_info *) service_types;
 	DARRAY(struct obs_modal_ui) modal_ui_callbacks;
 	DARRAY(struct obs_modeless_ui) modeless_ui_callbacks;
 
@@ -451,6 +535,11 @@ struct obs_core {
 
 extern struct obs_core *obs;
 
+static inline void obs_layout_changed(void)
+{
+	os_atomic_inc_long(&obs->data.layout_gen);
+}
+
 struct obs_graphics_context {
 	uint64_t last_time;
 	uint64_t interval;
@@ -493,6 +582,7 @@ extern void stop_raw_video(video_t *video,
 
 struct obs_context_data {
 	char *name;
+	char *uuid;
 	void *data;
 	obs_data_t *settings;
 	signal_handler_t *signals;
@@ -510,6 +600,10 @@ struct obs_context_data {
 	struct obs_context_data *next;
 	struct obs_context_data **prev_next;
 
+	struct obs_context_index *index;
+	struct obs_context_data *next_name;
+	struct obs_context_data *next_uuid;
+
 	bool private;
 };
 
@@ -526,6 +620,10 @@ extern void obs_context_data_remove(struct obs_context_data *context);
 extern void obs_context_data_setname(struct obs_context_data *context,
 				     const char *name);
 
+/* only before the context is inserted */
+extern void obs_context_data_setuuid(struct obs_context_data *context,
+				     const char *uuid);
+
 /* ------------------------------------------------------------------------- */
 /* ref-counting  */
 
@@ -619,6 +717,17 @@ struct obs_source {
 	/* signals to call the source update in the video thread */
 	long defer_update_count;
 
+	/* ticked every frame, otherwise only queued when something changes */
+	bool ticks_always;
+	size_t tick_idx;
+	volatile bool tick_queued;
+	struct obs_source *tick_queue_next;
+	const char *profile_tick_name;
+
+	/* size as of the last tick, see obs_source_check_layout */
+	uint32_t tick_width;
+	uint32_t tick_height;
+
 	/* ensures show/hide are only called once */
 	volatile long show_refs;
 
@@ -630,6 +739,10 @@ struct obs_source {
 	 * to handle things but it's the best option) */
 	bool removed;
 
+	/* set once destruction has started, async video that arrives from the
+	 * source's own threads after that is dropped */
+	volatile bool destroying;
+
 	bool active;
 	bool showing;
 
@@ -662,6 +775,9 @@ struct obs_source {
 	DARRAY(struct audio_action) audio_actions;
 	float *audio_output_buf[MAX_AUDIO_MIXES][MAX_AUDIO_CHANNELS];
 	float *audio_mix_buf[MAX_AUDIO_CHANNELS];
+
+	/* mixes of audio_output_buf that can hold audio, the rest are silent */
+	uint32_t audio_output_mixes;
 	struct resample_info sample_info;
 	audio_resampler_t *resampler;
 	pthread_mutex_t audio_actions_mutex;
@@ -699,6 +815,8 @@ struct obs_source {
 	DARRAY(struct async_frame) async_cache;
 	DARRAY(struct obs_source_frame *) async_frames;
 	pthread_mutex_t async_mutex;
+	size_t async_pool_size;
+	struct obs_source_async_stats async_stats;
 	uint32_t async_width;
 	uint32_t async_height;
 	uint32_t async_cache_width;
@@ -811,16 +929,13 @@ static inline void obs_source_dosignal(struct obs_source *source,
 				       const char *signal_obs,
 				       const char *signal_source)
 {
-	struct calldata data;
-	uint8_t stack[128];
-
-	calldata_init_fixed(&data, stack, sizeof(stack));
-	calldata_set_ptr(&data, "source", source);
 	if (signal_obs && !source->context.private)
-		signal_handler_signal(obs->signals, signal_obs, &data);
+		signal_handler_signal_args(obs->signals,
+					   signal_get_id(signal_obs), source);
 	if (signal_source)
-		signal_handler_signal(source->context.signals, signal_source,
-				      &data);
+		signal_handler_signal_args(source->context.signals,
+					   signal_get_id(signal_source),
+					   source);
 }
 
 /* maximum timestamp variance in nanoseconds */
@@ -851,9 +966,36 @@ convert_video_format(enum video_format format)
 	}
 }
 
+/* keeps the uuid a source was saved with */
+extern obs_source_t *obs_source_create_with_uuid(const char *id,
+						 const char *name,
+						 const char *uuid,
+						 obs_data_t *settings,
+						 obs_data_t *hotkey_data,
+						 uint32_t last_obs_ver);
+/* while a queue is set on a thread, the source_create signals of sources
+ * created on it are queued instead of sent, so obs_load_sources can send
+ * them from the calling thread in load order */
+struct obs_source_create_queue {
+	DARRAY(obs_source_t *) sources;
+};
+
+extern void
+obs_source_set_create_queue(struct obs_source_create_queue *queue);
+extern void
+obs_source_send_create_queue(struct obs_source_create_queue *queue);
 extern void obs_source_activate(obs_source_t *source, enum view_type type);
 extern void obs_source_deactivate(obs_source_t *source, enum view_type type);
 extern void obs_source_video_tick(obs_source_t *source, float seconds);
+extern bool obs_source_video_tick_begin(obs_source_t *source, float seconds);
+extern void obs_source_call_video_tick(obs_source_t *source, float seconds);
+extern void obs_source_queue_tick(obs_source_t *source);
+extern void obs_source_check_layout(obs_source_t *source);
+extern void obs_tick_list_add(obs_source_t *source);
+extern void obs_tick_list_remove(obs_source_t *source);
+extern void obs_tick_queue_free(void);
+extern void obs_tick_list_free(void);
+extern void obs_tick_pool_free(struct obs_tick_pool *pool);
 extern float obs_source_get_target_volume(obs_source_t *source,
 					  obs_source_t *target);
 
@@ -898,6 +1040,11 @@ struct delay_data {
 	struct encoder_packet packet;
 };
 
+struct delay_block {
+	long *refs;
+	size_t capacity;
+};
+
 typedef void (*encoded_callback_t)(void *data, struct encoder_packet *packet);
 
 struct obs_weak_output {
@@ -925,6 +1072,49 @@ extern bool audio_pause_check(struct pause_data *pause, struct audio_data *data,
 			      size_t sample_rate);
 extern void pause_reset(struct pause_data *pause);
 
+#define PACKET_TRACE_BUCKETS 24
+#define PACKET_TRACE_EVENTS 4096
+#define PACKET_TRACE_SLOT_BITS 12
+#define PACKET_TRACE_SLOTS (1 << PACKET_TRACE_SLOT_BITS)
+
+/* bucket i counts latencies below 2^(i + 1) microseconds */
+struct packet_trace_histogram {
+	volatile long buckets[PACKET_TRACE_BUCKETS];
+	volatile long count;
+	volatile long max_usec;
+};
+
+struct packet_trace_event {
+	volatile long seq;
+	uint64_t start_ns;
+	uint64_t end_ns;
+	enum obs_packet_trace_stage stage;
+	enum obs_encoder_type type;
+	uint32_t track_idx;
+	bool keyframe;
+};
+
+/* stage stamps of a packet on its way through the output, found by the
+ * encoder and sys_dts_usec of the packet, which every copy keeps.  busy is
+ * only ever tried on the packet path, never waited for */
+struct packet_trace_slot {
+	volatile long busy;
+	const struct obs_encoder *encoder;
+	int64_t sys_dts_usec;
+	uint64_t stamps[OBS_PACKET_TRACE_STAGES];
+};
+
+struct packet_trace {
+	volatile bool enabled;
+	pthread_mutex_t mutex;
+	struct packet_trace_histogram histograms[OBS_PACKET_TRACE_STAGES][2];
+	struct packet_trace_event *events;
+	volatile long next_event;
+
+	/* allocated with the output */
+	struct packet_trace_slot *slots;
+};
+
 struct obs_output {
 	struct obs_context_data context;
 	struct obs_output_info info;
@@ -999,6 +1189,10 @@ struct obs_output {
 	uint64_t active_delay_ns;
 	encoded_callback_t delay_callback;
 	struct circlebuf delay_data; /* struct delay_data */
+	struct circlebuf delay_payload;
+	DARRAY(struct delay_block) delay_pool;
+	size_t delay_pool_bytes;
+	size_t delay_peak_bytes;
 	pthread_mutex_t delay_mutex;
 	uint32_t delay_sec;
 	uint32_t delay_flags;
@@ -1009,6 +1203,8 @@ struct obs_output {
 
 	char *last_error_message;
 
+	struct packet_trace trace;
+
 	float audio_data[MAX_AUDIO_CHANNELS][AUDIO_OUTPUT_FRAMES];
 };
 
@@ -1023,12 +1219,17 @@ static inline void do_output_signal(struct obs_output *output,
 
 extern void process_delay(void *data, struct encoder_packet *packet);
 extern void obs_output_cleanup_delay(obs_output_t *output);
+extern void obs_output_free_delay_pool(obs_output_t *output);
 extern bool obs_output_delay_start(obs_output_t *output);
 extern void obs_output_delay_stop(obs_output_t *output);
 extern bool obs_output_actual_start(obs_output_t *output);
 extern void obs_output_actual_stop(obs_output_t *output, bool force,
 				   uint64_t ts);
 
+extern void obs_output_add_trace_procs(struct obs_output *output);
+extern void obs_output_trace_received(struct obs_output *output,
+				      const struct encoder_packet *packet);
+
 extern const struct obs_output_info *find_output(const char *id);
 
 extern void obs_output_remove_encoder(struct obs_output *output,
@@ -1053,6 +1254,14 @@ struct encoder_callback {
 	void *param;
 };
 
+#define NUM_ASYNC_ENCODE_FRAMES 4
+
+struct encoder_async_frame {
+	struct video_frame frame;
+	int64_t pts;
+	bool force_keyframe;
+};
+
 struct obs_encoder {
 	struct obs_context_data context;
 	struct obs_encoder_info info;
@@ -1074,6 +1283,7 @@ struct obs_encoder {
 	uint32_t scaled_width;
 	uint32_t scaled_height;
 	enum video_format preferred_format;
+	uint32_t keyframe_alignment;
 
 	volatile bool active;
 	volatile bool paused;
@@ -1093,9 +1303,11 @@ struct obs_encoder {
 	/* if a video encoder is paired with an audio encoder, make it start
 	 * up at the specific timestamp.  if this is the audio encoder,
 	 * wait_for_video makes it wait until it's ready to sync up with
-	 * video */
+	 * video.  first_received is set on the thread that encodes (or the
+	 * audio thread) and read on the video thread, first_raw_ts is set
+	 * before it.  offset_usec is only used on the thread that encodes */
 	bool wait_for_video;
-	bool first_received;
+	volatile bool first_received;
 	struct obs_encoder *paired_encoder;
 	int64_t offset_usec;
 	uint64_t first_raw_ts;
@@ -1112,10 +1324,28 @@ struct obs_encoder {
 	pthread_mutex_t callbacks_mutex;
 	DARRAY(struct encoder_callback) callbacks;
 
+	/* set under callbacks_mutex when the last callback is removed, packets
+	 * of frames still in flight are dropped from then on */
+	volatile bool stopping;
+
 	struct pause_data pause;
 
 	const char *profile_encoder_encode_name;
 	char *last_error_message;
+
+	/* asynchronous encode stage (OBS_ENCODER_CAP_ASYNC_ENCODE) */
+	pthread_t async_thread;
+	bool async_thread_initialized;
+	volatile bool async_stop;
+	enum video_format async_format;
+	uint32_t async_height;
+	os_sem_t *async_frame_sem;
+	pthread_mutex_t async_mutex;
+	struct circlebuf async_queue;
+	struct circlebuf async_avail_queue;
+	struct encoder_async_frame async_frames[NUM_ASYNC_ENCODE_FRAMES];
+	bool async_pending_keyframe;
+	long async_dropped_frames;
 };
 
 extern struct obs_encoder_info *find_encoder(const char *id);
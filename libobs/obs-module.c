@@ -15,6 +15,8 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <sys/stat.h>
+
 #include "util/platform.h"
 #include "util/dstr.h"
 
@@ -101,6 +103,7 @@ int obs_open_module(obs_module_t **module, const char *path,
 		    const char *data_path)
 {
 	struct obs_module mod = {0};
+	uint64_t start_time;
 	int errorcode;
 
 	if (!module || !path || !obs)
@@ -119,6 +122,8 @@ int obs_open_module(obs_module_t **module, const char *path,
 
 	blog(LOG_DEBUG, "---------------------------------");
 
+	start_time = os_gettime_ns();
+
 	mod.module = os_dlopen(path);
 	if (!mod.module) {
 		blog(LOG_WARNING, "Module '%s' not loaded", path);
@@ -129,19 +134,26 @@ int obs_open_module(obs_module_t **module, const char *path,
 	if (errorcode != MODULE_SUCCESS)
 		return errorcode;
 
+	mod.open_time_ns = os_gettime_ns() - start_time;
+
 	mod.bin_path = bstrdup(path);
 	mod.file = strrchr(mod.bin_path, '/');
 	mod.file = (!mod.file) ? mod.bin_path : (mod.file + 1);
 	mod.mod_name = get_module_name(mod.file);
 	mod.data_path = bstrdup(data_path);
-	mod.next = obs->first_module;
 
 	if (mod.file) {
 		blog(LOG_DEBUG, "Loading module: %s", mod.file);
 	}
 
+	/* a deferred module can be opened on another thread, and the list is
+	 * walked without a lock */
+	pthread_mutex_lock(&obs->deferred_modules_mutex);
+	mod.next = obs->first_module;
 	*module = bmemdup(&mod, sizeof(mod));
-	obs->first_module = (*module);
+	os_atomic_set_ptr((void *volatile *)&obs->first_module, *module);
+	pthread_mutex_unlock(&obs->deferred_modules_mutex);
+
 	mod.set_pointer(*module);
 
 	if (mod.set_locale)
@@ -150,8 +162,417 @@ int obs_open_module(obs_module_t **module, const char *path,
 	return MODULE_SUCCESS;
 }
 
+/* ------------------------------------------------------------------------- */
+/* module cache                                                              */
+
+struct module_type_counts {
+	size_t sources;
+	size_t outputs;
+	size_t encoders;
+	size_t services;
+	size_t ui;
+};
+
+static void get_module_type_counts(struct module_type_counts *counts)
+{
+	pthread_rwlock_rdlock(&obs->types_lock);
+	counts->sources = obs->source_types.num;
+	counts->outputs = obs->output_types.num;
+	counts->encoders = obs->encoder_types.num;
+	counts->services = obs->service_types.num;
+	pthread_rwlock_unlock(&obs->types_lock);
+	counts->ui = obs->modal_ui_callbacks.num +
+		     obs->modeless_ui_callbacks.num;
+}
+
+static bool get_module_file_info(const char *path, long long *size,
+				 long long *mtime)
+{
+	struct stat st;
+
+	if (os_stat(path, &st) != 0)
+		return false;
+
+	*size = (long long)st.st_size;
+	*mtime = (long long)st.st_mtime;
+	return true;
+}
+
+static void cache_type(obs_data_array_t *array, const char *id)
+{
+	obs_data_t *type = obs_data_create();
+	obs_data_set_string(type, "id", id);
+	obs_data_array_push_back(array, type);
+	obs_data_release(type);
+}
+
+static void cache_source_type(obs_data_array_t *array,
+			      const struct obs_source_info *info)
+{
+	obs_data_t *type = obs_data_create();
+	obs_data_set_string(type, "id", info->id);
+	obs_data_set_string(type, "unversioned_id", info->unversioned_id);
+	obs_data_set_int(type, "version", info->version);
+	obs_data_set_int(type, "type", info->type);
+	obs_data_array_push_back(array, type);
+	obs_data_release(type);
+}
+
+#define CACHE_TYPES(entry, name, list, first, last)                \
+	do {                                                       \
+		obs_data_array_t *array = obs_data_array_create(); \
+		for (size_t i = first; i < last; i++)              \
+			cache_type(array, list.array[i]->id);      \
+		obs_data_set_array(entry, name, array);            \
+		obs_data_array_release(array);                     \
+	} while (false)
+
+/* records the types a module registered when it was loaded, the next time
+ * it is found it can then be loaded only once one of them is requested */
+static void cache_module_types(struct obs_module *mod,
+			       const struct module_type_counts *before)
+{
+	struct module_type_counts after;
+	obs_data_array_t *sources;
+	obs_data_t *modules;
+	obs_data_t *entry;
+	long long size;
+	long long mtime;
+	size_t num_types;
+	bool deferrable;
+
+	if (!obs->module_cache)
+		return;
+	if (!get_module_file_info(mod->bin_path, &size, &mtime))
+		return;
+
+	get_module_type_counts(&after);
+	num_types = (after.sources - before->sources) +
+		    (after.outputs - before->outputs) +
+		    (after.encoders - before->encoders) +
+		    (after.services - before->services);
+
+	/* anything that does more than register types, or registers nothing
+	 * at all, is always loaded at startup */
+	deferrable = num_types > 0 && after.ui == before->ui &&
+		     !mod->post_load;
+
+	entry = obs_data_create();
+	obs_data_set_int(entry, "size", size);
+	obs_data_set_int(entry, "mtime", mtime);
+	obs_data_set_bool(entry, "deferrable", deferrable);
+
+	pthread_rwlock_rdlock(&obs->types_lock);
+
+	sources = obs_data_array_create();
+	for (size_t i = before->sources; i < after.sources; i++)
+		cache_source_type(sources, obs->source_types.array[i]);
+	obs_data_set_array(entry, "sources", sources);
+	obs_data_array_release(sources);
+
+	CACHE_TYPES(entry, "outputs", obs->output_types, before->outputs,
+		    after.outputs);
+	CACHE_TYPES(entry, "encoders", obs->encoder_types, before->encoders,
+		    after.encoders);
+	CACHE_TYPES(entry, "services", obs->service_types, before->services,
+		    after.services);
+
+	pthread_rwlock_unlock(&obs->types_lock);
+
+	modules = obs_data_get_obj(obs->module_cache, "modules");
+	obs_data_set_obj(modules, mod->bin_path, entry);
+	obs_data_release(modules);
+	obs_data_release(entry);
+}
+
+#undef CACHE_TYPES
+
+static char *get_module_cache_path(void)
+{
+	struct dstr path = {0};
+
+	if (!obs->module_config_path)
+		return NULL;
+
+	dstr_copy(&path, obs->module_config_path);
+	if (!dstr_is_empty(&path) && dstr_end(&path) != '/')
+		dstr_cat_ch(&path, '/');
+	dstr_cat(&path, "module-cache.json");
+	return path.array;
+}
+
+/* starts a new cache and returns the modules of the previous one, if it was
+ * written by this version of libobs */
+static obs_data_t *load_module_cache(void)
+{
+	char *path = get_module_cache_path();
+	obs_data_t *cache = NULL;
+	obs_data_t *modules = NULL;
+
+	if (!path)
+		return NULL;
+
+	if (os_file_exists(path))
+		cache = obs_data_create_from_json_file_safe(path, "bak");
+	if (cache && obs_data_get_int(cache, "version") == LIBOBS_API_VER)
+		modules = obs_data_get_obj(cache, "modules");
+	obs_data_release(cache);
+	bfree(path);
+
+	obs_data_release(obs->module_cache);
+	obs->module_cache = obs_data_create();
+	obs_data_set_int(obs->module_cache, "version", LIBOBS_API_VER);
+
+	obs_data_t *new_modules = obs_data_create();
+	obs_data_set_obj(obs->module_cache, "modules", new_modules);
+	obs_data_release(new_modules);
+
+	return modules;
+}
+
+static void save_module_cache(void)
+{
+	char *path = get_module_cache_path();
+
+	if (!path || !obs->module_cache) {
+		bfree(path);
+		return;
+	}
+
+	os_mkdirs(obs->module_config_path);
+	if (!obs_data_save_json_safe(obs->module_cache, path, "tmp", "bak"))
+		blog(LOG_WARNING, "Failed to save module cache '%s'", path);
+
+	bfree(path);
+}
+
+/* ------------------------------------------------------------------------- */
+/* deferred modules                                                          */
+
+bool obs_init_deferred_modules(void)
+{
+	pthread_mutexattr_t attr;
+	bool success = false;
+
+	if (pthread_rwlock_init(&obs->types_lock, NULL) != 0)
+		return false;
+
+	/* loading a module can look up the types of another one */
+	if (pthread_mutexattr_init(&attr) != 0)
+		return false;
+	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
+		goto fail;
+	if (pthread_mutex_init(&obs->deferred_modules_mutex, &attr) != 0)
+		goto fail;
+
+	success = true;
+
+fail:
+	pthread_mutexattr_destroy(&attr);
+	return success;
+}
+
+static void free_deferred_module(struct obs_deferred_module *dm)
+{
+	obs_data_release(dm->types);
+	bfree(dm->mod_name);
+	bfree(dm->bin_path);
+	bfree(dm->data_path);
+}
+
+void obs_free_deferred_modules(void)
+{
+	for (size_t i = 0; i < obs->deferred_modules.num; i++)
+		free_deferred_module(obs->deferred_modules.array + i);
+	da_free(obs->deferred_modules);
+
+	obs_data_release(obs->module_cache);
+	obs->module_cache = NULL;
+
+	pthread_mutex_destroy(&obs->deferred_modules_mutex);
+	pthread_rwlock_destroy(&obs->types_lock);
+}
+
+static bool defer_module(obs_data_t *cached, const struct obs_module_info *info)
+{
+	struct obs_deferred_module *dm;
+	obs_data_t *modules;
+	obs_data_t *entry;
+	long long size;
+	long long mtime;
+	const char *file;
+
+	if (!cached || !get_module_file_info(info->bin_path, &size, &mtime))
+		return false;
+
+	entry = obs_data_get_obj(cached, info->bin_path);
+	if (!entry || !obs_data_get_bool(entry, "deferrable") ||
+	    obs_data_get_int(entry, "size") != size ||
+	    obs_data_get_int(entry, "mtime") != mtime) {
+		obs_data_release(entry);
+		return false;
+	}
+
+	modules = obs_data_get_obj(obs->module_cache, "modules");
+	obs_data_set_obj(modules, info->bin_path, entry);
+	obs_data_release(modules);
+
+	file = strrchr(info->bin_path, '/');
+	file = file ? file + 1 : info->bin_path;
+
+	pthread_mutex_lock(&obs->deferred_modules_mutex);
+	dm = da_push_back_new(obs->deferred_modules);
+	dm->mod_name = get_module_name(file);
+	dm->bin_path = bstrdup(info->bin_path);
+	dm->data_path = bstrdup(info->data_path);
+	dm->types = entry;
+	pthread_mutex_unlock(&obs->deferred_modules_mutex);
+
+	blog(LOG_DEBUG, "Deferred loading module: %s", file);
+	return true;
+}
+
+static bool deferred_module_has_type(const struct obs_deferred_module *dm,
+				     const char *types, const char *field,
+				     const char *id, int source_type)
+{
+	obs_data_array_t *array = obs_data_get_array(dm->types, types);
+	size_t count = obs_data_array_count(array);
+	bool found = false;
+
+	for (size_t i = 0; !found && i < count; i++) {
+		obs_data_t *type = obs_data_array_item(array, i);
+		const char *value = field ? obs_data_get_string(type, field)
+					  : NULL;
+
+		if (field)
+			found = strcmp(value, id) == 0;
+		else
+			found = source_type < 0 ||
+				obs_data_get_int(type, "type") == source_type;
+
+		obs_data_release(type);
+	}
+
+	obs_data_array_release(array);
+	return found;
+}
+
+/* assumes deferred_modules_mutex */
+static void load_deferred_module(struct obs_deferred_module *dm)
+{
+	obs_module_t *module;
+	int code;
+
+	/* marked first, so looking up its own types while it registers them
+	 * doesn't load it again */
+	dm->loaded = true;
+
+	blog(LOG_INFO, "Loading deferred module: %s", dm->mod_name);
+
+	code = obs_open_module(&module, dm->bin_path, dm->data_path);
+	if (code == MODULE_SUCCESS)
+		obs_init_module(module);
+	else
+		blog(LOG_WARNING, "Failed to load deferred module '%s': %d",
+		     dm->bin_path, code);
+}
+
+/* returns true if the module with the type has been loaded, by this call or
+ * by another thread while the caller was looking the type up, so the caller
+ * should look again */
+bool obs_load_deferred_module(const char *types, const char *field,
+			      const char *id)
+{
+	bool found = false;
+
+	if (!obs || !id)
+		return false;
+
+	pthread_mutex_lock(&obs->deferred_modules_mutex);
+
+	for (size_t i = 0; i < obs->deferred_modules.num; i++) {
+		struct obs_deferred_module *dm =
+			obs->deferred_modules.array + i;
+
+		if (deferred_module_has_type(dm, types, field, id, -1)) {
+			if (!dm->loaded)
+				load_deferred_module(dm);
+			found = true;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&obs->deferred_modules_mutex);
+	return found;
+}
+
+void obs_load_deferred_modules(const char *types, int source_type)
+{
+	if (!obs)
+		return;
+
+	pthread_mutex_lock(&obs->deferred_modules_mutex);
+
+	for (size_t i = 0; i < obs->deferred_modules.num; i++) {
+		struct obs_deferred_module *dm =
+			obs->deferred_modules.array + i;
+
+		if (!dm->loaded && deferred_module_has_type(dm, types, NULL,
+							    NULL, source_type))
+			load_deferred_module(dm);
+	}
+
+	pthread_mutex_unlock(&obs->deferred_modules_mutex);
+}
+
+static bool load_deferred_module_by_name(const char *name)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&obs->deferred_modules_mutex);
+
+	for (size_t i = 0; i < obs->deferred_modules.num; i++) {
+		struct obs_deferred_module *dm =
+			obs->deferred_modules.array + i;
+
+		if (strcmp(dm->mod_name, name) == 0) {
+			if (!dm->loaded)
+				load_deferred_module(dm);
+			found = true;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&obs->deferred_modules_mutex);
+	return found;
+}
+
+void *obs_get_registered_type(const struct darray *types, size_t idx)
+{
+	void *type = NULL;
+
+	pthread_rwlock_rdlock(&obs->types_lock);
+	if (idx < types->num)
+		type = ((void **)types->array)[idx];
+	pthread_rwlock_unlock(&obs->types_lock);
+
+	return type;
+}
+
+void obs_set_deferred_module_loading(bool enable)
+{
+	if (obs)
+		obs->defer_modules = enable;
+}
+
+/* ------------------------------------------------------------------------- */
+
 bool obs_init_module(obs_module_t *module)
 {
+	struct module_type_counts counts;
+	uint64_t start_time;
+
 	if (!module || !obs)
 		return false;
 	if (module->loaded)
@@ -162,21 +583,92 @@ bool obs_init_module(obs_module_t *module)
 				   "obs_init_module(%s)", module->file);
 	profile_start(profile_name);
 
+	/* one module at a time, the types registered in between are the ones
+	 * recorded for it */
+	pthread_mutex_lock(&obs->deferred_modules_mutex);
+
+	get_module_type_counts(&counts);
+	start_time = os_gettime_ns();
+
 	module->loaded = module->load();
-	if (!module->loaded)
+	module->load_time_ns = os_gettime_ns() - start_time;
+
+	if (module->loaded)
+		cache_module_types(module, &counts);
+	else
 		blog(LOG_WARNING, "Failed to initialize module '%s'",
 		     module->file);
 
+	pthread_mutex_unlock(&obs->deferred_modules_mutex);
+
 	profile_end(profile_name);
 	return module->loaded;
 }
 
+static int cmp_module_time(const void *a, const void *b)
+{
+	const struct obs_module *mod_a = *(const struct obs_module **)a;
+	const struct obs_module *mod_b = *(const struct obs_module **)b;
+	uint64_t time_a = mod_a->open_time_ns + mod_a->load_time_ns;
+	uint64_t time_b = mod_b->open_time_ns + mod_b->load_time_ns;
+
+	return (time_a < time_b) ? 1 : ((time_a > time_b) ? -1 : 0);
+}
+
+static inline double ns_to_ms(uint64_t ns)
+{
+	return (double)ns / 1000000.0;
+}
+
 void obs_log_loaded_modules(void)
 {
+	DARRAY(struct obs_module *) modules;
+	uint64_t open_total = 0;
+	uint64_t load_total = 0;
+
+	da_init(modules);
+
 	blog(LOG_INFO, "  Loaded Modules:");
 
-	for (obs_module_t *mod = obs->first_module; !!mod; mod = mod->next)
+	for (obs_module_t *mod = obs->first_module; !!mod; mod = mod->next) {
 		blog(LOG_INFO, "    %s", mod->file);
+		da_push_back(modules, &mod);
+	}
+
+	pthread_mutex_lock(&obs->deferred_modules_mutex);
+	for (size_t i = 0, count = 0; i < obs->deferred_modules.num; i++) {
+		struct obs_deferred_module *dm =
+			obs->deferred_modules.array + i;
+		if (dm->loaded)
+			continue;
+		if (count++ == 0)
+			blog(LOG_INFO, "  Deferred Modules:");
+		blog(LOG_INFO, "    %s", dm->mod_name);
+	}
+	pthread_mutex_unlock(&obs->deferred_modules_mutex);
+
+	/* slowest first, open is os_dlopen, load is obs_module_load */
+	qsort(modules.array, modules.num, sizeof(struct obs_module *),
+	      cmp_module_time);
+
+	blog(LOG_INFO, "  Module Load Times:");
+
+	for (size_t i = 0; i < modules.num; i++) {
+		struct obs_module *mod = modules.array[i];
+		open_total += mod->open_time_ns;
+		load_total += mod->load_time_ns;
+
+		blog(LOG_INFO, "    %s: %.2f ms (open %.2f ms, load %.2f ms)",
+		     mod->file,
+		     ns_to_ms(mod->open_time_ns + mod->load_time_ns),
+		     ns_to_ms(mod->open_time_ns), ns_to_ms(mod->load_time_ns));
+	}
+
+	blog(LOG_INFO, "    total: %.2f ms (open %.2f ms, load %.2f ms)",
+	     ns_to_ms(open_total + load_total), ns_to_ms(open_total),
+	     ns_to_ms(load_total));
+
+	da_free(modules);
 }
 
 const char *obs_get_module_file_name(obs_module_t *module)
@@ -209,9 +701,10 @@ const char *obs_get_module_data_path(obs_module_t *module)
 	return module ? module->data_path : NULL;
 }
 
-obs_module_t *obs_get_module(const char *name)
+static obs_module_t *find_module(const char *name)
 {
-	obs_module_t *module = obs->first_module;
+	obs_module_t *module =
+		os_atomic_load_ptr((void *const volatile *)&obs->first_module);
 	while (module) {
 		if (strcmp(module->mod_name, name) == 0) {
 			return module;
@@ -223,6 +716,16 @@ obs_module_t *obs_get_module(const char *name)
 	return NULL;
 }
 
+obs_module_t *obs_get_module(const char *name)
+{
+	obs_module_t *module = find_module(name);
+
+	if (!module && load_deferred_module_by_name(name))
+		module = find_module(name);
+
+	return module;
+}
+
 char *obs_find_module_file(obs_module_t *module, const char *file)
 {
 	struct dstr output = {0};
@@ -273,6 +776,9 @@ static void load_all_callback(void *param, const struct obs_module_info *info)
 {
 	obs_module_t *module;
 
+	if (defer_module(param, info))
+		return;
+
 	int code = obs_open_module(&module, info->bin_path, info->data_path);
 	if (code != MODULE_SUCCESS) {
 		blog(LOG_DEBUG, "Failed to load module file '%s': %d",
@@ -281,8 +787,6 @@ static void load_all_callback(void *param, const struct obs_module_info *info)
 	}
 
 	obs_init_module(module);
-
-	UNUSED_PARAMETER(param);
 }
 
 static const char *obs_load_all_modules_name = "obs_load_all_modules";
@@ -292,13 +796,19 @@ static const char *reset_win32_symbol_paths_name = "reset_win32_symbol_paths";
 
 void obs_load_all_modules(void)
 {
+	obs_data_t *cached = NULL;
+
 	profile_start(obs_load_all_modules_name);
-	obs_find_modules(load_all_callback, NULL);
+	if (obs->defer_modules)
+		cached = load_module_cache();
+	obs_find_modules(load_all_callback, cached);
 #ifdef _WIN32
 	profile_start(reset_win32_symbol_paths_name);
 	reset_win32_symbol_paths();
 	profile_end(reset_win32_symbol_paths_name);
 #endif
+	save_module_cache();
+	obs_data_release(cached);
 	profile_end(obs_load_all_modules_name);
 }
 
@@ -540,7 +1050,21 @@ cleanup:
 	return lookup;
 }
 
-#define REGISTER_OBS_DEF(size_var, structure, dest, info)               \
+/* types are allocated one at a time and never move, lookups on other threads
+ * keep using them while a deferred module registers more */
+static void register_type(struct darray *all, struct darray *array,
+			  const void *data, size_t size)
+{
+	void *type = bmemdup(data, size);
+
+	pthread_rwlock_wrlock(&obs->types_lock);
+	darray_push_back(sizeof(type), all, &type);
+	if (array)
+		darray_push_back(sizeof(type), array, &type);
+	pthread_rwlock_unlock(&obs->types_lock);
+}
+
+#define REGISTER_OBS_DEF_(size_var, structure, info, push)              \
 	do {                                                            \
 		struct structure data = {0};                            \
 		if (!size_var) {                                        \
@@ -561,9 +1085,17 @@ cleanup:
 		}                                                       \
                                                                         \
 		memcpy(&data, info, size_var);                          \
-		da_push_back(dest, &data);                              \
+		push;                                                   \
 	} while (false)
 
+#define REGISTER_OBS_DEF(size_var, structure, dest, info) \
+	REGISTER_OBS_DEF_(size_var, structure, info,      \
+			  da_push_back(dest, &data))
+
+#define REGISTER_OBS_TYPE(size_var, structure, dest, info)                    \
+	REGISTER_OBS_DEF_(size_var, structure, info,                          \
+			  register_type(&dest.da, NULL, &data, sizeof(data)))
+
 #define CHECK_REQUIRED_VAL(type, info, val, func)                       \
 	do {                                                            \
 		if ((offsetof(type, val) + sizeof(info->val) > size) || \
@@ -695,9 +1227,7 @@ void obs_register_source_s(const struct obs_source_info *info, size_t size)
 		data.id = bstrdup(data.id);
 	}
 
-	if (array)
-		darray_push_back(sizeof(struct obs_source_info), array, &data);
-	da_push_back(obs->source_types, &data);
+	register_type(&obs->source_types.da, array, &data, sizeof(data));
 	return;
 
 error:
@@ -740,7 +1270,7 @@ void obs_register_output_s(const struct obs_output_info *info, size_t size)
 	}
 #undef CHECK_REQUIRED_VAL_
 
-	REGISTER_OBS_DEF(size, obs_output_info, obs->output_types, info);
+	REGISTER_OBS_TYPE(size, obs_output_info, obs->output_types, info);
 	return;
 
 error:
@@ -771,7 +1301,7 @@ void obs_register_encoder_s(const struct obs_encoder_info *info, size_t size)
 		CHECK_REQUIRED_VAL_(info, get_frame_size, obs_register_encoder);
 #undef CHECK_REQUIRED_VAL_
 
-	REGISTER_OBS_DEF(size, obs_encoder_info, obs->encoder_types, info);
+	REGISTER_OBS_TYPE(size, obs_encoder_info, obs->encoder_types, info);
 	return;
 
 error:
@@ -794,7 +1324,7 @@ void obs_register_service_s(const struct obs_service_info *info, size_t size)
 	CHECK_REQUIRED_VAL_(info, destroy, obs_register_service);
 #undef CHECK_REQUIRED_VAL_
 
-	REGISTER_OBS_DEF(size, obs_service_info, obs->service_types, info);
+	REGISTER_OBS_TYPE(size, obs_service_info, obs->service_types, info);
 	return;
 
 error:
@@ -28,6 +28,42 @@ static inline bool delay_capturing(const struct obs_output *output)
 	return os_atomic_load_bool(&output->delay_capturing);
 }
 
+/* Packet payloads are copied into one pooled byte ring (delay_payload)
+ * instead of a heap allocation per packet that lives for the whole delay.
+ * The ring is sized from the encoder bitrates when the delay starts and
+ * only grows in fixed steps after that.  Dequeued packets are copied into
+ * blocks from a small pool (delay_pool) that keeps a reference of its own
+ * on each block, a block is reused once the output has released it. */
+
+#define MAX_DELAY_RESERVE (1024ULL * 1024 * 1024)
+#define DELAY_PAYLOAD_STEP (4 * 1024 * 1024)
+#define DELAY_DATA_STEP (256 * sizeof(struct delay_data))
+#define DELAY_BLOCK_ALIGN 4096
+#define MAX_DELAY_POOL 256
+
+static inline void update_peak(struct obs_output *output)
+{
+	size_t allocated = output->delay_data.capacity +
+			   output->delay_payload.capacity +
+			   output->delay_pool_bytes;
+
+	if (allocated > output->delay_peak_bytes)
+		output->delay_peak_bytes = allocated;
+}
+
+/* circlebuf doubles its capacity when it runs out, which at the reserved
+ * size would mean copying and allocating hundreds of megabytes with
+ * delay_mutex held.  Grow by a fixed step instead. */
+static inline void grow_ring(struct circlebuf *cb, size_t size, size_t step)
+{
+	size_t needed = cb->size + size;
+
+	if (needed <= cb->capacity)
+		return;
+
+	circlebuf_reserve(cb, needed + step);
+}
+
 static inline void push_packet(struct obs_output *output,
 			       struct encoder_packet *packet, uint64_t t)
 {
@@ -35,10 +71,142 @@ static inline void push_packet(struct obs_output *output,
 
 	dd.msg = DELAY_MSG_PACKET;
 	dd.ts = t;
-	obs_encoder_packet_create_instance(&dd.packet, packet);
+	dd.packet = *packet;
+	dd.packet.data = NULL;
 
 	pthread_mutex_lock(&output->delay_mutex);
+	grow_ring(&output->delay_data, sizeof(dd), DELAY_DATA_STEP);
+	grow_ring(&output->delay_payload, packet->size, DELAY_PAYLOAD_STEP);
 	circlebuf_push_back(&output->delay_data, &dd, sizeof(dd));
+	circlebuf_push_back(&output->delay_payload, packet->data,
+			    packet->size);
+	update_peak(output);
+	pthread_mutex_unlock(&output->delay_mutex);
+}
+
+static inline bool block_idle(const struct delay_block *block)
+{
+	return os_atomic_load_long(block->refs) == 1;
+}
+
+/* must be called with delay_mutex held.  Returns the smallest idle block
+ * the packet fits in, resizes an idle block that is too small, or adds a
+ * new one while the pool is not full. */
+static long *get_pool_block(struct obs_output *output, size_t size)
+{
+	struct delay_block *best = NULL;
+	struct delay_block *small = NULL;
+	struct delay_block *block;
+	size_t capacity;
+
+	for (size_t i = 0; i < output->delay_pool.num; i++) {
+		block = &output->delay_pool.array[i];
+		if (!block_idle(block))
+			continue;
+
+		if (block->capacity >= size) {
+			if (!best || block->capacity < best->capacity)
+				best = block;
+		} else if (!small) {
+			small = block;
+		}
+	}
+
+	if (best)
+		return best->refs;
+
+	capacity = (size + DELAY_BLOCK_ALIGN - 1) & ~(DELAY_BLOCK_ALIGN - 1);
+
+	if (small) {
+		output->delay_pool_bytes += capacity - small->capacity;
+		small->refs = brealloc(small->refs, capacity + sizeof(long));
+		small->capacity = capacity;
+		return small->refs;
+	}
+
+	if (output->delay_pool.num >= MAX_DELAY_POOL)
+		return NULL;
+
+	block = da_push_back_new(output->delay_pool);
+	block->refs = bmalloc(capacity + sizeof(long));
+	block->capacity = capacity;
+	*block->refs = 1;
+	output->delay_pool_bytes += capacity;
+	return block->refs;
+}
+
+/* must be called with delay_mutex held, in queue order */
+static inline void pop_payload(struct obs_output *output,
+			       struct encoder_packet *packet)
+{
+	long *p_refs = get_pool_block(output, packet->size);
+
+	/* the pool keeps its own reference, the output releases the other */
+	if (p_refs) {
+		os_atomic_set_long(p_refs, 2);
+	} else {
+		p_refs = bmalloc(packet->size + sizeof(long));
+		*p_refs = 1;
+	}
+
+	packet->data = (void *)(p_refs + 1);
+	circlebuf_pop_front(&output->delay_payload, packet->data,
+			    packet->size);
+}
+
+void obs_output_free_delay_pool(obs_output_t *output)
+{
+	/* blocks the output still holds are freed by its last release */
+	for (size_t i = 0; i < output->delay_pool.num; i++) {
+		long *p_refs = output->delay_pool.array[i].refs;
+		if (os_atomic_dec_long(p_refs) == 0)
+			bfree(p_refs);
+	}
+
+	da_free(output->delay_pool);
+	output->delay_pool_bytes = 0;
+}
+
+static uint64_t get_encoder_bitrate(obs_encoder_t *encoder)
+{
+	obs_data_t *settings;
+	uint64_t kbps;
+
+	if (!encoder)
+		return 0;
+
+	settings = obs_encoder_get_settings(encoder);
+	kbps = (uint64_t)obs_data_get_int(settings, "bitrate");
+	obs_data_release(settings);
+	return kbps * 1000;
+}
+
+static void reserve_delay_buffers(struct obs_output *output)
+{
+	uint64_t bitrate = get_encoder_bitrate(output->video_encoder);
+	uint64_t packets = 60;
+	uint64_t bytes;
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		if (output->audio_encoders[i]) {
+			bitrate += get_encoder_bitrate(
+				output->audio_encoders[i]);
+			packets += 50;
+		}
+	}
+
+	/* a quarter on top for keyframes and bitrate overshoot */
+	bytes = bitrate / 8 * output->delay_sec;
+	bytes += bytes / 4;
+	if (bytes > MAX_DELAY_RESERVE)
+		bytes = MAX_DELAY_RESERVE;
+
+	pthread_mutex_lock(&output->delay_mutex);
+	circlebuf_reserve(&output->delay_payload, (size_t)bytes);
+	circlebuf_reserve(&output->delay_data,
+			  (size_t)(packets * output->delay_sec *
+				   sizeof(struct delay_data)));
+	update_peak(output);
 	pthread_mutex_unlock(&output->delay_mutex);
 }
 
@@ -49,8 +217,11 @@ static inline void process_delay_data(struct obs_output *output,
 	case DELAY_MSG_PACKET:
 		if (!delay_active(output) || !delay_capturing(output))
 			obs_encoder_packet_release(&dd->packet);
-		else
+		else {
+			obs_output_trace_packet(output, &dd->packet,
+						OBS_PACKET_TRACE_DELAYED);
 			output->delay_callback(output, &dd->packet);
+		}
 		break;
 	case DELAY_MSG_START:
 		obs_output_actual_start(output);
@@ -65,12 +236,20 @@ void obs_output_cleanup_delay(obs_output_t *output)
 {
 	struct delay_data dd;
 
-	while (output->delay_data.size) {
+	if (output->delay_peak_bytes)
+		blog(LOG_INFO, "Output '%s': delay buffer peaked at %.1f MB",
+		     output->context.name,
+		     (double)output->delay_peak_bytes / (1024.0 * 1024.0));
+
+	/* queued packets have no payload of their own */
+	while (output->delay_data.size)
 		circlebuf_pop_front(&output->delay_data, &dd, sizeof(dd));
-		if (dd.msg == DELAY_MSG_PACKET) {
-			obs_encoder_packet_release(&dd.packet);
-		}
-	}
+
+	/* the payload ring can be hundreds of megabytes, it is allocated
+	 * again on the next start */
+	circlebuf_free(&output->delay_payload);
+	obs_output_free_delay_pool(output);
+	output->delay_peak_bytes = 0;
 
 	output->active_delay_ns = 0;
 	os_atomic_set_long(&output->delay_restart_refs, 0);
@@ -85,10 +264,10 @@ static inline bool pop_packet(struct obs_output *output, uint64_t t)
 
 	/* ------------------------------------------------ */
 
-	preserve = (output->delay_cur_flags & OBS_OUTPUT_DELAY_PRESERVE) != 0;
-
 	pthread_mutex_lock(&output->delay_mutex);
 
+	preserve = (output->delay_cur_flags & OBS_OUTPUT_DELAY_PRESERVE) != 0;
+
 	if (output->delay_data.size) {
 		circlebuf_peek_front(&output->delay_data, &dd, sizeof(dd));
 		elapsed_time = (t - dd.ts);
@@ -99,6 +278,8 @@ static inline bool pop_packet(struct obs_output *output, uint64_t t)
 		} else if (elapsed_time > output->active_delay_ns) {
 			circlebuf_pop_front(&output->delay_data, NULL,
 					    sizeof(dd));
+			if (dd.msg == DELAY_MSG_PACKET)
+				pop_payload(output, &dd.packet);
 			popped = true;
 		}
 	}
@@ -117,6 +298,7 @@ void process_delay(void *data, struct encoder_packet *packet)
 {
 	struct obs_output *output = data;
 	uint64_t t = os_gettime_ns();
+	obs_output_trace_received(output, packet);
 	push_packet(output, packet, t);
 	while (pop_packet(output, t))
 		;
@@ -146,6 +328,8 @@ bool obs_output_delay_start(obs_output_t *output)
 			return false;
 		if (!obs_output_initialize_encoders(output, 0))
 			return false;
+
+		reserve_delay_buffers(output);
 	}
 
 	pthread_mutex_lock(&output->delay_mutex);
@@ -197,6 +381,24 @@ void obs_output_set_delay(obs_output_t *output, uint32_t delay_sec,
 
 	output->delay_sec = delay_sec;
 	output->delay_flags = flags;
+
+	/* a running delay is changed in place: queued packets are released
+	 * against the new delay, longer delays hold the output until the
+	 * queue has filled up again.  Adding or removing the delay changes
+	 * the packet path, that only takes effect on the next start. */
+	pthread_mutex_lock(&output->delay_mutex);
+	if (delay_active(output) && output->active_delay_ns && delay_sec) {
+		output->active_delay_ns = (uint64_t)delay_sec * 1000000000ULL;
+		output->delay_cur_flags = flags;
+		pthread_mutex_unlock(&output->delay_mutex);
+
+		blog(LOG_INFO,
+		     "Output '%s': delay changed to %" PRIu32 " seconds",
+		     output->context.name, delay_sec);
+		obs_output_signal_delay(output, "delay_changed");
+		return;
+	}
+	pthread_mutex_unlock(&output->delay_mutex);
 }
 
 uint32_t obs_output_get_delay(const obs_output_t *output)
@@ -206,6 +408,20 @@ uint32_t obs_output_get_delay(const obs_output_t *output)
 		       : 0;
 }
 
+uint64_t obs_output_get_delay_memory_usage(obs_output_t *output)
+{
+	uint64_t allocated;
+
+	if (!obs_output_valid(output, "obs_output_get_delay_memory_usage"))
+		return 0;
+
+	pthread_mutex_lock(&output->delay_mutex);
+	allocated = output->delay_data.capacity +
+		    output->delay_payload.capacity + output->delay_pool_bytes;
+	pthread_mutex_unlock(&output->delay_mutex);
+	return allocated;
+}
+
 uint32_t obs_output_get_active_delay(const obs_output_t *output)
 {
 	return obs_output_valid(output, "obs_output_set_delay")
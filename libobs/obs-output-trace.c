@@ -0,0 +1,466 @@
+/******************************************************************************
+    Copyright (C) 2023 OBS Project
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <inttypes.h>
+#include <limits.h>
+#include "obs-internal.h"
+
+/* Each stamp records the time since the previous stage the packet passed
+ * into a histogram of the output, so a stall shows up in the stage that
+ * caused it.  A packet is first stamped (OBS_PACKET_TRACE_ENCODED) when the
+ * output receives it from the encoder, which also records the encode
+ * latency from the capture time of the packet (dts_usec).
+ *
+ * Stamps are kept in a table of the output instead of the packet, found by
+ * the encoder and sys_dts_usec of the packet.  Outputs copy and reparse
+ * packets, but always keep those two.  A packet takes the oldest of a few
+ * neighbouring slots, so packets are only lost from the trace once a few
+ * thousand newer ones were received while they were queued.
+ *
+ * Tracing a packet never takes a lock.  A slot is claimed with an atomic
+ * flag that is only tried: if another thread has the slot at that moment,
+ * the stamp is skipped instead of waited for.  Histogram buckets are atomic
+ * counters and events go to a ring, where every slot carries a sequence
+ * number so a reader can skip a slot that was being rewritten while it was
+ * copied.  trace->mutex only serializes enabling and reading the trace. */
+
+#define PACKET_TRACE_PROBES 4
+
+static const char *stage_names[OBS_PACKET_TRACE_STAGES] = {
+	"encode", "delay", "interleave", "mux", "send",
+};
+
+static inline bool trace_enabled(const struct obs_output *output)
+{
+	return os_atomic_load_bool(&output->trace.enabled);
+}
+
+static inline size_t get_bucket(uint64_t usec)
+{
+	size_t bucket = 0;
+
+	while (usec > 1 && bucket < PACKET_TRACE_BUCKETS - 1) {
+		usec >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+static void record_histogram(struct packet_trace_histogram *hist,
+			     uint64_t usec)
+{
+	long max_usec = usec > LONG_MAX ? LONG_MAX : (long)usec;
+	long cur_max;
+
+	os_atomic_inc_long(&hist->buckets[get_bucket(usec)]);
+	os_atomic_inc_long(&hist->count);
+
+	do {
+		cur_max = os_atomic_load_long(&hist->max_usec);
+	} while (cur_max < max_usec &&
+		 !os_atomic_compare_swap_long(&hist->max_usec, cur_max,
+					      max_usec));
+}
+
+static void record_event(struct packet_trace *trace,
+			 const struct encoder_packet *packet,
+			 enum obs_packet_trace_stage stage, uint64_t start_ns,
+			 uint64_t end_ns)
+{
+	struct packet_trace_event *event;
+	long seq = os_atomic_inc_long(&trace->next_event);
+
+	event = &trace->events[(unsigned long)(seq - 1) % PACKET_TRACE_EVENTS];
+
+	os_atomic_set_long(&event->seq, 0);
+	event->start_ns = start_ns;
+	event->end_ns = end_ns;
+	event->stage = stage;
+	event->type = packet->type;
+	event->track_idx = (uint32_t)packet->track_idx;
+	event->keyframe = packet->keyframe;
+	os_atomic_set_long(&event->seq, seq);
+}
+
+static void record(struct packet_trace *trace,
+		   const struct encoder_packet *packet,
+		   enum obs_packet_trace_stage stage, uint64_t start_ns,
+		   uint64_t end_ns)
+{
+	size_t type = packet->type == OBS_ENCODER_VIDEO ? 0 : 1;
+
+	if (end_ns < start_ns)
+		return;
+
+	record_histogram(&trace->histograms[stage][type],
+			 (end_ns - start_ns) / 1000);
+	record_event(trace, packet, stage, start_ns, end_ns);
+}
+
+static inline size_t get_slot_idx(const struct encoder_packet *packet)
+{
+	uint64_t key = (uint64_t)packet->sys_dts_usec ^
+		       (uint64_t)(uintptr_t)packet->encoder;
+
+	return (size_t)((key * 0x9E3779B97F4A7C15ULL) >>
+			(64 - PACKET_TRACE_SLOT_BITS));
+}
+
+static inline bool try_lock_slot(struct packet_trace_slot *slot)
+{
+	return os_atomic_compare_swap_long(&slot->busy, 0, 1);
+}
+
+static inline void unlock_slot(struct packet_trace_slot *slot)
+{
+	os_atomic_set_long(&slot->busy, 0);
+}
+
+static inline bool slot_matches(const struct packet_trace_slot *slot,
+				const struct encoder_packet *packet)
+{
+	return slot->encoder == packet->encoder &&
+	       slot->sys_dts_usec == packet->sys_dts_usec;
+}
+
+/* returns the slot of the packet locked, or NULL if it has none (or it is
+ * busy) */
+static struct packet_trace_slot *
+find_slot(struct packet_trace *trace, const struct encoder_packet *packet)
+{
+	size_t idx = get_slot_idx(packet);
+
+	for (size_t i = 0; i < PACKET_TRACE_PROBES; i++) {
+		struct packet_trace_slot *slot =
+			&trace->slots[(idx + i) % PACKET_TRACE_SLOTS];
+
+		if (!try_lock_slot(slot))
+			continue;
+		if (slot_matches(slot, packet))
+			return slot;
+
+		unlock_slot(slot);
+	}
+
+	return NULL;
+}
+
+/* returns the slot of the packet locked, taking over the oldest slot if it
+ * has none yet */
+static struct packet_trace_slot *
+claim_slot(struct packet_trace *trace, const struct encoder_packet *packet)
+{
+	struct packet_trace_slot *oldest = NULL;
+	uint64_t oldest_ns = UINT64_MAX;
+	size_t idx = get_slot_idx(packet);
+
+	for (size_t i = 0; i < PACKET_TRACE_PROBES; i++) {
+		struct packet_trace_slot *slot =
+			&trace->slots[(idx + i) % PACKET_TRACE_SLOTS];
+		uint64_t received_ns;
+
+		if (!try_lock_slot(slot))
+			continue;
+		if (slot_matches(slot, packet))
+			return slot;
+
+		received_ns = slot->stamps[OBS_PACKET_TRACE_ENCODED];
+		unlock_slot(slot);
+
+		if (received_ns < oldest_ns) {
+			oldest_ns = received_ns;
+			oldest = slot;
+		}
+	}
+
+	/* the oldest may have been taken over in between, that only means
+	 * an older packet is lost from the trace instead */
+	if (!oldest || !try_lock_slot(oldest))
+		return NULL;
+
+	oldest->encoder = packet->encoder;
+	oldest->sys_dts_usec = packet->sys_dts_usec;
+	memset(oldest->stamps, 0, sizeof(oldest->stamps));
+	return oldest;
+}
+
+void obs_output_trace_received(struct obs_output *output,
+			       const struct encoder_packet *packet)
+{
+	struct packet_trace *trace = &output->trace;
+	struct packet_trace_slot *slot;
+	uint64_t ts;
+
+	if (!trace_enabled(output))
+		return;
+
+	ts = os_gettime_ns();
+
+	slot = claim_slot(trace, packet);
+	if (slot) {
+		slot->stamps[OBS_PACKET_TRACE_ENCODED] = ts;
+		unlock_slot(slot);
+	}
+
+	if (packet->dts_usec > 0)
+		record(trace, packet, OBS_PACKET_TRACE_ENCODED,
+		       (uint64_t)packet->dts_usec * 1000, ts);
+}
+
+void obs_output_trace_packet(obs_output_t *output,
+			     struct encoder_packet *packet,
+			     enum obs_packet_trace_stage stage)
+{
+	struct packet_trace *trace;
+	struct packet_trace_slot *slot;
+	uint64_t prev_ns = 0;
+	uint64_t ts;
+
+	if (!output || !packet || !trace_enabled(output))
+		return;
+	if (stage <= OBS_PACKET_TRACE_ENCODED ||
+	    stage >= OBS_PACKET_TRACE_STAGES)
+		return;
+
+	trace = &output->trace;
+	ts = os_gettime_ns();
+
+	slot = find_slot(trace, packet);
+	if (slot) {
+		slot->stamps[stage] = ts;
+
+		for (int prev = stage - 1; prev >= 0 && !prev_ns; prev--)
+			prev_ns = slot->stamps[prev];
+
+		unlock_slot(slot);
+	}
+
+	if (prev_ns)
+		record(trace, packet, stage, prev_ns, ts);
+}
+
+/* must be called with trace->mutex held.  threads still stamping from
+ * before the trace was disabled hold a slot only briefly */
+static void reset_slots(struct packet_trace *trace)
+{
+	for (size_t i = 0; i < PACKET_TRACE_SLOTS; i++) {
+		struct packet_trace_slot *slot = &trace->slots[i];
+
+		while (!try_lock_slot(slot))
+			os_sleep_ms(0);
+
+		slot->encoder = NULL;
+		slot->sys_dts_usec = 0;
+		memset(slot->stamps, 0, sizeof(slot->stamps));
+		unlock_slot(slot);
+	}
+}
+
+void obs_output_set_packet_trace(obs_output_t *output, bool enable)
+{
+	struct packet_trace *trace;
+
+	if (!obs_output_valid(output, "obs_output_set_packet_trace"))
+		return;
+
+	trace = &output->trace;
+
+	pthread_mutex_lock(&trace->mutex);
+
+	if (enable && !trace_enabled(output)) {
+		if (!trace->events)
+			trace->events = bmalloc(sizeof(*trace->events) *
+						PACKET_TRACE_EVENTS);
+
+		memset(trace->histograms, 0, sizeof(trace->histograms));
+		memset(trace->events, 0,
+		       sizeof(*trace->events) * PACKET_TRACE_EVENTS);
+		os_atomic_set_long(&trace->next_event, 0);
+		reset_slots(trace);
+	}
+
+	/* the event ring and slots are kept until the output is destroyed,
+	 * a packet thread may still be recording into them */
+	os_atomic_set_bool(&trace->enabled, enable);
+
+	pthread_mutex_unlock(&trace->mutex);
+}
+
+bool obs_output_packet_trace_enabled(const obs_output_t *output)
+{
+	return obs_output_valid(output, "obs_output_packet_trace_enabled")
+		       ? trace_enabled(output)
+		       : false;
+}
+
+static long get_percentile(const struct packet_trace_histogram *hist,
+			   long count, double percentile)
+{
+	long target = (long)((double)count * percentile + 0.5);
+	long total = 0;
+
+	if (target < 1)
+		target = 1;
+
+	for (size_t i = 0; i < PACKET_TRACE_BUCKETS; i++) {
+		total += os_atomic_load_long(&hist->buckets[i]);
+		if (total >= target)
+			return 1L << (i + 1);
+	}
+
+	return os_atomic_load_long(&hist->max_usec);
+}
+
+obs_data_t *obs_output_get_packet_trace_stats(obs_output_t *output)
+{
+	obs_data_array_t *stages;
+	obs_data_t *stats;
+
+	if (!obs_output_valid(output, "obs_output_get_packet_trace_stats"))
+		return NULL;
+
+	stats = obs_data_create();
+	stages = obs_data_array_create();
+
+	for (size_t i = 0; i < OBS_PACKET_TRACE_STAGES; i++) {
+		for (size_t type = 0; type < 2; type++) {
+			const struct packet_trace_histogram *hist =
+				&output->trace.histograms[i][type];
+			long count = os_atomic_load_long(&hist->count);
+			obs_data_t *stage;
+
+			if (!count)
+				continue;
+
+			stage = obs_data_create();
+			obs_data_set_string(stage, "stage", stage_names[i]);
+			obs_data_set_string(stage, "type",
+					    type == 0 ? "video" : "audio");
+			obs_data_set_int(stage, "count", count);
+			obs_data_set_int(stage, "p50_usec",
+					 get_percentile(hist, count, 0.5));
+			obs_data_set_int(stage, "p99_usec",
+					 get_percentile(hist, count, 0.99));
+			obs_data_set_int(stage, "max_usec",
+					 os_atomic_load_long(&hist->max_usec));
+			obs_data_array_push_back(stages, stage);
+			obs_data_release(stage);
+		}
+	}
+
+	obs_data_set_bool(stats, "enabled", trace_enabled(output));
+	obs_data_set_array(stats, "stages", stages);
+	obs_data_array_release(stages);
+	return stats;
+}
+
+static bool copy_event(const struct packet_trace_event *src,
+		       struct packet_trace_event *dst)
+{
+	long seq = os_atomic_load_long(&src->seq);
+
+	if (!seq)
+		return false;
+
+	*dst = *src;
+	return os_atomic_load_long(&src->seq) == seq;
+}
+
+char *obs_output_get_packet_trace_json(obs_output_t *output)
+{
+	struct packet_trace *trace;
+	struct dstr json = {0};
+	bool first = true;
+	long next;
+	long start;
+
+	if (!obs_output_valid(output, "obs_output_get_packet_trace_json"))
+		return NULL;
+
+	trace = &output->trace;
+	dstr_copy(&json, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	pthread_mutex_lock(&trace->mutex);
+
+	next = trace->events ? os_atomic_load_long(&trace->next_event) : 0;
+	start = next > PACKET_TRACE_EVENTS ? next - PACKET_TRACE_EVENTS : 0;
+
+	for (long i = start; i < next; i++) {
+		struct packet_trace_event event;
+		size_t idx = (unsigned long)i % PACKET_TRACE_EVENTS;
+		bool video;
+
+		if (!copy_event(&trace->events[idx], &event))
+			continue;
+
+		video = event.type == OBS_ENCODER_VIDEO;
+
+		/* one row per track: video, then the audio tracks */
+		dstr_catf(&json,
+			  "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+			  "\"ts\":%" PRIu64 ",\"dur\":%" PRIu64 ","
+			  "\"pid\":1,\"tid\":%u,"
+			  "\"args\":{\"keyframe\":%s}}",
+			  first ? "" : ",", stage_names[event.stage],
+			  video ? "video" : "audio", event.start_ns / 1000,
+			  (event.end_ns - event.start_ns) / 1000,
+			  video ? 0 : event.track_idx + 1,
+			  event.keyframe ? "true" : "false");
+		first = false;
+	}
+
+	pthread_mutex_unlock(&trace->mutex);
+
+	dstr_cat(&json, "]}");
+	return json.array;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void set_packet_trace_proc(void *data, calldata_t *cd)
+{
+	obs_output_set_packet_trace(data, calldata_bool(cd, "enabled"));
+}
+
+static void get_packet_trace_stats_proc(void *data, calldata_t *cd)
+{
+	obs_data_t *stats = obs_output_get_packet_trace_stats(data);
+
+	calldata_set_string(cd, "json", obs_data_get_json(stats));
+	obs_data_release(stats);
+}
+
+static void get_packet_trace_proc(void *data, calldata_t *cd)
+{
+	char *json = obs_output_get_packet_trace_json(data);
+
+	calldata_set_string(cd, "json", json);
+	bfree(json);
+}
+
+void obs_output_add_trace_procs(struct obs_output *output)
+{
+	proc_handler_t *ph = output->context.procs;
+
+	proc_handler_add(ph, "void set_packet_trace(bool enabled)",
+			 set_packet_trace_proc, output);
+	proc_handler_add(ph, "void get_packet_trace_stats(out string json)",
+			 get_packet_trace_stats_proc, output);
+	proc_handler_add(ph, "void get_packet_trace(out string json)",
+			 get_packet_trace_proc, output);
+}
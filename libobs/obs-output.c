@@ -56,14 +56,30 @@ static inline bool data_capture_ending(const struct obs_output *output)
 	return os_atomic_load_bool(&output->end_data_capture_thread_active);
 }
 
+static const struct obs_output_info *find_output_type(const char *id)
+{
+	const struct obs_output_info *info = NULL;
+
+	pthread_rwlock_rdlock(&obs->types_lock);
+	for (size_t i = 0; i < obs->output_types.num; i++) {
+		if (strcmp(obs->output_types.array[i]->id, id) == 0) {
+			info = obs->output_types.array[i];
+			break;
+		}
+	}
+	pthread_rwlock_unlock(&obs->types_lock);
+
+	return info;
+}
+
 const struct obs_output_info *find_output(const char *id)
 {
-	size_t i;
-	for (i = 0; i < obs->output_types.num; i++)
-		if (strcmp(obs->output_types.array[i].id, id) == 0)
-			return obs->output_types.array + i;
+	const struct obs_output_info *info = find_output_type(id);
 
-	return NULL;
+	if (!info && obs_load_deferred_module("outputs", "id", id))
+		info = find_output_type(id);
+
+	return info;
 }
 
 const char *obs_output_get_display_name(const char *id)
@@ -83,6 +99,7 @@ static const char *output_signals[] = {
 	"void deactivate(ptr output)",
 	"void reconnect(ptr output)",
 	"void reconnect_success(ptr output)",
+	"void delay_changed(ptr output, int sec)",
 	NULL,
 };
 
@@ -94,6 +111,7 @@ static bool init_output_handlers(struct obs_output *output, const char *name,
 		return false;
 
 	signal_handler_add_array(output->context.signals, output_signals);
+	obs_output_add_trace_procs(output);
 	return true;
 }
 
@@ -109,6 +127,9 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 	pthread_mutex_init_value(&output->delay_mutex);
 	pthread_mutex_init_value(&output->caption_mutex);
 	pthread_mutex_init_value(&output->pause.mutex);
+	pthread_mutex_init_value(&output->trace.mutex);
+	output->trace.slots =
+		bzalloc(sizeof(*output->trace.slots) * PACKET_TRACE_SLOTS);
 
 	if (pthread_mutex_init(&output->interleaved_mutex, NULL) != 0)
 		goto fail;
@@ -118,6 +139,8 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 		goto fail;
 	if (pthread_mutex_init(&output->pause.mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutex_init(&output->trace.mutex, NULL) != 0)
+		goto fail;
 	if (os_event_init(&output->stopping_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
 	if (!init_output_handlers(output, name, settings, hotkey_data))
@@ -224,13 +247,18 @@ void obs_output_destroy(obs_output_t *output)
 		pthread_mutex_destroy(&output->caption_mutex);
 		pthread_mutex_destroy(&output->interleaved_mutex);
 		pthread_mutex_destroy(&output->delay_mutex);
+		pthread_mutex_destroy(&output->trace.mutex);
 		os_event_destroy(output->reconnect_stop_event);
 		obs_context_data_free(&output->context);
 		circlebuf_free(&output->delay_data);
+		circlebuf_free(&output->delay_payload);
+		obs_output_free_delay_pool(output);
 		if (output->owns_info_id)
 			bfree((void *)output->info.id);
 		if (output->last_error_message)
 			bfree(output->last_error_message);
+		bfree(output->trace.events);
+		bfree(output->trace.slots);
 		bfree(output);
 	}
 }
@@ -1291,6 +1319,7 @@ static inline void send_interleaved(struct obs_output *output)
 #endif
 	}
 
+	obs_output_trace_packet(output, &out, OBS_PACKET_TRACE_INTERLEAVED);
 	output->info.encoded_packet(output->context.data, &out);
 	obs_encoder_packet_release(&out);
 }
@@ -1634,6 +1663,9 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (!active(output))
 		return;
 
+	if (!output->active_delay_ns)
+		obs_output_trace_received(output, packet);
+
 	if (packet->type == OBS_ENCODER_AUDIO)
 		packet->track_idx = get_track_index(output, packet);
 
@@ -1688,9 +1720,14 @@ static void default_encoded_callback(void *param, struct encoder_packet *packet)
 	struct obs_output *output = param;
 
 	if (data_active(output)) {
+		if (!output->active_delay_ns)
+			obs_output_trace_received(output, packet);
+
 		if (packet->type == OBS_ENCODER_AUDIO)
 			packet->track_idx = get_track_index(output, packet);
 
+		obs_output_trace_packet(output, packet,
+					OBS_PACKET_TRACE_INTERLEAVED);
 		output->info.encoded_packet(output->context.data, packet);
 
 		if (packet->type == OBS_ENCODER_VIDEO)
@@ -1871,9 +1908,11 @@ static void hook_data_capture(struct obs_output *output, bool encoded,
 					   : default_encoded_callback;
 
 		if (output->delay_sec) {
+			pthread_mutex_lock(&output->delay_mutex);
 			output->active_delay_ns =
 				(uint64_t)output->delay_sec * 1000000000ULL;
 			output->delay_cur_flags = output->delay_flags;
+			pthread_mutex_unlock(&output->delay_mutex);
 			output->delay_callback = encoded_callback;
 			encoded_callback = process_delay;
 			os_atomic_set_bool(&output->delay_active, true);
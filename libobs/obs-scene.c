@@ -18,6 +18,7 @@
 
 #include "util/threading.h"
 #include "util/util_uint64.h"
+#include "media-io/audio-mix.h"
 #include "graphics/math-defs.h"
 #include "obs-scene.h"
 
@@ -86,6 +87,7 @@ static void *scene_create(obs_data_t *settings, struct obs_source *source)
 	pthread_mutexattr_t attr;
 	struct obs_scene *scene = bzalloc(sizeof(struct obs_scene));
 	scene->source = source;
+	scene->update_transforms = true;
 
 	if (strcmp(source->info.id, group_info.id) == 0) {
 		scene->is_group = true;
@@ -183,6 +185,7 @@ static void scene_destroy(void *data)
 
 	pthread_mutex_destroy(&scene->video_mutex);
 	pthread_mutex_destroy(&scene->audio_mutex);
+	bfree(scene->audio_fade_buf);
 	bfree(scene);
 }
 
@@ -237,6 +240,24 @@ static inline void detach_sceneitem(struct obs_scene_item *item)
 	item->parent = NULL;
 }
 
+static inline void scene_transforms_changed(struct obs_scene *scene)
+{
+	os_atomic_set_bool(&scene->update_transforms, true);
+
+	/* a group is only updated by the scene it is in, which can't be
+	 * reached from here, so make every scene check its items again */
+	if (scene->is_group)
+		obs_layout_changed();
+}
+
+static inline void item_transform_changed(struct obs_scene_item *item)
+{
+	os_atomic_set_bool(&item->update_transform, true);
+
+	if (item->parent)
+		scene_transforms_changed(item->parent);
+}
+
 static inline void attach_sceneitem(struct obs_scene *parent,
 				    struct obs_scene_item *item,
 				    struct obs_scene_item *prev)
@@ -255,6 +276,8 @@ static inline void attach_sceneitem(struct obs_scene *parent,
 			parent->first_item->prev = item;
 		parent->first_item = item;
 	}
+
+	item_transform_changed(item);
 }
 
 void add_alignment(struct vec2 *v, uint32_t align, int cx, int cy)
@@ -334,6 +357,26 @@ static inline uint32_t calc_cy(const struct obs_scene_item *item,
 	return (crop_cy > height) ? 2 : (height - crop_cy);
 }
 
+static void update_item_box_extents(struct obs_scene_item *item)
+{
+	struct vec3 corner;
+
+	vec2_set(&item->box_min, M_INFINITE, M_INFINITE);
+	vec2_set(&item->box_max, -M_INFINITE, -M_INFINITE);
+
+	for (int i = 0; i < 4; i++) {
+		vec3_set(&corner, (float)(i & 1), (float)(i >> 1), 0.0f);
+		vec3_transform(&corner, &corner, &item->box_transform);
+
+		item->box_min.x = fminf(item->box_min.x, corner.x);
+		item->box_min.y = fminf(item->box_min.y, corner.y);
+		item->box_max.x = fmaxf(item->box_max.x, corner.x);
+		item->box_max.y = fmaxf(item->box_max.y, corner.y);
+	}
+
+	matrix4_inv(&item->inv_box_transform, &item->box_transform);
+}
+
 static void update_item_transform(struct obs_scene_item *item, bool update_tex)
 {
 	uint32_t width;
@@ -343,8 +386,6 @@ static void update_item_transform(struct obs_scene_item *item, bool update_tex)
 	struct vec2 base_origin;
 	struct vec2 origin;
 	struct vec2 scale;
-	struct calldata params;
-	uint8_t stack[128];
 
 	if (os_atomic_load_long(&item->defer_update) > 0)
 		return;
@@ -409,11 +450,15 @@ static void update_item_transform(struct obs_scene_item *item, bool update_tex)
 	matrix4_translate3f(&item->box_transform, &item->box_transform,
 			    item->pos.x, item->pos.y, 0.0f);
 
+	update_item_box_extents(item);
+
 	/* ----------------------- */
 
-	calldata_init_fixed(&params, stack, sizeof(stack));
-	calldata_set_ptr(&params, "item", item);
-	signal_parent(item->parent, "item_transform", &params);
+	/* can happen every frame, the call data is only created if anything
+	 * is connected */
+	signal_handler_signal_args(item->parent->source->context.signals,
+				   signal_get_id("item_transform"),
+				   item->parent, item);
 
 	if (!update_tex)
 		return;
@@ -550,6 +595,13 @@ static inline void render_item(struct obs_scene_item *item)
 		uint32_t cx = calc_cx(item, width);
 		uint32_t cy = calc_cy(item, height);
 
+		/* render the texture once per frame, however many times the
+		 * scene is drawn */
+		if (item->item_render_time != obs->video.video_time) {
+			item->item_render_time = obs->video.video_time;
+			gs_texrender_reset(item->item_render);
+		}
+
 		if (cx && cy && gs_texrender_begin(item->item_render, cx, cy)) {
 			float cx_scale = (float)width / (float)cx;
 			float cy_scale = (float)height / (float)cy;
@@ -583,23 +635,6 @@ cleanup:
 	GS_DEBUG_MARKER_END();
 }
 
-static void scene_video_tick(void *data, float seconds)
-{
-	struct obs_scene *scene = data;
-	struct obs_scene_item *item;
-
-	video_lock(scene);
-	item = scene->first_item;
-	while (item) {
-		if (item->item_render)
-			gs_texrender_reset(item->item_render);
-		item = item->next;
-	}
-	video_unlock(scene);
-
-	UNUSED_PARAMETER(seconds);
-}
-
 /* assumes video lock */
 static void
 update_transforms_and_prune_sources(obs_scene_t *scene,
@@ -607,10 +642,18 @@ update_transforms_and_prune_sources(obs_scene_t *scene,
 				    obs_sceneitem_t *group_sceneitem)
 {
 	struct obs_scene_item *item = scene->first_item;
+	long layout_gen = os_atomic_load_long(&obs->data.layout_gen);
+	bool changed = os_atomic_set_bool(&scene->update_transforms, false);
 	bool rebuild_group =
 		group_sceneitem &&
 		os_atomic_load_bool(&group_sceneitem->update_group_resize);
 
+	/* nothing moved, resized or was removed since the last render */
+	if (!changed && !rebuild_group && scene->layout_gen == layout_gen)
+		return;
+
+	scene->layout_gen = layout_gen;
+
 	while (item) {
 		if (obs_source_removed(item->source)) {
 			struct obs_scene_item *del_item = item;
@@ -833,6 +876,7 @@ static void scene_load(void *data, obs_data_t *settings)
 		scene->cx = (uint32_t)obs_data_get_int(settings, "cx");
 		scene->cy = (uint32_t)obs_data_get_int(settings, "cy");
 		scene->custom_size = true;
+		obs_layout_changed();
 	}
 
 	obs_data_array_release(items);
@@ -951,19 +995,12 @@ static uint32_t scene_getheight(void *data)
 }
 
 static void apply_scene_item_audio_actions(struct obs_scene_item *item,
-					   float **p_buf, uint64_t ts,
+					   float *buf, uint64_t ts,
 					   size_t sample_rate)
 {
 	bool cur_visible = item->visible;
 	uint64_t frame_num = 0;
 	size_t deref_count = 0;
-	float *buf = NULL;
-
-	if (p_buf) {
-		if (!*p_buf)
-			*p_buf = malloc(AUDIO_OUTPUT_FRAMES * sizeof(float));
-		buf = *p_buf;
-	}
 
 	pthread_mutex_lock(&item->actions_mutex);
 
@@ -1010,7 +1047,7 @@ static void apply_scene_item_audio_actions(struct obs_scene_item *item,
 	}
 }
 
-static bool apply_scene_item_volume(struct obs_scene_item *item, float **buf,
+static bool apply_scene_item_volume(struct obs_scene_item *item, float *buf,
 				    uint64_t ts, size_t sample_rate)
 {
 	bool actions_pending;
@@ -1045,27 +1082,29 @@ static void process_all_audio_actions(struct obs_scene_item *item,
 		;
 }
 
-static void mix_audio_with_buf(float *p_out, float *p_in, float *buf_in,
-			       size_t pos, size_t count)
+/* mixes the audio of an item that starts pos frames into the scene's audio,
+ * only for the mixes the item has audio in */
+static void mix_item_audio(struct obs_source_audio_mix *out,
+			   const struct obs_source_audio_mix *in,
+			   const float *fade, uint32_t mixes, size_t channels,
+			   size_t pos)
 {
-	register float *out = p_out;
-	register float *buf = buf_in + pos;
-	register float *in = p_in + pos;
-	register float *end = in + count;
+	size_t count = AUDIO_OUTPUT_FRAMES - pos;
 
-	while (in < end)
-		*(out++) += *(in++) * *(buf++);
-}
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+		if ((mixes & (1 << mix)) == 0)
+			continue;
 
-static inline void mix_audio(float *p_out, float *p_in, size_t pos,
-			     size_t count)
-{
-	register float *out = p_out;
-	register float *in = p_in + pos;
-	register float *end = in + count;
+		for (size_t ch = 0; ch < channels; ch++) {
+			float *dst = out->output[mix].data[ch] + pos;
+			const float *src = in->output[mix].data[ch];
 
-	while (in < end)
-		*(out++) += *(in++);
+			if (fade)
+				audio_mix_add_mul(dst, src, fade + pos, count);
+			else
+				audio_mix_add(dst, src, count);
+		}
+	}
 }
 
 static bool scene_audio_render(void *data, uint64_t *ts_out,
@@ -1074,7 +1113,7 @@ static bool scene_audio_render(void *data, uint64_t *ts_out,
 			       size_t sample_rate)
 {
 	uint64_t timestamp = 0;
-	float *buf = NULL;
+	uint32_t output_mixes = 0;
 	struct obs_source_audio_mix child_audio;
 	struct obs_scene *scene = data;
 	struct obs_scene_item *item;
@@ -1103,18 +1142,24 @@ static bool scene_audio_render(void *data, uint64_t *ts_out,
 			item = item->next;
 		}
 
+		scene->source->audio_output_mixes = 0;
 		audio_unlock(scene);
 		return false;
 	}
 
+	if (!scene->audio_fade_buf)
+		scene->audio_fade_buf =
+			bmalloc(AUDIO_OUTPUT_FRAMES * sizeof(float));
+
 	item = scene->first_item;
 	while (item) {
 		uint64_t source_ts;
-		size_t pos, count;
+		uint32_t item_mixes;
+		size_t pos;
 		bool apply_buf;
 
-		apply_buf = apply_scene_item_volume(item, &buf, timestamp,
-						    sample_rate);
+		apply_buf = apply_scene_item_volume(item, scene->audio_fade_buf,
+						    timestamp, sample_rate);
 
 		if (obs_source_audio_pending(item->source)) {
 			item = item->next;
@@ -1129,34 +1174,26 @@ static bool scene_audio_render(void *data, uint64_t *ts_out,
 
 		pos = (size_t)ns_to_audio_frames(sample_rate,
 						 source_ts - timestamp);
-		count = AUDIO_OUTPUT_FRAMES - pos;
+		item_mixes = item->source->audio_output_mixes & mixers;
 
-		if (!apply_buf && !item->visible) {
+		if ((!apply_buf && !item->visible) || !item_mixes ||
+		    pos >= AUDIO_OUTPUT_FRAMES) {
 			item = item->next;
 			continue;
 		}
 
 		obs_source_get_audio_mix(item->source, &child_audio);
-		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
-			for (size_t ch = 0; ch < channels; ch++) {
-				float *out = audio_output->output[mix].data[ch];
-				float *in = child_audio.output[mix].data[ch];
-
-				if (apply_buf)
-					mix_audio_with_buf(out, in, buf, pos,
-							   count);
-				else
-					mix_audio(out, in, pos, count);
-			}
-		}
+		mix_item_audio(audio_output, &child_audio,
+			       apply_buf ? scene->audio_fade_buf : NULL,
+			       item_mixes, channels, pos);
+		output_mixes |= item_mixes;
 
 		item = item->next;
 	}
 
+	scene->source->audio_output_mixes = output_mixes;
 	*ts_out = timestamp;
 	audio_unlock(scene);
-
-	free(buf);
 	return true;
 }
 
@@ -1168,7 +1205,6 @@ const struct obs_source_info scene_info = {
 	.get_name = scene_getname,
 	.create = scene_create,
 	.destroy = scene_destroy,
-	.video_tick = scene_video_tick,
 	.video_render = scene_video_render,
 	.audio_render = scene_audio_render,
 	.get_width = scene_getwidth,
@@ -1186,7 +1222,6 @@ const struct obs_source_info group_info = {
 	.get_name = group_getname,
 	.create = scene_create,
 	.destroy = scene_destroy,
-	.video_tick = scene_video_tick,
 	.video_render = scene_video_render,
 	.audio_render = scene_audio_render,
 	.get_width = scene_getwidth,
@@ -1299,7 +1334,7 @@ static inline void duplicate_item_data(struct obs_scene_item *dst,
 	obs_sceneitem_set_crop(dst, &src->crop);
 
 	if (defer_texture_update) {
-		os_atomic_set_bool(&dst->update_transform, true);
+		item_transform_changed(dst);
 	} else {
 		if (!dst->item_render && item_texture_enabled(dst)) {
 			obs_enter_graphics();
@@ -1734,6 +1769,9 @@ static obs_sceneitem_t *obs_scene_add_internal(obs_scene_t *scene,
 		}
 	}
 
+	/* the box and its extents are computed on the next render */
+	item_transform_changed(item);
+
 	full_unlock(scene);
 
 	if (!scene->source->context.private)
@@ -1869,12 +1907,12 @@ bool obs_sceneitem_selected(const obs_sceneitem_t *item)
 	return item ? item->selected : false;
 }
 
-#define do_update_transform(item)                                          \
-	do {                                                               \
-		if (!item->parent || item->parent->is_group)               \
-			os_atomic_set_bool(&item->update_transform, true); \
-		else                                                       \
-			update_item_transform(item, false);                \
+#define do_update_transform(item)                            \
+	do {                                                 \
+		if (!item->parent || item->parent->is_group) \
+			item_transform_changed(item);        \
+		else                                         \
+			update_item_transform(item, false);  \
 	} while (false)
 
 void obs_sceneitem_set_pos(obs_sceneitem_t *item, const struct vec2 *pos)
@@ -2123,6 +2161,43 @@ void obs_sceneitem_get_box_scale(const obs_sceneitem_t *item,
 		*scale = item->box_scale;
 }
 
+void obs_sceneitem_get_box_extents(const obs_sceneitem_t *item,
+				   struct vec2 *min, struct vec2 *max)
+{
+	if (item) {
+		*min = item->box_min;
+		*max = item->box_max;
+	}
+}
+
+bool obs_sceneitem_hit_test(const obs_sceneitem_t *item,
+			    const struct vec2 *pos)
+{
+	struct vec3 pos3;
+	struct vec3 box_pos;
+	struct vec3 check;
+
+	if (!obs_ptr_valid(item, "obs_sceneitem_hit_test"))
+		return false;
+
+	if (pos->x < item->box_min.x || pos->x > item->box_max.x ||
+	    pos->y < item->box_min.y || pos->y > item->box_max.y)
+		return false;
+
+	vec3_set(&pos3, pos->x, pos->y, 0.0f);
+	vec3_transform(&box_pos, &pos3, &item->inv_box_transform);
+
+	/* a box without an area has no usable inverse, make sure the
+	 * position maps back to where it came from */
+	vec3_transform(&check, &box_pos, &item->box_transform);
+	if (!close_float(pos3.x, check.x, 0.01f) ||
+	    !close_float(pos3.y, check.y, 0.01f))
+		return false;
+
+	return box_pos.x >= 0.0f && box_pos.x <= 1.0f && box_pos.y >= 0.0f &&
+	       box_pos.y <= 1.0f;
+}
+
 bool obs_sceneitem_visible(const obs_sceneitem_t *item)
 {
 	return item ? item->user_visible : false;
@@ -2311,7 +2386,7 @@ void obs_sceneitem_set_crop(obs_sceneitem_t *item,
 	if (item->crop.bottom < 0)
 		item->crop.bottom = 0;
 
-	os_atomic_set_bool(&item->update_transform, true);
+	item_transform_changed(item);
 }
 
 void obs_sceneitem_get_crop(const obs_sceneitem_t *item,
@@ -2333,7 +2408,7 @@ void obs_sceneitem_set_scale_filter(obs_sceneitem_t *item,
 
 	item->scale_filter = filter;
 
-	os_atomic_set_bool(&item->update_transform, true);
+	item_transform_changed(item);
 }
 
 enum obs_scale_type obs_sceneitem_get_scale_filter(obs_sceneitem_t *item)
@@ -2373,8 +2448,11 @@ void obs_sceneitem_defer_group_resize_end(obs_sceneitem_t *item)
 	if (!obs_ptr_valid(item, "obs_sceneitem_defer_group_resize_end"))
 		return;
 
-	if (os_atomic_dec_long(&item->defer_group_resize) == 0)
+	if (os_atomic_dec_long(&item->defer_group_resize) == 0) {
 		os_atomic_set_bool(&item->update_group_resize, true);
+		if (item->parent)
+			scene_transforms_changed(item->parent);
+	}
 }
 
 int64_t obs_sceneitem_get_id(const obs_sceneitem_t *item)
@@ -2624,6 +2702,7 @@ obs_sceneitem_t *obs_scene_insert_group(obs_scene_t *scene, const char *name,
 		}
 		items[idx]->parent = sub_scene;
 		apply_group_transform(items[idx], item);
+		item_transform_changed(items[idx]);
 	}
 	items[0]->prev = NULL;
 	resize_group(item);
@@ -49,6 +49,7 @@ struct obs_scene_item {
 	bool locked;
 
 	gs_texrender_t *item_render;
+	uint64_t item_render_time;
 	struct obs_sceneitem_crop crop;
 
 	struct vec2 pos;
@@ -68,6 +69,12 @@ struct obs_scene_item {
 	struct vec2 box_scale;
 	struct matrix4 draw_transform;
 
+	/* for hit testing, the inverse of the box transform and the box
+	 * extents in the space of the parent scene */
+	struct matrix4 inv_box_transform;
+	struct vec2 box_min;
+	struct vec2 box_max;
+
 	enum obs_bounds_type bounds_type;
 	uint32_t bounds_align;
 	struct vec2 bounds;
@@ -97,4 +104,12 @@ struct obs_scene {
 	pthread_mutex_t video_mutex;
 	pthread_mutex_t audio_mutex;
 	struct obs_scene_item *first_item;
+
+	/* items are only checked for a new transform when one of them is
+	 * marked or the layout generation of the core changed */
+	volatile bool update_transforms;
+	long layout_gen;
+
+	/* show/hide fades of an item, reused for every item */
+	float *audio_fade_buf;
 };
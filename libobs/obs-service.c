@@ -17,14 +17,30 @@
 
 #include "obs-internal.h"
 
+static const struct obs_service_info *find_service_type(const char *id)
+{
+	const struct obs_service_info *info = NULL;
+
+	pthread_rwlock_rdlock(&obs->types_lock);
+	for (size_t i = 0; i < obs->service_types.num; i++) {
+		if (strcmp(obs->service_types.array[i]->id, id) == 0) {
+			info = obs->service_types.array[i];
+			break;
+		}
+	}
+	pthread_rwlock_unlock(&obs->types_lock);
+
+	return info;
+}
+
 const struct obs_service_info *find_service(const char *id)
 {
-	size_t i;
-	for (i = 0; i < obs->service_types.num; i++)
-		if (strcmp(obs->service_types.array[i].id, id) == 0)
-			return obs->service_types.array + i;
+	const struct obs_service_info *info = find_service_type(id);
 
-	return NULL;
+	if (!info && obs_load_deferred_module("services", "id", id))
+		info = find_service_type(id);
+
+	return info;
 }
 
 const char *obs_service_get_display_name(const char *id)
@@ -43,28 +43,50 @@ static inline bool deinterlacing_enabled(const struct obs_source *source)
 	return source->deinterlace_mode != OBS_DEINTERLACE_MODE_DISABLE;
 }
 
-struct obs_source_info *get_source_info(const char *id)
+static struct obs_source_info *find_source_info(const char *unversioned_id,
+					       const char *id, uint32_t ver)
 {
+	struct obs_source_info *info = NULL;
+
+	pthread_rwlock_rdlock(&obs->types_lock);
 	for (size_t i = 0; i < obs->source_types.num; i++) {
-		struct obs_source_info *info = &obs->source_types.array[i];
-		if (strcmp(info->id, id) == 0)
-			return info;
+		struct obs_source_info *type = obs->source_types.array[i];
+
+		if (id && strcmp(type->id, id) != 0)
+			continue;
+		if (!id && (strcmp(type->unversioned_id, unversioned_id) != 0 ||
+			    type->version != ver))
+			continue;
+
+		info = type;
+		break;
 	}
+	pthread_rwlock_unlock(&obs->types_lock);
 
-	return NULL;
+	return info;
+}
+
+struct obs_source_info *get_source_info(const char *id)
+{
+	struct obs_source_info *info = find_source_info(NULL, id, 0);
+
+	if (!info && obs_load_deferred_module("sources", "id", id))
+		info = find_source_info(NULL, id, 0);
+
+	return info;
 }
 
 struct obs_source_info *get_source_info2(const char *unversioned_id,
 					 uint32_t ver)
 {
-	for (size_t i = 0; i < obs->source_types.num; i++) {
-		struct obs_source_info *info = &obs->source_types.array[i];
-		if (strcmp(info->unversioned_id, unversioned_id) == 0 &&
-		    info->version == ver)
-			return info;
-	}
+	struct obs_source_info *info =
+		find_source_info(unversioned_id, NULL, ver);
 
-	return NULL;
+	if (!info && obs_load_deferred_module("sources", "unversioned_id",
+					      unversioned_id))
+		info = find_source_info(unversioned_id, NULL, ver);
+
+	return info;
 }
 
 static const char *source_signals[] = {
@@ -159,6 +181,11 @@ static inline bool is_async_video_source(const struct obs_source *source)
 	       OBS_SOURCE_ASYNC_VIDEO;
 }
 
+static inline bool destroying(struct obs_source *source)
+{
+	return os_atomic_load_bool(&source->destroying);
+}
+
 static inline bool is_audio_source(const struct obs_source *source)
 {
 	return source->info.output_flags & OBS_SOURCE_AUDIO;
@@ -169,6 +196,19 @@ static inline bool is_composite_source(const struct obs_source *source)
 	return source->info.output_flags & OBS_SOURCE_COMPOSITE;
 }
 
+/* sources without anything to do each frame are only ticked when a show,
+ * activate or deferred update is pending, see obs_source_queue_tick */
+static inline bool source_ticks_always(const struct obs_source *source)
+{
+	if (source->info.video_tick)
+		return true;
+	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
+		return true;
+	if (source->info.type == OBS_SOURCE_TYPE_FILTER)
+		return (source->info.output_flags & OBS_SOURCE_VIDEO) != 0;
+	return (source->info.output_flags & OBS_SOURCE_ASYNC) != 0;
+}
+
 extern char *find_libobs_data_file(const char *file);
 
 /* internal initialization */
@@ -218,6 +258,7 @@ static bool obs_source_init(struct obs_source *source)
 	source->deinterlace_top_first = true;
 	source->control->source = source;
 	source->audio_mixers = 0xFF;
+	source->ticks_always = source_ticks_always(source);
 
 	source->private_settings = obs_data_create();
 	return true;
@@ -240,6 +281,9 @@ static void obs_source_init_finalize(struct obs_source *source)
 
 	obs_context_data_insert(&source->context, &obs->data.sources_mutex,
 				&obs->data.first_source);
+
+	if (source->ticks_always)
+		obs_tick_list_add(source);
 }
 
 static bool obs_source_hotkey_mute(void *data, obs_hotkey_pair_id id,
@@ -384,10 +428,31 @@ static void obs_source_init_audio_hotkeys(struct obs_source *source)
 	}
 }
 
+static THREAD_LOCAL struct obs_source_create_queue *create_queue = NULL;
+
+void obs_source_set_create_queue(struct obs_source_create_queue *queue)
+{
+	create_queue = queue;
+}
+
+void obs_source_send_create_queue(struct obs_source_create_queue *queue)
+{
+	for (size_t i = 0; i < queue->sources.num; i++) {
+		obs_source_t *source = queue->sources.array[i];
+		if (source) {
+			obs_source_dosignal(source, "source_create", NULL);
+			obs_source_release(source);
+		}
+	}
+
+	da_free(queue->sources);
+}
+
 static obs_source_t *
 obs_source_create_internal(const char *id, const char *name,
-			   obs_data_t *settings, obs_data_t *hotkey_data,
-			   bool private, uint32_t last_obs_ver)
+			   const char *uuid, obs_data_t *settings,
+			   obs_data_t *hotkey_data, bool private,
+			   uint32_t last_obs_ver)
 {
 	struct obs_source *source = bzalloc(sizeof(struct obs_source));
 
@@ -420,6 +485,8 @@ obs_source_create_internal(const char *id, const char *name,
 				     private))
 		goto fail;
 
+	obs_context_data_setuuid(&source->context, uuid);
+
 	if (info) {
 		if (info->get_defaults) {
 			info->get_defaults(source->context.settings);
@@ -451,7 +518,12 @@ obs_source_create_internal(const char *id, const char *name,
 	source->enabled = true;
 
 	if (!private) {
-		obs_source_dosignal(source, "source_create", NULL);
+		if (create_queue) {
+			obs_source_t *ref = obs_source_get_ref(source);
+			da_push_back(create_queue->sources, &ref);
+		} else {
+			obs_source_dosignal(source, "source_create", NULL);
+		}
 	}
 
 	obs_source_init_finalize(source);
@@ -466,15 +538,15 @@ fail:
 obs_source_t *obs_source_create(const char *id, const char *name,
 				obs_data_t *settings, obs_data_t *hotkey_data)
 {
-	return obs_source_create_internal(id, name, settings, hotkey_data,
-					  false, LIBOBS_API_VER);
+	return obs_source_create_internal(id, name, NULL, settings,
+					  hotkey_data, false, LIBOBS_API_VER);
 }
 
 obs_source_t *obs_source_create_private(const char *id, const char *name,
 					obs_data_t *settings)
 {
-	return obs_source_create_internal(id, name, settings, NULL, true,
-					  LIBOBS_API_VER);
+	return obs_source_create_internal(id, name, NULL, settings, NULL,
+					  true, LIBOBS_API_VER);
 }
 
 obs_source_t *obs_source_create_set_last_ver(const char *id, const char *name,
@@ -482,8 +554,18 @@ obs_source_t *obs_source_create_set_last_ver(const char *id, const char *name,
 					     obs_data_t *hotkey_data,
 					     uint32_t last_obs_ver)
 {
-	return obs_source_create_internal(id, name, settings, hotkey_data,
-					  false, last_obs_ver);
+	return obs_source_create_internal(id, name, NULL, settings,
+					  hotkey_data, false, last_obs_ver);
+}
+
+obs_source_t *obs_source_create_with_uuid(const char *id, const char *name,
+					  const char *uuid,
+					  obs_data_t *settings,
+					  obs_data_t *hotkey_data,
+					  uint32_t last_obs_ver)
+{
+	return obs_source_create_internal(id, name, uuid, settings,
+					  hotkey_data, false, last_obs_ver);
 }
 
 static char *get_new_filter_name(obs_source_t *dst, const char *name)
@@ -670,6 +752,8 @@ void obs_source_destroy(struct obs_source *source)
 	if (!obs_source_valid(source, "obs_source_destroy"))
 		return;
 
+	os_atomic_set_bool(&source->destroying, true);
+
 	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
 		obs_transition_clear(source);
 
@@ -690,6 +774,9 @@ void obs_source_destroy(struct obs_source *source)
 
 	obs_context_data_remove(&source->context);
 
+	if (source->ticks_always)
+		obs_tick_list_remove(source);
+
 	blog(LOG_DEBUG, "%ssource '%s' destroyed",
 	     source->context.private ? "private " : "", source->context.name);
 
@@ -843,6 +930,7 @@ void obs_source_remove(obs_source_t *source)
 
 	if (!source->removed) {
 		source->removed = true;
+		obs_layout_changed();
 		obs_source_dosignal(source, "source_remove", "remove");
 	}
 }
@@ -962,6 +1050,7 @@ void obs_source_update(obs_source_t *source, obs_data_t *settings)
 
 	if (source->info.output_flags & OBS_SOURCE_VIDEO) {
 		os_atomic_inc_long(&source->defer_update_count);
+		obs_source_queue_tick(source);
 	} else if (source->context.data && source->info.update) {
 		source->info.update(source->context.data,
 				    source->context.settings);
@@ -1080,6 +1169,7 @@ static void activate_tree(obs_source_t *parent, obs_source_t *child,
 			  void *param)
 {
 	os_atomic_inc_long(&child->activate_refs);
+	obs_source_queue_tick(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -1089,6 +1179,7 @@ static void deactivate_tree(obs_source_t *parent, obs_source_t *child,
 			    void *param)
 {
 	os_atomic_dec_long(&child->activate_refs);
+	obs_source_queue_tick(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -1097,6 +1188,7 @@ static void deactivate_tree(obs_source_t *parent, obs_source_t *child,
 static void show_tree(obs_source_t *parent, obs_source_t *child, void *param)
 {
 	os_atomic_inc_long(&child->show_refs);
+	obs_source_queue_tick(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -1105,6 +1197,7 @@ static void show_tree(obs_source_t *parent, obs_source_t *child, void *param)
 static void hide_tree(obs_source_t *parent, obs_source_t *child, void *param)
 {
 	os_atomic_dec_long(&child->show_refs);
+	obs_source_queue_tick(child);
 
 	UNUSED_PARAMETER(parent);
 	UNUSED_PARAMETER(param);
@@ -1122,6 +1215,8 @@ void obs_source_activate(obs_source_t *source, enum view_type type)
 		os_atomic_inc_long(&source->activate_refs);
 		obs_source_enum_active_tree(source, activate_tree, NULL);
 	}
+
+	obs_source_queue_tick(source);
 }
 
 void obs_source_deactivate(obs_source_t *source, enum view_type type)
@@ -1141,6 +1236,8 @@ void obs_source_deactivate(obs_source_t *source, enum view_type type)
 						    NULL);
 		}
 	}
+
+	obs_source_queue_tick(source);
 }
 
 static inline struct obs_source_frame *get_closest_frame(obs_source_t *source,
@@ -1173,12 +1270,13 @@ static void async_tick(obs_source_t *source)
 			set_async_texture_size(source, source->cur_async_frame);
 }
 
-void obs_source_video_tick(obs_source_t *source, float seconds)
+/* everything but the video_tick callback, returns whether there is one */
+bool obs_source_video_tick_begin(obs_source_t *source, float seconds)
 {
 	bool now_showing, now_active;
 
 	if (!obs_source_valid(source, "obs_source_video_tick"))
-		return;
+		return false;
 
 	if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
 		obs_transition_tick(source, seconds);
@@ -1241,11 +1339,65 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 		source->active = now_active;
 	}
 
-	if (source->context.data && source->info.video_tick)
-		source->info.video_tick(source->context.data, seconds);
-
 	source->async_rendered = false;
 	source->deinterlace_rendered = false;
+
+	return source->context.data && source->info.video_tick;
+}
+
+void obs_source_call_video_tick(obs_source_t *source, float seconds)
+{
+	if (!source->profile_tick_name)
+		source->profile_tick_name = profile_store_name(
+			obs_get_profiler_name_store(), "video_tick(%s)",
+			source->context.name);
+
+	profile_start(source->profile_tick_name);
+	source->info.video_tick(source->context.data, seconds);
+	profile_end(source->profile_tick_name);
+}
+
+void obs_source_video_tick(obs_source_t *source, float seconds)
+{
+	if (obs_source_video_tick_begin(source, seconds))
+		obs_source_call_video_tick(source, seconds);
+}
+
+/* called after a tick, scenes only check the sizes of their items again
+ * when a source changed size */
+void obs_source_check_layout(obs_source_t *source)
+{
+	uint32_t cx = obs_source_get_width(source);
+	uint32_t cy = obs_source_get_height(source);
+
+	if (cx != source->tick_width || cy != source->tick_height) {
+		source->tick_width = cx;
+		source->tick_height = cy;
+		obs_layout_changed();
+	}
+}
+
+void obs_source_queue_tick(obs_source_t *source)
+{
+	struct obs_core_data *data = &obs->data;
+	void *volatile *queue = (void *volatile *)&data->tick_queue;
+	struct obs_source *first;
+
+	if (source->ticks_always || !data->valid)
+		return;
+	if (os_atomic_set_bool(&source->tick_queued, true))
+		return;
+
+	/* the queue holds a reference until the graphics thread ticks it */
+	if (!obs_source_get_ref(source)) {
+		os_atomic_set_bool(&source->tick_queued, false);
+		return;
+	}
+
+	do {
+		first = os_atomic_load_ptr(queue);
+		source->tick_queue_next = first;
+	} while (!os_atomic_compare_swap_ptr(queue, first, source));
 }
 
 /* unless the value is 3+ hours worth of frames, this won't overflow */
@@ -2474,6 +2626,8 @@ void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
+	obs_layout_changed();
+
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "source", source);
 	calldata_set_ptr(&cd, "filter", filter);
@@ -2508,6 +2662,8 @@ static bool obs_source_filter_remove_refless(obs_source_t *source,
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
+	obs_layout_changed();
+
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "source", source);
 	calldata_set_ptr(&cd, "filter", filter);
@@ -2635,8 +2791,10 @@ void obs_source_filter_set_order(obs_source_t *source, obs_source_t *filter,
 	success = move_filter_dir(source, filter, movement);
 	pthread_mutex_unlock(&source->filter_mutex);
 
-	if (success)
+	if (success) {
+		obs_layout_changed();
 		obs_source_dosignal(source, NULL, "reorder_filters");
+	}
 }
 
 obs_data_t *obs_source_get_settings(const obs_source_t *source)
@@ -2809,30 +2967,41 @@ static void clean_cache(obs_source_t *source)
 }
 
 #define MAX_ASYNC_FRAMES 30
-//if return value is not null then do (os_atomic_dec_long(&output->refs) == 0) && obs_source_frame_destroy(output)
-static inline struct obs_source_frame *
-cache_video(struct obs_source *source, const struct obs_source_frame *frame)
+
+/* returns a cached frame for the given format/size with an extra reference
+ * held for the caller, or NULL if the queue has overflowed.  must be called
+ * with async_mutex held */
+static struct obs_source_frame *
+get_cached_frame(struct obs_source *source, enum video_format format,
+		 uint32_t width, uint32_t height, bool full_range)
 {
 	struct obs_source_frame *new_frame = NULL;
-
-	pthread_mutex_lock(&source->async_mutex);
-
-	if (source->async_frames.num >= MAX_ASYNC_FRAMES) {
+	const size_t max_frames = source->async_pool_size
+					  ? source->async_pool_size
+					  : MAX_ASYNC_FRAMES;
+
+	if (source->async_frames.num >= max_frames) {
+		/* the queued frames are flushed along with the new one */
+		source->async_stats.dropped += source->async_frames.num + 1;
+		source->async_stats.overflows++;
 		free_async_cache(source);
 		source->last_frame_ts = 0;
-		pthread_mutex_unlock(&source->async_mutex);
 		return NULL;
 	}
 
-	if (async_texture_changed(source, frame)) {
+	struct obs_source_frame info = {.format = format,
+					.width = width,
+					.height = height,
+					.full_range = full_range};
+
+	if (async_texture_changed(source, &info)) {
 		free_async_cache(source);
-		source->async_cache_width = frame->width;
-		source->async_cache_height = frame->height;
+		source->async_cache_width = width;
+		source->async_cache_height = height;
 	}
 
-	const enum video_format format = frame->format;
 	source->async_cache_format = format;
-	source->async_cache_full_range = frame->full_range;
+	source->async_cache_full_range = full_range;
 
 	for (size_t i = 0; i < source->async_cache.num; i++) {
 		struct async_frame *af = &source->async_cache.array[i];
@@ -2850,51 +3019,163 @@ cache_video(struct obs_source *source, const struct obs_source_frame *frame)
 	if (!new_frame) {
 		struct async_frame new_af;
 
-		new_frame = obs_source_frame_create(format, frame->width,
-						    frame->height);
+		new_frame = obs_source_frame_create(format, width, height);
 		new_af.frame = new_frame;
 		new_af.used = true;
 		new_af.unused_count = 0;
 		new_frame->refs = 1;
 
 		da_push_back(source->async_cache, &new_af);
+		source->async_stats.allocated++;
 	}
 
 	os_atomic_inc_long(&new_frame->refs);
+	return new_frame;
+}
 
+//if return value is not null then do (os_atomic_dec_long(&output->refs) == 0) && obs_source_frame_destroy(output)
+static inline struct obs_source_frame *
+cache_video(struct obs_source *source, const struct obs_source_frame *frame)
+{
+	struct obs_source_frame *new_frame;
+
+	pthread_mutex_lock(&source->async_mutex);
+	new_frame = get_cached_frame(source, frame->format, frame->width,
+				     frame->height, frame->full_range);
+	if (new_frame)
+		source->async_stats.copied++;
 	pthread_mutex_unlock(&source->async_mutex);
 
-	copy_frame_data(new_frame, frame);
+	if (new_frame)
+		copy_frame_data(new_frame, frame);
 
 	return new_frame;
 }
 
+/* drops the caller's reference and queues the frame for display, unless the
+ * cache was reset while the caller was holding it */
+static void queue_async_frame(obs_source_t *source,
+			      struct obs_source_frame *output)
+{
+	pthread_mutex_lock(&source->async_mutex);
+	if (os_atomic_dec_long(&output->refs) == 0) {
+		obs_source_frame_destroy(output);
+		source->async_stats.dropped++;
+	} else {
+		da_push_back(source->async_frames, &output);
+		source->async_active = true;
+	}
+	pthread_mutex_unlock(&source->async_mutex);
+}
+
 static void
 obs_source_output_video_internal(obs_source_t *source,
 				 const struct obs_source_frame *frame)
 {
 	if (!obs_source_valid(source, "obs_source_output_video"))
 		return;
+	if (destroying(source))
+		return;
 
 	if (!frame) {
 		source->async_active = false;
 		return;
 	}
 
-	struct obs_source_frame *output = !!frame ? cache_video(source, frame)
-						  : NULL;
+	struct obs_source_frame *output = cache_video(source, frame);
+	if (output)
+		queue_async_frame(source, output);
+}
+
+struct obs_source_frame *
+obs_source_frame_acquire(obs_source_t *source, enum video_format format,
+			 uint32_t width, uint32_t height,
+			 enum video_range_type range)
+{
+	struct obs_source_frame *frame;
+
+	if (!obs_source_valid(source, "obs_source_frame_acquire"))
+		return NULL;
+	if (destroying(source))
+		return NULL;
+	if (format == VIDEO_FORMAT_NONE || !width || !height)
+		return NULL;
+
+	range = resolve_video_range(format, range);
 
-	/* ------------------------------------------- */
 	pthread_mutex_lock(&source->async_mutex);
-	if (output) {
-		if (os_atomic_dec_long(&output->refs) == 0) {
-			obs_source_frame_destroy(output);
-			output = NULL;
-		} else {
-			da_push_back(source->async_frames, &output);
-			source->async_active = true;
-		}
+	frame = get_cached_frame(source, format, width, height,
+				 range == VIDEO_RANGE_FULL);
+	if (frame)
+		source->async_stats.acquired++;
+	pthread_mutex_unlock(&source->async_mutex);
+
+	if (frame) {
+		frame->full_range = range == VIDEO_RANGE_FULL;
+		frame->flip = false;
+		frame->timestamp = 0;
 	}
+
+	return frame;
+}
+
+void obs_source_frame_submit(obs_source_t *source,
+			     struct obs_source_frame *frame)
+{
+	if (!obs_source_valid(source, "obs_source_frame_submit"))
+		return;
+	if (!obs_ptr_valid(frame, "obs_source_frame_submit"))
+		return;
+
+	/* the frame still has to go back to the pool */
+	if (destroying(source)) {
+		obs_source_frame_release(source, frame);
+		return;
+	}
+
+	queue_async_frame(source, frame);
+}
+
+void obs_source_frame_release(obs_source_t *source,
+			      struct obs_source_frame *frame)
+{
+	if (!obs_source_valid(source, "obs_source_frame_release"))
+		return;
+	if (!obs_ptr_valid(frame, "obs_source_frame_release"))
+		return;
+
+	pthread_mutex_lock(&source->async_mutex);
+	if (os_atomic_dec_long(&frame->refs) == 0)
+		obs_source_frame_destroy(frame);
+	else
+		remove_async_frame(source, frame);
+	pthread_mutex_unlock(&source->async_mutex);
+}
+
+void obs_source_set_async_pool_size(obs_source_t *source, size_t frames)
+{
+	if (!obs_source_valid(source, "obs_source_set_async_pool_size"))
+		return;
+
+	pthread_mutex_lock(&source->async_mutex);
+	source->async_pool_size = frames;
+	pthread_mutex_unlock(&source->async_mutex);
+}
+
+void obs_source_get_async_stats(obs_source_t *source,
+				struct obs_source_async_stats *stats)
+{
+	if (!obs_source_valid(source, "obs_source_get_async_stats"))
+		return;
+	if (!obs_ptr_valid(stats, "obs_source_get_async_stats"))
+		return;
+
+	pthread_mutex_lock(&source->async_mutex);
+	*stats = source->async_stats;
+	stats->pool_size = source->async_pool_size ? source->async_pool_size
+						   : MAX_ASYNC_FRAMES;
+	stats->cached = source->async_cache.num;
+	stats->queued = source->async_frames.num;
 	pthread_mutex_unlock(&source->async_mutex);
 }
 
@@ -3546,6 +3827,13 @@ const char *obs_source_get_name(const obs_source_t *source)
 		       : NULL;
 }
 
+const char *obs_source_get_uuid(const obs_source_t *source)
+{
+	return obs_source_valid(source, "obs_source_get_uuid")
+		       ? source->context.uuid
+		       : NULL;
+}
+
 void obs_source_set_name(obs_source_t *source, const char *name)
 {
 	if (!obs_source_valid(source, "obs_source_set_name"))
@@ -4309,6 +4597,10 @@ void obs_source_set_enabled(obs_source_t *source, bool enabled)
 
 	source->enabled = enabled;
 
+	/* a filter being skipped or not can change the size of its parent */
+	if (source->info.type == OBS_SOURCE_TYPE_FILTER)
+		obs_layout_changed();
+
 	calldata_init_fixed(&data, stack, sizeof(stack));
 	calldata_set_ptr(&data, "source", source);
 	calldata_set_bool(&data, "enabled", enabled);
@@ -4695,10 +4987,16 @@ static void custom_audio_render(obs_source_t *source, uint32_t mixers,
 			audio_data.output[mix].data[ch] =
 				source->audio_output_buf[mix][ch];
 		}
-		memset(source->audio_output_buf[mix][0], 0,
-		       sizeof(float) * AUDIO_OUTPUT_FRAMES * channels);
+
+		/* the other mixes are still silent from the last render */
+		if ((source->audio_output_mixes & (1 << mix)) != 0)
+			memset(source->audio_output_buf[mix][0], 0,
+			       sizeof(float) * AUDIO_OUTPUT_FRAMES * channels);
 	}
 
+	/* scenes narrow this down to the mixes their items were mixed to */
+	source->audio_output_mixes = ALL_AUDIO_MIXES;
+
 	success = source->info.audio_render(source->context.data, &ts,
 					    &audio_data, mixers, channels,
 					    sample_rate);
@@ -4787,6 +5085,7 @@ static inline void process_audio_source_tick(obs_source_t *source,
 	}
 
 	if (audio_submix) {
+		source->audio_output_mixes = ALL_AUDIO_MIXES;
 		source->audio_pending = false;
 		return;
 	}
@@ -4794,6 +5093,8 @@ static inline void process_audio_source_tick(obs_source_t *source,
 	if ((source->audio_mixers & 1) == 0)
 		memset(source->audio_output_buf[0][0], 0, size * channels);
 
+	source->audio_output_mixes = source->audio_mixers & ALL_AUDIO_MIXES;
+
 	apply_audio_volume(source, mixers, channels, sample_rate);
 	source->audio_pending = false;
 }
@@ -191,6 +191,25 @@ enum obs_media_state {
  */
 #define OBS_SOURCE_TRACK (1 << 14)
 
+/**
+ * Source type cannot be created from more than one thread at a time.
+ *
+ * When sources are loaded, sources of this type (and sources with filters of
+ * this type) are created one after another on the loading thread instead of
+ * alongside the other sources.
+ */
+#define OBS_SOURCE_SERIAL_CREATE (1 << 15)
+
+/**
+ * Source type's video_tick can run at the same time as the video_tick of
+ * other sources.
+ *
+ * The video_tick callbacks of sources of this type are called from a pool of
+ * threads once the other sources have been ticked, and all of them finish
+ * before rendering starts.
+ */
+#define OBS_SOURCE_PARALLEL_TICK (1 << 16)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t *parent,
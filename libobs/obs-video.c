@@ -29,9 +29,185 @@
 #include <windows.h>
 #endif
 
+/* ------------------------------------------------------------------------- */
+/* parallel video_tick                                                       */
+
+static const char *parallel_tick_name = "parallel_tick";
+
+static void run_parallel_ticks(struct obs_tick_pool *pool)
+{
+	long num = (long)pool->sources.num;
+	long idx;
+
+	profile_start(parallel_tick_name);
+
+	while ((idx = os_atomic_inc_long(&pool->next) - 1) < num)
+		obs_source_call_video_tick(pool->sources.array[idx],
+					   pool->seconds);
+
+	profile_end(parallel_tick_name);
+}
+
+static void *tick_pool_thread(void *param)
+{
+	struct obs_tick_pool *pool = param;
+
+	os_set_thread_name("libobs: tick thread");
+
+	while (os_sem_wait(pool->start) == 0 && !pool->stop) {
+		run_parallel_ticks(pool);
+
+		if (os_atomic_dec_long(&pool->running) == 0)
+			os_event_signal(pool->done);
+	}
+
+	return NULL;
+}
+
+static void tick_pool_init(struct obs_tick_pool *pool)
+{
+	int cores = os_get_logical_cores();
+	size_t max_threads = cores > 1 ? (size_t)cores - 1 : 0;
+
+	if (max_threads > TICK_POOL_MAX_THREADS)
+		max_threads = TICK_POOL_MAX_THREADS;
+
+	pool->initialized = true;
+
+	if (!max_threads)
+		return;
+	if (os_sem_init(&pool->start, 0) != 0)
+		return;
+	if (os_event_init(&pool->done, OS_EVENT_TYPE_AUTO) != 0)
+		return;
+
+	for (; pool->num_threads < max_threads; pool->num_threads++) {
+		if (pthread_create(&pool->threads[pool->num_threads], NULL,
+				   tick_pool_thread, pool) != 0)
+			break;
+	}
+
+	blog(LOG_DEBUG, "Started %zu video tick threads", pool->num_threads);
+}
+
+void obs_tick_pool_free(struct obs_tick_pool *pool)
+{
+	if (pool->num_threads) {
+		pool->stop = true;
+
+		for (size_t i = 0; i < pool->num_threads; i++)
+			os_sem_post(pool->start);
+		for (size_t i = 0; i < pool->num_threads; i++)
+			pthread_join(pool->threads[i], NULL);
+	}
+
+	os_sem_destroy(pool->start);
+	os_event_destroy(pool->done);
+	da_free(pool->sources);
+	memset(pool, 0, sizeof(*pool));
+}
+
+/* the graphics thread ticks along with as many threads as there are sources
+ * left to take, and waits for all of them */
+static void tick_parallel_sources(struct obs_tick_pool *pool, float seconds)
+{
+	size_t num = pool->sources.num;
+	size_t num_wake;
+
+	if (!num)
+		return;
+	if (!pool->initialized)
+		tick_pool_init(pool);
+
+	num_wake = pool->num_threads < num - 1 ? pool->num_threads : num - 1;
+
+	pool->seconds = seconds;
+	os_atomic_set_long(&pool->next, 0);
+	os_atomic_set_long(&pool->running, (long)num_wake);
+
+	for (size_t i = 0; i < num_wake; i++)
+		os_sem_post(pool->start);
+
+	run_parallel_ticks(pool);
+
+	if (num_wake)
+		os_event_wait(pool->done);
+
+	for (size_t i = 0; i < num; i++) {
+		obs_source_check_layout(pool->sources.array[i]);
+		obs_source_release(pool->sources.array[i]);
+	}
+	pool->sources.num = 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* tick list, changed with sources_mutex held                                */
+
+void obs_tick_list_add(obs_source_t *source)
+{
+	struct obs_core_data *data = &obs->data;
+	obs_weak_source_t *weak = obs_source_get_weak_source(source);
+
+	pthread_mutex_lock(&data->sources_mutex);
+	source->tick_idx = data->tick_sources.num;
+	da_push_back(data->tick_sources, &weak);
+	os_atomic_set_bool(&data->tick_sources_changed, true);
+	pthread_mutex_unlock(&data->sources_mutex);
+}
+
+/* the last source takes the place of the removed one */
+void obs_tick_list_remove(obs_source_t *source)
+{
+	struct obs_core_data *data = &obs->data;
+	size_t idx = source->tick_idx;
+	size_t last;
+
+	pthread_mutex_lock(&data->sources_mutex);
+
+	if (idx >= data->tick_sources.num ||
+	    data->tick_sources.array[idx]->source != source) {
+		pthread_mutex_unlock(&data->sources_mutex);
+		return;
+	}
+
+	last = data->tick_sources.num - 1;
+	da_push_back(data->tick_sources_removed,
+		     &data->tick_sources.array[idx]);
+
+	if (idx != last) {
+		obs_weak_source_t *moved = data->tick_sources.array[last];
+
+		data->tick_sources.array[idx] = moved;
+		moved->source->tick_idx = idx;
+	}
+
+	da_pop_back(data->tick_sources);
+	os_atomic_set_bool(&data->tick_sources_changed, true);
+
+	pthread_mutex_unlock(&data->sources_mutex);
+}
+
+/* called by the graphics thread before a tick when the list has changed, so
+ * creating or destroying many sources at once costs one copy */
+static void update_tick_list(struct obs_core_data *data)
+{
+	pthread_mutex_lock(&data->sources_mutex);
+
+	da_copy(data->tick_list, data->tick_sources);
+
+	for (size_t i = 0; i < data->tick_sources_removed.num; i++)
+		obs_weak_source_release(data->tick_sources_removed.array[i]);
+	data->tick_sources_removed.num = 0;
+
+	os_atomic_set_bool(&data->tick_sources_changed, false);
+
+	pthread_mutex_unlock(&data->sources_mutex);
+}
+
 static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 {
 	struct obs_core_data *data = &obs->data;
+	struct obs_tick_pool *pool = &obs->video.tick_pool;
 	struct obs_source *source;
 	uint64_t delta_time;
 	float seconds;
@@ -59,24 +235,80 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 	/* ------------------------------------- */
 	/* call the tick function of each source */
 
-	pthread_mutex_lock(&data->sources_mutex);
+	if (os_atomic_load_bool(&data->tick_sources_changed))
+		update_tick_list(data);
 
-	source = data->first_source;
-	while (source) {
-		struct obs_source *cur_source = obs_source_get_ref(source);
-		source = (struct obs_source *)source->context.next;
+	for (size_t i = 0; i < data->tick_list.num; i++) {
+		source = obs_weak_source_get_source(data->tick_list.array[i]);
+		if (!source)
+			continue;
 
-		if (cur_source) {
-			obs_source_video_tick(cur_source, seconds);
-			obs_source_release(cur_source);
+		if (obs_source_video_tick_begin(source, seconds)) {
+			if (source->info.output_flags &
+			    OBS_SOURCE_PARALLEL_TICK) {
+				da_push_back(pool->sources, &source);
+				continue;
+			}
+
+			obs_source_call_video_tick(source, seconds);
 		}
+
+		obs_source_check_layout(source);
+		obs_source_release(source);
 	}
 
-	pthread_mutex_unlock(&data->sources_mutex);
+	/* ------------------------------------- */
+	/* tick sources with a pending change    */
+
+	source = os_atomic_set_ptr((void *volatile *)&data->tick_queue, NULL);
+	while (source) {
+		struct obs_source *next = source->tick_queue_next;
+
+		os_atomic_set_bool(&source->tick_queued, false);
+		obs_source_video_tick(source, seconds);
+		obs_source_check_layout(source);
+		obs_source_release(source);
+		source = next;
+	}
+
+	/* ------------------------------------- */
+	/* tick sources in parallel              */
+
+	tick_parallel_sources(pool, seconds);
 
 	return cur_time;
 }
 
+void obs_tick_queue_free(void)
+{
+	struct obs_core_data *data = &obs->data;
+	struct obs_source *source;
+
+	source = os_atomic_set_ptr((void *volatile *)&data->tick_queue, NULL);
+	while (source) {
+		struct obs_source *next = source->tick_queue_next;
+
+		os_atomic_set_bool(&source->tick_queued, false);
+		obs_source_release(source);
+		source = next;
+	}
+}
+
+/* the graphics thread has stopped by now */
+void obs_tick_list_free(void)
+{
+	struct obs_core_data *data = &obs->data;
+
+	for (size_t i = 0; i < data->tick_sources.num; i++)
+		obs_weak_source_release(data->tick_sources.array[i]);
+	for (size_t i = 0; i < data->tick_sources_removed.num; i++)
+		obs_weak_source_release(data->tick_sources_removed.array[i]);
+
+	da_free(data->tick_sources);
+	da_free(data->tick_sources_removed);
+	da_free(data->tick_list);
+}
+
 /* in obs-display.c */
 extern void render_display(struct obs_display *display);
 
@@ -456,6 +456,8 @@ static void stop_video(void)
 			video->thread_initialized = false;
 		}
 	}
+
+	obs_tick_pool_free(&video->tick_pool);
 }
 
 static void obs_free_video(void)
@@ -623,6 +625,14 @@ static void obs_free_audio(void)
 	memset(audio, 0, sizeof(struct obs_core_audio));
 }
 
+static void free_context_index(struct obs_context_index *index)
+{
+	pthread_rwlock_destroy(&index->lock);
+	bfree(index->names);
+	bfree(index->uuids);
+	memset(index, 0, sizeof(*index));
+}
+
 static bool obs_init_data(void)
 {
 	struct obs_core_data *data = &obs->data;
@@ -653,6 +663,14 @@ static bool obs_init_data(void)
 		goto fail;
 	if (pthread_mutex_init(&obs->data.mixers_mutex, &attr) != 0)
 		goto fail;
+	if (pthread_rwlock_init(&data->source_index.lock, NULL) != 0)
+		goto fail;
+	if (pthread_rwlock_init(&data->output_index.lock, NULL) != 0)
+		goto fail;
+	if (pthread_rwlock_init(&data->encoder_index.lock, NULL) != 0)
+		goto fail;
+	if (pthread_rwlock_init(&data->service_index.lock, NULL) != 0)
+		goto fail;
 	if (!obs_view_init(&data->main_view))
 		goto fail;
 
@@ -705,7 +723,9 @@ static void obs_free_data(void)
 
 	blog(LOG_INFO, "Freeing OBS context data");
 
+	obs_tick_queue_free();
 	FREE_OBS_LINKED_LIST(source);
+	obs_tick_list_free();
 	FREE_OBS_LINKED_LIST(output);
 	FREE_OBS_LINKED_LIST(encoder);
 	FREE_OBS_LINKED_LIST(display);
@@ -718,6 +738,10 @@ static void obs_free_data(void)
 	pthread_mutex_destroy(&data->encoders_mutex);
 	pthread_mutex_destroy(&data->services_mutex);
 	pthread_mutex_destroy(&data->draw_callbacks_mutex);
+	free_context_index(&data->source_index);
+	free_context_index(&data->output_index);
+	free_context_index(&data->encoder_index);
+	free_context_index(&data->service_index);
 	da_free(data->draw_callbacks);
 	da_free(data->tick_callbacks);
 	obs_data_release(data->private_data);
@@ -890,6 +914,8 @@ static bool obs_init(const char *locale, const char *module_config_path,
 		return false;
 	if (!obs_init_hotkeys())
 		return false;
+	if (!obs_init_deferred_modules())
+		return false;
 
 	if (module_config_path)
 		obs->module_config_path = bstrdup(module_config_path);
@@ -1016,11 +1042,12 @@ void obs_shutdown(void)
 	struct obs_module *module;
 
 	for (size_t i = 0; i < obs->source_types.num; i++) {
-		struct obs_source_info *item = &obs->source_types.array[i];
+		struct obs_source_info *item = obs->source_types.array[i];
 		if (item->type_data && item->free_type_data)
 			item->free_type_data(item->type_data);
 		if (item->id)
 			bfree((void *)item->id);
+		bfree(item);
 	}
 	da_free(obs->source_types);
 
@@ -1034,12 +1061,24 @@ void obs_shutdown(void)
 		da_free(list);                                         \
 	} while (false)
 
-	FREE_REGISTERED_TYPES(obs_output_info, obs->output_types);
-	FREE_REGISTERED_TYPES(obs_encoder_info, obs->encoder_types);
-	FREE_REGISTERED_TYPES(obs_service_info, obs->service_types);
+#define FREE_REGISTERED_TYPE_PTRS(structure, list)                     \
+	do {                                                           \
+		for (size_t i = 0; i < list.num; i++) {                \
+			struct structure *item = list.array[i];        \
+			if (item->type_data && item->free_type_data)   \
+				item->free_type_data(item->type_data); \
+			bfree(item);                                   \
+		}                                                      \
+		da_free(list);                                         \
+	} while (false)
+
+	FREE_REGISTERED_TYPE_PTRS(obs_output_info, obs->output_types);
+	FREE_REGISTERED_TYPE_PTRS(obs_encoder_info, obs->encoder_types);
+	FREE_REGISTERED_TYPE_PTRS(obs_service_info, obs->service_types);
 	FREE_REGISTERED_TYPES(obs_modal_ui, obs->modal_ui_callbacks);
 	FREE_REGISTERED_TYPES(obs_modeless_ui, obs->modeless_ui_callbacks);
 
+#undef FREE_REGISTERED_TYPE_PTRS
 #undef FREE_REGISTERED_TYPES
 
 	da_free(obs->input_types);
@@ -1074,6 +1113,8 @@ void obs_shutdown(void)
 	if (obs->name_store_owned)
 		profiler_name_store_free(obs->name_store);
 
+	obs_free_deferred_modules();
+
 	bfree(obs->module_config_path);
 	bfree(obs->locale);
 	bfree(obs);
@@ -1203,6 +1244,9 @@ int obs_reset_video(struct obs_video_info *ovi)
 	     get_video_format_name(ovi->output_format),
 	     yuv ? yuv_format : "None", yuv ? "/" : "", yuv ? yuv_range : "");
 
+	/* scenes without a custom size change along with the base size */
+	obs_layout_changed();
+
 	return obs_init_video(ovi);
 }
 
@@ -1266,50 +1310,83 @@ bool obs_get_audio_info(struct obs_audio_info *oai)
 	return true;
 }
 
+/* types of deferred modules are listed once the loaded ones run out */
+static void *enum_type(const struct darray *types, size_t idx,
+		       const char *deferred_types, int source_type)
+{
+	void *type = obs_get_registered_type(types, idx);
+	if (!type) {
+		obs_load_deferred_modules(deferred_types, source_type);
+		type = obs_get_registered_type(types, idx);
+	}
+	return type;
+}
+
 bool obs_enum_source_types(size_t idx, const char **id)
 {
-	if (idx >= obs->source_types.num)
+	const struct obs_source_info *info =
+		enum_type(&obs->source_types.da, idx, "sources", -1);
+	if (!info)
 		return false;
-	*id = obs->source_types.array[idx].id;
+	*id = info->id;
 	return true;
 }
 
 bool obs_enum_input_types(size_t idx, const char **id)
 {
-	if (idx >= obs->input_types.num)
+	const struct obs_source_info *info = enum_type(
+		&obs->input_types.da, idx, "sources", OBS_SOURCE_TYPE_INPUT);
+	if (!info)
 		return false;
-	*id = obs->input_types.array[idx].id;
+	*id = info->id;
 	return true;
 }
 
 bool obs_enum_input_types2(size_t idx, const char **id,
 			   const char **unversioned_id)
 {
-	if (idx >= obs->input_types.num)
+	const struct obs_source_info *info = enum_type(
+		&obs->input_types.da, idx, "sources", OBS_SOURCE_TYPE_INPUT);
+	if (!info)
 		return false;
 	if (id)
-		*id = obs->input_types.array[idx].id;
+		*id = info->id;
 	if (unversioned_id)
-		*unversioned_id = obs->input_types.array[idx].unversioned_id;
+		*unversioned_id = info->unversioned_id;
 	return true;
 }
 
-const char *obs_get_latest_input_type_id(const char *unversioned_id)
+static struct obs_source_info *
+find_latest_input_type(const char *unversioned_id)
 {
 	struct obs_source_info *latest = NULL;
 	int version = -1;
 
-	if (!unversioned_id)
-		return NULL;
-
+	pthread_rwlock_rdlock(&obs->types_lock);
 	for (size_t i = 0; i < obs->source_types.num; i++) {
-		struct obs_source_info *info = &obs->source_types.array[i];
+		struct obs_source_info *info = obs->source_types.array[i];
 		if (strcmp(info->unversioned_id, unversioned_id) == 0 &&
 		    (int)info->version > version) {
 			latest = info;
 			version = info->version;
 		}
 	}
+	pthread_rwlock_unlock(&obs->types_lock);
+
+	return latest;
+}
+
+const char *obs_get_latest_input_type_id(const char *unversioned_id)
+{
+	struct obs_source_info *latest;
+
+	if (!unversioned_id)
+		return NULL;
+
+	latest = find_latest_input_type(unversioned_id);
+	if (!latest && obs_load_deferred_module("sources", "unversioned_id",
+						unversioned_id))
+		latest = find_latest_input_type(unversioned_id);
 
 	assert(!!latest);
 	if (!latest)
@@ -1320,41 +1397,52 @@ const char *obs_get_latest_input_type_id(const char *unversioned_id)
 
 bool obs_enum_filter_types(size_t idx, const char **id)
 {
-	if (idx >= obs->filter_types.num)
+	const struct obs_source_info *info = enum_type(
+		&obs->filter_types.da, idx, "sources", OBS_SOURCE_TYPE_FILTER);
+	if (!info)
 		return false;
-	*id = obs->filter_types.array[idx].id;
+	*id = info->id;
 	return true;
 }
 
 bool obs_enum_transition_types(size_t idx, const char **id)
 {
-	if (idx >= obs->transition_types.num)
+	const struct obs_source_info *info =
+		enum_type(&obs->transition_types.da, idx, "sources",
+			  OBS_SOURCE_TYPE_TRANSITION);
+	if (!info)
 		return false;
-	*id = obs->transition_types.array[idx].id;
+	*id = info->id;
 	return true;
 }
 
 bool obs_enum_output_types(size_t idx, const char **id)
 {
-	if (idx >= obs->output_types.num)
+	const struct obs_output_info *info =
+		enum_type(&obs->output_types.da, idx, "outputs", -1);
+	if (!info)
 		return false;
-	*id = obs->output_types.array[idx].id;
+	*id = info->id;
 	return true;
 }
 
 bool obs_enum_encoder_types(size_t idx, const char **id)
 {
-	if (idx >= obs->encoder_types.num)
+	const struct obs_encoder_info *info =
+		enum_type(&obs->encoder_types.da, idx, "encoders", -1);
+	if (!info)
 		return false;
-	*id = obs->encoder_types.array[idx].id;
+	*id = info->id;
 	return true;
 }
 
 bool obs_enum_service_types(size_t idx, const char **id)
 {
-	if (idx >= obs->service_types.num)
+	const struct obs_service_info *info =
+		enum_type(&obs->service_types.da, idx, "services", -1);
+	if (!info)
 		return false;
-	*id = obs->service_types.array[idx].id;
+	*id = info->id;
 	return true;
 }
 
@@ -1656,25 +1744,67 @@ void obs_enum_services(bool (*enum_proc)(void *, obs_service_t *), void *param)
 		 param);
 }
 
-static inline void *get_context_by_name(void *vfirst, const char *name,
-					pthread_mutex_t *mutex,
-					void *(*addref)(void *))
+static inline uint32_t hash_key(const char *key)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*key) {
+		hash ^= (uint8_t)*key++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static inline struct obs_context_data **
+index_next(struct obs_context_data *context, bool uuid)
+{
+	return uuid ? &context->next_uuid : &context->next_name;
+}
+
+static inline const char *index_key(const struct obs_context_data *context,
+				    bool uuid)
+{
+	return uuid ? context->uuid : context->name;
+}
+
+static inline struct obs_context_data **
+index_bucket(struct obs_context_index *index, const char *key, bool uuid)
+{
+	struct obs_context_data **buckets = uuid ? index->uuids : index->names;
+	return &buckets[hash_key(key) & (index->num_buckets - 1)];
+}
+
+static struct obs_context_data *index_find(struct obs_context_index *index,
+					   const char *key, bool uuid)
 {
-	struct obs_context_data **first = vfirst;
 	struct obs_context_data *context;
 
-	pthread_mutex_lock(mutex);
+	if (!index->num_buckets)
+		return NULL;
 
-	context = *first;
-	while (context) {
-		if (!context->private && strcmp(context->name, name) == 0) {
-			context = addref(context);
-			break;
-		}
-		context = context->next;
-	}
+	context = *index_bucket(index, key, uuid);
+	while (context && strcmp(index_key(context, uuid), key) != 0)
+		context = *index_next(context, uuid);
+
+	return context;
+}
+
+static void *get_context_by_key(struct obs_context_index *index,
+				const char *key, bool uuid,
+				void *(*addref)(void *))
+{
+	struct obs_context_data *context;
+
+	if (!key)
+		return NULL;
+
+	pthread_rwlock_rdlock(&index->lock);
+	context = index_find(index, key, uuid);
+	if (context)
+		context = addref(context);
+	pthread_rwlock_unlock(&index->lock);
 
-	pthread_mutex_unlock(mutex);
 	return context;
 }
 
@@ -1705,30 +1835,32 @@ static inline void *obs_id_(void *data)
 
 obs_source_t *obs_get_source_by_name(const char *name)
 {
-	return get_context_by_name(&obs->data.first_source, name,
-				   &obs->data.sources_mutex,
-				   obs_source_addref_safe_);
+	return get_context_by_key(&obs->data.source_index, name, false,
+				  obs_source_addref_safe_);
+}
+
+obs_source_t *obs_get_source_by_uuid(const char *uuid)
+{
+	return get_context_by_key(&obs->data.source_index, uuid, true,
+				  obs_source_addref_safe_);
 }
 
 obs_output_t *obs_get_output_by_name(const char *name)
 {
-	return get_context_by_name(&obs->data.first_output, name,
-				   &obs->data.outputs_mutex,
-				   obs_output_addref_safe_);
+	return get_context_by_key(&obs->data.output_index, name, false,
+				  obs_output_addref_safe_);
 }
 
 obs_encoder_t *obs_get_encoder_by_name(const char *name)
 {
-	return get_context_by_name(&obs->data.first_encoder, name,
-				   &obs->data.encoders_mutex,
-				   obs_encoder_addref_safe_);
+	return get_context_by_key(&obs->data.encoder_index, name, false,
+				  obs_encoder_addref_safe_);
 }
 
 obs_service_t *obs_get_service_by_name(const char *name)
 {
-	return get_context_by_name(&obs->data.first_service, name,
-				   &obs->data.services_mutex,
-				   obs_service_addref_safe_);
+	return get_context_by_key(&obs->data.service_index, name, false,
+				  obs_service_addref_safe_);
 }
 
 gs_effect_t *obs_get_base_effect(enum obs_base_effect effect)
@@ -1854,6 +1986,7 @@ static obs_source_t *obs_load_source_type(obs_data_t *source_data)
 	obs_data_array_t *filters = obs_data_get_array(source_data, "filters");
 	obs_source_t *source;
 	const char *name = obs_data_get_string(source_data, "name");
+	const char *uuid = obs_data_get_string(source_data, "uuid");
 	const char *id = obs_data_get_string(source_data, "id");
 	const char *v_id = obs_data_get_string(source_data, "versioned_id");
 	obs_data_t *settings = obs_data_get_obj(source_data, "settings");
@@ -1874,8 +2007,8 @@ static obs_source_t *obs_load_source_type(obs_data_t *source_data)
 	if (!*v_id)
 		v_id = id;
 
-	source = obs_source_create_set_last_ver(v_id, name, settings, hotkeys,
-						prev_ver);
+	source = obs_source_create_with_uuid(v_id, name, uuid, settings,
+					     hotkeys, prev_ver);
 	if (source->owns_info_id) {
 		bfree((void *)source->info.unversioned_id);
 		source->info.unversioned_id = bstrdup(id);
@@ -1989,34 +2122,169 @@ obs_source_t *obs_load_source(obs_data_t *source_data)
 	return obs_load_source_type(source_data);
 }
 
+/* ------------------------------------------------------------------------- */
+/* Source loading
+ *
+ * Sources are created from several threads at once, the calling thread
+ * included.  Scenes, and sources whose type (or the type of one of their
+ * filters) has OBS_SOURCE_SERIAL_CREATE, are all created on the calling
+ * thread, one after another, while the other threads create the rest.
+ *
+ * The source_create signals are held back while creating: frontends handle
+ * them with calls that block on the calling thread.  They are sent from the
+ * calling thread once all sources exist, in their original order, and the
+ * sources are then loaded in that order too. */
+
+#define LOAD_MAX_THREADS 8
+
+struct load_source_job {
+	obs_data_t *data;
+	obs_source_t *source;
+	struct obs_source_create_queue created;
+	bool serial;
+};
+
+struct load_sources_info {
+	struct load_source_job *jobs;
+	size_t num;
+	volatile long next;
+};
+
+static bool type_creates_serially(obs_data_t *source_data)
+{
+	const char *id = obs_data_get_string(source_data, "versioned_id");
+	const struct obs_source_info *info;
+
+	if (!*id)
+		id = obs_data_get_string(source_data, "id");
+
+	info = get_source_info(id);
+	if (!info)
+		return false;
+
+	return info->type == OBS_SOURCE_TYPE_SCENE ||
+	       (info->output_flags & OBS_SOURCE_SERIAL_CREATE) != 0;
+}
+
+static bool creates_serially(obs_data_t *source_data)
+{
+	obs_data_array_t *filters = obs_data_get_array(source_data, "filters");
+	size_t count = obs_data_array_count(filters);
+	bool serial = type_creates_serially(source_data);
+
+	for (size_t i = 0; !serial && i < count; i++) {
+		obs_data_t *filter_data = obs_data_array_item(filters, i);
+		serial = type_creates_serially(filter_data);
+		obs_data_release(filter_data);
+	}
+
+	obs_data_array_release(filters);
+	return serial;
+}
+
+static void create_job_source(struct load_source_job *job)
+{
+	obs_source_set_create_queue(&job->created);
+	job->source = obs_load_source(job->data);
+	obs_source_set_create_queue(NULL);
+}
+
+static void create_parallel_sources(struct load_sources_info *info)
+{
+	for (;;) {
+		long idx = os_atomic_inc_long(&info->next) - 1;
+		struct load_source_job *job;
+
+		if ((size_t)idx >= info->num)
+			break;
+
+		job = &info->jobs[idx];
+		if (!job->serial)
+			create_job_source(job);
+	}
+}
+
+static void *load_sources_thread(void *param)
+{
+	os_set_thread_name("libobs: load sources");
+	create_parallel_sources(param);
+	return NULL;
+}
+
+static const char *obs_load_sources_name = "obs_load_sources";
+static const char *create_sources_name = "create sources";
+static const char *load_sources_name = "load sources";
+
 void obs_load_sources(obs_data_array_t *array, obs_load_source_cb cb,
 		      void *private_data)
 {
 	struct obs_core_data *data = &obs->data;
-	DARRAY(obs_source_t *) sources;
+	struct load_sources_info info = {0};
+	pthread_t threads[LOAD_MAX_THREADS];
+	size_t num_threads = 0;
+	size_t num_parallel = 0;
 	size_t count;
 	size_t i;
+	uint64_t start_time;
+	uint64_t created_time;
 
-	da_init(sources);
+	profile_start(obs_load_sources_name);
+	profile_start(create_sources_name);
+	start_time = os_gettime_ns();
 
 	count = obs_data_array_count(array);
-	da_reserve(sources, count);
-
-	pthread_mutex_lock(&data->sources_mutex);
+	info.jobs = bzalloc(sizeof(struct load_source_job) * count);
+	info.num = count;
 
 	for (i = 0; i < count; i++) {
-		obs_data_t *source_data = obs_data_array_item(array, i);
-		obs_source_t *source = obs_load_source(source_data);
+		struct load_source_job *job = &info.jobs[i];
 
-		da_push_back(sources, &source);
+		job->data = obs_data_array_item(array, i);
+		job->serial = creates_serially(job->data);
+		if (!job->serial)
+			num_parallel++;
+	}
 
-		obs_data_release(source_data);
+	if (num_parallel > 1) {
+		int cores = os_get_logical_cores();
+		size_t max_threads = cores > 1 ? (size_t)cores - 1 : 0;
+
+		if (max_threads > LOAD_MAX_THREADS)
+			max_threads = LOAD_MAX_THREADS;
+		if (max_threads > num_parallel - 1)
+			max_threads = num_parallel - 1;
+
+		for (; num_threads < max_threads; num_threads++) {
+			if (pthread_create(&threads[num_threads], NULL,
+					   load_sources_thread, &info) != 0)
+				break;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		struct load_source_job *job = &info.jobs[i];
+		if (job->serial)
+			create_job_source(job);
 	}
 
+	create_parallel_sources(&info);
+
+	for (i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < count; i++)
+		obs_source_send_create_queue(&info.jobs[i].created);
+
+	created_time = os_gettime_ns();
+	profile_end(create_sources_name);
+	profile_start(load_sources_name);
+
+	pthread_mutex_lock(&data->sources_mutex);
+
 	/* tell sources that we want to load */
-	for (i = 0; i < sources.num; i++) {
-		obs_source_t *source = sources.array[i];
-		obs_data_t *source_data = obs_data_array_item(array, i);
+	for (i = 0; i < count; i++) {
+		obs_source_t *source = info.jobs[i].source;
+		obs_data_t *source_data = info.jobs[i].data;
 		if (source) {
 			if (source->info.type == OBS_SOURCE_TYPE_TRANSITION)
 				obs_transition_load(source, source_data);
@@ -2029,15 +2297,26 @@ void obs_load_sources(obs_data_array_t *array, obs_load_source_cb cb,
 			if (cb)
 				cb(private_data, source);
 		}
-		obs_data_release(source_data);
 	}
 
-	for (i = 0; i < sources.num; i++)
-		obs_source_release(sources.array[i]);
+	for (i = 0; i < count; i++) {
+		obs_source_release(info.jobs[i].source);
+		obs_data_release(info.jobs[i].data);
+	}
 
 	pthread_mutex_unlock(&data->sources_mutex);
 
-	da_free(sources);
+	profile_end(load_sources_name);
+	profile_end(obs_load_sources_name);
+
+	blog(LOG_INFO,
+	     "Loaded %zu sources: created in %.1f ms (%zu serially, "
+	     "%zu threads), loaded in %.1f ms",
+	     count, (double)(created_time - start_time) / 1000000.0,
+	     count - num_parallel, num_threads + 1,
+	     (double)(os_gettime_ns() - created_time) / 1000000.0);
+
+	bfree(info.jobs);
 }
 
 obs_data_t *obs_save_source(obs_source_t *source)
@@ -2078,6 +2357,7 @@ obs_data_t *obs_save_source(obs_source_t *source)
 	obs_data_set_int(source_data, "prev_ver", LIBOBS_API_VER);
 
 	obs_data_set_string(source_data, "name", name);
+	obs_data_set_string(source_data, "uuid", obs_source_get_uuid(source));
 	obs_data_set_string(source_data, "id", id);
 	obs_data_set_string(source_data, "versioned_id", v_id);
 	obs_data_set_obj(source_data, "settings", settings);
@@ -2265,6 +2545,7 @@ static inline bool obs_context_data_init_wrap(struct obs_context_data *context,
 		return false;
 
 	context->name = dup_name(name, private);
+	context->uuid = os_generate_uuid();
 	context->settings = obs_data_newref(settings);
 	context->hotkey_data = obs_data_newref(hotkey_data);
 	return true;
@@ -2293,6 +2574,7 @@ void obs_context_data_free(struct obs_context_data *context)
 	obs_context_data_remove(context);
 	pthread_mutex_destroy(&context->rename_cache_mutex);
 	bfree(context->name);
+	bfree(context->uuid);
 
 	for (size_t i = 0; i < context->rename_cache.num; i++)
 		bfree(context->rename_cache.array[i]);
@@ -2301,6 +2583,139 @@ void obs_context_data_free(struct obs_context_data *context)
 	memset(context, 0, sizeof(*context));
 }
 
+static struct obs_context_index *get_context_index(enum obs_obj_type type)
+{
+	switch (type) {
+	case OBS_OBJ_TYPE_SOURCE:
+		return &obs->data.source_index;
+	case OBS_OBJ_TYPE_OUTPUT:
+		return &obs->data.output_index;
+	case OBS_OBJ_TYPE_ENCODER:
+		return &obs->data.encoder_index;
+	case OBS_OBJ_TYPE_SERVICE:
+		return &obs->data.service_index;
+	case OBS_OBJ_TYPE_INVALID:
+		break;
+	}
+
+	return NULL;
+}
+
+static inline void index_link(struct obs_context_index *index,
+			      struct obs_context_data *context, bool uuid)
+{
+	struct obs_context_data **bucket;
+
+	if (!index_key(context, uuid))
+		return;
+
+	bucket = index_bucket(index, index_key(context, uuid), uuid);
+	*index_next(context, uuid) = *bucket;
+	*bucket = context;
+}
+
+static inline void index_unlink(struct obs_context_index *index,
+				struct obs_context_data *context, bool uuid)
+{
+	struct obs_context_data **link;
+
+	if (!index_key(context, uuid))
+		return;
+
+	link = index_bucket(index, index_key(context, uuid), uuid);
+	while (*link && *link != context)
+		link = index_next(*link, uuid);
+
+	if (*link)
+		*link = *index_next(context, uuid);
+	*index_next(context, uuid) = NULL;
+}
+
+/* moves the chains to a table twice the size.  Chains are appended to in
+ * order, so of contexts with the same name the newest is still found
+ * first, as it was with the linked list. */
+static void index_rehash_chains(struct obs_context_index *index,
+				struct obs_context_data **old, size_t num_old,
+				bool uuid)
+{
+	for (size_t i = 0; i < num_old; i++) {
+		struct obs_context_data *context = old[i];
+
+		while (context) {
+			struct obs_context_data *next = *index_next(context,
+								    uuid);
+			struct obs_context_data **link = index_bucket(
+				index, index_key(context, uuid), uuid);
+
+			while (*link)
+				link = index_next(*link, uuid);
+
+			*link = context;
+			*index_next(context, uuid) = NULL;
+			context = next;
+		}
+	}
+}
+
+static void index_grow(struct obs_context_index *index)
+{
+	struct obs_context_data **names = index->names;
+	struct obs_context_data **uuids = index->uuids;
+	size_t num_old = index->num_buckets;
+
+	index->num_buckets = num_old ? num_old * 2 : 64;
+	index->names = bzalloc(sizeof(*names) * index->num_buckets);
+	index->uuids = bzalloc(sizeof(*uuids) * index->num_buckets);
+
+	index_rehash_chains(index, names, num_old, false);
+	index_rehash_chains(index, uuids, num_old, true);
+
+	bfree(names);
+	bfree(uuids);
+}
+
+static void index_insert(struct obs_context_data *context)
+{
+	struct obs_context_index *index = get_context_index(context->type);
+
+	if (!index || context->private)
+		return;
+
+	pthread_rwlock_wrlock(&index->lock);
+
+	if (index->num >= index->num_buckets)
+		index_grow(index);
+
+	/* a loaded uuid can already exist, e.g. when the same collection is
+	 * imported twice */
+	if (context->uuid && index_find(index, context->uuid, true)) {
+		bfree(context->uuid);
+		context->uuid = os_generate_uuid();
+	}
+
+	index_link(index, context, false);
+	index_link(index, context, true);
+	index->num++;
+	context->index = index;
+
+	pthread_rwlock_unlock(&index->lock);
+}
+
+static void index_remove(struct obs_context_data *context)
+{
+	struct obs_context_index *index = context->index;
+
+	if (!index)
+		return;
+
+	pthread_rwlock_wrlock(&index->lock);
+	index_unlink(index, context, false);
+	index_unlink(index, context, true);
+	index->num--;
+	context->index = NULL;
+	pthread_rwlock_unlock(&index->lock);
+}
+
 void obs_context_data_insert(struct obs_context_data *context,
 			     pthread_mutex_t *mutex, void *pfirst)
 {
@@ -2319,11 +2734,15 @@ void obs_context_data_insert(struct obs_context_data *context,
 	if (context->next)
 		context->next->prev_next = &context->next;
 	pthread_mutex_unlock(mutex);
+
+	index_insert(context);
 }
 
 void obs_context_data_remove(struct obs_context_data *context)
 {
 	if (context && context->mutex) {
+		index_remove(context);
+
 		pthread_mutex_lock(context->mutex);
 		if (context->prev_next)
 			*context->prev_next = context->next;
@@ -2338,6 +2757,13 @@ void obs_context_data_remove(struct obs_context_data *context)
 void obs_context_data_setname(struct obs_context_data *context,
 			      const char *name)
 {
+	struct obs_context_index *index = context->index;
+
+	if (index) {
+		pthread_rwlock_wrlock(&index->lock);
+		index_unlink(index, context, false);
+	}
+
 	pthread_mutex_lock(&context->rename_cache_mutex);
 
 	if (context->name)
@@ -2345,6 +2771,21 @@ void obs_context_data_setname(struct obs_context_data *context,
 	context->name = dup_name(name, context->private);
 
 	pthread_mutex_unlock(&context->rename_cache_mutex);
+
+	if (index) {
+		index_link(index, context, false);
+		pthread_rwlock_unlock(&index->lock);
+	}
+}
+
+void obs_context_data_setuuid(struct obs_context_data *context,
+			      const char *uuid)
+{
+	if (!uuid || !*uuid || context->index)
+		return;
+
+	bfree(context->uuid);
+	context->uuid = bstrdup(uuid);
 }
 
 profiler_name_store_t *obs_get_profiler_name_store(void)
@@ -152,7 +152,8 @@ struct obs_transform_info {
 struct obs_video_info {
 #ifndef SWIG
 	/**
-	 * Graphics module to use (usually "libobs-opengl" or "libobs-d3d11")
+	 * Graphics module to use (usually "libobs-opengl" or "libobs-d3d11",
+	 * or "libobs-null" for the headless software renderer)
 	 */
 	const char *graphics_module;
 #endif
@@ -259,6 +260,18 @@ struct obs_source_frame2 {
 	bool flip;
 };
 
+/** Async frame pool statistics, see obs_source_get_async_stats */
+struct obs_source_async_stats {
+	uint64_t acquired;  /**< frames borrowed with frame_acquire */
+	uint64_t copied;    /**< frames copied by output_video */
+	uint64_t allocated; /**< pool frames allocated */
+	uint64_t dropped;   /**< frames dropped before being queued */
+	uint64_t overflows; /**< times the frame queue was flushed */
+	size_t pool_size;   /**< maximum queued frames */
+	size_t cached;      /**< frames currently in the pool */
+	size_t queued;      /**< frames currently waiting for display */
+};
+
 /** Access to the argc/argv used to start OBS. What you see is what you get. */
 struct obs_cmdline_args {
 	int argc;
@@ -462,6 +475,14 @@ EXPORT const char *obs_get_module_data_path(obs_module_t *module);
  */
 EXPORT void obs_add_module_path(const char *bin, const char *data);
 
+/**
+ * Loads modules that only registered types the last time they were loaded
+ * the first time one of those types is requested, instead of in
+ * obs_load_all_modules.  What each module registered is cached in the module
+ * config path.  Must be called before obs_load_all_modules.
+ */
+EXPORT void obs_set_deferred_module_loading(bool enable);
+
 /** Automatically loads all modules from module paths (convenience function) */
 EXPORT void obs_load_all_modules(void);
 
@@ -634,6 +655,14 @@ EXPORT void *obs_audio_mix_tracks();
  */
 EXPORT obs_source_t *obs_get_source_by_name(const char *name);
 
+/**
+ * Gets a source by its UUID.
+ *
+ *   Increments the source reference counter, use obs_source_release to
+ * release it when complete.
+ */
+EXPORT obs_source_t *obs_get_source_by_uuid(const char *uuid);
+
 /** Gets an output by its name. */
 EXPORT obs_output_t *obs_get_output_by_name(const char *name);
 
@@ -979,6 +1008,9 @@ EXPORT obs_data_t *obs_source_get_settings(const obs_source_t *source);
 /** Gets the name of a source */
 EXPORT const char *obs_source_get_name(const obs_source_t *source);
 
+/** Gets the UUID of a source, it is kept when the source is saved/loaded */
+EXPORT const char *obs_source_get_uuid(const obs_source_t *source);
+
 /** Sets the name of a source */
 EXPORT void obs_source_set_name(obs_source_t *source, const char *name);
 
@@ -1236,6 +1268,34 @@ EXPORT void obs_source_output_video(obs_source_t *source,
 EXPORT void obs_source_output_video2(obs_source_t *source,
 				     const struct obs_source_frame2 *frame);
 
+/**
+ * Borrows a frame from the source's async frame pool so that it can be filled
+ * in place, avoiding the copy made by obs_source_output_video.  Write the
+ * frame data to the returned frame's planes, set its timestamp (and color
+ * parameters for YUV formats), then pass it to obs_source_frame_submit, or
+ * return it unused with obs_source_frame_release.
+ *
+ * Returns NULL if the source's frame queue has overflowed, in which case the
+ * frame should be skipped.
+ */
+EXPORT struct obs_source_frame *
+obs_source_frame_acquire(obs_source_t *source, enum video_format format,
+			 uint32_t width, uint32_t height,
+			 enum video_range_type range);
+EXPORT void obs_source_frame_submit(obs_source_t *source,
+				    struct obs_source_frame *frame);
+EXPORT void obs_source_frame_release(obs_source_t *source,
+				     struct obs_source_frame *frame);
+
+/**
+ * Sets the maximum number of frames that can be queued for display before
+ * the queue is flushed.  0 restores the default.
+ */
+EXPORT void obs_source_set_async_pool_size(obs_source_t *source,
+					   size_t frames);
+EXPORT void obs_source_get_async_stats(obs_source_t *source,
+				       struct obs_source_async_stats *stats);
+
 EXPORT void obs_source_set_async_rotation(obs_source_t *source, long rotation);
 
 /**
@@ -1640,6 +1700,10 @@ EXPORT void obs_sceneitem_get_box_transform(const obs_sceneitem_t *item,
 					    struct matrix4 *transform);
 EXPORT void obs_sceneitem_get_box_scale(const obs_sceneitem_t *item,
 					struct vec2 *scale);
+EXPORT void obs_sceneitem_get_box_extents(const obs_sceneitem_t *item,
+					  struct vec2 *min, struct vec2 *max);
+EXPORT bool obs_sceneitem_hit_test(const obs_sceneitem_t *item,
+				   const struct vec2 *pos);
 
 EXPORT bool obs_sceneitem_visible(const obs_sceneitem_t *item);
 EXPORT bool obs_sceneitem_set_visible(obs_sceneitem_t *item, bool visible);
@@ -1767,9 +1831,9 @@ EXPORT void obs_output_stop(obs_output_t *output);
 /**
  * Sets the current output delay, in seconds (if the output supports delay).
  *
- * If delay is currently active, it will set the delay value, but will not
- * affect the current delay, it will only affect the next time the output is
- * activated.
+ * If delay is currently active, the new value takes effect immediately.
+ * Adding a delay to an output started without one, or removing it, only
+ * takes effect the next time the output is activated.
  */
 EXPORT void obs_output_set_delay(obs_output_t *output, uint32_t delay_sec,
 				 uint32_t flags);
@@ -1780,6 +1844,9 @@ EXPORT uint32_t obs_output_get_delay(const obs_output_t *output);
 /** If delay is active, gets the currently active delay value, in seconds. */
 EXPORT uint32_t obs_output_get_active_delay(const obs_output_t *output);
 
+/** Gets the memory allocated for the delay queue, in bytes */
+EXPORT uint64_t obs_output_get_delay_memory_usage(obs_output_t *output);
+
 /** Forces the output to stop.  Usually only used with delay. */
 EXPORT void obs_output_force_stop(obs_output_t *output);
 
@@ -1941,6 +2008,20 @@ obs_output_get_supported_video_codecs(const obs_output_t *output);
 EXPORT const char *
 obs_output_get_supported_audio_codecs(const obs_output_t *output);
 
+/**
+ * Enables per-packet tracing of the output pipeline.  Stage latencies are
+ * collected into histograms, the most recent stamps are kept as events.
+ * Enabling resets what was collected before.
+ */
+EXPORT void obs_output_set_packet_trace(obs_output_t *output, bool enable);
+EXPORT bool obs_output_packet_trace_enabled(const obs_output_t *output);
+
+/** Returns count, p50/p99 and maximum latency of each traced stage */
+EXPORT obs_data_t *obs_output_get_packet_trace_stats(obs_output_t *output);
+
+/** Returns the recent packet events as Chrome trace JSON, free with bfree */
+EXPORT char *obs_output_get_packet_trace_json(obs_output_t *output);
+
 /* ------------------------------------------------------------------------- */
 /* Functions used by outputs */
 
@@ -1964,6 +2045,15 @@ EXPORT bool obs_output_can_begin_data_capture(const obs_output_t *output,
 EXPORT bool obs_output_initialize_encoders(obs_output_t *output,
 					   uint32_t flags);
 
+/**
+ * Stamps a packet at a stage of the output, used by outputs for
+ * OBS_PACKET_TRACE_MUXED and OBS_PACKET_TRACE_SENT.  Does nothing unless
+ * tracing is enabled on the output.
+ */
+EXPORT void obs_output_trace_packet(obs_output_t *output,
+				    struct encoder_packet *packet,
+				    enum obs_packet_trace_stage stage);
+
 /**
  * Begins data capture from media/encoders.
  *
@@ -2062,6 +2152,22 @@ EXPORT enum obs_encoder_type obs_encoder_get_type(const obs_encoder_t *encoder);
 EXPORT void obs_encoder_set_scaled_size(obs_encoder_t *encoder, uint32_t width,
 					uint32_t height);
 
+/**
+ * Aligns the keyframes of a video encoder to the frame count of its video
+ * output.  A keyframe is requested every interval frames counted from the
+ * start of the video output rather than from the start of the encoder, so all
+ * encoders of a rendition ladder that use the same interval produce matching
+ * GOP boundaries for HLS/DASH packaging.  Set to 0 to let the encoder place
+ * keyframes itself.  If the encoder is active, this function will trigger a
+ * warning, and do nothing.
+ */
+EXPORT void obs_encoder_set_keyframe_alignment(obs_encoder_t *encoder,
+					       uint32_t interval);
+
+/** For video encoders, returns the keyframe alignment interval in frames */
+EXPORT uint32_t
+obs_encoder_get_keyframe_alignment(const obs_encoder_t *encoder);
+
 /** For video encoders, returns true if pre-encode scaling is enabled */
 EXPORT bool obs_encoder_scaling_enabled(const obs_encoder_t *encoder);
 
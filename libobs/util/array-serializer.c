@@ -40,6 +40,16 @@ void array_output_serializer_init(struct serializer *s,
 	s->get_pos = array_output_get_pos;
 }
 
+void array_output_serializer_reset(struct serializer *s,
+				   struct array_output_data *data)
+{
+	memset(s, 0, sizeof(struct serializer));
+	data->bytes.num = 0;
+	s->data = data;
+	s->write = array_output_write;
+	s->get_pos = array_output_get_pos;
+}
+
 void array_output_serializer_free(struct array_output_data *data)
 {
 	da_free(data->bytes);
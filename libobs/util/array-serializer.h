@@ -25,4 +25,6 @@ struct array_output_data {
 
 EXPORT void array_output_serializer_init(struct serializer *s,
 					 struct array_output_data *data);
+EXPORT void array_output_serializer_reset(struct serializer *s,
+					  struct array_output_data *data);
 EXPORT void array_output_serializer_free(struct array_output_data *data);
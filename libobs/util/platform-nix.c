@@ -19,6 +19,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <stdlib.h>
 #include <limits.h>
@@ -941,6 +943,95 @@ uint64_t os_get_proc_virtual_size(void)
 #endif
 #endif
 
+char *os_generate_uuid(void)
+{
+	static volatile long counter = 0;
+	uint8_t bytes[16];
+	bool success = false;
+	struct dstr uuid = {0};
+	FILE *file;
+
+	file = fopen("/dev/urandom", "rb");
+	if (file) {
+		success = fread(bytes, 1, sizeof(bytes), file) == sizeof(bytes);
+		fclose(file);
+	}
+
+	/* still unique within the process */
+	if (!success) {
+		uint64_t ts = os_gettime_ns();
+		long count = os_atomic_inc_long(&counter);
+		pid_t pid = getpid();
+
+		memcpy(bytes, &ts, sizeof(ts));
+		memcpy(bytes + 8, &count, sizeof(int32_t));
+		memcpy(bytes + 12, &pid, sizeof(int32_t));
+	}
+
+	bytes[6] = (bytes[6] & 0x0f) | 0x40;
+	bytes[8] = (bytes[8] & 0x3f) | 0x80;
+
+	for (size_t i = 0; i < sizeof(bytes); i++) {
+		if (i == 4 || i == 6 || i == 8 || i == 10)
+			dstr_cat_ch(&uuid, '-');
+		dstr_catf(&uuid, "%02x", bytes[i]);
+	}
+
+	return uuid.array;
+}
+
+struct os_file_map {
+	void *data;
+	size_t size;
+};
+
+os_file_map_t *os_file_map_open(const char *path)
+{
+	struct os_file_map *map;
+	struct stat st;
+	void *data;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return NULL;
+
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return NULL;
+	}
+
+	/* the mapping keeps its own reference to the file */
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return NULL;
+
+	map = bmalloc(sizeof(struct os_file_map));
+	map->data = data;
+	map->size = (size_t)st.st_size;
+	return map;
+}
+
+const void *os_file_map_data(os_file_map_t *map)
+{
+	return map ? map->data : NULL;
+}
+
+size_t os_file_map_size(os_file_map_t *map)
+{
+	return map ? map->size : 0;
+}
+
+void os_file_map_close(os_file_map_t *map)
+{
+	if (map) {
+		munmap(map->data, map->size);
+		bfree(map);
+	}
+}
+
 uint64_t os_get_free_disk_space(const char *dir)
 {
 	struct statvfs info;
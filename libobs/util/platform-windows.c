@@ -1162,6 +1162,89 @@ uint64_t os_get_proc_virtual_size(void)
 	return pmc.PagefileUsage;
 }
 
+char *os_generate_uuid(void)
+{
+	struct dstr uuid = {0};
+	GUID guid;
+
+	if (FAILED(CoCreateGuid(&guid)))
+		return NULL;
+
+	dstr_printf(&uuid,
+		    "%08lx-%04hx-%04hx-%02x%02x-%02x%02x%02x%02x%02x%02x",
+		    guid.Data1, guid.Data2, guid.Data3, guid.Data4[0],
+		    guid.Data4[1], guid.Data4[2], guid.Data4[3], guid.Data4[4],
+		    guid.Data4[5], guid.Data4[6], guid.Data4[7]);
+	return uuid.array;
+}
+
+struct os_file_map {
+	HANDLE mapping;
+	void *data;
+	size_t size;
+};
+
+os_file_map_t *os_file_map_open(const char *path)
+{
+	struct os_file_map *map;
+	LARGE_INTEGER size;
+	wchar_t *wpath = NULL;
+	HANDLE file;
+	HANDLE mapping = NULL;
+	void *data = NULL;
+
+	if (!os_utf8_to_wcs_ptr(path, 0, &wpath))
+		return NULL;
+
+	file = CreateFileW(wpath, GENERIC_READ,
+			   FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+			   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	bfree(wpath);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+		mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0,
+					     NULL);
+
+	/* the mapping keeps its own reference to the file */
+	CloseHandle(file);
+
+	if (mapping)
+		data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		if (mapping)
+			CloseHandle(mapping);
+		return NULL;
+	}
+
+	map = bmalloc(sizeof(struct os_file_map));
+	map->mapping = mapping;
+	map->data = data;
+	map->size = (size_t)size.QuadPart;
+	return map;
+}
+
+const void *os_file_map_data(os_file_map_t *map)
+{
+	return map ? map->data : NULL;
+}
+
+size_t os_file_map_size(os_file_map_t *map)
+{
+	return map ? map->size : 0;
+}
+
+void os_file_map_close(os_file_map_t *map)
+{
+	if (map) {
+		UnmapViewOfFile(map->data);
+		CloseHandle(map->mapping);
+		bfree(map);
+	}
+}
+
 uint64_t os_get_free_disk_space(const char *dir)
 {
 	wchar_t *wdir = NULL;
@@ -172,6 +172,18 @@ EXPORT int os_safe_replace(const char *target_path, const char *from_path,
 EXPORT char *os_generate_formatted_filename(const char *extension, bool space,
 					    const char *format);
 
+/** Returns a new random (version 4) UUID string, free with bfree */
+EXPORT char *os_generate_uuid(void);
+
+struct os_file_map;
+typedef struct os_file_map os_file_map_t;
+
+/** Maps a file read-only into memory, the data stays valid until closed */
+EXPORT os_file_map_t *os_file_map_open(const char *path);
+EXPORT const void *os_file_map_data(os_file_map_t *map);
+EXPORT size_t os_file_map_size(os_file_map_t *map);
+EXPORT void os_file_map_close(os_file_map_t *map);
+
 struct os_inhibit_info;
 typedef struct os_inhibit_info os_inhibit_t;
 
@@ -21,6 +21,7 @@
 #include "util/windows/win-version.h"
 #endif
 
+#include <inttypes.h>
 #include <libavformat/avformat.h>
 
 #define do_log(level, format, ...)                  \
@@ -51,6 +52,8 @@ static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
 	}
 
 	circlebuf_free(&stream->packets);
+	replay_ring_release(stream->ring);
+	stream->ring = NULL;
 	stream->cur_size = 0;
 	stream->cur_time = 0;
 	stream->max_size = 0;
@@ -703,6 +706,79 @@ static void replay_buffer_destroy(void *data)
 	ffmpeg_mux_destroy(data);
 }
 
+static int64_t get_encoder_bitrate(obs_encoder_t *encoder)
+{
+	obs_data_t *settings = obs_encoder_get_settings(encoder);
+	int64_t bitrate = obs_data_get_int(settings, "bitrate");
+
+	obs_data_release(settings);
+	return bitrate;
+}
+
+/* without a size limit the ring is sized from the encoder bitrates, with
+ * room for variable bitrate peaks and for new data arriving during a save */
+static uint64_t get_ring_capacity(struct ffmpeg_muxer *stream)
+{
+	obs_output_t *output = stream->output;
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(output);
+	int64_t kbps = 0;
+	uint64_t capacity;
+
+	if (stream->max_size)
+		return (uint64_t)stream->max_size +
+		       (uint64_t)stream->max_size / 4;
+
+	if (vencoder)
+		kbps += get_encoder_bitrate(vencoder);
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		obs_encoder_t *aencoder =
+			obs_output_get_audio_encoder(output, i);
+		if (aencoder)
+			kbps += get_encoder_bitrate(aencoder);
+	}
+
+	if (!kbps)
+		kbps = 50000;
+
+	capacity = (uint64_t)(kbps * 1000 / 8) *
+		   (uint64_t)(stream->max_time / 1000000LL);
+	return capacity * 2;
+}
+
+static bool replay_buffer_create_ring(struct ffmpeg_muxer *stream,
+				      obs_data_t *settings)
+{
+	const char *dir = obs_data_get_string(settings, "disk_buffer_path");
+	uint64_t capacity = get_ring_capacity(stream);
+	struct dstr path = {0};
+
+	if (!dir || !*dir)
+		dir = obs_data_get_string(settings, "directory");
+
+	dstr_copy(&path, dir);
+	dstr_replace(&path, "\\", "/");
+	if (dstr_end(&path) != '/')
+		dstr_cat_ch(&path, '/');
+	os_mkdirs(path.array);
+
+	if (os_get_free_disk_space(path.array) < capacity) {
+		warn("Not enough disk space in '%s' for a %" PRIu64
+		     " MB replay buffer",
+		     path.array, capacity / (1024 * 1024));
+		dstr_free(&path);
+		return false;
+	}
+
+	dstr_catf(&path, ".replay-buffer-%p.tmp", stream);
+	stream->ring = replay_ring_create(path.array, capacity);
+	if (stream->ring)
+		info("Using a %" PRIu64 " MB replay buffer file in '%s'",
+		     capacity / (1024 * 1024), dir);
+
+	dstr_free(&path);
+	return stream->ring != NULL;
+}
+
 static bool replay_buffer_start(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -715,6 +791,12 @@ static bool replay_buffer_start(void *data)
 	obs_data_t *s = obs_output_get_settings(stream->output);
 	stream->max_time = obs_data_get_int(s, "max_time_sec") * 1000000LL;
 	stream->max_size = obs_data_get_int(s, "max_size_mb") * (1024 * 1024);
+
+	if (obs_data_get_bool(s, "use_disk_buffer") &&
+	    !replay_buffer_create_ring(stream, s)) {
+		obs_data_release(s);
+		return false;
+	}
 	obs_data_release(s);
 
 	os_atomic_set_bool(&stream->active, true);
@@ -786,6 +868,28 @@ static inline void replay_buffer_purge(struct ffmpeg_muxer *stream,
 		purge(stream);
 }
 
+static inline void replay_ring_purge_window(struct ffmpeg_muxer *stream,
+					    struct encoder_packet *pkt)
+{
+	struct replay_ring *ring = stream->ring;
+
+	if (stream->max_size) {
+		while (replay_ring_keyframes(ring) > 2 &&
+		       (int64_t)replay_ring_size(ring) + (int64_t)pkt->size >
+			       stream->max_size) {
+			if (!replay_ring_purge(ring))
+				break;
+		}
+	}
+
+	while (replay_ring_keyframes(ring) > 2 &&
+	       pkt->dts_usec - replay_ring_start_time(ring) >
+		       stream->max_time) {
+		if (!replay_ring_purge(ring))
+			break;
+	}
+}
+
 static void insert_packet(struct darray *array, struct encoder_packet *packet,
 			  int64_t video_offset, int64_t *audio_offsets,
 			  int64_t video_dts_offset, int64_t *audio_dts_offsets)
@@ -817,6 +921,43 @@ static void insert_packet(struct darray *array, struct encoder_packet *packet,
 	*array = packets.da;
 }
 
+/* packets come out of the ring in the order they were received, the muxer
+ * interleaves them again once the per track offsets are applied */
+static bool write_ring_packets(struct ffmpeg_muxer *stream)
+{
+	bool found_video = false;
+	bool found_audio[MAX_AUDIO_MIXES] = {0};
+	int64_t video_dts_offset = 0;
+	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
+	struct encoder_packet pkt;
+
+	while (replay_ring_read(stream->ring_reader, &pkt)) {
+		int64_t *offset;
+
+		if (pkt.type == OBS_ENCODER_VIDEO) {
+			if (!found_video) {
+				video_dts_offset = pkt.dts;
+				found_video = true;
+			}
+			offset = &video_dts_offset;
+		} else {
+			if (!found_audio[pkt.track_idx]) {
+				found_audio[pkt.track_idx] = true;
+				audio_dts_offsets[pkt.track_idx] = pkt.dts;
+			}
+			offset = &audio_dts_offsets[pkt.track_idx];
+		}
+
+		pkt.dts -= *offset;
+		pkt.pts -= *offset;
+
+		if (!write_packet(stream, &pkt))
+			break;
+	}
+
+	return !replay_ring_read_overrun(stream->ring_reader);
+}
+
 static void *replay_buffer_mux_thread(void *data)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -834,6 +975,15 @@ static void *replay_buffer_mux_thread(void *data)
 		goto error;
 	}
 
+	if (stream->ring_reader) {
+		if (!write_ring_packets(stream)) {
+			warn("Replay buffer data was overwritten while saving "
+			     "'%s'",
+			     stream->path.array);
+			goto error;
+		}
+	}
+
 	for (size_t i = 0; i < stream->mux_packets.num; i++) {
 		struct encoder_packet *pkt = &stream->mux_packets.array[i];
 		write_packet(stream, pkt);
@@ -846,6 +996,8 @@ error:
 	os_process_pipe_destroy(stream->pipe);
 	stream->pipe = NULL;
 	da_free(stream->mux_packets);
+	replay_ring_read_end(stream->ring_reader);
+	stream->ring_reader = NULL;
 	os_atomic_set_bool(&stream->muxing, false);
 	return NULL;
 }
@@ -855,6 +1007,13 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 	const size_t size = sizeof(struct encoder_packet);
 	size_t num_packets = stream->packets.size / size;
 
+	/* a disk buffer is read back by the mux thread itself */
+	if (stream->ring) {
+		stream->ring_reader = replay_ring_read_begin(stream->ring);
+		if (!stream->ring_reader)
+			return;
+	}
+
 	da_reserve(stream->mux_packets, num_packets);
 
 	/* ---------------------------- */
@@ -960,17 +1119,25 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 		}
 	}
 
-	obs_encoder_packet_ref(&pkt, packet);
-	replay_buffer_purge(stream, &pkt);
+	if (stream->ring) {
+		replay_ring_purge_window(stream, packet);
+		if (!replay_ring_push(stream->ring, packet))
+			warn("Packet of %zu bytes does not fit the replay "
+			     "buffer",
+			     packet->size);
+	} else {
+		obs_encoder_packet_ref(&pkt, packet);
+		replay_buffer_purge(stream, &pkt);
 
-	if (!stream->packets.size)
-		stream->cur_time = pkt.dts_usec;
-	stream->cur_size += pkt.size;
+		if (!stream->packets.size)
+			stream->cur_time = pkt.dts_usec;
+		stream->cur_size += pkt.size;
 
-	circlebuf_push_back(&stream->packets, packet, sizeof(*packet));
+		circlebuf_push_back(&stream->packets, packet, sizeof(*packet));
 
-	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
-		stream->keyframes++;
+		if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
+			stream->keyframes++;
+	}
 
 	if (stream->save_ts && packet->sys_dts_usec >= stream->save_ts) {
 		if (os_atomic_load_bool(&stream->muxing))
@@ -993,6 +1160,7 @@ static void replay_buffer_defaults(obs_data_t *s)
 	obs_data_set_default_string(s, "format", "%CCYY-%MM-%DD %hh-%mm-%ss");
 	obs_data_set_default_string(s, "extension", "mp4");
 	obs_data_set_default_bool(s, "allow_spaces", true);
+	obs_data_set_default_bool(s, "use_disk_buffer", false);
 }
 
 struct obs_output_info replay_buffer = {
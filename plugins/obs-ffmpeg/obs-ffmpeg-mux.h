@@ -9,6 +9,7 @@
 #include <util/pipe.h>
 #include <util/platform.h>
 #include <util/threading.h>
+#include "replay-ring.h"
 
 struct ffmpeg_muxer {
 	obs_output_t *output;
@@ -35,6 +36,10 @@ struct ffmpeg_muxer {
 	volatile bool muxing;
 	DARRAY(struct encoder_packet) mux_packets;
 
+	/* disk backed replay buffer, replaces packets when used */
+	struct replay_ring *ring;
+	struct replay_ring_reader *ring_reader;
+
 	/* these are accessed both by replay buffer and by HLS */
 	pthread_t mux_thread;
 	bool mux_thread_joinable;
@@ -251,10 +251,26 @@ static void dump_source_info(struct ffmpeg_source *s, const char *input,
 		s->close_when_inactive ? "yes" : "no");
 }
 
+static struct obs_source_frame *acquire_frame(void *opaque,
+					      enum video_format format,
+					      uint32_t width, uint32_t height,
+					      enum video_range_type range)
+{
+	struct ffmpeg_source *s = opaque;
+	return obs_source_frame_acquire(s->source, format, width, height,
+					range);
+}
+
 static void get_frame(void *opaque, struct obs_source_frame *f)
 {
 	struct ffmpeg_source *s = opaque;
-	obs_source_output_video(s->source, f);
+	obs_source_frame_submit(s->source, f);
+}
+
+static void release_frame(void *opaque, struct obs_source_frame *f)
+{
+	struct ffmpeg_source *s = opaque;
+	obs_source_frame_release(s->source, f);
 }
 
 static void preload_frame(void *opaque, struct obs_source_frame *f)
@@ -305,6 +321,8 @@ static void ffmpeg_source_open(struct ffmpeg_source *s)
 		struct mp_media_info info = {
 			.opaque = s,
 			.v_cb = get_frame,
+			.v_acquire_cb = acquire_frame,
+			.v_release_cb = release_frame,
 			.v_preload_cb = preload_frame,
 			.v_seek_cb = seek_frame,
 			.a_cb = get_audio,
@@ -745,7 +763,7 @@ struct obs_source_info ffmpeg_source = {
 	.type = OBS_SOURCE_TYPE_INPUT,
 	.output_flags = OBS_SOURCE_ASYNC_VIDEO | OBS_SOURCE_AUDIO |
 			OBS_SOURCE_DO_NOT_DUPLICATE |
-			OBS_SOURCE_CONTROLLABLE_MEDIA,
+			OBS_SOURCE_CONTROLLABLE_MEDIA | OBS_SOURCE_PARALLEL_TICK,
 	.get_name = ffmpeg_source_getname,
 	.create = ffmpeg_source_create,
 	.destroy = ffmpeg_source_destroy,
@@ -0,0 +1,495 @@
+#include <inttypes.h>
+#include <util/bmem.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "replay-ring.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define warn(format, ...) \
+	blog(LOG_WARNING, "[replay ring] " format, ##__VA_ARGS__)
+
+/* written pages are given back to the system in chunks of this size, the
+ * capacity is rounded up to it */
+#define RELEASE_CHUNK (16ULL * 1024 * 1024)
+
+#define RECORD_ALIGN 8ULL
+
+enum record_kind {
+	RECORD_PACKET,
+	/* the rest of the ring up to the end is unused */
+	RECORD_WRAP,
+};
+
+struct record {
+	uint32_t kind;
+	uint32_t size;
+	int64_t pts;
+	int64_t dts;
+	int64_t dts_usec;
+	int64_t sys_dts_usec;
+	int32_t timebase_num;
+	int32_t timebase_den;
+	int32_t priority;
+	int32_t drop_priority;
+	uint32_t track_idx;
+	uint8_t type;
+	uint8_t keyframe;
+	uint8_t padding[2];
+};
+
+struct replay_ring {
+	volatile long refs;
+	pthread_mutex_t mutex;
+
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+	uint8_t *data;
+	uint64_t capacity;
+
+	/* positions only ever grow, the offset in the file is pos % capacity */
+	uint64_t head;
+	uint64_t tail;
+	uint64_t released;
+
+	/* positions of the video keyframes between tail and head */
+	struct circlebuf keyframes;
+
+	struct replay_ring_reader *reader;
+};
+
+struct replay_ring_reader {
+	struct replay_ring *ring;
+	uint64_t pos;
+	uint64_t end;
+	bool overrun;
+	DARRAY(uint8_t) buf;
+};
+
+static inline uint64_t record_size(size_t size)
+{
+	uint64_t total = sizeof(struct record) + size;
+	return (total + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+}
+
+static void ring_unmap(struct replay_ring *ring)
+{
+#ifdef _WIN32
+	if (ring->data)
+		UnmapViewOfFile(ring->data);
+	if (ring->mapping)
+		CloseHandle(ring->mapping);
+	if (ring->file != INVALID_HANDLE_VALUE)
+		CloseHandle(ring->file);
+#else
+	if (ring->data)
+		munmap(ring->data, (size_t)ring->capacity);
+	if (ring->fd != -1)
+		close(ring->fd);
+#endif
+}
+
+#ifdef _WIN32
+static bool ring_map(struct replay_ring *ring, const char *path)
+{
+	wchar_t *wpath = NULL;
+
+	os_utf8_to_wcs_ptr(path, 0, &wpath);
+	if (!wpath)
+		return false;
+
+	/* the file goes away with the last handle, even after a crash */
+	ring->file = CreateFileW(wpath, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+				 CREATE_ALWAYS,
+				 FILE_ATTRIBUTE_TEMPORARY |
+					 FILE_FLAG_DELETE_ON_CLOSE,
+				 NULL);
+	bfree(wpath);
+	if (ring->file == INVALID_HANDLE_VALUE)
+		return false;
+
+	ring->mapping = CreateFileMappingW(ring->file, NULL, PAGE_READWRITE,
+					   (DWORD)(ring->capacity >> 32),
+					   (DWORD)ring->capacity, NULL);
+	if (!ring->mapping)
+		return false;
+
+	ring->data = MapViewOfFile(ring->mapping, FILE_MAP_ALL_ACCESS, 0, 0,
+				   (SIZE_T)ring->capacity);
+	return ring->data != NULL;
+}
+#else
+static bool ring_map(struct replay_ring *ring, const char *path)
+{
+	void *data;
+
+	ring->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (ring->fd == -1)
+		return false;
+
+	/* the file only lives as long as the descriptor */
+	unlink(path);
+
+#ifdef __linux__
+	if (posix_fallocate(ring->fd, 0, (off_t)ring->capacity) != 0)
+		return false;
+#else
+	if (ftruncate(ring->fd, (off_t)ring->capacity) != 0)
+		return false;
+#endif
+
+	data = mmap(NULL, (size_t)ring->capacity, PROT_READ | PROT_WRITE,
+		    MAP_SHARED, ring->fd, 0);
+	if (data == MAP_FAILED)
+		return false;
+
+	ring->data = data;
+	return true;
+}
+#endif
+
+/* the data stays in the file, only the pages of this process are dropped */
+static void release_chunk(struct replay_ring *ring, uint64_t offset)
+{
+	void *addr = ring->data + offset;
+
+#ifdef _WIN32
+	/* unlocking pages that are not locked removes them from the working
+	 * set */
+	VirtualUnlock(addr, (SIZE_T)RELEASE_CHUNK);
+#else
+	msync(addr, (size_t)RELEASE_CHUNK, MS_ASYNC);
+#ifdef MADV_DONTNEED
+	madvise(addr, (size_t)RELEASE_CHUNK, MADV_DONTNEED);
+#endif
+#endif
+}
+
+struct replay_ring *replay_ring_create(const char *path, uint64_t capacity)
+{
+	struct replay_ring *ring = bzalloc(sizeof(struct replay_ring));
+
+	ring->refs = 1;
+	ring->capacity =
+		(capacity + RELEASE_CHUNK - 1) / RELEASE_CHUNK * RELEASE_CHUNK;
+#ifdef _WIN32
+	ring->file = INVALID_HANDLE_VALUE;
+#else
+	ring->fd = -1;
+#endif
+
+	if (pthread_mutex_init(&ring->mutex, NULL) != 0) {
+		bfree(ring);
+		return NULL;
+	}
+
+	if (!ring->capacity || !ring_map(ring, path)) {
+		warn("Failed to map %" PRIu64 " MB at '%s'",
+		     ring->capacity / (1024 * 1024), path);
+		ring_unmap(ring);
+		pthread_mutex_destroy(&ring->mutex);
+		bfree(ring);
+		return NULL;
+	}
+
+	return ring;
+}
+
+void replay_ring_release(struct replay_ring *ring)
+{
+	if (!ring || os_atomic_dec_long(&ring->refs) > 0)
+		return;
+
+	ring_unmap(ring);
+	circlebuf_free(&ring->keyframes);
+	pthread_mutex_destroy(&ring->mutex);
+	bfree(ring);
+}
+
+static inline uint64_t first_keyframe(struct replay_ring *ring)
+{
+	uint64_t pos;
+	circlebuf_peek_front(&ring->keyframes, &pos, sizeof(pos));
+	return pos;
+}
+
+/* position of the first keyframe after the tail, or the head if there is
+ * none */
+static uint64_t next_gop(struct replay_ring *ring)
+{
+	size_t count = ring->keyframes.size / sizeof(uint64_t);
+	uint64_t pos;
+
+	if (!count)
+		return ring->head;
+
+	pos = first_keyframe(ring);
+	if (pos > ring->tail)
+		return pos;
+	if (count < 2)
+		return ring->head;
+
+	return *(uint64_t *)circlebuf_data(&ring->keyframes, sizeof(pos));
+}
+
+static void drop_until(struct replay_ring *ring, uint64_t pos)
+{
+	while (ring->keyframes.size && first_keyframe(ring) < pos)
+		circlebuf_pop_front(&ring->keyframes, NULL, sizeof(uint64_t));
+
+	ring->tail = pos;
+}
+
+/* finds the record at pos, skipping the unused end of the ring */
+static const struct record *record_at(struct replay_ring *ring,
+				      uint64_t *pos)
+{
+	uint64_t offset = *pos % ring->capacity;
+	uint64_t remaining = ring->capacity - offset;
+	const struct record *rec = (const struct record *)(ring->data + offset);
+
+	if (remaining < sizeof(struct record) || rec->kind == RECORD_WRAP) {
+		*pos += remaining;
+		rec = (const struct record *)ring->data;
+	}
+
+	return rec;
+}
+
+bool replay_ring_push(struct replay_ring *ring,
+		      const struct encoder_packet *packet)
+{
+	uint64_t size = record_size(packet->size);
+	uint64_t offset, remaining, skip = 0;
+	struct record rec = {0};
+	uint64_t pos;
+
+	if (size > ring->capacity)
+		return false;
+
+	pthread_mutex_lock(&ring->mutex);
+
+	offset = ring->head % ring->capacity;
+	remaining = ring->capacity - offset;
+	if (size > remaining)
+		skip = remaining;
+
+	/* out of space, drop the oldest data even if a reader needs it */
+	while (ring->capacity - (ring->head - ring->tail) < skip + size) {
+		/* an empty ring can simply start over at the beginning */
+		if (ring->head == ring->tail) {
+			ring->head += skip;
+			ring->tail = ring->head;
+			offset = 0;
+			skip = 0;
+			break;
+		}
+
+		drop_until(ring, next_gop(ring));
+	}
+
+	pos = ring->head + skip;
+	pthread_mutex_unlock(&ring->mutex);
+
+	/* the space between head and tail is only touched by this thread */
+	if (skip) {
+		if (skip >= sizeof(rec)) {
+			rec.kind = RECORD_WRAP;
+			memcpy(ring->data + offset, &rec, sizeof(rec));
+		}
+		offset = 0;
+	}
+
+	rec.kind = RECORD_PACKET;
+	rec.size = (uint32_t)packet->size;
+	rec.pts = packet->pts;
+	rec.dts = packet->dts;
+	rec.dts_usec = packet->dts_usec;
+	rec.sys_dts_usec = packet->sys_dts_usec;
+	rec.timebase_num = packet->timebase_num;
+	rec.timebase_den = packet->timebase_den;
+	rec.priority = packet->priority;
+	rec.drop_priority = packet->drop_priority;
+	rec.track_idx = (uint32_t)packet->track_idx;
+	rec.type = (uint8_t)packet->type;
+	rec.keyframe = packet->keyframe;
+
+	memcpy(ring->data + offset, &rec, sizeof(rec));
+	memcpy(ring->data + offset + sizeof(rec), packet->data, packet->size);
+
+	pthread_mutex_lock(&ring->mutex);
+	ring->head = pos + size;
+	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
+		circlebuf_push_back(&ring->keyframes, &pos, sizeof(pos));
+	pthread_mutex_unlock(&ring->mutex);
+
+	while (ring->head - ring->released >= RELEASE_CHUNK) {
+		release_chunk(ring, ring->released % ring->capacity);
+		ring->released += RELEASE_CHUNK;
+	}
+
+	return true;
+}
+
+bool replay_ring_purge(struct replay_ring *ring)
+{
+	bool success = false;
+	uint64_t next;
+
+	pthread_mutex_lock(&ring->mutex);
+
+	next = next_gop(ring);
+	if (next == ring->tail)
+		goto unlock;
+	if (ring->reader && next > ring->reader->pos)
+		goto unlock;
+
+	drop_until(ring, next);
+	success = true;
+
+unlock:
+	pthread_mutex_unlock(&ring->mutex);
+	return success;
+}
+
+size_t replay_ring_keyframes(struct replay_ring *ring)
+{
+	size_t count;
+
+	pthread_mutex_lock(&ring->mutex);
+	count = ring->keyframes.size / sizeof(uint64_t);
+	pthread_mutex_unlock(&ring->mutex);
+	return count;
+}
+
+uint64_t replay_ring_size(struct replay_ring *ring)
+{
+	uint64_t size;
+
+	pthread_mutex_lock(&ring->mutex);
+	size = ring->head - ring->tail;
+	pthread_mutex_unlock(&ring->mutex);
+	return size;
+}
+
+bool replay_ring_empty(struct replay_ring *ring)
+{
+	return replay_ring_size(ring) == 0;
+}
+
+int64_t replay_ring_start_time(struct replay_ring *ring)
+{
+	int64_t time = 0;
+
+	pthread_mutex_lock(&ring->mutex);
+	if (ring->head != ring->tail) {
+		uint64_t pos = ring->tail;
+		time = record_at(ring, &pos)->dts_usec;
+	}
+	pthread_mutex_unlock(&ring->mutex);
+	return time;
+}
+
+struct replay_ring_reader *replay_ring_read_begin(struct replay_ring *ring)
+{
+	struct replay_ring_reader *reader = NULL;
+
+	pthread_mutex_lock(&ring->mutex);
+	if (!ring->reader) {
+		reader = bzalloc(sizeof(struct replay_ring_reader));
+		reader->ring = ring;
+		reader->pos = ring->tail;
+		reader->end = ring->head;
+		ring->reader = reader;
+		os_atomic_inc_long(&ring->refs);
+	}
+	pthread_mutex_unlock(&ring->mutex);
+
+	return reader;
+}
+
+void replay_ring_read_end(struct replay_ring_reader *reader)
+{
+	struct replay_ring *ring;
+
+	if (!reader)
+		return;
+
+	ring = reader->ring;
+
+	pthread_mutex_lock(&ring->mutex);
+	ring->reader = NULL;
+	pthread_mutex_unlock(&ring->mutex);
+
+	da_free(reader->buf);
+	bfree(reader);
+	replay_ring_release(ring);
+}
+
+bool replay_ring_read(struct replay_ring_reader *reader,
+		      struct encoder_packet *packet)
+{
+	struct replay_ring *ring = reader->ring;
+	const struct record *rec;
+	bool success = false;
+
+	pthread_mutex_lock(&ring->mutex);
+
+	if (reader->pos < ring->tail) {
+		reader->overrun = true;
+		goto unlock;
+	}
+	if (reader->pos >= reader->end)
+		goto unlock;
+
+	/* copied under the lock, the writer can only reuse the space once the
+	 * tail moved past it */
+	rec = record_at(ring, &reader->pos);
+	da_resize(reader->buf, rec->size);
+	memcpy(reader->buf.array, rec + 1, rec->size);
+
+	memset(packet, 0, sizeof(*packet));
+	packet->data = reader->buf.array;
+	packet->size = rec->size;
+	packet->pts = rec->pts;
+	packet->dts = rec->dts;
+	packet->dts_usec = rec->dts_usec;
+	packet->sys_dts_usec = rec->sys_dts_usec;
+	packet->timebase_num = rec->timebase_num;
+	packet->timebase_den = rec->timebase_den;
+	packet->priority = rec->priority;
+	packet->drop_priority = rec->drop_priority;
+	packet->track_idx = rec->track_idx;
+	packet->type = (enum obs_encoder_type)rec->type;
+	packet->keyframe = rec->keyframe;
+
+	reader->pos += record_size(rec->size);
+	success = true;
+
+unlock:
+	pthread_mutex_unlock(&ring->mutex);
+	return success;
+}
+
+bool replay_ring_read_overrun(struct replay_ring_reader *reader)
+{
+	bool overrun;
+
+	pthread_mutex_lock(&reader->ring->mutex);
+	overrun = reader->overrun;
+	pthread_mutex_unlock(&reader->ring->mutex);
+	return overrun;
+}
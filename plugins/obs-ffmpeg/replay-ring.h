@@ -0,0 +1,49 @@
+#pragma once
+
+#include <obs.h>
+
+/* Disk backed replay buffer storage.  Packets are appended to a preallocated
+ * file that is memory mapped and used as a ring, only the positions of the
+ * video keyframes are kept in memory.  Written pages are handed back to the
+ * system as the ring advances, so the resident size does not grow with the
+ * length of the buffer.
+ *
+ * One thread pushes and purges, a save runs on another thread through a
+ * reader.  Purging never passes a reader, but if the ring runs out of space
+ * the oldest data is dropped anyway and the reader fails. */
+
+struct replay_ring;
+struct replay_ring_reader;
+
+extern struct replay_ring *replay_ring_create(const char *path,
+					      uint64_t capacity);
+
+/* the ring is freed once it and all of its readers are released */
+extern void replay_ring_release(struct replay_ring *ring);
+
+extern bool replay_ring_push(struct replay_ring *ring,
+			     const struct encoder_packet *packet);
+
+/* drops the oldest group of pictures, returns false if nothing could be
+ * dropped because the ring is empty or a reader still needs the data */
+extern bool replay_ring_purge(struct replay_ring *ring);
+
+extern size_t replay_ring_keyframes(struct replay_ring *ring);
+extern uint64_t replay_ring_size(struct replay_ring *ring);
+extern bool replay_ring_empty(struct replay_ring *ring);
+
+/* dts_usec of the oldest packet */
+extern int64_t replay_ring_start_time(struct replay_ring *ring);
+
+/* captures everything currently in the ring, only one reader can be active
+ * at a time */
+extern struct replay_ring_reader *replay_ring_read_begin(
+	struct replay_ring *ring);
+extern void replay_ring_read_end(struct replay_ring_reader *reader);
+
+/* the packet data stays valid until the next call.  Returns false at the
+ * end of the capture, or if it was overwritten, see
+ * replay_ring_read_overrun. */
+extern bool replay_ring_read(struct replay_ring_reader *reader,
+			     struct encoder_packet *packet);
+extern bool replay_ring_read_overrun(struct replay_ring_reader *reader);
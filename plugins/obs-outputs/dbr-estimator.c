@@ -0,0 +1,266 @@
+#include <util/bmem.h>
+#include <util/circlebuf.h>
+#include <string.h>
+#include "dbr-estimator.h"
+
+#define MSEC_TO_USEC 1000LL
+#define MSEC_TO_NSEC 1000000ULL
+
+#define DBR_TRIGGER_USEC (200 * MSEC_TO_USEC)
+#define MIN_ESTIMATE_DURATION_MS 1000
+#define MAX_ESTIMATE_DURATION_MS 2000
+
+/* ------------------------------------------------------------------------- */
+/* send rate: throughput of the frames sent during the last two seconds      */
+
+struct send_rate {
+	struct circlebuf frames;
+	size_t data_size;
+	long bandwidth;
+};
+
+static void *send_rate_create(void)
+{
+	return bzalloc(sizeof(struct send_rate));
+}
+
+static void send_rate_destroy(void *data)
+{
+	struct send_rate *sr = data;
+
+	circlebuf_free(&sr->frames);
+	bfree(sr);
+}
+
+static void send_rate_add_sample(void *data, const struct dbr_sample *sample)
+{
+	struct send_rate *sr = data;
+	struct dbr_sample front;
+	uint64_t dur;
+
+	circlebuf_push_back(&sr->frames, sample, sizeof(*sample));
+	circlebuf_peek_front(&sr->frames, &front, sizeof(front));
+
+	sr->data_size += sample->size;
+
+	dur = (sample->send_end - front.send_beg) / MSEC_TO_NSEC;
+
+	if (dur >= MAX_ESTIMATE_DURATION_MS) {
+		sr->data_size -= front.size;
+		circlebuf_pop_front(&sr->frames, NULL, sizeof(front));
+	}
+
+	sr->bandwidth = (dur >= MIN_ESTIMATE_DURATION_MS)
+				? (long)(sr->data_size * 1000 / dur)
+				: 0;
+	sr->bandwidth *= 8;
+	sr->bandwidth /= 1000;
+}
+
+static long send_rate_get_bandwidth(void *data)
+{
+	struct send_rate *sr = data;
+	return sr->bandwidth;
+}
+
+static bool send_rate_congested(void *data, int64_t buffer_duration_usec)
+{
+	UNUSED_PARAMETER(data);
+	return buffer_duration_usec >= DBR_TRIGGER_USEC;
+}
+
+static void send_rate_reset(void *data)
+{
+	struct send_rate *sr = data;
+
+	sr->data_size = 0;
+	sr->bandwidth = 0;
+	circlebuf_pop_front(&sr->frames, NULL, sr->frames.size);
+}
+
+static const struct dbr_estimator_info send_rate_estimator = {
+	.id = "send_rate",
+	.name = "RTMPStream.DBREstimator.SendRate",
+	.create = send_rate_create,
+	.destroy = send_rate_destroy,
+	.add_sample = send_rate_add_sample,
+	.get_bandwidth = send_rate_get_bandwidth,
+	.congested = send_rate_congested,
+	.reset = send_rate_reset,
+};
+
+/* ------------------------------------------------------------------------- */
+/* delay gradient: reacts to the queue delay growing, before the send buffer */
+/* is full.  The slope of the smoothed delay over the last frames is fitted  */
+/* with least squares, a positive slope means frames are produced faster     */
+/* than the link delivers them.                                              */
+
+#define TRENDLINE_WINDOW 20
+#define TRENDLINE_SMOOTHING 0.9
+
+/* queue delay growing by 50ms per second */
+#define OVERUSE_SLOPE 0.05
+#define OVERUSE_MIN_DELAY_USEC (50 * MSEC_TO_USEC)
+#define OVERUSE_BACKOFF 0.85
+
+struct trend_point {
+	double time_ms;
+	double delay_ms;
+};
+
+struct delay_gradient {
+	struct send_rate rate;
+
+	struct trend_point points[TRENDLINE_WINDOW];
+	size_t num_points;
+	size_t next_point;
+	double smoothed_delay_ms;
+	double slope;
+	bool overusing;
+};
+
+static void *delay_gradient_create(void)
+{
+	return bzalloc(sizeof(struct delay_gradient));
+}
+
+static void delay_gradient_destroy(void *data)
+{
+	struct delay_gradient *dg = data;
+
+	circlebuf_free(&dg->rate.frames);
+	bfree(dg);
+}
+
+static double trendline_slope(const struct delay_gradient *dg)
+{
+	double avg_t = 0.0, avg_d = 0.0;
+	double num = 0.0, den = 0.0;
+
+	for (size_t i = 0; i < dg->num_points; i++) {
+		avg_t += dg->points[i].time_ms;
+		avg_d += dg->points[i].delay_ms;
+	}
+
+	avg_t /= (double)dg->num_points;
+	avg_d /= (double)dg->num_points;
+
+	for (size_t i = 0; i < dg->num_points; i++) {
+		double dt = dg->points[i].time_ms - avg_t;
+		double dd = dg->points[i].delay_ms - avg_d;
+
+		num += dt * dd;
+		den += dt * dt;
+	}
+
+	return den > 0.0 ? num / den : 0.0;
+}
+
+static void delay_gradient_add_sample(void *data,
+				      const struct dbr_sample *sample)
+{
+	struct delay_gradient *dg = data;
+	double delay_ms = (double)sample->queue_delay_usec / 1000.0;
+	struct trend_point *point;
+
+	send_rate_add_sample(&dg->rate, sample);
+
+	if (!dg->num_points)
+		dg->smoothed_delay_ms = delay_ms;
+
+	dg->smoothed_delay_ms = TRENDLINE_SMOOTHING * dg->smoothed_delay_ms +
+				(1.0 - TRENDLINE_SMOOTHING) * delay_ms;
+
+	point = &dg->points[dg->next_point];
+	point->time_ms = (double)(sample->send_end / MSEC_TO_NSEC);
+	point->delay_ms = dg->smoothed_delay_ms;
+
+	dg->next_point = (dg->next_point + 1) % TRENDLINE_WINDOW;
+	if (dg->num_points < TRENDLINE_WINDOW)
+		dg->num_points++;
+
+	if (dg->num_points == TRENDLINE_WINDOW) {
+		dg->slope = trendline_slope(dg);
+		dg->overusing = dg->slope > OVERUSE_SLOPE;
+	}
+}
+
+static long delay_gradient_get_bandwidth(void *data)
+{
+	struct delay_gradient *dg = data;
+	long bandwidth = dg->rate.bandwidth;
+
+	if (dg->overusing)
+		bandwidth = (long)((double)bandwidth * OVERUSE_BACKOFF);
+	return bandwidth;
+}
+
+static bool delay_gradient_congested(void *data, int64_t buffer_duration_usec)
+{
+	struct delay_gradient *dg = data;
+
+	if (buffer_duration_usec >= DBR_TRIGGER_USEC)
+		return true;
+
+	return dg->overusing && buffer_duration_usec >= OVERUSE_MIN_DELAY_USEC;
+}
+
+static void delay_gradient_reset(void *data)
+{
+	struct delay_gradient *dg = data;
+
+	send_rate_reset(&dg->rate);
+	dg->num_points = 0;
+	dg->next_point = 0;
+	dg->slope = 0.0;
+	dg->overusing = false;
+}
+
+static const struct dbr_estimator_info delay_gradient_estimator = {
+	.id = "delay_gradient",
+	.name = "RTMPStream.DBREstimator.DelayGradient",
+	.create = delay_gradient_create,
+	.destroy = delay_gradient_destroy,
+	.add_sample = delay_gradient_add_sample,
+	.get_bandwidth = delay_gradient_get_bandwidth,
+	.congested = delay_gradient_congested,
+	.reset = delay_gradient_reset,
+};
+
+/* ------------------------------------------------------------------------- */
+
+static const struct dbr_estimator_info *estimators[] = {
+	&send_rate_estimator,
+	&delay_gradient_estimator,
+};
+
+#define NUM_ESTIMATORS (sizeof(estimators) / sizeof(estimators[0]))
+
+const struct dbr_estimator_info *dbr_enum_estimators(size_t idx)
+{
+	return idx < NUM_ESTIMATORS ? estimators[idx] : NULL;
+}
+
+bool dbr_estimator_init(struct dbr_estimator *est, const char *id)
+{
+	const struct dbr_estimator_info *info = estimators[0];
+
+	for (size_t i = 0; id && i < NUM_ESTIMATORS; i++) {
+		if (strcmp(estimators[i]->id, id) == 0) {
+			info = estimators[i];
+			break;
+		}
+	}
+
+	est->info = info;
+	est->data = info->create();
+	return est->data != NULL;
+}
+
+void dbr_estimator_free(struct dbr_estimator *est)
+{
+	if (est->data)
+		est->info->destroy(est->data);
+	est->info = NULL;
+	est->data = NULL;
+}
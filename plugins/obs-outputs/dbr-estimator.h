@@ -0,0 +1,71 @@
+#pragma once
+
+#include <util/c99defs.h>
+
+/* Congestion estimators for the dynamic bitrate of rtmp-stream.  An
+ * estimator is fed every video frame after it has been handed to the socket
+ * and reports the bandwidth it thinks is available, plus whether the current
+ * send queue means the bitrate should be lowered now.  New estimators are
+ * added to the table in dbr-estimator.c. */
+
+struct dbr_sample {
+	uint64_t send_beg; /* ns */
+	uint64_t send_end; /* ns */
+	size_t size;
+
+	/* time between the frame being captured and it being sent */
+	int64_t queue_delay_usec;
+};
+
+struct dbr_estimator_info {
+	const char *id;
+	const char *name; /* locale key */
+
+	void *(*create)(void);
+	void (*destroy)(void *data);
+
+	void (*add_sample)(void *data, const struct dbr_sample *sample);
+
+	/* total bandwidth in kbps, or 0 if there is no estimate yet */
+	long (*get_bandwidth)(void *data);
+
+	/* buffer_duration_usec is the duration of the video waiting in the
+	 * send queue */
+	bool (*congested)(void *data, int64_t buffer_duration_usec);
+
+	/* drops all samples, called after the bitrate was lowered */
+	void (*reset)(void *data);
+};
+
+struct dbr_estimator {
+	const struct dbr_estimator_info *info;
+	void *data;
+};
+
+#define DBR_DEFAULT_ESTIMATOR "send_rate"
+
+extern const struct dbr_estimator_info *dbr_enum_estimators(size_t idx);
+extern bool dbr_estimator_init(struct dbr_estimator *est, const char *id);
+extern void dbr_estimator_free(struct dbr_estimator *est);
+
+static inline void dbr_estimator_add_sample(struct dbr_estimator *est,
+					    const struct dbr_sample *sample)
+{
+	est->info->add_sample(est->data, sample);
+}
+
+static inline long dbr_estimator_bandwidth(struct dbr_estimator *est)
+{
+	return est->info->get_bandwidth(est->data);
+}
+
+static inline bool dbr_estimator_congested(struct dbr_estimator *est,
+					   int64_t buffer_duration_usec)
+{
+	return est->info->congested(est->data, buffer_duration_usec);
+}
+
+static inline void dbr_estimator_reset(struct dbr_estimator *est)
+{
+	est->info->reset(est->data);
+}
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <util/base.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "file-writer.h"
+
+struct file_writer {
+	FILE *file;
+
+	pthread_mutex_t mutex;
+	uint8_t *buf;
+	size_t capacity;
+	size_t start;
+	size_t size;
+	uint64_t total_bytes;
+
+	os_event_t *data_event;
+	os_event_t *space_event;
+	pthread_t thread;
+	bool thread_active;
+	bool stop;
+	volatile bool error;
+};
+
+static void *writer_thread(void *data)
+{
+	struct file_writer *writer = data;
+	bool stop = false;
+
+	os_set_thread_name("file-writer: write thread");
+
+	while (!stop) {
+		os_event_wait(writer->data_event);
+
+		for (;;) {
+			const uint8_t *region;
+			size_t len;
+
+			pthread_mutex_lock(&writer->mutex);
+			region = writer->buf + writer->start;
+			len = writer->capacity - writer->start;
+			if (len > writer->size)
+				len = writer->size;
+			stop = writer->stop;
+			pthread_mutex_unlock(&writer->mutex);
+
+			if (!len) {
+				fflush(writer->file);
+				break;
+			}
+
+			/* the region stays valid: only this thread frees it */
+			if (fwrite(region, 1, len, writer->file) != len)
+				os_atomic_set_bool(&writer->error, true);
+
+			pthread_mutex_lock(&writer->mutex);
+			writer->start =
+				(writer->start + len) % writer->capacity;
+			writer->size -= len;
+			pthread_mutex_unlock(&writer->mutex);
+
+			os_event_signal(writer->space_event);
+		}
+	}
+
+	return NULL;
+}
+
+struct file_writer *file_writer_open(const char *path, size_t buffer_size)
+{
+	struct file_writer *writer = bzalloc(sizeof(struct file_writer));
+
+	pthread_mutex_init_value(&writer->mutex);
+
+	writer->file = os_fopen(path, "wb");
+	if (!writer->file)
+		goto fail;
+
+	if (pthread_mutex_init(&writer->mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&writer->data_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+	if (os_event_init(&writer->space_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
+	writer->capacity = buffer_size;
+	writer->buf = bmalloc(buffer_size);
+
+	if (pthread_create(&writer->thread, NULL, writer_thread, writer) != 0)
+		goto fail;
+	writer->thread_active = true;
+
+	return writer;
+
+fail:
+	file_writer_close(writer);
+	return NULL;
+}
+
+bool file_writer_close(struct file_writer *writer)
+{
+	bool success;
+
+	if (!writer)
+		return false;
+
+	if (writer->thread_active) {
+		pthread_mutex_lock(&writer->mutex);
+		writer->stop = true;
+		pthread_mutex_unlock(&writer->mutex);
+
+		os_event_signal(writer->data_event);
+		pthread_join(writer->thread, NULL);
+	}
+
+	success = writer->file && !os_atomic_load_bool(&writer->error);
+	if (writer->file && fclose(writer->file) != 0)
+		success = false;
+
+	os_event_destroy(writer->data_event);
+	os_event_destroy(writer->space_event);
+	pthread_mutex_destroy(&writer->mutex);
+	bfree(writer->buf);
+	bfree(writer);
+	return success;
+}
+
+bool file_writer_write(struct file_writer *writer, const void *data,
+		       size_t size)
+{
+	const uint8_t *in = data;
+
+	while (size) {
+		size_t end, len;
+
+		if (os_atomic_load_bool(&writer->error))
+			return false;
+
+		pthread_mutex_lock(&writer->mutex);
+		end = (writer->start + writer->size) % writer->capacity;
+		len = writer->capacity - writer->size;
+		if (len > writer->capacity - end)
+			len = writer->capacity - end;
+		if (len > size)
+			len = size;
+		pthread_mutex_unlock(&writer->mutex);
+
+		/* the free part of the buffer is only touched by the caller */
+		if (len) {
+			memcpy(writer->buf + end, in, len);
+
+			pthread_mutex_lock(&writer->mutex);
+			writer->size += len;
+			writer->total_bytes += len;
+			pthread_mutex_unlock(&writer->mutex);
+
+			os_event_signal(writer->data_event);
+		}
+
+		in += len;
+		size -= len;
+
+		/* buffer full, wait for the write thread to catch up */
+		if (size && !len)
+			os_event_wait(writer->space_event);
+	}
+
+	return true;
+}
+
+uint64_t file_writer_total_bytes(struct file_writer *writer)
+{
+	uint64_t total;
+
+	pthread_mutex_lock(&writer->mutex);
+	total = writer->total_bytes;
+	pthread_mutex_unlock(&writer->mutex);
+	return total;
+}
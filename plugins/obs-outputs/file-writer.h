@@ -0,0 +1,25 @@
+#pragma once
+
+#include <util/c99defs.h>
+
+/* Write-behind file output: writes are copied into a ring buffer and a
+ * dedicated thread hands them to the file, so that muxing never waits on the
+ * disk unless the buffer is full.  The file is flushed every time the buffer
+ * runs empty. */
+
+struct file_writer;
+
+extern struct file_writer *file_writer_open(const char *path,
+					    size_t buffer_size);
+
+/* waits for all pending data to be written, returns false if any write
+ * failed */
+extern bool file_writer_close(struct file_writer *writer);
+
+/* blocks while the buffer is full, returns false once a write failed.  Only
+ * one thread may write at a time. */
+extern bool file_writer_write(struct file_writer *writer, const void *data,
+			      size_t size);
+
+/* bytes handed to file_writer_write so far */
+extern uint64_t file_writer_total_bytes(struct file_writer *writer);
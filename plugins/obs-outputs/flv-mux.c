@@ -185,15 +185,12 @@ void flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 static int32_t last_time = 0;
 #endif
 
-static void flv_video(struct serializer *s, int32_t dts_offset,
-		      struct encoder_packet *packet, bool is_header)
+static void flv_video_header(struct serializer *s, int32_t dts_offset,
+			     struct encoder_packet *packet, bool is_header)
 {
 	int64_t offset = packet->pts - packet->dts;
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
 
-	if (!packet->data || !packet->size)
-		return;
-
 	s_w8(s, RTMP_PACKET_TYPE_VIDEO);
 
 #ifdef DEBUG_TIMESTAMPS
@@ -214,20 +211,13 @@ static void flv_video(struct serializer *s, int32_t dts_offset,
 	s_w8(s, packet->keyframe ? 0x17 : 0x27);
 	s_w8(s, is_header ? 0 : 1);
 	s_wb24(s, get_ms_time(packet, offset));
-	s_write(s, packet->data, packet->size);
-
-	/* write tag size (starting byte doesn't count) */
-	s_wb32(s, (uint32_t)serializer_get_pos(s) - 1);
 }
 
-static void flv_audio(struct serializer *s, int32_t dts_offset,
-		      struct encoder_packet *packet, bool is_header)
+static void flv_audio_header(struct serializer *s, int32_t dts_offset,
+			     struct encoder_packet *packet, bool is_header)
 {
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
 
-	if (!packet->data || !packet->size)
-		return;
-
 	s_w8(s, RTMP_PACKET_TYPE_AUDIO);
 
 #ifdef DEBUG_TIMESTAMPS
@@ -247,27 +237,75 @@ static void flv_audio(struct serializer *s, int32_t dts_offset,
 	/* these are the two extra bytes mentioned above */
 	s_w8(s, 0xaf);
 	s_w8(s, is_header ? 0 : 1);
-	s_write(s, packet->data, packet->size);
+}
 
-	/* write tag size (starting byte doesn't count) */
-	s_wb32(s, (uint32_t)serializer_get_pos(s) - 1);
+/* the header and trailer are both stored in buf, pointers are only taken once
+ * everything has been written because the array may have been reallocated */
+static void flv_tag_set(struct flv_tag *tag, struct array_output_data *buf,
+			size_t header_size, struct encoder_packet *packet)
+{
+	tag->header = buf->bytes.array;
+	tag->header_size = header_size;
+	tag->payload = packet->data;
+	tag->payload_size = packet->size;
+	tag->trailer = buf->bytes.array + header_size;
+	tag->trailer_size = buf->bytes.num - header_size;
 }
 
-void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
-		    uint8_t **output, size_t *size, bool is_header)
+static void flv_tag_join(const struct flv_tag *tag, uint8_t **output,
+			 size_t *size)
+{
+	uint8_t *data;
+
+	*size = flv_tag_size(tag);
+	*output = NULL;
+	if (!*size)
+		return;
+
+	*output = data = bmalloc(*size);
+	memcpy(data, tag->header, tag->header_size);
+	data += tag->header_size;
+	memcpy(data, tag->payload, tag->payload_size);
+	data += tag->payload_size;
+	memcpy(data, tag->trailer, tag->trailer_size);
+}
+
+void flv_packet_mux_tag(struct array_output_data *buf,
+			struct encoder_packet *packet, int32_t dts_offset,
+			bool is_header, struct flv_tag *tag)
 {
-	struct array_output_data data;
 	struct serializer s;
+	size_t header_size;
 
-	array_output_serializer_init(&s, &data);
+	memset(tag, 0, sizeof(*tag));
+	array_output_serializer_reset(&s, buf);
+
+	if (!packet->data || !packet->size)
+		return;
 
 	if (packet->type == OBS_ENCODER_VIDEO)
-		flv_video(&s, dts_offset, packet, is_header);
+		flv_video_header(&s, dts_offset, packet, is_header);
 	else
-		flv_audio(&s, dts_offset, packet, is_header);
+		flv_audio_header(&s, dts_offset, packet, is_header);
 
-	*output = data.bytes.array;
-	*size = data.bytes.num;
+	header_size = buf->bytes.num;
+
+	/* write tag size (starting byte doesn't count) */
+	s_wb32(&s, (uint32_t)(header_size + packet->size) - 1);
+
+	flv_tag_set(tag, buf, header_size, packet);
+}
+
+void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
+		    uint8_t **output, size_t *size, bool is_header)
+{
+	struct array_output_data data = {0};
+	struct flv_tag tag;
+
+	flv_packet_mux_tag(&data, packet, dts_offset, is_header, &tag);
+	flv_tag_join(&tag, output, size);
+
+	array_output_serializer_free(&data);
 }
 
 /* ------------------------------------------------------------------------- */
@@ -426,55 +464,17 @@ static inline void s_u29b_value(struct serializer *s, uint32_t val)
 	s_u29(s, 1 | ((val & 0xFFFFFFF) << 1));
 }
 
-static void flv_build_additional_audio(uint8_t **data, size_t *size,
-				       struct encoder_packet *packet,
-				       bool is_header, size_t index)
+/* writes everything in front of the packet data, the AMF object is closed
+ * in the trailer */
+static void flv_additional_audio_header(struct serializer *s,
+					struct array_output_data *buf,
+					int32_t dts_offset,
+					struct encoder_packet *packet,
+					bool is_header, size_t index)
 {
 	UNUSED_PARAMETER(index);
-	struct array_output_data out;
-	struct serializer s;
-
-	array_output_serializer_init(&s, &out);
-
-	s_w8(&s, AMF_STRING);
-	s_amf_conststring(&s, "additionalMedia");
-
-	s_w8(&s, AMF_OBJECT);
-	{
-		s_amf_conststring(&s, "id");
-
-		s_w8(&s, AMF_STRING);
-		s_amf_conststring(&s, "stream0");
-
-		/* ----- */
-
-		s_amf_conststring(&s, "media");
-
-		s_w8(&s, AMF_AVMPLUS);
-		s_w8(&s, AMF3_BYTE_ARRAY);
-		s_u29b_value(&s, (uint32_t)packet->size + 2);
-		s_w8(&s, 0xaf);
-		s_w8(&s, is_header ? 0 : 1);
-		s_write(&s, packet->data, packet->size);
-	}
-	s_wb24(&s, AMF_OBJECT_END);
-
-	*data = out.bytes.array;
-	*size = out.bytes.num;
-}
-
-static void flv_additional_audio(struct serializer *s, int32_t dts_offset,
-				 struct encoder_packet *packet, bool is_header,
-				 size_t index)
-{
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
-	uint8_t *data;
-	size_t size;
-
-	if (!packet->data || !packet->size)
-		return;
-
-	flv_build_additional_audio(&data, &size, packet, is_header, index);
+	uint32_t body_size;
 
 	s_w8(s, RTMP_PACKET_TYPE_INFO); //18
 
@@ -487,33 +487,80 @@ static void flv_additional_audio(struct serializer *s, int32_t dts_offset,
 	last_time = time_ms;
 #endif
 
-	s_wb24(s, (uint32_t)size);
+	/* body size is patched in below */
+	s_wb24(s, 0);
 	s_wb24(s, time_ms);
 	s_w8(s, (time_ms >> 24) & 0x7F);
 	s_wb24(s, 0);
 
-	serialize(s, data, size);
-	bfree(data);
+	s_w8(s, AMF_STRING);
+	s_amf_conststring(s, "additionalMedia");
+
+	s_w8(s, AMF_OBJECT);
+	{
+		s_amf_conststring(s, "id");
+
+		s_w8(s, AMF_STRING);
+		s_amf_conststring(s, "stream0");
+
+		/* ----- */
+
+		s_amf_conststring(s, "media");
+
+		s_w8(s, AMF_AVMPLUS);
+		s_w8(s, AMF3_BYTE_ARRAY);
+		s_u29b_value(s, (uint32_t)packet->size + 2);
+		s_w8(s, 0xaf);
+		s_w8(s, is_header ? 0 : 1);
+	}
 
-	s_wb32(s, (uint32_t)serializer_get_pos(s) - 1);
+	/* tag header + packet data + AMF_OBJECT_END */
+	body_size = (uint32_t)(buf->bytes.num - 11 + packet->size + 3);
+	buf->bytes.array[1] = (uint8_t)(body_size >> 16);
+	buf->bytes.array[2] = (uint8_t)(body_size >> 8);
+	buf->bytes.array[3] = (uint8_t)body_size;
 }
 
-void flv_additional_packet_mux(struct encoder_packet *packet,
-			       int32_t dts_offset, uint8_t **data, size_t *size,
-			       bool is_header, size_t index)
+void flv_additional_packet_mux_tag(struct array_output_data *buf,
+				   struct encoder_packet *packet,
+				   int32_t dts_offset, bool is_header,
+				   size_t index, struct flv_tag *tag)
 {
-	struct array_output_data out;
 	struct serializer s;
+	size_t header_size;
 
-	array_output_serializer_init(&s, &out);
+	memset(tag, 0, sizeof(*tag));
+	array_output_serializer_reset(&s, buf);
 
 	if (packet->type == OBS_ENCODER_VIDEO) {
 		//currently unsupported
 		bcrash("who said you could output an additional video packet?");
-	} else {
-		flv_additional_audio(&s, dts_offset, packet, is_header, index);
 	}
 
-	*data = out.bytes.array;
-	*size = out.bytes.num;
+	if (!packet->data || !packet->size)
+		return;
+
+	flv_additional_audio_header(&s, buf, dts_offset, packet, is_header,
+				    index);
+
+	header_size = buf->bytes.num;
+
+	s_wb24(&s, AMF_OBJECT_END);
+	s_wb32(&s, (uint32_t)(header_size + packet->size + 3) - 1);
+
+	flv_tag_set(tag, buf, header_size, packet);
+}
+
+void flv_additional_packet_mux(struct encoder_packet *packet,
+			       int32_t dts_offset, uint8_t **data, size_t *size,
+			       bool is_header, size_t index)
+{
+	struct array_output_data out = {0};
+	struct flv_tag tag;
+
+	flv_additional_packet_mux_tag(&out, packet, dts_offset, is_header,
+				      index, &tag);
+	flv_tag_join(&tag, data, size);
+
+	array_output_serializer_free(&out);
 }
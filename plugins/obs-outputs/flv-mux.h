@@ -18,6 +18,7 @@
 #pragma once
 
 #include <obs.h>
+#include <util/array-serializer.h>
 
 #define MILLISECOND_DEN 1000
 
@@ -26,6 +27,23 @@ static int32_t get_ms_time(struct encoder_packet *packet, int64_t val)
 	return (int32_t)(val * MILLISECOND_DEN / packet->timebase_den);
 }
 
+/* An FLV tag split into the parts that have to be written in order.  The
+ * header and trailer point into the muxer's buffer, the payload points
+ * directly at the encoder packet data.  All sizes are 0 for empty packets. */
+struct flv_tag {
+	const uint8_t *header;
+	size_t header_size;
+	const uint8_t *payload;
+	size_t payload_size;
+	const uint8_t *trailer;
+	size_t trailer_size;
+};
+
+static inline size_t flv_tag_size(const struct flv_tag *tag)
+{
+	return tag->header_size + tag->payload_size + tag->trailer_size;
+}
+
 extern void write_file_info(FILE *file, int64_t duration_ms, int64_t size);
 
 extern void flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
@@ -38,3 +56,16 @@ extern void flv_additional_packet_mux(struct encoder_packet *packet,
 				      int32_t dts_offset, uint8_t **output,
 				      size_t *size, bool is_header,
 				      size_t index);
+
+/* Same as the above, but without copying the packet data: the tag header and
+ * trailer are written to buf, which is reused across calls, and tag is only
+ * valid until the next call with the same buf or until the packet is
+ * released. */
+extern void flv_packet_mux_tag(struct array_output_data *buf,
+			       struct encoder_packet *packet,
+			       int32_t dts_offset, bool is_header,
+			       struct flv_tag *tag);
+extern void flv_additional_packet_mux_tag(struct array_output_data *buf,
+					  struct encoder_packet *packet,
+					  int32_t dts_offset, bool is_header,
+					  size_t index, struct flv_tag *tag);
@@ -45,6 +45,8 @@ struct flv_output {
 
 	bool got_first_video;
 	int32_t start_dts_offset;
+
+	struct array_output_data tag_buf;
 };
 
 static inline bool stopping(struct flv_output *stream)
@@ -70,6 +72,7 @@ static void flv_output_destroy(void *data)
 	struct flv_output *stream = data;
 
 	pthread_mutex_destroy(&stream->mutex);
+	array_output_serializer_free(&stream->tag_buf);
 	dstr_free(&stream->path);
 	bfree(stream);
 }
@@ -87,16 +90,17 @@ static void *flv_output_create(obs_data_t *settings, obs_output_t *output)
 static int write_packet(struct flv_output *stream,
 			struct encoder_packet *packet, bool is_header)
 {
-	uint8_t *data;
-	size_t size;
+	struct flv_tag tag;
 	int ret = 0;
 
 	stream->last_packet_ts = get_ms_time(packet, packet->dts);
 
-	flv_packet_mux(packet, is_header ? 0 : stream->start_dts_offset, &data,
-		       &size, is_header);
-	fwrite(data, 1, size, stream->file);
-	bfree(data);
+	flv_packet_mux_tag(&stream->tag_buf, packet,
+			   is_header ? 0 : stream->start_dts_offset, is_header,
+			   &tag);
+	fwrite(tag.header, 1, tag.header_size, stream->file);
+	fwrite(tag.payload, 1, tag.payload_size, stream->file);
+	fwrite(tag.trailer, 1, tag.trailer_size, stream->file);
 
 	return ret;
 }
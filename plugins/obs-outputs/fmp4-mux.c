@@ -0,0 +1,828 @@
+#include <util/bmem.h>
+#include <util/dstr.h>
+#include "fmp4-mux.h"
+
+#define MOVIE_TIMESCALE 1000
+
+#define TFHD_DEFAULT_BASE_IS_MOOF 0x020000
+#define TRUN_DATA_OFFSET 0x000001
+#define TRUN_SAMPLE_DURATION 0x000100
+#define TRUN_SAMPLE_SIZE 0x000200
+#define TRUN_SAMPLE_FLAGS 0x000400
+#define TRUN_SAMPLE_CTS 0x000800
+
+#define SAMPLE_FLAGS_SYNC 0x02000000
+#define SAMPLE_FLAGS_NON_SYNC 0x01010000
+
+bool fmp4_codec_from_name(const char *name, enum fmp4_codec *codec)
+{
+	if (!name)
+		return false;
+
+	if (astrcmpi(name, "h264") == 0)
+		*codec = FMP4_CODEC_H264;
+	else if (astrcmpi(name, "aac") == 0)
+		*codec = FMP4_CODEC_AAC;
+	else if (astrcmpi(name, "opus") == 0)
+		*codec = FMP4_CODEC_OPUS;
+	else if (astrcmpi(name, "pcm_s16le") == 0)
+		*codec = FMP4_CODEC_PCM_S16;
+	else if (astrcmpi(name, "pcm_s32le") == 0)
+		*codec = FMP4_CODEC_PCM_S32;
+	else if (astrcmpi(name, "pcm_f32le") == 0)
+		*codec = FMP4_CODEC_PCM_F32;
+	else
+		return false;
+
+	return true;
+}
+
+static inline bool is_video(const struct fmp4_track *track)
+{
+	return track->info.codec == FMP4_CODEC_H264;
+}
+
+void fmp4_mux_init(struct fmp4_mux *mux, uint32_t max_fragment_ms,
+		   fmp4_write_cb write, void *param)
+{
+	memset(mux, 0, sizeof(*mux));
+	mux->max_fragment_ms = max_fragment_ms;
+	mux->write = write;
+	mux->param = param;
+}
+
+void fmp4_mux_free(struct fmp4_mux *mux)
+{
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct fmp4_track *track = &mux->tracks[i];
+
+		bfree((void *)track->info.extra_data);
+		da_free(track->samples);
+		da_free(track->data);
+	}
+
+	da_free(mux->buf);
+	memset(mux, 0, sizeof(*mux));
+}
+
+int fmp4_mux_add_track(struct fmp4_mux *mux,
+		       const struct fmp4_track_info *info)
+{
+	struct fmp4_track *track;
+	size_t idx = mux->num_tracks;
+
+	if (idx == FMP4_MAX_TRACKS || mux->wrote_header || !info->timescale)
+		return -1;
+
+	track = &mux->tracks[idx];
+	track->info = *info;
+	track->id = (uint32_t)idx + 1;
+
+	if (info->extra_size)
+		track->info.extra_data =
+			bmemdup(info->extra_data, info->extra_size);
+	else
+		track->info.extra_data = NULL;
+
+	/* fragments follow the video track, or the first track */
+	if (is_video(track) && !is_video(&mux->tracks[mux->primary_track]))
+		mux->primary_track = idx;
+
+	mux->num_tracks++;
+	return (int)idx;
+}
+
+/* ------------------------------------------------------------------------- */
+/* box writing                                                               */
+
+static inline void w8(struct fmp4_mux *mux, uint8_t val)
+{
+	da_push_back(mux->buf, &val);
+}
+
+static inline void w16(struct fmp4_mux *mux, uint16_t val)
+{
+	w8(mux, (uint8_t)(val >> 8));
+	w8(mux, (uint8_t)val);
+}
+
+static inline void w32(struct fmp4_mux *mux, uint32_t val)
+{
+	w16(mux, (uint16_t)(val >> 16));
+	w16(mux, (uint16_t)val);
+}
+
+static inline void w64(struct fmp4_mux *mux, uint64_t val)
+{
+	w32(mux, (uint32_t)(val >> 32));
+	w32(mux, (uint32_t)val);
+}
+
+static inline void wdata(struct fmp4_mux *mux, const void *data, size_t size)
+{
+	da_push_back_array(mux->buf, (const uint8_t *)data, size);
+}
+
+static inline void wzero(struct fmp4_mux *mux, size_t size)
+{
+	while (size--)
+		w8(mux, 0);
+}
+
+static inline void patch32(struct fmp4_mux *mux, size_t pos, uint32_t val)
+{
+	mux->buf.array[pos] = (uint8_t)(val >> 24);
+	mux->buf.array[pos + 1] = (uint8_t)(val >> 16);
+	mux->buf.array[pos + 2] = (uint8_t)(val >> 8);
+	mux->buf.array[pos + 3] = (uint8_t)val;
+}
+
+static size_t box_begin(struct fmp4_mux *mux, const char *type)
+{
+	size_t pos = mux->buf.num;
+
+	w32(mux, 0);
+	wdata(mux, type, 4);
+	return pos;
+}
+
+static size_t full_box_begin(struct fmp4_mux *mux, const char *type,
+			     uint8_t version, uint32_t flags)
+{
+	size_t pos = box_begin(mux, type);
+
+	w32(mux, ((uint32_t)version << 24) | flags);
+	return pos;
+}
+
+static inline void box_end(struct fmp4_mux *mux, size_t pos)
+{
+	patch32(mux, pos, (uint32_t)(mux->buf.num - pos));
+}
+
+static void write_matrix(struct fmp4_mux *mux)
+{
+	static const uint32_t matrix[9] = {0x00010000, 0, 0, 0, 0x00010000,
+					   0,          0, 0, 0x40000000};
+
+	for (size_t i = 0; i < 9; i++)
+		w32(mux, matrix[i]);
+}
+
+/* ------------------------------------------------------------------------- */
+/* annex b                                                                   */
+
+static const uint8_t *find_start_code(const uint8_t *p, const uint8_t *end)
+{
+	while (p + 3 <= end) {
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+			return p;
+		p++;
+	}
+
+	return end;
+}
+
+/* calls cb for every nal unit, without the start code */
+static void for_each_nal(const uint8_t *data, size_t size,
+			 void (*cb)(void *param, const uint8_t *nal,
+				    size_t size),
+			 void *param)
+{
+	const uint8_t *end = data + size;
+	const uint8_t *p = find_start_code(data, end);
+
+	while (p < end) {
+		const uint8_t *nal = p + 3;
+		const uint8_t *next = find_start_code(nal, end);
+		const uint8_t *nal_end = next;
+
+		while (nal_end > nal && nal_end[-1] == 0)
+			nal_end--;
+		if (nal_end > nal)
+			cb(param, nal, (size_t)(nal_end - nal));
+
+		p = next;
+	}
+}
+
+struct parameter_sets {
+	const uint8_t *sps;
+	size_t sps_size;
+	const uint8_t *pps;
+	size_t pps_size;
+};
+
+static void find_parameter_sets(void *param, const uint8_t *nal, size_t size)
+{
+	struct parameter_sets *sets = param;
+	uint8_t type = nal[0] & 0x1f;
+
+	if (type == 7 && !sets->sps) {
+		sets->sps = nal;
+		sets->sps_size = size;
+	} else if (type == 8 && !sets->pps) {
+		sets->pps = nal;
+		sets->pps_size = size;
+	}
+}
+
+static void append_length_prefixed(void *param, const uint8_t *nal,
+				   size_t size)
+{
+	struct fmp4_track *track = param;
+	uint8_t len[4];
+
+	/* access unit delimiters have no place in mp4 samples */
+	if ((nal[0] & 0x1f) == 9)
+		return;
+
+	len[0] = (uint8_t)(size >> 24);
+	len[1] = (uint8_t)(size >> 16);
+	len[2] = (uint8_t)(size >> 8);
+	len[3] = (uint8_t)size;
+
+	da_push_back_array(track->data, len, 4);
+	da_push_back_array(track->data, nal, size);
+}
+
+/* ------------------------------------------------------------------------- */
+/* init segment                                                              */
+
+static void write_avcc(struct fmp4_mux *mux, const struct fmp4_track *track)
+{
+	struct parameter_sets sets = {0};
+	size_t box;
+
+	for_each_nal(track->info.extra_data, track->info.extra_size,
+		     find_parameter_sets, &sets);
+
+	box = box_begin(mux, "avcC");
+	w8(mux, 1);
+	w8(mux, sets.sps_size > 3 ? sets.sps[1] : 0x64);
+	w8(mux, sets.sps_size > 3 ? sets.sps[2] : 0);
+	w8(mux, sets.sps_size > 3 ? sets.sps[3] : 0x28);
+	w8(mux, 0xff); /* 4 byte nal lengths */
+
+	w8(mux, 0xe0 | (sets.sps ? 1 : 0));
+	if (sets.sps) {
+		w16(mux, (uint16_t)sets.sps_size);
+		wdata(mux, sets.sps, sets.sps_size);
+	}
+
+	w8(mux, sets.pps ? 1 : 0);
+	if (sets.pps) {
+		w16(mux, (uint16_t)sets.pps_size);
+		wdata(mux, sets.pps, sets.pps_size);
+	}
+
+	box_end(mux, box);
+}
+
+static void write_video_sample_entry(struct fmp4_mux *mux,
+				     const struct fmp4_track *track)
+{
+	size_t box = box_begin(mux, "avc1");
+
+	wzero(mux, 6);
+	w16(mux, 1); /* data reference index */
+	wzero(mux, 16);
+	w16(mux, (uint16_t)track->info.width);
+	w16(mux, (uint16_t)track->info.height);
+	w32(mux, 0x00480000); /* 72 dpi */
+	w32(mux, 0x00480000);
+	w32(mux, 0);
+	w16(mux, 1); /* frame count */
+	wzero(mux, 32);
+	w16(mux, 0x0018);
+	w16(mux, 0xffff);
+
+	write_avcc(mux, track);
+	box_end(mux, box);
+}
+
+static void audio_sample_entry_begin(struct fmp4_mux *mux,
+				     const struct fmp4_track *track,
+				     uint16_t sample_size)
+{
+	wzero(mux, 6);
+	w16(mux, 1); /* data reference index */
+	wzero(mux, 8);
+	w16(mux, (uint16_t)track->info.channels);
+	w16(mux, sample_size);
+	w32(mux, 0);
+	w32(mux, track->info.sample_rate < 0x10000
+			 ? track->info.sample_rate << 16
+			 : 0);
+}
+
+static inline void write_descriptor_header(struct fmp4_mux *mux, uint8_t tag,
+					   size_t size)
+{
+	/* always the four byte form, the size is patched by nobody */
+	w8(mux, tag);
+	w8(mux, (uint8_t)(0x80 | ((size >> 21) & 0x7f)));
+	w8(mux, (uint8_t)(0x80 | ((size >> 14) & 0x7f)));
+	w8(mux, (uint8_t)(0x80 | ((size >> 7) & 0x7f)));
+	w8(mux, (uint8_t)(size & 0x7f));
+}
+
+static void write_esds(struct fmp4_mux *mux, const struct fmp4_track *track)
+{
+	size_t asc_size = track->info.extra_size;
+	size_t dsi_size = 5 + asc_size;
+	size_t dcd_size = 13 + dsi_size;
+	size_t es_size = 3 + 5 + dcd_size + 5 + 1;
+	size_t box = full_box_begin(mux, "esds", 0, 0);
+
+	write_descriptor_header(mux, 0x03, es_size);
+	w16(mux, (uint16_t)track->id);
+	w8(mux, 0);
+
+	write_descriptor_header(mux, 0x04, dcd_size);
+	w8(mux, 0x40); /* mpeg-4 audio */
+	w8(mux, 0x15); /* audio stream */
+	w8(mux, 0);    /* buffer size */
+	w16(mux, 0);
+	w32(mux, 0); /* max bitrate */
+	w32(mux, 0); /* avg bitrate */
+
+	write_descriptor_header(mux, 0x05, asc_size);
+	wdata(mux, track->info.extra_data, asc_size);
+
+	write_descriptor_header(mux, 0x06, 1);
+	w8(mux, 0x02);
+
+	box_end(mux, box);
+}
+
+static inline uint16_t rl16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t rl32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	       ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* dOps carries the fields of OpusHead in big endian */
+static void write_dops(struct fmp4_mux *mux, const struct fmp4_track *track)
+{
+	const uint8_t *head = track->info.extra_data;
+	size_t head_size = track->info.extra_size;
+	uint8_t channels = (uint8_t)track->info.channels;
+	uint16_t pre_skip = 312;
+	uint32_t input_rate = track->info.sample_rate;
+	uint16_t gain = 0;
+	uint8_t family = channels > 2 ? 255 : 0;
+	size_t box;
+
+	bool has_head = head_size >= 19 && memcmp(head, "OpusHead", 8) == 0;
+	if (has_head) {
+		channels = head[9];
+		pre_skip = rl16(head + 10);
+		input_rate = rl32(head + 12);
+		gain = rl16(head + 16);
+		family = head[18];
+		if (family && head_size < 21 + (size_t)channels)
+			has_head = false;
+	}
+
+	box = box_begin(mux, "dOps");
+	w8(mux, 0);
+	w8(mux, channels);
+	w16(mux, pre_skip);
+	w32(mux, input_rate);
+	w16(mux, gain);
+	w8(mux, family);
+
+	if (family && has_head) {
+		wdata(mux, head + 19, 2 + (size_t)channels);
+	} else if (family) {
+		/* one uncoupled stream per channel */
+		w8(mux, channels);
+		w8(mux, 0);
+		for (uint8_t i = 0; i < channels; i++)
+			w8(mux, i);
+	}
+
+	box_end(mux, box);
+}
+
+static void write_pcm_sample_entry(struct fmp4_mux *mux,
+				   const struct fmp4_track *track)
+{
+	bool is_float = track->info.codec == FMP4_CODEC_PCM_F32;
+	uint8_t bits = track->info.codec == FMP4_CODEC_PCM_S16 ? 16 : 32;
+	size_t box = box_begin(mux, is_float ? "fpcm" : "ipcm");
+	size_t pcmc;
+
+	audio_sample_entry_begin(mux, track, bits);
+
+	pcmc = full_box_begin(mux, "pcmC", 0, 0);
+	w8(mux, 1); /* little endian */
+	w8(mux, bits);
+	box_end(mux, pcmc);
+
+	box_end(mux, box);
+}
+
+static void write_audio_sample_entry(struct fmp4_mux *mux,
+				     const struct fmp4_track *track)
+{
+	size_t box;
+
+	switch (track->info.codec) {
+	case FMP4_CODEC_AAC:
+		box = box_begin(mux, "mp4a");
+		audio_sample_entry_begin(mux, track, 16);
+		write_esds(mux, track);
+		box_end(mux, box);
+		break;
+	case FMP4_CODEC_OPUS:
+		box = box_begin(mux, "Opus");
+		audio_sample_entry_begin(mux, track, 16);
+		write_dops(mux, track);
+		box_end(mux, box);
+		break;
+	case FMP4_CODEC_PCM_S16:
+	case FMP4_CODEC_PCM_S32:
+	case FMP4_CODEC_PCM_F32:
+		write_pcm_sample_entry(mux, track);
+		break;
+	case FMP4_CODEC_H264:
+		break;
+	}
+}
+
+static void write_empty_tables(struct fmp4_mux *mux)
+{
+	size_t box;
+
+	box = full_box_begin(mux, "stts", 0, 0);
+	w32(mux, 0);
+	box_end(mux, box);
+
+	box = full_box_begin(mux, "stsc", 0, 0);
+	w32(mux, 0);
+	box_end(mux, box);
+
+	box = full_box_begin(mux, "stsz", 0, 0);
+	w32(mux, 0);
+	w32(mux, 0);
+	box_end(mux, box);
+
+	box = full_box_begin(mux, "stco", 0, 0);
+	w32(mux, 0);
+	box_end(mux, box);
+}
+
+static void write_trak(struct fmp4_mux *mux, const struct fmp4_track *track)
+{
+	bool video = is_video(track);
+	size_t trak, mdia, minf, dinf, dref, stbl, stsd, box;
+
+	trak = box_begin(mux, "trak");
+
+	box = full_box_begin(mux, "tkhd", 0, 0x000003);
+	w32(mux, 0); /* creation time */
+	w32(mux, 0); /* modification time */
+	w32(mux, track->id);
+	w32(mux, 0);
+	w32(mux, 0); /* duration, unknown while fragmented */
+	wzero(mux, 8);
+	w16(mux, 0);              /* layer */
+	w16(mux, video ? 0 : 1);  /* alternate group */
+	w16(mux, video ? 0 : 0x0100);
+	w16(mux, 0);
+	write_matrix(mux);
+	w32(mux, video ? track->info.width << 16 : 0);
+	w32(mux, video ? track->info.height << 16 : 0);
+	box_end(mux, box);
+
+	mdia = box_begin(mux, "mdia");
+
+	box = full_box_begin(mux, "mdhd", 0, 0);
+	w32(mux, 0);
+	w32(mux, 0);
+	w32(mux, track->info.timescale);
+	w32(mux, 0);
+	w16(mux, 0x55c4); /* und */
+	w16(mux, 0);
+	box_end(mux, box);
+
+	box = full_box_begin(mux, "hdlr", 0, 0);
+	w32(mux, 0);
+	wdata(mux, video ? "vide" : "soun", 4);
+	wzero(mux, 12);
+	wdata(mux, video ? "VideoHandler" : "SoundHandler", 13);
+	box_end(mux, box);
+
+	minf = box_begin(mux, "minf");
+
+	if (video) {
+		box = full_box_begin(mux, "vmhd", 0, 1);
+		wzero(mux, 8);
+	} else {
+		box = full_box_begin(mux, "smhd", 0, 0);
+		wzero(mux, 4);
+	}
+	box_end(mux, box);
+
+	dinf = box_begin(mux, "dinf");
+	dref = full_box_begin(mux, "dref", 0, 0);
+	w32(mux, 1);
+	box = full_box_begin(mux, "url ", 0, 1);
+	box_end(mux, box);
+	box_end(mux, dref);
+	box_end(mux, dinf);
+
+	stbl = box_begin(mux, "stbl");
+	stsd = full_box_begin(mux, "stsd", 0, 0);
+	w32(mux, 1);
+	if (video)
+		write_video_sample_entry(mux, track);
+	else
+		write_audio_sample_entry(mux, track);
+	box_end(mux, stsd);
+	write_empty_tables(mux);
+	box_end(mux, stbl);
+
+	box_end(mux, minf);
+	box_end(mux, mdia);
+	box_end(mux, trak);
+}
+
+static void write_init_segment(struct fmp4_mux *mux)
+{
+	size_t moov, mvex, box;
+
+	da_resize(mux->buf, 0);
+
+	box = box_begin(mux, "ftyp");
+	wdata(mux, "isom", 4);
+	w32(mux, 0x200);
+	wdata(mux, "isomiso6mp41", 12);
+	box_end(mux, box);
+
+	moov = box_begin(mux, "moov");
+
+	box = full_box_begin(mux, "mvhd", 0, 0);
+	w32(mux, 0);
+	w32(mux, 0);
+	w32(mux, MOVIE_TIMESCALE);
+	w32(mux, 0);
+	w32(mux, 0x00010000); /* rate */
+	w16(mux, 0x0100);     /* volume */
+	wzero(mux, 10);
+	write_matrix(mux);
+	wzero(mux, 24);
+	w32(mux, (uint32_t)mux->num_tracks + 1);
+	box_end(mux, box);
+
+	for (size_t i = 0; i < mux->num_tracks; i++)
+		write_trak(mux, &mux->tracks[i]);
+
+	mvex = box_begin(mux, "mvex");
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		box = full_box_begin(mux, "trex", 0, 0);
+		w32(mux, mux->tracks[i].id);
+		w32(mux, 1);
+		w32(mux, 0);
+		w32(mux, 0);
+		w32(mux, 0);
+		box_end(mux, box);
+	}
+	box_end(mux, mvex);
+
+	box_end(mux, moov);
+
+	mux->write(mux->param, mux->buf.array, mux->buf.num);
+	mux->wrote_header = true;
+
+	if (mux->fragment) {
+		struct fmp4_fragment fragment = {.init = true};
+		mux->fragment(mux->param, &fragment);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* fragments                                                                 */
+
+static inline uint32_t sample_duration(const struct fmp4_track *track,
+				       size_t idx, int64_t next_dts)
+{
+	const struct fmp4_sample *samples = track->samples.array;
+	int64_t next = idx + 1 < track->samples.num ? samples[idx + 1].dts
+						     : next_dts;
+
+	return next > samples[idx].dts ? (uint32_t)(next - samples[idx].dts)
+				       : track->last_duration;
+}
+
+/* next_dts is the dts of the packet that starts the next fragment on the
+ * primary track, the other tracks repeat their last sample duration */
+static inline int64_t ticks_to_usec(const struct fmp4_track *track,
+				    int64_t ticks)
+{
+	return ticks * 1000000 / track->info.timescale;
+}
+
+static void get_fragment_info(struct fmp4_mux *mux,
+			      struct fmp4_fragment *fragment, int64_t next_dts)
+{
+	struct fmp4_track *primary = &mux->tracks[mux->primary_track];
+	int64_t duration = 0;
+
+	memset(fragment, 0, sizeof(*fragment));
+	if (!primary->samples.num)
+		return;
+
+	for (size_t i = 0; i < primary->samples.num; i++)
+		duration += sample_duration(primary, i, next_dts);
+
+	fragment->independent = !is_video(primary) ||
+				primary->samples.array[0].keyframe;
+	fragment->start_usec = ticks_to_usec(
+		primary, primary->samples.array[0].dts - primary->start_dts);
+	fragment->duration_usec = ticks_to_usec(primary, duration);
+}
+
+static void write_fragment(struct fmp4_mux *mux, int64_t next_dts)
+{
+	struct fmp4_fragment fragment;
+	size_t data_offsets[FMP4_MAX_TRACKS];
+	size_t mdat_size = 8;
+	size_t moof, box;
+
+	/* before the durations below update last_duration */
+	get_fragment_info(mux, &fragment, next_dts);
+
+	da_resize(mux->buf, 0);
+
+	moof = box_begin(mux, "moof");
+
+	box = full_box_begin(mux, "mfhd", 0, 0);
+	w32(mux, ++mux->sequence);
+	box_end(mux, box);
+
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct fmp4_track *track = &mux->tracks[i];
+		bool video = is_video(track);
+		int64_t track_next = i == mux->primary_track ? next_dts : -1;
+		uint32_t flags = TRUN_DATA_OFFSET | TRUN_SAMPLE_DURATION |
+				 TRUN_SAMPLE_SIZE | TRUN_SAMPLE_FLAGS;
+		int64_t base;
+		size_t traf;
+
+		if (!track->samples.num)
+			continue;
+		if (video)
+			flags |= TRUN_SAMPLE_CTS;
+
+		traf = box_begin(mux, "traf");
+
+		box = full_box_begin(mux, "tfhd", 0,
+				     TFHD_DEFAULT_BASE_IS_MOOF);
+		w32(mux, track->id);
+		box_end(mux, box);
+
+		base = track->samples.array[0].dts - track->start_dts;
+		box = full_box_begin(mux, "tfdt", 1, 0);
+		w64(mux, base > 0 ? (uint64_t)base : 0);
+		box_end(mux, box);
+
+		box = full_box_begin(mux, "trun", 1, flags);
+		w32(mux, (uint32_t)track->samples.num);
+		data_offsets[i] = mux->buf.num;
+		w32(mux, 0);
+
+		for (size_t j = 0; j < track->samples.num; j++) {
+			struct fmp4_sample *sample = &track->samples.array[j];
+			uint32_t duration =
+				sample_duration(track, j, track_next);
+
+			track->last_duration = duration;
+
+			w32(mux, duration);
+			w32(mux, sample->size);
+			w32(mux, (!video || sample->keyframe)
+					 ? SAMPLE_FLAGS_SYNC
+					 : SAMPLE_FLAGS_NON_SYNC);
+			if (video)
+				w32(mux, (uint32_t)sample->cts_offset);
+		}
+
+		box_end(mux, box);
+		box_end(mux, traf);
+	}
+
+	box_end(mux, moof);
+
+	/* data offsets are relative to the start of the moof */
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct fmp4_track *track = &mux->tracks[i];
+
+		if (!track->samples.num)
+			continue;
+
+		patch32(mux, data_offsets[i],
+			(uint32_t)(mux->buf.num + mdat_size));
+		mdat_size += track->data.num;
+	}
+
+	w32(mux, (uint32_t)mdat_size);
+	wdata(mux, "mdat", 4);
+	mux->write(mux->param, mux->buf.array, mux->buf.num);
+
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct fmp4_track *track = &mux->tracks[i];
+
+		if (track->data.num)
+			mux->write(mux->param, track->data.array,
+				   track->data.num);
+
+		da_resize(track->samples, 0);
+		da_resize(track->data, 0);
+	}
+
+	if (mux->fragment)
+		mux->fragment(mux->param, &fragment);
+}
+
+static inline int64_t to_ticks(const struct fmp4_track *track,
+			       const struct encoder_packet *packet,
+			       int64_t val)
+{
+	int64_t num = packet->timebase_num ? packet->timebase_num : 1;
+	return val * num * (int64_t)track->info.timescale /
+	       packet->timebase_den;
+}
+
+static bool fragment_full(struct fmp4_mux *mux, size_t idx, int64_t dts,
+			  bool keyframe)
+{
+	struct fmp4_track *primary = &mux->tracks[mux->primary_track];
+	int64_t max_ticks;
+
+	if (idx != mux->primary_track || !primary->samples.num)
+		return false;
+	if (keyframe)
+		return true;
+
+	max_ticks = (int64_t)mux->max_fragment_ms * primary->info.timescale /
+		    1000;
+	return max_ticks && dts - primary->samples.array[0].dts >= max_ticks;
+}
+
+void fmp4_mux_packet(struct fmp4_mux *mux, size_t idx,
+		     const struct encoder_packet *packet)
+{
+	struct fmp4_track *track = &mux->tracks[idx];
+	struct fmp4_sample *sample;
+	int64_t dts = to_ticks(track, packet, packet->dts);
+	int64_t pts = to_ticks(track, packet, packet->pts);
+	bool keyframe = is_video(track) && packet->keyframe;
+	size_t start;
+
+	if (!mux->wrote_header)
+		write_init_segment(mux);
+
+	/* all tracks share the time origin of the first packet, whichever track
+	 * it belongs to, so that they stay in sync */
+	if (!mux->started) {
+		for (size_t i = 0; i < mux->num_tracks; i++)
+			mux->tracks[i].start_dts =
+				to_ticks(&mux->tracks[i], packet, packet->dts);
+		mux->started = true;
+	}
+
+	if (fragment_full(mux, idx, dts, keyframe))
+		write_fragment(mux, dts);
+
+	start = track->data.num;
+	if (is_video(track))
+		for_each_nal(packet->data, packet->size,
+			     append_length_prefixed, track);
+	else
+		da_push_back_array(track->data, packet->data, packet->size);
+
+	sample = da_push_back_new(track->samples);
+	sample->dts = dts;
+	sample->cts_offset = (int32_t)(pts - dts);
+	sample->size = (uint32_t)(track->data.num - start);
+	sample->keyframe = keyframe;
+}
+
+void fmp4_mux_flush(struct fmp4_mux *mux)
+{
+	bool pending = false;
+
+	for (size_t i = 0; i < mux->num_tracks; i++)
+		pending |= mux->tracks[i].samples.num > 0;
+
+	if (pending)
+		write_fragment(mux, -1);
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <obs.h>
+#include <util/darray.h>
+
+/* Fragmented MP4 muxer.  The init segment (ftyp + moov without samples) is
+ * written with the first packet, after that every fragment (moof + mdat) is
+ * written as soon as it is complete: at each video keyframe, or once the
+ * pending samples reach max_fragment_ms.  Whatever was written is a playable
+ * file, there is no index to finalize. */
+
+#define FMP4_MAX_TRACKS (1 + MAX_AUDIO_MIXES)
+
+enum fmp4_codec {
+	FMP4_CODEC_H264,
+	FMP4_CODEC_AAC,
+	FMP4_CODEC_OPUS,
+	FMP4_CODEC_PCM_S16,
+	FMP4_CODEC_PCM_S32,
+	FMP4_CODEC_PCM_F32,
+};
+
+struct fmp4_track_info {
+	enum fmp4_codec codec;
+
+	/* annex b parameter sets for h264, AudioSpecificConfig for aac,
+	 * OpusHead for opus (optional) */
+	const uint8_t *extra_data;
+	size_t extra_size;
+
+	/* ticks per second, packet timestamps are converted to it */
+	uint32_t timescale;
+
+	uint32_t width;
+	uint32_t height;
+
+	uint32_t sample_rate;
+	uint32_t channels;
+};
+
+struct fmp4_sample {
+	int64_t dts;
+	int32_t cts_offset;
+	uint32_t size;
+	bool keyframe;
+};
+
+struct fmp4_track {
+	struct fmp4_track_info info;
+	uint32_t id;
+
+	DARRAY(struct fmp4_sample) samples;
+	DARRAY(uint8_t) data;
+
+	/* first dts of the file, in this track's timescale */
+	int64_t start_dts;
+	uint32_t last_duration;
+};
+
+typedef void (*fmp4_write_cb)(void *param, const void *data, size_t size);
+
+struct fmp4_fragment {
+	/* the init segment was written, the other fields are unset */
+	bool init;
+
+	/* starts with a video keyframe, always true without video */
+	bool independent;
+
+	/* of the primary track, relative to the first packet */
+	int64_t start_usec;
+	int64_t duration_usec;
+};
+
+/* called after everything belonging to the init segment or to a fragment
+ * was passed to the write callback */
+typedef void (*fmp4_fragment_cb)(void *param,
+				 const struct fmp4_fragment *fragment);
+
+struct fmp4_mux {
+	struct fmp4_track tracks[FMP4_MAX_TRACKS];
+	size_t num_tracks;
+	size_t primary_track;
+
+	uint32_t max_fragment_ms;
+	uint32_t sequence;
+	bool wrote_header;
+	bool started;
+
+	fmp4_write_cb write;
+	fmp4_fragment_cb fragment;
+	void *param;
+
+	DARRAY(uint8_t) buf;
+};
+
+extern bool fmp4_codec_from_name(const char *name, enum fmp4_codec *codec);
+
+extern void fmp4_mux_init(struct fmp4_mux *mux, uint32_t max_fragment_ms,
+			  fmp4_write_cb write, void *param);
+extern void fmp4_mux_free(struct fmp4_mux *mux);
+
+static inline void fmp4_mux_set_fragment_callback(struct fmp4_mux *mux,
+						  fmp4_fragment_cb fragment)
+{
+	mux->fragment = fragment;
+}
+
+/* returns the track index, or -1 if the muxer is full */
+extern int fmp4_mux_add_track(struct fmp4_mux *mux,
+			      const struct fmp4_track_info *info);
+
+/* video packets are annex b */
+extern void fmp4_mux_packet(struct fmp4_mux *mux, size_t track,
+			    const struct encoder_packet *packet);
+
+/* writes the pending fragment, call before closing the file */
+extern void fmp4_mux_flush(struct fmp4_mux *mux);
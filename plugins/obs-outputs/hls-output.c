@@ -0,0 +1,375 @@
+#include <inttypes.h>
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include "fmp4-mux.h"
+#include "hls-packager.h"
+
+#define do_log(level, format, ...)                \
+	blog(level, "[hls output: '%s'] " format, \
+	     obs_output_get_name(stream->output), ##__VA_ARGS__)
+
+#define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
+
+#define OPT_PATH "path"
+#define OPT_PLAYLIST "playlist"
+#define OPT_SEGMENT_MS "segment_ms"
+#define OPT_PART_MS "part_ms"
+#define OPT_MAX_SEGMENTS "max_segments"
+
+#define VIDEO_TIMESCALE 90000
+
+struct hls_output {
+	obs_output_t *output;
+	struct dstr path;
+	volatile bool active;
+	volatile bool stopping;
+	uint64_t stop_ts;
+
+	pthread_mutex_t mutex;
+
+	struct fmp4_mux mux;
+	struct hls_packager *packager;
+	DARRAY(uint8_t) fragment;
+
+	int video_track;
+	int audio_track;
+};
+
+static inline bool stopping(struct hls_output *stream)
+{
+	return os_atomic_load_bool(&stream->stopping);
+}
+
+static inline bool active(struct hls_output *stream)
+{
+	return os_atomic_load_bool(&stream->active);
+}
+
+static const char *hls_output_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("HLSOutput");
+}
+
+static void hls_output_destroy(void *data)
+{
+	struct hls_output *stream = data;
+
+	hls_packager_destroy(stream->packager);
+	fmp4_mux_free(&stream->mux);
+	da_free(stream->fragment);
+	pthread_mutex_destroy(&stream->mutex);
+	dstr_free(&stream->path);
+	bfree(stream);
+}
+
+static void *hls_output_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct hls_output *stream = bzalloc(sizeof(struct hls_output));
+	stream->output = output;
+	pthread_mutex_init(&stream->mutex, NULL);
+
+	UNUSED_PARAMETER(settings);
+	return stream;
+}
+
+static void write_data(void *data, const void *buf, size_t size)
+{
+	struct hls_output *stream = data;
+	da_push_back_array(stream->fragment, (const uint8_t *)buf, size);
+}
+
+/* the collected data is handed over to the packager as is */
+static void fragment_done(void *data, const struct fmp4_fragment *fragment)
+{
+	struct hls_output *stream = data;
+	uint8_t *buf = stream->fragment.array;
+	size_t size = stream->fragment.num;
+
+	da_init(stream->fragment);
+
+	if (fragment->init)
+		hls_packager_add_init(stream->packager, buf, size);
+	else
+		hls_packager_add_part(stream->packager, buf, size, fragment);
+}
+
+static int add_track(struct hls_output *stream, obs_encoder_t *encoder)
+{
+	struct fmp4_track_info info = {0};
+	uint8_t *extra = NULL;
+	size_t size = 0;
+
+	if (!fmp4_codec_from_name(obs_encoder_get_codec(encoder),
+				  &info.codec)) {
+		warn("Codec '%s' is not supported",
+		     obs_encoder_get_codec(encoder));
+		return -1;
+	}
+
+	obs_encoder_get_extra_data(encoder, &extra, &size);
+	info.extra_data = extra;
+	info.extra_size = size;
+
+	if (obs_encoder_get_type(encoder) == OBS_ENCODER_VIDEO) {
+		info.timescale = VIDEO_TIMESCALE;
+		info.width = obs_encoder_get_width(encoder);
+		info.height = obs_encoder_get_height(encoder);
+	} else {
+		info.sample_rate = obs_encoder_get_sample_rate(encoder);
+		info.timescale = info.sample_rate;
+		info.channels = (uint32_t)audio_output_get_channels(
+			obs_encoder_audio(encoder));
+	}
+
+	return fmp4_mux_add_track(&stream->mux, &info);
+}
+
+static bool init_mux(struct hls_output *stream, uint32_t part_ms)
+{
+	obs_output_t *output = stream->output;
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(output);
+	obs_encoder_t *aencoder = obs_output_get_audio_encoder(output, 0);
+
+	fmp4_mux_free(&stream->mux);
+	fmp4_mux_init(&stream->mux, part_ms, write_data, stream);
+	fmp4_mux_set_fragment_callback(&stream->mux, fragment_done);
+	da_resize(stream->fragment, 0);
+
+	stream->video_track = vencoder ? add_track(stream, vencoder) : -1;
+	stream->audio_track = aencoder ? add_track(stream, aencoder) : -1;
+
+	if (vencoder && stream->video_track < 0)
+		return false;
+	if (aencoder && stream->audio_track < 0)
+		return false;
+	return stream->mux.num_tracks > 0;
+}
+
+/* segments can only start at keyframes, so the keyframe interval may not be
+ * longer than a segment.  it is set on the encoder if it is not running yet,
+ * segments are made longer if a keyframe every second is still too far
+ * apart for them. */
+static bool check_keyint(struct hls_output *stream,
+			 struct hls_packager_config *config)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t *settings;
+	int64_t keyint_sec;
+	int64_t max_sec;
+
+	config->keyint_ms = 0;
+	if (!vencoder)
+		return true;
+
+	settings = obs_encoder_get_settings(vencoder);
+	keyint_sec = obs_data_get_int(settings, "keyint_sec");
+	max_sec = config->segment_ms >= 1000 ? config->segment_ms / 1000 : 1;
+
+	if (keyint_sec <= 0 || keyint_sec > max_sec) {
+		if (obs_encoder_active(vencoder)) {
+			warn("The keyframe interval of the running video "
+			     "encoder has to be %" PRId64 " seconds or less",
+			     max_sec);
+			obs_output_set_last_error(
+				stream->output,
+				obs_module_text("HLSOutput.KeyintTooLong"));
+			obs_data_release(settings);
+			return false;
+		}
+
+		obs_data_set_int(settings, "keyint_sec", max_sec);
+		obs_encoder_update(vencoder, settings);
+		info("Keyframe interval set to %" PRId64 " seconds", max_sec);
+		keyint_sec = max_sec;
+	}
+
+	obs_data_release(settings);
+
+	config->keyint_ms = (uint32_t)keyint_sec * 1000;
+	if (config->segment_ms < config->keyint_ms) {
+		info("Segment duration raised to %" PRIu32 " ms",
+		     config->keyint_ms);
+		config->segment_ms = config->keyint_ms;
+	}
+
+	return true;
+}
+
+static bool hls_output_start(void *data)
+{
+	struct hls_output *stream = data;
+	struct hls_packager_config config;
+	struct hls_sink *sink;
+	obs_data_t *settings;
+	const char *playlist;
+
+	if (!obs_output_can_begin_data_capture(stream->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(stream->output, 0))
+		return false;
+
+	os_atomic_set_bool(&stream->stopping, false);
+
+	settings = obs_output_get_settings(stream->output);
+	dstr_copy(&stream->path, obs_data_get_string(settings, OPT_PATH));
+	playlist = obs_data_get_string(settings, OPT_PLAYLIST);
+
+	config.segment_ms =
+		(uint32_t)obs_data_get_int(settings, OPT_SEGMENT_MS);
+	config.part_ms = (uint32_t)obs_data_get_int(settings, OPT_PART_MS);
+	config.max_segments =
+		(uint32_t)obs_data_get_int(settings, OPT_MAX_SEGMENTS);
+	config.playlist_name = *playlist ? playlist : "index.m3u8";
+
+	if (!check_keyint(stream, &config) ||
+	    !init_mux(stream, config.part_ms)) {
+		obs_data_release(settings);
+		return false;
+	}
+
+	sink = hls_sink_create(stream->path.array);
+	if (!sink) {
+		warn("Unable to write to '%s'", stream->path.array);
+		obs_data_release(settings);
+		return false;
+	}
+
+	hls_packager_destroy(stream->packager);
+	stream->packager = hls_packager_create(&config, sink);
+	obs_data_release(settings);
+
+	if (!stream->packager)
+		return false;
+
+	os_atomic_set_bool(&stream->active, true);
+	obs_output_begin_data_capture(stream->output, 0);
+
+	info("Writing HLS to '%s'...", stream->path.array);
+	return true;
+}
+
+static void hls_output_stop(void *data, uint64_t ts)
+{
+	struct hls_output *stream = data;
+	stream->stop_ts = ts / 1000;
+	os_atomic_set_bool(&stream->stopping, true);
+}
+
+static void hls_output_actual_stop(struct hls_output *stream, int code)
+{
+	os_atomic_set_bool(&stream->active, false);
+
+	/* the last part, the last segment and the final playlist */
+	fmp4_mux_flush(&stream->mux);
+	hls_packager_destroy(stream->packager);
+	stream->packager = NULL;
+
+	if (code) {
+		obs_output_signal_stop(stream->output, code);
+	} else {
+		obs_output_end_data_capture(stream->output);
+	}
+
+	info("HLS output complete");
+}
+
+static void hls_output_data(void *data, struct encoder_packet *packet)
+{
+	struct hls_output *stream = data;
+	int idx;
+
+	pthread_mutex_lock(&stream->mutex);
+
+	if (!active(stream))
+		goto unlock;
+
+	if (!packet) {
+		hls_output_actual_stop(stream, OBS_OUTPUT_ENCODE_ERROR);
+		goto unlock;
+	}
+
+	if (stopping(stream)) {
+		if (packet->sys_dts_usec >= (int64_t)stream->stop_ts) {
+			hls_output_actual_stop(stream, 0);
+			goto unlock;
+		}
+	}
+
+	if (hls_packager_failed(stream->packager)) {
+		warn("Failed to write to '%s'", stream->path.array);
+		hls_output_actual_stop(stream, OBS_OUTPUT_DISCONNECTED);
+		goto unlock;
+	}
+
+	idx = packet->type == OBS_ENCODER_VIDEO ? stream->video_track
+						: stream->audio_track;
+	if (idx >= 0)
+		fmp4_mux_packet(&stream->mux, (size_t)idx, packet);
+
+unlock:
+	pthread_mutex_unlock(&stream->mutex);
+}
+
+static uint64_t hls_output_total_bytes(void *data)
+{
+	struct hls_output *stream = data;
+	uint64_t total = 0;
+
+	pthread_mutex_lock(&stream->mutex);
+	if (stream->packager)
+		total = hls_packager_total_bytes(stream->packager);
+	pthread_mutex_unlock(&stream->mutex);
+	return total;
+}
+
+static void hls_output_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_string(defaults, OPT_PLAYLIST, "index.m3u8");
+	obs_data_set_default_int(defaults, OPT_SEGMENT_MS, 1000);
+	obs_data_set_default_int(defaults, OPT_PART_MS, 200);
+	obs_data_set_default_int(defaults, OPT_MAX_SEGMENTS, 6);
+}
+
+static obs_properties_t *hls_output_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_text(props, OPT_PATH,
+				obs_module_text("HLSOutput.Path"),
+				OBS_TEXT_DEFAULT);
+	obs_properties_add_text(props, OPT_PLAYLIST,
+				obs_module_text("HLSOutput.Playlist"),
+				OBS_TEXT_DEFAULT);
+	obs_properties_add_int(props, OPT_SEGMENT_MS,
+			       obs_module_text("HLSOutput.SegmentDuration"),
+			       500, 10000, 100);
+	obs_properties_add_int(props, OPT_PART_MS,
+			       obs_module_text("HLSOutput.PartDuration"), 50,
+			       2000, 10);
+	obs_properties_add_int(props, OPT_MAX_SEGMENTS,
+			       obs_module_text("HLSOutput.MaxSegments"), 2, 100,
+			       1);
+	return props;
+}
+
+struct obs_output_info hls_output_info = {
+	.id = "llhls_output",
+	.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED,
+	.encoded_video_codecs = "h264",
+	.encoded_audio_codecs = "aac;opus",
+	.get_name = hls_output_getname,
+	.create = hls_output_create,
+	.destroy = hls_output_destroy,
+	.start = hls_output_start,
+	.stop = hls_output_stop,
+	.encoded_packet = hls_output_data,
+	.get_total_bytes = hls_output_total_bytes,
+	.get_defaults = hls_output_defaults,
+	.get_properties = hls_output_properties,
+};
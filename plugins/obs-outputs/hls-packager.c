@@ -0,0 +1,414 @@
+#include <util/base.h>
+#include <util/bmem.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "hls-packager.h"
+
+#define INIT_NAME "init.mp4"
+#define SEGMENT_NAME "seg%u.m4s"
+#define PART_NAME "seg%u.%u.m4s"
+
+/* parts are only listed for the newest segments, older segments are played
+ * as a whole */
+#define PART_SEGMENTS 3
+
+/* data waiting for the sink, past this the sink is too slow to keep up */
+#define MAX_QUEUED_BYTES (64 * 1024 * 1024)
+
+/* segment durations are summed from rounded part durations */
+#define SPLIT_TOLERANCE_USEC 1000
+
+enum job_type {
+	JOB_INIT,
+	JOB_PART,
+	JOB_FINISH,
+};
+
+struct job {
+	enum job_type type;
+	uint8_t *data;
+	size_t size;
+
+	uint32_t segment;
+	uint32_t part;
+	bool independent;
+	int64_t duration_usec;
+};
+
+struct part {
+	int64_t duration_usec;
+	bool independent;
+};
+
+struct segment {
+	uint32_t index;
+	int64_t duration_usec;
+	DARRAY(struct part) parts;
+	bool complete;
+};
+
+struct hls_packager {
+	struct hls_packager_config config;
+	struct dstr playlist_name;
+	struct hls_sink *sink;
+
+	/* the target duration may not change during the stream */
+	int64_t target_usec;
+
+	/* muxing thread */
+	uint32_t segment;
+	uint32_t part;
+	int64_t segment_usec;
+	bool started;
+
+	pthread_mutex_t mutex;
+	struct circlebuf jobs;
+	size_t queued_bytes;
+	os_sem_t *sem;
+	pthread_t thread;
+	bool thread_active;
+
+	volatile bool failed;
+	uint64_t total_bytes;
+
+	/* worker thread */
+	DARRAY(struct segment) segments;
+	DARRAY(uint8_t) segment_data;
+	struct dstr name;
+	struct dstr playlist;
+};
+
+static void put(struct hls_packager *packager, const char *name,
+		const void *data, size_t size)
+{
+	if (!hls_sink_put(packager->sink, name, data, size)) {
+		os_atomic_set_bool(&packager->failed, true);
+		return;
+	}
+
+	pthread_mutex_lock(&packager->mutex);
+	packager->total_bytes += size;
+	pthread_mutex_unlock(&packager->mutex);
+}
+
+/* a single part that is too long on its own (the odd long frame) is listed
+ * with the part target */
+static inline double clamp_duration(int64_t usec, int64_t max_usec)
+{
+	return (double)(usec > max_usec ? max_usec : usec) / 1000000.0;
+}
+
+static void write_playlist(struct hls_packager *packager, bool finished)
+{
+	struct dstr *m3u8 = &packager->playlist;
+	struct segment *segments = packager->segments.array;
+	size_t num = packager->segments.num;
+	int64_t part_usec = (int64_t)packager->config.part_ms * 1000;
+	double part_target = packager->config.part_ms / 1000.0;
+
+	if (!num)
+		return;
+
+	dstr_copy(m3u8, "#EXTM3U\n#EXT-X-VERSION:6\n");
+	dstr_catf(m3u8, "#EXT-X-TARGETDURATION:%d\n",
+		  (int)(packager->target_usec / 1000000));
+	dstr_catf(m3u8, "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=%.3f\n",
+		  part_target * 3.0);
+	dstr_catf(m3u8, "#EXT-X-PART-INF:PART-TARGET=%.3f\n", part_target);
+	dstr_catf(m3u8, "#EXT-X-MEDIA-SEQUENCE:%u\n", segments[0].index);
+	dstr_cat(m3u8, "#EXT-X-MAP:URI=\"" INIT_NAME "\"\n");
+
+	for (size_t i = 0; i < num; i++) {
+		struct segment *seg = &segments[i];
+
+		if (i + PART_SEGMENTS >= num) {
+			for (size_t j = 0; j < seg->parts.num; j++) {
+				struct part *part = &seg->parts.array[j];
+
+				dstr_catf(m3u8,
+					  "#EXT-X-PART:DURATION=%.3f,"
+					  "URI=\"" PART_NAME "\"%s\n",
+					  clamp_duration(part->duration_usec,
+							 part_usec),
+					  seg->index, (unsigned)j,
+					  part->independent
+						  ? ",INDEPENDENT=YES"
+						  : "");
+			}
+		}
+
+		if (seg->complete)
+			dstr_catf(m3u8, "#EXTINF:%.3f,\n" SEGMENT_NAME "\n",
+				  (double)seg->duration_usec / 1000000.0,
+				  seg->index);
+	}
+
+	if (finished) {
+		dstr_cat(m3u8, "#EXT-X-ENDLIST\n");
+	} else {
+		struct segment *last = &segments[num - 1];
+		dstr_catf(m3u8,
+			  "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"" PART_NAME
+			  "\"\n",
+			  last->index, (unsigned)last->parts.num);
+	}
+
+	put(packager, packager->playlist_name.array, m3u8->array, m3u8->len);
+}
+
+static void finalize_segment(struct hls_packager *packager,
+			     struct segment *seg)
+{
+	dstr_printf(&packager->name, SEGMENT_NAME, seg->index);
+	put(packager, packager->name.array, packager->segment_data.array,
+	    packager->segment_data.num);
+
+	da_resize(packager->segment_data, 0);
+	seg->complete = true;
+}
+
+static void remove_old_segments(struct hls_packager *packager)
+{
+	while (packager->segments.num > packager->config.max_segments) {
+		struct segment *seg = &packager->segments.array[0];
+
+		dstr_printf(&packager->name, SEGMENT_NAME, seg->index);
+		hls_sink_remove(packager->sink, packager->name.array);
+
+		for (size_t i = 0; i < seg->parts.num; i++) {
+			dstr_printf(&packager->name, PART_NAME, seg->index,
+				    (unsigned)i);
+			hls_sink_remove(packager->sink, packager->name.array);
+		}
+
+		da_free(seg->parts);
+		da_erase(packager->segments, 0);
+	}
+}
+
+static void handle_part(struct hls_packager *packager, struct job *job)
+{
+	struct segment *seg = da_end(packager->segments);
+	struct part part = {job->duration_usec, job->independent};
+
+	if (!seg || seg->index != job->segment) {
+		if (seg)
+			finalize_segment(packager, seg);
+
+		seg = da_push_back_new(packager->segments);
+		seg->index = job->segment;
+
+		remove_old_segments(packager);
+		seg = da_end(packager->segments);
+	}
+
+	dstr_printf(&packager->name, PART_NAME, job->segment, job->part);
+	put(packager, packager->name.array, job->data, job->size);
+
+	da_push_back_array(packager->segment_data, job->data, job->size);
+	da_push_back(seg->parts, &part);
+	seg->duration_usec += job->duration_usec;
+
+	write_playlist(packager, false);
+}
+
+static void finish(struct hls_packager *packager)
+{
+	struct segment *seg = da_end(packager->segments);
+
+	if (seg && !seg->complete)
+		finalize_segment(packager, seg);
+
+	write_playlist(packager, true);
+}
+
+static void *packager_thread(void *data)
+{
+	struct hls_packager *packager = data;
+	bool stop = false;
+
+	os_set_thread_name("hls-packager: write thread");
+
+	while (!stop) {
+		struct job job;
+
+		os_sem_wait(packager->sem);
+
+		pthread_mutex_lock(&packager->mutex);
+		circlebuf_pop_front(&packager->jobs, &job, sizeof(job));
+		packager->queued_bytes -= job.size;
+		pthread_mutex_unlock(&packager->mutex);
+
+		switch (job.type) {
+		case JOB_INIT:
+			put(packager, INIT_NAME, job.data, job.size);
+			break;
+		case JOB_PART:
+			handle_part(packager, &job);
+			break;
+		case JOB_FINISH:
+			finish(packager);
+			stop = true;
+			break;
+		}
+
+		bfree(job.data);
+	}
+
+	return NULL;
+}
+
+static void push_job(struct hls_packager *packager, const struct job *job)
+{
+	bool full;
+
+	pthread_mutex_lock(&packager->mutex);
+	full = job->type != JOB_FINISH &&
+	       packager->queued_bytes + job->size > MAX_QUEUED_BYTES;
+	if (!full) {
+		circlebuf_push_back(&packager->jobs, job, sizeof(*job));
+		packager->queued_bytes += job->size;
+	}
+	pthread_mutex_unlock(&packager->mutex);
+
+	/* a part can't be left out of a segment, the stream has failed */
+	if (full) {
+		if (!os_atomic_set_bool(&packager->failed, true))
+			blog(LOG_WARNING, "hls-packager: the sink fell more "
+					  "than %d MB behind, stopping",
+			     MAX_QUEUED_BYTES / (1024 * 1024));
+		bfree(job->data);
+		return;
+	}
+
+	os_sem_post(packager->sem);
+}
+
+struct hls_packager *
+hls_packager_create(const struct hls_packager_config *config,
+		    struct hls_sink *sink)
+{
+	struct hls_packager *packager = bzalloc(sizeof(struct hls_packager));
+
+	pthread_mutex_init_value(&packager->mutex);
+
+	packager->config = *config;
+	packager->sink = sink;
+	dstr_copy(&packager->playlist_name, config->playlist_name);
+	if (!packager->config.max_segments)
+		packager->config.max_segments = 1;
+
+	packager->target_usec =
+		(int64_t)((packager->config.segment_ms + 999) / 1000) * 1000000;
+	if (packager->target_usec < 1000000)
+		packager->target_usec = 1000000;
+
+	if (pthread_mutex_init(&packager->mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&packager->sem, 0) != 0)
+		goto fail;
+	if (pthread_create(&packager->thread, NULL, packager_thread,
+			   packager) != 0)
+		goto fail;
+
+	packager->thread_active = true;
+	return packager;
+
+fail:
+	hls_packager_destroy(packager);
+	return NULL;
+}
+
+void hls_packager_destroy(struct hls_packager *packager)
+{
+	if (!packager)
+		return;
+
+	if (packager->thread_active) {
+		struct job job = {.type = JOB_FINISH};
+
+		push_job(packager, &job);
+		pthread_join(packager->thread, NULL);
+	}
+
+	while (packager->jobs.size) {
+		struct job job;
+		circlebuf_pop_front(&packager->jobs, &job, sizeof(job));
+		bfree(job.data);
+	}
+
+	for (size_t i = 0; i < packager->segments.num; i++)
+		da_free(packager->segments.array[i].parts);
+
+	hls_sink_destroy(packager->sink);
+	circlebuf_free(&packager->jobs);
+	da_free(packager->segments);
+	da_free(packager->segment_data);
+	dstr_free(&packager->playlist_name);
+	dstr_free(&packager->name);
+	dstr_free(&packager->playlist);
+	os_sem_destroy(packager->sem);
+	pthread_mutex_destroy(&packager->mutex);
+	bfree(packager);
+}
+
+void hls_packager_add_init(struct hls_packager *packager, uint8_t *data,
+			   size_t size)
+{
+	struct job job = {.type = JOB_INIT, .data = data, .size = size};
+	push_job(packager, &job);
+}
+
+void hls_packager_add_part(struct hls_packager *packager, uint8_t *data,
+			   size_t size, const struct fmp4_fragment *fragment)
+{
+	int64_t segment_usec = (int64_t)packager->config.segment_ms * 1000;
+	int64_t keyint_usec = (int64_t)packager->config.keyint_ms * 1000;
+	struct job job = {.type = JOB_PART,
+			  .data = data,
+			  .size = size,
+			  .independent = fragment->independent,
+			  .duration_usec = fragment->duration_usec};
+	bool split = false;
+
+	/* segments only start where a player can start decoding.  the next
+	 * keyframe is at most keyint away, split here if waiting for it
+	 * could take the segment past segment_ms */
+	if (fragment->independent) {
+		int64_t next_usec = keyint_usec ? keyint_usec
+						: fragment->duration_usec;
+		split = packager->segment_usec + next_usec >
+			segment_usec + SPLIT_TOLERANCE_USEC;
+	}
+
+	if (packager->started && split) {
+		packager->segment++;
+		packager->part = 0;
+		packager->segment_usec = 0;
+	}
+
+	packager->started = true;
+	packager->segment_usec += fragment->duration_usec;
+
+	job.segment = packager->segment;
+	job.part = packager->part++;
+	push_job(packager, &job);
+}
+
+bool hls_packager_failed(struct hls_packager *packager)
+{
+	return os_atomic_load_bool(&packager->failed);
+}
+
+uint64_t hls_packager_total_bytes(struct hls_packager *packager)
+{
+	uint64_t total;
+
+	pthread_mutex_lock(&packager->mutex);
+	total = packager->total_bytes;
+	pthread_mutex_unlock(&packager->mutex);
+	return total;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "fmp4-mux.h"
+#include "hls-sink.h"
+
+/* Low latency HLS packaging of fragmented MP4.  Every fragment of the muxer
+ * becomes a partial segment, partial segments are grouped into segments that
+ * always start at a keyframe and never go past segment_ms, which sets the
+ * target duration for the whole stream.  Parts, segments and the media
+ * playlist are written to the sink on a worker thread, in order, so the
+ * muxing thread never waits for the disk or the network. */
+
+struct hls_packager_config {
+	uint32_t segment_ms;
+	uint32_t part_ms;
+
+	/* the longest keyframe interval, must not be longer than segment_ms.
+	 * 0 when every part starts with a keyframe (audio only) */
+	uint32_t keyint_ms;
+
+	/* segments kept in the playlist, older ones are removed */
+	uint32_t max_segments;
+
+	const char *playlist_name;
+};
+
+struct hls_packager;
+
+/* takes ownership of the sink */
+extern struct hls_packager *
+hls_packager_create(const struct hls_packager_config *config,
+		    struct hls_sink *sink);
+
+/* writes what is pending and ends the playlist */
+extern void hls_packager_destroy(struct hls_packager *packager);
+
+/* data is taken over and must have been allocated with bmalloc */
+extern void hls_packager_add_init(struct hls_packager *packager,
+				  uint8_t *data, size_t size);
+extern void hls_packager_add_part(struct hls_packager *packager,
+				  uint8_t *data, size_t size,
+				  const struct fmp4_fragment *fragment);
+
+/* true once the sink failed to take a file */
+extern bool hls_packager_failed(struct hls_packager *packager);
+extern uint64_t hls_packager_total_bytes(struct hls_packager *packager);
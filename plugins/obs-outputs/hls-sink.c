@@ -0,0 +1,426 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET http_socket_t;
+#define INVALID_HTTP_SOCKET INVALID_SOCKET
+#define close_socket closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+typedef int http_socket_t;
+#define INVALID_HTTP_SOCKET -1
+#define close_socket close
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <util/base.h>
+#include <util/bmem.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include "hls-sink.h"
+
+#define HTTP_TIMEOUT_MS 5000
+#define HTTP_MAX_HEADER 8192
+
+struct hls_sink *hls_sink_create_custom(const struct hls_sink_info *info,
+					void *data)
+{
+	struct hls_sink *sink = bzalloc(sizeof(struct hls_sink));
+	sink->info = info;
+	sink->data = data;
+	return sink;
+}
+
+void hls_sink_destroy(struct hls_sink *sink)
+{
+	if (!sink)
+		return;
+
+	if (sink->info->destroy)
+		sink->info->destroy(sink->data);
+	bfree(sink);
+}
+
+/* ------------------------------------------------------------------------- */
+/* local directory                                                           */
+
+struct file_sink {
+	struct dstr dir;
+	struct dstr path;
+	struct dstr temp;
+};
+
+static bool file_sink_put(void *data, const char *name, const void *buf,
+			  size_t size)
+{
+	struct file_sink *sink = data;
+	bool success;
+	FILE *file;
+
+	dstr_copy_dstr(&sink->path, &sink->dir);
+	dstr_cat(&sink->path, name);
+	dstr_copy_dstr(&sink->temp, &sink->path);
+	dstr_cat(&sink->temp, ".tmp");
+
+	file = os_fopen(sink->temp.array, "wb");
+	if (!file) {
+		blog(LOG_WARNING, "[hls sink] Failed to open '%s'",
+		     sink->temp.array);
+		return false;
+	}
+
+	success = fwrite(buf, 1, size, file) == size;
+	if (fclose(file) != 0)
+		success = false;
+
+	if (success && os_rename(sink->temp.array, sink->path.array) != 0)
+		success = false;
+
+	if (!success) {
+		blog(LOG_WARNING, "[hls sink] Failed to write '%s'",
+		     sink->path.array);
+		os_unlink(sink->temp.array);
+	}
+
+	return success;
+}
+
+static void file_sink_remove(void *data, const char *name)
+{
+	struct file_sink *sink = data;
+
+	dstr_copy_dstr(&sink->path, &sink->dir);
+	dstr_cat(&sink->path, name);
+	os_unlink(sink->path.array);
+}
+
+static void file_sink_destroy(void *data)
+{
+	struct file_sink *sink = data;
+
+	dstr_free(&sink->dir);
+	dstr_free(&sink->path);
+	dstr_free(&sink->temp);
+	bfree(sink);
+}
+
+static const struct hls_sink_info file_sink_info = {
+	.put = file_sink_put,
+	.remove = file_sink_remove,
+	.destroy = file_sink_destroy,
+};
+
+static struct hls_sink *file_sink_create(const char *dir)
+{
+	struct file_sink *sink = bzalloc(sizeof(struct file_sink));
+
+	dstr_copy(&sink->dir, dir);
+	dstr_replace(&sink->dir, "\\", "/");
+	if (dstr_end(&sink->dir) != '/')
+		dstr_cat_ch(&sink->dir, '/');
+
+	if (os_mkdirs(sink->dir.array) == MKDIR_ERROR) {
+		blog(LOG_WARNING, "[hls sink] Failed to create '%s'",
+		     sink->dir.array);
+		file_sink_destroy(sink);
+		return NULL;
+	}
+
+	return hls_sink_create_custom(&file_sink_info, sink);
+}
+
+/* ------------------------------------------------------------------------- */
+/* http put                                                                  */
+
+struct http_sink {
+	struct dstr host;
+	int port;
+	struct dstr base;
+
+	http_socket_t sock;
+	struct dstr request;
+	char response[HTTP_MAX_HEADER];
+};
+
+static void http_close(struct http_sink *sink)
+{
+	if (sink->sock != INVALID_HTTP_SOCKET) {
+		close_socket(sink->sock);
+		sink->sock = INVALID_HTTP_SOCKET;
+	}
+}
+
+static void set_timeouts(http_socket_t sock)
+{
+#ifdef _WIN32
+	DWORD timeout = HTTP_TIMEOUT_MS;
+#else
+	struct timeval timeout = {.tv_sec = HTTP_TIMEOUT_MS / 1000,
+				  .tv_usec = (HTTP_TIMEOUT_MS % 1000) * 1000};
+#endif
+	int nodelay = 1;
+
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout,
+		   sizeof(timeout));
+	setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout,
+		   sizeof(timeout));
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&nodelay,
+		   sizeof(nodelay));
+}
+
+static bool http_connect(struct http_sink *sink)
+{
+	struct addrinfo hints = {0};
+	struct addrinfo *result, *ai;
+	char port[16];
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(port, sizeof(port), "%d", sink->port);
+
+	if (getaddrinfo(sink->host.array, port, &hints, &result) != 0) {
+		blog(LOG_WARNING, "[hls sink] Failed to resolve '%s'",
+		     sink->host.array);
+		return false;
+	}
+
+	for (ai = result; ai; ai = ai->ai_next) {
+		sink->sock = socket(ai->ai_family, ai->ai_socktype,
+				    ai->ai_protocol);
+		if (sink->sock == INVALID_HTTP_SOCKET)
+			continue;
+
+		set_timeouts(sink->sock);
+		if (connect(sink->sock, ai->ai_addr, (int)ai->ai_addrlen) == 0)
+			break;
+
+		http_close(sink);
+	}
+
+	freeaddrinfo(result);
+	return sink->sock != INVALID_HTTP_SOCKET;
+}
+
+static bool send_all(http_socket_t sock, const void *data, size_t size)
+{
+	const char *p = data;
+
+	while (size) {
+		int len = size > INT_MAX ? INT_MAX : (int)size;
+		int ret = send(sock, p, len, 0);
+		if (ret <= 0)
+			return false;
+
+		p += ret;
+		size -= (size_t)ret;
+	}
+
+	return true;
+}
+
+static const char *find_header(const char *headers, const char *name)
+{
+	size_t len = strlen(name);
+	const char *line = strstr(headers, "\r\n");
+
+	while (line && line[2] != '\r') {
+		line += 2;
+		if (astrcmpi_n(line, name, len) == 0 && line[len] == ':')
+			return line + len + 1;
+		line = strstr(line, "\r\n");
+	}
+
+	return NULL;
+}
+
+/* returns the status code, or 0 if the connection failed */
+static int read_response(struct http_sink *sink)
+{
+	size_t received = 0;
+	const char *end = NULL;
+	const char *value;
+	long long body = 0;
+	int status = 0;
+
+	while (!end) {
+		int ret;
+
+		if (received == sizeof(sink->response) - 1)
+			return 0;
+
+		ret = recv(sink->sock, sink->response + received,
+			   (int)(sizeof(sink->response) - 1 - received), 0);
+		if (ret <= 0)
+			return 0;
+
+		received += (size_t)ret;
+		sink->response[received] = 0;
+		end = strstr(sink->response, "\r\n\r\n");
+	}
+
+	if (sscanf(sink->response, "HTTP/%*d.%*d %d", &status) != 1)
+		return 0;
+
+	value = find_header(sink->response, "Content-Length");
+	if (value)
+		body = strtoll(value, NULL, 10);
+
+	/* skip the body, part of it may already be in the buffer */
+	body -= (long long)(received - (size_t)(end + 4 - sink->response));
+	while (body > 0) {
+		char discard[1024];
+		int len = (int)sizeof(discard);
+		int ret;
+
+		if (body < len)
+			len = (int)body;
+
+		ret = recv(sink->sock, discard, len, 0);
+		if (ret <= 0)
+			return 0;
+		body -= ret;
+	}
+
+	value = find_header(sink->response, "Connection");
+	if (value && astrcmpi_n(value + strspn(value, " "), "close", 5) == 0)
+		http_close(sink);
+
+	return status;
+}
+
+static int http_request_once(struct http_sink *sink, const char *method,
+			     const char *name, const void *buf, size_t size)
+{
+	if (sink->sock == INVALID_HTTP_SOCKET && !http_connect(sink))
+		return 0;
+
+	dstr_printf(&sink->request,
+		    "%s %s%s HTTP/1.1\r\n"
+		    "Host: %s:%d\r\n"
+		    "Content-Length: %zu\r\n"
+		    "Connection: keep-alive\r\n"
+		    "\r\n",
+		    method, sink->base.array, name, sink->host.array,
+		    sink->port, size);
+
+	if (!send_all(sink->sock, sink->request.array, sink->request.len) ||
+	    (size && !send_all(sink->sock, buf, size))) {
+		http_close(sink);
+		return 0;
+	}
+
+	return read_response(sink);
+}
+
+static int http_request(struct http_sink *sink, const char *method,
+			const char *name, const void *buf, size_t size)
+{
+	int status = http_request_once(sink, method, name, buf, size);
+
+	/* the server may have closed an idle keep-alive connection */
+	if (!status) {
+		http_close(sink);
+		status = http_request_once(sink, method, name, buf, size);
+	}
+
+	if (!status)
+		http_close(sink);
+	return status;
+}
+
+static bool http_sink_put(void *data, const char *name, const void *buf,
+			  size_t size)
+{
+	struct http_sink *sink = data;
+	int status = http_request(sink, "PUT", name, buf, size);
+
+	if (status < 200 || status >= 300) {
+		blog(LOG_WARNING, "[hls sink] PUT %s%s failed (%d)",
+		     sink->base.array, name, status);
+		return false;
+	}
+
+	return true;
+}
+
+static void http_sink_remove(void *data, const char *name)
+{
+	struct http_sink *sink = data;
+	http_request(sink, "DELETE", name, NULL, 0);
+}
+
+static void http_sink_destroy(void *data)
+{
+	struct http_sink *sink = data;
+
+	http_close(sink);
+	dstr_free(&sink->host);
+	dstr_free(&sink->base);
+	dstr_free(&sink->request);
+	bfree(sink);
+}
+
+static const struct hls_sink_info http_sink_info = {
+	.put = http_sink_put,
+	.remove = http_sink_remove,
+	.destroy = http_sink_destroy,
+};
+
+static struct hls_sink *http_sink_create(const char *url)
+{
+	struct http_sink *sink = bzalloc(sizeof(struct http_sink));
+	const char *host = url + strlen("http://");
+	const char *path = strchr(host, '/');
+	const char *port;
+
+	sink->sock = INVALID_HTTP_SOCKET;
+	sink->port = 80;
+
+	if (!path)
+		path = host + strlen(host);
+
+	port = strchr(host, ':');
+	if (port && port < path) {
+		sink->port = atoi(port + 1);
+		dstr_ncopy(&sink->host, host, port - host);
+	} else {
+		dstr_ncopy(&sink->host, host, path - host);
+	}
+
+	dstr_copy(&sink->base, *path ? path : "/");
+	if (dstr_end(&sink->base) != '/')
+		dstr_cat_ch(&sink->base, '/');
+
+	if (dstr_is_empty(&sink->host) || sink->port <= 0 ||
+	    sink->port > 65535) {
+		blog(LOG_WARNING, "[hls sink] Invalid url '%s'", url);
+		http_sink_destroy(sink);
+		return NULL;
+	}
+
+	return hls_sink_create_custom(&http_sink_info, sink);
+}
+
+struct hls_sink *hls_sink_create(const char *path)
+{
+	if (!path || !*path)
+		return NULL;
+
+	if (astrcmpi_n(path, "http://", 7) == 0)
+		return http_sink_create(path);
+
+	if (astrcmpi_n(path, "https://", 8) == 0) {
+		blog(LOG_WARNING, "[hls sink] https is not supported");
+		return NULL;
+	}
+
+	return file_sink_create(path);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <util/c99defs.h>
+
+/* Destination of the files written by the HLS packager.  The built-in sinks
+ * write to a local directory or upload with HTTP PUT/DELETE to a plain
+ * http:// base url, anything else can provide its own callbacks. */
+
+struct hls_sink_info {
+	/* must replace the file atomically, readers never see a partial
+	 * playlist */
+	bool (*put)(void *data, const char *name, const void *buf,
+		    size_t size);
+	void (*remove)(void *data, const char *name);
+	void (*destroy)(void *data);
+};
+
+struct hls_sink {
+	const struct hls_sink_info *info;
+	void *data;
+};
+
+/* picks the sink from the path, NULL if the path is not usable */
+extern struct hls_sink *hls_sink_create(const char *path);
+extern struct hls_sink *hls_sink_create_custom(const struct hls_sink_info *info,
+					       void *data);
+extern void hls_sink_destroy(struct hls_sink *sink);
+
+static inline bool hls_sink_put(struct hls_sink *sink, const char *name,
+				const void *buf, size_t size)
+{
+	return sink->info->put(sink->data, name, buf, size);
+}
+
+static inline void hls_sink_remove(struct hls_sink *sink, const char *name)
+{
+	if (sink->info->remove)
+		sink->info->remove(sink->data, name);
+}
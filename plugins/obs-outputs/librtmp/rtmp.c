@@ -4050,22 +4050,12 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
     return wrote;
 }
 
-int
-RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+static int
+AllocChannelsOut(RTMP *r, int channel)
 {
-    const RTMPPacket *prevPacket;
-    uint32_t last = 0;
-    int nSize;
-    int hSize, cSize;
-    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
-    uint32_t t;
-    char *buffer, *tbuf = NULL, *toff = NULL;
-    int nChunkSize;
-    int tlen;
-
-    if (packet->m_nChannel >= r->m_channelsAllocatedOut)
+    if (channel >= r->m_channelsAllocatedOut)
     {
-        int n = packet->m_nChannel + 10;
+        int n = channel + 10;
         RTMPPacket **packets = realloc(r->m_vecChannelsOut, sizeof(RTMPPacket*) * n);
         if (!packets)
         {
@@ -4078,6 +4068,24 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
         memset(r->m_vecChannelsOut + r->m_channelsAllocatedOut, 0, sizeof(RTMPPacket*) * (n - r->m_channelsAllocatedOut));
         r->m_channelsAllocatedOut = n;
     }
+    return TRUE;
+}
+
+int
+RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+{
+    const RTMPPacket *prevPacket;
+    uint32_t last = 0;
+    int nSize;
+    int hSize, cSize;
+    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    uint32_t t;
+    char *buffer, *tbuf = NULL, *toff = NULL;
+    int nChunkSize;
+    int tlen;
+
+    if (!AllocChannelsOut(r, packet->m_nChannel))
+        return FALSE;
 
     prevPacket = r->m_vecChannelsOut[packet->m_nChannel];
     if (prevPacket && packet->m_headerType != RTMP_PACKET_SIZE_LARGE)
@@ -4267,6 +4275,331 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     return TRUE;
 }
 
+#define SEND_CHUNK_BUF_SIZE (RTMP_MAX_HEADER_SIZE + 4096)
+#define SEND_MAX_SEGS 64
+
+/* Whether WriteV can hand its buffers to the socket as they are.  TLS, RC4
+ * and HTTP all need the data in one piece, as does a custom send function
+ * without a vectored variant. */
+static int
+CanWriteV(RTMP *r)
+{
+#if defined(RTMP_NETSTACK_DUMP)
+    return FALSE;
+#endif
+    if (r->Link.protocol & RTMP_FEATURE_HTTP)
+        return FALSE;
+#ifdef CRYPTO
+    if (r->Link.rc4keyOut)
+        return FALSE;
+#endif
+    if (r->m_bCustomSend)
+        return r->m_customSendVFunc != NULL;
+#if defined(CRYPTO) && !defined(NO_SSL)
+    if (r->m_sb.sb_ssl)
+        return FALSE;
+#endif
+    return TRUE;
+}
+
+static int
+SockBuf_SendV(RTMPSockBuf *sb, const AVal *segs, int count)
+{
+#ifdef _WIN32
+    WSABUF bufs[SEND_MAX_SEGS];
+    DWORD sent = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        bufs[i].buf = segs[i].av_val;
+        bufs[i].len = (ULONG)segs[i].av_len;
+    }
+
+    if (WSASend(sb->sb_socket, bufs, (DWORD)count, &sent, 0, NULL, NULL) != 0)
+        return -1;
+    return (int)sent;
+#else
+    struct iovec iov[SEND_MAX_SEGS];
+    struct msghdr msg;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        iov[i].iov_base = segs[i].av_val;
+        iov[i].iov_len = (size_t)segs[i].av_len;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    return (int)sendmsg(sb->sb_socket, &msg, MSG_NOSIGNAL);
+#endif
+}
+
+/* Same as WriteN for a list of up to SEND_MAX_SEGS buffers.  When the
+ * connection allows it they go out in one gathered send without being
+ * copied, otherwise they are joined first.  The list itself is used up. */
+static int
+WriteV(RTMP *r, AVal *segs, int count)
+{
+    if (!CanWriteV(r))
+    {
+        char buf[SEND_CHUNK_BUF_SIZE], *joined = buf, *ptr;
+        int size = 0, ret, i;
+
+        for (i = 0; i < count; i++)
+            size += segs[i].av_len;
+
+        if (size > (int)sizeof(buf))
+        {
+            joined = malloc(size);
+            if (!joined)
+                return FALSE;
+        }
+
+        ptr = joined;
+        for (i = 0; i < count; i++)
+        {
+            memcpy(ptr, segs[i].av_val, segs[i].av_len);
+            ptr += segs[i].av_len;
+        }
+
+        ret = WriteN(r, joined, size);
+        if (joined != buf)
+            free(joined);
+        return ret;
+    }
+
+    while (count > 0)
+    {
+        int nBytes;
+
+        if (r->m_bCustomSend)
+            nBytes = r->m_customSendVFunc(&r->m_sb, segs, count,
+                                          r->m_customSendParam);
+        else
+            nBytes = SockBuf_SendV(&r->m_sb, segs, count);
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d (%d buffers)", __FUNCTION__,
+                     sockerr, count);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            r->last_error_code = sockerr;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            break;
+
+        /* drop what was sent, a partly sent buffer continues next time */
+        while (count > 0 && nBytes >= segs->av_len)
+        {
+            nBytes -= segs->av_len;
+            segs++;
+            count--;
+        }
+        if (count > 0)
+        {
+            segs->av_val += nBytes;
+            segs->av_len -= nBytes;
+        }
+    }
+
+    return count == 0;
+}
+
+/* Same as RTMP_SendPacket, but the body is gathered from a list of buffers
+ * starting at the given offset instead of a single allocation with room for
+ * the chunk headers in front of it.  The chunk headers and slices of the
+ * body are interleaved in a buffer list for WriteV, so the body buffers are
+ * neither modified nor copied on a plain socket, which also gets several
+ * chunks per send.  Everywhere else each chunk is written on its own, so a
+ * TLS connection gets one record per chunk. */
+
+static int
+SendPacketV(RTMP *r, RTMPPacket *packet, const AVal *parts, int count,
+            int offset)
+{
+    const RTMPPacket *prevPacket;
+    uint32_t last = 0;
+    int nSize;
+    int hSize, cSize;
+    char hbuf[RTMP_MAX_HEADER_SIZE], *hptr, *hend = hbuf + sizeof(hbuf), c;
+    char cbuf[3], *hdr = hbuf;
+    AVal segs[SEND_MAX_SEGS];
+    int nSegs = 0;
+    int batch;
+    uint32_t t;
+    int nChunkSize;
+    int part = 0;
+
+    /* a chunk takes its header and at most one slice of every part */
+    if (count + 1 > SEND_MAX_SEGS)
+        return FALSE;
+    if (!AllocChannelsOut(r, packet->m_nChannel))
+        return FALSE;
+
+    prevPacket = r->m_vecChannelsOut[packet->m_nChannel];
+    if (prevPacket && packet->m_headerType != RTMP_PACKET_SIZE_LARGE)
+    {
+        /* compress a bit by using the prev packet's attributes */
+        if (prevPacket->m_nBodySize == packet->m_nBodySize
+                && prevPacket->m_packetType == packet->m_packetType
+                && packet->m_headerType == RTMP_PACKET_SIZE_MEDIUM)
+            packet->m_headerType = RTMP_PACKET_SIZE_SMALL;
+
+        if (prevPacket->m_nTimeStamp == packet->m_nTimeStamp
+                && packet->m_headerType == RTMP_PACKET_SIZE_SMALL)
+            packet->m_headerType = RTMP_PACKET_SIZE_MINIMUM;
+        last = prevPacket->m_nTimeStamp;
+    }
+
+    if (packet->m_headerType > 3)	/* sanity */
+    {
+        RTMP_Log(RTMP_LOGERROR, "sanity failed!! trying to send header of type: 0x%02x.",
+                 (unsigned char)packet->m_headerType);
+        return FALSE;
+    }
+
+    nSize = packetSize[packet->m_headerType];
+    cSize = 0;
+    t = packet->m_nTimeStamp - last;
+
+    if (packet->m_nChannel > 319)
+        cSize = 2;
+    else if (packet->m_nChannel > 63)
+        cSize = 1;
+
+    hptr = hbuf;
+    c = packet->m_headerType << 6;
+    switch (cSize)
+    {
+    case 0:
+        c |= packet->m_nChannel;
+        break;
+    case 1:
+        break;
+    case 2:
+        c |= 1;
+        break;
+    }
+    *hptr++ = c;
+    if (cSize)
+    {
+        int tmp = packet->m_nChannel - 64;
+        *hptr++ = tmp & 0xff;
+        if (cSize == 2)
+            *hptr++ = tmp >> 8;
+    }
+
+    if (nSize > 1)
+    {
+        hptr = AMF_EncodeInt24(hptr, hend, t > 0xffffff ? 0xffffff : t);
+    }
+
+    if (nSize > 4)
+    {
+        hptr = AMF_EncodeInt24(hptr, hend, packet->m_nBodySize);
+        *hptr++ = packet->m_packetType;
+    }
+
+    if (nSize > 8)
+        hptr += EncodeInt32LE(hptr, packet->m_nInfoField2);
+
+    if (nSize > 1 && t >= 0xffffff)
+        hptr = AMF_EncodeInt32(hptr, hend, t);
+
+    hSize = (int)(hptr - hbuf);
+    nSize = packet->m_nBodySize;
+    nChunkSize = r->m_outChunkSize;
+    /* a custom send function still gets a single chunk per call */
+    batch = CanWriteV(r) && !r->m_bCustomSend;
+
+    RTMP_Log(RTMP_LOGDEBUG2, "%s: fd=%d, size=%d", __FUNCTION__, (int)r->m_sb.sb_socket,
+             nSize);
+    while (nSize + hSize)
+    {
+        int chunk = nSize < nChunkSize ? nSize : nChunkSize;
+
+        if (nSegs + count + 1 > SEND_MAX_SEGS)
+        {
+            if (!WriteV(r, segs, nSegs))
+                return FALSE;
+            nSegs = 0;
+        }
+
+        RTMP_LogHexString(RTMP_LOGDEBUG2, (uint8_t *)hdr, hSize);
+        segs[nSegs].av_val = hdr;
+        segs[nSegs].av_len = hSize;
+        nSegs++;
+
+        nSize -= chunk;
+        while (chunk)
+        {
+            int n;
+
+            while (part < count && offset >= parts[part].av_len)
+            {
+                offset -= parts[part].av_len;
+                part++;
+            }
+            if (part == count)
+                return FALSE;
+
+            n = parts[part].av_len - offset;
+            if (n > chunk)
+                n = chunk;
+            segs[nSegs].av_val = parts[part].av_val + offset;
+            segs[nSegs].av_len = n;
+            nSegs++;
+
+            offset += n;
+            chunk -= n;
+        }
+
+        if (!batch || !nSize)
+        {
+            if (!WriteV(r, segs, nSegs))
+                return FALSE;
+            nSegs = 0;
+        }
+        hSize = 0;
+
+        if (nSize > 0)
+        {
+            /* hbuf may still be queued, so continuations get their own */
+            hdr = cbuf;
+            cbuf[0] = (0xc0 | c);
+            hSize = 1;
+            if (cSize)
+            {
+                int tmp = packet->m_nChannel - 64;
+                cbuf[1] = tmp & 0xff;
+                if (cSize == 2)
+                    cbuf[2] = tmp >> 8;
+                hSize += cSize;
+            }
+        }
+    }
+
+    packet->m_body = NULL;
+    if (!r->m_vecChannelsOut[packet->m_nChannel])
+        r->m_vecChannelsOut[packet->m_nChannel] = malloc(sizeof(RTMPPacket));
+    memcpy(r->m_vecChannelsOut[packet->m_nChannel], packet, sizeof(RTMPPacket));
+    return TRUE;
+}
+
+#undef SEND_MAX_SEGS
+#undef SEND_CHUNK_BUF_SIZE
+
 void
 RTMP_Close(RTMP *r)
 {
@@ -5356,3 +5689,77 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
     }
     return size+s2;
 }
+
+/* Writes one complete FLV tag that is split across several buffers, for
+ * example a small tag header followed by the encoder's payload.  The body is
+ * chunked straight out of the buffers instead of being copied into a packet
+ * allocation first.  Must not be mixed with a partially written RTMP_Write
+ * tag. */
+int
+RTMP_WriteV(RTMP *r, const AVal *parts, int count, int streamIdx)
+{
+    RTMPPacket pkt;
+    const char *buf;
+    int size = 0, i;
+
+    for (i = 0; i < count; i++)
+        size += parts[i].av_len;
+
+    if (!size)
+        return 0;
+    if (parts[0].av_len < 11)
+    {
+        /* FLV tag header must be in the first buffer */
+        return 0;
+    }
+
+    if (r->Link.protocol & RTMP_FEATURE_HTTP)
+    {
+        /* all chunks go out in one HTTP request, join the tag */
+        char *joined = malloc(size), *ptr = joined;
+        int ret;
+
+        if (!joined)
+            return -1;
+        for (i = 0; i < count; i++)
+        {
+            memcpy(ptr, parts[i].av_val, parts[i].av_len);
+            ptr += parts[i].av_len;
+        }
+
+        ret = RTMP_Write(r, joined, size, streamIdx);
+        free(joined);
+        return ret;
+    }
+
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.m_nChannel = 0x04;	/* source channel */
+    pkt.m_nInfoField2 = r->Link.streams[streamIdx].id;
+
+    buf = parts[0].av_val;
+    pkt.m_packetType = *buf++;
+    pkt.m_nBodySize = AMF_DecodeInt24(buf);
+    buf += 3;
+    pkt.m_nTimeStamp = AMF_DecodeInt24(buf);
+    buf += 3;
+    pkt.m_nTimeStamp |= *buf++ << 24;
+
+    if ((int)pkt.m_nBodySize > size - 11)
+        return 0;
+
+    if (((pkt.m_packetType == RTMP_PACKET_TYPE_AUDIO
+            || pkt.m_packetType == RTMP_PACKET_TYPE_VIDEO) &&
+            !pkt.m_nTimeStamp) || pkt.m_packetType == RTMP_PACKET_TYPE_INFO)
+    {
+        pkt.m_headerType = RTMP_PACKET_SIZE_LARGE;
+    }
+    else
+    {
+        pkt.m_headerType = RTMP_PACKET_SIZE_MEDIUM;
+    }
+
+    if (!SendPacketV(r, &pkt, parts, count, 11))
+        return -1;
+
+    return size;
+}
@@ -393,6 +393,8 @@ extern "C"
     } RTMP_BINDINFO;
 
     typedef int (*CUSTOMSEND)(RTMPSockBuf*, const char *, int, void*);
+    /* optional, takes a list of buffers in place of a joined copy */
+    typedef int (*CUSTOMSENDV)(RTMPSockBuf*, const AVal *, int, void*);
 
     typedef struct RTMP
     {
@@ -418,6 +420,7 @@ extern "C"
         uint8_t m_bCustomSend;
         void*   m_customSendParam;
         CUSTOMSEND m_customSendFunc;
+        CUSTOMSENDV m_customSendVFunc;
 
         RTMP_BINDINFO m_bindIP;
 
@@ -538,6 +541,7 @@ extern "C"
     void RTMP_DropRequest(RTMP *r, int i, int freeit);
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx);
+    int RTMP_WriteV(RTMP *r, const AVal *parts, int count, int streamIdx);
 
 #ifdef USE_HASHSWF
     /* hashswf.c */
@@ -0,0 +1,447 @@
+#include <util/bmem.h>
+#include <util/dstr.h>
+#include "mpegts-mux.h"
+
+#define PAT_PID 0x0000
+#define PMT_PID 0x1000
+#define FIRST_STREAM_PID 0x0100
+#define PROGRAM_NUMBER 1
+
+#define STREAM_TYPE_AAC 0x0f
+#define STREAM_TYPE_H264 0x1b
+#define STREAM_TYPE_HEVC 0x24
+#define STREAM_TYPE_PRIVATE 0x06
+
+/* timestamps are shifted so that b-frame pts/dts of the first frames, and
+ * the pcr written slightly ahead of the dts, never go negative */
+#define TS_OFFSET 90000
+#define PCR_DELAY 9000
+#define PSI_INTERVAL 45000
+
+#define MAX_TS 0x1FFFFFFFFLL
+
+static const uint8_t h264_aud[] = {0, 0, 0, 1, 0x09, 0xf0};
+static const uint8_t hevc_aud[] = {0, 0, 0, 1, 0x46, 0x01, 0x50};
+
+bool mpegts_codec_from_name(const char *name, enum mpegts_codec *codec)
+{
+	if (!name)
+		return false;
+
+	if (astrcmpi(name, "h264") == 0)
+		*codec = MPEGTS_CODEC_H264;
+	else if (astrcmpi(name, "hevc") == 0)
+		*codec = MPEGTS_CODEC_HEVC;
+	else if (astrcmpi(name, "aac") == 0)
+		*codec = MPEGTS_CODEC_AAC;
+	else if (astrcmpi(name, "opus") == 0)
+		*codec = MPEGTS_CODEC_OPUS;
+	else
+		return false;
+
+	return true;
+}
+
+static inline bool is_video(enum mpegts_codec codec)
+{
+	return codec == MPEGTS_CODEC_H264 || codec == MPEGTS_CODEC_HEVC;
+}
+
+void mpegts_mux_init(struct mpegts_mux *mux)
+{
+	memset(mux, 0, sizeof(*mux));
+}
+
+void mpegts_mux_free(struct mpegts_mux *mux)
+{
+	for (size_t i = 0; i < mux->num_streams; i++)
+		bfree(mux->streams[i].extra_data);
+	da_free(mux->pes);
+	memset(mux, 0, sizeof(*mux));
+}
+
+int mpegts_mux_add_stream(struct mpegts_mux *mux, enum mpegts_codec codec,
+			  const uint8_t *extra_data, size_t extra_size,
+			  int channels)
+{
+	struct mpegts_stream *stream;
+	size_t num_audio = 0;
+	size_t idx = mux->num_streams;
+
+	if (idx == MPEGTS_MAX_STREAMS)
+		return -1;
+
+	for (size_t i = 0; i < idx; i++) {
+		if (!is_video(mux->streams[i].codec))
+			num_audio++;
+	}
+
+	stream = &mux->streams[idx];
+	stream->codec = codec;
+	stream->pid = (uint16_t)(FIRST_STREAM_PID + idx);
+	stream->channels = channels;
+
+	if (is_video(codec))
+		stream->stream_id = 0xe0;
+	else if (codec == MPEGTS_CODEC_OPUS)
+		stream->stream_id = 0xbd;
+	else
+		stream->stream_id = (uint8_t)(0xc0 + num_audio);
+
+	if (extra_size) {
+		stream->extra_data = bmemdup(extra_data, extra_size);
+		stream->extra_size = extra_size;
+	}
+
+	/* pcr goes on the video stream, or the first stream without video */
+	if (idx == 0)
+		mux->pcr_stream = 0;
+	else if (is_video(codec) &&
+		 !is_video(mux->streams[mux->pcr_stream].codec))
+		mux->pcr_stream = idx;
+
+	mux->num_streams++;
+	return (int)idx;
+}
+
+/* ------------------------------------------------------------------------- */
+/* PSI                                                                       */
+
+static uint32_t crc32_mpeg(const uint8_t *data, size_t size)
+{
+	uint32_t crc = 0xffffffff;
+
+	for (size_t i = 0; i < size; i++) {
+		crc ^= (uint32_t)data[i] << 24;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7
+						 : (crc << 1);
+	}
+
+	return crc;
+}
+
+static void write_section(struct serializer *s, uint16_t pid, uint8_t *cc,
+			  uint8_t *section, size_t size)
+{
+	uint8_t packet[MPEGTS_PACKET_SIZE];
+	uint32_t crc;
+
+	/* section_length covers everything after it, including the crc */
+	section[1] = 0xb0 | (uint8_t)(((size + 4 - 3) >> 8) & 0x0f);
+	section[2] = (uint8_t)((size + 4 - 3) & 0xff);
+
+	crc = crc32_mpeg(section, size);
+	section[size++] = (uint8_t)(crc >> 24);
+	section[size++] = (uint8_t)(crc >> 16);
+	section[size++] = (uint8_t)(crc >> 8);
+	section[size++] = (uint8_t)crc;
+
+	memset(packet, 0xff, sizeof(packet));
+	packet[0] = 0x47;
+	packet[1] = 0x40 | (uint8_t)(pid >> 8);
+	packet[2] = (uint8_t)pid;
+	packet[3] = 0x10 | *cc;
+	packet[4] = 0; /* pointer field */
+	memcpy(packet + 5, section, size);
+
+	*cc = (*cc + 1) & 0x0f;
+	s_write(s, packet, sizeof(packet));
+}
+
+static void write_pat(struct mpegts_mux *mux, struct serializer *s)
+{
+	uint8_t section[MPEGTS_PACKET_SIZE];
+	size_t size = 0;
+
+	section[size++] = 0x00; /* table id */
+	size += 2;              /* section length */
+	section[size++] = 0x00; /* transport stream id */
+	section[size++] = 0x01;
+	section[size++] = 0xc1; /* version 0, current */
+	section[size++] = 0x00; /* section number */
+	section[size++] = 0x00; /* last section number */
+	section[size++] = 0x00;
+	section[size++] = PROGRAM_NUMBER;
+	section[size++] = 0xe0 | (PMT_PID >> 8);
+	section[size++] = PMT_PID & 0xff;
+
+	write_section(s, PAT_PID, &mux->pat_cc, section, size);
+}
+
+static uint8_t stream_type(enum mpegts_codec codec)
+{
+	switch (codec) {
+	case MPEGTS_CODEC_H264:
+		return STREAM_TYPE_H264;
+	case MPEGTS_CODEC_HEVC:
+		return STREAM_TYPE_HEVC;
+	case MPEGTS_CODEC_AAC:
+		return STREAM_TYPE_AAC;
+	case MPEGTS_CODEC_OPUS:
+		return STREAM_TYPE_PRIVATE;
+	}
+
+	return STREAM_TYPE_PRIVATE;
+}
+
+static void write_pmt(struct mpegts_mux *mux, struct serializer *s)
+{
+	uint8_t section[MPEGTS_PACKET_SIZE];
+	uint16_t pcr_pid = mux->streams[mux->pcr_stream].pid;
+	size_t size = 0;
+
+	section[size++] = 0x02; /* table id */
+	size += 2;              /* section length */
+	section[size++] = 0x00;
+	section[size++] = PROGRAM_NUMBER;
+	section[size++] = 0xc1; /* version 0, current */
+	section[size++] = 0x00; /* section number */
+	section[size++] = 0x00; /* last section number */
+	section[size++] = 0xe0 | (uint8_t)(pcr_pid >> 8);
+	section[size++] = (uint8_t)pcr_pid;
+	section[size++] = 0xf0; /* program info length */
+	section[size++] = 0x00;
+
+	for (size_t i = 0; i < mux->num_streams; i++) {
+		struct mpegts_stream *stream = &mux->streams[i];
+		bool opus = stream->codec == MPEGTS_CODEC_OPUS;
+		uint8_t info_size = opus ? 10 : 0;
+
+		section[size++] = stream_type(stream->codec);
+		section[size++] = 0xe0 | (uint8_t)(stream->pid >> 8);
+		section[size++] = (uint8_t)stream->pid;
+		section[size++] = 0xf0;
+		section[size++] = info_size;
+
+		if (opus) {
+			int channels = stream->channels;
+			bool plain = channels >= 1 && channels <= 8;
+
+			/* registration descriptor */
+			section[size++] = 0x05;
+			section[size++] = 4;
+			memcpy(section + size, "Opus", 4);
+			size += 4;
+
+			/* extension descriptor, channel config code.  Only
+			 * the codes for 1-8 channels need no extra data */
+			section[size++] = 0x7f;
+			section[size++] = 2;
+			section[size++] = 0x80;
+			section[size++] = (uint8_t)(plain ? channels : 2);
+		}
+	}
+
+	write_section(s, PMT_PID, &mux->pmt_cc, section, size);
+}
+
+/* ------------------------------------------------------------------------- */
+/* PES                                                                       */
+
+static inline int64_t to_90khz(const struct encoder_packet *packet,
+			       int64_t val)
+{
+	int64_t num = packet->timebase_num ? packet->timebase_num : 1;
+	int64_t ts = val * 90000 * num / packet->timebase_den + TS_OFFSET;
+	return ts & MAX_TS;
+}
+
+static void write_timestamp(uint8_t *out, uint8_t prefix, int64_t ts)
+{
+	out[0] = (uint8_t)((prefix << 4) | ((ts >> 29) & 0x0e) | 1);
+	out[1] = (uint8_t)(ts >> 22);
+	out[2] = (uint8_t)(((ts >> 14) & 0xfe) | 1);
+	out[3] = (uint8_t)(ts >> 7);
+	out[4] = (uint8_t)(((ts << 1) & 0xfe) | 1);
+}
+
+static void write_pes_header(struct mpegts_mux *mux,
+			     struct mpegts_stream *stream, int64_t pts,
+			     int64_t dts)
+{
+	bool has_dts = pts != dts;
+	uint8_t header[19];
+	size_t size = 0;
+
+	header[size++] = 0;
+	header[size++] = 0;
+	header[size++] = 1;
+	header[size++] = stream->stream_id;
+	size += 2; /* pes packet length, set once the payload is known */
+	header[size++] = 0x80;
+	header[size++] = has_dts ? 0xc0 : 0x80;
+	header[size++] = has_dts ? 10 : 5;
+
+	write_timestamp(header + size, has_dts ? 3 : 2, pts);
+	size += 5;
+	if (has_dts) {
+		write_timestamp(header + size, 1, dts);
+		size += 5;
+	}
+
+	da_push_back_array(mux->pes, header, size);
+}
+
+static void write_adts_header(struct mpegts_mux *mux,
+			      struct mpegts_stream *stream, size_t size)
+{
+	uint8_t profile = 2, sr_idx = 3, channels = 2;
+	size_t frame_size = size + 7;
+	uint8_t adts[7];
+
+	if (stream->extra_size >= 2) {
+		const uint8_t *asc = stream->extra_data;
+		profile = asc[0] >> 3;
+		sr_idx = (uint8_t)(((asc[0] & 0x07) << 1) | (asc[1] >> 7));
+		channels = (asc[1] >> 3) & 0x0f;
+	} else if (stream->channels > 0 && stream->channels < 8) {
+		channels = (uint8_t)stream->channels;
+	}
+
+	adts[0] = 0xff;
+	adts[1] = 0xf1;
+	adts[2] = (uint8_t)(((profile - 1) << 6) | (sr_idx << 2) |
+			    (channels >> 2));
+	adts[3] = (uint8_t)(((channels & 3) << 6) | (frame_size >> 11));
+	adts[4] = (uint8_t)(frame_size >> 3);
+	adts[5] = (uint8_t)(((frame_size & 7) << 5) | 0x1f);
+	adts[6] = 0xfc;
+
+	da_push_back_array(mux->pes, adts, sizeof(adts));
+}
+
+static void write_opus_control_header(struct mpegts_mux *mux, size_t size)
+{
+	uint8_t ff = 0xff;
+	uint8_t header[2] = {0x7f, 0xe0};
+
+	da_push_back_array(mux->pes, header, sizeof(header));
+	while (size >= 255) {
+		da_push_back(mux->pes, &ff);
+		size -= 255;
+	}
+
+	ff = (uint8_t)size;
+	da_push_back(mux->pes, &ff);
+}
+
+static void write_ts_packets(struct mpegts_stream *stream,
+			     const uint8_t *data, size_t size, bool pcr,
+			     int64_t pcr_base, bool random_access,
+			     struct serializer *s)
+{
+	bool first = true;
+
+	while (size) {
+		uint8_t packet[MPEGTS_PACKET_SIZE];
+		uint8_t flags = 0;
+		size_t af_size = 0;
+		size_t stuffing;
+		size_t payload;
+		size_t pos = 4;
+
+		if (first && random_access)
+			flags |= 0x40;
+		if (first && pcr)
+			flags |= 0x10;
+		if (flags)
+			af_size = (flags & 0x10) ? 8 : 2;
+
+		payload = MPEGTS_PACKET_SIZE - 4 - af_size;
+		if (payload > size)
+			payload = size;
+
+		stuffing = MPEGTS_PACKET_SIZE - 4 - af_size - payload;
+		if (stuffing && !af_size) {
+			af_size = stuffing == 1 ? 1 : 2;
+			stuffing -= af_size;
+		}
+
+		packet[0] = 0x47;
+		packet[1] = (uint8_t)((first ? 0x40 : 0) | (stream->pid >> 8));
+		packet[2] = (uint8_t)stream->pid;
+		packet[3] = (uint8_t)((af_size ? 0x30 : 0x10) | stream->cc);
+		stream->cc = (stream->cc + 1) & 0x0f;
+
+		if (af_size) {
+			packet[pos++] = (uint8_t)(af_size + stuffing - 1);
+			if (af_size > 1)
+				packet[pos++] = flags;
+
+			if (flags & 0x10) {
+				packet[pos++] = (uint8_t)(pcr_base >> 25);
+				packet[pos++] = (uint8_t)(pcr_base >> 17);
+				packet[pos++] = (uint8_t)(pcr_base >> 9);
+				packet[pos++] = (uint8_t)(pcr_base >> 1);
+				packet[pos++] =
+					(uint8_t)(((pcr_base & 1) << 7) | 0x7e);
+				packet[pos++] = 0;
+			}
+
+			memset(packet + pos, 0xff, stuffing);
+			pos += stuffing;
+		}
+
+		memcpy(packet + pos, data, payload);
+		s_write(s, packet, sizeof(packet));
+
+		data += payload;
+		size -= payload;
+		first = false;
+	}
+}
+
+void mpegts_mux_packet(struct mpegts_mux *mux, size_t stream_idx,
+		       const struct encoder_packet *packet,
+		       struct serializer *s)
+{
+	struct mpegts_stream *stream = &mux->streams[stream_idx];
+	bool video = is_video(stream->codec);
+	bool keyframe = video && packet->keyframe;
+	int64_t pts = to_90khz(packet, packet->pts);
+	int64_t dts = to_90khz(packet, packet->dts);
+	size_t pes_size;
+
+	if (!mux->sent_psi || keyframe ||
+	    ((dts - mux->last_psi_dts) & MAX_TS) >= PSI_INTERVAL) {
+		write_pat(mux, s);
+		write_pmt(mux, s);
+		mux->sent_psi = true;
+		mux->last_psi_dts = dts;
+	}
+
+	da_resize(mux->pes, 0);
+	write_pes_header(mux, stream, pts, dts);
+
+	switch (stream->codec) {
+	case MPEGTS_CODEC_H264:
+		da_push_back_array(mux->pes, h264_aud, sizeof(h264_aud));
+		break;
+	case MPEGTS_CODEC_HEVC:
+		da_push_back_array(mux->pes, hevc_aud, sizeof(hevc_aud));
+		break;
+	case MPEGTS_CODEC_AAC:
+		write_adts_header(mux, stream, packet->size);
+		break;
+	case MPEGTS_CODEC_OPUS:
+		write_opus_control_header(mux, packet->size);
+		break;
+	}
+
+	if (keyframe && stream->extra_size)
+		da_push_back_array(mux->pes, stream->extra_data,
+				   stream->extra_size);
+	da_push_back_array(mux->pes, packet->data, packet->size);
+
+	/* the length may only be left at 0 for video */
+	pes_size = mux->pes.num - 6;
+	if (pes_size > 0xffff)
+		pes_size = 0;
+	mux->pes.array[4] = (uint8_t)(pes_size >> 8);
+	mux->pes.array[5] = (uint8_t)pes_size;
+
+	write_ts_packets(stream, mux->pes.array, mux->pes.num,
+			 stream_idx == mux->pcr_stream,
+			 (dts - PCR_DELAY) & MAX_TS, keyframe, s);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <obs.h>
+#include <util/darray.h>
+#include <util/serializer.h>
+
+/* Minimal MPEG transport stream muxer: one program, PAT/PMT repeated before
+ * every video keyframe, PCR carried on the video stream (or the first stream
+ * when there is no video).  Every call writes whole 188 byte packets. */
+
+#define MPEGTS_PACKET_SIZE 188
+#define MPEGTS_MAX_STREAMS (1 + MAX_AUDIO_MIXES)
+
+enum mpegts_codec {
+	MPEGTS_CODEC_H264,
+	MPEGTS_CODEC_HEVC,
+	MPEGTS_CODEC_AAC,
+	MPEGTS_CODEC_OPUS,
+};
+
+struct mpegts_stream {
+	enum mpegts_codec codec;
+	uint16_t pid;
+	uint8_t stream_id;
+	uint8_t cc;
+
+	/* annex b parameter sets for video, AudioSpecificConfig for aac */
+	uint8_t *extra_data;
+	size_t extra_size;
+
+	int channels;
+};
+
+struct mpegts_mux {
+	struct mpegts_stream streams[MPEGTS_MAX_STREAMS];
+	size_t num_streams;
+	size_t pcr_stream;
+
+	uint8_t pat_cc;
+	uint8_t pmt_cc;
+	bool sent_psi;
+	int64_t last_psi_dts;
+
+	DARRAY(uint8_t) pes;
+};
+
+extern bool mpegts_codec_from_name(const char *name, enum mpegts_codec *codec);
+
+extern void mpegts_mux_init(struct mpegts_mux *mux);
+extern void mpegts_mux_free(struct mpegts_mux *mux);
+
+/* returns the stream index, or -1 if the muxer is full */
+extern int mpegts_mux_add_stream(struct mpegts_mux *mux,
+				 enum mpegts_codec codec,
+				 const uint8_t *extra_data, size_t extra_size,
+				 int channels);
+
+/* packet data is annex b for video and raw frames for audio */
+extern void mpegts_mux_packet(struct mpegts_mux *mux, size_t stream_idx,
+			      const struct encoder_packet *packet,
+			      struct serializer *s);
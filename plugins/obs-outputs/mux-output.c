@@ -0,0 +1,403 @@
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include <util/serializer.h>
+#include <util/array-serializer.h>
+#include "file-writer.h"
+#include "fmp4-mux.h"
+#include "mpegts-mux.h"
+
+#define do_log(level, format, ...)                \
+	blog(level, "[mux output: '%s'] " format, \
+	     obs_output_get_name(stream->output), ##__VA_ARGS__)
+
+#define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
+
+#define OPT_PATH "path"
+#define OPT_FORMAT "format"
+#define OPT_MAX_FRAGMENT_MS "max_fragment_ms"
+#define OPT_WRITE_BUFFER_MB "write_buffer_mb"
+
+#define VIDEO_TIMESCALE 90000
+
+enum mux_format {
+	MUX_FORMAT_FMP4,
+	MUX_FORMAT_MPEGTS,
+};
+
+struct mux_output {
+	obs_output_t *output;
+	struct dstr path;
+	volatile bool active;
+	volatile bool stopping;
+	uint64_t stop_ts;
+
+	pthread_mutex_t mutex;
+
+	enum mux_format format;
+	struct file_writer *writer;
+	bool write_failed;
+
+	struct fmp4_mux fmp4;
+	struct mpegts_mux ts;
+	struct array_output_data ts_data;
+	struct serializer ts_out;
+
+	int video_track;
+	int audio_tracks[MAX_AUDIO_MIXES];
+};
+
+static inline bool stopping(struct mux_output *stream)
+{
+	return os_atomic_load_bool(&stream->stopping);
+}
+
+static inline bool active(struct mux_output *stream)
+{
+	return os_atomic_load_bool(&stream->active);
+}
+
+static const char *mux_output_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("MuxOutput");
+}
+
+static void mux_output_destroy(void *data)
+{
+	struct mux_output *stream = data;
+
+	if (stream->writer)
+		file_writer_close(stream->writer);
+
+	fmp4_mux_free(&stream->fmp4);
+	mpegts_mux_free(&stream->ts);
+	array_output_serializer_free(&stream->ts_data);
+	pthread_mutex_destroy(&stream->mutex);
+	dstr_free(&stream->path);
+	bfree(stream);
+}
+
+static void *mux_output_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct mux_output *stream = bzalloc(sizeof(struct mux_output));
+	stream->output = output;
+	pthread_mutex_init(&stream->mutex, NULL);
+	array_output_serializer_init(&stream->ts_out, &stream->ts_data);
+
+	UNUSED_PARAMETER(settings);
+	return stream;
+}
+
+static void write_data(void *data, const void *buf, size_t size)
+{
+	struct mux_output *stream = data;
+
+	if (!stream->write_failed &&
+	    !file_writer_write(stream->writer, buf, size))
+		stream->write_failed = true;
+}
+
+static enum mux_format get_format(const char *format, const char *path)
+{
+	const char *ext;
+
+	if (strcmp(format, "mpegts") == 0)
+		return MUX_FORMAT_MPEGTS;
+	if (strcmp(format, "fmp4") == 0)
+		return MUX_FORMAT_FMP4;
+
+	ext = strrchr(path, '.');
+	if (ext && (astrcmpi(ext, ".ts") == 0 || astrcmpi(ext, ".m2ts") == 0))
+		return MUX_FORMAT_MPEGTS;
+	return MUX_FORMAT_FMP4;
+}
+
+static int add_fmp4_track(struct mux_output *stream, obs_encoder_t *encoder)
+{
+	struct fmp4_track_info info = {0};
+	uint8_t *extra = NULL;
+	size_t size = 0;
+
+	if (!fmp4_codec_from_name(obs_encoder_get_codec(encoder), &info.codec))
+		return -1;
+
+	obs_encoder_get_extra_data(encoder, &extra, &size);
+	info.extra_data = extra;
+	info.extra_size = size;
+
+	if (obs_encoder_get_type(encoder) == OBS_ENCODER_VIDEO) {
+		info.timescale = VIDEO_TIMESCALE;
+		info.width = obs_encoder_get_width(encoder);
+		info.height = obs_encoder_get_height(encoder);
+	} else {
+		info.sample_rate = obs_encoder_get_sample_rate(encoder);
+		info.timescale = info.sample_rate;
+		info.channels = (uint32_t)audio_output_get_channels(
+			obs_encoder_audio(encoder));
+	}
+
+	return fmp4_mux_add_track(&stream->fmp4, &info);
+}
+
+static int add_ts_stream(struct mux_output *stream, obs_encoder_t *encoder)
+{
+	enum mpegts_codec codec;
+	uint8_t *extra = NULL;
+	size_t size = 0;
+	int channels = 0;
+
+	if (!mpegts_codec_from_name(obs_encoder_get_codec(encoder), &codec))
+		return -1;
+
+	if (obs_encoder_get_type(encoder) == OBS_ENCODER_AUDIO)
+		channels = (int)audio_output_get_channels(
+			obs_encoder_audio(encoder));
+
+	obs_encoder_get_extra_data(encoder, &extra, &size);
+	return mpegts_mux_add_stream(&stream->ts, codec, extra, size,
+				     channels);
+}
+
+static inline int add_track(struct mux_output *stream, obs_encoder_t *encoder)
+{
+	int idx = stream->format == MUX_FORMAT_FMP4
+			  ? add_fmp4_track(stream, encoder)
+			  : add_ts_stream(stream, encoder);
+
+	if (idx < 0)
+		warn("Codec '%s' is not supported by the %s muxer",
+		     obs_encoder_get_codec(encoder),
+		     stream->format == MUX_FORMAT_FMP4 ? "fMP4" : "MPEG-TS");
+	return idx;
+}
+
+static bool init_mux(struct mux_output *stream, obs_data_t *settings)
+{
+	obs_output_t *output = stream->output;
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(output);
+	uint32_t max_fragment_ms =
+		(uint32_t)obs_data_get_int(settings, OPT_MAX_FRAGMENT_MS);
+
+	fmp4_mux_free(&stream->fmp4);
+	mpegts_mux_free(&stream->ts);
+	fmp4_mux_init(&stream->fmp4, max_fragment_ms, write_data, stream);
+	mpegts_mux_init(&stream->ts);
+
+	stream->video_track = -1;
+	if (vencoder) {
+		stream->video_track = add_track(stream, vencoder);
+		if (stream->video_track < 0)
+			return false;
+	}
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		obs_encoder_t *aencoder =
+			obs_output_get_audio_encoder(output, i);
+
+		stream->audio_tracks[i] = -1;
+		if (!aencoder)
+			continue;
+
+		stream->audio_tracks[i] = add_track(stream, aencoder);
+		if (stream->audio_tracks[i] < 0)
+			return false;
+	}
+
+	return stream->video_track >= 0 || stream->audio_tracks[0] >= 0;
+}
+
+static bool mux_output_start(void *data)
+{
+	struct mux_output *stream = data;
+	obs_data_t *settings;
+	size_t buffer_size;
+	bool success;
+
+	if (!obs_output_can_begin_data_capture(stream->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(stream->output, 0))
+		return false;
+
+	os_atomic_set_bool(&stream->stopping, false);
+	stream->write_failed = false;
+
+	settings = obs_output_get_settings(stream->output);
+	dstr_copy(&stream->path, obs_data_get_string(settings, OPT_PATH));
+	stream->format = get_format(obs_data_get_string(settings, OPT_FORMAT),
+				    stream->path.array);
+	buffer_size = (size_t)obs_data_get_int(settings, OPT_WRITE_BUFFER_MB) *
+		      1024 * 1024;
+	success = init_mux(stream, settings);
+	obs_data_release(settings);
+
+	if (!success)
+		return false;
+
+	stream->writer = file_writer_open(stream->path.array,
+					  buffer_size ? buffer_size
+						      : 1024 * 1024);
+	if (!stream->writer) {
+		warn("Unable to open file '%s'", stream->path.array);
+		return false;
+	}
+
+	os_atomic_set_bool(&stream->active, true);
+	obs_output_begin_data_capture(stream->output, 0);
+
+	info("Writing %s file '%s'...",
+	     stream->format == MUX_FORMAT_FMP4 ? "fMP4" : "MPEG-TS",
+	     stream->path.array);
+	return true;
+}
+
+static void mux_output_stop(void *data, uint64_t ts)
+{
+	struct mux_output *stream = data;
+	stream->stop_ts = ts / 1000;
+	os_atomic_set_bool(&stream->stopping, true);
+}
+
+static void mux_output_actual_stop(struct mux_output *stream, int code)
+{
+	os_atomic_set_bool(&stream->active, false);
+
+	if (stream->writer) {
+		if (stream->format == MUX_FORMAT_FMP4)
+			fmp4_mux_flush(&stream->fmp4);
+
+		if (!file_writer_close(stream->writer) && !code) {
+			warn("Failed to write file '%s'", stream->path.array);
+			code = OBS_OUTPUT_ERROR;
+		}
+		stream->writer = NULL;
+	}
+
+	if (code) {
+		obs_output_signal_stop(stream->output, code);
+	} else {
+		obs_output_end_data_capture(stream->output);
+	}
+
+	info("File output complete");
+}
+
+static void write_packet(struct mux_output *stream,
+			 struct encoder_packet *packet)
+{
+	int idx = packet->type == OBS_ENCODER_VIDEO
+			  ? stream->video_track
+			  : stream->audio_tracks[packet->track_idx];
+
+	if (idx < 0)
+		return;
+
+	if (stream->format == MUX_FORMAT_FMP4) {
+		fmp4_mux_packet(&stream->fmp4, (size_t)idx, packet);
+	} else {
+		array_output_serializer_reset(&stream->ts_out,
+					      &stream->ts_data);
+		mpegts_mux_packet(&stream->ts, (size_t)idx, packet,
+				  &stream->ts_out);
+		write_data(stream, stream->ts_data.bytes.array,
+			   stream->ts_data.bytes.num);
+	}
+}
+
+static void mux_output_data(void *data, struct encoder_packet *packet)
+{
+	struct mux_output *stream = data;
+
+	pthread_mutex_lock(&stream->mutex);
+
+	if (!active(stream))
+		goto unlock;
+
+	if (!packet) {
+		mux_output_actual_stop(stream, OBS_OUTPUT_ENCODE_ERROR);
+		goto unlock;
+	}
+
+	if (stopping(stream)) {
+		if (packet->sys_dts_usec >= (int64_t)stream->stop_ts) {
+			mux_output_actual_stop(stream, 0);
+			goto unlock;
+		}
+	}
+
+	write_packet(stream, packet);
+
+	if (stream->write_failed) {
+		warn("Failed to write file '%s'", stream->path.array);
+		mux_output_actual_stop(stream, OBS_OUTPUT_ERROR);
+	}
+
+unlock:
+	pthread_mutex_unlock(&stream->mutex);
+}
+
+static uint64_t mux_output_total_bytes(void *data)
+{
+	struct mux_output *stream = data;
+	uint64_t total = 0;
+
+	pthread_mutex_lock(&stream->mutex);
+	if (stream->writer)
+		total = file_writer_total_bytes(stream->writer);
+	pthread_mutex_unlock(&stream->mutex);
+	return total;
+}
+
+static void mux_output_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_string(defaults, OPT_FORMAT, "auto");
+	obs_data_set_default_int(defaults, OPT_MAX_FRAGMENT_MS, 1000);
+	obs_data_set_default_int(defaults, OPT_WRITE_BUFFER_MB, 8);
+}
+
+static obs_properties_t *mux_output_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+	obs_property_t *p;
+
+	obs_properties_add_text(props, OPT_PATH,
+				obs_module_text("MuxOutput.FilePath"),
+				OBS_TEXT_DEFAULT);
+
+	p = obs_properties_add_list(props, OPT_FORMAT,
+				    obs_module_text("MuxOutput.Format"),
+				    OBS_COMBO_TYPE_LIST,
+				    OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(
+		p, obs_module_text("MuxOutput.Format.Auto"), "auto");
+	obs_property_list_add_string(p, "Fragmented MP4", "fmp4");
+	obs_property_list_add_string(p, "MPEG-TS", "mpegts");
+
+	obs_properties_add_int(props, OPT_MAX_FRAGMENT_MS,
+			       obs_module_text("MuxOutput.MaxFragment"), 100,
+			       10000, 100);
+	obs_properties_add_int(props, OPT_WRITE_BUFFER_MB,
+			       obs_module_text("MuxOutput.WriteBuffer"), 1,
+			       256, 1);
+	return props;
+}
+
+struct obs_output_info mux_output_info = {
+	.id = "mux_output",
+	.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED | OBS_OUTPUT_MULTI_TRACK,
+	.encoded_video_codecs = "h264;hevc",
+	.encoded_audio_codecs = "aac;opus",
+	.get_name = mux_output_getname,
+	.create = mux_output_create,
+	.destroy = mux_output_destroy,
+	.start = mux_output_start,
+	.stop = mux_output_stop,
+	.encoded_packet = mux_output_data,
+	.get_total_bytes = mux_output_total_bytes,
+	.get_defaults = mux_output_defaults,
+	.get_properties = mux_output_properties,
+};
@@ -0,0 +1,608 @@
+#ifdef __linux__
+#include "rtmp-stream.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
+/* page pinning only pays off for large sends, smaller ones are copied */
+#define ZEROCOPY_MIN_SEND (32 * 1024)
+
+/* give up on MSG_ZEROCOPY once this many sends were copied anyway (loopback,
+ * or a NIC without scatter-gather / checksum offload) */
+#define ZEROCOPY_MAX_COPIED 16
+
+/* keep the kernel's unsent backlog small so that congestion shows up in the
+ * write buffer, where frame dropping and dynamic bitrate can see it */
+#define NOTSENT_LOWAT (128 * 1024)
+#define NOTSENT_LOWAT_LOW_LATENCY (16 * 1024)
+
+#define LATENCY_FACTOR 20
+
+/* the stop event isn't tied to the epoll set, so it is checked this often */
+#define POLL_TIMEOUT_MS 100
+
+/* once a stop is forced, whatever is still buffered gets this long to go
+ * out before it is dropped, so a stalled peer can't hold up the stop */
+#define FORCED_STOP_DRAIN_NS (500ULL * 1000000ULL)
+
+struct zerocopy_send {
+	uint32_t id;
+	size_t size;
+};
+
+struct socket_loop {
+	struct rtmp_stream *stream;
+	int fd;
+	int epoll_fd;
+	bool can_write;
+	bool want_write;
+
+	int delay_time;
+	size_t latency_packet_size;
+	uint64_t last_send_time;
+	uint64_t abandon_ts;
+
+	bool zerocopy;
+	uint32_t zerocopy_next_id;
+	uint32_t zerocopy_copied;
+	struct circlebuf zerocopy_sends;
+};
+
+bool socket_thread_linux_init(struct rtmp_stream *stream)
+{
+	socket_thread_linux_free(stream);
+	stream->socket_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	return stream->socket_wake_fd != -1;
+}
+
+void socket_thread_linux_wake(struct rtmp_stream *stream)
+{
+	if (stream->socket_wake_fd != -1)
+		eventfd_write(stream->socket_wake_fd, 1);
+}
+
+void socket_thread_linux_free(struct rtmp_stream *stream)
+{
+	if (stream->socket_wake_fd != -1) {
+		close(stream->socket_wake_fd);
+		stream->socket_wake_fd = -1;
+	}
+}
+
+static void fatal_sock_shutdown(struct rtmp_stream *stream)
+{
+	pthread_mutex_lock(&stream->write_buf_mutex);
+	close(stream->rtmp.m_sb.sb_socket);
+	stream->rtmp.m_sb.sb_socket = -1;
+	stream->write_buf_len = 0;
+	stream->write_buf_pinned = 0;
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	os_event_signal(stream->buffer_space_available_event);
+}
+
+static inline bool using_tls(struct rtmp_stream *stream)
+{
+#if defined(CRYPTO) && !defined(NO_SSL)
+	return stream->rtmp.m_sb.sb_ssl != NULL;
+#else
+	UNUSED_PARAMETER(stream);
+	return false;
+#endif
+}
+
+static void tune_socket(struct socket_loop *loop)
+{
+	struct rtmp_stream *stream = loop->stream;
+	int lowat = stream->low_latency_mode ? NOTSENT_LOWAT_LOW_LATENCY
+					     : NOTSENT_LOWAT;
+	int one = 1;
+
+	/* chunks are already coalesced in the write buffer, so Nagle would
+	 * only add latency */
+	setsockopt(loop->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	if (setsockopt(loop->fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat,
+		       sizeof(lowat)) != 0)
+		blog(LOG_DEBUG, "socket_thread_linux: TCP_NOTSENT_LOWAT "
+				"not supported");
+
+	/* TLS records are built in user space, pages can't be pinned */
+	if (!using_tls(stream))
+		loop->zerocopy = setsockopt(loop->fd, SOL_SOCKET, SO_ZEROCOPY,
+					    &one, sizeof(one)) == 0;
+
+	if (loop->zerocopy)
+		blog(LOG_INFO, "socket_thread_linux: Using MSG_ZEROCOPY");
+}
+
+static bool set_want_write(struct socket_loop *loop, bool want_write)
+{
+	struct epoll_event ev = {0};
+
+	if (loop->want_write == want_write)
+		return true;
+
+	ev.events = EPOLLIN | EPOLLRDHUP | (want_write ? EPOLLOUT : 0);
+	ev.data.fd = loop->fd;
+
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, loop->fd, &ev) != 0)
+		return false;
+
+	loop->want_write = want_write;
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void release_pinned(struct socket_loop *loop, uint32_t last_id)
+{
+	struct rtmp_stream *stream = loop->stream;
+	size_t released = 0;
+
+	/* TCP completes zerocopy sends in order */
+	while (loop->zerocopy_sends.size) {
+		struct zerocopy_send zc;
+
+		circlebuf_peek_front(&loop->zerocopy_sends, &zc, sizeof(zc));
+		if ((int32_t)(zc.id - last_id) > 0)
+			break;
+
+		circlebuf_pop_front(&loop->zerocopy_sends, NULL, sizeof(zc));
+		released += zc.size;
+	}
+
+	if (!released)
+		return;
+
+	pthread_mutex_lock(&stream->write_buf_mutex);
+	stream->write_buf_pinned -= released;
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	os_event_signal(stream->buffer_space_available_event);
+}
+
+static bool read_error_queue(struct socket_loop *loop)
+{
+	for (;;) {
+		char control[128];
+		struct msghdr msg = {0};
+		struct cmsghdr *cm;
+
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(loop->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			struct sock_extended_err *err;
+
+			if (!(cm->cmsg_level == SOL_IP &&
+			      cm->cmsg_type == IP_RECVERR) &&
+			    !(cm->cmsg_level == SOL_IPV6 &&
+			      cm->cmsg_type == IPV6_RECVERR))
+				continue;
+
+			err = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+				loop->stream->rtmp.last_error_code =
+					(int)err->ee_errno;
+				return false;
+			}
+
+			if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED &&
+			    ++loop->zerocopy_copied == ZEROCOPY_MAX_COPIED &&
+			    loop->zerocopy) {
+				blog(LOG_INFO,
+				     "socket_thread_linux: Kernel is "
+				     "copying zerocopy sends, disabling "
+				     "MSG_ZEROCOPY");
+				loop->zerocopy = false;
+			}
+
+			release_pinned(loop, err->ee_data);
+		}
+	}
+}
+
+static bool socket_error(struct socket_loop *loop)
+{
+	struct rtmp_stream *stream = loop->stream;
+	int err = 0;
+	socklen_t size = sizeof(err);
+
+	if (read_error_queue(loop)) {
+		getsockopt(loop->fd, SOL_SOCKET, SO_ERROR, &err, &size);
+		if (!err)
+			return true;
+
+		stream->rtmp.last_error_code = err;
+	}
+
+	blog(LOG_ERROR,
+	     "socket_thread_linux: Aborting due to socket error %d "
+	     "(buffer: %d / %d)",
+	     stream->rtmp.last_error_code, (int)stream->write_buf_len,
+	     (int)stream->write_buf_size);
+	fatal_sock_shutdown(stream);
+	return false;
+}
+
+static bool discard_recv(struct socket_loop *loop)
+{
+	struct rtmp_stream *stream = loop->stream;
+	char discard[16384];
+
+	for (;;) {
+		ssize_t ret = recv(loop->fd, discard, sizeof(discard),
+				   MSG_DONTWAIT);
+		int err_code;
+
+		if (ret > 0)
+			continue;
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return true;
+		if (ret < 0 && errno == EINTR)
+			continue;
+
+		err_code = ret < 0 ? errno : 0;
+		blog(LOG_ERROR,
+		     "socket_thread_linux: Socket error, recv() returned "
+		     "%d, errno %d",
+		     (int)ret, err_code);
+		stream->rtmp.last_error_code = err_code;
+		fatal_sock_shutdown(stream);
+		return false;
+	}
+}
+
+static void log_hangup(struct socket_loop *loop)
+{
+	struct rtmp_stream *stream = loop->stream;
+
+	if (loop->last_send_time) {
+		uint32_t diff = (uint32_t)(os_gettime_ns() / 1000000 -
+					   loop->last_send_time);
+
+		blog(LOG_ERROR,
+		     "socket_thread_linux: Received hangup, %u ms since "
+		     "last send (buffer: %d / %d)",
+		     diff, (int)stream->write_buf_len,
+		     (int)stream->write_buf_size);
+	}
+
+	if (os_event_try(stream->stop_event) != EAGAIN)
+		blog(LOG_ERROR,
+		     "socket_thread_linux: Aborting due to hangup during "
+		     "shutdown, %d bytes lost",
+		     (int)stream->write_buf_len);
+	else
+		blog(LOG_ERROR, "socket_thread_linux: Aborting due to "
+				"hangup");
+}
+
+/* ------------------------------------------------------------------------- */
+
+enum data_ret { RET_BREAK, RET_FATAL, RET_CONTINUE };
+
+#if defined(CRYPTO) && !defined(NO_SSL)
+static ssize_t send_tls(struct rtmp_stream *stream, const struct iovec *iov,
+			int iov_count)
+{
+	ssize_t total = 0;
+
+	for (int i = 0; i < iov_count; i++) {
+		int ret = RTMPSockBuf_Send(&stream->rtmp.m_sb,
+					   (const char *)iov[i].iov_base,
+					   (int)iov[i].iov_len);
+		if (ret <= 0)
+			return total ? total : ret;
+
+		total += ret;
+		if ((size_t)ret < iov[i].iov_len)
+			break;
+	}
+
+	return total;
+}
+#endif
+
+static enum data_ret write_data(struct socket_loop *loop)
+{
+	struct rtmp_stream *stream = loop->stream;
+	struct iovec iov[2];
+	struct msghdr msg = {0};
+	size_t start, len, first;
+	int iov_count = 1;
+	int flags = MSG_NOSIGNAL;
+	ssize_t ret;
+
+	pthread_mutex_lock(&stream->write_buf_mutex);
+	start = stream->write_buf_start;
+	len = stream->write_buf_len;
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	if (!len)
+		return RET_BREAK;
+
+	if (len > loop->latency_packet_size)
+		len = loop->latency_packet_size;
+
+	/* the unsent region may wrap around the end of the ring, in which
+	 * case both halves go out in a single call.  the region is only ever
+	 * appended to by other threads, so it can be sent without holding
+	 * the mutex. */
+	first = stream->write_buf_size - start;
+	if (first > len)
+		first = len;
+
+	iov[0].iov_base = stream->write_buf + start;
+	iov[0].iov_len = first;
+	if (first < len) {
+		iov[1].iov_base = stream->write_buf;
+		iov[1].iov_len = len - first;
+		iov_count = 2;
+	}
+
+#if defined(CRYPTO) && !defined(NO_SSL)
+	if (using_tls(stream)) {
+		ret = send_tls(stream, iov, iov_count);
+	} else
+#endif
+	{
+		bool zerocopy = loop->zerocopy && len >= ZEROCOPY_MIN_SEND;
+
+		msg.msg_iov = iov;
+		msg.msg_iovlen = iov_count;
+
+		ret = sendmsg(loop->fd, &msg,
+			      flags | (zerocopy ? MSG_ZEROCOPY : 0));
+
+		/* out of optmem for pinned pages, send this one copied */
+		if (ret < 0 && zerocopy && errno == ENOBUFS)
+			ret = sendmsg(loop->fd, &msg, flags);
+		else if (ret > 0 && zerocopy)
+			flags |= MSG_ZEROCOPY;
+	}
+
+	if (ret > 0) {
+		pthread_mutex_lock(&stream->write_buf_mutex);
+		stream->write_buf_start =
+			(start + (size_t)ret) % stream->write_buf_size;
+		stream->write_buf_len -= (size_t)ret;
+		if (flags & MSG_ZEROCOPY)
+			stream->write_buf_pinned += (size_t)ret;
+		len = stream->write_buf_len;
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+
+		loop->last_send_time = os_gettime_ns() / 1000000;
+
+		if (flags & MSG_ZEROCOPY) {
+			struct zerocopy_send zc = {loop->zerocopy_next_id++,
+						   (size_t)ret};
+			circlebuf_push_back(&loop->zerocopy_sends, &zc,
+					    sizeof(zc));
+		} else {
+			os_event_signal(stream->buffer_space_available_event);
+		}
+
+	} else if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		loop->can_write = false;
+		return RET_BREAK;
+
+	} else if (ret < 0 && errno == EINTR) {
+		return RET_CONTINUE;
+
+	} else {
+		/* connection closed, or connection was aborted / socket
+		 * closed / etc, that's a fatal error. */
+		int err_code = ret < 0 ? errno : 0;
+
+		blog(LOG_ERROR,
+		     "socket_thread_linux: Socket error, send() returned "
+		     "%d, errno %d",
+		     (int)ret, err_code);
+
+		stream->rtmp.last_error_code = err_code;
+		fatal_sock_shutdown(stream);
+		return RET_FATAL;
+	}
+
+	if (loop->delay_time)
+		os_sleep_ms(loop->delay_time);
+
+	/* finish writing for now */
+	return len <= 1000 ? RET_BREAK : RET_CONTINUE;
+}
+
+static bool buffer_drained(struct rtmp_stream *stream)
+{
+	bool drained;
+
+	pthread_mutex_lock(&stream->write_buf_mutex);
+	drained = stream->write_buf_len == 0 && stream->write_buf_pinned == 0;
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	return drained;
+}
+
+/* a stop without a timestamp, or one past the shutdown timeout, doesn't
+ * wait for the rest of the buffer to be sent */
+static bool drain_abandoned(struct socket_loop *loop)
+{
+	struct rtmp_stream *stream = loop->stream;
+	uint64_t now;
+
+	if (os_event_try(stream->stop_event) == EAGAIN)
+		return false;
+
+	now = os_gettime_ns();
+	if (!loop->abandon_ts) {
+		if (stream->stop_ts != 0 && now < stream->shutdown_timeout_ts)
+			return false;
+		loop->abandon_ts = now + FORCED_STOP_DRAIN_NS;
+	}
+
+	if (now < loop->abandon_ts || buffer_drained(stream))
+		return false;
+
+	blog(LOG_WARNING,
+	     "socket_thread_linux: Stop forced, abandoning %d buffered "
+	     "bytes",
+	     (int)stream->write_buf_len);
+	fatal_sock_shutdown(stream);
+	return true;
+}
+
+#define MAX_EVENTS 4
+
+static void socket_loop_run(struct socket_loop *loop)
+{
+	struct rtmp_stream *stream = loop->stream;
+	struct epoll_event events[MAX_EVENTS];
+
+	for (;;) {
+		if (os_event_try(stream->send_thread_signaled_exit) != EAGAIN &&
+		    buffer_drained(stream)) {
+			os_event_reset(stream->send_thread_signaled_exit);
+			break;
+		}
+
+		if (drain_abandoned(loop))
+			return;
+
+		int count = epoll_wait(loop->epoll_fd, events, MAX_EVENTS,
+				       POLL_TIMEOUT_MS);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+
+			blog(LOG_ERROR, "socket_thread_linux: Aborting due "
+					"to epoll_wait failure, errno %d",
+			     errno);
+			fatal_sock_shutdown(stream);
+			return;
+		}
+
+		for (int i = 0; i < count; i++) {
+			uint32_t ev = events[i].events;
+
+			if (events[i].data.fd == stream->socket_wake_fd) {
+				eventfd_t val;
+				eventfd_read(stream->socket_wake_fd, &val);
+				continue;
+			}
+
+			if ((ev & EPOLLERR) && !socket_error(loop))
+				return;
+			if ((ev & EPOLLIN) && !discard_recv(loop))
+				return;
+			if (ev & (EPOLLHUP | EPOLLRDHUP)) {
+				log_hangup(loop);
+				fatal_sock_shutdown(stream);
+				return;
+			}
+			if (ev & EPOLLOUT)
+				loop->can_write = true;
+		}
+
+		while (loop->can_write) {
+			enum data_ret ret = write_data(loop);
+
+			if (ret == RET_FATAL)
+				return;
+			if (ret == RET_BREAK)
+				break;
+		}
+
+		/* only poll for writability while the socket is full,
+		 * otherwise the loop would spin on an empty buffer */
+		if (!set_want_write(loop, !loop->can_write)) {
+			blog(LOG_ERROR, "socket_thread_linux: epoll_ctl "
+					"failed, errno %d",
+			     errno);
+			fatal_sock_shutdown(stream);
+			return;
+		}
+	}
+
+	blog(LOG_INFO, "socket_thread_linux: Normal exit");
+}
+
+static bool socket_loop_init(struct socket_loop *loop,
+			     struct rtmp_stream *stream)
+{
+	struct epoll_event ev = {0};
+
+	memset(loop, 0, sizeof(*loop));
+	loop->stream = stream;
+	loop->fd = stream->rtmp.m_sb.sb_socket;
+	loop->can_write = true;
+
+	if (stream->low_latency_mode) {
+		loop->delay_time = 1000 / LATENCY_FACTOR;
+		loop->latency_packet_size =
+			stream->write_buf_size / (LATENCY_FACTOR - 2);
+	} else {
+		loop->latency_packet_size = stream->write_buf_size;
+	}
+
+	tune_socket(loop);
+
+	loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epoll_fd == -1)
+		return false;
+
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	ev.data.fd = loop->fd;
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->fd, &ev) != 0)
+		return false;
+
+	ev.events = EPOLLIN;
+	ev.data.fd = stream->socket_wake_fd;
+	return epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, stream->socket_wake_fd,
+			 &ev) == 0;
+}
+
+void *socket_thread_linux(void *data)
+{
+	struct rtmp_stream *stream = data;
+	struct socket_loop loop;
+
+	os_set_thread_name("rtmp-stream: socket_thread");
+
+	if (socket_loop_init(&loop, stream)) {
+		socket_loop_run(&loop);
+	} else {
+		blog(LOG_ERROR, "socket_thread_linux: Failed to set up "
+				"epoll, errno %d",
+		     errno);
+		fatal_sock_shutdown(stream);
+	}
+
+	if (loop.epoll_fd != -1)
+		close(loop.epoll_fd);
+	circlebuf_free(&loop.zerocopy_sends);
+	return NULL;
+}
+#endif
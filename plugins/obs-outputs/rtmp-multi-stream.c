@@ -0,0 +1,492 @@
+/* Streams one set of encoders to several RTMP servers.  Packets are
+ * interleaved once by libobs and every destination gets a reference to the
+ * same packet data.  Each destination is a regular rtmp_stream with its own
+ * send thread, frame dropping and reconnect loop, so a slow or failing
+ * server does not hold back the others. */
+
+#include "rtmp-stream.h"
+
+#undef do_log
+#define do_log(level, format, ...)                       \
+	blog(level, "[rtmp multi stream: '%s'] " format, \
+	     obs_output_get_name(multi->output), ##__VA_ARGS__)
+
+#define OPT_DESTINATIONS "destinations"
+#define OPT_MAX_RETRIES "max_retries"
+#define OPT_RETRY_DELAY_SEC "retry_delay_sec"
+
+#define MAX_RETRY_DELAY_SEC (15 * 60)
+
+struct rtmp_multi_stream;
+
+struct rtmp_dest {
+	struct rtmp_multi_stream *multi;
+	struct rtmp_stream *stream;
+
+	struct dstr url, key;
+	struct dstr username, password;
+
+	pthread_t thread;
+	bool thread_active;
+	os_event_t *stopped_event;
+	int stop_code;
+};
+
+struct rtmp_multi_stream {
+	obs_output_t *output;
+
+	/* only start and destroy change the array, but the packet, stop and
+	 * stats callbacks can walk it from other threads at the same time */
+	pthread_mutex_t dests_mutex;
+	DARRAY(struct rtmp_dest *) dests;
+
+	os_event_t *stop_event;
+	volatile bool active;
+	volatile bool encode_error;
+	volatile long running;
+
+	int max_retries;
+	int retry_delay_sec;
+};
+
+static inline bool multi_stopping(struct rtmp_multi_stream *multi)
+{
+	return os_event_try(multi->stop_event) != EAGAIN;
+}
+
+static inline bool multi_active(struct rtmp_multi_stream *multi)
+{
+	return os_atomic_load_bool(&multi->active);
+}
+
+static const char *rtmp_multi_stream_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("RTMPMultiStream");
+}
+
+/* called from the destination's send thread when it exits */
+static void dest_stopped(void *param, int code)
+{
+	struct rtmp_dest *dest = param;
+
+	dest->stop_code = code;
+	os_event_signal(dest->stopped_event);
+}
+
+static struct rtmp_dest *dest_create(struct rtmp_multi_stream *multi,
+				     obs_data_t *settings)
+{
+	struct rtmp_dest *dest = bzalloc(sizeof(*dest));
+
+	dest->multi = multi;
+	dstr_copy(&dest->url, obs_data_get_string(settings, "server"));
+	dstr_copy(&dest->key, obs_data_get_string(settings, "key"));
+	dstr_copy(&dest->username, obs_data_get_string(settings, "username"));
+	dstr_copy(&dest->password, obs_data_get_string(settings, "password"));
+
+	if (os_event_init(&dest->stopped_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
+	dest->stream = rtmp_stream_dest_create(multi->output, dest_stopped,
+					       dest);
+	if (!dest->stream)
+		goto fail;
+
+	return dest;
+
+fail:
+	os_event_destroy(dest->stopped_event);
+	dstr_free(&dest->url);
+	dstr_free(&dest->key);
+	dstr_free(&dest->username);
+	dstr_free(&dest->password);
+	bfree(dest);
+	return NULL;
+}
+
+static void dest_destroy(struct rtmp_dest *dest)
+{
+	rtmp_stream_dest_destroy(dest->stream);
+	os_event_destroy(dest->stopped_event);
+	dstr_free(&dest->url);
+	dstr_free(&dest->key);
+	dstr_free(&dest->username);
+	dstr_free(&dest->password);
+	bfree(dest);
+}
+
+static void free_dests(struct rtmp_multi_stream *multi)
+{
+	DARRAY(struct rtmp_dest *) dests;
+
+	da_init(dests);
+
+	/* the threads are joined outside of the lock */
+	pthread_mutex_lock(&multi->dests_mutex);
+	da_move(dests, multi->dests);
+	pthread_mutex_unlock(&multi->dests_mutex);
+
+	for (size_t i = 0; i < dests.num; i++) {
+		struct rtmp_dest *dest = dests.array[i];
+
+		if (dest->thread_active)
+			pthread_join(dest->thread, NULL);
+		dest_destroy(dest);
+	}
+
+	da_free(dests);
+}
+
+static void stop_dests(struct rtmp_multi_stream *multi, uint64_t ts)
+{
+	os_event_signal(multi->stop_event);
+
+	pthread_mutex_lock(&multi->dests_mutex);
+	for (size_t i = 0; i < multi->dests.num; i++)
+		rtmp_stream_dest_stop(multi->dests.array[i]->stream, ts);
+	pthread_mutex_unlock(&multi->dests_mutex);
+}
+
+static void rtmp_multi_stream_destroy(void *data)
+{
+	struct rtmp_multi_stream *multi = data;
+
+	if (multi_active(multi))
+		stop_dests(multi, 0);
+
+	free_dests(multi);
+	os_event_destroy(multi->stop_event);
+	pthread_mutex_destroy(&multi->dests_mutex);
+	bfree(multi);
+}
+
+static void *rtmp_multi_stream_create(obs_data_t *settings,
+				      obs_output_t *output)
+{
+	struct rtmp_multi_stream *multi = bzalloc(sizeof(*multi));
+	multi->output = output;
+
+	if (pthread_mutex_init(&multi->dests_mutex, NULL) != 0) {
+		bfree(multi);
+		return NULL;
+	}
+	if (os_event_init(&multi->stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
+		pthread_mutex_destroy(&multi->dests_mutex);
+		bfree(multi);
+		return NULL;
+	}
+
+	UNUSED_PARAMETER(settings);
+	return multi;
+}
+
+static int wait_for_send_thread(struct rtmp_dest *dest)
+{
+	os_event_wait(dest->stopped_event);
+	rtmp_stream_dest_join(dest->stream);
+	return dest->stop_code;
+}
+
+static inline bool can_retry(int code)
+{
+	return code == OBS_OUTPUT_DISCONNECTED ||
+	       code == OBS_OUTPUT_CONNECT_FAILED;
+}
+
+/* the last destination to finish ends the output */
+static void dest_finished(struct rtmp_multi_stream *multi, int code)
+{
+	if (os_atomic_dec_long(&multi->running) > 0)
+		return;
+
+	os_atomic_set_bool(&multi->active, false);
+
+	if (os_atomic_load_bool(&multi->encode_error)) {
+		obs_output_signal_stop(multi->output, OBS_OUTPUT_ENCODE_ERROR);
+	} else if (multi_stopping(multi)) {
+		obs_output_end_data_capture(multi->output);
+	} else {
+		/* every destination has already used up its own retries, so
+		 * do not let libobs start over with all of them */
+		if (code == OBS_OUTPUT_DISCONNECTED)
+			code = OBS_OUTPUT_CONNECT_FAILED;
+		obs_output_signal_stop(multi->output, code);
+	}
+}
+
+static void *dest_thread(void *data)
+{
+	struct rtmp_dest *dest = data;
+	struct rtmp_multi_stream *multi = dest->multi;
+	int retry_delay = multi->retry_delay_sec;
+	int retries = 0;
+	int code;
+
+	os_set_thread_name("rtmp-multi-stream: dest_thread");
+
+	for (;;) {
+		code = rtmp_stream_dest_connect(dest->stream, dest->url.array,
+						dest->key.array,
+						dest->username.array,
+						dest->password.array);
+
+		if (code == OBS_OUTPUT_SUCCESS) {
+			retries = 0;
+			retry_delay = multi->retry_delay_sec;
+
+			/* stopped while still connecting */
+			if (multi_stopping(multi))
+				rtmp_stream_dest_stop(dest->stream, 0);
+
+			code = wait_for_send_thread(dest);
+
+		} else if (rtmp_stream_dest_active(dest->stream)) {
+			/* failed after the send thread was started */
+			rtmp_stream_dest_stop(dest->stream, 0);
+			wait_for_send_thread(dest);
+		}
+
+		if (multi_stopping(multi) || !can_retry(code))
+			break;
+
+		if (retries++ == multi->max_retries) {
+			warn("Giving up on %s after %d retries",
+			     dest->url.array, multi->max_retries);
+			break;
+		}
+
+		info("Reconnecting to %s in %d seconds...", dest->url.array,
+		     retry_delay);
+
+		if (os_event_timedwait(multi->stop_event,
+				       (unsigned long)retry_delay * 1000) !=
+		    ETIMEDOUT)
+			break;
+
+		retry_delay *= 2;
+		if (retry_delay > MAX_RETRY_DELAY_SEC)
+			retry_delay = MAX_RETRY_DELAY_SEC;
+	}
+
+	dest_finished(multi, code);
+	return NULL;
+}
+
+static bool create_dests(struct rtmp_multi_stream *multi)
+{
+	obs_data_t *settings = obs_output_get_settings(multi->output);
+	obs_data_array_t *array =
+		obs_data_get_array(settings, OPT_DESTINATIONS);
+	size_t count = obs_data_array_count(array);
+	DARRAY(struct rtmp_dest *) dests;
+
+	multi->max_retries = (int)obs_data_get_int(settings, OPT_MAX_RETRIES);
+	multi->retry_delay_sec =
+		(int)obs_data_get_int(settings, OPT_RETRY_DELAY_SEC);
+	if (multi->retry_delay_sec < 1)
+		multi->retry_delay_sec = 1;
+
+	da_init(dests);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *item = obs_data_array_item(array, i);
+		struct rtmp_dest *dest = dest_create(multi, item);
+
+		if (dest)
+			da_push_back(dests, &dest);
+		obs_data_release(item);
+	}
+
+	pthread_mutex_lock(&multi->dests_mutex);
+	da_move(multi->dests, dests);
+	pthread_mutex_unlock(&multi->dests_mutex);
+
+	obs_data_array_release(array);
+	obs_data_release(settings);
+	return multi->dests.num > 0;
+}
+
+static bool rtmp_multi_stream_start(void *data)
+{
+	struct rtmp_multi_stream *multi = data;
+
+	if (!obs_output_can_begin_data_capture(multi->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(multi->output, 0))
+		return false;
+
+	/* threads of the previous run have all finished by now */
+	free_dests(multi);
+
+	if (!create_dests(multi)) {
+		warn("No destinations");
+		return false;
+	}
+
+	os_event_reset(multi->stop_event);
+	os_atomic_set_bool(&multi->encode_error, false);
+	os_atomic_set_long(&multi->running, (long)multi->dests.num);
+	os_atomic_set_bool(&multi->active, true);
+
+	/* destinations that are not connected yet simply skip packets, and
+	 * join at the next keyframe once they are */
+	obs_output_begin_data_capture(multi->output, 0);
+
+	for (size_t i = 0; i < multi->dests.num; i++) {
+		struct rtmp_dest *dest = multi->dests.array[i];
+
+		dest->thread_active =
+			pthread_create(&dest->thread, NULL, dest_thread,
+				       dest) == 0;
+		if (!dest->thread_active) {
+			warn("Failed to create thread for %s",
+			     dest->url.array);
+			dest_finished(multi, OBS_OUTPUT_ERROR);
+		}
+	}
+
+	return true;
+}
+
+static void rtmp_multi_stream_stop(void *data, uint64_t ts)
+{
+	struct rtmp_multi_stream *multi = data;
+
+	if (multi_active(multi))
+		stop_dests(multi, ts);
+	else
+		obs_output_signal_stop(multi->output, OBS_OUTPUT_SUCCESS);
+}
+
+static void rtmp_multi_stream_data(void *data, struct encoder_packet *packet)
+{
+	struct rtmp_multi_stream *multi = data;
+	struct encoder_packet parsed;
+
+	if (!multi_active(multi))
+		return;
+
+	/* encoder fail */
+	if (!packet) {
+		os_atomic_set_bool(&multi->encode_error, true);
+		os_event_signal(multi->stop_event);
+
+		pthread_mutex_lock(&multi->dests_mutex);
+		for (size_t i = 0; i < multi->dests.num; i++)
+			rtmp_stream_dest_encode_error(
+				multi->dests.array[i]->stream);
+		pthread_mutex_unlock(&multi->dests_mutex);
+		return;
+	}
+
+	/* parse once, every destination only takes a reference */
+	if (packet->type == OBS_ENCODER_VIDEO)
+		obs_parse_avc_packet(&parsed, packet);
+	else
+		obs_encoder_packet_ref(&parsed, packet);
+
+	pthread_mutex_lock(&multi->dests_mutex);
+	for (size_t i = 0; i < multi->dests.num; i++)
+		rtmp_stream_dest_packet(multi->dests.array[i]->stream, &parsed);
+	pthread_mutex_unlock(&multi->dests_mutex);
+
+	obs_encoder_packet_release(&parsed);
+}
+
+static void rtmp_multi_stream_defaults(obs_data_t *defaults)
+{
+	rtmp_stream_defaults(defaults);
+	obs_data_set_default_int(defaults, OPT_MAX_RETRIES, 20);
+	obs_data_set_default_int(defaults, OPT_RETRY_DELAY_SEC, 10);
+}
+
+static obs_properties_t *rtmp_multi_stream_properties(void *unused)
+{
+	obs_properties_t *props = rtmp_stream_properties(unused);
+
+	obs_properties_add_int(props, OPT_MAX_RETRIES,
+			       obs_module_text("RTMPMultiStream.MaxRetries"),
+			       0, 10000, 1);
+	obs_properties_add_int(props, OPT_RETRY_DELAY_SEC,
+			       obs_module_text("RTMPMultiStream.RetryDelay"),
+			       1, 30, 1);
+
+	return props;
+}
+
+static uint64_t rtmp_multi_stream_total_bytes_sent(void *data)
+{
+	struct rtmp_multi_stream *multi = data;
+	uint64_t total = 0;
+
+	pthread_mutex_lock(&multi->dests_mutex);
+	for (size_t i = 0; i < multi->dests.num; i++)
+		total += multi->dests.array[i]->stream->total_bytes_sent;
+	pthread_mutex_unlock(&multi->dests_mutex);
+	return total;
+}
+
+static int rtmp_multi_stream_dropped_frames(void *data)
+{
+	struct rtmp_multi_stream *multi = data;
+	int dropped = 0;
+
+	pthread_mutex_lock(&multi->dests_mutex);
+	for (size_t i = 0; i < multi->dests.num; i++)
+		dropped += multi->dests.array[i]->stream->dropped_frames;
+	pthread_mutex_unlock(&multi->dests_mutex);
+	return dropped;
+}
+
+/* reports the most congested destination */
+static float rtmp_multi_stream_congestion(void *data)
+{
+	struct rtmp_multi_stream *multi = data;
+	float congestion = 0.0f;
+
+	pthread_mutex_lock(&multi->dests_mutex);
+	for (size_t i = 0; i < multi->dests.num; i++) {
+		float val = rtmp_stream_dest_congestion(
+			multi->dests.array[i]->stream);
+		if (val > congestion)
+			congestion = val;
+	}
+	pthread_mutex_unlock(&multi->dests_mutex);
+	return congestion;
+}
+
+static int rtmp_multi_stream_connect_time(void *data)
+{
+	struct rtmp_multi_stream *multi = data;
+	int connect_time = 0;
+
+	pthread_mutex_lock(&multi->dests_mutex);
+	for (size_t i = 0; i < multi->dests.num; i++) {
+		int val = rtmp_stream_dest_connect_time(
+			multi->dests.array[i]->stream);
+		if (val > connect_time)
+			connect_time = val;
+	}
+	pthread_mutex_unlock(&multi->dests_mutex);
+	return connect_time;
+}
+
+struct obs_output_info rtmp_multi_output_info = {
+	.id = "rtmp_multi_output",
+	.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED | OBS_OUTPUT_MULTI_TRACK,
+	.encoded_video_codecs = "h264",
+	.encoded_audio_codecs = "aac",
+	.get_name = rtmp_multi_stream_getname,
+	.create = rtmp_multi_stream_create,
+	.destroy = rtmp_multi_stream_destroy,
+	.start = rtmp_multi_stream_start,
+	.stop = rtmp_multi_stream_stop,
+	.encoded_packet = rtmp_multi_stream_data,
+	.get_defaults = rtmp_multi_stream_defaults,
+	.get_properties = rtmp_multi_stream_properties,
+	.get_total_bytes = rtmp_multi_stream_total_bytes_sent,
+	.get_congestion = rtmp_multi_stream_congestion,
+	.get_connect_time_ms = rtmp_multi_stream_connect_time,
+	.get_dropped_frames = rtmp_multi_stream_dropped_frames,
+};
@@ -31,9 +31,6 @@
 
 /* dynamic bitrate coefficients */
 #define DBR_INC_TIMER (30ULL * SEC_TO_NSEC)
-#define DBR_TRIGGER_USEC (200ULL * MSEC_TO_USEC)
-#define MIN_ESTIMATE_DURATION_MS 1000
-#define MAX_ESTIMATE_DURATION_MS 2000
 
 static const char *rtmp_stream_getname(void *unused)
 {
@@ -105,7 +102,8 @@ static void rtmp_stream_destroy(void *data)
 
 		if (active(stream)) {
 			os_sem_post(stream->send_sem);
-			obs_output_end_data_capture(stream->output);
+			if (!stream->dest_stopped)
+				obs_output_end_data_capture(stream->output);
 			pthread_join(stream->send_thread, NULL);
 		}
 	}
@@ -122,10 +120,11 @@ static void rtmp_stream_destroy(void *data)
 	os_sem_destroy(stream->send_sem);
 	pthread_mutex_destroy(&stream->packets_mutex);
 	circlebuf_free(&stream->packets);
+	array_output_serializer_free(&stream->tag_buf);
 #ifdef TEST_FRAMEDROPS
 	circlebuf_free(&stream->droptest_info);
 #endif
-	circlebuf_free(&stream->dbr_frames);
+	dbr_estimator_free(&stream->dbr_est);
 	pthread_mutex_destroy(&stream->dbr_mutex);
 
 	os_event_destroy(stream->buffer_space_available_event);
@@ -134,16 +133,23 @@ static void rtmp_stream_destroy(void *data)
 	os_event_destroy(stream->send_thread_signaled_exit);
 	pthread_mutex_destroy(&stream->write_buf_mutex);
 
+#ifdef __linux__
+	socket_thread_linux_free(stream);
+#endif
+
 	if (stream->write_buf)
 		bfree(stream->write_buf);
 	bfree(stream);
 }
 
-static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
+static struct rtmp_stream *rtmp_stream_alloc(obs_output_t *output)
 {
 	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
 	stream->output = output;
 	pthread_mutex_init_value(&stream->packets_mutex);
+#ifdef __linux__
+	stream->socket_wake_fd = -1;
+#endif
 
 	RTMP_LogSetCallback(log_rtmp);
 	RTMP_Init(&stream->rtmp);
@@ -185,7 +191,6 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 		goto fail;
 	}
 
-	UNUSED_PARAMETER(settings);
 	return stream;
 
 fail:
@@ -193,6 +198,36 @@ fail:
 	return NULL;
 }
 
+static void get_dbr_stats(void *data, calldata_t *cd)
+{
+	struct rtmp_stream *stream = data;
+
+	pthread_mutex_lock(&stream->dbr_mutex);
+	calldata_set_int(cd, "bandwidth", stream->dbr_bandwidth);
+	calldata_set_int(cd, "queue_delay_ms",
+			 stream->dbr_queue_delay_usec / 1000);
+	calldata_set_int(cd, "video_bitrate", stream->dbr_cur_bitrate);
+	calldata_set_int(cd, "audio_bitrate", stream->audio_bitrate);
+	pthread_mutex_unlock(&stream->dbr_mutex);
+}
+
+static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct rtmp_stream *stream = rtmp_stream_alloc(output);
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+
+	if (stream)
+		proc_handler_add(ph,
+				 "void get_dbr_stats(out int bandwidth, "
+				 "out int queue_delay_ms, "
+				 "out int video_bitrate, "
+				 "out int audio_bitrate)",
+				 get_dbr_stats, stream);
+
+	UNUSED_PARAMETER(settings);
+	return stream;
+}
+
 static void rtmp_stream_stop(void *data, uint64_t ts)
 {
 	struct rtmp_stream *stream = data;
@@ -214,7 +249,7 @@ static void rtmp_stream_stop(void *data, uint64_t ts)
 		os_event_signal(stream->stop_event);
 		if (stream->stop_ts == 0)
 			os_sem_post(stream->send_sem);
-	} else {
+	} else if (!stream->dest_stopped) {
 		obs_output_signal_stop(stream->output, OBS_OUTPUT_SUCCESS);
 	}
 }
@@ -363,12 +398,26 @@ static void droptest_cap_data_rate(struct rtmp_stream *stream, size_t size)
 }
 #endif
 
-static int socket_queue_data(RTMPSockBuf *sb, const char *data, int len,
-			     void *arg)
+static inline void signal_socket_thread(struct rtmp_stream *stream)
+{
+	os_event_signal(stream->buffer_has_data_event);
+#ifdef __linux__
+	socket_thread_linux_wake(stream);
+#endif
+}
+
+/* the chunk headers and the packet payload are queued straight from the
+ * buffers RTMP_WriteV got, without joining them first */
+static int socket_queue_data_v(RTMPSockBuf *sb, const AVal *parts, int count,
+			       void *arg)
 {
 	UNUSED_PARAMETER(sb);
 
 	struct rtmp_stream *stream = arg;
+	int len = 0;
+
+	for (int i = 0; i < count; i++)
+		len += parts[i].av_len;
 
 retry_send:
 
@@ -377,7 +426,7 @@ retry_send:
 
 	pthread_mutex_lock(&stream->write_buf_mutex);
 
-	if (stream->write_buf_len + len > stream->write_buf_size) {
+	if ((size_t)len > write_buf_free_space(stream)) {
 
 		pthread_mutex_unlock(&stream->write_buf_mutex);
 
@@ -388,21 +437,30 @@ retry_send:
 		goto retry_send;
 	}
 
-	memcpy(stream->write_buf + stream->write_buf_len, data, len);
-	stream->write_buf_len += len;
+	for (int i = 0; i < count; i++)
+		write_buf_push(stream, parts[i].av_val, parts[i].av_len);
 
 	pthread_mutex_unlock(&stream->write_buf_mutex);
 
-	os_event_signal(stream->buffer_has_data_event);
+	signal_socket_thread(stream);
 
 	return len;
 }
 
+static int socket_queue_data(RTMPSockBuf *sb, const char *data, int len,
+			     void *arg)
+{
+	AVal part = {(char *)data, len};
+
+	return socket_queue_data_v(sb, &part, 1, arg);
+}
+
 static int send_packet(struct rtmp_stream *stream,
 		       struct encoder_packet *packet, bool is_header,
 		       size_t idx)
 {
-	uint8_t *data;
+	struct flv_tag tag;
+	AVal parts[3];
 	size_t size;
 	int recv_size = 0;
 	int ret = 0;
@@ -424,25 +482,42 @@ static int send_packet(struct rtmp_stream *stream,
 	}
 
 	if (idx > 0) {
-		flv_additional_packet_mux(
-			packet, is_header ? 0 : stream->start_dts_offset, &data,
-			&size, is_header, idx);
+		flv_additional_packet_mux_tag(
+			&stream->tag_buf, packet,
+			is_header ? 0 : stream->start_dts_offset, is_header,
+			idx, &tag);
 	} else {
-		flv_packet_mux(packet, is_header ? 0 : stream->start_dts_offset,
-			       &data, &size, is_header);
+		flv_packet_mux_tag(&stream->tag_buf, packet,
+				   is_header ? 0 : stream->start_dts_offset,
+				   is_header, &tag);
 	}
 
+	size = flv_tag_size(&tag);
+
+	if (!is_header)
+		obs_output_trace_packet(stream->output, packet,
+					OBS_PACKET_TRACE_MUXED);
+
 #ifdef TEST_FRAMEDROPS
 	droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
-	bfree(data);
+	parts[0].av_val = (char *)tag.header;
+	parts[0].av_len = (int)tag.header_size;
+	parts[1].av_val = (char *)tag.payload;
+	parts[1].av_len = (int)tag.payload_size;
+	parts[2].av_val = (char *)tag.trailer;
+	parts[2].av_len = (int)tag.trailer_size;
+
+	ret = RTMP_WriteV(&stream->rtmp, parts, 3, 0);
 
-	if (is_header)
+	if (is_header) {
 		bfree(packet->data);
-	else
+	} else {
+		obs_output_trace_packet(stream->output, packet,
+					OBS_PACKET_TRACE_SENT);
 		obs_encoder_packet_release(packet);
+	}
 
 	stream->total_bytes_sent += size;
 	return ret;
@@ -536,29 +611,14 @@ static void set_output_error(struct rtmp_stream *stream)
 		obs_output_set_last_error(stream->output, msg);
 }
 
-static void dbr_add_frame(struct rtmp_stream *stream, struct dbr_frame *back)
+static void dbr_add_frame(struct rtmp_stream *stream,
+			  const struct dbr_sample *sample)
 {
-	struct dbr_frame front;
-	uint64_t dur;
+	dbr_estimator_add_sample(&stream->dbr_est, sample);
 
-	circlebuf_push_back(&stream->dbr_frames, back, sizeof(*back));
-	circlebuf_peek_front(&stream->dbr_frames, &front, sizeof(front));
-
-	stream->dbr_data_size += back->size;
-
-	dur = (back->send_end - front.send_beg) / 1000000;
-
-	if (dur >= MAX_ESTIMATE_DURATION_MS) {
-		stream->dbr_data_size -= front.size;
-		circlebuf_pop_front(&stream->dbr_frames, NULL, sizeof(front));
-	}
-
-	stream->dbr_est_bitrate =
-		(dur >= MIN_ESTIMATE_DURATION_MS)
-			? (long)(stream->dbr_data_size * 1000 / dur)
-			: 0;
-	stream->dbr_est_bitrate *= 8;
-	stream->dbr_est_bitrate /= 1000;
+	stream->dbr_bandwidth = dbr_estimator_bandwidth(&stream->dbr_est);
+	stream->dbr_queue_delay_usec = sample->queue_delay_usec;
+	stream->dbr_est_bitrate = stream->dbr_bandwidth;
 
 	if (stream->dbr_est_bitrate) {
 		stream->dbr_est_bitrate -= stream->audio_bitrate;
@@ -569,6 +629,14 @@ static void dbr_add_frame(struct rtmp_stream *stream, struct dbr_frame *back)
 
 static void dbr_set_bitrate(struct rtmp_stream *stream);
 
+/* only the send thread changes the bitrate, but get_dbr_stats reads it */
+static inline void dbr_store_bitrate(struct rtmp_stream *stream, long bitrate)
+{
+	pthread_mutex_lock(&stream->dbr_mutex);
+	stream->dbr_cur_bitrate = bitrate;
+	pthread_mutex_unlock(&stream->dbr_mutex);
+}
+
 static void *send_thread(void *data)
 {
 	struct rtmp_stream *stream = data;
@@ -577,7 +645,7 @@ static void *send_thread(void *data)
 
 	while (os_sem_wait(stream->send_sem) == 0) {
 		struct encoder_packet packet;
-		struct dbr_frame dbr_frame;
+		struct dbr_sample dbr_sample;
 
 		if (stopping(stream) && stream->stop_ts == 0) {
 			break;
@@ -601,8 +669,11 @@ static void *send_thread(void *data)
 		}
 
 		if (stream->dbr_enabled) {
-			dbr_frame.send_beg = os_gettime_ns();
-			dbr_frame.size = packet.size;
+			dbr_sample.send_beg = os_gettime_ns();
+			dbr_sample.size = packet.size;
+			dbr_sample.queue_delay_usec =
+				(int64_t)(dbr_sample.send_beg / 1000) -
+				packet.sys_dts_usec;
 		}
 
 		if (send_packet(stream, &packet, false, packet.track_idx) < 0) {
@@ -611,15 +682,16 @@ static void *send_thread(void *data)
 		}
 
 		if (stream->dbr_enabled) {
-			dbr_frame.send_end = os_gettime_ns();
+			dbr_sample.send_end = os_gettime_ns();
 
 			pthread_mutex_lock(&stream->dbr_mutex);
-			dbr_add_frame(stream, &dbr_frame);
+			dbr_add_frame(stream, &dbr_sample);
 			pthread_mutex_unlock(&stream->dbr_mutex);
 		}
 	}
 
 	bool encode_error = os_atomic_load_bool(&stream->encode_error);
+	int dest_code = OBS_OUTPUT_SUCCESS;
 
 	if (disconnected(stream)) {
 		info("Disconnected from %s", stream->path.array);
@@ -631,16 +703,25 @@ static void *send_thread(void *data)
 
 	if (stream->new_socket_loop) {
 		os_event_signal(stream->send_thread_signaled_exit);
-		os_event_signal(stream->buffer_has_data_event);
+		signal_socket_thread(stream);
 		pthread_join(stream->socket_thread, NULL);
 		stream->socket_thread_active = false;
 		stream->rtmp.m_bCustomSend = false;
+#ifdef __linux__
+		socket_thread_linux_free(stream);
+#endif
 	}
 
 	set_output_error(stream);
 	RTMP_Close(&stream->rtmp);
 
-	if (!stopping(stream)) {
+	if (stream->dest_stopped) {
+		/* reported to the owning output once everything is reset */
+		if (!stopping(stream))
+			dest_code = OBS_OUTPUT_DISCONNECTED;
+		else if (encode_error)
+			dest_code = OBS_OUTPUT_ENCODE_ERROR;
+	} else if (!stopping(stream)) {
 		pthread_detach(stream->send_thread);
 		obs_output_signal_stop(stream->output, OBS_OUTPUT_DISCONNECTED);
 	} else if (encode_error) {
@@ -649,6 +730,7 @@ static void *send_thread(void *data)
 		obs_output_end_data_capture(stream->output);
 	}
 
+	os_atomic_set_bool(&stream->dest_ready, false);
 	free_packets(stream);
 	os_event_reset(stream->stop_event);
 	os_atomic_set_bool(&stream->active, false);
@@ -657,11 +739,14 @@ static void *send_thread(void *data)
 	/* reset bitrate on stop */
 	if (stream->dbr_enabled) {
 		if (stream->dbr_cur_bitrate != stream->dbr_orig_bitrate) {
-			stream->dbr_cur_bitrate = stream->dbr_orig_bitrate;
+			dbr_store_bitrate(stream, stream->dbr_orig_bitrate);
 			dbr_set_bitrate(stream);
 		}
 	}
 
+	if (stream->dest_stopped)
+		stream->dest_stopped(stream->dest_param, dest_code);
+
 	return NULL;
 }
 
@@ -857,10 +942,22 @@ static int init_send(struct rtmp_stream *stream)
 
 		stream->write_buf_size = ideal_buffer_size;
 		stream->write_buf = bmalloc(ideal_buffer_size);
+		stream->write_buf_start = 0;
+		stream->write_buf_len = 0;
+		stream->write_buf_pinned = 0;
 
 #ifdef _WIN32
 		ret = pthread_create(&stream->socket_thread, NULL,
 				     socket_thread_windows, stream);
+#elif defined(__linux__)
+		if (!socket_thread_linux_init(stream)) {
+			RTMP_Close(&stream->rtmp);
+			warn("Failed to create socket wake event");
+			return OBS_OUTPUT_ERROR;
+		}
+
+		ret = pthread_create(&stream->socket_thread, NULL,
+				     socket_thread_linux, stream);
 #else
 		warn("New socket loop not supported on this platform");
 		return OBS_OUTPUT_ERROR;
@@ -875,6 +972,7 @@ static int init_send(struct rtmp_stream *stream)
 		stream->socket_thread_active = true;
 		stream->rtmp.m_bCustomSend = true;
 		stream->rtmp.m_customSendFunc = socket_queue_data;
+		stream->rtmp.m_customSendVFunc = socket_queue_data_v;
 		stream->rtmp.m_customSendParam = stream;
 	}
 
@@ -898,7 +996,10 @@ static int init_send(struct rtmp_stream *stream)
 		return OBS_OUTPUT_DISCONNECTED;
 	}
 
-	obs_output_begin_data_capture(stream->output, 0);
+	if (stream->dest_stopped)
+		os_atomic_set_bool(&stream->dest_ready, true);
+	else
+		obs_output_begin_data_capture(stream->output, 0);
 
 	return OBS_OUTPUT_SUCCESS;
 }
@@ -1030,7 +1131,7 @@ static int try_connect(struct rtmp_stream *stream)
 
 static bool init_connect(struct rtmp_stream *stream)
 {
-	obs_service_t *service;
+	obs_service_t *service = NULL;
 	obs_data_t *settings;
 	const char *bind_ip;
 	int64_t drop_p;
@@ -1043,22 +1144,34 @@ static bool init_connect(struct rtmp_stream *stream)
 
 	free_packets(stream);
 
-	service = obs_output_get_service(stream->output);
-	if (!service)
-		return false;
+	/* destinations of a multi destination output get their URL and key
+	 * from that output instead of a service */
+	if (!stream->dest_stopped) {
+		service = obs_output_get_service(stream->output);
+		if (!service)
+			return false;
+	}
 
 	os_atomic_set_bool(&stream->disconnected, false);
+	os_atomic_set_bool(&stream->dest_ready, false);
 	os_atomic_set_bool(&stream->encode_error, false);
 	stream->total_bytes_sent = 0;
 	stream->dropped_frames = 0;
 	stream->min_priority = 0;
+
+	pthread_mutex_lock(&stream->packets_mutex);
 	stream->got_first_video = false;
+	pthread_mutex_unlock(&stream->packets_mutex);
 
 	settings = obs_output_get_settings(stream->output);
-	dstr_copy(&stream->path, obs_service_get_url(service));
-	dstr_copy(&stream->key, obs_service_get_key(service));
-	dstr_copy(&stream->username, obs_service_get_username(service));
-	dstr_copy(&stream->password, obs_service_get_password(service));
+	if (!stream->dest_stopped) {
+		dstr_copy(&stream->path, obs_service_get_url(service));
+		dstr_copy(&stream->key, obs_service_get_key(service));
+		dstr_copy(&stream->username,
+			  obs_service_get_username(service));
+		dstr_copy(&stream->password,
+			  obs_service_get_password(service));
+	}
 	dstr_depad(&stream->path);
 	dstr_depad(&stream->key);
 	drop_b = (int64_t)obs_data_get_int(settings, OPT_DROP_THRESHOLD);
@@ -1071,11 +1184,16 @@ static bool init_connect(struct rtmp_stream *stream)
 	obs_data_t *vsettings = obs_encoder_get_settings(venc);
 	obs_data_t *asettings = obs_encoder_get_settings(aenc);
 
-	circlebuf_free(&stream->dbr_frames);
+	dbr_estimator_free(&stream->dbr_est);
+	dbr_estimator_init(&stream->dbr_est,
+			   obs_data_get_string(settings, OPT_DBR_ESTIMATOR));
+	pthread_mutex_lock(&stream->dbr_mutex);
 	stream->audio_bitrate = (long)obs_data_get_int(asettings, "bitrate");
-	stream->dbr_data_size = 0;
+	stream->dbr_bandwidth = 0;
+	stream->dbr_queue_delay_usec = 0;
 	stream->dbr_orig_bitrate = (long)obs_data_get_int(vsettings, "bitrate");
 	stream->dbr_cur_bitrate = stream->dbr_orig_bitrate;
+	pthread_mutex_unlock(&stream->dbr_mutex);
 	stream->dbr_est_bitrate = 0;
 	stream->dbr_inc_bitrate = stream->dbr_orig_bitrate / 10;
 	stream->dbr_inc_timeout = 0;
@@ -1090,8 +1208,14 @@ static bool init_connect(struct rtmp_stream *stream)
 		stream->dbr_enabled = false;
 	}
 
+	/* the encoders are shared with the other destinations */
+	if (stream->dest_stopped) {
+		stream->dbr_enabled = false;
+	}
+
 	if (stream->dbr_enabled) {
 		info("Dynamic bitrate enabled.  Dropped frames begone!");
+		info("Dynamic bitrate estimator: %s", stream->dbr_est.info->id);
 	}
 
 	obs_data_release(vsettings);
@@ -1239,9 +1363,7 @@ static bool dbr_bitrate_lowered(struct rtmp_stream *stream)
 
 	if (stream->dbr_est_bitrate &&
 	    stream->dbr_est_bitrate < stream->dbr_cur_bitrate) {
-		stream->dbr_data_size = 0;
-		circlebuf_pop_front(&stream->dbr_frames, NULL,
-				    stream->dbr_frames.size);
+		dbr_estimator_reset(&stream->dbr_est);
 		est_bitrate = stream->dbr_est_bitrate / 100 * 100;
 		if (est_bitrate < 50) {
 			est_bitrate = 50;
@@ -1288,7 +1410,7 @@ static bool dbr_bitrate_lowered(struct rtmp_stream *stream)
 #endif
 
 	stream->dbr_prev_bitrate = 0;
-	stream->dbr_cur_bitrate = new_bitrate;
+	dbr_store_bitrate(stream, new_bitrate);
 	stream->dbr_inc_timeout = os_gettime_ns() + DBR_INC_TIMER;
 	info("bitrate decreased to: %ld", stream->dbr_cur_bitrate);
 	return true;
@@ -1307,18 +1429,19 @@ static void dbr_set_bitrate(struct rtmp_stream *stream)
 
 static void dbr_inc_bitrate(struct rtmp_stream *stream)
 {
+	long new_bitrate = stream->dbr_cur_bitrate + stream->dbr_inc_bitrate;
+
 	stream->dbr_prev_bitrate = stream->dbr_cur_bitrate;
-	stream->dbr_cur_bitrate += stream->dbr_inc_bitrate;
 
-	if (stream->dbr_cur_bitrate >= stream->dbr_orig_bitrate) {
-		stream->dbr_cur_bitrate = stream->dbr_orig_bitrate;
-		info("bitrate increased to: %ld, done",
-		     stream->dbr_cur_bitrate);
-	} else if (stream->dbr_cur_bitrate < stream->dbr_orig_bitrate) {
+	if (new_bitrate >= stream->dbr_orig_bitrate) {
+		new_bitrate = stream->dbr_orig_bitrate;
+		info("bitrate increased to: %ld, done", new_bitrate);
+	} else {
 		stream->dbr_inc_timeout = os_gettime_ns() + DBR_INC_TIMER;
-		info("bitrate increased to: %ld, waiting",
-		     stream->dbr_cur_bitrate);
+		info("bitrate increased to: %ld, waiting", new_bitrate);
 	}
+
+	dbr_store_bitrate(stream, new_bitrate);
 }
 
 static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
@@ -1373,11 +1496,11 @@ static void check_to_drop_frames(struct rtmp_stream *stream, bool pframes)
 			return;
 		}
 
-		if ((uint64_t)buffer_duration_usec >= DBR_TRIGGER_USEC) {
-			pthread_mutex_lock(&stream->dbr_mutex);
+		pthread_mutex_lock(&stream->dbr_mutex);
+		if (dbr_estimator_congested(&stream->dbr_est,
+					    buffer_duration_usec))
 			bitrate_changed = dbr_bitrate_lowered(stream);
-			pthread_mutex_unlock(&stream->dbr_mutex);
-		}
+		pthread_mutex_unlock(&stream->dbr_mutex);
 
 		if (bitrate_changed) {
 			debug("buffer_duration_msec: %" PRId64,
@@ -1412,11 +1535,31 @@ static bool add_video_packet(struct rtmp_stream *stream,
 	return add_packet(stream, packet);
 }
 
+static void queue_packet(struct rtmp_stream *stream,
+			 struct encoder_packet *packet)
+{
+	bool added_packet = false;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+
+	if (!disconnected(stream)) {
+		added_packet = (packet->type == OBS_ENCODER_VIDEO)
+				       ? add_video_packet(stream, packet)
+				       : add_packet(stream, packet);
+	}
+
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	if (added_packet)
+		os_sem_post(stream->send_sem);
+	else
+		obs_encoder_packet_release(packet);
+}
+
 static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 {
 	struct rtmp_stream *stream = data;
 	struct encoder_packet new_packet;
-	bool added_packet = false;
 
 	if (disconnected(stream) || !active(stream))
 		return;
@@ -1440,23 +1583,10 @@ static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 		obs_encoder_packet_ref(&new_packet, packet);
 	}
 
-	pthread_mutex_lock(&stream->packets_mutex);
-
-	if (!disconnected(stream)) {
-		added_packet = (packet->type == OBS_ENCODER_VIDEO)
-				       ? add_video_packet(stream, &new_packet)
-				       : add_packet(stream, &new_packet);
-	}
-
-	pthread_mutex_unlock(&stream->packets_mutex);
-
-	if (added_packet)
-		os_sem_post(stream->send_sem);
-	else
-		obs_encoder_packet_release(&new_packet);
+	queue_packet(stream, &new_packet);
 }
 
-static void rtmp_stream_defaults(obs_data_t *defaults)
+void rtmp_stream_defaults(obs_data_t *defaults)
 {
 	obs_data_set_default_int(defaults, OPT_DROP_THRESHOLD, 700);
 	obs_data_set_default_int(defaults, OPT_PFRAME_DROP_THRESHOLD, 900);
@@ -1464,9 +1594,11 @@ static void rtmp_stream_defaults(obs_data_t *defaults)
 	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
 	obs_data_set_default_bool(defaults, OPT_NEWSOCKETLOOP_ENABLED, false);
 	obs_data_set_default_bool(defaults, OPT_LOWLATENCY_ENABLED, false);
+	obs_data_set_default_string(defaults, OPT_DBR_ESTIMATOR,
+				    DBR_DEFAULT_ESTIMATOR);
 }
 
-static obs_properties_t *rtmp_stream_properties(void *unused)
+obs_properties_t *rtmp_stream_properties(void *unused)
 {
 	UNUSED_PARAMETER(unused);
 
@@ -1497,6 +1629,16 @@ static obs_properties_t *rtmp_stream_properties(void *unused)
 	obs_properties_add_bool(props, OPT_LOWLATENCY_ENABLED,
 				obs_module_text("RTMPStream.LowLatencyMode"));
 
+	p = obs_properties_add_list(props, OPT_DBR_ESTIMATOR,
+				    obs_module_text("RTMPStream.DBREstimator"),
+				    OBS_COMBO_TYPE_LIST,
+				    OBS_COMBO_FORMAT_STRING);
+
+	const struct dbr_estimator_info *est;
+	for (size_t i = 0; (est = dbr_enum_estimators(i)) != NULL; i++)
+		obs_property_list_add_string(p, obs_module_text(est->name),
+					     est->id);
+
 	return props;
 }
 
@@ -1529,6 +1671,113 @@ static int rtmp_stream_connect_time(void *data)
 	return stream->rtmp.connect_time_ms;
 }
 
+/* ------------------------------------------------------------------------- */
+/* destinations of rtmp_multi_output                                         */
+
+struct rtmp_stream *rtmp_stream_dest_create(obs_output_t *output,
+					    void (*stopped)(void *param,
+							    int code),
+					    void *param)
+{
+	struct rtmp_stream *stream = rtmp_stream_alloc(output);
+
+	if (stream) {
+		stream->dest_stopped = stopped;
+		stream->dest_param = param;
+	}
+	return stream;
+}
+
+void rtmp_stream_dest_destroy(struct rtmp_stream *stream)
+{
+	rtmp_stream_destroy(stream);
+}
+
+int rtmp_stream_dest_connect(struct rtmp_stream *stream, const char *url,
+			     const char *key, const char *username,
+			     const char *password)
+{
+	int ret;
+
+	dstr_copy(&stream->path, url);
+	dstr_copy(&stream->key, key);
+	dstr_copy(&stream->username, username);
+	dstr_copy(&stream->password, password);
+
+	if (!init_connect(stream))
+		return OBS_OUTPUT_BAD_PATH;
+
+	ret = try_connect(stream);
+
+	/* the connection is retried with the same RTMP object */
+	if (ret != OBS_OUTPUT_SUCCESS && !active(stream))
+		RTMP_Close(&stream->rtmp);
+	return ret;
+}
+
+void rtmp_stream_dest_stop(struct rtmp_stream *stream, uint64_t ts)
+{
+	rtmp_stream_stop(stream, ts);
+}
+
+void rtmp_stream_dest_join(struct rtmp_stream *stream)
+{
+	pthread_join(stream->send_thread, NULL);
+}
+
+bool rtmp_stream_dest_active(struct rtmp_stream *stream)
+{
+	return active(stream);
+}
+
+/* Video is held back until the first keyframe, so destinations that connect
+ * or reconnect mid-stream always start on a keyframe.  The packet is only
+ * referenced, the caller keeps its own reference. */
+void rtmp_stream_dest_packet(struct rtmp_stream *stream,
+			     struct encoder_packet *packet)
+{
+	struct encoder_packet new_packet;
+	bool got_first_video;
+
+	if (!os_atomic_load_bool(&stream->dest_ready) ||
+	    disconnected(stream) || !active(stream))
+		return;
+
+	/* init_connect resets got_first_video under the same mutex, and the
+	 * send thread only reads start_dts_offset for packets it popped
+	 * under it */
+	pthread_mutex_lock(&stream->packets_mutex);
+	if (!stream->got_first_video && packet->type == OBS_ENCODER_VIDEO &&
+	    packet->keyframe) {
+		stream->start_dts_offset = get_ms_time(packet, packet->dts);
+		stream->got_first_video = true;
+	}
+	got_first_video = stream->got_first_video;
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	if (!got_first_video)
+		return;
+
+	obs_encoder_packet_ref(&new_packet, packet);
+	queue_packet(stream, &new_packet);
+}
+
+void rtmp_stream_dest_encode_error(struct rtmp_stream *stream)
+{
+	os_atomic_set_bool(&stream->encode_error, true);
+	rtmp_stream_stop(stream, 0);
+}
+
+float rtmp_stream_dest_congestion(struct rtmp_stream *stream)
+{
+	return active(stream) ? rtmp_stream_congestion(stream) : 0.0f;
+}
+
+int rtmp_stream_dest_connect_time(struct rtmp_stream *stream)
+{
+	return rtmp_stream_connect_time(stream);
+}
+
 struct obs_output_info rtmp_output_info = {
 	.id = "rtmp_output",
 	.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED | OBS_OUTPUT_SERVICE |
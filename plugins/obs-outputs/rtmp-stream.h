@@ -9,6 +9,7 @@
 #include "librtmp/log.h"
 #include "flv-mux.h"
 #include "net-if.h"
+#include "dbr-estimator.h"
 
 #ifdef _WIN32
 #include <Iphlpapi.h>
@@ -25,6 +26,7 @@
 #define debug(format, ...) do_log(LOG_DEBUG, format, ##__VA_ARGS__)
 
 #define OPT_DYN_BITRATE "dyn_bitrate"
+#define OPT_DBR_ESTIMATOR "dbr_estimator"
 #define OPT_DROP_THRESHOLD "drop_threshold_ms"
 #define OPT_PFRAME_DROP_THRESHOLD "pframe_drop_threshold_ms"
 #define OPT_MAX_SHUTDOWN_TIME_SEC "max_shutdown_time_sec"
@@ -47,12 +49,6 @@ struct droptest_info {
 };
 #endif
 
-struct dbr_frame {
-	uint64_t send_beg;
-	uint64_t send_end;
-	size_t size;
-};
-
 struct rtmp_stream {
 	obs_output_t *output;
 
@@ -83,6 +79,12 @@ struct rtmp_stream {
 	struct dstr encoder_name;
 	struct dstr bind_ip;
 
+	/* set when this stream is one destination of rtmp_multi_output, which
+	 * owns data capture and reconnecting instead of libobs */
+	void (*dest_stopped)(void *param, int code);
+	void *dest_param;
+	volatile bool dest_ready;
+
 	/* frame drop variables */
 	int64_t drop_threshold_usec;
 	int64_t pframe_drop_threshold_usec;
@@ -102,8 +104,9 @@ struct rtmp_stream {
 #endif
 
 	pthread_mutex_t dbr_mutex;
-	struct circlebuf dbr_frames;
-	size_t dbr_data_size;
+	struct dbr_estimator dbr_est;
+	long dbr_bandwidth;
+	int64_t dbr_queue_delay_usec;
 	uint64_t dbr_inc_timeout;
 	long audio_bitrate;
 	long dbr_est_bitrate;
@@ -115,21 +118,80 @@ struct rtmp_stream {
 
 	RTMP rtmp;
 
+	/* FLV tag headers, reused for every packet */
+	struct array_output_data tag_buf;
+
 	bool new_socket_loop;
 	bool low_latency_mode;
 	bool disable_send_window_optimization;
 	bool socket_thread_active;
 	pthread_t socket_thread;
 	uint8_t *write_buf;
+	size_t write_buf_start;
 	size_t write_buf_len;
+	size_t write_buf_pinned;
 	size_t write_buf_size;
 	pthread_mutex_t write_buf_mutex;
 	os_event_t *buffer_space_available_event;
 	os_event_t *buffer_has_data_event;
 	os_event_t *socket_available_event;
 	os_event_t *send_thread_signaled_exit;
+#ifdef __linux__
+	int socket_wake_fd;
+#endif
 };
 
+/* The socket loop's write buffer is a ring: write_buf_len bytes of unsent
+ * data begin at write_buf_start, and are preceded by write_buf_pinned bytes
+ * that have been handed to the kernel with MSG_ZEROCOPY but may still be
+ * referenced by it.  write_buf_mutex must be held. */
+static inline size_t write_buf_free_space(const struct rtmp_stream *stream)
+{
+	return stream->write_buf_size - stream->write_buf_len -
+	       stream->write_buf_pinned;
+}
+
+static inline void write_buf_push(struct rtmp_stream *stream,
+				  const void *data, size_t len)
+{
+	size_t pos = (stream->write_buf_start + stream->write_buf_len) %
+		     stream->write_buf_size;
+	size_t first = stream->write_buf_size - pos;
+
+	if (first > len)
+		first = len;
+
+	memcpy(stream->write_buf + pos, data, first);
+	memcpy(stream->write_buf, (const uint8_t *)data + first, len - first);
+	stream->write_buf_len += len;
+}
+
+void rtmp_stream_defaults(obs_data_t *defaults);
+obs_properties_t *rtmp_stream_properties(void *unused);
+
+/* used by rtmp_multi_output, see rtmp-multi-stream.c */
+struct rtmp_stream *rtmp_stream_dest_create(obs_output_t *output,
+					    void (*stopped)(void *param,
+							    int code),
+					    void *param);
+void rtmp_stream_dest_destroy(struct rtmp_stream *stream);
+int rtmp_stream_dest_connect(struct rtmp_stream *stream, const char *url,
+			     const char *key, const char *username,
+			     const char *password);
+void rtmp_stream_dest_stop(struct rtmp_stream *stream, uint64_t ts);
+void rtmp_stream_dest_join(struct rtmp_stream *stream);
+bool rtmp_stream_dest_active(struct rtmp_stream *stream);
+void rtmp_stream_dest_packet(struct rtmp_stream *stream,
+			     struct encoder_packet *packet);
+void rtmp_stream_dest_encode_error(struct rtmp_stream *stream);
+float rtmp_stream_dest_congestion(struct rtmp_stream *stream);
+int rtmp_stream_dest_connect_time(struct rtmp_stream *stream);
+
 #ifdef _WIN32
 void *socket_thread_windows(void *data);
+#elif defined(__linux__)
+void *socket_thread_linux(void *data);
+bool socket_thread_linux_init(struct rtmp_stream *stream);
+void socket_thread_linux_wake(struct rtmp_stream *stream);
+void socket_thread_linux_free(struct rtmp_stream *stream);
 #endif
@@ -0,0 +1,989 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET arq_socket_t;
+#define INVALID_ARQ_SOCKET INVALID_SOCKET
+#define close_socket closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <unistd.h>
+typedef int arq_socket_t;
+#define INVALID_ARQ_SOCKET -1
+#define close_socket close
+#endif
+
+#include <stdio.h>
+#include <util/base.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "udp-arq.h"
+
+#define ARQ_VERSION 1
+#define HEADER_SIZE 12
+#define FEC_SIZE (2 + ARQ_PAYLOAD_SIZE)
+#define MAX_DATAGRAM (HEADER_SIZE + FEC_SIZE)
+#define MAX_NAK_RANGES (ARQ_PAYLOAD_SIZE / 8)
+
+#define DEFAULT_BUFFER_PACKETS 8192
+#define FEC_SLOTS 256
+#define SOCKET_BUFFER_SIZE (4 * 1024 * 1024)
+
+#define POLL_INTERVAL_US 1000
+#define ACK_INTERVAL_US 10000
+#define MIN_NAK_INTERVAL_US 5000
+
+/* with fec the first nak waits a bit, so the parity packet of the group has
+ * a chance to arrive and repair the loss first */
+#define FEC_NAK_DELAY_US 10000
+
+#define FLAG_RETRANSMIT 0x01
+
+enum arq_type {
+	ARQ_DATA,
+	ARQ_FEC,
+	ARQ_NAK,
+	ARQ_ACK,
+	ARQ_ACKACK,
+};
+
+/* All fields big endian:
+ *
+ *   u8  version << 4 | type
+ *   u8  flags (data), group size (fec)
+ *   u16 payload size
+ *   u32 sequence number (data), first sequence number of the group (fec)
+ *   u32 sender time in microseconds, echoed back in ACKACK */
+struct arq_header {
+	uint8_t type;
+	uint8_t flags;
+	uint16_t size;
+	uint32_t seq;
+	uint32_t ts;
+};
+
+static inline void wb16(uint8_t *p, uint16_t val)
+{
+	p[0] = (uint8_t)(val >> 8);
+	p[1] = (uint8_t)val;
+}
+
+static inline void wb32(uint8_t *p, uint32_t val)
+{
+	p[0] = (uint8_t)(val >> 24);
+	p[1] = (uint8_t)(val >> 16);
+	p[2] = (uint8_t)(val >> 8);
+	p[3] = (uint8_t)val;
+}
+
+static inline uint16_t rb16(const uint8_t *p)
+{
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t rb32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void write_header(uint8_t *p, const struct arq_header *header)
+{
+	p[0] = (uint8_t)((ARQ_VERSION << 4) | header->type);
+	p[1] = header->flags;
+	wb16(p + 2, header->size);
+	wb32(p + 4, header->seq);
+	wb32(p + 8, header->ts);
+}
+
+static bool read_header(const uint8_t *p, size_t size,
+			struct arq_header *header)
+{
+	if (size < HEADER_SIZE || (p[0] >> 4) != ARQ_VERSION)
+		return false;
+
+	header->type = p[0] & 0x0f;
+	header->flags = p[1];
+	header->size = rb16(p + 2);
+	header->seq = rb32(p + 4);
+	header->ts = rb32(p + 8);
+
+	return header->size <= size - HEADER_SIZE &&
+	       header->size <= FEC_SIZE;
+}
+
+static inline uint64_t now_us(void)
+{
+	return os_gettime_ns() / 1000;
+}
+
+static inline bool seq_before(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) < 0;
+}
+
+static uint32_t buffer_packets(const struct arq_config *config)
+{
+	uint32_t wanted = config->buffer_packets ? config->buffer_packets
+						 : DEFAULT_BUFFER_PACKETS;
+	uint32_t size = 64;
+
+	while (size < wanted && size < (1U << 20))
+		size <<= 1;
+	return size;
+}
+
+static arq_socket_t open_socket(int family)
+{
+	int buf_size = SOCKET_BUFFER_SIZE;
+	arq_socket_t sock = socket(family, SOCK_DGRAM, IPPROTO_UDP);
+
+	if (sock == INVALID_ARQ_SOCKET)
+		return sock;
+
+	setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (const char *)&buf_size,
+		   sizeof(buf_size));
+	setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char *)&buf_size,
+		   sizeof(buf_size));
+	return sock;
+}
+
+static struct addrinfo *resolve(const char *host, int port, bool passive)
+{
+	struct addrinfo hints = {0};
+	struct addrinfo *result = NULL;
+	char port_str[16];
+
+	snprintf(port_str, sizeof(port_str), "%d", port);
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+	if (passive)
+		hints.ai_flags = AI_PASSIVE;
+
+	if (getaddrinfo(host, port_str, &hints, &result) != 0)
+		return NULL;
+	return result;
+}
+
+/* returns true if the socket became readable within timeout_us */
+static bool wait_readable(arq_socket_t sock, uint64_t timeout_us)
+{
+	struct timeval tv;
+	fd_set set;
+
+	FD_ZERO(&set);
+	FD_SET(sock, &set);
+	tv.tv_sec = (long)(timeout_us / 1000000);
+	tv.tv_usec = (long)(timeout_us % 1000000);
+
+	return select((int)sock + 1, &set, NULL, NULL, &tv) > 0;
+}
+
+/* deterministic, so tests with simulated loss are reproducible */
+static bool simulate_drop(const struct arq_config *config, uint32_t *state)
+{
+	if (config->simulated_loss <= 0.0)
+		return false;
+
+	*state = *state * 1103515245 + 12345;
+	return (double)((*state >> 16) % 10000) <
+	       config->simulated_loss * 100.0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* sender                                                                    */
+
+struct send_slot {
+	uint32_t seq;
+	uint64_t sent_ts;
+	size_t size;
+	uint8_t data[HEADER_SIZE + ARQ_PAYLOAD_SIZE];
+};
+
+struct arq_sender {
+	struct arq_config config;
+	arq_socket_t sock;
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+	uint64_t start_ts;
+
+	pthread_mutex_t mutex;
+	struct send_slot *slots;
+	uint32_t mask;
+	uint32_t next_seq;
+
+	uint8_t fec[FEC_SIZE];
+	uint32_t fec_base;
+	uint32_t fec_count;
+
+	uint32_t loss_state;
+	struct arq_stats stats;
+
+	pthread_t thread;
+	bool thread_active;
+	volatile bool stop;
+};
+
+static inline uint32_t sender_time(struct arq_sender *sender)
+{
+	return (uint32_t)(now_us() - sender->start_ts);
+}
+
+static void transmit(struct arq_sender *sender, const uint8_t *data,
+		     size_t size)
+{
+	if (simulate_drop(&sender->config, &sender->loss_state)) {
+		sender->stats.simulated_drops++;
+		return;
+	}
+
+	sendto(sender->sock, (const char *)data, (int)size, 0,
+	       (const struct sockaddr *)&sender->addr, sender->addr_len);
+}
+
+static void fec_add(struct arq_sender *sender, uint32_t seq,
+		    const uint8_t *data, size_t size)
+{
+	uint8_t packet[MAX_DATAGRAM];
+	struct arq_header header = {0};
+
+	if (!sender->config.fec_group)
+		return;
+
+	if (!sender->fec_count) {
+		memset(sender->fec, 0, sizeof(sender->fec));
+		sender->fec_base = seq;
+	}
+
+	sender->fec[0] ^= (uint8_t)(size >> 8);
+	sender->fec[1] ^= (uint8_t)size;
+	for (size_t i = 0; i < size; i++)
+		sender->fec[2 + i] ^= data[i];
+
+	if (++sender->fec_count < sender->config.fec_group)
+		return;
+
+	header.type = ARQ_FEC;
+	header.flags = (uint8_t)sender->fec_count;
+	header.size = FEC_SIZE;
+	header.seq = sender->fec_base;
+	header.ts = sender_time(sender);
+	write_header(packet, &header);
+	memcpy(packet + HEADER_SIZE, sender->fec, FEC_SIZE);
+
+	transmit(sender, packet, HEADER_SIZE + FEC_SIZE);
+	sender->stats.fec_packets++;
+	sender->fec_count = 0;
+}
+
+bool arq_sender_send(struct arq_sender *sender, const uint8_t *data,
+		     size_t size)
+{
+	pthread_mutex_lock(&sender->mutex);
+
+	while (size) {
+		size_t chunk = size < ARQ_PAYLOAD_SIZE ? size
+						       : ARQ_PAYLOAD_SIZE;
+		uint32_t seq = sender->next_seq++;
+		struct send_slot *slot = &sender->slots[seq & sender->mask];
+		struct arq_header header = {0};
+
+		header.type = ARQ_DATA;
+		header.size = (uint16_t)chunk;
+		header.seq = seq;
+		header.ts = sender_time(sender);
+
+		slot->seq = seq;
+		slot->sent_ts = now_us();
+		slot->size = HEADER_SIZE + chunk;
+		write_header(slot->data, &header);
+		memcpy(slot->data + HEADER_SIZE, data, chunk);
+
+		transmit(sender, slot->data, slot->size);
+		sender->stats.packets++;
+		sender->stats.bytes += chunk;
+
+		fec_add(sender, seq, data, chunk);
+
+		data += chunk;
+		size -= chunk;
+	}
+
+	pthread_mutex_unlock(&sender->mutex);
+	return true;
+}
+
+static void retransmit(struct arq_sender *sender, uint32_t seq, uint64_t now)
+{
+	struct send_slot *slot = &sender->slots[seq & sender->mask];
+	uint64_t latency_us = (uint64_t)sender->config.latency_ms * 1000;
+
+	if (slot->seq != seq || !slot->size)
+		return;
+
+	/* would arrive after the receiver gave up on it */
+	if (now - slot->sent_ts > latency_us)
+		return;
+
+	slot->data[1] |= FLAG_RETRANSMIT;
+	transmit(sender, slot->data, slot->size);
+	sender->stats.retransmitted++;
+}
+
+static void handle_nak(struct arq_sender *sender, const uint8_t *payload,
+		       size_t size)
+{
+	uint64_t now = now_us();
+
+	pthread_mutex_lock(&sender->mutex);
+	sender->stats.naks++;
+
+	for (size_t i = 0; i + 8 <= size; i += 8) {
+		uint32_t first = rb32(payload + i);
+		uint32_t last = rb32(payload + i + 4);
+		uint32_t count = last - first + 1;
+
+		if (!seq_before(last, sender->next_seq) ||
+		    count > sender->mask + 1)
+			continue;
+
+		for (uint32_t j = 0; j < count; j++)
+			retransmit(sender, first + j, now);
+	}
+
+	pthread_mutex_unlock(&sender->mutex);
+}
+
+static void handle_ack(struct arq_sender *sender,
+		       const struct arq_header *ack, const uint8_t *payload)
+{
+	uint8_t packet[HEADER_SIZE];
+	struct arq_header header = {0};
+
+	header.type = ARQ_ACKACK;
+	header.ts = ack->ts;
+	write_header(packet, &header);
+	sendto(sender->sock, (const char *)packet, HEADER_SIZE, 0,
+	       (const struct sockaddr *)&sender->addr, sender->addr_len);
+
+	if (ack->size < 20)
+		return;
+
+	pthread_mutex_lock(&sender->mutex);
+	sender->stats.rtt_ms = (int)(rb32(payload + 4) / 1000);
+	sender->stats.lost = rb32(payload + 8);
+	sender->stats.recovered_fec = rb32(payload + 12);
+	sender->stats.recovered_arq = rb32(payload + 16);
+	pthread_mutex_unlock(&sender->mutex);
+}
+
+static void *sender_thread(void *data)
+{
+	struct arq_sender *sender = data;
+	uint8_t buf[MAX_DATAGRAM];
+
+	os_set_thread_name("udp-arq: sender");
+
+	while (!os_atomic_load_bool(&sender->stop)) {
+		struct arq_header header;
+		int ret;
+
+		if (!wait_readable(sender->sock, ACK_INTERVAL_US))
+			continue;
+
+		ret = recvfrom(sender->sock, (char *)buf, sizeof(buf), 0, NULL,
+			       NULL);
+		if (ret <= 0 || !read_header(buf, (size_t)ret, &header))
+			continue;
+
+		if (header.type == ARQ_NAK)
+			handle_nak(sender, buf + HEADER_SIZE, header.size);
+		else if (header.type == ARQ_ACK)
+			handle_ack(sender, &header, buf + HEADER_SIZE);
+	}
+
+	return NULL;
+}
+
+struct arq_sender *arq_sender_create(const struct arq_config *config,
+				     const char *host, int port)
+{
+	struct arq_sender *sender = bzalloc(sizeof(struct arq_sender));
+	struct addrinfo *addr = resolve(host, port, false);
+	uint32_t size = buffer_packets(config);
+
+	pthread_mutex_init_value(&sender->mutex);
+	sender->sock = INVALID_ARQ_SOCKET;
+	sender->config = *config;
+	sender->config.fec_group = config->fec_group > 255 ? 255
+							   : config->fec_group;
+	sender->loss_state = config->simulated_loss_seed;
+	sender->stats.latency_ms = (int)config->latency_ms;
+	sender->start_ts = now_us();
+
+	if (!addr) {
+		blog(LOG_WARNING, "udp-arq: Failed to resolve '%s'", host);
+		goto fail;
+	}
+
+	memcpy(&sender->addr, addr->ai_addr, addr->ai_addrlen);
+	sender->addr_len = (socklen_t)addr->ai_addrlen;
+	sender->sock = open_socket(addr->ai_family);
+	freeaddrinfo(addr);
+
+	if (sender->sock == INVALID_ARQ_SOCKET)
+		goto fail;
+	if (pthread_mutex_init(&sender->mutex, NULL) != 0)
+		goto fail;
+
+	sender->slots = bzalloc(sizeof(struct send_slot) * size);
+	sender->mask = size - 1;
+
+	if (pthread_create(&sender->thread, NULL, sender_thread, sender) != 0)
+		goto fail;
+	sender->thread_active = true;
+
+	return sender;
+
+fail:
+	arq_sender_destroy(sender);
+	return NULL;
+}
+
+void arq_sender_destroy(struct arq_sender *sender)
+{
+	if (!sender)
+		return;
+
+	if (sender->thread_active) {
+		os_atomic_set_bool(&sender->stop, true);
+		pthread_join(sender->thread, NULL);
+	}
+
+	if (sender->sock != INVALID_ARQ_SOCKET)
+		close_socket(sender->sock);
+
+	pthread_mutex_destroy(&sender->mutex);
+	bfree(sender->slots);
+	bfree(sender);
+}
+
+void arq_sender_get_stats(struct arq_sender *sender, struct arq_stats *stats)
+{
+	pthread_mutex_lock(&sender->mutex);
+	*stats = sender->stats;
+	pthread_mutex_unlock(&sender->mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+/* receiver                                                                  */
+
+enum slot_state {
+	SLOT_EMPTY,
+	SLOT_MISSING,
+	SLOT_PRESENT,
+	SLOT_DELIVERED,
+};
+
+struct recv_slot {
+	uint32_t seq;
+	enum slot_state state;
+
+	/* for missing packets, the time of the packet that revealed the gap */
+	int64_t sender_ts;
+	uint64_t nak_ts;
+
+	size_t size;
+	uint8_t data[ARQ_PAYLOAD_SIZE];
+};
+
+struct fec_slot {
+	uint32_t base;
+	uint32_t count;
+	bool present;
+	uint8_t data[FEC_SIZE];
+};
+
+struct arq_receiver {
+	struct arq_config config;
+	arq_socket_t sock;
+	arq_receive_cb callback;
+	void *param;
+	uint64_t start_ts;
+
+	struct sockaddr_storage peer;
+	socklen_t peer_len;
+	bool have_peer;
+
+	struct recv_slot *slots;
+	uint32_t mask;
+	struct fec_slot fec[FEC_SLOTS];
+	uint32_t fec_group;
+
+	bool started;
+	uint32_t next_seq;
+	uint32_t end_seq;
+
+	/* local time minus sender time, the smallest one seen */
+	int64_t ts_offset;
+	int64_t last_sender_ts;
+
+	uint64_t last_ack_ts;
+	uint32_t rtt_us;
+
+	struct arq_stats stats;
+
+	pthread_mutex_t stats_mutex;
+	struct arq_stats published_stats;
+
+	pthread_t thread;
+	bool thread_active;
+	volatile bool stop;
+};
+
+static inline struct recv_slot *get_slot(struct arq_receiver *recv,
+					 uint32_t seq)
+{
+	return &recv->slots[seq & recv->mask];
+}
+
+static inline int64_t extend_ts(struct arq_receiver *recv, uint32_t ts)
+{
+	int64_t ext = recv->last_sender_ts +
+		      (int32_t)(ts - (uint32_t)recv->last_sender_ts);
+	if (ext > recv->last_sender_ts)
+		recv->last_sender_ts = ext;
+	return ext;
+}
+
+static inline uint32_t receiver_time(struct arq_receiver *recv)
+{
+	return (uint32_t)(now_us() - recv->start_ts);
+}
+
+static void send_to_peer(struct arq_receiver *recv, const uint8_t *data,
+			 size_t size)
+{
+	if (recv->have_peer)
+		sendto(recv->sock, (const char *)data, (int)size, 0,
+		       (const struct sockaddr *)&recv->peer, recv->peer_len);
+}
+
+/* marks everything up to end as missing, unless it was seen already */
+static void extend_window(struct arq_receiver *recv, uint32_t end,
+			  int64_t sender_ts, uint64_t now)
+{
+	uint64_t nak_delay = recv->fec_group ? FEC_NAK_DELAY_US : 0;
+
+	if (end - recv->next_seq > recv->mask + 1)
+		return;
+
+	while (seq_before(recv->end_seq, end)) {
+		struct recv_slot *slot = get_slot(recv, recv->end_seq);
+
+		slot->seq = recv->end_seq++;
+		slot->state = SLOT_MISSING;
+		slot->sender_ts = sender_ts;
+		slot->nak_ts = now + nak_delay;
+		slot->size = 0;
+	}
+}
+
+static bool slot_has_data(struct arq_receiver *recv, uint32_t seq)
+{
+	struct recv_slot *slot = get_slot(recv, seq);
+	return slot->seq == seq &&
+	       (slot->state == SLOT_PRESENT || slot->state == SLOT_DELIVERED);
+}
+
+static void try_fec(struct arq_receiver *recv, uint32_t base)
+{
+	struct fec_slot *fec;
+	struct recv_slot *target = NULL;
+	uint8_t data[FEC_SIZE];
+
+	if (!recv->fec_group)
+		return;
+
+	fec = &recv->fec[(base / recv->fec_group) % FEC_SLOTS];
+	if (!fec->present || fec->base != base)
+		return;
+
+	for (uint32_t i = 0; i < fec->count; i++) {
+		uint32_t seq = base + i;
+		struct recv_slot *slot = get_slot(recv, seq);
+
+		if (slot_has_data(recv, seq))
+			continue;
+		if (target || slot->seq != seq || slot->state != SLOT_MISSING)
+			return;
+		target = slot;
+	}
+
+	fec->present = false;
+	if (!target)
+		return;
+
+	memcpy(data, fec->data, FEC_SIZE);
+	for (uint32_t i = 0; i < fec->count; i++) {
+		struct recv_slot *slot = get_slot(recv, base + i);
+		if (slot == target)
+			continue;
+
+		data[0] ^= (uint8_t)(slot->size >> 8);
+		data[1] ^= (uint8_t)slot->size;
+		for (size_t j = 0; j < slot->size; j++)
+			data[2 + j] ^= slot->data[j];
+	}
+
+	target->size = rb16(data);
+	if (target->size > ARQ_PAYLOAD_SIZE)
+		return;
+
+	memcpy(target->data, data + 2, target->size);
+	target->state = SLOT_PRESENT;
+	recv->stats.recovered_fec++;
+}
+
+static void handle_data(struct arq_receiver *recv,
+			const struct arq_header *header,
+			const uint8_t *payload, uint64_t now)
+{
+	bool retransmitted = (header->flags & FLAG_RETRANSMIT) != 0;
+	int64_t sender_ts = extend_ts(recv, header->ts);
+	struct recv_slot *slot;
+
+	if (!recv->started) {
+		recv->started = true;
+		recv->next_seq = header->seq;
+		recv->end_seq = header->seq;
+		recv->ts_offset = (int64_t)now - sender_ts;
+	} else if (!retransmitted &&
+		   (int64_t)now - sender_ts < recv->ts_offset) {
+		recv->ts_offset = (int64_t)now - sender_ts;
+	}
+
+	if (seq_before(header->seq, recv->next_seq)) {
+		recv->stats.duplicates++;
+		return;
+	}
+
+	/* further ahead than the buffer can hold */
+	if (header->seq - recv->next_seq > recv->mask) {
+		recv->stats.lost++;
+		return;
+	}
+
+	slot = get_slot(recv, header->seq);
+
+	if (seq_before(header->seq, recv->end_seq)) {
+		if (slot->seq != header->seq || slot->state != SLOT_MISSING) {
+			recv->stats.duplicates++;
+			return;
+		}
+		if (retransmitted)
+			recv->stats.recovered_arq++;
+	} else {
+		extend_window(recv, header->seq + 1, sender_ts, now);
+	}
+
+	slot->state = SLOT_PRESENT;
+	slot->sender_ts = sender_ts;
+	slot->size = header->size;
+	memcpy(slot->data, payload, header->size);
+
+	recv->stats.packets++;
+	recv->stats.bytes += header->size;
+	if (retransmitted)
+		recv->stats.retransmitted++;
+
+	if (recv->fec_group)
+		try_fec(recv, header->seq - header->seq % recv->fec_group);
+}
+
+static void handle_fec(struct arq_receiver *recv,
+		       const struct arq_header *header,
+		       const uint8_t *payload, uint64_t now)
+{
+	struct fec_slot *fec;
+
+	if (!recv->started || header->size != FEC_SIZE || !header->flags)
+		return;
+
+	recv->fec_group = header->flags;
+	recv->stats.fec_packets++;
+
+	if (seq_before(header->seq, recv->next_seq))
+		return;
+
+	/* the parity packet also tells about losses at the end of the group */
+	extend_window(recv, header->seq + header->flags,
+		      extend_ts(recv, header->ts), now);
+
+	fec = &recv->fec[(header->seq / recv->fec_group) % FEC_SLOTS];
+	fec->base = header->seq;
+	fec->count = header->flags;
+	fec->present = true;
+	memcpy(fec->data, payload, FEC_SIZE);
+
+	try_fec(recv, header->seq);
+}
+
+static void handle_ackack(struct arq_receiver *recv,
+			  const struct arq_header *header)
+{
+	uint32_t rtt = receiver_time(recv) - header->ts;
+
+	recv->rtt_us = recv->rtt_us ? (recv->rtt_us * 7 + rtt) / 8 : rtt;
+	recv->stats.rtt_ms = (int)(recv->rtt_us / 1000);
+}
+
+static inline int64_t play_time(struct arq_receiver *recv,
+				struct recv_slot *slot)
+{
+	return slot->sender_ts + recv->ts_offset +
+	       (int64_t)recv->config.latency_ms * 1000;
+}
+
+static void deliver(struct arq_receiver *recv, uint64_t now)
+{
+	while (seq_before(recv->next_seq, recv->end_seq)) {
+		struct recv_slot *slot = get_slot(recv, recv->next_seq);
+
+		if (play_time(recv, slot) > (int64_t)now)
+			break;
+
+		if (slot->state == SLOT_PRESENT) {
+			recv->callback(recv->param, slot->data, slot->size);
+			slot->state = SLOT_DELIVERED;
+		} else {
+			slot->state = SLOT_EMPTY;
+			recv->stats.lost++;
+		}
+
+		recv->next_seq++;
+	}
+}
+
+static void send_naks(struct arq_receiver *recv, uint64_t now)
+{
+	uint8_t packet[HEADER_SIZE + MAX_NAK_RANGES * 8];
+	uint64_t interval = recv->rtt_us > MIN_NAK_INTERVAL_US
+				    ? recv->rtt_us
+				    : MIN_NAK_INTERVAL_US;
+	struct arq_header header = {0};
+	size_t ranges = 0;
+	bool in_range = false;
+
+	for (uint32_t seq = recv->next_seq; seq_before(seq, recv->end_seq);
+	     seq++) {
+		struct recv_slot *slot = get_slot(recv, seq);
+		bool wanted = slot->state == SLOT_MISSING &&
+			      slot->nak_ts <= now &&
+			      play_time(recv, slot) > (int64_t)now;
+		uint8_t *range = packet + HEADER_SIZE + ranges * 8;
+
+		if (wanted) {
+			slot->nak_ts = now + interval;
+			if (!in_range)
+				wb32(range, seq);
+			wb32(range + 4, seq);
+			in_range = true;
+		} else if (in_range) {
+			in_range = false;
+			if (++ranges == MAX_NAK_RANGES)
+				break;
+		}
+	}
+
+	if (in_range)
+		ranges++;
+	if (!ranges)
+		return;
+
+	header.type = ARQ_NAK;
+	header.size = (uint16_t)(ranges * 8);
+	header.ts = receiver_time(recv);
+	write_header(packet, &header);
+	send_to_peer(recv, packet, HEADER_SIZE + ranges * 8);
+	recv->stats.naks++;
+}
+
+static void send_ack(struct arq_receiver *recv, uint64_t now)
+{
+	uint8_t packet[HEADER_SIZE + 20];
+	uint8_t *payload = packet + HEADER_SIZE;
+	struct arq_header header = {0};
+
+	if (now - recv->last_ack_ts < ACK_INTERVAL_US)
+		return;
+	recv->last_ack_ts = now;
+
+	header.type = ARQ_ACK;
+	header.size = 20;
+	header.seq = recv->next_seq;
+	header.ts = receiver_time(recv);
+	write_header(packet, &header);
+
+	wb32(payload, recv->next_seq);
+	wb32(payload + 4, recv->rtt_us);
+	wb32(payload + 8, (uint32_t)recv->stats.lost);
+	wb32(payload + 12, (uint32_t)recv->stats.recovered_fec);
+	wb32(payload + 16, (uint32_t)recv->stats.recovered_arq);
+
+	send_to_peer(recv, packet, sizeof(packet));
+}
+
+static void receive_packet(struct arq_receiver *recv, uint64_t now)
+{
+	uint8_t buf[MAX_DATAGRAM];
+	struct sockaddr_storage from;
+	socklen_t from_len = sizeof(from);
+	struct arq_header header;
+	int ret;
+
+	ret = recvfrom(recv->sock, (char *)buf, sizeof(buf), 0,
+		       (struct sockaddr *)&from, &from_len);
+	if (ret <= 0 || !read_header(buf, (size_t)ret, &header))
+		return;
+
+	switch (header.type) {
+	case ARQ_DATA:
+		memcpy(&recv->peer, &from, from_len);
+		recv->peer_len = from_len;
+		recv->have_peer = true;
+		handle_data(recv, &header, buf + HEADER_SIZE, now);
+		break;
+	case ARQ_FEC:
+		handle_fec(recv, &header, buf + HEADER_SIZE, now);
+		break;
+	case ARQ_ACKACK:
+		handle_ackack(recv, &header);
+		break;
+	}
+}
+
+static void *receiver_thread(void *data)
+{
+	struct arq_receiver *recv = data;
+
+	os_set_thread_name("udp-arq: receiver");
+
+	while (!os_atomic_load_bool(&recv->stop)) {
+		uint64_t timeout = POLL_INTERVAL_US;
+		uint64_t now;
+
+		/* drain the socket before acting on what is missing */
+		while (wait_readable(recv->sock, timeout)) {
+			receive_packet(recv, now_us());
+			timeout = 0;
+		}
+
+		now = now_us();
+		deliver(recv, now);
+
+		if (recv->started) {
+			send_naks(recv, now);
+			send_ack(recv, now);
+		}
+
+		pthread_mutex_lock(&recv->stats_mutex);
+		recv->published_stats = recv->stats;
+		pthread_mutex_unlock(&recv->stats_mutex);
+	}
+
+	return NULL;
+}
+
+struct arq_receiver *arq_receiver_create(const struct arq_config *config,
+					 const char *bind_ip, int port,
+					 arq_receive_cb callback, void *param)
+{
+	struct arq_receiver *recv = bzalloc(sizeof(struct arq_receiver));
+	struct addrinfo *addr = resolve(bind_ip, port, true);
+	uint32_t size = buffer_packets(config);
+
+	pthread_mutex_init_value(&recv->stats_mutex);
+	recv->sock = INVALID_ARQ_SOCKET;
+	recv->config = *config;
+	recv->callback = callback;
+	recv->param = param;
+	recv->stats.latency_ms = (int)config->latency_ms;
+	recv->start_ts = now_us();
+
+	if (!addr)
+		goto fail;
+
+	recv->sock = open_socket(addr->ai_family);
+	if (recv->sock != INVALID_ARQ_SOCKET &&
+	    bind(recv->sock, addr->ai_addr, (int)addr->ai_addrlen) != 0) {
+		close_socket(recv->sock);
+		recv->sock = INVALID_ARQ_SOCKET;
+	}
+	freeaddrinfo(addr);
+
+	if (recv->sock == INVALID_ARQ_SOCKET) {
+		blog(LOG_WARNING, "udp-arq: Failed to bind port %d", port);
+		goto fail;
+	}
+	if (pthread_mutex_init(&recv->stats_mutex, NULL) != 0)
+		goto fail;
+
+	recv->slots = bzalloc(sizeof(struct recv_slot) * size);
+	recv->mask = size - 1;
+
+	if (pthread_create(&recv->thread, NULL, receiver_thread, recv) != 0)
+		goto fail;
+	recv->thread_active = true;
+
+	return recv;
+
+fail:
+	arq_receiver_destroy(recv);
+	return NULL;
+}
+
+void arq_receiver_destroy(struct arq_receiver *recv)
+{
+	if (!recv)
+		return;
+
+	if (recv->thread_active) {
+		os_atomic_set_bool(&recv->stop, true);
+		pthread_join(recv->thread, NULL);
+	}
+
+	if (recv->sock != INVALID_ARQ_SOCKET)
+		close_socket(recv->sock);
+
+	pthread_mutex_destroy(&recv->stats_mutex);
+	bfree(recv->slots);
+	bfree(recv);
+}
+
+int arq_receiver_get_port(struct arq_receiver *recv)
+{
+	struct sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+
+	if (getsockname(recv->sock, (struct sockaddr *)&addr, &len) != 0)
+		return 0;
+
+	if (addr.ss_family == AF_INET6)
+		return ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+	return ntohs(((struct sockaddr_in *)&addr)->sin_port);
+}
+
+void arq_receiver_get_stats(struct arq_receiver *recv,
+			    struct arq_stats *stats)
+{
+	pthread_mutex_lock(&recv->stats_mutex);
+	*stats = recv->published_stats;
+	pthread_mutex_unlock(&recv->stats_mutex);
+}
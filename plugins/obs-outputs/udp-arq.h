@@ -0,0 +1,70 @@
+#pragma once
+
+#include <util/c99defs.h>
+
+/* Low latency transport over UDP, in the spirit of SRT and RIST.  The sender
+ * numbers every datagram and keeps it for the duration of the latency
+ * window.  The receiver holds packets for that same window, asks for the ones
+ * that went missing with NAKs, and delivers everything in order at a fixed
+ * delay.  Optionally one XOR parity packet is sent for every fec_group data
+ * packets, which lets the receiver repair single losses without waiting for
+ * a round trip.
+ *
+ * Payloads are cut in chunks of ARQ_PAYLOAD_SIZE (seven MPEG-TS packets). */
+
+#define ARQ_PAYLOAD_SIZE 1316
+
+struct arq_config {
+	uint32_t latency_ms;
+
+	/* data packets per parity packet, 0 disables fec */
+	uint32_t fec_group;
+
+	/* packets kept for retransmission / reordering, rounded up to a power
+	 * of two.  0 picks a default */
+	uint32_t buffer_packets;
+
+	/* percentage of outgoing datagrams to drop on purpose, for testing */
+	double simulated_loss;
+	uint32_t simulated_loss_seed;
+};
+
+/* Sender and receiver use the same structure.  On the sender, lost and the
+ * recovered counters are the ones last reported by the receiver. */
+struct arq_stats {
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t retransmitted;
+	uint64_t fec_packets;
+	uint64_t naks;
+	uint64_t recovered_fec;
+	uint64_t recovered_arq;
+	uint64_t lost;
+	uint64_t duplicates;
+	uint64_t simulated_drops;
+	int rtt_ms;
+	int latency_ms;
+};
+
+typedef void (*arq_receive_cb)(void *param, const uint8_t *data, size_t size);
+
+struct arq_sender;
+struct arq_receiver;
+
+extern struct arq_sender *arq_sender_create(const struct arq_config *config,
+					    const char *host, int port);
+extern void arq_sender_destroy(struct arq_sender *sender);
+extern bool arq_sender_send(struct arq_sender *sender, const uint8_t *data,
+			    size_t size);
+extern void arq_sender_get_stats(struct arq_sender *sender,
+				 struct arq_stats *stats);
+
+/* port 0 binds to any free port, see arq_receiver_get_port.  The callback is
+ * called from the receiver thread. */
+extern struct arq_receiver *
+arq_receiver_create(const struct arq_config *config, const char *bind_ip,
+		    int port, arq_receive_cb callback, void *param);
+extern void arq_receiver_destroy(struct arq_receiver *receiver);
+extern int arq_receiver_get_port(struct arq_receiver *receiver);
+extern void arq_receiver_get_stats(struct arq_receiver *receiver,
+				   struct arq_stats *stats);
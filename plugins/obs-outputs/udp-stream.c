@@ -0,0 +1,653 @@
+#include <obs-module.h>
+#include <util/array-serializer.h>
+#include <util/circlebuf.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "mpegts-mux.h"
+#include "udp-arq.h"
+
+#define do_log(level, format, ...)                \
+	blog(level, "[udp stream: '%s'] " format, \
+	     obs_output_get_name(stream->output), ##__VA_ARGS__)
+
+#define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
+
+#define OPT_URL "url"
+#define OPT_LATENCY "latency_ms"
+#define OPT_FEC_GROUP "fec_group"
+#define OPT_SIMULATED_LOSS "simulated_loss"
+#define OPT_DROP_THRESHOLD "drop_threshold_ms"
+
+/* MPEG-TS over the UDP ARQ transport of udp-arq.c.  Packets arrive already
+ * interleaved from obs-output.c, they are muxed and handed to the transport
+ * on a send thread so that the encoders are never blocked by the network. */
+
+struct udp_stream {
+	obs_output_t *output;
+
+	pthread_mutex_t packets_mutex;
+	struct circlebuf packets;
+	int64_t drop_threshold_usec;
+	bool wait_for_keyframe;
+	int dropped_frames;
+
+	volatile bool connecting;
+	pthread_t connect_thread;
+
+	volatile bool active;
+	volatile bool encode_error;
+	pthread_t send_thread;
+
+	os_sem_t *send_sem;
+	os_event_t *stop_event;
+	uint64_t stop_ts;
+
+	struct dstr host;
+	int port;
+	struct arq_config config;
+
+	/* replaced under stats_mutex, the send thread only uses it while
+	 * active */
+	struct arq_sender *sender;
+
+	struct mpegts_mux mux;
+	int video_stream;
+	int audio_streams[MAX_AUDIO_MIXES];
+	struct array_output_data ts_data;
+	struct serializer ts;
+
+	pthread_mutex_t stats_mutex;
+	int64_t queue_delay_usec;
+	uint64_t last_packets;
+	uint64_t last_retransmitted;
+	float congestion;
+
+	uint64_t total_bytes_sent;
+};
+
+static const char *udp_stream_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("UDPStream");
+}
+
+static inline bool stopping(struct udp_stream *stream)
+{
+	return os_event_try(stream->stop_event) != EAGAIN;
+}
+
+static inline bool connecting(struct udp_stream *stream)
+{
+	return os_atomic_load_bool(&stream->connecting);
+}
+
+static inline bool active(struct udp_stream *stream)
+{
+	return os_atomic_load_bool(&stream->active);
+}
+
+static inline void free_packets(struct udp_stream *stream)
+{
+	pthread_mutex_lock(&stream->packets_mutex);
+	while (stream->packets.size) {
+		struct encoder_packet packet;
+		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
+		obs_encoder_packet_release(&packet);
+	}
+	pthread_mutex_unlock(&stream->packets_mutex);
+}
+
+static void udp_stream_destroy(void *data)
+{
+	struct udp_stream *stream = data;
+
+	if (connecting(stream))
+		pthread_join(stream->connect_thread, NULL);
+
+	if (active(stream)) {
+		os_event_signal(stream->stop_event);
+		os_sem_post(stream->send_sem);
+		pthread_join(stream->send_thread, NULL);
+	}
+
+	free_packets(stream);
+	arq_sender_destroy(stream->sender);
+	mpegts_mux_free(&stream->mux);
+	array_output_serializer_free(&stream->ts_data);
+	dstr_free(&stream->host);
+
+	os_event_destroy(stream->stop_event);
+	os_sem_destroy(stream->send_sem);
+	pthread_mutex_destroy(&stream->packets_mutex);
+	pthread_mutex_destroy(&stream->stats_mutex);
+	circlebuf_free(&stream->packets);
+	bfree(stream);
+}
+
+static void get_arq_stats(void *data, calldata_t *cd)
+{
+	struct udp_stream *stream = data;
+	struct arq_stats stats = {0};
+	double loss = 0.0;
+
+	pthread_mutex_lock(&stream->stats_mutex);
+	if (stream->sender)
+		arq_sender_get_stats(stream->sender, &stats);
+	pthread_mutex_unlock(&stream->stats_mutex);
+
+	if (stats.packets)
+		loss = (double)stats.lost * 100.0 / (double)stats.packets;
+
+	calldata_set_int(cd, "packets", (long long)stats.packets);
+	calldata_set_int(cd, "retransmitted", (long long)stats.retransmitted);
+	calldata_set_int(cd, "recovered",
+			 (long long)(stats.recovered_fec +
+				     stats.recovered_arq));
+	calldata_set_int(cd, "lost", (long long)stats.lost);
+	calldata_set_float(cd, "loss_percent", loss);
+	calldata_set_int(cd, "rtt_ms", stats.rtt_ms);
+	calldata_set_int(cd, "latency_ms", stats.latency_ms);
+
+	pthread_mutex_lock(&stream->stats_mutex);
+	calldata_set_int(cd, "queue_delay_ms",
+			 (long long)(stream->queue_delay_usec / 1000));
+	pthread_mutex_unlock(&stream->stats_mutex);
+}
+
+static void *udp_stream_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct udp_stream *stream = bzalloc(sizeof(struct udp_stream));
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+
+	stream->output = output;
+	pthread_mutex_init_value(&stream->packets_mutex);
+	pthread_mutex_init_value(&stream->stats_mutex);
+	array_output_serializer_init(&stream->ts, &stream->ts_data);
+	mpegts_mux_init(&stream->mux);
+
+	if (pthread_mutex_init(&stream->packets_mutex, NULL) != 0)
+		goto fail;
+	if (pthread_mutex_init(&stream->stats_mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+
+	proc_handler_add(ph,
+			 "void get_arq_stats(out int packets, "
+			 "out int retransmitted, out int recovered, "
+			 "out int lost, out float loss_percent, "
+			 "out int rtt_ms, out int latency_ms, "
+			 "out int queue_delay_ms)",
+			 get_arq_stats, stream);
+
+	UNUSED_PARAMETER(settings);
+	return stream;
+
+fail:
+	udp_stream_destroy(stream);
+	return NULL;
+}
+
+static void udp_stream_stop(void *data, uint64_t ts)
+{
+	struct udp_stream *stream = data;
+
+	if (stopping(stream) && ts != 0)
+		return;
+
+	if (connecting(stream))
+		pthread_join(stream->connect_thread, NULL);
+
+	stream->stop_ts = ts / 1000ULL;
+
+	if (active(stream)) {
+		os_event_signal(stream->stop_event);
+		if (stream->stop_ts == 0)
+			os_sem_post(stream->send_sem);
+	} else {
+		obs_output_signal_stop(stream->output, OBS_OUTPUT_SUCCESS);
+	}
+}
+
+static inline bool get_next_packet(struct udp_stream *stream,
+				   struct encoder_packet *packet)
+{
+	bool new_packet = false;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	if (stream->packets.size) {
+		circlebuf_pop_front(&stream->packets, packet,
+				    sizeof(struct encoder_packet));
+		new_packet = true;
+	}
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	return new_packet;
+}
+
+static void send_packet(struct udp_stream *stream,
+			struct encoder_packet *packet)
+{
+	int idx = packet->type == OBS_ENCODER_VIDEO
+			  ? stream->video_stream
+			  : stream->audio_streams[packet->track_idx];
+
+	if (idx < 0)
+		return;
+
+	array_output_serializer_reset(&stream->ts, &stream->ts_data);
+	mpegts_mux_packet(&stream->mux, (size_t)idx, packet, &stream->ts);
+
+	arq_sender_send(stream->sender, stream->ts_data.bytes.array,
+			stream->ts_data.bytes.num);
+	stream->total_bytes_sent += stream->ts_data.bytes.num;
+
+	pthread_mutex_lock(&stream->stats_mutex);
+	stream->queue_delay_usec =
+		(int64_t)(os_gettime_ns() / 1000) - packet->sys_dts_usec;
+	pthread_mutex_unlock(&stream->stats_mutex);
+}
+
+static void *send_thread(void *data)
+{
+	struct udp_stream *stream = data;
+	bool encode_error;
+
+	os_set_thread_name("udp-stream: send_thread");
+
+	while (os_sem_wait(stream->send_sem) == 0) {
+		struct encoder_packet packet;
+
+		if (stopping(stream) && stream->stop_ts == 0)
+			break;
+		if (os_atomic_load_bool(&stream->encode_error))
+			break;
+
+		if (!get_next_packet(stream, &packet))
+			continue;
+
+		if (stopping(stream) &&
+		    packet.sys_dts_usec >= (int64_t)stream->stop_ts) {
+			obs_encoder_packet_release(&packet);
+			break;
+		}
+
+		send_packet(stream, &packet);
+		obs_encoder_packet_release(&packet);
+	}
+
+	encode_error = os_atomic_load_bool(&stream->encode_error);
+	if (encode_error) {
+		info("Encoder error, disconnecting");
+		obs_output_signal_stop(stream->output, OBS_OUTPUT_ENCODE_ERROR);
+	} else {
+		info("User stopped the stream");
+		obs_output_end_data_capture(stream->output);
+	}
+
+	free_packets(stream);
+	os_event_reset(stream->stop_event);
+	os_atomic_set_bool(&stream->active, false);
+	return NULL;
+}
+
+/* accepts host:port, [ipv6]:port and an optional scheme:// prefix */
+static bool parse_url(struct udp_stream *stream, const char *url)
+{
+	const char *scheme = url ? strstr(url, "://") : NULL;
+	const char *host;
+	const char *port;
+
+	if (!url || !*url)
+		return false;
+
+	host = scheme ? scheme + 3 : url;
+	port = strrchr(host, ':');
+	if (!port || port == host)
+		return false;
+
+	if (*host == '[' && port[-1] == ']')
+		dstr_ncopy(&stream->host, host + 1, port - host - 2);
+	else
+		dstr_ncopy(&stream->host, host, port - host);
+
+	stream->port = atoi(port + 1);
+	return stream->port > 0 && stream->port < 65536;
+}
+
+static bool init_mux(struct udp_stream *stream)
+{
+	obs_output_t *output = stream->output;
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(output);
+	enum mpegts_codec codec;
+	uint8_t *extra;
+	size_t size;
+
+	mpegts_mux_free(&stream->mux);
+	mpegts_mux_init(&stream->mux);
+	stream->video_stream = -1;
+
+	if (vencoder) {
+		if (!mpegts_codec_from_name(obs_encoder_get_codec(vencoder),
+					    &codec))
+			return false;
+
+		obs_encoder_get_extra_data(vencoder, &extra, &size);
+		stream->video_stream = mpegts_mux_add_stream(
+			&stream->mux, codec, extra, size, 0);
+	}
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		obs_encoder_t *aencoder =
+			obs_output_get_audio_encoder(output, i);
+		int channels;
+
+		stream->audio_streams[i] = -1;
+		if (!aencoder)
+			continue;
+
+		if (!mpegts_codec_from_name(obs_encoder_get_codec(aencoder),
+					    &codec))
+			return false;
+
+		channels = (int)audio_output_get_channels(
+			obs_encoder_audio(aencoder));
+		extra = NULL;
+		size = 0;
+		obs_encoder_get_extra_data(aencoder, &extra, &size);
+		stream->audio_streams[i] = mpegts_mux_add_stream(
+			&stream->mux, codec, extra, size, channels);
+	}
+
+	return stream->mux.num_streams > 0;
+}
+
+static bool init_connect(struct udp_stream *stream)
+{
+	obs_data_t *settings = obs_output_get_settings(stream->output);
+	struct arq_sender *sender;
+	bool success = false;
+
+	if (!parse_url(stream, obs_data_get_string(settings, OPT_URL))) {
+		warn("Invalid url '%s'",
+		     obs_data_get_string(settings, OPT_URL));
+		goto exit;
+	}
+
+	memset(&stream->config, 0, sizeof(stream->config));
+	stream->config.latency_ms =
+		(uint32_t)obs_data_get_int(settings, OPT_LATENCY);
+	stream->config.fec_group =
+		(uint32_t)obs_data_get_int(settings, OPT_FEC_GROUP);
+	stream->config.simulated_loss =
+		obs_data_get_double(settings, OPT_SIMULATED_LOSS);
+	stream->config.simulated_loss_seed = (uint32_t)os_gettime_ns();
+	stream->drop_threshold_usec =
+		obs_data_get_int(settings, OPT_DROP_THRESHOLD) * 1000;
+
+	if (!init_mux(stream)) {
+		warn("Unsupported encoder codec");
+		goto exit;
+	}
+
+	sender = arq_sender_create(&stream->config, stream->host.array,
+				   stream->port);
+
+	pthread_mutex_lock(&stream->stats_mutex);
+	arq_sender_destroy(stream->sender);
+	stream->sender = sender;
+	pthread_mutex_unlock(&stream->stats_mutex);
+
+	if (!sender) {
+		warn("Could not open socket to %s:%d", stream->host.array,
+		     stream->port);
+		goto exit;
+	}
+
+	info("Sending to %s:%d, latency %ums, fec group %u",
+	     stream->host.array, stream->port, stream->config.latency_ms,
+	     stream->config.fec_group);
+	success = true;
+
+exit:
+	obs_data_release(settings);
+	return success;
+}
+
+static bool init_send(struct udp_stream *stream)
+{
+	os_sem_destroy(stream->send_sem);
+	if (os_sem_init(&stream->send_sem, 0) != 0)
+		return false;
+
+	os_atomic_set_bool(&stream->active, true);
+	if (pthread_create(&stream->send_thread, NULL, send_thread, stream) !=
+	    0) {
+		os_atomic_set_bool(&stream->active, false);
+		return false;
+	}
+
+	stream->last_packets = 0;
+	stream->last_retransmitted = 0;
+	stream->congestion = 0.0f;
+	stream->total_bytes_sent = 0;
+	stream->wait_for_keyframe = false;
+	stream->dropped_frames = 0;
+	obs_output_begin_data_capture(stream->output, 0);
+	return true;
+}
+
+static void *connect_thread(void *data)
+{
+	struct udp_stream *stream = data;
+
+	os_set_thread_name("udp-stream: connect_thread");
+
+	if (!init_connect(stream))
+		obs_output_signal_stop(stream->output, OBS_OUTPUT_BAD_PATH);
+	else if (!init_send(stream))
+		obs_output_signal_stop(stream->output, OBS_OUTPUT_ERROR);
+
+	if (!stopping(stream))
+		pthread_detach(stream->connect_thread);
+
+	os_atomic_set_bool(&stream->connecting, false);
+	return NULL;
+}
+
+static bool udp_stream_start(void *data)
+{
+	struct udp_stream *stream = data;
+
+	if (!obs_output_can_begin_data_capture(stream->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(stream->output, 0))
+		return false;
+
+	os_atomic_set_bool(&stream->encode_error, false);
+	os_atomic_set_bool(&stream->connecting, true);
+	return pthread_create(&stream->connect_thread, NULL, connect_thread,
+			      stream) == 0;
+}
+
+/* Like rtmp-stream, when the link can't keep up, video frames that nothing
+ * depends on are dropped from the queue, audio and keyframes are kept.  If
+ * that is still far too much, the link is stalled and the whole queue goes.
+ * Video is then dropped until the next keyframe. */
+static void drop_frames(struct udp_stream *stream, int64_t dts_usec)
+{
+	struct encoder_packet *first = circlebuf_data(&stream->packets, 0);
+	bool drop_all = dts_usec - first->dts_usec >
+			stream->drop_threshold_usec * 4;
+	struct circlebuf new_buf = {0};
+	int num_frames_dropped = 0;
+
+	circlebuf_reserve(&new_buf, sizeof(struct encoder_packet) * 8);
+
+	while (stream->packets.size) {
+		struct encoder_packet packet;
+		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
+
+		if (!drop_all && (packet.type == OBS_ENCODER_AUDIO ||
+				  packet.keyframe)) {
+			circlebuf_push_back(&new_buf, &packet, sizeof(packet));
+		} else {
+			if (packet.type == OBS_ENCODER_VIDEO)
+				num_frames_dropped++;
+			obs_encoder_packet_release(&packet);
+		}
+	}
+
+	circlebuf_free(&stream->packets);
+	stream->packets = new_buf;
+	stream->wait_for_keyframe = true;
+	stream->dropped_frames += num_frames_dropped;
+}
+
+/* must be called with packets_mutex held */
+static bool add_packet(struct udp_stream *stream,
+		       struct encoder_packet *packet)
+{
+	struct encoder_packet new_packet;
+
+	if (stream->packets.size) {
+		struct encoder_packet *first =
+			circlebuf_data(&stream->packets, 0);
+
+		if (packet->dts_usec - first->dts_usec >
+		    stream->drop_threshold_usec)
+			drop_frames(stream, packet->dts_usec);
+	}
+
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		if (packet->keyframe) {
+			stream->wait_for_keyframe = false;
+		} else if (stream->wait_for_keyframe) {
+			stream->dropped_frames++;
+			return false;
+		}
+	}
+
+	obs_encoder_packet_ref(&new_packet, packet);
+	circlebuf_push_back(&stream->packets, &new_packet, sizeof(new_packet));
+	return true;
+}
+
+static void udp_stream_data(void *data, struct encoder_packet *packet)
+{
+	struct udp_stream *stream = data;
+	bool added_packet;
+
+	if (!active(stream))
+		return;
+
+	/* encoder fail */
+	if (!packet) {
+		os_atomic_set_bool(&stream->encode_error, true);
+		os_sem_post(stream->send_sem);
+		return;
+	}
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	added_packet = add_packet(stream, packet);
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	if (added_packet)
+		os_sem_post(stream->send_sem);
+}
+
+static void udp_stream_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, OPT_LATENCY, 120);
+	obs_data_set_default_int(defaults, OPT_FEC_GROUP, 0);
+	obs_data_set_default_double(defaults, OPT_SIMULATED_LOSS, 0.0);
+	obs_data_set_default_int(defaults, OPT_DROP_THRESHOLD, 700);
+}
+
+static obs_properties_t *udp_stream_properties(void *unused)
+{
+	obs_properties_t *props = obs_properties_create();
+
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_add_text(props, OPT_URL,
+				obs_module_text("UDPStream.URL"),
+				OBS_TEXT_DEFAULT);
+	obs_properties_add_int(props, OPT_LATENCY,
+			       obs_module_text("UDPStream.Latency"), 20, 8000,
+			       10);
+	obs_properties_add_int(props, OPT_FEC_GROUP,
+			       obs_module_text("UDPStream.FECGroup"), 0, 255,
+			       1);
+	obs_properties_add_int(props, OPT_DROP_THRESHOLD,
+			       obs_module_text("UDPStream.DropThreshold"), 100,
+			       10000, 100);
+
+	return props;
+}
+
+static uint64_t udp_stream_total_bytes_sent(void *data)
+{
+	struct udp_stream *stream = data;
+	return stream->total_bytes_sent;
+}
+
+static int udp_stream_dropped_frames(void *data)
+{
+	struct udp_stream *stream = data;
+	int dropped;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	dropped = stream->dropped_frames;
+	pthread_mutex_unlock(&stream->packets_mutex);
+	return dropped;
+}
+
+/* share of the packets sent since the last call that had to be resent */
+static float udp_stream_congestion(void *data)
+{
+	struct udp_stream *stream = data;
+	struct arq_stats stats = {0};
+	uint64_t packets, retransmitted;
+
+	if (!active(stream))
+		return 0.0f;
+
+	pthread_mutex_lock(&stream->stats_mutex);
+	if (stream->sender)
+		arq_sender_get_stats(stream->sender, &stats);
+	pthread_mutex_unlock(&stream->stats_mutex);
+
+	packets = stats.packets - stream->last_packets;
+	retransmitted = stats.retransmitted - stream->last_retransmitted;
+
+	if (packets) {
+		stream->congestion = (float)retransmitted / (float)packets;
+		if (stream->congestion > 1.0f)
+			stream->congestion = 1.0f;
+	}
+
+	stream->last_packets = stats.packets;
+	stream->last_retransmitted = stats.retransmitted;
+	return stream->congestion;
+}
+
+struct obs_output_info udp_output_info = {
+	.id = "udp_arq_output",
+	.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED | OBS_OUTPUT_MULTI_TRACK,
+	.encoded_video_codecs = "h264;hevc",
+	.encoded_audio_codecs = "aac;opus",
+	.get_name = udp_stream_getname,
+	.create = udp_stream_create,
+	.destroy = udp_stream_destroy,
+	.start = udp_stream_start,
+	.stop = udp_stream_stop,
+	.encoded_packet = udp_stream_data,
+	.get_defaults = udp_stream_defaults,
+	.get_properties = udp_stream_properties,
+	.get_total_bytes = udp_stream_total_bytes_sent,
+	.get_congestion = udp_stream_congestion,
+	.get_dropped_frames = udp_stream_dropped_frames,
+};
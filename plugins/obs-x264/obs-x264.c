@@ -439,6 +439,14 @@ static void update_params(struct obs_x264 *obsx264, obs_data_t *settings,
 		obsx264->params.i_keyint_max =
 			keyint_sec * voi->fps_num / voi->fps_den;
 
+	/* libobs requests the keyframes when they're aligned across
+	 * renditions, so don't let x264 place any of its own */
+	if (obs_encoder_get_keyframe_alignment(obsx264->encoder)) {
+		obsx264->params.i_keyint_max = X264_KEYINT_MAX_INFINITE;
+		obsx264->params.i_scenecut_threshold = 0;
+		obsx264->params.b_open_gop = 0;
+	}
+
 	if (!use_bufsize)
 		buffer_size = bitrate;
 
@@ -725,6 +733,9 @@ static inline void init_pic_data(struct obs_x264 *obsx264, x264_picture_t *pic,
 	pic->i_pts = frame->pts;
 	pic->img.i_csp = obsx264->params.i_csp;
 
+	if (frame->force_keyframe)
+		pic->i_type = X264_TYPE_IDR;
+
 	if (obsx264->params.i_csp == X264_CSP_NV12)
 		pic->img.i_plane = 2;
 	else if (obsx264->params.i_csp == X264_CSP_I420)
@@ -826,5 +837,5 @@ struct obs_encoder_info obs_x264_encoder = {
 	.get_extra_data = obs_x264_extra_data,
 	.get_sei_data = obs_x264_sei,
 	.get_video_info = obs_x264_video_info,
-	.caps = OBS_ENCODER_CAP_DYN_BITRATE,
+	.caps = OBS_ENCODER_CAP_DYN_BITRATE | OBS_ENCODER_CAP_ASYNC_ENCODE,
 };
@@ -0,0 +1,241 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <obs.h>
+#include <graphics/vec4.h>
+#include <util/platform.h>
+
+#define FRAME_SIZE 4
+#define RED 0xFF0000FF
+#define BLUE 0xFFFF0000
+
+/* an async input whose frames are pushed by the test, standing in for a
+ * decoder thread */
+struct async_input {
+	obs_source_t *source;
+	struct obs_source_frame *pending;
+};
+
+static struct async_input *last_input;
+
+static const char *async_get_name(void *type_data)
+{
+	UNUSED_PARAMETER(type_data);
+	return "Async";
+}
+
+static void *async_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct async_input *input = bzalloc(sizeof(*input));
+
+	UNUSED_PARAMETER(settings);
+	input->source = source;
+	last_input = input;
+	return input;
+}
+
+/* the decoder thread is joined here and hands in the frame it was filling */
+static void async_destroy(void *data)
+{
+	struct async_input *input = data;
+
+	if (input->pending)
+		obs_source_frame_submit(input->source, input->pending);
+	bfree(input);
+}
+
+static struct obs_source_info async_info = {
+	.id = "test_async",
+	.type = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_ASYNC_VIDEO,
+	.get_name = async_get_name,
+	.create = async_create,
+	.destroy = async_destroy,
+};
+
+static int setup(void **state)
+{
+	struct obs_video_info ovi = {
+		.graphics_module = NULL_GRAPHICS_MODULE,
+		.fps_num = 30,
+		.fps_den = 1,
+		.base_width = 64,
+		.base_height = 64,
+		.output_width = 64,
+		.output_height = 64,
+		.output_format = VIDEO_FORMAT_RGBA,
+		.colorspace = VIDEO_CS_709,
+		.range = VIDEO_RANGE_PARTIAL,
+		.scale_type = OBS_SCALE_BILINEAR,
+	};
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return -1;
+
+	obs_add_data_path(LIBOBS_DATA_PATH);
+	obs_register_source(&async_info);
+
+	if (obs_reset_video(&ovi) != OBS_VIDEO_SUCCESS) {
+		obs_shutdown();
+		return -1;
+	}
+
+	UNUSED_PARAMETER(state);
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	obs_shutdown();
+
+	UNUSED_PARAMETER(state);
+	return 0;
+}
+
+static struct obs_source_frame *acquire_filled(obs_source_t *source,
+					       uint32_t color)
+{
+	struct obs_source_frame *frame = obs_source_frame_acquire(
+		source, VIDEO_FORMAT_RGBA, FRAME_SIZE, FRAME_SIZE,
+		VIDEO_RANGE_DEFAULT);
+
+	assert_non_null(frame);
+
+	for (uint32_t y = 0; y < FRAME_SIZE; y++) {
+		uint32_t *row =
+			(uint32_t *)(frame->data[0] + y * frame->linesize[0]);
+		for (uint32_t x = 0; x < FRAME_SIZE; x++)
+			row[x] = color;
+	}
+
+	frame->timestamp = os_gettime_ns();
+	return frame;
+}
+
+/* the graphics thread ticks async sources and moves the frame out of the
+ * queue */
+static bool wait_for_tick(obs_source_t *source)
+{
+	struct obs_source_async_stats stats;
+
+	for (int i = 0; i < 200; i++) {
+		obs_source_get_async_stats(source, &stats);
+		if (!stats.queued)
+			return true;
+		os_sleep_ms(10);
+	}
+
+	return false;
+}
+
+static uint32_t render_pixel(obs_source_t *source)
+{
+	gs_texrender_t *texrender;
+	gs_stagesurf_t *stage;
+	struct vec4 clear_color;
+	uint32_t pixel = 0;
+	uint8_t *data;
+	uint32_t linesize;
+
+	obs_enter_graphics();
+
+	texrender = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+	if (gs_texrender_begin(texrender, FRAME_SIZE, FRAME_SIZE)) {
+		vec4_zero(&clear_color);
+		gs_clear(GS_CLEAR_COLOR, &clear_color, 1.0f, 0);
+		gs_ortho(0.0f, (float)FRAME_SIZE, 0.0f, (float)FRAME_SIZE,
+			 -100.0f, 100.0f);
+		obs_source_video_render(source);
+		gs_texrender_end(texrender);
+	}
+
+	stage = gs_stagesurface_create(FRAME_SIZE, FRAME_SIZE, GS_RGBA);
+	gs_stage_texture(stage, gs_texrender_get_texture(texrender));
+	if (gs_stagesurface_map(stage, &data, &linesize)) {
+		memcpy(&pixel, data, sizeof(pixel));
+		gs_stagesurface_unmap(stage);
+	}
+
+	gs_stagesurface_destroy(stage);
+	gs_texrender_destroy(texrender);
+
+	obs_leave_graphics();
+	return pixel;
+}
+
+/* a filled frame is queued without a copy, rendered, and goes back to the
+ * pool for the next acquire */
+static void acquire_submit_render_test(void **state)
+{
+	obs_source_t *source =
+		obs_source_create_private("test_async", "async", NULL);
+	struct obs_source_async_stats stats;
+	struct obs_source_frame *frame, *next;
+
+	obs_source_set_async_unbuffered(source, true);
+
+	frame = acquire_filled(source, RED);
+	obs_source_frame_submit(source, frame);
+
+	obs_source_get_async_stats(source, &stats);
+	assert_int_equal(stats.acquired, 1);
+	assert_int_equal(stats.copied, 0);
+	assert_int_equal(stats.allocated, 1);
+	assert_int_equal(stats.queued, 1);
+
+	obs_set_output_source(0, source);
+	assert_true(wait_for_tick(source));
+	assert_int_equal(render_pixel(source), RED);
+
+	next = acquire_filled(source, BLUE);
+	assert_ptr_equal(next, frame);
+	obs_source_frame_release(source, next);
+
+	obs_source_get_async_stats(source, &stats);
+	assert_int_equal(stats.allocated, 1);
+	assert_int_equal(stats.dropped, 0);
+
+	obs_set_output_source(0, NULL);
+	obs_source_release(source);
+
+	UNUSED_PARAMETER(state);
+}
+
+/* queued frames and a frame submitted while the source is destroyed all go
+ * back to the pool and are freed with it */
+static void release_on_destroy_test(void **state)
+{
+	long allocs = bnum_allocs();
+	obs_source_t *source =
+		obs_source_create_private("test_async", "async", NULL);
+	struct async_input *input = last_input;
+	struct obs_source_async_stats stats;
+
+	obs_source_frame_submit(source, acquire_filled(source, RED));
+	obs_source_frame_submit(source, acquire_filled(source, BLUE));
+	input->pending = acquire_filled(source, RED);
+
+	obs_source_get_async_stats(source, &stats);
+	assert_int_equal(stats.acquired, 3);
+
+	obs_source_release(source);
+
+	/* the graphics thread drops its tick list reference on its own time */
+	for (int i = 0; i < 100 && bnum_allocs() != allocs; i++)
+		os_sleep_ms(10);
+	assert_int_equal(bnum_allocs(), allocs);
+
+	UNUSED_PARAMETER(state);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(acquire_submit_render_test),
+		cmocka_unit_test(release_on_destroy_test),
+	};
+
+	return cmocka_run_group_tests(tests, setup, teardown);
+}
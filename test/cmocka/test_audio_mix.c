@@ -0,0 +1,248 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <media-io/audio-io.h>
+#include <media-io/audio-mix.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+
+#define MAX_COUNT 67
+#define NUM_LEVELS 8
+#define NUM_LEAVES 4
+#define NUM_TICKS 200
+
+static void fill(float *buf, size_t count, float seed)
+{
+	for (size_t i = 0; i < count; i++)
+		buf[i] = sinf(seed + (float)i * 0.37f);
+}
+
+static void add_test(void **state)
+{
+	float out[MAX_COUNT + 1], expected[MAX_COUNT + 1];
+	float in[MAX_COUNT + 1], mul[MAX_COUNT + 1];
+
+	/* every length and an unaligned start for the remainders */
+	for (size_t count = 0; count <= MAX_COUNT; count++) {
+		fill(out, MAX_COUNT + 1, 1.0f);
+		fill(in, MAX_COUNT + 1, 2.0f);
+		fill(mul, MAX_COUNT + 1, 3.0f);
+		memcpy(expected, out, sizeof(out));
+
+		for (size_t i = 0; i < count; i++)
+			expected[i + 1] += in[i];
+		audio_mix_add(out + 1, in, count);
+		assert_memory_equal(out, expected, sizeof(out));
+
+		for (size_t i = 0; i < count; i++)
+			expected[i + 1] += in[i] * mul[i + 1];
+		audio_mix_add_mul(out + 1, in, mul + 1, count);
+		assert_memory_equal(out, expected, sizeof(out));
+	}
+
+	UNUSED_PARAMETER(state);
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* the audio output of a source, like obs_source::audio_output_buf */
+struct node {
+	float *data;
+	float *buf[MAX_AUDIO_MIXES][MAX_AUDIO_CHANNELS];
+	uint32_t mixes;
+};
+
+static struct node scenes[NUM_LEVELS];
+static struct node leaves[NUM_LEVELS][NUM_LEAVES];
+
+static void node_init(struct node *node, uint32_t mixes, float seed)
+{
+	node->data = bzalloc(sizeof(float) * AUDIO_OUTPUT_FRAMES *
+			     MAX_AUDIO_CHANNELS * MAX_AUDIO_MIXES);
+	node->mixes = mixes;
+
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+		for (size_t ch = 0; ch < MAX_AUDIO_CHANNELS; ch++) {
+			size_t plane = mix * MAX_AUDIO_CHANNELS + ch;
+			float *buf = node->data + plane * AUDIO_OUTPUT_FRAMES;
+
+			node->buf[mix][ch] = buf;
+			if ((mixes & (1 << mix)) != 0)
+				fill(buf, AUDIO_OUTPUT_FRAMES,
+				     seed + (float)plane);
+		}
+	}
+}
+
+static inline size_t item_pos(size_t item)
+{
+	return item * 3;
+}
+
+static inline void fill_fade(float *fade)
+{
+	for (size_t i = 0; i < AUDIO_OUTPUT_FRAMES; i++)
+		fade[i] = i < AUDIO_OUTPUT_FRAMES / 2 ? 1.0f : 0.0f;
+}
+
+/* the scene audio render as it was: clear every mix, allocate the fade
+ * buffer, and mix every mix of every item one sample at a time */
+static void render_scalar(size_t level)
+{
+	struct node *scene = &scenes[level];
+	size_t num_items = NUM_LEAVES + (level + 1 < NUM_LEVELS);
+	float *fade = malloc(AUDIO_OUTPUT_FRAMES * sizeof(float));
+
+	if (level + 1 < NUM_LEVELS)
+		render_scalar(level + 1);
+
+	memset(scene->data, 0,
+	       sizeof(float) * AUDIO_OUTPUT_FRAMES * MAX_AUDIO_CHANNELS *
+		       MAX_AUDIO_MIXES);
+
+	for (size_t i = 0; i < num_items; i++) {
+		struct node *item = i < NUM_LEAVES ? &leaves[level][i]
+						   : &scenes[level + 1];
+		size_t pos = item_pos(i);
+
+		if (i == 0)
+			fill_fade(fade);
+
+		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+			for (size_t ch = 0; ch < MAX_AUDIO_CHANNELS; ch++) {
+				float *out = scene->buf[mix][ch] + pos;
+				float *in = item->buf[mix][ch];
+				float *end = in + AUDIO_OUTPUT_FRAMES - pos;
+				float *buf = fade + pos;
+
+				if (i == 0) {
+					while (in < end)
+						*(out++) += *(in++) * *(buf++);
+				} else {
+					while (in < end)
+						*(out++) += *(in++);
+				}
+			}
+		}
+	}
+
+	free(fade);
+}
+
+/* the scene audio render now: only the mixes that had audio are cleared,
+ * only the mixes items have audio in are mixed */
+static void render_masked(size_t level, float *fade)
+{
+	struct node *scene = &scenes[level];
+	size_t num_items = NUM_LEAVES + (level + 1 < NUM_LEVELS);
+	uint32_t mixes = 0;
+
+	if (level + 1 < NUM_LEVELS)
+		render_masked(level + 1, fade);
+
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+		if ((scene->mixes & (1 << mix)) != 0)
+			memset(scene->buf[mix][0], 0,
+			       sizeof(float) * AUDIO_OUTPUT_FRAMES *
+				       MAX_AUDIO_CHANNELS);
+	}
+
+	for (size_t i = 0; i < num_items; i++) {
+		struct node *item = i < NUM_LEAVES ? &leaves[level][i]
+						   : &scenes[level + 1];
+		size_t pos = item_pos(i);
+		size_t count = AUDIO_OUTPUT_FRAMES - pos;
+
+		if (i == 0)
+			fill_fade(fade);
+
+		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+			if ((item->mixes & (1 << mix)) == 0)
+				continue;
+
+			for (size_t ch = 0; ch < MAX_AUDIO_CHANNELS; ch++) {
+				float *out = scene->buf[mix][ch] + pos;
+				float *in = item->buf[mix][ch];
+
+				if (i == 0)
+					audio_mix_add_mul(out, in, fade + pos,
+							  count);
+				else
+					audio_mix_add(out, in, count);
+			}
+		}
+
+		mixes |= item->mixes;
+	}
+
+	scene->mixes = mixes;
+}
+
+/* a scene nested NUM_LEVELS deep, each level with NUM_LEAVES 16 channel
+ * sources sent to two of the mixes, one of them fading */
+static void nested_scene_benchmark(void **state)
+{
+	float *fade = bmalloc(AUDIO_OUTPUT_FRAMES * sizeof(float));
+	size_t size = sizeof(float) * AUDIO_OUTPUT_FRAMES *
+		      MAX_AUDIO_CHANNELS * MAX_AUDIO_MIXES;
+	float *expected = bmalloc(size);
+	uint64_t start, scalar_ns, masked_ns;
+
+	for (size_t level = 0; level < NUM_LEVELS; level++) {
+		node_init(&scenes[level], (1 << MAX_AUDIO_MIXES) - 1, 0.0f);
+
+		for (size_t i = 0; i < NUM_LEAVES; i++) {
+			uint32_t mixes = (1 << (i % 3)) | (1 << 3);
+			node_init(&leaves[level][i], mixes,
+				  (float)(level * NUM_LEAVES + i));
+		}
+	}
+
+	start = os_gettime_ns();
+	for (int i = 0; i < NUM_TICKS; i++)
+		render_scalar(0);
+	scalar_ns = os_gettime_ns() - start;
+
+	memcpy(expected, scenes[0].data, size);
+
+	start = os_gettime_ns();
+	for (int i = 0; i < NUM_TICKS; i++)
+		render_masked(0, fade);
+	masked_ns = os_gettime_ns() - start;
+
+	for (size_t i = 0; i < size / sizeof(float); i++)
+		assert_true(fabsf(scenes[0].data[i] - expected[i]) < 1e-4f);
+
+	printf("%d levels of %d channel audio: %.1f us per tick before, "
+	       "%.1f us now\n",
+	       NUM_LEVELS, MAX_AUDIO_CHANNELS,
+	       (double)scalar_ns / NUM_TICKS / 1000.0,
+	       (double)masked_ns / NUM_TICKS / 1000.0);
+
+	for (size_t level = 0; level < NUM_LEVELS; level++) {
+		bfree(scenes[level].data);
+		for (size_t i = 0; i < NUM_LEAVES; i++)
+			bfree(leaves[level][i].data);
+	}
+
+	bfree(expected);
+	bfree(fade);
+
+	UNUSED_PARAMETER(state);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(add_test),
+		cmocka_unit_test(nested_scene_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,121 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdio.h>
+#include <obs.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+
+#define NUM_SCENES 5000
+#define NUM_LOOKUPS 200000
+
+static obs_scene_t *scenes[NUM_SCENES];
+
+static int setup(void **state)
+{
+	struct dstr name = {0};
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return -1;
+
+	for (size_t i = 0; i < NUM_SCENES; i++) {
+		dstr_printf(&name, "Scene %zu", i);
+		scenes[i] = obs_scene_create(name.array);
+	}
+
+	dstr_free(&name);
+
+	UNUSED_PARAMETER(state);
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	for (size_t i = 0; i < NUM_SCENES; i++)
+		obs_scene_release(scenes[i]);
+
+	obs_shutdown();
+
+	UNUSED_PARAMETER(state);
+	return 0;
+}
+
+static void lookup_test(void **state)
+{
+	obs_source_t *scene = obs_scene_get_source(scenes[1234]);
+	obs_source_t *source;
+
+	source = obs_get_source_by_name("Scene 1234");
+	assert_ptr_equal(source, scene);
+	obs_source_release(source);
+
+	source = obs_get_source_by_uuid(obs_source_get_uuid(scene));
+	assert_ptr_equal(source, scene);
+	obs_source_release(source);
+
+	assert_null(obs_get_source_by_name("Scene 5000"));
+	assert_null(obs_get_source_by_uuid("not a uuid"));
+
+	/* renaming moves the source in the index */
+	obs_source_set_name(scene, "Renamed");
+	assert_null(obs_get_source_by_name("Scene 1234"));
+
+	source = obs_get_source_by_name("Renamed");
+	assert_ptr_equal(source, scene);
+	obs_source_release(source);
+
+	obs_source_set_name(scene, "Scene 1234");
+
+	UNUSED_PARAMETER(state);
+}
+
+static void uuid_test(void **state)
+{
+	const char *uuid = obs_source_get_uuid(obs_scene_get_source(scenes[0]));
+
+	assert_non_null(uuid);
+	assert_int_equal(strlen(uuid), 36);
+	assert_int_equal(uuid[14], '4');
+	assert_string_not_equal(
+		uuid, obs_source_get_uuid(obs_scene_get_source(scenes[1])));
+
+	UNUSED_PARAMETER(state);
+}
+
+static void lookup_benchmark(void **state)
+{
+	struct dstr name = {0};
+	uint64_t start;
+	double ns;
+
+	start = os_gettime_ns();
+
+	for (size_t i = 0; i < NUM_LOOKUPS; i++) {
+		obs_source_t *source;
+
+		dstr_printf(&name, "Scene %zu", (i * 7919) % NUM_SCENES);
+		source = obs_get_source_by_name(name.array);
+		assert_non_null(source);
+		obs_source_release(source);
+	}
+
+	ns = (double)(os_gettime_ns() - start) / NUM_LOOKUPS;
+	printf("%d sources: %.0f ns per lookup by name\n", NUM_SCENES, ns);
+
+	dstr_free(&name);
+
+	UNUSED_PARAMETER(state);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(lookup_test),
+		cmocka_unit_test(uuid_test),
+		cmocka_unit_test(lookup_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,162 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/bmem.h>
+#include "dbr-estimator.h"
+
+#define FPS 30
+#define FRAME_NS (1000000000ULL / FPS)
+
+/* netem style link: a send buffer that drains at a fixed rate.  A blocking
+ * send returns once the whole frame fits in the buffer. */
+struct shaper {
+	double rate_bytes_per_ns;
+	double buffer_size;
+	double busy_until;
+	double last_send_end;
+};
+
+static void shaper_init(struct shaper *shaper, long kbps, size_t buffer_size)
+{
+	memset(shaper, 0, sizeof(*shaper));
+	shaper->rate_bytes_per_ns = (double)kbps * 1000.0 / 8.0 / 1e9;
+	shaper->buffer_size = (double)buffer_size;
+}
+
+static void shaper_send(struct shaper *shaper, uint64_t capture_ts,
+			size_t size, struct dbr_sample *sample)
+{
+	double send_beg = (double)capture_ts;
+	double fits_at;
+	double send_end;
+
+	/* one send thread: a frame waits for the previous one */
+	if (send_beg < shaper->last_send_end)
+		send_beg = shaper->last_send_end;
+
+	fits_at = shaper->busy_until -
+		  (shaper->buffer_size - (double)size) /
+			  shaper->rate_bytes_per_ns;
+	send_end = fits_at > send_beg ? fits_at : send_beg;
+
+	if (shaper->busy_until < send_beg)
+		shaper->busy_until = send_beg;
+	shaper->busy_until += (double)size / shaper->rate_bytes_per_ns;
+	shaper->last_send_end = send_end;
+
+	sample->send_beg = (uint64_t)send_beg;
+	sample->send_end = (uint64_t)send_end;
+	sample->size = size;
+	sample->queue_delay_usec = (int64_t)((send_end - capture_ts) / 1000.0);
+}
+
+struct run_result {
+	long bandwidth;
+	bool congested;
+
+	/* queue delay of the first frame considered congested */
+	int64_t queue_delay_usec;
+};
+
+/* sends seconds worth of frames at bitrate over a link of link_kbps */
+static void run(const char *id, long bitrate, long link_kbps, int seconds,
+		struct run_result *result)
+{
+	struct dbr_estimator est;
+	struct shaper shaper;
+	size_t frame_size = (size_t)(bitrate * 1000 / 8 / FPS);
+
+	assert_true(dbr_estimator_init(&est, id));
+	assert_string_equal(est.info->id, id);
+	shaper_init(&shaper, link_kbps, 64 * 1024);
+
+	memset(result, 0, sizeof(*result));
+
+	for (int i = 0; i < seconds * FPS; i++) {
+		uint64_t capture_ts = (uint64_t)i * FRAME_NS;
+		struct dbr_sample sample;
+		int64_t buffer_duration;
+
+		shaper_send(&shaper, capture_ts, frame_size, &sample);
+		dbr_estimator_add_sample(&est, &sample);
+
+		/* video still waiting to be sent when this frame is done */
+		buffer_duration = sample.queue_delay_usec;
+
+		result->bandwidth = dbr_estimator_bandwidth(&est);
+
+		if (!result->congested &&
+		    dbr_estimator_congested(&est, buffer_duration)) {
+			result->queue_delay_usec = sample.queue_delay_usec;
+			result->congested = true;
+		}
+	}
+
+	dbr_estimator_free(&est);
+}
+
+static void send_rate_test(void **state)
+{
+	struct run_result result;
+
+	UNUSED_PARAMETER(state);
+
+	/* twice the link capacity: congested, bandwidth close to the link */
+	run("send_rate", 6000, 3000, 10, &result);
+	assert_true(result.congested);
+	assert_in_range(result.bandwidth, 2500, 3500);
+
+	/* below the link capacity */
+	run("send_rate", 2000, 3000, 10, &result);
+	assert_false(result.congested);
+	assert_in_range(result.bandwidth, 1800, 2200);
+}
+
+static void delay_gradient_test(void **state)
+{
+	struct run_result gradient;
+	struct run_result send_rate;
+
+	UNUSED_PARAMETER(state);
+
+	/* slightly over capacity: the growing delay is noticed before the
+	 * queue reaches the send rate estimator's fixed threshold */
+	run("delay_gradient", 3300, 3000, 20, &gradient);
+	run("send_rate", 3300, 3000, 20, &send_rate);
+
+	assert_true(gradient.congested);
+	assert_true(send_rate.congested);
+	assert_true(gradient.queue_delay_usec < send_rate.queue_delay_usec);
+	assert_in_range(gradient.bandwidth, 2000, 3000);
+
+	/* steady delay is not congestion */
+	run("delay_gradient", 2000, 3000, 10, &gradient);
+	assert_false(gradient.congested);
+}
+
+static void unknown_estimator_test(void **state)
+{
+	struct dbr_estimator est;
+
+	UNUSED_PARAMETER(state);
+
+	assert_true(dbr_estimator_init(&est, "does_not_exist"));
+	assert_string_equal(est.info->id, DBR_DEFAULT_ESTIMATOR);
+	dbr_estimator_free(&est);
+
+	assert_non_null(dbr_enum_estimators(0));
+	assert_null(dbr_enum_estimators(1000));
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(send_rate_test),
+		cmocka_unit_test(delay_gradient_test),
+		cmocka_unit_test(unknown_estimator_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,212 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <obs.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+/* an encoder slower than the frame rate, so frames queue up behind the one
+ * being encoded */
+#define ENCODE_MS 100
+
+/* internal to libobs, outputs start and stop encoders through these */
+extern bool obs_encoder_initialize(obs_encoder_t *encoder);
+extern void obs_encoder_start(obs_encoder_t *encoder,
+			      void (*new_packet)(void *param,
+						 struct encoder_packet *packet),
+			      void *param);
+extern void obs_encoder_stop(obs_encoder_t *encoder,
+			     void (*new_packet)(void *param,
+						struct encoder_packet *packet),
+			     void *param);
+
+static const uint8_t frame_data[] = {0x00, 0x00, 0x00, 0x01, 0x65};
+
+static volatile long encode_calls;
+
+struct packet_counter {
+	volatile long packets;
+};
+
+static const char *slow_get_name(void *type_data)
+{
+	UNUSED_PARAMETER(type_data);
+	return "Slow";
+}
+
+static void *slow_create(obs_data_t *settings, obs_encoder_t *encoder)
+{
+	UNUSED_PARAMETER(settings);
+	UNUSED_PARAMETER(encoder);
+	return bzalloc(1);
+}
+
+static bool slow_encode(void *data, struct encoder_frame *frame,
+			struct encoder_packet *packet, bool *received_packet)
+{
+	os_atomic_inc_long(&encode_calls);
+	os_sleep_ms(ENCODE_MS);
+
+	packet->data = (uint8_t *)frame_data;
+	packet->size = sizeof(frame_data);
+	packet->type = OBS_ENCODER_VIDEO;
+	packet->pts = frame->pts;
+	packet->dts = frame->pts;
+	packet->keyframe = true;
+	*received_packet = true;
+
+	UNUSED_PARAMETER(data);
+	return true;
+}
+
+static struct obs_encoder_info slow_info = {
+	.id = "test_slow",
+	.type = OBS_ENCODER_VIDEO,
+	.codec = "h264",
+	.caps = OBS_ENCODER_CAP_ASYNC_ENCODE,
+	.get_name = slow_get_name,
+	.create = slow_create,
+	.destroy = bfree,
+	.encode = slow_encode,
+};
+
+static int setup(void **state)
+{
+	struct obs_video_info ovi = {
+		.graphics_module = NULL_GRAPHICS_MODULE,
+		.fps_num = 30,
+		.fps_den = 1,
+		.base_width = 64,
+		.base_height = 64,
+		.output_width = 64,
+		.output_height = 64,
+		.output_format = VIDEO_FORMAT_NV12,
+		.colorspace = VIDEO_CS_709,
+		.range = VIDEO_RANGE_PARTIAL,
+		.scale_type = OBS_SCALE_BILINEAR,
+	};
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return -1;
+
+	obs_add_data_path(LIBOBS_DATA_PATH);
+	obs_register_encoder(&slow_info);
+
+	if (obs_reset_video(&ovi) != OBS_VIDEO_SUCCESS) {
+		obs_shutdown();
+		return -1;
+	}
+
+	UNUSED_PARAMETER(state);
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	obs_shutdown();
+
+	UNUSED_PARAMETER(state);
+	return 0;
+}
+
+static void count_packet(void *param, struct encoder_packet *packet)
+{
+	struct packet_counter *counter = param;
+
+	os_atomic_inc_long(&counter->packets);
+	UNUSED_PARAMETER(packet);
+}
+
+static obs_encoder_t *create_started(struct packet_counter *counter)
+{
+	obs_encoder_t *encoder =
+		obs_video_encoder_create("test_slow", "slow", NULL, NULL);
+
+	assert_non_null(encoder);
+	obs_encoder_set_video(encoder, obs_get_video());
+	assert_true(obs_encoder_initialize(encoder));
+
+	obs_encoder_start(encoder, count_packet, counter);
+	assert_true(obs_encoder_active(encoder));
+	return encoder;
+}
+
+static bool wait_for_packets(struct packet_counter *counter, long count)
+{
+	for (int i = 0; i < 300; i++) {
+		if (os_atomic_load_long(&counter->packets) >= count)
+			return true;
+		os_sleep_ms(10);
+	}
+
+	return false;
+}
+
+/* stopping while a frame is being encoded and more are queued behind it
+ * returns once the encode thread is done, and nothing reaches the callback
+ * after that.  the queued frames are not encoded */
+static void stop_during_inflight_test(void **state)
+{
+	struct packet_counter counter = {0};
+	obs_encoder_t *encoder = create_started(&counter);
+	long calls, packets;
+
+	assert_true(wait_for_packets(&counter, 2));
+
+	calls = os_atomic_load_long(&encode_calls);
+	obs_encoder_stop(encoder, count_packet, &counter);
+	packets = os_atomic_load_long(&counter.packets);
+
+	assert_false(obs_encoder_active(encoder));
+	assert_true(os_atomic_load_long(&encode_calls) <= calls + 1);
+
+	os_sleep_ms(ENCODE_MS * 3);
+	assert_int_equal(os_atomic_load_long(&counter.packets), packets);
+
+	obs_encoder_release(encoder);
+
+	UNUSED_PARAMETER(state);
+}
+
+/* a second callback stopping leaves the first one receiving packets, and
+ * the encoder delivers again after a stop and restart */
+static void stop_and_restart_test(void **state)
+{
+	struct packet_counter first = {0};
+	struct packet_counter second = {0};
+	obs_encoder_t *encoder = create_started(&first);
+	long packets;
+
+	obs_encoder_start(encoder, count_packet, &second);
+	assert_true(wait_for_packets(&second, 1));
+
+	obs_encoder_stop(encoder, count_packet, &second);
+	packets = os_atomic_load_long(&first.packets);
+	assert_true(wait_for_packets(&first, packets + 2));
+	assert_true(obs_encoder_active(encoder));
+
+	obs_encoder_stop(encoder, count_packet, &first);
+	assert_false(obs_encoder_active(encoder));
+
+	first.packets = 0;
+	assert_true(obs_encoder_initialize(encoder));
+	obs_encoder_start(encoder, count_packet, &first);
+	assert_true(wait_for_packets(&first, 2));
+
+	obs_encoder_stop(encoder, count_packet, &first);
+	obs_encoder_release(encoder);
+
+	UNUSED_PARAMETER(state);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(stop_during_inflight_test),
+		cmocka_unit_test(stop_and_restart_test),
+	};
+
+	return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,208 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdio.h>
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include "file-writer.h"
+#include "fmp4-mux.h"
+
+#define NUM_FRAMES 60
+#define KEYFRAME_INTERVAL 30
+#define OPUS_CHANNELS 16
+
+#define WRITE_CHUNK_SIZE (64 * 1024)
+#define WRITE_TOTAL_SIZE (128 * 1024 * 1024)
+
+static const uint8_t avc_header[] = {0, 0, 0, 1, 0x67, 0x64, 0x00, 0x28,
+				     0xac, 0, 0, 0, 1, 0x68, 0xee, 0x3c};
+
+struct output {
+	DARRAY(uint8_t) data;
+};
+
+static void append_output(void *param, const void *data, size_t size)
+{
+	struct output *out = param;
+	da_push_back_array(out->data, (const uint8_t *)data, size);
+}
+
+static inline uint32_t rb32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | p[3];
+}
+
+static const uint8_t *find_box(const uint8_t *data, size_t size,
+			       const char *type)
+{
+	for (size_t i = 4; i + 4 <= size; i++) {
+		if (memcmp(data + i, type, 4) == 0)
+			return data + i - 4;
+	}
+
+	return NULL;
+}
+
+static void fmp4_structure_test(void **state)
+{
+	struct output output;
+	struct fmp4_mux mux;
+	struct fmp4_track_info video = {.codec = FMP4_CODEC_H264,
+					.extra_data = avc_header,
+					.extra_size = sizeof(avc_header),
+					.timescale = 90000,
+					.width = 1920,
+					.height = 1080};
+	struct fmp4_track_info audio = {.codec = FMP4_CODEC_OPUS,
+					.timescale = 48000,
+					.sample_rate = 48000,
+					.channels = OPUS_CHANNELS};
+	uint8_t frame[64] = {0, 0, 0, 1, 0x09, 0xf0, 0, 0, 0, 1, 0x65};
+	uint8_t audio_frame[32] = {0};
+	size_t pos = 0, fragments = 0;
+	const uint8_t *out, *dops;
+	size_t out_size;
+
+	/* nal units never end in a zero byte */
+	memset(frame + 11, 0xaa, sizeof(frame) - 11);
+
+	da_init(output.data);
+	fmp4_mux_init(&mux, 1000, append_output, &output);
+	assert_int_equal(fmp4_mux_add_track(&mux, &video), 0);
+	assert_int_equal(fmp4_mux_add_track(&mux, &audio), 1);
+
+	for (int i = 0; i < NUM_FRAMES; i++) {
+		struct encoder_packet packet = {.type = OBS_ENCODER_VIDEO,
+						.timebase_num = 1,
+						.timebase_den = 30,
+						.data = frame,
+						.size = sizeof(frame),
+						.pts = i,
+						.dts = i};
+
+		packet.keyframe = i % KEYFRAME_INTERVAL == 0;
+		frame[10] = packet.keyframe ? 0x65 : 0x41;
+		fmp4_mux_packet(&mux, 0, &packet);
+
+		/* two 20 ms opus frames per video frame, close enough */
+		for (int j = 0; j < 2; j++) {
+			struct encoder_packet apacket = {
+				.type = OBS_ENCODER_AUDIO,
+				.timebase_num = 1,
+				.timebase_den = 48000,
+				.data = audio_frame,
+				.size = sizeof(audio_frame),
+				.pts = (i * 2 + j) * 800,
+				.dts = (i * 2 + j) * 800};
+
+			fmp4_mux_packet(&mux, 1, &apacket);
+		}
+	}
+
+	fmp4_mux_flush(&mux);
+	out = output.data.array;
+	out_size = output.data.num;
+
+	/* the multichannel opus config must survive without an OpusHead */
+	dops = find_box(out, out_size, "dOps");
+	assert_non_null(dops);
+	assert_int_equal(dops[9], OPUS_CHANNELS);
+	assert_int_equal(dops[18], 255);
+	assert_int_equal(dops[19], OPUS_CHANNELS);
+
+	assert_memory_equal(out + 4, "ftyp", 4);
+	pos += rb32(out);
+	assert_memory_equal(out + pos + 4, "moov", 4);
+	pos += rb32(out + pos);
+
+	while (pos < out_size) {
+		const uint8_t *moof = out + pos;
+		size_t moof_size = rb32(moof);
+		const uint8_t *mdat = moof + moof_size;
+		const uint8_t *trun;
+		uint32_t samples, offset;
+
+		assert_memory_equal(moof + 4, "moof", 4);
+		assert_memory_equal(mdat + 4, "mdat", 4);
+
+		/* the first run is video, its first sample starts with a
+		 * keyframe nal, the aud is gone */
+		trun = find_box(moof, moof_size, "trun");
+		assert_non_null(trun);
+		samples = rb32(trun + 12);
+		offset = rb32(trun + 16);
+		assert_int_equal(samples, KEYFRAME_INTERVAL);
+		assert_true(offset >= moof_size + 8);
+		assert_int_equal(rb32(moof + offset), sizeof(frame) - 10);
+		assert_int_equal(moof[offset + 4], 0x65);
+
+		pos += moof_size + rb32(mdat);
+		fragments++;
+	}
+
+	assert_int_equal(pos, out_size);
+	assert_int_equal(fragments, NUM_FRAMES / KEYFRAME_INTERVAL);
+
+	fmp4_mux_free(&mux);
+	da_free(output.data);
+
+	UNUSED_PARAMETER(state);
+}
+
+static void file_writer_test(void **state)
+{
+	const char *path = "test_file_mux.tmp";
+	uint8_t *chunk = bmalloc(WRITE_CHUNK_SIZE);
+	uint8_t *check = bmalloc(WRITE_CHUNK_SIZE);
+	struct file_writer *writer;
+	uint64_t start, elapsed;
+	FILE *file;
+
+	writer = file_writer_open(path, 8 * 1024 * 1024);
+	assert_non_null(writer);
+
+	start = os_gettime_ns();
+	for (size_t i = 0; i < WRITE_TOTAL_SIZE / WRITE_CHUNK_SIZE; i++) {
+		memset(chunk, (int)(i & 0xff), WRITE_CHUNK_SIZE);
+		assert_true(file_writer_write(writer, chunk, WRITE_CHUNK_SIZE));
+	}
+
+	assert_int_equal(file_writer_total_bytes(writer), WRITE_TOTAL_SIZE);
+	assert_true(file_writer_close(writer));
+	elapsed = os_gettime_ns() - start;
+
+	print_message("write-behind throughput: %.1f MB/s\n",
+		      (double)WRITE_TOTAL_SIZE / (1024.0 * 1024.0) /
+			      ((double)elapsed / 1000000000.0));
+
+	file = os_fopen(path, "rb");
+	assert_non_null(file);
+	for (size_t i = 0; i < WRITE_TOTAL_SIZE / WRITE_CHUNK_SIZE; i++) {
+		memset(chunk, (int)(i & 0xff), WRITE_CHUNK_SIZE);
+		assert_int_equal(fread(check, 1, WRITE_CHUNK_SIZE, file),
+				 WRITE_CHUNK_SIZE);
+		assert_memory_equal(check, chunk, WRITE_CHUNK_SIZE);
+	}
+	assert_int_equal(fread(check, 1, 1, file), 0);
+	fclose(file);
+
+	os_unlink(path);
+	bfree(chunk);
+	bfree(check);
+
+	UNUSED_PARAMETER(state);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(fmp4_structure_test),
+		cmocka_unit_test(file_writer_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,326 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "flv-mux.h"
+#include "librtmp/rtmp.h"
+
+static void fill_packet(struct encoder_packet *packet, uint8_t *data,
+			size_t size, enum obs_encoder_type type, int64_t dts)
+{
+	for (size_t i = 0; i < size; i++)
+		data[i] = (uint8_t)(i * 7 + dts);
+
+	memset(packet, 0, sizeof(*packet));
+	packet->type = type;
+	packet->data = data;
+	packet->size = size;
+	packet->timebase_den = 1000;
+	packet->dts = dts;
+	packet->pts = dts + 33;
+	packet->keyframe = true;
+}
+
+static void join_tag(const struct flv_tag *tag, uint8_t *out)
+{
+	memcpy(out, tag->header, tag->header_size);
+	out += tag->header_size;
+	memcpy(out, tag->payload, tag->payload_size);
+	out += tag->payload_size;
+	memcpy(out, tag->trailer, tag->trailer_size);
+}
+
+static void video_tag_test(void **state)
+{
+	struct array_output_data buf = {0};
+	struct encoder_packet packet;
+	struct flv_tag tag;
+	uint8_t data[1000];
+	uint8_t joined[1100];
+	uint8_t *prev_array;
+	const uint8_t expected_header[] = {
+		RTMP_PACKET_TYPE_VIDEO, 0x00, 0x03, 0xed, 0x00, 0x01,
+		0x2c, 0x00, 0x00, 0x00, 0x00, 0x17, 0x01, 0x00, 0x00, 0x21};
+	const uint8_t expected_trailer[] = {0x00, 0x00, 0x03, 0xf7};
+
+	UNUSED_PARAMETER(state);
+
+	fill_packet(&packet, data, sizeof(data), OBS_ENCODER_VIDEO, 300);
+	flv_packet_mux_tag(&buf, &packet, 0, false, &tag);
+
+	assert_int_equal(tag.header_size, sizeof(expected_header));
+	assert_memory_equal(tag.header, expected_header,
+			    sizeof(expected_header));
+	assert_ptr_equal(tag.payload, data);
+	assert_int_equal(tag.payload_size, sizeof(data));
+	assert_int_equal(tag.trailer_size, sizeof(expected_trailer));
+	assert_memory_equal(tag.trailer, expected_trailer,
+			    sizeof(expected_trailer));
+
+	/* the buffer is reused, not reallocated, for the next tag */
+	prev_array = buf.bytes.array;
+	fill_packet(&packet, data, sizeof(data), OBS_ENCODER_AUDIO, 320);
+	flv_packet_mux_tag(&buf, &packet, 0, false, &tag);
+	assert_ptr_equal(buf.bytes.array, prev_array);
+	assert_int_equal(flv_tag_size(&tag), 11 + 2 + sizeof(data) + 4);
+
+	join_tag(&tag, joined);
+	assert_int_equal(joined[0], RTMP_PACKET_TYPE_AUDIO);
+	assert_int_equal(joined[11], 0xaf);
+	assert_memory_equal(joined + 13, data, sizeof(data));
+
+	/* empty packets produce nothing */
+	packet.size = 0;
+	flv_packet_mux_tag(&buf, &packet, 0, false, &tag);
+	assert_int_equal(flv_tag_size(&tag), 0);
+
+	array_output_serializer_free(&buf);
+}
+
+static void additional_audio_tag_test(void **state)
+{
+	struct array_output_data buf = {0};
+	struct encoder_packet packet;
+	struct flv_tag tag;
+	uint8_t data[200];
+	uint8_t joined[400];
+	size_t size, body_size;
+
+	UNUSED_PARAMETER(state);
+
+	fill_packet(&packet, data, sizeof(data), OBS_ENCODER_AUDIO, 40);
+	flv_additional_packet_mux_tag(&buf, &packet, 0, false, 1, &tag);
+
+	size = flv_tag_size(&tag);
+	join_tag(&tag, joined);
+
+	body_size = ((size_t)joined[1] << 16) | ((size_t)joined[2] << 8) |
+		    joined[3];
+	assert_int_equal(joined[0], RTMP_PACKET_TYPE_INFO);
+	assert_int_equal(body_size, size - 11 - 4);
+	assert_memory_equal(joined + tag.header_size, data, sizeof(data));
+
+	/* AMF object end, then the previous tag size */
+	assert_int_equal(joined[size - 5], AMF_OBJECT_END);
+	assert_int_equal(joined[size - 1], (uint8_t)(size - 4 - 1));
+
+	array_output_serializer_free(&buf);
+}
+
+struct capture {
+	DARRAY(uint8_t) bytes;
+	int sends;
+
+	/* bytes that were passed by pointer into this buffer */
+	const uint8_t *data;
+	size_t data_size;
+	size_t from_data;
+};
+
+static int capture_send(RTMPSockBuf *sb, const char *buf, int len, void *param)
+{
+	struct capture *cap = param;
+
+	UNUSED_PARAMETER(sb);
+	da_push_back_array(cap->bytes, (const uint8_t *)buf, len);
+	cap->sends++;
+	return len;
+}
+
+static int capture_send_v(RTMPSockBuf *sb, const AVal *parts, int count,
+			  void *param)
+{
+	struct capture *cap = param;
+	int len = 0;
+
+	UNUSED_PARAMETER(sb);
+
+	for (int i = 0; i < count; i++) {
+		const uint8_t *ptr = (const uint8_t *)parts[i].av_val;
+
+		if (ptr >= cap->data && ptr < cap->data + cap->data_size)
+			cap->from_data += parts[i].av_len;
+
+		da_push_back_array(cap->bytes, ptr, parts[i].av_len);
+		len += parts[i].av_len;
+	}
+
+	cap->sends++;
+	return len;
+}
+
+static void init_rtmp(RTMP *r, struct capture *cap)
+{
+	RTMP_Init(r);
+	r->m_bCustomSend = 1;
+	r->m_customSendFunc = capture_send;
+	r->m_customSendParam = cap;
+	r->Link.streams[0].id = 1;
+}
+
+/* writes the same four tags with RTMP_Write and RTMP_WriteV, returns the
+ * number of payload bytes */
+static size_t write_tags(RTMP *r_write, RTMP *r_write_v, uint8_t *data,
+			 size_t data_size)
+{
+	struct array_output_data buf = {0};
+	struct encoder_packet packet;
+	uint8_t joined[1100];
+	size_t payload_size = 0;
+
+	assert_true(data_size + 100 <= sizeof(joined));
+
+	for (int i = 0; i < 4; i++) {
+		struct flv_tag tag;
+		AVal parts[3];
+		int size;
+
+		/* same size and timestamp twice to hit header compression */
+		fill_packet(&packet, data, data_size - (i / 2) * 100,
+			    i & 1 ? OBS_ENCODER_AUDIO : OBS_ENCODER_VIDEO,
+			    (i / 2) * 33);
+		flv_packet_mux_tag(&buf, &packet, 0, false, &tag);
+
+		size = (int)flv_tag_size(&tag);
+		join_tag(&tag, joined);
+		payload_size += tag.payload_size;
+
+		parts[0].av_val = (char *)tag.header;
+		parts[0].av_len = (int)tag.header_size;
+		parts[1].av_val = (char *)tag.payload;
+		parts[1].av_len = (int)tag.payload_size;
+		parts[2].av_val = (char *)tag.trailer;
+		parts[2].av_len = (int)tag.trailer_size;
+
+		assert_int_equal(RTMP_Write(r_write, (char *)joined, size, 0),
+				 size);
+		assert_int_equal(RTMP_WriteV(r_write_v, parts, 3, 0), size);
+	}
+
+	array_output_serializer_free(&buf);
+	return payload_size;
+}
+
+/* RTMP_WriteV must put exactly the same chunks on the wire as RTMP_Write
+ * does for the joined tag, each chunk in a single write */
+static void rtmp_write_v_test(void **state)
+{
+	struct capture write_cap = {0};
+	struct capture write_v_cap = {0};
+	RTMP *r_write = bzalloc(sizeof(RTMP));
+	RTMP *r_write_v = bzalloc(sizeof(RTMP));
+	uint8_t data[1000];
+
+	UNUSED_PARAMETER(state);
+
+	init_rtmp(r_write, &write_cap);
+	init_rtmp(r_write_v, &write_v_cap);
+
+	write_tags(r_write, r_write_v, data, sizeof(data));
+
+	assert_int_equal(write_cap.bytes.num, write_v_cap.bytes.num);
+	assert_memory_equal(write_cap.bytes.array, write_v_cap.bytes.array,
+			    write_cap.bytes.num);
+	assert_int_equal(write_cap.sends, write_v_cap.sends);
+
+	RTMP_Close(r_write);
+	RTMP_Close(r_write_v);
+	bfree(r_write);
+	bfree(r_write_v);
+	da_free(write_cap.bytes);
+	da_free(write_v_cap.bytes);
+}
+
+/* with a vectored send function the payload is passed through, not copied */
+static void rtmp_write_v_vectored_test(void **state)
+{
+	struct capture write_cap = {0};
+	struct capture write_v_cap = {0};
+	RTMP *r_write = bzalloc(sizeof(RTMP));
+	RTMP *r_write_v = bzalloc(sizeof(RTMP));
+	uint8_t data[1000];
+	size_t payload_size;
+
+	UNUSED_PARAMETER(state);
+
+	init_rtmp(r_write, &write_cap);
+	init_rtmp(r_write_v, &write_v_cap);
+	r_write_v->m_customSendVFunc = capture_send_v;
+	write_v_cap.data = data;
+	write_v_cap.data_size = sizeof(data);
+
+	payload_size = write_tags(r_write, r_write_v, data, sizeof(data));
+
+	assert_int_equal(write_cap.bytes.num, write_v_cap.bytes.num);
+	assert_memory_equal(write_cap.bytes.array, write_v_cap.bytes.array,
+			    write_cap.bytes.num);
+	assert_int_equal(write_cap.sends, write_v_cap.sends);
+	assert_int_equal(write_v_cap.from_data, payload_size);
+
+	RTMP_Close(r_write);
+	RTMP_Close(r_write_v);
+	bfree(r_write);
+	bfree(r_write_v);
+	da_free(write_cap.bytes);
+	da_free(write_v_cap.bytes);
+}
+
+#ifndef _WIN32
+/* the gathered socket send must produce the same stream as well */
+static void rtmp_write_v_socket_test(void **state)
+{
+	struct capture write_cap = {0};
+	RTMP *r_write = bzalloc(sizeof(RTMP));
+	RTMP *r_write_v = bzalloc(sizeof(RTMP));
+	uint8_t data[1000];
+	uint8_t *received;
+	ssize_t ret;
+	int sv[2];
+
+	UNUSED_PARAMETER(state);
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+
+	init_rtmp(r_write, &write_cap);
+	RTMP_Init(r_write_v);
+	r_write_v->m_sb.sb_socket = sv[0];
+	r_write_v->Link.streams[0].id = 1;
+
+	write_tags(r_write, r_write_v, data, sizeof(data));
+
+	received = bmalloc(write_cap.bytes.num);
+	ret = recv(sv[1], received, write_cap.bytes.num, MSG_WAITALL);
+	assert_int_equal(ret, write_cap.bytes.num);
+	assert_memory_equal(write_cap.bytes.array, received,
+			    write_cap.bytes.num);
+
+	RTMP_Close(r_write);
+	RTMP_Close(r_write_v);
+	close(sv[1]);
+	bfree(received);
+	bfree(r_write);
+	bfree(r_write_v);
+	da_free(write_cap.bytes);
+}
+#endif
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(video_tag_test),
+		cmocka_unit_test(additional_audio_tag_test),
+		cmocka_unit_test(rtmp_write_v_test),
+		cmocka_unit_test(rtmp_write_v_vectored_test),
+#ifndef _WIN32
+		cmocka_unit_test(rtmp_write_v_socket_test),
+#endif
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
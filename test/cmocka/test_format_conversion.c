@@ -0,0 +1,363 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/platform.h>
+#include <media-io/format-conversion.h>
+#include <media-io/video-frame.h>
+
+static const enum video_format formats[] = {
+	VIDEO_FORMAT_I420, VIDEO_FORMAT_NV12, VIDEO_FORMAT_YVYU,
+	VIDEO_FORMAT_YUY2, VIDEO_FORMAT_UYVY, VIDEO_FORMAT_RGBA,
+	VIDEO_FORMAT_BGRA, VIDEO_FORMAT_BGRX, VIDEO_FORMAT_Y800,
+	VIDEO_FORMAT_I444, VIDEO_FORMAT_BGR3, VIDEO_FORMAT_I422,
+	VIDEO_FORMAT_I40A, VIDEO_FORMAT_I42A, VIDEO_FORMAT_YUVA,
+	VIDEO_FORMAT_AYUV,
+};
+
+#define NUM_FORMATS (sizeof(formats) / sizeof(formats[0]))
+
+/* bytes per row and number of rows of each plane, 0 if the plane is unused */
+static void plane_size(enum video_format format, size_t plane, uint32_t width,
+		       uint32_t height, uint32_t *row_bytes, uint32_t *rows)
+{
+	*row_bytes = 0;
+	*rows = height;
+
+	if (plane > 3)
+		return;
+
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_I40A:
+		if (plane == 0 || plane == 3) {
+			if (plane == 0 || format == VIDEO_FORMAT_I40A)
+				*row_bytes = width;
+		} else {
+			*row_bytes = width / 2;
+			*rows = height / 2;
+		}
+		break;
+	case VIDEO_FORMAT_I422:
+	case VIDEO_FORMAT_I42A:
+		if (plane == 0 || plane == 3) {
+			if (plane == 0 || format == VIDEO_FORMAT_I42A)
+				*row_bytes = width;
+		} else {
+			*row_bytes = width / 2;
+		}
+		break;
+	case VIDEO_FORMAT_I444:
+		*row_bytes = plane < 3 ? width : 0;
+		break;
+	case VIDEO_FORMAT_YUVA:
+		*row_bytes = width;
+		break;
+	case VIDEO_FORMAT_NV12:
+		if (plane == 0) {
+			*row_bytes = width;
+		} else if (plane == 1) {
+			*row_bytes = width;
+			*rows = height / 2;
+		}
+		break;
+	case VIDEO_FORMAT_YVYU:
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+		*row_bytes = plane == 0 ? width * 2 : 0;
+		break;
+	case VIDEO_FORMAT_Y800:
+		*row_bytes = plane == 0 ? width : 0;
+		break;
+	case VIDEO_FORMAT_BGR3:
+		*row_bytes = plane == 0 ? width * 3 : 0;
+		break;
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+	case VIDEO_FORMAT_AYUV:
+		*row_bytes = plane == 0 ? width * 4 : 0;
+		break;
+	case VIDEO_FORMAT_NONE:
+		break;
+	}
+}
+
+static void fill_frame(struct video_frame *frame, enum video_format format,
+		       uint32_t width, uint32_t height, uint32_t *seed)
+{
+	for (size_t plane = 0; plane < MAX_AV_PLANES; plane++) {
+		uint32_t row_bytes, rows;
+		plane_size(format, plane, width, height, &row_bytes, &rows);
+
+		for (uint32_t y = 0; y < rows; y++) {
+			uint8_t *row =
+				frame->data[plane] + y * frame->linesize[plane];
+
+			for (uint32_t x = 0; x < row_bytes; x++) {
+				*seed = *seed * 1103515245 + 12345;
+				row[x] = (uint8_t)(*seed >> 16);
+			}
+		}
+	}
+}
+
+static void clear_frame(struct video_frame *frame, enum video_format format,
+			uint32_t width, uint32_t height)
+{
+	for (size_t plane = 0; plane < MAX_AV_PLANES; plane++) {
+		uint32_t row_bytes, rows;
+		plane_size(format, plane, width, height, &row_bytes, &rows);
+
+		for (uint32_t y = 0; y < rows; y++)
+			memset(frame->data[plane] + y * frame->linesize[plane],
+			       0xCD, row_bytes);
+	}
+}
+
+static bool frames_equal(const struct video_frame *a,
+			 const struct video_frame *b, enum video_format format,
+			 uint32_t width, uint32_t height)
+{
+	for (size_t plane = 0; plane < MAX_AV_PLANES; plane++) {
+		uint32_t row_bytes, rows;
+		plane_size(format, plane, width, height, &row_bytes, &rows);
+
+		for (uint32_t y = 0; y < rows; y++) {
+			if (memcmp(a->data[plane] + y * a->linesize[plane],
+				   b->data[plane] + y * b->linesize[plane],
+				   row_bytes) != 0)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static void compare_pair(enum video_format in, enum video_format out,
+			 uint32_t width, uint32_t height, uint32_t *seed)
+{
+	struct video_frame src, dst, ref;
+
+	video_frame_init(&src, in, width, height);
+	video_frame_init(&dst, out, width, height);
+	video_frame_init(&ref, out, width, height);
+
+	fill_frame(&src, in, width, height, seed);
+	clear_frame(&dst, out, width, height);
+	clear_frame(&ref, out, width, height);
+
+	assert_true(video_frame_convert(&dst, out, &src, in, width, height,
+					VIDEO_CS_709, VIDEO_RANGE_PARTIAL));
+	assert_true(video_frame_convert_reference(&ref, out, &src, in, width,
+						  height, VIDEO_CS_709,
+						  VIDEO_RANGE_PARTIAL));
+
+	if (!frames_equal(&dst, &ref, out, width, height)) {
+		print_message("%s -> %s (%ux%u) differs from reference\n",
+			      get_video_format_name(in),
+			      get_video_format_name(out), width, height);
+		assert_true(false);
+	}
+
+	video_frame_free(&src);
+	video_frame_free(&dst);
+	video_frame_free(&ref);
+}
+
+static void matches_reference_test(void **state)
+{
+	static const uint32_t sizes[][2] = {{2, 2}, {64, 32}, {98, 18}};
+	uint32_t seed = 1;
+
+	UNUSED_PARAMETER(state);
+
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		for (size_t i = 0; i < NUM_FORMATS; i++) {
+			for (size_t j = 0; j < NUM_FORMATS; j++)
+				compare_pair(formats[i], formats[j],
+					     sizes[s][0], sizes[s][1], &seed);
+		}
+	}
+}
+
+static void odd_size_test(void **state)
+{
+	struct video_frame src, dst;
+
+	UNUSED_PARAMETER(state);
+
+	video_frame_init(&src, VIDEO_FORMAT_RGBA, 4, 4);
+	video_frame_init(&dst, VIDEO_FORMAT_I420, 4, 4);
+
+	assert_false(video_frame_convert(&dst, VIDEO_FORMAT_I420, &src,
+					 VIDEO_FORMAT_RGBA, 3, 4, VIDEO_CS_709,
+					 VIDEO_RANGE_PARTIAL));
+	assert_false(video_frame_convert(&dst, VIDEO_FORMAT_I420, &src,
+					 VIDEO_FORMAT_RGBA, 4, 3, VIDEO_CS_709,
+					 VIDEO_RANGE_PARTIAL));
+	assert_true(video_frame_convert(&dst, VIDEO_FORMAT_BGRA, &src,
+					VIDEO_FORMAT_RGBA, 3, 3, VIDEO_CS_709,
+					VIDEO_RANGE_PARTIAL));
+
+	video_frame_free(&src);
+	video_frame_free(&dst);
+}
+
+static void supported_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	assert_true(video_frame_convert_supported(
+		VIDEO_FORMAT_NV12, VIDEO_FORMAT_I444, 1920, 1080));
+	assert_true(video_frame_convert_supported(
+		VIDEO_FORMAT_BGRA, VIDEO_FORMAT_RGBA, 1919, 1079));
+	assert_false(video_frame_convert_supported(
+		VIDEO_FORMAT_I420, VIDEO_FORMAT_RGBA, 1919, 1080));
+	assert_false(video_frame_convert_supported(
+		VIDEO_FORMAT_NONE, VIDEO_FORMAT_RGBA, 1920, 1080));
+}
+
+static void known_values_test(void **state)
+{
+	struct video_frame src, dst;
+
+	UNUSED_PARAMETER(state);
+
+	video_frame_init(&src, VIDEO_FORMAT_RGBA, 2, 2);
+	video_frame_init(&dst, VIDEO_FORMAT_I420, 2, 2);
+
+	/* white top row, black bottom row */
+	memset(src.data[0], 0xFF, 8);
+	memset(src.data[0] + src.linesize[0], 0, 8);
+	src.data[0][src.linesize[0] + 3] = 0xFF;
+	src.data[0][src.linesize[0] + 7] = 0xFF;
+
+	assert_true(video_frame_convert(&dst, VIDEO_FORMAT_I420, &src,
+					VIDEO_FORMAT_RGBA, 2, 2, VIDEO_CS_709,
+					VIDEO_RANGE_PARTIAL));
+
+	assert_int_equal(dst.data[0][0], 235);
+	assert_int_equal(dst.data[0][1], 235);
+	assert_int_equal(dst.data[0][dst.linesize[0]], 16);
+	assert_int_equal(dst.data[0][dst.linesize[0] + 1], 16);
+	assert_int_equal(dst.data[1][0], 128);
+	assert_int_equal(dst.data[2][0], 128);
+
+	video_frame_free(&src);
+	video_frame_free(&dst);
+}
+
+static void round_trip_test(void **state)
+{
+	const uint32_t width = 64, height = 16;
+	struct video_frame rgb, yuv, out;
+	uint32_t seed = 7;
+
+	UNUSED_PARAMETER(state);
+
+	video_frame_init(&rgb, VIDEO_FORMAT_BGRA, width, height);
+	video_frame_init(&yuv, VIDEO_FORMAT_I444, width, height);
+	video_frame_init(&out, VIDEO_FORMAT_BGRA, width, height);
+
+	fill_frame(&rgb, VIDEO_FORMAT_BGRA, width, height, &seed);
+
+	assert_true(video_frame_convert(&yuv, VIDEO_FORMAT_I444, &rgb,
+					VIDEO_FORMAT_BGRA, width, height,
+					VIDEO_CS_601, VIDEO_RANGE_FULL));
+	assert_true(video_frame_convert(&out, VIDEO_FORMAT_BGRA, &yuv,
+					VIDEO_FORMAT_I444, width, height,
+					VIDEO_CS_601, VIDEO_RANGE_FULL));
+
+	for (uint32_t y = 0; y < height; y++) {
+		const uint8_t *a = rgb.data[0] + y * rgb.linesize[0];
+		const uint8_t *b = out.data[0] + y * out.linesize[0];
+
+		for (uint32_t x = 0; x < width * 4; x++) {
+			if (x % 4 == 3)
+				continue;
+			assert_in_range(a[x] - b[x] + 2, 0, 4);
+		}
+	}
+
+	video_frame_free(&rgb);
+	video_frame_free(&yuv);
+	video_frame_free(&out);
+}
+
+typedef bool (*convert_func_t)(struct video_frame *, enum video_format,
+			       const struct video_frame *, enum video_format,
+			       uint32_t, uint32_t, enum video_colorspace,
+			       enum video_range_type);
+
+static double megapixels_per_sec(convert_func_t convert, enum video_format in,
+				 enum video_format out)
+{
+	const uint32_t width = 1920, height = 1080;
+	const int iterations = 20;
+	struct video_frame src, dst;
+	uint32_t seed = 3;
+	uint64_t start, elapsed;
+
+	video_frame_init(&src, in, width, height);
+	video_frame_init(&dst, out, width, height);
+	fill_frame(&src, in, width, height, &seed);
+
+	start = os_gettime_ns();
+	for (int i = 0; i < iterations; i++)
+		convert(&dst, out, &src, in, width, height, VIDEO_CS_709,
+			VIDEO_RANGE_PARTIAL);
+	elapsed = os_gettime_ns() - start;
+
+	video_frame_free(&src);
+	video_frame_free(&dst);
+
+	return (double)width * height * iterations * 1000.0 /
+	       (double)(elapsed ? elapsed : 1);
+}
+
+static void throughput_test(void **state)
+{
+	static const enum video_format pairs[][2] = {
+		{VIDEO_FORMAT_NV12, VIDEO_FORMAT_I420},
+		{VIDEO_FORMAT_I420, VIDEO_FORMAT_NV12},
+		{VIDEO_FORMAT_YUY2, VIDEO_FORMAT_NV12},
+		{VIDEO_FORMAT_UYVY, VIDEO_FORMAT_I420},
+		{VIDEO_FORMAT_RGBA, VIDEO_FORMAT_BGRA},
+		{VIDEO_FORMAT_BGRX, VIDEO_FORMAT_RGBA},
+		{VIDEO_FORMAT_RGBA, VIDEO_FORMAT_I420},
+		{VIDEO_FORMAT_NV12, VIDEO_FORMAT_BGRA},
+	};
+
+	UNUSED_PARAMETER(state);
+
+	print_message("format conversion kernels: %s\n",
+		      video_frame_convert_get_kernel_name());
+
+	for (size_t i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+		enum video_format in = pairs[i][0];
+		enum video_format out = pairs[i][1];
+
+		print_message("%s -> %s: %.1f MP/s (reference %.1f MP/s)\n",
+			      get_video_format_name(in),
+			      get_video_format_name(out),
+			      megapixels_per_sec(video_frame_convert, in, out),
+			      megapixels_per_sec(video_frame_convert_reference,
+						 in, out));
+	}
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(matches_reference_test),
+		cmocka_unit_test(odd_size_test),
+		cmocka_unit_test(supported_test),
+		cmocka_unit_test(known_values_test),
+		cmocka_unit_test(round_trip_test),
+		cmocka_unit_test(throughput_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,445 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET test_socket_t;
+#define close_socket closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+typedef int test_socket_t;
+#define close_socket close
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include "hls-packager.h"
+
+#define PART_USEC 200000
+#define NUM_PARTS 40
+#define KEYFRAME_PARTS 5
+
+struct stored_file {
+	char *name;
+	size_t size;
+};
+
+struct memory_sink {
+	DARRAY(struct stored_file) files;
+	struct dstr playlist;
+	size_t puts;
+	size_t removes;
+};
+
+static struct stored_file *find_file(struct memory_sink *sink,
+				     const char *name)
+{
+	for (size_t i = 0; i < sink->files.num; i++) {
+		if (strcmp(sink->files.array[i].name, name) == 0)
+			return &sink->files.array[i];
+	}
+
+	return NULL;
+}
+
+static bool memory_put(void *data, const char *name, const void *buf,
+		       size_t size)
+{
+	struct memory_sink *sink = data;
+	struct stored_file *file = find_file(sink, name);
+
+	if (!file) {
+		file = da_push_back_new(sink->files);
+		file->name = bstrdup(name);
+	}
+
+	file->size = size;
+	sink->puts++;
+
+	if (strcmp(name, "index.m3u8") == 0)
+		dstr_ncopy(&sink->playlist, buf, size);
+	return true;
+}
+
+static void memory_remove(void *data, const char *name)
+{
+	struct memory_sink *sink = data;
+
+	for (size_t i = 0; i < sink->files.num; i++) {
+		if (strcmp(sink->files.array[i].name, name) == 0) {
+			bfree(sink->files.array[i].name);
+			da_erase(sink->files, i);
+			break;
+		}
+	}
+
+	sink->removes++;
+}
+
+static const struct hls_sink_info memory_sink_info = {
+	.put = memory_put,
+	.remove = memory_remove,
+};
+
+static uint8_t *make_data(size_t size)
+{
+	uint8_t *data = bmalloc(size);
+	memset(data, 0xaa, size);
+	return data;
+}
+
+static void feed(struct hls_packager *packager, size_t parts)
+{
+	hls_packager_add_init(packager, make_data(100), 100);
+
+	for (size_t i = 0; i < parts; i++) {
+		struct fmp4_fragment fragment = {
+			.independent = i % KEYFRAME_PARTS == 0,
+			.start_usec = (int64_t)i * PART_USEC,
+			.duration_usec = PART_USEC,
+		};
+
+		hls_packager_add_part(packager, make_data(1000), 1000,
+				      &fragment);
+	}
+}
+
+static void playlist_test(void **state)
+{
+	struct memory_sink sink = {0};
+	struct hls_packager_config config = {.segment_ms = 1000,
+					     .part_ms = 200,
+					     .keyint_ms = 1000,
+					     .max_segments = 3,
+					     .playlist_name = "index.m3u8"};
+	struct hls_packager *packager;
+	struct stored_file *file;
+	const char *m3u8;
+
+	packager = hls_packager_create(
+		&config, hls_sink_create_custom(&memory_sink_info, &sink));
+	assert_non_null(packager);
+
+	/* 8 segments of 5 parts each, only the last 3 are kept */
+	feed(packager, NUM_PARTS);
+	hls_packager_destroy(packager);
+
+	m3u8 = sink.playlist.array;
+	assert_non_null(m3u8);
+	assert_non_null(strstr(m3u8, "#EXT-X-TARGETDURATION:1\n"));
+	assert_non_null(strstr(m3u8, "#EXT-X-PART-INF:PART-TARGET=0.200\n"));
+	assert_non_null(strstr(m3u8, "#EXT-X-MEDIA-SEQUENCE:5\n"));
+	assert_non_null(strstr(m3u8, "#EXT-X-MAP:URI=\"init.mp4\"\n"));
+	assert_non_null(strstr(m3u8, "#EXTINF:1.000,\nseg7.m4s\n"));
+	assert_non_null(strstr(m3u8, "#EXT-X-PART:DURATION=0.200,"
+				     "URI=\"seg5.0.m4s\",INDEPENDENT=YES\n"));
+	assert_non_null(strstr(m3u8, "#EXT-X-PART:DURATION=0.200,"
+				     "URI=\"seg7.4.m4s\"\n"));
+	assert_non_null(strstr(m3u8, "#EXT-X-ENDLIST\n"));
+	assert_null(strstr(m3u8, "seg4"));
+	assert_null(strstr(m3u8, "PRELOAD-HINT"));
+
+	/* segments are the concatenation of their parts */
+	file = find_file(&sink, "seg7.m4s");
+	assert_non_null(file);
+	assert_int_equal(file->size, 5 * 1000);
+	assert_non_null(find_file(&sink, "init.mp4"));
+	assert_non_null(find_file(&sink, "seg5.0.m4s"));
+	assert_null(find_file(&sink, "seg4.m4s"));
+	assert_null(find_file(&sink, "seg4.0.m4s"));
+
+	/* init + parts + segments + a playlist per part + the final one */
+	assert_int_equal(sink.puts, 1 + NUM_PARTS + 8 + NUM_PARTS + 1);
+	assert_int_equal(sink.removes, 5 * (1 + KEYFRAME_PARTS));
+
+	for (size_t i = 0; i < sink.files.num; i++)
+		bfree(sink.files.array[i].name);
+	da_free(sink.files);
+	dstr_free(&sink.playlist);
+
+	UNUSED_PARAMETER(state);
+}
+
+/* segments only start at keyframes and never go past the segment duration,
+ * even when a keyframe comes early */
+static void keyframe_test(void **state)
+{
+	static const size_t keyframes[] = {0, 5, 7, 12, 17, 22, 27};
+	struct memory_sink sink = {0};
+	struct hls_packager_config config = {.segment_ms = 2000,
+					     .part_ms = 200,
+					     .keyint_ms = 1000,
+					     .max_segments = 10,
+					     .playlist_name = "index.m3u8"};
+	struct hls_packager *packager;
+	const char *m3u8;
+
+	packager = hls_packager_create(
+		&config, hls_sink_create_custom(&memory_sink_info, &sink));
+	assert_non_null(packager);
+
+	hls_packager_add_init(packager, make_data(100), 100);
+
+	/* a keyframe every second, and one after 1.4 seconds */
+	for (size_t i = 0, k = 0; i < 30; i++) {
+		struct fmp4_fragment fragment = {
+			.start_usec = (int64_t)i * PART_USEC,
+			.duration_usec = PART_USEC,
+		};
+
+		if (k < sizeof(keyframes) / sizeof(keyframes[0]) &&
+		    keyframes[k] == i) {
+			fragment.independent = true;
+			k++;
+		}
+
+		hls_packager_add_part(packager, make_data(1000), 1000,
+				      &fragment);
+	}
+
+	hls_packager_destroy(packager);
+
+	m3u8 = sink.playlist.array;
+	assert_non_null(m3u8);
+	assert_non_null(strstr(m3u8, "#EXT-X-TARGETDURATION:2\n"));
+	assert_non_null(strstr(m3u8, "#EXTINF:1.400,\nseg0.m4s\n"));
+	assert_non_null(strstr(m3u8, "#EXTINF:2.000,\nseg1.m4s\n"));
+	assert_non_null(strstr(m3u8, "#EXTINF:2.000,\nseg2.m4s\n"));
+	assert_non_null(strstr(m3u8, "#EXTINF:0.600,\nseg3.m4s\n"));
+	assert_null(strstr(m3u8, "seg4"));
+	assert_non_null(strstr(m3u8, "#EXT-X-PART:DURATION=0.200,"
+				     "URI=\"seg1.0.m4s\",INDEPENDENT=YES\n"));
+	assert_non_null(strstr(m3u8, "#EXT-X-PART:DURATION=0.200,"
+				     "URI=\"seg2.0.m4s\",INDEPENDENT=YES\n"));
+	assert_non_null(strstr(m3u8, "#EXT-X-PART:DURATION=0.200,"
+				     "URI=\"seg3.0.m4s\",INDEPENDENT=YES\n"));
+
+	for (size_t i = 0; i < sink.files.num; i++)
+		bfree(sink.files.array[i].name);
+	da_free(sink.files);
+	dstr_free(&sink.playlist);
+
+	UNUSED_PARAMETER(state);
+}
+
+struct blocked_sink {
+	os_event_t *event;
+	size_t puts;
+};
+
+static bool blocked_put(void *data, const char *name, const void *buf,
+			size_t size)
+{
+	struct blocked_sink *sink = data;
+
+	os_event_wait(sink->event);
+	sink->puts++;
+
+	UNUSED_PARAMETER(name);
+	UNUSED_PARAMETER(buf);
+	UNUSED_PARAMETER(size);
+	return true;
+}
+
+static const struct hls_sink_info blocked_sink_info = {
+	.put = blocked_put,
+};
+
+/* parts for a sink that stopped taking them are not queued forever */
+static void blocked_sink_test(void **state)
+{
+	struct blocked_sink sink = {0};
+	struct hls_packager_config config = {.segment_ms = 1000,
+					     .part_ms = 200,
+					     .keyint_ms = 1000,
+					     .max_segments = 3,
+					     .playlist_name = "index.m3u8"};
+	struct hls_packager *packager;
+	size_t part_size = 1024 * 1024;
+
+	assert_int_equal(os_event_init(&sink.event, OS_EVENT_TYPE_MANUAL), 0);
+
+	packager = hls_packager_create(
+		&config, hls_sink_create_custom(&blocked_sink_info, &sink));
+	assert_non_null(packager);
+
+	for (size_t i = 0; i < 80; i++) {
+		struct fmp4_fragment fragment = {
+			.independent = i % KEYFRAME_PARTS == 0,
+			.start_usec = (int64_t)i * PART_USEC,
+			.duration_usec = PART_USEC,
+		};
+
+		hls_packager_add_part(packager, make_data(part_size),
+				      part_size, &fragment);
+	}
+
+	assert_true(hls_packager_failed(packager));
+
+	os_event_signal(sink.event);
+	hls_packager_destroy(packager);
+
+	/* the parts queued before the limit still went out */
+	assert_true(sink.puts >= 60);
+	assert_true(sink.puts < 80 * 2);
+
+	os_event_destroy(sink.event);
+
+	UNUSED_PARAMETER(state);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct http_server {
+	test_socket_t listener;
+	pthread_t thread;
+	int port;
+
+	size_t puts;
+	size_t deletes;
+	size_t connections;
+	size_t bytes;
+};
+
+static bool read_request(test_socket_t sock, struct http_server *server)
+{
+	char header[4096];
+	size_t received = 0;
+	char *end = NULL;
+	char *length;
+	long long body;
+
+	while (!end) {
+		int ret = recv(sock, header + received,
+			       (int)(sizeof(header) - 1 - received), 0);
+		if (ret <= 0)
+			return false;
+
+		received += (size_t)ret;
+		header[received] = 0;
+		end = strstr(header, "\r\n\r\n");
+	}
+
+	length = strstr(header, "Content-Length: ");
+	body = length ? strtoll(length + 16, NULL, 10) : 0;
+	server->bytes += (size_t)body;
+	body -= (long long)(received - (size_t)(end + 4 - header));
+
+	while (body > 0) {
+		char discard[4096];
+		int ret = recv(sock, discard,
+			       body < (long long)sizeof(discard)
+				       ? (int)body
+				       : (int)sizeof(discard),
+			       0);
+		if (ret <= 0)
+			return false;
+		body -= ret;
+	}
+
+	if (strncmp(header, "PUT ", 4) == 0)
+		server->puts++;
+	else if (strncmp(header, "DELETE ", 7) == 0)
+		server->deletes++;
+	return true;
+}
+
+static void *server_thread(void *data)
+{
+	static const char response[] =
+		"HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n";
+	struct http_server *server = data;
+	test_socket_t sock;
+
+	/* one connection at a time, the sink keeps it alive */
+	while ((sock = accept(server->listener, NULL, NULL)) >= 0) {
+		server->connections++;
+
+		while (read_request(sock, server))
+			send(sock, response, (int)strlen(response), 0);
+
+		close_socket(sock);
+	}
+
+	return NULL;
+}
+
+static void http_test(void **state)
+{
+	struct http_server server = {0};
+	struct sockaddr_in addr = {0};
+	socklen_t len = sizeof(addr);
+	struct hls_packager_config config = {.segment_ms = 1000,
+					     .part_ms = 200,
+					     .keyint_ms = 1000,
+					     .max_segments = 3,
+					     .playlist_name = "index.m3u8"};
+	struct hls_packager *packager;
+	struct dstr url = {0};
+
+#ifdef _WIN32
+	WSADATA wsad;
+	WSAStartup(MAKEWORD(2, 2), &wsad);
+#endif
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	server.listener = socket(AF_INET, SOCK_STREAM, 0);
+	assert_int_equal(bind(server.listener, (struct sockaddr *)&addr,
+			      sizeof(addr)),
+			 0);
+	assert_int_equal(listen(server.listener, 1), 0);
+	getsockname(server.listener, (struct sockaddr *)&addr, &len);
+	server.port = ntohs(addr.sin_port);
+	pthread_create(&server.thread, NULL, server_thread, &server);
+
+	dstr_printf(&url, "http://127.0.0.1:%d/live/", server.port);
+	packager = hls_packager_create(&config, hls_sink_create(url.array));
+	assert_non_null(packager);
+
+	feed(packager, NUM_PARTS);
+	hls_packager_destroy(packager);
+
+	/* unblocks accept */
+#ifdef _WIN32
+	closesocket(server.listener);
+#else
+	shutdown(server.listener, SHUT_RDWR);
+	close(server.listener);
+#endif
+	pthread_join(server.thread, NULL);
+
+	assert_int_equal(server.puts, 1 + NUM_PARTS + 8 + NUM_PARTS + 1);
+	assert_int_equal(server.deletes, 5 * (1 + KEYFRAME_PARTS));
+	assert_int_equal(server.connections, 1);
+	assert_true(server.bytes > 100 + NUM_PARTS * 1000 * 2);
+
+	dstr_free(&url);
+
+	UNUSED_PARAMETER(state);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(playlist_test),
+		cmocka_unit_test(keyframe_test),
+		cmocka_unit_test(blocked_sink_test),
+		cmocka_unit_test(http_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
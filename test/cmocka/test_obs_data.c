@@ -0,0 +1,513 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <obs-data.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+
+#define NUM_KEYS 1000
+#define NUM_SOURCES 10000
+#define NUM_SETTINGS 40
+#define ORDER_FILE "test_obs_data_order.json"
+#define COLLECTION_FILE "test_obs_data_collection.json"
+#define BINARY_FILE "test_obs_data.bin"
+#define BINARY_JSON_FILE "test_obs_data_binary.json"
+
+static void lookup_test(void **state)
+{
+	obs_data_t *data = obs_data_create();
+	struct dstr key = {0};
+
+	for (int i = NUM_KEYS - 1; i >= 0; i--) {
+		dstr_printf(&key, "key%04d", i);
+		obs_data_set_int(data, key.array, i);
+	}
+
+	for (int i = 0; i < NUM_KEYS; i++) {
+		dstr_printf(&key, "key%04d", i);
+		assert_int_equal(obs_data_get_int(data, key.array), i);
+	}
+
+	assert_false(obs_data_has_user_value(data, "key"));
+	assert_false(obs_data_has_user_value(data, "key10000"));
+
+	/* growing a value reallocates its item */
+	obs_data_set_int(data, "key0500", 0);
+	obs_data_set_string(data, "key0500", "a much longer value than before");
+	assert_string_equal(obs_data_get_string(data, "key0500"),
+			    "a much longer value than before");
+
+	obs_data_erase(data, "key0700");
+	assert_false(obs_data_has_user_value(data, "key0700"));
+	assert_int_equal(obs_data_get_int(data, "key0701"), 701);
+
+	obs_data_set_int(data, "key0700", 7);
+	assert_int_equal(obs_data_get_int(data, "key0700"), 7);
+
+	dstr_free(&key);
+	obs_data_release(data);
+
+	UNUSED_PARAMETER(state);
+}
+
+/* keys set after erasing back below the hash threshold must be found */
+static void shrink_test(void **state)
+{
+	obs_data_t *data = obs_data_create();
+	struct dstr key = {0};
+
+	for (int i = 0; i < 16; i++) {
+		dstr_printf(&key, "key%d", i);
+		obs_data_set_int(data, key.array, i);
+	}
+
+	for (int i = 0; i < 14; i++) {
+		dstr_printf(&key, "key%d", i);
+		obs_data_erase(data, key.array);
+	}
+
+	obs_data_set_int(data, "new", 100);
+	assert_int_equal(obs_data_get_int(data, "new"), 100);
+	assert_int_equal(obs_data_get_int(data, "key15"), 15);
+
+	/* setting it again must not add a second item */
+	obs_data_set_int(data, "new", 101);
+	assert_int_equal(obs_data_get_int(data, "new"), 101);
+	obs_data_erase(data, "new");
+	assert_false(obs_data_has_user_value(data, "new"));
+
+	dstr_free(&key);
+	obs_data_release(data);
+
+	UNUSED_PARAMETER(state);
+}
+
+static void order_test(void **state)
+{
+	obs_data_t *data = obs_data_create();
+	obs_data_t *loaded;
+	obs_data_item_t *item;
+	const char *prev = "";
+	char *json;
+
+	obs_data_set_int(data, "c", 3);
+	obs_data_set_int(data, "a", 1);
+	obs_data_set_int(data, "d", 4);
+	obs_data_set_int(data, "b", 2);
+	for (int i = 0; i < 20; i++) {
+		char key[8];
+		snprintf(key, sizeof(key), "x%d", i);
+		obs_data_set_bool(data, key, true);
+	}
+
+	/* items are still kept sorted by name */
+	for (item = obs_data_first(data); item; obs_data_item_next(&item)) {
+		const char *name = obs_data_item_get_name(item);
+		assert_true(strcmp(prev, name) < 0);
+		prev = name;
+	}
+
+	json = bstrdup(obs_data_get_json(data));
+	loaded = obs_data_create_from_json(json);
+	assert_string_equal(obs_data_get_json(loaded), json);
+	assert_int_equal(obs_data_get_int(loaded, "d"), 4);
+	obs_data_release(loaded);
+
+	/* same for the streaming file loader */
+	assert_true(os_quick_write_utf8_file(ORDER_FILE, json, strlen(json),
+					     false));
+	loaded = obs_data_create_from_json_file(ORDER_FILE);
+	assert_non_null(loaded);
+	assert_string_equal(obs_data_get_json(loaded), json);
+	os_unlink(ORDER_FILE);
+
+	bfree(json);
+	obs_data_release(loaded);
+	obs_data_release(data);
+
+	UNUSED_PARAMETER(state);
+}
+
+static obs_data_t *create_all_types(void)
+{
+	obs_data_t *data = obs_data_create();
+	obs_data_t *obj = obs_data_create();
+	obs_data_t *empty = obs_data_create();
+	obs_data_array_t *array = obs_data_array_create();
+
+	obs_data_set_string(data, "string", "\"quoted\" ünïcode");
+	obs_data_set_string(data, "empty_string", "");
+	obs_data_set_int(data, "int", -1234567890123LL);
+	obs_data_set_double(data, "double", 0.1);
+	obs_data_set_bool(data, "bool", true);
+	obs_data_set_bool(data, "false", false);
+	obs_data_set_default_int(data, "default", 5);
+
+	obs_data_set_string(obj, "string", "value");
+	obs_data_set_obj(obj, "empty", empty);
+	obs_data_set_obj(data, "obj", obj);
+
+	for (int i = 0; i < 3; i++) {
+		obs_data_t *item = obs_data_create();
+		obs_data_set_int(item, "idx", i);
+		obs_data_array_push_back(array, item);
+		obs_data_release(item);
+	}
+	obs_data_set_array(data, "array", array);
+
+	obs_data_array_release(array);
+	obs_data_release(empty);
+	obs_data_release(obj);
+	return data;
+}
+
+static void binary_test(void **state)
+{
+	obs_data_t *data = create_all_types();
+	obs_data_array_t *array;
+	obs_data_t *loaded;
+	obs_data_t *obj;
+	char *json;
+
+	json = bstrdup(obs_data_get_json(data));
+
+	assert_true(obs_data_save_binary(data, BINARY_FILE));
+	loaded = obs_data_create_from_binary_file(BINARY_FILE);
+	assert_non_null(loaded);
+
+	/* objects are read on first use */
+	obj = obs_data_get_obj(loaded, "obj");
+	assert_string_equal(obs_data_get_string(obj, "string"), "value");
+	obs_data_release(obj);
+
+	array = obs_data_get_array(loaded, "array");
+	assert_int_equal(obs_data_array_count(array), 3);
+	obj = obs_data_array_item(array, 2);
+	assert_int_equal(obs_data_get_int(obj, "idx"), 2);
+	obs_data_release(obj);
+	obs_data_array_release(array);
+
+	assert_int_equal(obs_data_get_int(loaded, "int"), -1234567890123LL);
+	assert_true(obs_data_get_double(loaded, "double") == 0.1);
+	assert_false(obs_data_has_user_value(loaded, "default"));
+	assert_string_equal(obs_data_get_json(loaded), json);
+	obs_data_release(loaded);
+
+	/* json -> binary -> json */
+	assert_true(obs_data_save_json(data, BINARY_JSON_FILE));
+	assert_true(obs_data_convert_json_to_binary(BINARY_JSON_FILE,
+						    BINARY_FILE));
+	os_unlink(BINARY_JSON_FILE);
+	assert_true(obs_data_convert_binary_to_json(BINARY_FILE,
+						    BINARY_JSON_FILE));
+
+	loaded = obs_data_create_from_json_file(BINARY_JSON_FILE);
+	assert_non_null(loaded);
+	assert_string_equal(obs_data_get_json(loaded), json);
+	obs_data_release(loaded);
+
+	os_unlink(BINARY_JSON_FILE);
+	os_unlink(BINARY_FILE);
+	bfree(json);
+	obs_data_release(data);
+
+	UNUSED_PARAMETER(state);
+}
+
+static void corrupt_test(void **state)
+{
+	obs_data_t *data = create_all_types();
+	obs_data_t *loaded;
+	char *buf;
+	size_t size;
+
+	assert_true(obs_data_save_binary(data, BINARY_FILE));
+	buf = os_quick_read_utf8_file(BINARY_FILE);
+	size = (size_t)os_get_file_size(BINARY_FILE);
+	assert_non_null(buf);
+
+	/* every truncation and a damaged byte at every offset either fails
+	 * to load or loads as much as is valid */
+	for (size_t i = 0; i < size; i++) {
+		assert_true(os_quick_write_utf8_file(BINARY_FILE, buf, i,
+						     false));
+		loaded = obs_data_create_from_binary_file(BINARY_FILE);
+		obs_data_get_json(loaded);
+		obs_data_release(loaded);
+
+		buf[i] ^= 0x5a;
+		assert_true(os_quick_write_utf8_file(BINARY_FILE, buf, size,
+						     false));
+		loaded = obs_data_create_from_binary_file(BINARY_FILE);
+		obs_data_get_json(loaded);
+		obs_data_release(loaded);
+		buf[i] ^= 0x5a;
+	}
+
+	assert_null(obs_data_create_from_binary_file("does_not_exist.bin"));
+
+	os_unlink(BINARY_FILE);
+	bfree(buf);
+	obs_data_release(data);
+
+	UNUSED_PARAMETER(state);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static obs_data_t *create_collection(void)
+{
+	obs_data_t *collection = obs_data_create();
+	obs_data_array_t *sources = obs_data_array_create();
+	struct dstr str = {0};
+
+	for (int i = 0; i < NUM_SOURCES; i++) {
+		obs_data_t *source = obs_data_create();
+		obs_data_t *settings = obs_data_create();
+
+		for (int j = 0; j < NUM_SETTINGS; j++) {
+			dstr_printf(&str, "setting_%d", j);
+			obs_data_set_int(settings, str.array, i + j);
+		}
+
+		dstr_printf(&str, "Source %d", i);
+		obs_data_set_string(source, "name", str.array);
+		obs_data_set_string(source, "id", "color_source");
+		obs_data_set_obj(source, "settings", settings);
+		obs_data_array_push_back(sources, source);
+
+		obs_data_release(settings);
+		obs_data_release(source);
+	}
+
+	obs_data_set_array(collection, "sources", sources);
+	obs_data_set_string(collection, "name", "Benchmark");
+
+	obs_data_array_release(sources);
+	dstr_free(&str);
+	return collection;
+}
+
+static void load_benchmark(void **state)
+{
+	obs_data_t *collection = create_collection();
+	obs_data_array_t *sources;
+	obs_data_t *loaded;
+	struct dstr key = {0};
+	uint64_t start, parsed, walked;
+	long long sum = 0;
+	char *json;
+
+	json = bstrdup(obs_data_get_json(collection));
+	obs_data_release(collection);
+
+	start = os_gettime_ns();
+	loaded = obs_data_create_from_json(json);
+	parsed = os_gettime_ns();
+	printf("%d sources: %.1f ms to parse from a string\n", NUM_SOURCES,
+	       (double)(parsed - start) / 1000000.0);
+	obs_data_release(loaded);
+
+	/* the file is streamed in chunks, the result has to be the same
+	 * as from the string */
+	assert_true(os_quick_write_utf8_file(COLLECTION_FILE, json,
+					     strlen(json), false));
+
+	start = os_gettime_ns();
+	loaded = obs_data_create_from_json_file(COLLECTION_FILE);
+	parsed = os_gettime_ns();
+
+	assert_non_null(loaded);
+	os_unlink(COLLECTION_FILE);
+
+	/* what loading a source does with its settings, roughly */
+	sources = obs_data_get_array(loaded, "sources");
+	for (size_t i = 0; i < obs_data_array_count(sources); i++) {
+		obs_data_t *source = obs_data_array_item(sources, i);
+		obs_data_t *settings = obs_data_get_obj(source, "settings");
+
+		for (int j = 0; j < NUM_SETTINGS; j++) {
+			dstr_printf(&key, "setting_%d", j);
+			sum += obs_data_get_int(settings, key.array);
+		}
+
+		obs_data_release(settings);
+		obs_data_release(source);
+	}
+	walked = os_gettime_ns();
+
+	assert_int_equal(obs_data_array_count(sources), NUM_SOURCES);
+	assert_true(sum > 0);
+	assert_string_equal(obs_data_get_json(loaded), json);
+
+	printf("%d sources: %.1f ms to load from a file, "
+	       "%.1f ms to read settings\n",
+	       NUM_SOURCES, (double)(parsed - start) / 1000000.0,
+	       (double)(walked - parsed) / 1000000.0);
+
+	obs_data_array_release(sources);
+	obs_data_release(loaded);
+	dstr_free(&key);
+	bfree(json);
+
+	UNUSED_PARAMETER(state);
+}
+
+/* the file loader has to reject the same strings jansson does */
+static void utf8_test(void **state)
+{
+	static const char *invalid[] = {
+		"{\"a\": \"\xC0\xAF\"}",         /* overlong */
+		"{\"a\": \"\xED\xA0\x80\"}",     /* surrogate */
+		"{\"a\": \"\xF4\x90\x80\x80\"}", /* past U+10FFFF */
+		"{\"a\": \"\xE2\x82\"}",         /* truncated */
+		"{\"a\": \"\x80\"}",             /* stray continuation */
+	};
+	static const char *valid = "{\"a\": \"\xC3\xA9\xE2\x82\xAC"
+				   "\xF0\x9F\x8E\xA5\"}";
+	obs_data_t *loaded;
+
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+		assert_null(obs_data_create_from_json(invalid[i]));
+
+		assert_true(os_quick_write_utf8_file(ORDER_FILE, invalid[i],
+						     strlen(invalid[i]),
+						     false));
+		assert_null(obs_data_create_from_json_file(ORDER_FILE));
+	}
+
+	assert_true(os_quick_write_utf8_file(ORDER_FILE, valid, strlen(valid),
+					     false));
+	loaded = obs_data_create_from_json_file(ORDER_FILE);
+	assert_non_null(loaded);
+	assert_string_equal(obs_data_get_string(loaded, "a"),
+			    "\xC3\xA9\xE2\x82\xAC\xF0\x9F\x8E\xA5");
+	obs_data_release(loaded);
+
+	os_unlink(ORDER_FILE);
+
+	UNUSED_PARAMETER(state);
+}
+
+/* changes that don't set a value must not reuse what was written before */
+static void incremental_unset_test(void **state)
+{
+	obs_data_t *data = obs_data_create();
+	obs_data_t *settings = obs_data_create();
+	obs_data_writer_t *writer = obs_data_writer_create();
+	obs_data_item_t *item;
+	obs_data_t *loaded;
+	char *json;
+
+	obs_data_set_int(settings, "a", 1);
+	obs_data_set_int(settings, "b", 2);
+	obs_data_set_default_int(settings, "c", 3);
+	obs_data_set_int(settings, "c", 4);
+	obs_data_set_obj(data, "settings", settings);
+	assert_true(obs_data_writer_save(writer, data, BINARY_FILE));
+
+	/* one level down, the parent object itself is unchanged */
+	obs_data_unset_user_value(settings, "b");
+	item = obs_data_item_byname(settings, "c");
+	obs_data_item_unset_user_value(item);
+	obs_data_item_release(&item);
+
+	assert_true(obs_data_writer_save(writer, data, BINARY_FILE));
+
+	json = bstrdup(obs_data_get_json(data));
+	loaded = obs_data_create_from_binary_file(BINARY_FILE);
+	assert_non_null(loaded);
+	assert_string_equal(obs_data_get_json(loaded), json);
+	obs_data_release(loaded);
+
+	os_unlink(BINARY_FILE);
+	bfree(json);
+	obs_data_writer_destroy(writer);
+	obs_data_release(settings);
+	obs_data_release(data);
+
+	UNUSED_PARAMETER(state);
+}
+
+static void incremental_benchmark(void **state)
+{
+	obs_data_t *collection = create_collection();
+	obs_data_writer_t *writer = obs_data_writer_create();
+	obs_data_array_t *sources;
+	obs_data_t *source, *settings;
+	obs_data_t *loaded;
+	uint64_t start, full, incremental;
+	char *json;
+
+	start = os_gettime_ns();
+	assert_true(obs_data_writer_save(writer, collection, BINARY_FILE));
+	full = os_gettime_ns() - start;
+	assert_int_equal(obs_data_writer_get_reused_bytes(writer), 0);
+
+	/* change a single setting of a single source */
+	sources = obs_data_get_array(collection, "sources");
+	source = obs_data_array_item(sources, NUM_SOURCES / 2);
+	settings = obs_data_get_obj(source, "settings");
+	obs_data_set_int(settings, "setting_0", -1);
+	obs_data_set_string(settings, "new_setting", "new");
+
+	start = os_gettime_ns();
+	assert_true(obs_data_writer_save_safe(writer, collection, BINARY_FILE,
+					      "tmp", "bak"));
+	incremental = os_gettime_ns() - start;
+	assert_true(obs_data_writer_get_reused_bytes(writer) > 0);
+
+	printf("%d sources: %.1f ms for a full binary save, "
+	       "%.1f ms for an incremental one\n",
+	       NUM_SOURCES, (double)full / 1000000.0,
+	       (double)incremental / 1000000.0);
+
+	json = bstrdup(obs_data_get_json(collection));
+	loaded = obs_data_create_from_binary_file(BINARY_FILE);
+	assert_non_null(loaded);
+	assert_string_equal(obs_data_get_json(loaded), json);
+	obs_data_release(loaded);
+
+	/* a second change after the incremental save */
+	obs_data_set_int(settings, "setting_1", -2);
+	obs_data_array_erase(sources, 0);
+	assert_true(obs_data_writer_save(writer, collection, BINARY_FILE));
+
+	bfree(json);
+	json = bstrdup(obs_data_get_json(collection));
+	loaded = obs_data_create_from_binary_file(BINARY_FILE);
+	assert_string_equal(obs_data_get_json(loaded), json);
+	obs_data_release(loaded);
+
+	os_unlink(BINARY_FILE);
+	os_unlink("test_obs_data.bin.bak");
+	bfree(json);
+	obs_data_release(settings);
+	obs_data_release(source);
+	obs_data_array_release(sources);
+	obs_data_writer_destroy(writer);
+	obs_data_release(collection);
+
+	UNUSED_PARAMETER(state);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(lookup_test),
+		cmocka_unit_test(shrink_test),
+		cmocka_unit_test(order_test),
+		cmocka_unit_test(load_benchmark),
+		cmocka_unit_test(binary_test),
+		cmocka_unit_test(corrupt_test),
+		cmocka_unit_test(utf8_test),
+		cmocka_unit_test(incremental_unset_test),
+		cmocka_unit_test(incremental_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,171 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/bmem.h>
+#include "replay-ring.h"
+
+#define RING_PATH "test_replay_ring.tmp"
+#define RING_CAPACITY (16 * 1024 * 1024)
+
+#define PACKET_SIZE (64 * 1024 + 13)
+#define KEYFRAME_INTERVAL 30
+#define FRAME_USEC 33333
+
+static uint8_t payload[PACKET_SIZE];
+
+static void make_packet(struct encoder_packet *packet, int64_t idx)
+{
+	memset(packet, 0, sizeof(*packet));
+	memcpy(payload, &idx, sizeof(idx));
+	memset(payload + sizeof(idx), (int)(idx & 0xff),
+	       PACKET_SIZE - sizeof(idx));
+
+	packet->type = OBS_ENCODER_VIDEO;
+	packet->data = payload;
+	packet->size = PACKET_SIZE;
+	packet->pts = idx;
+	packet->dts = idx;
+	packet->dts_usec = idx * FRAME_USEC;
+	packet->timebase_num = 1;
+	packet->timebase_den = 30;
+	packet->keyframe = idx % KEYFRAME_INTERVAL == 0;
+}
+
+static void check_packet(const struct encoder_packet *packet, int64_t idx)
+{
+	int64_t stored;
+
+	assert_int_equal(packet->size, PACKET_SIZE);
+	memcpy(&stored, packet->data, sizeof(stored));
+	assert_int_equal(stored, idx);
+	assert_int_equal(packet->data[PACKET_SIZE - 1], idx & 0xff);
+	assert_int_equal(packet->dts, idx);
+	assert_int_equal(packet->dts_usec, idx * FRAME_USEC);
+	assert_int_equal(packet->keyframe, idx % KEYFRAME_INTERVAL == 0);
+}
+
+static void push_range(struct replay_ring *ring, int64_t start, int64_t end)
+{
+	struct encoder_packet packet;
+
+	for (int64_t i = start; i < end; i++) {
+		make_packet(&packet, i);
+		assert_true(replay_ring_push(ring, &packet));
+	}
+}
+
+/* writes several times the capacity, the oldest groups of pictures are
+ * dropped as the ring wraps around */
+static void wrap_test(void **state)
+{
+	struct replay_ring *ring = replay_ring_create(RING_PATH, RING_CAPACITY);
+	struct replay_ring_reader *reader;
+	struct encoder_packet packet;
+	int64_t idx, count = 0;
+
+	assert_non_null(ring);
+	push_range(ring, 0, 1000);
+
+	assert_true(replay_ring_size(ring) <= RING_CAPACITY);
+	assert_true(replay_ring_keyframes(ring) > 0);
+
+	idx = replay_ring_start_time(ring) / FRAME_USEC;
+	assert_int_equal(idx % KEYFRAME_INTERVAL, 0);
+
+	reader = replay_ring_read_begin(ring);
+	assert_non_null(reader);
+	while (replay_ring_read(reader, &packet)) {
+		check_packet(&packet, idx++);
+		count++;
+	}
+
+	assert_false(replay_ring_read_overrun(reader));
+	assert_int_equal(idx, 1000);
+	assert_true(count > 100);
+
+	replay_ring_read_end(reader);
+	replay_ring_release(ring);
+
+	UNUSED_PARAMETER(state);
+}
+
+/* purging stops at an active reader, new data can still be pushed */
+static void reader_pin_test(void **state)
+{
+	struct replay_ring *ring = replay_ring_create(RING_PATH, RING_CAPACITY);
+	struct replay_ring_reader *reader;
+	struct encoder_packet packet;
+
+	assert_non_null(ring);
+	push_range(ring, 0, 90);
+	assert_int_equal(replay_ring_keyframes(ring), 3);
+
+	reader = replay_ring_read_begin(ring);
+	assert_non_null(reader);
+	assert_null(replay_ring_read_begin(ring));
+	assert_false(replay_ring_purge(ring));
+
+	for (int64_t i = 0; i < KEYFRAME_INTERVAL; i++) {
+		assert_true(replay_ring_read(reader, &packet));
+		check_packet(&packet, i);
+	}
+
+	assert_true(replay_ring_purge(ring));
+	assert_int_equal(replay_ring_keyframes(ring), 2);
+	assert_int_equal(replay_ring_start_time(ring),
+			 KEYFRAME_INTERVAL * FRAME_USEC);
+
+	/* packets pushed after the reader started are not part of it */
+	push_range(ring, 90, 100);
+	for (int64_t i = KEYFRAME_INTERVAL; i < 90; i++) {
+		assert_true(replay_ring_read(reader, &packet));
+		check_packet(&packet, i);
+	}
+	assert_false(replay_ring_read(reader, &packet));
+	assert_false(replay_ring_read_overrun(reader));
+
+	/* the ring outlives its release while a reader still holds it */
+	replay_ring_release(ring);
+	replay_ring_read_end(reader);
+
+	UNUSED_PARAMETER(state);
+}
+
+/* running out of space overwrites data a reader has not reached yet */
+static void overrun_test(void **state)
+{
+	struct replay_ring *ring = replay_ring_create(RING_PATH, RING_CAPACITY);
+	struct replay_ring_reader *reader;
+	struct encoder_packet packet;
+
+	assert_non_null(ring);
+	push_range(ring, 0, 60);
+
+	reader = replay_ring_read_begin(ring);
+	assert_non_null(reader);
+	assert_true(replay_ring_read(reader, &packet));
+	check_packet(&packet, 0);
+
+	push_range(ring, 60, 600);
+
+	assert_false(replay_ring_read(reader, &packet));
+	assert_true(replay_ring_read_overrun(reader));
+
+	replay_ring_read_end(reader);
+	replay_ring_release(ring);
+
+	UNUSED_PARAMETER(state);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(wrap_test),
+		cmocka_unit_test(reader_pin_test),
+		cmocka_unit_test(overrun_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,500 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "rtmp-stream.h"
+
+#define NUM_SERVERS 3
+#define SIG_SIZE 1536
+#define FRAMES_PER_RUN 30
+#define KEYFRAME_INTERVAL 10
+#define TIMEOUT_MS 10000
+
+extern struct obs_output_info rtmp_multi_output_info;
+
+const char *obs_module_text(const char *val)
+{
+	return val;
+}
+
+/* ------------------------------------------------------------------------- */
+/* stub encoders                                                             */
+
+static const uint8_t avc_header[] = {
+	0x00, 0x00, 0x00, 0x01, 0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9,
+	0x00, 0x00, 0x00, 0x01, 0x68, 0xeb, 0xe3, 0xcb, 0x22, 0xc0};
+static const uint8_t avc_idr[] = {0x00, 0x00, 0x00, 0x01, 0x65,
+				  0x88, 0x84, 0x00, 0x33, 0xff};
+static const uint8_t avc_slice[] = {0x00, 0x00, 0x00, 0x01, 0x41,
+				    0x9a, 0x02, 0x04, 0x40, 0xff};
+static const uint8_t aac_header[] = {0x11, 0x90};
+static const uint8_t aac_frame[] = {0x21, 0x00, 0x49, 0x90, 0x02, 0x19};
+
+struct stub_encoder {
+	int64_t frames;
+};
+
+static const char *stub_encoder_get_name(void *type_data)
+{
+	UNUSED_PARAMETER(type_data);
+	return "Stub";
+}
+
+static void *stub_encoder_create(obs_data_t *settings, obs_encoder_t *encoder)
+{
+	UNUSED_PARAMETER(settings);
+	UNUSED_PARAMETER(encoder);
+	return bzalloc(sizeof(struct stub_encoder));
+}
+
+static bool stub_video_encode(void *data, struct encoder_frame *frame,
+			      struct encoder_packet *packet,
+			      bool *received_packet)
+{
+	struct stub_encoder *enc = data;
+	bool keyframe = enc->frames++ % KEYFRAME_INTERVAL == 0;
+
+	packet->data = (uint8_t *)(keyframe ? avc_idr : avc_slice);
+	packet->size = keyframe ? sizeof(avc_idr) : sizeof(avc_slice);
+	packet->type = OBS_ENCODER_VIDEO;
+	packet->pts = frame->pts;
+	packet->dts = frame->pts;
+	packet->keyframe = keyframe;
+	*received_packet = true;
+	return true;
+}
+
+static bool stub_video_extra_data(void *data, uint8_t **extra_data,
+				  size_t *size)
+{
+	UNUSED_PARAMETER(data);
+	*extra_data = (uint8_t *)avc_header;
+	*size = sizeof(avc_header);
+	return true;
+}
+
+static bool stub_audio_encode(void *data, struct encoder_frame *frame,
+			      struct encoder_packet *packet,
+			      bool *received_packet)
+{
+	UNUSED_PARAMETER(data);
+	packet->data = (uint8_t *)aac_frame;
+	packet->size = sizeof(aac_frame);
+	packet->type = OBS_ENCODER_AUDIO;
+	packet->pts = frame->pts;
+	packet->dts = frame->pts;
+	*received_packet = true;
+	return true;
+}
+
+static bool stub_audio_extra_data(void *data, uint8_t **extra_data,
+				  size_t *size)
+{
+	UNUSED_PARAMETER(data);
+	*extra_data = (uint8_t *)aac_header;
+	*size = sizeof(aac_header);
+	return true;
+}
+
+static size_t stub_audio_frame_size(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return 1024;
+}
+
+static struct obs_encoder_info stub_video_info = {
+	.id = "test_h264",
+	.type = OBS_ENCODER_VIDEO,
+	.codec = "h264",
+	.get_name = stub_encoder_get_name,
+	.create = stub_encoder_create,
+	.destroy = bfree,
+	.encode = stub_video_encode,
+	.get_extra_data = stub_video_extra_data,
+};
+
+static struct obs_encoder_info stub_audio_info = {
+	.id = "test_aac",
+	.type = OBS_ENCODER_AUDIO,
+	.codec = "aac",
+	.get_name = stub_encoder_get_name,
+	.create = stub_encoder_create,
+	.destroy = bfree,
+	.encode = stub_audio_encode,
+	.get_extra_data = stub_audio_extra_data,
+	.get_frame_size = stub_audio_frame_size,
+};
+
+/* ------------------------------------------------------------------------- */
+/* stub ingest servers                                                       */
+
+struct server {
+	int listen_fd;
+	int port;
+	pthread_t thread;
+
+	volatile long connections;
+	volatile long video_frames;
+	volatile long audio_frames;
+	volatile bool bad_first_frame;
+};
+
+static bool recv_all(int fd, uint8_t *buf, size_t size)
+{
+	while (size) {
+		ssize_t ret = recv(fd, buf, size, 0);
+		if (ret <= 0)
+			return false;
+
+		buf += ret;
+		size -= (size_t)ret;
+	}
+
+	return true;
+}
+
+static bool serve_handshake(int fd)
+{
+	uint8_t c0c1[1 + SIG_SIZE];
+	uint8_t s0s1s2[1 + SIG_SIZE * 2] = {0x03};
+
+	if (!recv_all(fd, c0c1, sizeof(c0c1)))
+		return false;
+
+	/* S2 echoes C1 */
+	memcpy(s0s1s2 + 1 + SIG_SIZE, c0c1 + 1, SIG_SIZE);
+	if (send(fd, s0s1s2, sizeof(s0s1s2), MSG_NOSIGNAL) !=
+	    (ssize_t)sizeof(s0s1s2))
+		return false;
+
+	return recv_all(fd, c0c1, SIG_SIZE);
+}
+
+static void send_result(RTMP *r, double txn, double stream_id)
+{
+	static const AVal av__result = AVC("_result");
+	char buf[RTMP_MAX_HEADER_SIZE + 64];
+	char *end = buf + sizeof(buf);
+	RTMPPacket packet = {0};
+	char *enc;
+
+	packet.m_nChannel = 0x03;
+	packet.m_headerType = RTMP_PACKET_SIZE_LARGE;
+	packet.m_packetType = RTMP_PACKET_TYPE_INVOKE;
+	packet.m_body = buf + RTMP_MAX_HEADER_SIZE;
+
+	enc = AMF_EncodeString(packet.m_body, end, &av__result);
+	enc = AMF_EncodeNumber(enc, end, txn);
+	*enc++ = AMF_NULL;
+	enc = AMF_EncodeNumber(enc, end, stream_id);
+
+	packet.m_nBodySize = (uint32_t)(enc - packet.m_body);
+	RTMP_SendPacket(r, &packet, false);
+}
+
+/* answers just enough for librtmp to start publishing */
+static void handle_invoke(RTMP *r, RTMPPacket *packet)
+{
+	static const AVal av_connect = AVC("connect");
+	static const AVal av_createStream = AVC("createStream");
+	static const AVal av_publish = AVC("publish");
+	AMFObject obj;
+	AVal method;
+	double txn;
+
+	if (AMF_Decode(&obj, packet->m_body, (int)packet->m_nBodySize,
+		       false) < 0)
+		return;
+
+	AMFProp_GetString(AMF_GetProp(&obj, NULL, 0), &method);
+	txn = AMFProp_GetNumber(AMF_GetProp(&obj, NULL, 1));
+
+	if (AVMATCH(&method, &av_connect) || AVMATCH(&method, &av_publish))
+		send_result(r, txn, 0.0);
+	else if (AVMATCH(&method, &av_createStream))
+		send_result(r, txn, 1.0);
+
+	AMF_Reset(&obj);
+}
+
+static void handle_packet(struct server *server, RTMP *r, RTMPPacket *packet,
+			  bool *got_video)
+{
+	const uint8_t *body = (const uint8_t *)packet->m_body;
+
+	switch (packet->m_packetType) {
+	case RTMP_PACKET_TYPE_CHUNK_SIZE:
+		r->m_inChunkSize = (int)AMF_DecodeInt32(packet->m_body);
+		break;
+	case RTMP_PACKET_TYPE_INVOKE:
+		handle_invoke(r, packet);
+		break;
+	case RTMP_PACKET_TYPE_VIDEO:
+		/* skip the sequence header */
+		if (packet->m_nBodySize < 2 || body[1] == 0)
+			break;
+
+		/* every connection has to start on a keyframe */
+		if (!*got_video && body[0] != 0x17)
+			server->bad_first_frame = true;
+
+		*got_video = true;
+		os_atomic_inc_long(&server->video_frames);
+		break;
+	case RTMP_PACKET_TYPE_AUDIO:
+		if (packet->m_nBodySize >= 2 && body[1] != 0)
+			os_atomic_inc_long(&server->audio_frames);
+		break;
+	}
+}
+
+static void serve(struct server *server, int fd)
+{
+	RTMP *r = bzalloc(sizeof(RTMP));
+	RTMPPacket packet = {0};
+	bool got_video = false;
+
+	RTMP_Init(r);
+	r->m_sb.sb_socket = fd;
+
+	if (serve_handshake(fd)) {
+		os_atomic_inc_long(&server->connections);
+
+		while (RTMP_ReadPacket(r, &packet)) {
+			if (!RTMPPacket_IsReady(&packet))
+				continue;
+
+			handle_packet(server, r, &packet, &got_video);
+			RTMPPacket_Free(&packet);
+		}
+	}
+
+	RTMPPacket_Free(&packet);
+	RTMP_Close(r);
+	bfree(r);
+}
+
+/* serves one connection after the other until the socket is shut down */
+static void *server_thread(void *data)
+{
+	struct server *server = data;
+	int fd;
+
+	while ((fd = accept(server->listen_fd, NULL, NULL)) != -1)
+		serve(server, fd);
+
+	return NULL;
+}
+
+static void server_start(struct server *server)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t len = sizeof(addr);
+
+	memset(server, 0, sizeof(*server));
+	server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	assert_int_equal(bind(server->listen_fd, (struct sockaddr *)&addr,
+			      sizeof(addr)),
+			 0);
+	assert_int_equal(listen(server->listen_fd, 1), 0);
+	getsockname(server->listen_fd, (struct sockaddr *)&addr, &len);
+	server->port = ntohs(addr.sin_port);
+
+	pthread_create(&server->thread, NULL, server_thread, server);
+}
+
+static void server_stop(struct server *server)
+{
+	shutdown(server->listen_fd, SHUT_RDWR);
+	pthread_join(server->thread, NULL);
+	close(server->listen_fd);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct stats {
+	obs_output_t *output;
+	pthread_t thread;
+	volatile bool stop;
+	volatile long polls;
+};
+
+/* the stats callbacks walk the destinations while start rebuilds them */
+static void *stats_thread(void *data)
+{
+	struct stats *stats = data;
+
+	while (!os_atomic_load_bool(&stats->stop)) {
+		obs_output_get_total_bytes(stats->output);
+		obs_output_get_frames_dropped(stats->output);
+		obs_output_get_congestion(stats->output);
+		obs_output_get_connect_time_ms(stats->output);
+		os_atomic_inc_long(&stats->polls);
+	}
+
+	return NULL;
+}
+
+static bool servers_have_frames(struct server *servers, long frames)
+{
+	for (size_t i = 0; i < NUM_SERVERS; i++) {
+		if (os_atomic_load_long(&servers[i].video_frames) < frames)
+			return false;
+	}
+	return true;
+}
+
+static bool wait_for(struct server *servers, long frames)
+{
+	for (int ms = 0; ms < TIMEOUT_MS; ms += 10) {
+		if (servers_have_frames(servers, frames))
+			return true;
+		os_sleep_ms(10);
+	}
+	return false;
+}
+
+static bool wait_for_stop(obs_output_t *output)
+{
+	for (int ms = 0; ms < TIMEOUT_MS; ms += 10) {
+		if (!obs_output_active(output))
+			return true;
+		os_sleep_ms(10);
+	}
+	return false;
+}
+
+static int setup(void **state)
+{
+	struct obs_video_info ovi = {
+		.graphics_module = NULL_GRAPHICS_MODULE,
+		.fps_num = 30,
+		.fps_den = 1,
+		.base_width = 64,
+		.base_height = 64,
+		.output_width = 64,
+		.output_height = 64,
+		.output_format = VIDEO_FORMAT_RGBA,
+		.colorspace = VIDEO_CS_709,
+		.range = VIDEO_RANGE_PARTIAL,
+		.scale_type = OBS_SCALE_BILINEAR,
+	};
+	struct obs_audio_info oai = {
+		.samples_per_sec = 48000,
+		.speakers = SPEAKERS_STEREO,
+	};
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return -1;
+
+	obs_add_data_path(LIBOBS_DATA_PATH);
+	obs_register_encoder(&stub_video_info);
+	obs_register_encoder(&stub_audio_info);
+	obs_register_output(&rtmp_multi_output_info);
+
+	if (obs_reset_video(&ovi) != OBS_VIDEO_SUCCESS ||
+	    !obs_reset_audio(&oai)) {
+		obs_shutdown();
+		return -1;
+	}
+
+	UNUSED_PARAMETER(state);
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	obs_shutdown();
+
+	UNUSED_PARAMETER(state);
+	return 0;
+}
+
+/* one set of encoders streams to several servers at once, twice in a row,
+ * while another thread keeps reading the output's stats */
+static void multi_stream_test(void **state)
+{
+	struct server servers[NUM_SERVERS];
+	struct stats stats = {0};
+	obs_data_t *settings = obs_data_create();
+	obs_data_array_t *dests = obs_data_array_create();
+	obs_encoder_t *venc;
+	obs_encoder_t *aenc;
+	obs_output_t *output;
+
+	for (size_t i = 0; i < NUM_SERVERS; i++) {
+		obs_data_t *dest = obs_data_create();
+		struct dstr url = {0};
+
+		server_start(&servers[i]);
+		dstr_printf(&url, "rtmp://127.0.0.1:%d/live", servers[i].port);
+		obs_data_set_string(dest, "server", url.array);
+		obs_data_set_string(dest, "key", "key");
+		obs_data_array_push_back(dests, dest);
+		obs_data_release(dest);
+		dstr_free(&url);
+	}
+
+	obs_data_set_array(settings, "destinations", dests);
+	obs_data_set_int(settings, "retry_delay_sec", 1);
+
+	venc = obs_video_encoder_create("test_h264", "video", NULL, NULL);
+	aenc = obs_audio_encoder_create("test_aac", "audio", NULL, 0, NULL);
+	obs_encoder_set_video(venc, obs_get_video());
+	obs_encoder_set_audio(aenc, obs_get_audio());
+
+	output = obs_output_create("rtmp_multi_output", "multi", settings,
+				   NULL);
+	assert_non_null(output);
+	obs_output_set_video_encoder(output, venc);
+	obs_output_set_audio_encoder(output, aenc, 0);
+
+	stats.output = output;
+	pthread_create(&stats.thread, NULL, stats_thread, &stats);
+
+	for (long run = 1; run <= 2; run++) {
+		assert_true(obs_output_start(output));
+		assert_true(wait_for(servers, run * FRAMES_PER_RUN));
+
+		obs_output_stop(output);
+		assert_true(wait_for_stop(output));
+	}
+
+	os_atomic_set_bool(&stats.stop, true);
+	pthread_join(stats.thread, NULL);
+	assert_true(os_atomic_load_long(&stats.polls) > 0);
+
+	for (size_t i = 0; i < NUM_SERVERS; i++) {
+		server_stop(&servers[i]);
+
+		assert_int_equal(servers[i].connections, 2);
+		assert_true(servers[i].audio_frames > 0);
+		assert_false(servers[i].bad_first_frame);
+	}
+
+	obs_output_release(output);
+	obs_encoder_release(venc);
+	obs_encoder_release(aenc);
+	obs_data_array_release(dests);
+	obs_data_release(settings);
+
+	UNUSED_PARAMETER(state);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(multi_stream_test),
+	};
+
+	return cmocka_run_group_tests(tests, setup, teardown);
+}
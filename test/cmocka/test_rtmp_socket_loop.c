@@ -0,0 +1,295 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "rtmp-stream.h"
+
+/* RTMP chunk size used by rtmp-stream, plus a type 0 chunk header */
+#define CHUNK_PAYLOAD 4096
+#define CHUNK_HEADER 12
+#define TOTAL_BYTES (256 * 1024 * 1024)
+
+static inline uint8_t pattern_byte(uint64_t offset)
+{
+	return (uint8_t)((offset * 2654435761ULL) >> 13);
+}
+
+struct sink {
+	int listen_fd;
+	int fd;
+	pthread_t thread;
+	uint64_t received;
+	bool corrupt;
+
+	/* accept the connection but never read from it */
+	bool stalled;
+	volatile bool done;
+};
+
+/* stub ingest server: accepts one connection and verifies every byte */
+static void *sink_thread(void *data)
+{
+	struct sink *sink = data;
+	uint8_t buf[65536];
+
+	sink->fd = accept(sink->listen_fd, NULL, NULL);
+	if (sink->fd == -1)
+		return NULL;
+
+	while (sink->stalled && !os_atomic_load_bool(&sink->done))
+		os_sleep_ms(10);
+
+	for (;;) {
+		ssize_t ret = recv(sink->fd, buf, sizeof(buf), 0);
+		if (ret <= 0)
+			break;
+
+		for (ssize_t i = 0; i < ret; i++) {
+			if (buf[i] != pattern_byte(sink->received + i))
+				sink->corrupt = true;
+		}
+
+		sink->received += ret;
+	}
+
+	close(sink->fd);
+	return NULL;
+}
+
+static int connect_to_sink(struct sink *sink)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t len = sizeof(addr);
+	int fd;
+
+	sink->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	assert_int_equal(bind(sink->listen_fd, (struct sockaddr *)&addr,
+			      sizeof(addr)),
+			 0);
+	assert_int_equal(listen(sink->listen_fd, 1), 0);
+	getsockname(sink->listen_fd, (struct sockaddr *)&addr, &len);
+
+	pthread_create(&sink->thread, NULL, sink_thread, sink);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert_int_equal(connect(fd, (struct sockaddr *)&addr, sizeof(addr)),
+			 0);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+static void init_stream(struct rtmp_stream *stream, int fd, size_t buf_size)
+{
+	memset(stream, 0, sizeof(*stream));
+	pthread_mutex_init(&stream->write_buf_mutex, NULL);
+	os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL);
+	os_event_init(&stream->buffer_space_available_event,
+		      OS_EVENT_TYPE_AUTO);
+	os_event_init(&stream->buffer_has_data_event, OS_EVENT_TYPE_AUTO);
+	os_event_init(&stream->send_thread_signaled_exit,
+		      OS_EVENT_TYPE_MANUAL);
+
+	stream->rtmp.m_sb.sb_socket = fd;
+	stream->write_buf_size = buf_size;
+	stream->write_buf = bmalloc(buf_size);
+	stream->socket_wake_fd = -1;
+	assert_true(socket_thread_linux_init(stream));
+}
+
+static void free_stream(struct rtmp_stream *stream)
+{
+	socket_thread_linux_free(stream);
+	bfree(stream->write_buf);
+	os_event_destroy(stream->stop_event);
+	os_event_destroy(stream->buffer_space_available_event);
+	os_event_destroy(stream->buffer_has_data_event);
+	os_event_destroy(stream->send_thread_signaled_exit);
+	pthread_mutex_destroy(&stream->write_buf_mutex);
+}
+
+/* same contract as socket_queue_data in rtmp-stream.c */
+static bool queue_data(struct rtmp_stream *stream, const uint8_t *data,
+		       size_t len)
+{
+	for (;;) {
+		pthread_mutex_lock(&stream->write_buf_mutex);
+		if (stream->rtmp.m_sb.sb_socket == -1) {
+			pthread_mutex_unlock(&stream->write_buf_mutex);
+			return false;
+		}
+		if (len <= write_buf_free_space(stream))
+			break;
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+
+		os_event_wait(stream->buffer_space_available_event);
+	}
+
+	write_buf_push(stream, data, len);
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	os_event_signal(stream->buffer_has_data_event);
+	socket_thread_linux_wake(stream);
+	return true;
+}
+
+static void loopback_test(void **state)
+{
+	struct rtmp_stream stream;
+	struct sink sink = {0};
+	uint8_t chunk[CHUNK_HEADER + CHUNK_PAYLOAD];
+	uint64_t offset = 0;
+	uint64_t start_time, elapsed;
+	pthread_t thread;
+
+	UNUSED_PARAMETER(state);
+
+	init_stream(&stream, connect_to_sink(&sink), 4 * 1024 * 1024);
+
+	pthread_create(&thread, NULL, socket_thread_linux, &stream);
+
+	start_time = os_gettime_ns();
+
+	while (offset < TOTAL_BYTES) {
+		for (size_t i = 0; i < sizeof(chunk); i++)
+			chunk[i] = pattern_byte(offset + i);
+
+		assert_true(queue_data(&stream, chunk, sizeof(chunk)));
+		offset += sizeof(chunk);
+	}
+
+	os_event_signal(stream.send_thread_signaled_exit);
+	socket_thread_linux_wake(&stream);
+	pthread_join(thread, NULL);
+
+	elapsed = os_gettime_ns() - start_time;
+
+	shutdown(stream.rtmp.m_sb.sb_socket, SHUT_WR);
+	pthread_join(sink.thread, NULL);
+	close(stream.rtmp.m_sb.sb_socket);
+	close(sink.listen_fd);
+
+	print_message("loopback throughput: %.1f MB/s\n",
+		      (double)offset / 1048576.0 /
+			      ((double)elapsed / 1000000000.0));
+
+	assert_int_equal(sink.received, offset);
+	assert_false(sink.corrupt);
+	assert_int_equal(stream.write_buf_len, 0);
+	assert_int_equal(stream.write_buf_pinned, 0);
+
+	free_stream(&stream);
+}
+
+struct producer {
+	struct rtmp_stream *stream;
+	uint64_t queued;
+	bool failed;
+};
+
+static void *producer_thread(void *data)
+{
+	struct producer *producer = data;
+	uint8_t chunk[CHUNK_HEADER + CHUNK_PAYLOAD] = {0};
+
+	while (queue_data(producer->stream, chunk, sizeof(chunk)))
+		producer->queued += sizeof(chunk);
+
+	producer->failed = true;
+	return NULL;
+}
+
+/* stopping without a timestamp must not wait for a peer that stopped
+ * reading, even with the producer blocked on a full buffer */
+static void stalled_peer_stop_test(void **state)
+{
+	struct rtmp_stream stream;
+	struct sink sink = {.stalled = true};
+	struct producer producer = {.stream = &stream};
+	pthread_t thread, producer_th;
+	uint64_t start_time, elapsed;
+
+	UNUSED_PARAMETER(state);
+
+	init_stream(&stream, connect_to_sink(&sink), 256 * 1024);
+
+	pthread_create(&thread, NULL, socket_thread_linux, &stream);
+	pthread_create(&producer_th, NULL, producer_thread, &producer);
+
+	/* wait for the socket and the write buffer to fill up */
+	for (int i = 0; i < 500; i++) {
+		pthread_mutex_lock(&stream.write_buf_mutex);
+		size_t free_space = write_buf_free_space(&stream);
+		pthread_mutex_unlock(&stream.write_buf_mutex);
+
+		if (free_space < CHUNK_HEADER + CHUNK_PAYLOAD)
+			break;
+		os_sleep_ms(10);
+	}
+	assert_false(producer.failed);
+
+	start_time = os_gettime_ns();
+
+	stream.stop_ts = 0;
+	os_event_signal(stream.stop_event);
+
+	pthread_join(producer_th, NULL);
+	os_event_signal(stream.send_thread_signaled_exit);
+	socket_thread_linux_wake(&stream);
+	pthread_join(thread, NULL);
+
+	elapsed = os_gettime_ns() - start_time;
+
+	assert_true(producer.failed);
+	assert_int_equal(stream.rtmp.m_sb.sb_socket, -1);
+	assert_true(elapsed < 2000000000ULL);
+
+	os_atomic_set_bool(&sink.done, true);
+	pthread_join(sink.thread, NULL);
+	close(sink.listen_fd);
+
+	free_stream(&stream);
+}
+
+static void ring_wrap_test(void **state)
+{
+	struct rtmp_stream stream = {0};
+	uint8_t data[6] = {1, 2, 3, 4, 5, 6};
+
+	UNUSED_PARAMETER(state);
+
+	stream.write_buf_size = 8;
+	stream.write_buf = bzalloc(8);
+	stream.write_buf_start = 5;
+	stream.write_buf_pinned = 2;
+
+	assert_int_equal(write_buf_free_space(&stream), 6);
+	write_buf_push(&stream, data, sizeof(data));
+
+	assert_int_equal(stream.write_buf_len, 6);
+	assert_int_equal(write_buf_free_space(&stream), 0);
+	assert_memory_equal(stream.write_buf + 5, data, 3);
+	assert_memory_equal(stream.write_buf, data + 3, 3);
+
+	bfree(stream.write_buf);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(ring_wrap_test),
+		cmocka_unit_test(loopback_test),
+		cmocka_unit_test(stalled_peer_stop_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
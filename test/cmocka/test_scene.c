@@ -0,0 +1,165 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <obs.h>
+#include <graphics/math-defs.h>
+#include <graphics/vec2.h>
+
+#define BOX_SIZE 16
+
+/* an input with a size and nothing to draw */
+static const char *box_get_name(void *type_data)
+{
+	UNUSED_PARAMETER(type_data);
+	return "Box";
+}
+
+static void *box_create(obs_data_t *settings, obs_source_t *source)
+{
+	UNUSED_PARAMETER(settings);
+	UNUSED_PARAMETER(source);
+	return bzalloc(1);
+}
+
+static uint32_t box_get_size(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return BOX_SIZE;
+}
+
+static void box_video_render(void *data, gs_effect_t *effect)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(effect);
+}
+
+static struct obs_source_info box_info = {
+	.id = "test_box",
+	.type = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_VIDEO,
+	.get_name = box_get_name,
+	.create = box_create,
+	.destroy = bfree,
+	.get_width = box_get_size,
+	.get_height = box_get_size,
+	.video_render = box_video_render,
+};
+
+static int setup(void **state)
+{
+	struct obs_video_info ovi = {
+		.graphics_module = NULL_GRAPHICS_MODULE,
+		.fps_num = 30,
+		.fps_den = 1,
+		.base_width = 64,
+		.base_height = 64,
+		.output_width = 64,
+		.output_height = 64,
+		.output_format = VIDEO_FORMAT_RGBA,
+		.colorspace = VIDEO_CS_709,
+		.range = VIDEO_RANGE_PARTIAL,
+		.scale_type = OBS_SCALE_BILINEAR,
+	};
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return -1;
+
+	obs_add_data_path(LIBOBS_DATA_PATH);
+	obs_register_source(&box_info);
+
+	if (obs_reset_video(&ovi) != OBS_VIDEO_SUCCESS) {
+		obs_shutdown();
+		return -1;
+	}
+
+	UNUSED_PARAMETER(state);
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	obs_shutdown();
+
+	UNUSED_PARAMETER(state);
+	return 0;
+}
+
+/* transforms are updated when the scene renders */
+static void render_scene(obs_scene_t *scene)
+{
+	obs_enter_graphics();
+	obs_source_video_render(obs_scene_get_source(scene));
+	obs_leave_graphics();
+}
+
+static bool hit(obs_sceneitem_t *item, float x, float y)
+{
+	struct vec2 pos;
+	vec2_set(&pos, x, y);
+	return obs_sceneitem_hit_test(item, &pos);
+}
+
+/* an item that is only added, never moved, must still be hit */
+static void add_hit_test(void **state)
+{
+	obs_scene_t *scene = obs_scene_create_private("scene");
+	obs_source_t *box =
+		obs_source_create_private("test_box", "box", NULL);
+	obs_sceneitem_t *item = obs_scene_add(scene, box);
+	struct vec2 min, max;
+
+	assert_non_null(item);
+	render_scene(scene);
+
+	obs_sceneitem_get_box_extents(item, &min, &max);
+	assert_true(close_float(min.x, 0.0f, 0.01f));
+	assert_true(close_float(min.y, 0.0f, 0.01f));
+	assert_true(close_float(max.x, (float)BOX_SIZE, 0.01f));
+	assert_true(close_float(max.y, (float)BOX_SIZE, 0.01f));
+
+	assert_true(hit(item, BOX_SIZE / 2, BOX_SIZE / 2));
+	assert_false(hit(item, BOX_SIZE * 2, BOX_SIZE / 2));
+
+	obs_source_release(box);
+	obs_scene_release(scene);
+
+	UNUSED_PARAMETER(state);
+}
+
+/* a group is hit where the items moved into it are */
+static void group_hit_test(void **state)
+{
+	obs_scene_t *scene = obs_scene_create_private("scene");
+	obs_source_t *box =
+		obs_source_create_private("test_box", "box", NULL);
+	obs_sceneitem_t *group = obs_scene_add_group(scene, "group");
+	obs_sceneitem_t *item = obs_scene_add(scene, box);
+	struct vec2 pos;
+
+	vec2_set(&pos, 32.0f, 32.0f);
+	obs_sceneitem_set_pos(item, &pos);
+	render_scene(scene);
+
+	obs_sceneitem_group_add_item(group, item);
+	render_scene(scene);
+
+	assert_true(hit(group, 32.0f + BOX_SIZE / 2, 32.0f + BOX_SIZE / 2));
+	assert_false(hit(group, BOX_SIZE / 2, BOX_SIZE / 2));
+
+	obs_source_release(box);
+	obs_scene_release(scene);
+
+	UNUSED_PARAMETER(state);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(add_hit_test),
+		cmocka_unit_test(group_hit_test),
+	};
+
+	return cmocka_run_group_tests(tests, setup, teardown);
+}
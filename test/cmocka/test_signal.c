@@ -0,0 +1,263 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <stdio.h>
+#include <callback/signal.h>
+#include <callback/proc.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+
+#define NUM_SIGNALS 40
+#define NUM_PROCS 100
+#define NUM_EMITS 1000000
+
+struct received {
+	size_t calls;
+	size_t global_calls;
+	const char *global_name;
+	void *ptr;
+	bool enabled;
+	long long count;
+	double level;
+	bool has_name;
+	char name[1024];
+	bool remove;
+};
+
+static void on_signal(void *data, calldata_t *cd)
+{
+	struct received *r = data;
+
+	r->calls++;
+	r->ptr = calldata_ptr(cd, "source");
+	r->enabled = calldata_bool(cd, "enabled");
+	r->count = calldata_int(cd, "count");
+	r->level = calldata_float(cd, "level");
+	/* the call data only lives as long as the signal */
+	const char *name = calldata_string(cd, "name");
+	r->has_name = name != NULL;
+	snprintf(r->name, sizeof(r->name), "%s", name ? name : "");
+
+	if (r->remove)
+		signal_handler_remove_current();
+}
+
+static void on_global(void *data, const char *name, calldata_t *cd)
+{
+	struct received *r = data;
+
+	r->global_calls++;
+	r->global_name = name;
+
+	UNUSED_PARAMETER(cd);
+}
+
+static const char *test_signals[] = {
+	"void plain(ptr source)",
+	"void typed(ptr source, bool enabled, int count, float level, "
+	"string name)",
+	NULL,
+};
+
+static void signal_test(void **state)
+{
+	signal_handler_t *handler = signal_handler_create();
+	struct received r = {0};
+	struct calldata cd;
+	uint8_t stack[128];
+	int source;
+
+	assert_true(signal_handler_add_array(handler, test_signals));
+	assert_false(signal_handler_add(handler, "void plain(ptr source)"));
+	assert_int_equal(signal_get_id("typed"), signal_get_id("typed"));
+	assert_int_not_equal(signal_get_id("typed"), signal_get_id("plain"));
+
+	/* nothing connected, nothing to call */
+	assert_false(signal_handler_has_callbacks(handler,
+						  signal_get_id("plain")));
+	signal_handler_signal_args(handler, signal_get_id("plain"), &source);
+
+	signal_handler_connect(handler, "typed", on_signal, &r);
+	signal_handler_connect(handler, "missing", on_signal, &r);
+	assert_true(signal_handler_has_callbacks(handler,
+						 signal_get_id("typed")));
+	assert_false(signal_handler_has_callbacks(handler,
+						  signal_get_id("plain")));
+
+	signal_handler_signal_args(handler, signal_get_id("typed"), &source,
+				   true, 42LL, 0.5, "name");
+	assert_int_equal(r.calls, 1);
+	assert_ptr_equal(r.ptr, &source);
+	assert_true(r.enabled);
+	assert_int_equal(r.count, 42);
+	assert_true(r.level == 0.5);
+	assert_string_equal(r.name, "name");
+
+	/* strings that do not fit the stack */
+	char long_name[1000];
+	memset(long_name, 'a', sizeof(long_name) - 1);
+	long_name[sizeof(long_name) - 1] = 0;
+
+	signal_handler_signal_args(handler, signal_get_id("typed"), NULL,
+				   false, -1LL, 0.0, long_name);
+	assert_int_equal(r.calls, 2);
+	assert_null(r.ptr);
+	assert_false(r.enabled);
+	assert_int_equal(r.count, -1);
+	assert_string_equal(r.name, long_name);
+
+	signal_handler_signal_args(handler, signal_get_id("typed"), NULL,
+				   false, 0LL, 0.0, NULL);
+	assert_false(r.has_name);
+
+	/* the same callback through call data, by name and by ID */
+	calldata_init_fixed(&cd, stack, sizeof(stack));
+	calldata_set_int(&cd, "count", 7);
+	signal_handler_signal(handler, "typed", &cd);
+	assert_int_equal(r.count, 7);
+
+	calldata_set_int(&cd, "count", 8);
+	signal_handler_signal_id(handler, signal_get_id("typed"), &cd);
+	assert_int_equal(r.count, 8);
+	assert_int_equal(r.calls, 5);
+
+	signal_handler_signal(handler, "unknown", &cd);
+	signal_handler_signal_id(handler, signal_get_id("unknown"), &cd);
+	assert_int_equal(r.calls, 5);
+
+	/* global callbacks see every signal, even without callbacks */
+	signal_handler_connect_global(handler, on_global, &r);
+	signal_handler_signal_args(handler, signal_get_id("plain"), &source);
+	assert_int_equal(r.global_calls, 1);
+	assert_string_equal(r.global_name, "plain");
+	signal_handler_disconnect_global(handler, on_global, &r);
+
+	/* removed from inside the callback */
+	r.remove = true;
+	signal_handler_signal_args(handler, signal_get_id("typed"), NULL,
+				   false, 0LL, 0.0, NULL);
+	assert_int_equal(r.calls, 6);
+	assert_false(signal_handler_has_callbacks(handler,
+						  signal_get_id("typed")));
+	signal_handler_signal_args(handler, signal_get_id("typed"), NULL,
+				   false, 0LL, 0.0, NULL);
+	assert_int_equal(r.calls, 6);
+
+	signal_handler_destroy(handler);
+
+	UNUSED_PARAMETER(state);
+}
+
+static void on_proc(void *data, calldata_t *cd)
+{
+	calldata_set_int(cd, "ret", (long long)(intptr_t)data);
+}
+
+static void proc_test(void **state)
+{
+	proc_handler_t *handler = proc_handler_create();
+	struct dstr decl = {0};
+	struct dstr name = {0};
+	struct calldata cd;
+	uint8_t stack[128];
+
+	for (intptr_t i = 0; i < NUM_PROCS; i++) {
+		dstr_printf(&decl, "void proc_%d(out int ret)", (int)i);
+		proc_handler_add(handler, decl.array, on_proc, (void *)i);
+	}
+
+	/* the first one added is called */
+	proc_handler_add(handler, "void proc_5(out int ret)", on_proc,
+			 (void *)(intptr_t)-1);
+
+	calldata_init_fixed(&cd, stack, sizeof(stack));
+
+	for (int i = 0; i < NUM_PROCS; i++) {
+		dstr_printf(&name, "proc_%d", i);
+		assert_true(proc_handler_call(handler, name.array, &cd));
+		assert_int_equal(calldata_int(&cd, "ret"), i);
+	}
+
+	assert_false(proc_handler_call(handler, "proc_100", &cd));
+	assert_false(proc_handler_call(handler, "proc", &cd));
+
+	dstr_free(&name);
+	dstr_free(&decl);
+	proc_handler_destroy(handler);
+
+	UNUSED_PARAMETER(state);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void count_signal(void *data, calldata_t *cd)
+{
+	(*(size_t *)data) += calldata_ptr(cd, "source") != NULL;
+}
+
+static double ns_per_emit(uint64_t start)
+{
+	return (double)(os_gettime_ns() - start) / NUM_EMITS;
+}
+
+/* a handler with as many signals as a source has, with a callback on the
+ * last one, like a volume meter on the volume of a source */
+static void dispatch_benchmark(void **state)
+{
+	signal_handler_t *handler = signal_handler_create();
+	signal_id_t id = signal_get_id("signal_39");
+	signal_id_t unused_id = signal_get_id("signal_0");
+	struct dstr decl = {0};
+	size_t calls = 0;
+	uint64_t start;
+	int source;
+
+	for (int i = 0; i < NUM_SIGNALS; i++) {
+		dstr_printf(&decl, "void signal_%d(ptr source)", i);
+		signal_handler_add(handler, decl.array);
+	}
+
+	signal_handler_connect(handler, "signal_39", count_signal, &calls);
+
+	start = os_gettime_ns();
+	for (int i = 0; i < NUM_EMITS; i++) {
+		struct calldata cd;
+		uint8_t stack[128];
+
+		calldata_init_fixed(&cd, stack, sizeof(stack));
+		calldata_set_ptr(&cd, "source", &source);
+		signal_handler_signal(handler, "signal_39", &cd);
+	}
+	printf("%.1f ns per signal by name with call data\n",
+	       ns_per_emit(start));
+
+	start = os_gettime_ns();
+	for (int i = 0; i < NUM_EMITS; i++)
+		signal_handler_signal_args(handler, id, &source);
+	printf("%.1f ns per signal by ID with arguments\n", ns_per_emit(start));
+
+	start = os_gettime_ns();
+	for (int i = 0; i < NUM_EMITS; i++)
+		signal_handler_signal_args(handler, unused_id, &source);
+	printf("%.1f ns per signal without callbacks\n", ns_per_emit(start));
+
+	assert_int_equal(calls, NUM_EMITS * 2);
+
+	dstr_free(&decl);
+	signal_handler_destroy(handler);
+
+	UNUSED_PARAMETER(state);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(signal_test),
+		cmocka_unit_test(proc_test),
+		cmocka_unit_test(dispatch_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
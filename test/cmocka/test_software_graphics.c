@@ -0,0 +1,159 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <graphics/graphics.h>
+#include <graphics/vec4.h>
+
+struct test_ctx {
+	graphics_t *graphics;
+	gs_effect_t *default_effect;
+	gs_effect_t *conversion_effect;
+	gs_texture_t *source;
+};
+
+static const uint32_t source_pixels[4] = {
+	0xFF0000FF, /* red */
+	0xFF00FF00, /* green */
+	0xFFFF0000, /* blue */
+	0xFFFFFFFF, /* white */
+};
+
+static int setup(void **state)
+{
+	struct test_ctx *ctx = bzalloc(sizeof(*ctx));
+	const uint8_t *data[1] = {(const uint8_t *)source_pixels};
+
+	if (gs_create(&ctx->graphics, NULL_GRAPHICS_MODULE, 0) !=
+	    GS_SUCCESS) {
+		bfree(ctx);
+		return -1;
+	}
+
+	gs_enter_context(ctx->graphics);
+	ctx->default_effect = gs_effect_create_from_file(
+		LIBOBS_DATA_PATH "default.effect", NULL);
+	ctx->conversion_effect = gs_effect_create_from_file(
+		LIBOBS_DATA_PATH "format_conversion.effect", NULL);
+	ctx->source = gs_texture_create(2, 2, GS_RGBA, 1, data, 0);
+
+	*state = ctx;
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct test_ctx *ctx = *state;
+
+	gs_texture_destroy(ctx->source);
+	gs_effect_destroy(ctx->default_effect);
+	gs_effect_destroy(ctx->conversion_effect);
+	gs_leave_context();
+	gs_destroy(ctx->graphics);
+	bfree(ctx);
+	return 0;
+}
+
+static void begin_target(gs_texture_t *target, uint32_t cx, uint32_t cy)
+{
+	struct vec4 clear_color;
+
+	vec4_zero(&clear_color);
+	gs_set_render_target(target, NULL);
+	gs_set_viewport(0, 0, cx, cy);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 1.0f, 0);
+	gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+}
+
+static void read_target(gs_texture_t *target, enum gs_color_format format,
+			uint32_t cx, uint32_t cy, uint8_t *out,
+			size_t pixel_size)
+{
+	gs_stagesurf_t *stage = gs_stagesurface_create(cx, cy, format);
+	uint8_t *data;
+	uint32_t linesize;
+
+	gs_stage_texture(stage, target);
+	assert_true(gs_stagesurface_map(stage, &data, &linesize));
+	for (uint32_t y = 0; y < cy; y++)
+		memcpy(out + y * cx * pixel_size, data + y * linesize,
+		       cx * pixel_size);
+	gs_stagesurface_unmap(stage);
+	gs_stagesurface_destroy(stage);
+}
+
+static void draw_sprite_test(void **state)
+{
+	struct test_ctx *ctx = *state;
+	gs_texture_t *target =
+		gs_texture_create(2, 2, GS_RGBA, 1, NULL, GS_RENDER_TARGET);
+	gs_effect_t *effect = ctx->default_effect;
+	uint32_t pixels[4];
+
+	assert_string_equal(gs_get_device_name(), "Software");
+	assert_int_equal(gs_get_device_type(), GS_DEVICE_SOFTWARE);
+
+	gs_begin_scene();
+	begin_target(target, 2, 2);
+	gs_enable_blending(false);
+
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"),
+			      ctx->source);
+	while (gs_effect_loop(effect, "Draw"))
+		gs_draw_sprite(ctx->source, 0, 2, 2);
+
+	gs_enable_blending(true);
+	gs_end_scene();
+
+	read_target(target, GS_RGBA, 2, 2, (uint8_t *)pixels,
+		    sizeof(uint32_t));
+	for (size_t i = 0; i < 4; i++)
+		assert_int_equal(pixels[i], source_pixels[i]);
+
+	gs_texture_destroy(target);
+}
+
+static void nv12_luma_test(void **state)
+{
+	struct test_ctx *ctx = *state;
+	gs_texture_t *target =
+		gs_texture_create(2, 2, GS_R8, 1, NULL, GS_RENDER_TARGET);
+	gs_effect_t *effect = ctx->conversion_effect;
+	struct vec4 color_vec0;
+	uint8_t luma[4];
+
+	vec4_set(&color_vec0, 0.2126f, 0.7152f, 0.0722f, 0.0f);
+
+	gs_begin_scene();
+	begin_target(target, 2, 2);
+	gs_enable_blending(false);
+
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"),
+			      ctx->source);
+	gs_effect_set_vec4(gs_effect_get_param_by_name(effect, "color_vec0"),
+			   &color_vec0);
+	while (gs_effect_loop(effect, "NV12_Y"))
+		gs_draw(GS_TRIS, 0, 3);
+
+	gs_enable_blending(true);
+	gs_end_scene();
+
+	read_target(target, GS_R8, 2, 2, luma, 1);
+	assert_int_equal(luma[0], 54);
+	assert_int_equal(luma[1], 182);
+	assert_int_equal(luma[2], 18);
+	assert_int_equal(luma[3], 255);
+
+	gs_texture_destroy(target);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(draw_sprite_test),
+		cmocka_unit_test(nv12_luma_test),
+	};
+
+	return cmocka_run_group_tests(tests, setup, teardown);
+}
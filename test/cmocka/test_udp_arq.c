@@ -0,0 +1,247 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#endif
+
+#include <util/array-serializer.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "udp-arq.h"
+#include "mpegts-mux.h"
+
+#define NUM_PACKETS 2000
+#define PACKET_INTERVAL_NS 250000ULL
+
+struct sink {
+	pthread_mutex_t mutex;
+	uint32_t received;
+	bool out_of_order;
+	bool corrupt;
+};
+
+static void fill_payload(uint8_t *data, uint32_t idx)
+{
+	memcpy(data, &idx, sizeof(idx));
+	memset(data + sizeof(idx), (int)(idx & 0xff),
+	       ARQ_PAYLOAD_SIZE - sizeof(idx));
+}
+
+static void sink_receive(void *param, const uint8_t *data, size_t size)
+{
+	struct sink *sink = param;
+	uint8_t expected[ARQ_PAYLOAD_SIZE];
+	uint32_t idx;
+
+	memcpy(&idx, data, sizeof(idx));
+
+	pthread_mutex_lock(&sink->mutex);
+	if (idx != sink->received)
+		sink->out_of_order = true;
+
+	fill_payload(expected, idx);
+	if (size != ARQ_PAYLOAD_SIZE || memcmp(data, expected, size) != 0)
+		sink->corrupt = true;
+
+	sink->received = idx + 1;
+	pthread_mutex_unlock(&sink->mutex);
+}
+
+static uint32_t sink_received(struct sink *sink)
+{
+	uint32_t received;
+
+	pthread_mutex_lock(&sink->mutex);
+	received = sink->received;
+	pthread_mutex_unlock(&sink->mutex);
+	return received;
+}
+
+/* sends NUM_PACKETS over loopback, paced like a ~40 mbps stream */
+static void run_loopback(struct arq_config *config, struct arq_stats *sent,
+			 struct arq_stats *received)
+{
+	struct arq_receiver *receiver;
+	struct arq_sender *sender;
+	uint8_t payload[ARQ_PAYLOAD_SIZE];
+	struct sink sink = {0};
+	uint64_t ts;
+
+	pthread_mutex_init(&sink.mutex, NULL);
+
+	receiver = arq_receiver_create(config, "127.0.0.1", 0, sink_receive,
+				       &sink);
+	assert_non_null(receiver);
+
+	sender = arq_sender_create(config, "127.0.0.1",
+				   arq_receiver_get_port(receiver));
+	assert_non_null(sender);
+
+	ts = os_gettime_ns();
+	for (uint32_t i = 0; i < NUM_PACKETS; i++) {
+		fill_payload(payload, i);
+		assert_true(arq_sender_send(sender, payload, sizeof(payload)));
+
+		ts += PACKET_INTERVAL_NS;
+		os_sleepto_ns(ts);
+	}
+
+	/* everything is delivered latency_ms after it was sent */
+	for (int i = 0; i < 300 && sink_received(&sink) < NUM_PACKETS; i++)
+		os_sleep_ms(10);
+
+	/* let one more ack report the final counters to the sender */
+	os_sleep_ms(50);
+
+	arq_sender_get_stats(sender, sent);
+	arq_receiver_get_stats(receiver, received);
+
+	arq_sender_destroy(sender);
+	arq_receiver_destroy(receiver);
+
+	assert_int_equal(sink.received, NUM_PACKETS);
+	assert_false(sink.out_of_order);
+	assert_false(sink.corrupt);
+
+	pthread_mutex_destroy(&sink.mutex);
+}
+
+static void no_loss_test(void **state)
+{
+	struct arq_config config = {.latency_ms = 50};
+	struct arq_stats sent, received;
+
+	UNUSED_PARAMETER(state);
+
+	run_loopback(&config, &sent, &received);
+
+	assert_int_equal(sent.packets, NUM_PACKETS);
+	assert_int_equal(sent.retransmitted, 0);
+	assert_int_equal(received.lost, 0);
+	assert_int_equal(received.packets, NUM_PACKETS);
+}
+
+static void retransmission_test(void **state)
+{
+	struct arq_config config = {
+		.latency_ms = 200,
+		.simulated_loss = 5.0,
+		.simulated_loss_seed = 1,
+	};
+	struct arq_stats sent, received;
+
+	UNUSED_PARAMETER(state);
+
+	run_loopback(&config, &sent, &received);
+
+	assert_true(sent.simulated_drops > 0);
+	assert_true(sent.naks > 0);
+	assert_true(sent.retransmitted >= sent.simulated_drops / 2);
+	assert_true(received.recovered_arq > 0);
+	assert_int_equal(received.lost, 0);
+
+	/* the sender sees what the receiver reported */
+	assert_int_equal(sent.lost, 0);
+	assert_int_equal(sent.recovered_arq, received.recovered_arq);
+}
+
+static void fec_test(void **state)
+{
+	struct arq_config config = {
+		.latency_ms = 200,
+		.fec_group = 10,
+		.simulated_loss = 1.0,
+		.simulated_loss_seed = 7,
+	};
+	struct arq_stats sent, received;
+
+	UNUSED_PARAMETER(state);
+
+	run_loopback(&config, &sent, &received);
+
+	assert_int_equal(sent.fec_packets, NUM_PACKETS / 10);
+	assert_true(received.fec_packets > 0);
+	assert_true(received.recovered_fec > 0);
+	assert_int_equal(received.lost, 0);
+}
+
+static void mpegts_test(void **state)
+{
+	struct array_output_data data;
+	struct serializer s;
+	struct mpegts_mux mux;
+	uint8_t frame[5000];
+	struct encoder_packet packet = {
+		.data = frame,
+		.size = sizeof(frame),
+		.type = OBS_ENCODER_VIDEO,
+		.timebase_num = 1,
+		.timebase_den = 30,
+		.keyframe = true,
+	};
+	uint8_t pat_cc = 0xff;
+
+	UNUSED_PARAMETER(state);
+
+	memset(frame, 0x11, sizeof(frame));
+	array_output_serializer_init(&s, &data);
+	mpegts_mux_init(&mux);
+
+	assert_int_equal(mpegts_mux_add_stream(&mux, MPEGTS_CODEC_H264, NULL,
+					       0, 0),
+			 0);
+	assert_int_equal(mpegts_mux_add_stream(&mux, MPEGTS_CODEC_AAC, NULL,
+					       0, 2),
+			 1);
+
+	for (int i = 0; i < 3; i++) {
+		packet.pts = packet.dts = i;
+		mpegts_mux_packet(&mux, 0, &packet, &s);
+	}
+
+	assert_int_equal(data.bytes.num % MPEGTS_PACKET_SIZE, 0);
+
+	/* a PAT precedes every keyframe, with a running continuity counter */
+	for (size_t i = 0; i < data.bytes.num; i += MPEGTS_PACKET_SIZE) {
+		const uint8_t *ts = data.bytes.array + i;
+		uint16_t pid = (uint16_t)(((ts[1] & 0x1f) << 8) | ts[2]);
+
+		assert_int_equal(ts[0], 0x47);
+		if (pid == 0) {
+			assert_int_equal(ts[3] & 0x0f, (pat_cc + 1) & 0x0f);
+			pat_cc = ts[3] & 0x0f;
+		}
+	}
+	assert_int_equal(pat_cc, 2);
+
+	mpegts_mux_free(&mux);
+	array_output_serializer_free(&data);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(no_loss_test),
+		cmocka_unit_test(retransmission_test),
+		cmocka_unit_test(fec_test),
+		cmocka_unit_test(mpegts_test),
+	};
+	int ret;
+
+#ifdef _WIN32
+	WSADATA wsad;
+	WSAStartup(MAKEWORD(2, 2), &wsad);
+#endif
+
+	ret = cmocka_run_group_tests(tests, NULL, NULL);
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	return ret;
+}